@@ -0,0 +1,150 @@
+/** @file
+ * VirtualBox shared framebuffer - layout of the shared memory segment which
+ * VBoxHeadless --shared-framebuffer exports for external consumers.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+#ifndef ___VBox_VBoxSharedFB_h
+#define ___VBox_VBoxSharedFB_h
+
+#include <iprt/types.h>
+#include <iprt/assert.h>
+
+/** @defgroup grp_vbox_sharedfb     Shared Framebuffer
+ *
+ * One segment is created per guest screen.  The name is the one given on the
+ * command line with "-<screen>" appended, e.g. "vm1-0".  On POSIX hosts this
+ * is a shm_open() object called "/vm1-0", on Windows a file mapping called
+ * "Local\vm1-0".  The segment starts with a VBOXSHAREDFBHDR, followed by the
+ * pixels at VBOXSHAREDFBHDR::offPixels.  Pixels are always 32 bpp BGRX.
+ *
+ * Only the VM process writes to the segment, consumers map it read-only.
+ * Everything is lock free:
+ *
+ *  - Geometry: VBOXSHAREDFBHDR::u32ModeSeq is odd while the geometry fields
+ *    are being changed.  Read it, read the geometry, read it again; retry if
+ *    it was odd or has changed.  A changed mode sequence means the whole
+ *    frame has to be read again.
+ *
+ *  - Damage: the writer copies the pixels of an update first and then
+ *    publishes the rectangle.  Rectangle number n (counting from 0) is stored
+ *    in aDamage[n % VBOXSHAREDFB_DAMAGE_ENTRIES] with u64Generation = n + 1,
+ *    after which VBOXSHAREDFBHDR::u64Generation is set to n + 1.  A consumer
+ *    that has seen everything up to generation g reads the rectangles g to
+ *    u64Generation - 1.  Each entry is read like the geometry: the entry's
+ *    generation before and after reading the rectangle must both be the
+ *    expected one, otherwise the ring has wrapped and the consumer falls back
+ *    to reading the whole frame.
+ *
+ * Pixels can change while a consumer reads them, but every such change is
+ * followed by a damage rectangle covering it, so a consumer that keeps up
+ * with the ring always ends up with the current content.
+ *
+ * @{
+ */
+
+/** Magic value of VBOXSHAREDFBHDR::u32Magic ('VBSF'). */
+#define VBOXSHAREDFB_MAGIC              UINT32_C(0x46534256)
+/** Current layout version, the major version is in the upper 16 bits. */
+#define VBOXSHAREDFB_VERSION            UINT32_C(0x00010000)
+/** Number of entries in the damage ring (power of two). */
+#define VBOXSHAREDFB_DAMAGE_ENTRIES     256
+
+/** @name VBOXSHAREDFBHDR::fFlags
+ * @{ */
+/** The screen is disabled or has no content, the pixel area is not updated. */
+#define VBOXSHAREDFB_F_BLANK            RT_BIT_32(0)
+/** The current mode does not fit into the pixel area, which is not updated. */
+#define VBOXSHAREDFB_F_TOO_BIG          RT_BIT_32(1)
+/** The writer has shut down, no further updates will come. */
+#define VBOXSHAREDFB_F_TERMINATED       RT_BIT_32(2)
+/** @} */
+
+/**
+ * A damage ring entry.
+ */
+typedef struct VBOXSHAREDFBDAMAGE
+{
+    /** The generation this rectangle was published as, 0 while the entry is
+     * being written. */
+    volatile uint64_t   u64Generation;
+    /** Left edge in pixels. */
+    volatile uint32_t   x;
+    /** Top edge in pixels. */
+    volatile uint32_t   y;
+    /** Width in pixels. */
+    volatile uint32_t   cx;
+    /** Height in pixels. */
+    volatile uint32_t   cy;
+} VBOXSHAREDFBDAMAGE;
+AssertCompileSize(VBOXSHAREDFBDAMAGE, 24);
+/** Pointer to a damage ring entry. */
+typedef VBOXSHAREDFBDAMAGE volatile *PVBOXSHAREDFBDAMAGE;
+
+/**
+ * The header at the start of the shared framebuffer segment.
+ */
+typedef struct VBOXSHAREDFBHDR
+{
+    /** VBOXSHAREDFB_MAGIC. */
+    uint32_t            u32Magic;
+    /** VBOXSHAREDFB_VERSION. */
+    uint32_t            u32Version;
+    /** Offset of the pixels from the start of the segment (page aligned). */
+    uint32_t            offPixels;
+    /** Size of the pixel area in bytes, the upper limit for cbLine * cy. */
+    uint32_t            cbPixels;
+    /** The guest screen this segment shows. */
+    uint32_t            uScreenId;
+    /** The process id of the VM process. */
+    uint32_t            uWriterPid;
+
+    /** Mode sequence number, odd while the fields below change. */
+    volatile uint32_t   u32ModeSeq;
+    /** VBOXSHAREDFB_F_XXX. */
+    volatile uint32_t   fFlags;
+    /** Width in pixels. */
+    volatile uint32_t   cx;
+    /** Height in pixels. */
+    volatile uint32_t   cy;
+    /** Bytes per scanline in the pixel area. */
+    volatile uint32_t   cbLine;
+    /** Bits per pixel, always 32. */
+    volatile uint32_t   cBitsPerPixel;
+    /** Screen origin in the guest desktop. */
+    volatile int32_t    xOrigin;
+    /** Screen origin in the guest desktop. */
+    volatile int32_t    yOrigin;
+
+    /** Number of damage rectangles published so far. */
+    volatile uint64_t   u64Generation;
+    /** The damage ring. */
+    VBOXSHAREDFBDAMAGE  aDamage[VBOXSHAREDFB_DAMAGE_ENTRIES];
+} VBOXSHAREDFBHDR;
+AssertCompileMemberAlignment(VBOXSHAREDFBHDR, u64Generation, 8);
+/** Pointer to the shared framebuffer header. */
+typedef VBOXSHAREDFBHDR volatile *PVBOXSHAREDFBHDR;
+
+/** @} */
+
+#endif
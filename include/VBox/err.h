@@ -1993,6 +1993,9 @@
 /** The size of the one or more regions in the shared module was out of
  * range. */
 #define VERR_GMM_SHARED_MODULE_BAD_REGIONS_SIZE     (-3831)
+/** The memory given to GMMR0SeedLargePage isn't backed by a single
+ * physically contiguous and aligned large page. */
+#define VERR_GMM_SEED_NOT_LARGE_PAGE                (-3832)
 /** @} */
 
 
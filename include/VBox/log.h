@@ -157,6 +157,8 @@ typedef enum LOGGROUP
     LOG_GROUP_DEV_VIRTIO,
     /** Virtio Network Device group. */
     LOG_GROUP_DEV_VIRTIO_NET,
+    /** Virtio SCSI Device group. */
+    LOG_GROUP_DEV_VIRTIO_SCSI,
     /** VMM Device group. */
     LOG_GROUP_DEV_VMM,
     /** VMM Device group for backdoor logging. */
@@ -775,6 +777,8 @@ typedef enum LOGGROUP
     LOG_GROUP_VD_VHDX,
     /** VMDK virtual disk backend. */
     LOG_GROUP_VD_VMDK,
+    /** VWC write-back cache backend. */
+    LOG_GROUP_VD_VWC,
     /** VM group. */
     LOG_GROUP_VM,
     /** VMM group. */
@@ -857,6 +861,7 @@ typedef enum LOGGROUP
     "DEV_VGA",      \
     "DEV_VIRTIO",   \
     "DEV_VIRTIO_NET", \
+    "DEV_VIRTIO_SCSI", \
     "DEV_VMM",      \
     "DEV_VMM_BACKDOOR", \
     "DEV_VMM_STDERR", \
@@ -1166,6 +1171,7 @@ typedef enum LOGGROUP
     "VD_VHD",       \
     "VD_VHDX",      \
     "VD_VMDK",      \
+    "VD_VWC",       \
     "VM",           \
     "VMM",          \
     "VRDE",         \
@@ -304,6 +304,64 @@ typedef struct VDCACHEBACKEND
      *  VD_CAP_FILE and NULL otherwise. */
     DECLR3CALLBACKMEMBER(int, pfnComposeName, (PVDINTERFACE pConfig, char **pszName));
 
+    /**
+     * Start a write-back request. The data is stored in the cache and marked
+     * dirty, it is written to the image later using pfnDirtyRead and
+     * pfnDirtyClear. NULL if the backend supports write-through caching only.
+     *
+     * @returns VBox status code.
+     * @retval  VERR_VD_BLOCK_FREE if there is no room for the range in the cache.
+     *          pcbWriteProcess holds the number of bytes which must be written
+     *          to the image instead.
+     * @param   pBackendData    Opaque state data for this image.
+     * @param   uOffset         The offset of the virtual disk to write to.
+     * @param   cbToWrite       How many bytes to write.
+     * @param   pIoCtx          I/O context associated with this request.
+     * @param   pcbWriteProcess Pointer to returned number of bytes that could
+     *                          be processed.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnWriteBack, (void *pBackendData, uint64_t uOffset, size_t cbToWrite,
+                                             PVDIOCTX pIoCtx, size_t *pcbWriteProcess));
+
+    /**
+     * Reads the next range of dirty data, synchronously.
+     *
+     * @returns VBox status code.
+     * @retval  VERR_NOT_FOUND if there is no dirty data at or after uOffset.
+     * @param   pBackendData    Opaque state data for this image.
+     * @param   uOffset         The offset of the virtual disk to start searching at.
+     * @param   pvBuf           Where to store the dirty data.
+     * @param   cbBuf           Size of the buffer, limits the returned range.
+     * @param   puOffsetDirty   Where to store the virtual disk offset of the data.
+     * @param   pcbDirty        Where to store the number of bytes returned.
+     * @param   puToken         Where to store the token to pass to pfnDirtyClear.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnDirtyRead, (void *pBackendData, uint64_t uOffset, void *pvBuf, size_t cbBuf,
+                                             uint64_t *puOffsetDirty, size_t *pcbDirty, uint64_t *puToken));
+
+    /**
+     * Marks a range returned by pfnDirtyRead clean after it was written to the
+     * image and the image was flushed. The range stays dirty if it was written
+     * again in the meantime.
+     *
+     * @returns VBox status code.
+     * @param   pBackendData    Opaque state data for this image.
+     * @param   uOffset         The offset returned by pfnDirtyRead.
+     * @param   cbClear         The size returned by pfnDirtyRead.
+     * @param   uToken          The token returned by pfnDirtyRead.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnDirtyClear, (void *pBackendData, uint64_t uOffset, size_t cbClear, uint64_t uToken));
+
+    /**
+     * Evicts clean data to make room for new writes. The space is available
+     * after the next flush.
+     *
+     * @returns VBox status code.
+     * @param   pBackendData    Opaque state data for this image.
+     * @param   pcbDirty        Where to store the number of dirty bytes in the cache.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnReclaim, (void *pBackendData, uint64_t *pcbDirty));
+
     /** Initialization safty marker. */
     uint32_t            u32VersionEnd;
 
@@ -314,6 +372,6 @@ typedef VDCACHEBACKEND *PVDCACHEBACKEND;
 typedef const VDCACHEBACKEND *PCVDCACHEBACKEND;
 
 /** The current version of the VDCACHEBACKEND structure. */
-#define VD_CACHEBACKEND_VERSION                 VD_VERSION_MAKE(0xff03, 1, 0)
+#define VD_CACHEBACKEND_VERSION                 VD_VERSION_MAKE(0xff03, 2, 0)
 
 #endif
@@ -235,6 +235,20 @@ typedef struct VDINTERFACEIOINT
                                                      PVDINTERFACEPROGRESS pIfProgress,
                                                      unsigned uPercentStart, unsigned uPercentSpan));
 
+    /**
+     * Deallocates the given range of the storage, leaving a hole which reads
+     * back as zeros. This is a synchronous operation.
+     *
+     * @return  VBox status code.
+     * @retval  VERR_NOT_SUPPORTED if the storage doesn't support punching holes.
+     * @param   pvUser          The opaque data passed on container creation.
+     * @param   pStorage        The storage handle.
+     * @param   off             Start offset of the range to deallocate.
+     * @param   cb              Size of the range in bytes.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnPunchHole, (void *pvUser, PVDIOSTORAGE pStorage,
+                                             uint64_t off, uint64_t cb));
+
     /**
      * Initiate a read request for user data.
      *
@@ -520,6 +534,14 @@ DECLINLINE(int) vdIfIoIntFileSetAllocationSize(PVDINTERFACEIOINT pIfIoInt, PVDIO
                                           pIfProgress, uPercentStart, uPercentSpan);
 }
 
+DECLINLINE(int) vdIfIoIntFilePunchHole(PVDINTERFACEIOINT pIfIoInt, PVDIOSTORAGE pStorage,
+                                       uint64_t off, uint64_t cb)
+{
+    if (!pIfIoInt->pfnPunchHole)
+        return VERR_NOT_SUPPORTED;
+    return pIfIoInt->pfnPunchHole(pIfIoInt->Core.pvUser, pStorage, off, cb);
+}
+
 DECLINLINE(int) vdIfIoIntFileWriteSync(PVDINTERFACEIOINT pIfIoInt, PVDIOSTORAGE pStorage,
                                        uint64_t uOffset, const void *pvBuffer, size_t cbBuffer)
 {
@@ -543,6 +543,22 @@ typedef struct VDINTERFACEIO
     DECLR3CALLBACKMEMBER(int, pfnFlushAsync, (void *pvUser, void *pvStorage,
                                               void *pvCompletion, void **ppTask));
 
+    /**
+     * Deallocates the given range of the storage, leaving a hole which reads
+     * back as zeros. Optional, synchronous.
+     *
+     * @return  VBox status code.
+     * @retval  VERR_NOT_SUPPORTED if the storage doesn't support punching holes.
+     * @param   pvUser          The opaque data passed on container creation.
+     * @param   pvStorage       The storage handle.
+     * @param   off             Start offset of the range to deallocate.
+     * @param   cb              Size of the range in bytes.
+     *
+     * @note There must be no outstanding requests for the given range.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnPunchHole, (void *pvUser, void *pvStorage,
+                                             uint64_t off, uint64_t cb));
+
 } VDINTERFACEIO, *PVDINTERFACEIO;
 
 /**
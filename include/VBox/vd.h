@@ -252,8 +252,15 @@ typedef struct VBOXHDDRAW
  * can lead to corrupted images in read-write mode.
  */
 #define VD_OPEN_FLAGS_SKIP_CONSISTENCY_CHECKS  RT_BIT(10)
+/**
+ * Use the cache in write-back mode, i.e. writes are completed once they are
+ * in the cache and are written to the image later by VDCacheDestage.
+ * Only valid for VDCacheOpen and VDCreateCache and only if the cache backend
+ * supports it. The cache must be opened read/write.
+ */
+#define VD_OPEN_FLAGS_CACHE_WRITE_BACK  RT_BIT(11)
 /** Mask of valid flags. */
-#define VD_OPEN_FLAGS_MASK          (VD_OPEN_FLAGS_NORMAL | VD_OPEN_FLAGS_READONLY | VD_OPEN_FLAGS_HONOR_ZEROES | VD_OPEN_FLAGS_HONOR_SAME | VD_OPEN_FLAGS_INFO | VD_OPEN_FLAGS_ASYNC_IO | VD_OPEN_FLAGS_SHAREABLE | VD_OPEN_FLAGS_SEQUENTIAL | VD_OPEN_FLAGS_DISCARD | VD_OPEN_FLAGS_IGNORE_FLUSH | VD_OPEN_FLAGS_INFORM_ABOUT_ZERO_BLOCKS | VD_OPEN_FLAGS_SKIP_CONSISTENCY_CHECKS)
+#define VD_OPEN_FLAGS_MASK          (VD_OPEN_FLAGS_NORMAL | VD_OPEN_FLAGS_READONLY | VD_OPEN_FLAGS_HONOR_ZEROES | VD_OPEN_FLAGS_HONOR_SAME | VD_OPEN_FLAGS_INFO | VD_OPEN_FLAGS_ASYNC_IO | VD_OPEN_FLAGS_SHAREABLE | VD_OPEN_FLAGS_SEQUENTIAL | VD_OPEN_FLAGS_DISCARD | VD_OPEN_FLAGS_IGNORE_FLUSH | VD_OPEN_FLAGS_INFORM_ABOUT_ZERO_BLOCKS | VD_OPEN_FLAGS_SKIP_CONSISTENCY_CHECKS | VD_OPEN_FLAGS_CACHE_WRITE_BACK)
 /** @}*/
 
 /** @name VBox HDD container filter flags
@@ -494,6 +501,31 @@ typedef VDGEOMETRY *PVDGEOMETRY;
 /** Pointer to constant disk geometry. */
 typedef const VDGEOMETRY *PCVDGEOMETRY;
 
+/**
+ * Cache statistics, see VDCacheQueryStatistics.
+ */
+typedef struct VDCACHESTATS
+{
+    /** Number of reads served from the cache. */
+    uint64_t    cReadHits;
+    /** Number of reads which had to go to the image chain. */
+    uint64_t    cReadMisses;
+    /** Number of bytes read from the cache. */
+    uint64_t    cbReadHit;
+    /** Number of bytes read from the image chain. */
+    uint64_t    cbReadMiss;
+    /** Number of bytes written to the cache in write-back mode. */
+    uint64_t    cbWriteBack;
+    /** Number of bytes written directly to the image because the cache was full. */
+    uint64_t    cbWriteThrough;
+    /** Number of dirty bytes written from the cache to the image. */
+    uint64_t    cbDestaged;
+    /** Number of dirty bytes currently in the cache. */
+    uint64_t    cbDirty;
+} VDCACHESTATS;
+/** Pointer to cache statistics. */
+typedef VDCACHESTATS *PVDCACHESTATS;
+
 /**
  * VBox HDD Container main structure.
  */
@@ -981,6 +1013,33 @@ VBOXDDU_DECL(int) VDFilterRemove(PVBOXHDD pDisk, uint32_t fFlags);
  */
 VBOXDDU_DECL(int) VDCacheClose(PVBOXHDD pDisk, bool fDelete);
 
+/**
+ * Writes dirty data from a write-back cache to the last image in the chain.
+ *
+ * The written data is flushed to the image before it is marked clean in the
+ * cache. Afterwards rarely used clean data is evicted to make room for new
+ * writes. Does nothing for caches which are not in write-back mode.
+ *
+ * @return  VBox status code.
+ * @return  VERR_VD_CACHE_NOT_FOUND if no cache is opened in HDD container.
+ * @param   pDisk           Pointer to HDD container.
+ * @param   cbMax           Maximum number of bytes to write before returning,
+ *                          UINT64_MAX to write everything.
+ * @param   pcbDirtyLeft    Where to store the number of dirty bytes remaining
+ *                          in the cache, optional.
+ */
+VBOXDDU_DECL(int) VDCacheDestage(PVBOXHDD pDisk, uint64_t cbMax, uint64_t *pcbDirtyLeft);
+
+/**
+ * Queries the statistics of the cache attached to the HDD container.
+ *
+ * @return  VBox status code.
+ * @return  VERR_VD_CACHE_NOT_FOUND if no cache is opened in HDD container.
+ * @param   pDisk           Pointer to HDD container.
+ * @param   pStats          Where to store the statistics.
+ */
+VBOXDDU_DECL(int) VDCacheQueryStatistics(PVBOXHDD pDisk, PVDCACHESTATS pStats);
+
 /**
  * Closes all opened image files in HDD container.
  *
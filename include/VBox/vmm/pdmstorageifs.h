@@ -619,6 +619,27 @@ typedef struct PDMIMEDIAEXPORT
                                                   void *pvIoReqAlloc, uint32_t offSrc, PRTSGBUF pSgBuf,
                                                   size_t cbCopy));
 
+    /**
+     * Queries the memory of the caller backing the data buffer of the given request for direct access,
+     * avoiding the copy through an intermediate buffer.
+     *
+     * @returns VBox status code.
+     * @retval  VERR_NOT_SUPPORTED if the buffer can't be accessed directly for this request (MMIO,
+     *          unaligned segments, etc.). The callee falls back to PDMIMEDIAEXPORT::pfnIoReqCopyToBuf
+     *          and PDMIMEDIAEXPORT::pfnIoReqCopyFromBuf then.
+     * @param   pInterface      Pointer to the interface structure containing the called function pointer.
+     * @param   hIoReq          The I/O request handle.
+     * @param   pvIoReqAlloc    The allocator specific memory for this request.
+     * @param   ppaSegs         Where to store the pointer to the array of segments on success.
+     * @param   pcSegs          Where to store the number of segments on success.
+     *
+     * @note Optional, NULL if not supported at all. On success the segments cover the whole transfer
+     *       and stay valid until the request completes (PDMIMEDIAEXPORT::pfnIoReqCompleteNotify or the
+     *       synchronous return of the submit method).
+     */
+    DECLR3CALLBACKMEMBER(int, pfnIoReqQueryBuf, (PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                 void *pvIoReqAlloc, PCRTSGSEG *ppaSegs, unsigned *pcSegs));
+
     /**
      * Queries the specified amount of ranges to discard from the callee for the given I/O request.
      *
@@ -659,7 +680,7 @@ typedef struct PDMIMEDIAEXPORT
 } PDMIMEDIAEXPORT;
 
 /** PDMIMEDIAAEXPORT interface ID. */
-#define PDMIMEDIAEXPORT_IID                  "e0a586a6-4186-40d0-8067-c754b6585b53"
+#define PDMIMEDIAEXPORT_IID                  "57627361-8e0a-45fb-8b28-3b61a45a25db"
 
 
 /** Pointer to an extended media interface. */
@@ -407,6 +407,8 @@ typedef enum VMMR0OPERATION
     VMMR0_DO_PGM_FLUSH_HANDY_PAGES,
     /** Call PGMR0AllocateLargePage(). */
     VMMR0_DO_PGM_ALLOCATE_LARGE_HANDY_PAGE,
+    /** Call PGMR0PhysSeedLargeHandyPage(). */
+    VMMR0_DO_PGM_SEED_LARGE_HANDY_PAGE,
     /** Call PGMR0PhysSetupIommu(). */
     VMMR0_DO_PGM_PHYS_SETUP_IOMMU,
 
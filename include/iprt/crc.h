@@ -181,6 +181,20 @@ RTDECL(uint32_t)    RTCrc32CStart(void);
  */
 RTDECL(uint32_t)    RTCrc32CProcess(uint32_t uCRC32C, const void *pv, size_t cb);
 
+/**
+ * Processes a data block for each of several independent CRC-32C calculations.
+ *
+ * This is faster than calling RTCrc32CProcess for each block when the CPU
+ * supports the SSE4.2 CRC32 instruction, as the streams are interleaved.
+ *
+ * @param   pauCRC32C   Array of @a cBufs intermediate CRC-32C values which are
+ *                      updated.
+ * @param   papvBufs    Array of @a cBufs pointers to the data blocks.
+ * @param   pacbBufs    Array of @a cBufs data block sizes in bytes.
+ * @param   cBufs       Number of CRC-32C calculations.
+ */
+RTDECL(void)        RTCrc32CProcessMulti(uint32_t *pauCRC32C, void const * const *papvBufs, size_t const *pacbBufs, size_t cBufs);
+
 /**
  * Complete a multiblock CRC-32 calculation.
  *
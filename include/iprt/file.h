@@ -1156,6 +1156,22 @@ RTDECL(void) RTFileReadAllFree(void *pvFile, size_t cbFile);
  */
 RTDECL(int) RTFileSetAllocationSize(RTFILE hFile, uint64_t cbSize, uint32_t fFlags);
 
+/**
+ * Deallocates the blocks backing the given range of the file, leaving a hole
+ * which reads back as zeros.  The file size is not changed.
+ *
+ * @returns IPRT status code.
+ * @retval  VERR_NOT_SUPPORTED if the host or the filesystem the file resides
+ *                             on doesn't support punching holes.
+ * @param   hFile           The handle to the file.
+ * @param   off             Start offset of the range to deallocate.
+ * @param   cb              Size of the range in bytes.
+ *
+ * @remarks The filesystem might only be able to deallocate whole blocks, the
+ *          partial blocks at the edges of the range are zeroed instead.
+ */
+RTDECL(int) RTFilePunchHole(RTFILE hFile, uint64_t off, uint64_t cb);
+
 #ifdef IN_RING3
 
 /** @page pg_rt_asyncio RT File async I/O API
@@ -609,6 +609,7 @@
 # define RTCrc32C                                       RT_MANGLER(RTCrc32C)
 # define RTCrc32CFinish                                 RT_MANGLER(RTCrc32CFinish)
 # define RTCrc32CProcess                                RT_MANGLER(RTCrc32CProcess)
+# define RTCrc32CProcessMulti                           RT_MANGLER(RTCrc32CProcessMulti)
 # define RTCrc32CStart                                  RT_MANGLER(RTCrc32CStart)
 # define RTCrc64                                        RT_MANGLER(RTCrc64)
 # define RTCrc64Finish                                  RT_MANGLER(RTCrc64Finish)
@@ -878,6 +879,7 @@
 # define RTFileOpenF                                    RT_MANGLER(RTFileOpenF)
 # define RTFileOpenV                                    RT_MANGLER(RTFileOpenV)
 # define RTFileOpenTemp                                 RT_MANGLER(RTFileOpenTemp)
+# define RTFilePunchHole                                RT_MANGLER(RTFilePunchHole)
 # define RTFileQueryFsSizes                             RT_MANGLER(RTFileQueryFsSizes)
 # define RTFileQueryInfo                                RT_MANGLER(RTFileQueryInfo)
 # define RTFileQuerySize                                RT_MANGLER(RTFileQuerySize)
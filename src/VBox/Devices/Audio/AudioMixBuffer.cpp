@@ -41,6 +41,9 @@
 #endif
 #include <iprt/mem.h>
 #include <iprt/string.h> /* For RT_BZERO. */
+#ifdef RT_ARCH_AMD64
+# include <emmintrin.h>
+#endif
 
 #ifdef VBOX_AUDIO_TESTCASE
 # define LOG_ENABLED
@@ -484,6 +487,276 @@ AUDMIXBUF_CONVERT(U32 /* Name */, uint32_t, 0         /* Min */, UINT32_MAX /* M
 
 #undef AUDMIXBUF_CONVERT
 
+/*
+ * 32-bit float, where [-1.0, 1.0) maps onto the 32-bit signed range.  Values
+ * outside are saturated, NaNs are turned into silence.
+ */
+
+/** Converts a float value to the 32-bit signed range (like audioMixBufClipFromS32 does). */
+DECLINLINE(int32_t) audioMixBufClipFromF32(float rVal)
+{
+    float const r = rVal * 2147483648.0f;
+    if (r >= 2147483648.0f)
+        return INT32_MAX;
+    if (r >= -2147483648.0f)
+        return (int32_t)r;
+    if (r < -2147483648.0f)
+        return INT32_MIN;
+    return 0; /* NaN */
+}
+
+/** Converts a single sample value to float. */
+DECLINLINE(float) audioMixBufClipToF32(int64_t iVal)
+{
+    return (float)audioMixBufClipToS32(iVal) * (1.0f / 2147483648.0f);
+}
+
+static DECLCALLBACK(uint32_t) audioMixBufConvFromF32Stereo(PPDMAUDIOSAMPLE paDst, const void *pvSrc, uint32_t cbSrc,
+                                                           PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    float const *pSrc = (float const *)pvSrc;
+    uint32_t const cSamples = RT_MIN(pOpts->cSamples, cbSrc / sizeof(float));
+    for (uint32_t i = 0; i < cSamples; i++)
+    {
+        paDst->i64LSample = ASMMult2xS32RetS64(audioMixBufClipFromF32(*pSrc++), pOpts->From.Volume.uLeft ) >> AUDIOMIXBUF_VOL_SHIFT;
+        paDst->i64RSample = ASMMult2xS32RetS64(audioMixBufClipFromF32(*pSrc++), pOpts->From.Volume.uRight) >> AUDIOMIXBUF_VOL_SHIFT;
+        paDst++;
+    }
+    return cSamples;
+}
+
+static DECLCALLBACK(uint32_t) audioMixBufConvFromF32Mono(PPDMAUDIOSAMPLE paDst, const void *pvSrc, uint32_t cbSrc,
+                                                         PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    float const *pSrc = (float const *)pvSrc;
+    uint32_t const cSamples = RT_MIN(pOpts->cSamples, cbSrc / sizeof(float));
+    for (uint32_t i = 0; i < cSamples; i++)
+    {
+        int32_t const iVal = audioMixBufClipFromF32(*pSrc++);
+        paDst->i64LSample = ASMMult2xS32RetS64(iVal, pOpts->From.Volume.uLeft ) >> AUDIOMIXBUF_VOL_SHIFT;
+        paDst->i64RSample = ASMMult2xS32RetS64(iVal, pOpts->From.Volume.uRight) >> AUDIOMIXBUF_VOL_SHIFT;
+        paDst++;
+    }
+    return cSamples;
+}
+
+static DECLCALLBACK(void) audioMixBufConvToF32Stereo(void *pvDst, PCPDMAUDIOSAMPLE paSrc, PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    float *pDst = (float *)pvDst;
+    for (uint32_t i = 0; i < pOpts->cSamples; i++)
+    {
+        *pDst++ = audioMixBufClipToF32(paSrc[i].i64LSample);
+        *pDst++ = audioMixBufClipToF32(paSrc[i].i64RSample);
+    }
+}
+
+static DECLCALLBACK(void) audioMixBufConvToF32Mono(void *pvDst, PCPDMAUDIOSAMPLE paSrc, PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    float *pDst = (float *)pvDst;
+    for (uint32_t i = 0; i < pOpts->cSamples; i++)
+        *pDst++ = audioMixBufClipToF32((paSrc[i].i64LSample + paSrc[i].i64RSample) / 2);
+}
+
+#ifdef RT_ARCH_AMD64
+/*
+ * SSE2 versions of the stereo S16 and S32 converters, which is what the
+ * emulated devices and the host backends use almost exclusively.  They give
+ * exactly the same results as the generic ones above and fall back to them
+ * for the remainder and for the cases they don't handle.
+ */
+
+/**
+ * Saturates four int64 values (two samples) in each of @a a and @a b to int32,
+ * which is what audioMixBufClipToS32 does and what audioMixBufClipToS16 does
+ * before the shift.
+ */
+DECLINLINE(__m128i) audioMixBufSse2ClipToS32(__m128i a, __m128i b)
+{
+    __m128i const uLo = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i const uHi = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+    /* In range if the upper half is just the sign extension of the lower one. */
+    __m128i const fInRange = _mm_cmpeq_epi32(uHi, _mm_srai_epi32(uLo, 31));
+    /* INT32_MAX for positive, INT32_MIN for negative values. */
+    __m128i const iSat = _mm_xor_si128(_mm_srai_epi32(uHi, 31), _mm_set1_epi32(INT32_MAX));
+    return _mm_or_si128(_mm_and_si128(fInRange, uLo), _mm_andnot_si128(fInRange, iSat));
+}
+
+/** Sign extends the four int32 values in @a i and stores them as two samples at @a paDst. */
+DECLINLINE(void) audioMixBufSse2StoreS32(PPDMAUDIOSAMPLE paDst, __m128i i)
+{
+    __m128i const iSign = _mm_srai_epi32(i, 31);
+    _mm_storeu_si128((__m128i *)&paDst[0], _mm_unpacklo_epi32(i, iSign));
+    _mm_storeu_si128((__m128i *)&paDst[1], _mm_unpackhi_epi32(i, iSign));
+}
+
+static DECLCALLBACK(uint32_t) audioMixBufConvFromS16StereoSse2(PPDMAUDIOSAMPLE paDst, const void *pvSrc, uint32_t cbSrc,
+                                                                PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    /*
+     * The volume is a table value in the upper bits (audioMixBufConvVol), so
+     * ((s16 << 16) * uVol) >> 30 is exactly s16 * (uVol >> 14), which fits into
+     * 32 bits and can be done with pmaddwd by splitting the factor into two
+     * 16-bit halves.  0dB (65536) doesn't split and is a plain shift instead.
+     */
+    uint32_t const uFactL = pOpts->From.Volume.uLeft  >> (AUDIOMIXBUF_VOL_SHIFT - 16);
+    uint32_t const uFactR = pOpts->From.Volume.uRight >> (AUDIOMIXBUF_VOL_SHIFT - 16);
+    if (   ((pOpts->From.Volume.uLeft | pOpts->From.Volume.uRight) & (RT_BIT_32(AUDIOMIXBUF_VOL_SHIFT - 16) - 1))
+        || (uFactL > UINT16_MAX - 1 && uFactL != _64K)
+        || (uFactR > UINT16_MAX - 1 && uFactR != _64K))
+        return audioMixBufConvFromS16Stereo(paDst, pvSrc, cbSrc, pOpts);
+
+    int16_t const *pSrc = (int16_t const *)pvSrc;
+    uint32_t const cSamples = RT_MIN(pOpts->cSamples, cbSrc / sizeof(int16_t));
+
+    int16_t const iMulL1 = uFactL == _64K ? 0 : (int16_t)(uFactL / 2);
+    int16_t const iMulL2 = uFactL == _64K ? 0 : (int16_t)(uFactL - uFactL / 2);
+    int16_t const iMulR1 = uFactR == _64K ? 0 : (int16_t)(uFactR / 2);
+    int16_t const iMulR2 = uFactR == _64K ? 0 : (int16_t)(uFactR - uFactR / 2);
+    __m128i const iMul   = _mm_setr_epi16(iMulL1, iMulL2, iMulR1, iMulR2, iMulL1, iMulL2, iMulR1, iMulR2);
+    __m128i const fShift = _mm_setr_epi32(uFactL == _64K ? 0xffff0000 : 0, uFactR == _64K ? 0xffff0000 : 0,
+                                          uFactL == _64K ? 0xffff0000 : 0, uFactR == _64K ? 0xffff0000 : 0);
+
+    uint32_t i = 0;
+    for (; i + 4 <= cSamples; i += 4)
+    {
+        __m128i const i16 = _mm_loadu_si128((__m128i const *)&pSrc[i * 2]);
+        /* Each value twice in a dword: s16 * (f1 + f2) by pmaddwd, s16 << 16 by masking. */
+        __m128i const iLo = _mm_unpacklo_epi16(i16, i16);
+        __m128i const iHi = _mm_unpackhi_epi16(i16, i16);
+        audioMixBufSse2StoreS32(&paDst[i],     _mm_add_epi32(_mm_madd_epi16(iLo, iMul), _mm_and_si128(iLo, fShift)));
+        audioMixBufSse2StoreS32(&paDst[i + 2], _mm_add_epi32(_mm_madd_epi16(iHi, iMul), _mm_and_si128(iHi, fShift)));
+    }
+
+    if (i < cSamples)
+    {
+        PDMAUDMIXBUFCONVOPTS Opts = *pOpts;
+        Opts.cSamples = cSamples - i;
+        audioMixBufConvFromS16Stereo(&paDst[i], &pSrc[i * 2], (cSamples - i) * sizeof(int16_t), &Opts);
+    }
+    return cSamples;
+}
+
+static DECLCALLBACK(uint32_t) audioMixBufConvFromS32StereoSse2(PPDMAUDIOSAMPLE paDst, const void *pvSrc, uint32_t cbSrc,
+                                                                PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    /* Only 0dB, where the conversion is a sign extension; attenuation needs a
+     * signed 32x32 multiplication, which SSE2 doesn't have. */
+    if (   pOpts->From.Volume.uLeft  != AUDIOMIXBUF_VOL_0DB
+        || pOpts->From.Volume.uRight != AUDIOMIXBUF_VOL_0DB)
+        return audioMixBufConvFromS32Stereo(paDst, pvSrc, cbSrc, pOpts);
+
+    int32_t const *pSrc = (int32_t const *)pvSrc;
+    uint32_t const cSamples = RT_MIN(pOpts->cSamples, cbSrc / sizeof(int32_t));
+
+    uint32_t i = 0;
+    for (; i + 2 <= cSamples; i += 2)
+        audioMixBufSse2StoreS32(&paDst[i], _mm_loadu_si128((__m128i const *)&pSrc[i * 2]));
+
+    if (i < cSamples)
+    {
+        PDMAUDMIXBUFCONVOPTS Opts = *pOpts;
+        Opts.cSamples = cSamples - i;
+        audioMixBufConvFromS32Stereo(&paDst[i], &pSrc[i * 2], (cSamples - i) * sizeof(int32_t), &Opts);
+    }
+    return cSamples;
+}
+
+static DECLCALLBACK(void) audioMixBufConvToS16StereoSse2(void *pvDst, PCPDMAUDIOSAMPLE paSrc, PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    int16_t *pDst = (int16_t *)pvDst;
+    uint32_t const cSamples = pOpts->cSamples;
+
+    uint32_t i = 0;
+    for (; i + 4 <= cSamples; i += 4)
+    {
+        __m128i const i32Lo = audioMixBufSse2ClipToS32(_mm_loadu_si128((__m128i const *)&paSrc[i]),
+                                                       _mm_loadu_si128((__m128i const *)&paSrc[i + 1]));
+        __m128i const i32Hi = audioMixBufSse2ClipToS32(_mm_loadu_si128((__m128i const *)&paSrc[i + 2]),
+                                                       _mm_loadu_si128((__m128i const *)&paSrc[i + 3]));
+        _mm_storeu_si128((__m128i *)&pDst[i * 2], _mm_packs_epi32(_mm_srai_epi32(i32Lo, 16), _mm_srai_epi32(i32Hi, 16)));
+    }
+
+    if (i < cSamples)
+    {
+        PDMAUDMIXBUFCONVOPTS Opts = *pOpts;
+        Opts.cSamples = cSamples - i;
+        audioMixBufConvToS16Stereo(&pDst[i * 2], &paSrc[i], &Opts);
+    }
+}
+
+static DECLCALLBACK(void) audioMixBufConvToS32StereoSse2(void *pvDst, PCPDMAUDIOSAMPLE paSrc, PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    int32_t *pDst = (int32_t *)pvDst;
+    uint32_t const cSamples = pOpts->cSamples;
+
+    uint32_t i = 0;
+    for (; i + 2 <= cSamples; i += 2)
+        _mm_storeu_si128((__m128i *)&pDst[i * 2], audioMixBufSse2ClipToS32(_mm_loadu_si128((__m128i const *)&paSrc[i]),
+                                                                           _mm_loadu_si128((__m128i const *)&paSrc[i + 1])));
+
+    if (i < cSamples)
+    {
+        PDMAUDMIXBUFCONVOPTS Opts = *pOpts;
+        Opts.cSamples = cSamples - i;
+        audioMixBufConvToS32Stereo(&pDst[i * 2], &paSrc[i], &Opts);
+    }
+}
+
+static DECLCALLBACK(uint32_t) audioMixBufConvFromF32StereoSse2(PPDMAUDIOSAMPLE paDst, const void *pvSrc, uint32_t cbSrc,
+                                                                PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    /* Same restriction as for S32, see audioMixBufConvFromS32StereoSse2. */
+    if (   pOpts->From.Volume.uLeft  != AUDIOMIXBUF_VOL_0DB
+        || pOpts->From.Volume.uRight != AUDIOMIXBUF_VOL_0DB)
+        return audioMixBufConvFromF32Stereo(paDst, pvSrc, cbSrc, pOpts);
+
+    float const *pSrc = (float const *)pvSrc;
+    uint32_t const cSamples = RT_MIN(pOpts->cSamples, cbSrc / sizeof(float));
+
+    __m128 const rScale = _mm_set1_ps(2147483648.0f);
+    uint32_t i = 0;
+    for (; i + 2 <= cSamples; i += 2)
+    {
+        __m128 const  r     = _mm_mul_ps(_mm_loadu_ps(&pSrc[i * 2]), rScale);
+        /* cvttps2dq gives INT32_MIN for anything out of range and for NaNs.  Turn
+           that into INT32_MAX for overflows and zero for NaNs. */
+        __m128i const i32   = _mm_xor_si128(_mm_cvttps_epi32(r), _mm_castps_si128(_mm_cmpge_ps(r, rScale)));
+        __m128i const fOrd  = _mm_castps_si128(_mm_cmpord_ps(r, r));
+        audioMixBufSse2StoreS32(&paDst[i], _mm_and_si128(i32, fOrd));
+    }
+
+    if (i < cSamples)
+    {
+        PDMAUDMIXBUFCONVOPTS Opts = *pOpts;
+        Opts.cSamples = cSamples - i;
+        audioMixBufConvFromF32Stereo(&paDst[i], &pSrc[i * 2], (cSamples - i) * sizeof(float), &Opts);
+    }
+    return cSamples;
+}
+
+static DECLCALLBACK(void) audioMixBufConvToF32StereoSse2(void *pvDst, PCPDMAUDIOSAMPLE paSrc, PCPDMAUDMIXBUFCONVOPTS pOpts)
+{
+    float *pDst = (float *)pvDst;
+    uint32_t const cSamples = pOpts->cSamples;
+
+    __m128 const rScale = _mm_set1_ps(1.0f / 2147483648.0f);
+    uint32_t i = 0;
+    for (; i + 2 <= cSamples; i += 2)
+    {
+        __m128i const i32 = audioMixBufSse2ClipToS32(_mm_loadu_si128((__m128i const *)&paSrc[i]),
+                                                     _mm_loadu_si128((__m128i const *)&paSrc[i + 1]));
+        _mm_storeu_ps(&pDst[i * 2], _mm_mul_ps(_mm_cvtepi32_ps(i32), rScale));
+    }
+
+    if (i < cSamples)
+    {
+        PDMAUDMIXBUFCONVOPTS Opts = *pOpts;
+        Opts.cSamples = cSamples - i;
+        audioMixBufConvToF32Stereo(&pDst[i * 2], &paSrc[i], &Opts);
+    }
+}
+#endif /* RT_ARCH_AMD64 */
+
 #define AUDMIXBUF_MIXOP(_aName, _aOp) \
     static void audioMixBufOp##_aName(PPDMAUDIOSAMPLE paDst, uint32_t cDstSamples, \
                                       PPDMAUDIOSAMPLE paSrc, uint32_t cSrcSamples, \
@@ -519,6 +792,10 @@ AUDMIXBUF_CONVERT(U32 /* Name */, uint32_t, 0         /* Min */, UINT32_MAX /* M
         PDMAUDIOSAMPLE  samCur     = { 0 }; \
         PDMAUDIOSAMPLE  samOut; \
         PDMAUDIOSAMPLE  samLast    = pRate->srcSampleLast; \
+        /* Work on copies, the compiler can't tell that the sample stores don't modify *pRate. */ \
+        uint64_t        dstOffset  = pRate->dstOffset; \
+        uint64_t const  dstInc     = pRate->dstInc; \
+        uint32_t        srcOffset  = pRate->srcOffset; \
         \
         while (paDst < paDstEnd) \
         { \
@@ -527,11 +804,11 @@ AUDMIXBUF_CONVERT(U32 /* Name */, uint32_t, 0         /* Min */, UINT32_MAX /* M
             if (paSrc >= paSrcEnd) \
                 break; \
             \
-            while (pRate->srcOffset <= (pRate->dstOffset >> 32)) \
+            while (srcOffset <= (dstOffset >> 32)) \
             { \
                 Assert(paSrc <= paSrcEnd); \
                 samLast = *paSrc++; \
-                pRate->srcOffset++; \
+                srcOffset++; \
                 if (paSrc == paSrcEnd) \
                     break; \
             } \
@@ -543,7 +820,7 @@ AUDMIXBUF_CONVERT(U32 /* Name */, uint32_t, 0         /* Min */, UINT32_MAX /* M
             samCur = *paSrc; \
             \
             /* Interpolate. */ \
-            int64_t iDstOffInt = pRate->dstOffset & UINT32_MAX; \
+            int64_t iDstOffInt = dstOffset & UINT32_MAX; \
             \
             samOut.i64LSample = (samLast.i64LSample * ((int64_t) (INT64_C(1) << 32) - iDstOffInt) + samCur.i64LSample * iDstOffInt) >> 32; \
             samOut.i64RSample = (samLast.i64RSample * ((int64_t) (INT64_C(1) << 32) - iDstOffInt) + samCur.i64RSample * iDstOffInt) >> 32; \
@@ -557,15 +834,17 @@ AUDMIXBUF_CONVERT(U32 /* Name */, uint32_t, 0         /* Min */, UINT32_MAX /* M
                                  samCur.i64LSample >> 32, samCur.i64RSample >> 32)); \
             \
             paDst++; \
-            pRate->dstOffset += pRate->dstInc; \
+            dstOffset += dstInc; \
             \
-            AUDMIXBUF_MACRO_LOG(("\t\tpRate->dstOffset=%RU32\n", pRate->dstOffset >> 32)); \
+            AUDMIXBUF_MACRO_LOG(("\t\tdstOffset=%RU32\n", dstOffset >> 32)); \
             \
         } \
         \
         AUDMIXBUF_MACRO_LOG(("%zu source samples -> %zu dest samples\n", paSrc - paSrcStart, paDst - paDstStart)); \
         \
         pRate->srcSampleLast = samLast; \
+        pRate->dstOffset     = dstOffset; \
+        pRate->srcOffset     = srcOffset; \
         \
         AUDMIXBUF_MACRO_LOG(("pRate->srcSampleLast l=%RI64, r=%RI64\n", \
                               pRate->srcSampleLast.i64LSample, pRate->srcSampleLast.i64RSample)); \
@@ -608,6 +887,19 @@ audioMixBufConvFromSilence(PPDMAUDIOSAMPLE paDst, const void *pvSrc, uint32_t cb
  */
 static PFNPDMAUDIOMIXBUFCONVFROM audioMixBufConvFromLookup(PDMAUDIOMIXBUFFMT enmFmt)
 {
+    if (AUDMIXBUF_FMT_FLOAT(enmFmt))
+    {
+        if (AUDMIXBUF_FMT_BITS_PER_SAMPLE(enmFmt) != 32)
+            return NULL;
+        if (AUDMIXBUF_FMT_CHANNELS(enmFmt) == 2)
+#ifdef RT_ARCH_AMD64
+            return audioMixBufConvFromF32StereoSse2;
+#else
+            return audioMixBufConvFromF32Stereo;
+#endif
+        return audioMixBufConvFromF32Mono;
+    }
+
     if (AUDMIXBUF_FMT_SIGNED(enmFmt))
     {
         if (AUDMIXBUF_FMT_CHANNELS(enmFmt) == 2)
@@ -615,8 +907,13 @@ static PFNPDMAUDIOMIXBUFCONVFROM audioMixBufConvFromLookup(PDMAUDIOMIXBUFFMT enm
             switch (AUDMIXBUF_FMT_BITS_PER_SAMPLE(enmFmt))
             {
                 case 8:  return audioMixBufConvFromS8Stereo;
+#ifdef RT_ARCH_AMD64
+                case 16: return audioMixBufConvFromS16StereoSse2;
+                case 32: return audioMixBufConvFromS32StereoSse2;
+#else
                 case 16: return audioMixBufConvFromS16Stereo;
                 case 32: return audioMixBufConvFromS32Stereo;
+#endif
                 default: return NULL;
             }
         }
@@ -668,6 +965,19 @@ static PFNPDMAUDIOMIXBUFCONVFROM audioMixBufConvFromLookup(PDMAUDIOMIXBUFFMT enm
  */
 static PFNPDMAUDIOMIXBUFCONVTO audioMixBufConvToLookup(PDMAUDIOMIXBUFFMT enmFmt)
 {
+    if (AUDMIXBUF_FMT_FLOAT(enmFmt))
+    {
+        if (AUDMIXBUF_FMT_BITS_PER_SAMPLE(enmFmt) != 32)
+            return NULL;
+        if (AUDMIXBUF_FMT_CHANNELS(enmFmt) == 2)
+#ifdef RT_ARCH_AMD64
+            return audioMixBufConvToF32StereoSse2;
+#else
+            return audioMixBufConvToF32Stereo;
+#endif
+        return audioMixBufConvToF32Mono;
+    }
+
     if (AUDMIXBUF_FMT_SIGNED(enmFmt))
     {
         if (AUDMIXBUF_FMT_CHANNELS(enmFmt) == 2)
@@ -675,8 +985,13 @@ static PFNPDMAUDIOMIXBUFCONVTO audioMixBufConvToLookup(PDMAUDIOMIXBUFFMT enmFmt)
             switch (AUDMIXBUF_FMT_BITS_PER_SAMPLE(enmFmt))
             {
                 case 8:  return audioMixBufConvToS8Stereo;
+#ifdef RT_ARCH_AMD64
+                case 16: return audioMixBufConvToS16StereoSse2;
+                case 32: return audioMixBufConvToS32StereoSse2;
+#else
                 case 16: return audioMixBufConvToS16Stereo;
                 case 32: return audioMixBufConvToS32Stereo;
+#endif
                 default: return NULL;
             }
         }
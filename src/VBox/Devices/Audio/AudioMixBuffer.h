@@ -25,12 +25,18 @@
  *  Note: This currently matches 1:1 the VRDE encoding -- this might change in the future, so better don't rely on this fact! */
 #define AUDMIXBUF_AUDIO_FMT_MAKE(freq, c, bps, s) ((((s) & 0x1) << 28) + (((bps) & 0xFF) << 20) + (((c) & 0xF) << 16) + ((freq) & 0xFFFF))
 
+/** Constructs 32 bit value for a 32-bit float format with the given frequency and number of channels.
+ *  Only used with the *Ex read and write functions, the mixing buffers themselves are always integer. */
+#define AUDMIXBUF_AUDIO_FMT_MAKE_F32(freq, c) (AUDMIXBUF_AUDIO_FMT_MAKE(freq, c, 32, 1) | RT_BIT_32(29))
+
 /** Decodes frequency (Hz). */
 #define AUDMIXBUF_FMT_SAMPLE_FREQ(a) ((a) & 0xFFFF)
 /** Decodes number of channels. */
 #define AUDMIXBUF_FMT_CHANNELS(a) (((a) >> 16) & 0xF)
 /** Decodes signed bit. */
 #define AUDMIXBUF_FMT_SIGNED(a) (((a) >> 28) & 0x1)
+/** Decodes float bit. */
+#define AUDMIXBUF_FMT_FLOAT(a) (((a) >> 29) & 0x1)
 /** Decodes number of bits per sample. */
 #define AUDMIXBUF_FMT_BITS_PER_SAMPLE(a) (((a) >> 20) & 0xFF)
 /** Decodes number of bytes per sample. */
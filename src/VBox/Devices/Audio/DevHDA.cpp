@@ -478,6 +478,9 @@ AssertCompile(HDA_MAX_SDI <= HDA_MAX_SDO);
  */
 /** Maximum FIFO size (in bytes). */
 #define HDA_FIFO_MAX                256
+/** Size (in bytes) of a stream's buffer between the DMA engine and the I/O thread.
+ *  Roughly 40ms of 48kHz 16-bit stereo. */
+#define HDA_IO_THREAD_BUF_SIZE      _8K
 
 #define HDA_SDIFIFO_120B            0x77 /* 8-, 16-, 20-, 24-, 32-bit Input Streams */
 #define HDA_SDIFIFO_160B            0x9F /* 20-, 24-bit Input Streams Streams */
@@ -832,10 +835,23 @@ typedef struct HDASTATE
      * Used to calculate the time actually elapsed between two timer callbacks. */
     uint64_t                           uTimerTS;
     uint64_t                           uTimerMS;
+    /** Timer ticks for the next round when the I/O thread is used.
+     * Adapts to the fill level of the stream buffers, see hdaTimerAdaptTicks(). */
+    uint64_t                           cTimerTicksCur;
+    /** Flag whether the host backend transfers are done on the I/O thread. */
+    bool                               fIOThread;
+    uint8_t                            u8Padding3[7];
+    /** The I/O thread, NULL if not used. */
+    R3PTRTYPE(PPDMTHREAD)              pIOThread;
+    /** Event semaphore the timer wakes up the I/O thread with. */
+    RTSEMEVENT                         hIOThreadEvent;
 #endif
 #ifdef VBOX_WITH_STATISTICS
 # ifndef VBOX_WITH_AUDIO_HDA_CALLBACKS
     STAMPROFILE                        StatTimer;
+    STAMPROFILE                        StatIOThread;
+    STAMCOUNTER                        StatTimerFaster;
+    STAMCOUNTER                        StatTimerSlower;
 # endif
     STAMCOUNTER                        StatBytesRead;
     STAMCOUNTER                        StatBytesWritten;
@@ -955,6 +971,10 @@ static void          hdaStreamDestroy(PHDASTREAM pStream);
 static int           hdaStreamDoDMA(PHDASTATE pThis, PHDASTREAM pStream, void *pvBuf, uint32_t cbBuf, uint32_t cbToProcess, uint32_t *pcbProcessed);
 static int           hdaStreamSetActive(PHDASTATE pThis, PHDASTREAM pStream, bool fActive);
 static int           hdaStreamUpdate(PHDASTATE pThis, PHDASTREAM pStream);
+# ifndef VBOX_WITH_AUDIO_HDA_CALLBACKS
+static int           hdaStreamUpdateDMA(PHDASTATE pThis, PHDASTREAM pStream);
+static int           hdaStreamUpdateHost(PHDASTATE pThis, PHDASTREAM pStream);
+# endif
 DECLINLINE(uint32_t) hdaStreamUpdateLPIB(PHDASTATE pThis, PHDASTREAM pStream, uint32_t u32LPIB);
 #endif /* IN_RING3 */
 /** @} */
@@ -995,6 +1015,7 @@ static void          hdaBDLEDumpAll(PHDASTATE pThis, uint64_t u64BaseDMA, uint16
 #if !defined(VBOX_WITH_AUDIO_HDA_CALLBACKS) && defined(IN_RING3)
 static void          hdaTimerMaybeStart(PHDASTATE pThis);
 static void          hdaTimerMaybeStop(PHDASTATE pThis);
+static uint64_t      hdaTimerAdaptTicks(PHDASTATE pThis);
 #endif
 /** @} */
 
@@ -1665,7 +1686,7 @@ static int hdaCORBCmdProcess(PHDASTATE pThis)
     return rc;
 }
 
-static int hdaStreamCreate(PHDASTREAM pStream, uint8_t uSD)
+static int hdaStreamCreate(PHDASTREAM pStream, uint8_t uSD, uint32_t cbCircBuf)
 {
     AssertPtrReturn(pStream, VERR_INVALID_POINTER);
     AssertReturn(uSD <= HDA_MAX_STREAMS, VERR_INVALID_PARAMETER);
@@ -1680,9 +1701,9 @@ static int hdaStreamCreate(PHDASTREAM pStream, uint8_t uSD)
     }
 
     if (RT_SUCCESS(rc))
-        rc = RTCircBufCreate(&pStream->State.pCircBuf, HDA_FIFO_MAX);
+        rc = RTCircBufCreate(&pStream->State.pCircBuf, cbCircBuf);
 
-    LogFlowFunc(("uSD=%RU8\n", uSD));
+    LogFlowFunc(("uSD=%RU8, cbCircBuf=%RU32\n", uSD, cbCircBuf));
     return rc;
 }
 
@@ -1767,7 +1788,13 @@ static void hdaStreamReset(PHDASTATE pThis, PHDASTREAM pStream)
     pStream->State.uCurBDLE = 0;
 
     if (pStream->State.pCircBuf)
+    {
+        /* The I/O thread might be working on the buffer. */
+        int rc2 = RTCritSectEnter(&pStream->State.CritSect);
+        AssertRC(rc2);
         RTCircBufReset(pStream->State.pCircBuf);
+        RTCritSectLeave(&pStream->State.CritSect);
+    }
 #if 0
     RT_ZERO(pStream->State.abFIFO);
     pStream->State.cbFIFOUsed = 0;
@@ -4138,11 +4165,25 @@ static void hdaDoTransfers(PHDASTATE pThis)
     /** @todo See note below. */
 #endif
 
-    hdaStreamUpdate(pThis, pStreamLineIn);
+    if (pThis->pIOThread)
+    {
+        /* Only do the DMA here, the I/O thread talks to the mixer and the backends. */
+        hdaStreamUpdateDMA(pThis, pStreamLineIn);
 #ifdef VBOX_WITH_AUDIO_HDA_MIC_IN
-    hdaStreamUpdate(pThis, pStreamMicIn);
+        hdaStreamUpdateDMA(pThis, pStreamMicIn);
 #endif
-    hdaStreamUpdate(pThis, pStreamFront);
+        hdaStreamUpdateDMA(pThis, pStreamFront);
+
+        RTSemEventSignal(pThis->hIOThreadEvent);
+    }
+    else
+    {
+        hdaStreamUpdate(pThis, pStreamLineIn);
+#ifdef VBOX_WITH_AUDIO_HDA_MIC_IN
+        hdaStreamUpdate(pThis, pStreamMicIn);
+#endif
+        hdaStreamUpdate(pThis, pStreamFront);
+    }
 
 
 #ifdef VBOX_WITH_AUDIO_HDA_51_SURROUND
@@ -4181,8 +4222,7 @@ static void hdaDoTransfers(PHDASTATE pThis)
         || fKickTimer)
     {
         /* Kick the timer again. */
-        uint64_t cTicks = pThis->cTimerTicks;
-        /** @todo adjust cTicks down by now much cbOutMin represents. */
+        uint64_t cTicks = pThis->pIOThread ? hdaTimerAdaptTicks(pThis) : pThis->cTimerTicks;
         TMTimerSet(pThis->pTimer, cTicksNow + cTicks);
     }
 
@@ -4200,6 +4240,118 @@ static DECLCALLBACK(void) hdaTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void *pv
     hdaDoTransfers(pThis);
 }
 
+/**
+ * Returns how many bytes the host side of a stream has left before it runs
+ * dry (output) or overflows (input) when the I/O thread is used.
+ *
+ * @returns Slack in bytes, UINT32_MAX if the stream is not active.
+ * @param   pStream             HDA stream to check. Optional.
+ */
+static uint32_t hdaStreamGetSlack(PHDASTREAM pStream)
+{
+    if (   !pStream
+        || !pStream->pMixSink
+        || !AudioMixerSinkIsActive(pStream->pMixSink->pMixSink))
+        return UINT32_MAX;
+
+    PRTCIRCBUF pCircBuf = pStream->State.pCircBuf;
+    if (hdaGetDirFromSD(pStream->u8SD) == PDMAUDIODIR_OUT)
+        return (uint32_t)RTCircBufUsed(pCircBuf);
+    return (uint32_t)RTCircBufFree(pCircBuf);
+}
+
+/**
+ * Calculates the timer ticks for the next DMA round when the I/O thread is used.
+ *
+ * The interval is halved when a stream buffer is about to run dry (output) or
+ * to overflow (input) and doubled when all buffers have plenty of slack, within
+ * a quarter and twice the configured interval.
+ *
+ * @returns Timer ticks until the next round.
+ * @param   pThis               HDA state.
+ */
+static uint64_t hdaTimerAdaptTicks(PHDASTATE pThis)
+{
+    uint32_t cbSlack = hdaStreamGetSlack(hdaSinkGetStream(pThis, &pThis->SinkFront));
+    cbSlack = RT_MIN(cbSlack, hdaStreamGetSlack(hdaSinkGetStream(pThis, &pThis->SinkLineIn)));
+#ifdef VBOX_WITH_AUDIO_HDA_MIC_IN
+    cbSlack = RT_MIN(cbSlack, hdaStreamGetSlack(hdaSinkGetStream(pThis, &pThis->SinkMicIn)));
+#endif
+
+    uint64_t cTicks = pThis->cTimerTicksCur;
+    if (cbSlack == UINT32_MAX)
+        cTicks = pThis->cTimerTicks;
+    else if (cbSlack < HDA_IO_THREAD_BUF_SIZE / 4)
+    {
+        cTicks = RT_MAX(cTicks / 2, pThis->cTimerTicks / 4);
+        STAM_COUNTER_INC(&pThis->StatTimerFaster);
+    }
+    else if (cbSlack > HDA_IO_THREAD_BUF_SIZE / 4 * 3)
+    {
+        cTicks = RT_MIN(cTicks * 2, pThis->cTimerTicks * 2);
+        STAM_COUNTER_INC(&pThis->StatTimerSlower);
+    }
+
+    pThis->cTimerTicksCur = cTicks;
+    return cTicks;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADDEV, Moves the audio data between the
+ *                      stream buffers and the mixer sinks.}
+ */
+static DECLCALLBACK(int) hdaIOThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    RT_NOREF(pDevIns);
+    PHDASTATE pThis = (PHDASTATE)pThread->pvUser;
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        RTSemEventWait(pThis->hIOThreadEvent, RT_INDEFINITE_WAIT);
+        if (pThread->enmState != PDMTHREADSTATE_RUNNING)
+            break;
+
+        STAM_PROFILE_START(&pThis->StatIOThread, a);
+        for (uint8_t i = 0; i < HDA_MAX_STREAMS; i++)
+            hdaStreamUpdateHost(pThis, &pThis->aStreams[i]);
+        STAM_PROFILE_STOP(&pThis->StatIOThread, a);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADWAKEUPDEV}
+ */
+static DECLCALLBACK(int) hdaIOThreadWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    RT_NOREF(pDevIns);
+    PHDASTATE pThis = (PHDASTATE)pThread->pvUser;
+    return RTSemEventSignal(pThis->hIOThreadEvent);
+}
+
+/**
+ * Destroys the I/O thread, if any.
+ *
+ * @param   pThis               HDA state.
+ */
+static void hdaIOThreadDestroy(PHDASTATE pThis)
+{
+    if (pThis->pIOThread)
+    {
+        PDMR3ThreadDestroy(pThis->pIOThread, NULL);
+        pThis->pIOThread = NULL;
+    }
+    if (pThis->hIOThreadEvent != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(pThis->hIOThreadEvent);
+        pThis->hIOThreadEvent = NIL_RTSEMEVENT;
+    }
+}
+
 #else /* VBOX_WITH_AUDIO_HDA_CALLBACKS */
 
 static DECLCALLBACK(int) hdaCallbackInput(PDMAUDIOCBTYPE enmType, void *pvCtx, size_t cbCtx, void *pvUser, size_t cbUser)
@@ -4552,6 +4704,158 @@ static int hdaStreamUpdate(PHDASTATE pThis, PHDASTREAM pStream)
 
     return rc;
 }
+
+# ifndef VBOX_WITH_AUDIO_HDA_CALLBACKS
+/**
+ * Does the DMA part of hdaStreamUpdate() when the I/O thread is used.
+ *
+ * For an SDO (output) stream this fills the stream's buffer with DMA data,
+ * for an SDI (input) stream this hands the data the I/O thread has read from
+ * the mixer sink over to the guest.
+ *
+ * @returns IPRT status code.
+ * @param   pThis               HDA state.
+ * @param   pStream             HDA stream to update.
+ */
+static int hdaStreamUpdateDMA(PHDASTATE pThis, PHDASTREAM pStream)
+{
+    AssertPtrReturn(pThis,   VERR_INVALID_POINTER);
+    AssertPtrReturn(pStream, VERR_INVALID_POINTER);
+
+    PHDAMIXERSINK pSink = pStream->pMixSink;
+    if (   !pSink
+        || !AudioMixerSinkIsActive(pSink->pMixSink)
+        || !pStream->u16FIFOS)
+        return VINF_SUCCESS;
+
+    PRTCIRCBUF pCircBuf = pStream->State.pCircBuf;
+    AssertPtr(pCircBuf);
+
+    void  *pvBuf;
+    size_t cbBuf;
+
+    uint32_t cbToProcess = _16K; /** @todo Tweak this. Later. */
+
+    while (cbToProcess >= pStream->u16FIFOS)
+    {
+        uint32_t cbProcessed = 0;
+        int rc2;
+
+        if (hdaGetDirFromSD(pStream->u8SD) == PDMAUDIODIR_OUT) /* Output (SDO). */
+        {
+            if (RTCircBufFree(pCircBuf) < pStream->u16FIFOS)
+                break;
+
+            /* Do one DMA transfer with FIFOS size at a time. */
+            RTCircBufAcquireWriteBlock(pCircBuf, pStream->u16FIFOS, &pvBuf, &cbBuf);
+            rc2 = hdaStreamDoDMA(pThis, pStream, pvBuf, (uint32_t)cbBuf, (uint32_t)cbBuf /* cbToProcess */, &cbProcessed);
+            AssertRC(rc2);
+            RTCircBufReleaseWriteBlock(pCircBuf, cbProcessed);
+        }
+        else /* Input (SDI). */
+        {
+            if (!RTCircBufUsed(pCircBuf))
+                break;
+
+            RTCircBufAcquireReadBlock(pCircBuf, pStream->u16FIFOS, &pvBuf, &cbBuf);
+            rc2 = hdaStreamDoDMA(pThis, pStream, pvBuf, (uint32_t)cbBuf, (uint32_t)cbBuf /* cbToProcess */, &cbProcessed);
+            AssertRC(rc2);
+            RTCircBufReleaseReadBlock(pCircBuf, cbProcessed);
+        }
+
+        if (!cbProcessed)
+            break;
+
+        cbToProcess -= RT_MIN(cbToProcess, cbProcessed);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Does the host part of hdaStreamUpdate() on the I/O thread.
+ *
+ * For an SDO (output) stream this writes the DMA'ed data to the mixer sink,
+ * for an SDI (input) stream this reads new data from the mixer sink.
+ *
+ * @returns IPRT status code.
+ * @param   pThis               HDA state.
+ * @param   pStream             HDA stream to update.
+ */
+static int hdaStreamUpdateHost(PHDASTATE pThis, PHDASTREAM pStream)
+{
+    AssertPtrReturn(pThis,   VERR_INVALID_POINTER);
+    AssertPtrReturn(pStream, VERR_INVALID_POINTER);
+
+    /* Serializes against the sink assignment and the stream reset. */
+    int rc = RTCritSectEnter(&pStream->State.CritSect);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    PHDAMIXERSINK pSink = pStream->pMixSink;
+    if (   pSink
+        && AudioMixerSinkIsActive(pSink->pMixSink)
+        && !ASMAtomicReadBool(&pStream->State.fInReset))
+    {
+        PRTCIRCBUF pCircBuf = pStream->State.pCircBuf;
+        void      *pvBuf;
+        size_t     cbBuf;
+        int        rc2;
+
+        if (hdaGetDirFromSD(pStream->u8SD) == PDMAUDIODIR_OUT) /* Output (SDO). */
+        {
+            /* At most two rounds, the used part of the buffer may wrap around. */
+            for (unsigned i = 0; i < 2 && RTCircBufUsed(pCircBuf); i++)
+            {
+                RTCircBufAcquireReadBlock(pCircBuf, RTCircBufUsed(pCircBuf), &pvBuf, &cbBuf);
+
+                uint32_t cbWritten = 0;
+                rc2 = AudioMixerSinkWrite(pSink->pMixSink, AUDMIXOP_COPY, pvBuf, (uint32_t)cbBuf, &cbWritten);
+                AssertRC(rc2);
+
+                /* Keep what the sink did not take for the next round, unless the buffer is
+                 * full and nothing was taken: then drop the data like hdaStreamUpdate() does,
+                 * so a sink without enabled streams cannot stall the guest's DMA. */
+                if (   !cbWritten
+                    && !RTCircBufFree(pCircBuf))
+                    cbWritten = (uint32_t)cbBuf;
+
+                RTCircBufReleaseReadBlock(pCircBuf, cbWritten);
+
+                if (cbWritten < cbBuf)
+                    break;
+            }
+
+            rc2 = AudioMixerSinkUpdate(pSink->pMixSink);
+            AssertRC(rc2);
+        }
+        else /* Input (SDI). */
+        {
+            rc2 = AudioMixerSinkUpdate(pSink->pMixSink);
+            AssertRC(rc2);
+
+            for (unsigned i = 0; i < 2 && RTCircBufFree(pCircBuf); i++)
+            {
+                RTCircBufAcquireWriteBlock(pCircBuf, RTCircBufFree(pCircBuf), &pvBuf, &cbBuf);
+
+                uint32_t cbRead = 0;
+                rc2 = AudioMixerSinkRead(pSink->pMixSink, AUDMIXOP_COPY, pvBuf, (uint32_t)cbBuf, &cbRead);
+                AssertRC(rc2);
+
+                RTCircBufReleaseWriteBlock(pCircBuf, cbRead);
+
+                if (cbRead < cbBuf)
+                    break;
+            }
+        }
+    }
+
+    int rc2 = RTCritSectLeave(&pStream->State.CritSect);
+    AssertRC(rc2);
+
+    return rc;
+}
+# endif /* !VBOX_WITH_AUDIO_HDA_CALLBACKS */
 #endif /* IN_RING3 */
 
 /* MMIO callbacks */
@@ -5638,6 +5942,11 @@ static DECLCALLBACK(int) hdaDestruct(PPDMDEVINS pDevIns)
 {
     PHDASTATE pThis = PDMINS_2_DATA(pDevIns, PHDASTATE);
 
+#ifndef VBOX_WITH_AUDIO_HDA_CALLBACKS
+    /* PDM would only destroy the thread after us, it uses the streams. */
+    hdaIOThreadDestroy(pThis);
+#endif
+
     PHDADRIVER pDrv;
     while (!RTListIsEmpty(&pThis->lstDrv))
     {
@@ -5779,6 +6088,11 @@ static DECLCALLBACK(void) hdaPowerOff(PPDMDEVINS pDevIns)
 
     LogRel2(("HDA: Powering off ...\n"));
 
+#ifndef VBOX_WITH_AUDIO_HDA_CALLBACKS
+    /* The I/O thread uses the mixer sinks, so it must go first. */
+    hdaIOThreadDestroy(pThis);
+#endif
+
     /* Ditto goes for the codec, which in turn uses the mixer. */
     hdaCodecPowerOff(pThis->pCodec);
 
@@ -5869,7 +6183,8 @@ static DECLCALLBACK(int) hdaConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
      */
     if (!CFGMR3AreValuesValid(pCfg, "R0Enabled\0"
                                     "RCEnabled\0"
-                                    "TimerHz\0"))
+                                    "TimerHz\0"
+                                    "IOThread\0"))
         return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
                                 N_ ("Invalid configuration for the Intel HDA device"));
 
@@ -5887,6 +6202,13 @@ static DECLCALLBACK(int) hdaConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
     if (RT_FAILURE(rc))
         return PDMDEV_SET_ERROR(pDevIns, rc,
                                 N_("HDA configuration error: failed to read Hertz (Hz) rate as unsigned integer"));
+    /* Whether to move the data to and from the host backends on a dedicated thread
+     * instead of the timer, which then only does the DMA. Experimental. */
+    rc = CFGMR3QueryBoolDef(pCfg, "IOThread", &pThis->fIOThread, false);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("HDA configuration error: failed to read IOThread as boolean"));
+    pThis->hIOThreadEvent = NIL_RTSEMEVENT;
 #endif
 
     /*
@@ -6104,9 +6426,14 @@ static DECLCALLBACK(int) hdaConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
         /*
          * Create all hardware streams.
          */
+        uint32_t cbCircBuf = HDA_FIFO_MAX;
+#ifndef VBOX_WITH_AUDIO_HDA_CALLBACKS
+        if (pThis->fIOThread)
+            cbCircBuf = HDA_IO_THREAD_BUF_SIZE;
+#endif
         for (uint8_t i = 0; i < HDA_MAX_STREAMS; i++)
         {
-            rc = hdaStreamCreate(&pThis->aStreams[i], i /* uSD */);
+            rc = hdaStreamCreate(&pThis->aStreams[i], i /* uSD */, cbCircBuf);
             AssertRC(rc);
         }
 
@@ -6316,11 +6643,24 @@ static DECLCALLBACK(int) hdaConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
 
         if (RT_SUCCESS(rc))
         {
-            pThis->cTimerTicks = TMTimerGetFreq(pThis->pTimer) / uTimerHz;
-            pThis->uTimerTS    = TMTimerGet(pThis->pTimer);
+            pThis->cTimerTicks    = TMTimerGetFreq(pThis->pTimer) / uTimerHz;
+            pThis->cTimerTicksCur = pThis->cTimerTicks;
+            pThis->uTimerTS       = TMTimerGet(pThis->pTimer);
             LogFunc(("Timer ticks=%RU64 (%RU16 Hz)\n", pThis->cTimerTicks, uTimerHz));
         }
     }
+
+    if (   RT_SUCCESS(rc)
+        && pThis->fIOThread)
+    {
+        rc = RTSemEventCreate(&pThis->hIOThreadEvent);
+        if (RT_SUCCESS(rc))
+            rc = PDMDevHlpThreadCreate(pDevIns, &pThis->pIOThread, pThis, hdaIOThread,
+                                       hdaIOThreadWakeUp, 0, RTTHREADTYPE_IO, "HDAIO");
+        if (RT_FAILURE(rc))
+            return PDMDEV_SET_ERROR(pDevIns, rc, N_("HDA: Failed to create the I/O thread"));
+        LogRel(("HDA: Using the I/O thread for the host backends\n"));
+    }
 # else
     if (RT_SUCCESS(rc))
     {
@@ -6361,6 +6701,9 @@ static DECLCALLBACK(int) hdaConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNO
          */
 #  ifndef VBOX_WITH_AUDIO_HDA_CALLBACKS
         PDMDevHlpSTAMRegister(pDevIns, &pThis->StatTimer,            STAMTYPE_PROFILE, "/Devices/HDA/Timer",             STAMUNIT_TICKS_PER_CALL, "Profiling hdaTimer.");
+        PDMDevHlpSTAMRegister(pDevIns, &pThis->StatIOThread,         STAMTYPE_PROFILE, "/Devices/HDA/IOThread",          STAMUNIT_TICKS_PER_CALL, "Profiling the I/O thread rounds.");
+        PDMDevHlpSTAMRegister(pDevIns, &pThis->StatTimerFaster,      STAMTYPE_COUNTER, "/Devices/HDA/TimerFaster",       STAMUNIT_OCCURENCES,     "Timer interval shortened because of low buffer slack.");
+        PDMDevHlpSTAMRegister(pDevIns, &pThis->StatTimerSlower,      STAMTYPE_COUNTER, "/Devices/HDA/TimerSlower",       STAMUNIT_OCCURENCES,     "Timer interval lengthened because of high buffer slack.");
 #  endif
         PDMDevHlpSTAMRegister(pDevIns, &pThis->StatBytesRead,        STAMTYPE_COUNTER, "/Devices/HDA/BytesRead"   ,      STAMUNIT_BYTES,          "Bytes read from HDA emulation.");
         PDMDevHlpSTAMRegister(pDevIns, &pThis->StatBytesWritten,     STAMTYPE_COUNTER, "/Devices/HDA/BytesWritten",      STAMUNIT_BYTES,          "Bytes written to HDA emulation.");
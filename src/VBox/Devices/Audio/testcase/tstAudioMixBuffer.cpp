@@ -26,6 +26,7 @@
 #include <iprt/stream.h>
 #include <iprt/string.h>
 #include <iprt/test.h>
+#include <iprt/time.h>
 
 
 #include "../AudioMixBuffer.h"
@@ -584,6 +585,292 @@ static int tstVolume(RTTEST hTest)
     return RTTestSubErrorCount(hTest) ? VERR_GENERAL_FAILURE : VINF_SUCCESS;
 }
 
+/* Test stereo S16 with different volumes per channel and a sample count which isn't a multiple of the vector size. */
+static int tstVolumeStereo(RTTEST hTest)
+{
+    RTTestSubF(hTest, "Volume control (S16 stereo, random)");
+
+    PDMAUDIOSTREAMCFG cfg =
+    {
+        "48000Hz, 2 Channels, S16",
+        PDMAUDIODIR_OUT,
+        { PDMAUDIOPLAYBACKDEST_UNKNOWN },
+        48000,                    /* Hz */
+        2                         /* Channels */,
+        PDMAUDIOFMT_S16           /* Format */,
+        PDMAUDIOENDIANNESS_LITTLE /* ENDIANNESS */
+    };
+    PDMAUDIOPCMPROPS props;
+    int rc = DrvAudioHlpStreamCfgToProps(&cfg, &props);
+    AssertRC(rc);
+
+    PDMAUDIOMIXBUF mb;
+    RTTESTI_CHECK_RC_OK(AudioMixBufInit(&mb, "Stereo", &props, 256));
+
+    /* Left at 0dB, right at -48dB (128 steps down), which is exactly a shift by 8. */
+    PDMAUDIOVOLUME vol = { false, 255, 255 - 128 };
+    AudioMixBufSetVolume(&mb, &vol);
+
+    int16_t aSamples[2 * 123];
+    for (unsigned i = 0; i < RT_ELEMENTS(aSamples); i++)
+        aSamples[i] = (int16_t)RTRandU32Ex(0, UINT16_MAX);
+    aSamples[0] = INT16_MIN;
+    aSamples[1] = INT16_MIN;
+    aSamples[2] = INT16_MAX;
+    aSamples[3] = INT16_MAX;
+
+    uint32_t cSamplesWritten, cSamplesRead;
+    RTTESTI_CHECK_RC_OK(AudioMixBufWriteAt(&mb, 0, aSamples, sizeof(aSamples), &cSamplesWritten));
+    RTTESTI_CHECK(cSamplesWritten == RT_ELEMENTS(aSamples) / 2);
+
+    int16_t aOut[2 * 123];
+    RT_ZERO(aOut);
+    RTTESTI_CHECK_RC_OK(AudioMixBufReadAt(&mb, 0, aOut, sizeof(aOut), &cSamplesRead));
+    for (unsigned i = 0; i < RT_ELEMENTS(aSamples); i += 2)
+    {
+        RTTESTI_CHECK_MSG(aOut[i] == aSamples[i], ("index %u: Dst=%d, Src=%d\n", i, aOut[i], aSamples[i]));
+        RTTESTI_CHECK_MSG(aOut[i + 1] == aSamples[i + 1] >> 8, ("index %u: Dst=%d, Src=%d\n", i + 1, aOut[i + 1], aSamples[i + 1]));
+    }
+
+    AudioMixBufDestroy(&mb);
+
+    return RTTestSubErrorCount(hTest) ? VERR_GENERAL_FAILURE : VINF_SUCCESS;
+}
+
+/* Test the F32 conversion routines against S32 (odd length, saturation, NaN). */
+static int tstConversionF32(RTTEST hTest)
+{
+    RTTestSubF(hTest, "Sample conversion (F32 stereo)");
+
+    PDMAUDIOSTREAMCFG cfg =
+    {
+        "48000Hz, 2 Channels, S32",
+        PDMAUDIODIR_OUT,
+        { PDMAUDIOPLAYBACKDEST_UNKNOWN },
+        48000,                    /* Hz */
+        2                         /* Channels */,
+        PDMAUDIOFMT_S32           /* Format */,
+        PDMAUDIOENDIANNESS_LITTLE /* ENDIANNESS */
+    };
+    PDMAUDIOPCMPROPS props;
+    int rc = DrvAudioHlpStreamCfgToProps(&cfg, &props);
+    AssertRC(rc);
+
+    PDMAUDIOMIXBUF mb;
+    RTTESTI_CHECK_RC_OK(AudioMixBufInit(&mb, "F32", &props, 256));
+    PDMAUDIOMIXBUFFMT const enmFmtF32 = AUDMIXBUF_AUDIO_FMT_MAKE_F32(48000, 2);
+
+    float   aSamples[2 * 61];
+    int32_t aExpected[2 * 61];
+    for (unsigned i = 0; i < RT_ELEMENTS(aSamples); i++)
+    {
+        aSamples[i]  = (float)((int32_t)RTRandU32() / 2147483648.0);
+        /* Values just below 1.0 may round up to it. */
+        float const r = aSamples[i] * 2147483648.0f;
+        aExpected[i] = r >= 2147483648.0f ? INT32_MAX : (int32_t)r;
+    }
+    static float const s_arEdge[]   = { 1.0f,      -1.0f,     1.5f,      -1.5f,     0.5f,       -0.5f,       0.0f };
+    static int32_t const s_aiEdge[] = { INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN, 0x40000000, -0x40000000, 0 };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_arEdge); i++)
+    {
+        aSamples[i * 3]  = s_arEdge[i];
+        aExpected[i * 3] = s_aiEdge[i];
+    }
+    /* NaN is silence. */
+    uint32_t const uNaN = UINT32_C(0x7fc00000);
+    memcpy(&aSamples[RT_ELEMENTS(aSamples) - 1], &uNaN, sizeof(uNaN));
+    aExpected[RT_ELEMENTS(aSamples) - 1] = 0;
+
+    uint32_t cSamplesWritten, cbRead;
+    RTTESTI_CHECK_RC_OK(AudioMixBufWriteAtEx(&mb, enmFmtF32, 0, aSamples, sizeof(aSamples), &cSamplesWritten));
+    RTTESTI_CHECK(cSamplesWritten == RT_ELEMENTS(aSamples) / 2);
+
+    int32_t aOut[2 * 61];
+    RT_ZERO(aOut);
+    RTTESTI_CHECK_RC_OK(AudioMixBufReadAt(&mb, 0, aOut, sizeof(aOut), &cbRead));
+    for (unsigned i = 0; i < RT_ELEMENTS(aOut); i++)
+        RTTESTI_CHECK_MSG(aOut[i] == aExpected[i], ("index %u: Dst=%d, Expected=%d (%g)\n", i, aOut[i], aExpected[i], aSamples[i]));
+
+    float arOut[2 * 61];
+    RT_ZERO(arOut);
+    RTTESTI_CHECK_RC_OK(AudioMixBufReadAtEx(&mb, enmFmtF32, 0, arOut, sizeof(arOut), &cbRead));
+    for (unsigned i = 0; i < RT_ELEMENTS(arOut); i++)
+        RTTESTI_CHECK_MSG(arOut[i] == (float)aExpected[i] / 2147483648.0f, ("index %u: Dst=%g, Src=%d\n", i, arOut[i], aExpected[i]));
+
+    AudioMixBufDestroy(&mb);
+
+    return RTTestSubErrorCount(hTest) ? VERR_GENERAL_FAILURE : VINF_SUCCESS;
+}
+
+/* Check the resampler against a straight implementation of the linear interpolation. */
+static int tstResampling(RTTEST hTest)
+{
+    RTTestSubF(hTest, "Resampling (S32 stereo, 44.1kHz -> 48kHz)");
+
+    PDMAUDIOSTREAMCFG cfg =
+    {
+        "48000Hz, 2 Channels, S32",
+        PDMAUDIODIR_OUT,
+        { PDMAUDIOPLAYBACKDEST_UNKNOWN },
+        48000,                    /* Hz */
+        2                         /* Channels */,
+        PDMAUDIOFMT_S32           /* Format */,
+        PDMAUDIOENDIANNESS_LITTLE /* ENDIANNESS */
+    };
+    PDMAUDIOPCMPROPS props;
+    int rc = DrvAudioHlpStreamCfgToProps(&cfg, &props);
+    AssertRC(rc);
+
+    uint32_t const cBufSize = _1K;
+    PDMAUDIOMIXBUF parent;
+    RTTESTI_CHECK_RC_OK(AudioMixBufInit(&parent, "Parent", &props, cBufSize));
+
+    cfg.uHz = 44100;
+    rc = DrvAudioHlpStreamCfgToProps(&cfg, &props);
+    AssertRC(rc);
+    PDMAUDIOMIXBUF child;
+    RTTESTI_CHECK_RC_OK(AudioMixBufInit(&child, "Child", &props, cBufSize));
+    RTTESTI_CHECK_RC_OK(AudioMixBufLinkTo(&child, &parent));
+
+    /* Full scale random data, including the extremes. */
+    uint32_t const cSrc = 441;
+    int32_t aSrc[2 * 441];
+    for (uint32_t i = 0; i < RT_ELEMENTS(aSrc); i++)
+        aSrc[i] = (int32_t)RTRandU32();
+    aSrc[0] = INT32_MIN;
+    aSrc[1] = INT32_MAX;
+    aSrc[2] = INT32_MAX;
+    aSrc[3] = INT32_MIN;
+
+    uint32_t cSamplesWritten, cSamplesMixed, cSamplesRead;
+    RTTESTI_CHECK_RC_OK(AudioMixBufWriteCirc(&child, aSrc, sizeof(aSrc), &cSamplesWritten));
+    RTTESTI_CHECK(cSamplesWritten == cSrc);
+    AudioMixBufMixToParent(&child, cSamplesWritten, &cSamplesMixed);
+
+    int32_t aOut[2 * 512];
+    RTTESTI_CHECK_RC_OK(AudioMixBufReadCirc(&parent, aOut, sizeof(aOut), &cSamplesRead));
+    RTTESTI_CHECK(cSamplesRead > 0);
+
+    /* The reference, same state handling as the mixing buffer. */
+    uint64_t const dstInc    = (UINT64_C(44100) << 32) / 48000;
+    uint64_t       dstOffset = 0;
+    uint32_t       srcOffset = 0;
+    uint32_t       iSrc      = 0;
+    int64_t        iLastL    = 0;
+    int64_t        iLastR    = 0;
+    uint32_t       cChecked  = 0;
+    for (uint32_t iDst = 0; iDst < cSamplesRead && iSrc < cSrc; iDst++)
+    {
+        while (srcOffset <= (dstOffset >> 32) && iSrc < cSrc)
+        {
+            iLastL = aSrc[iSrc * 2];
+            iLastR = aSrc[iSrc * 2 + 1];
+            iSrc++;
+            srcOffset++;
+        }
+        if (iSrc >= cSrc)
+            break;
+
+        int64_t const iFrac = dstOffset & UINT32_MAX;
+        int32_t const iL = (int32_t)((iLastL * ((INT64_C(1) << 32) - iFrac) + aSrc[iSrc * 2]     * iFrac) >> 32);
+        int32_t const iR = (int32_t)((iLastR * ((INT64_C(1) << 32) - iFrac) + aSrc[iSrc * 2 + 1] * iFrac) >> 32);
+        RTTESTI_CHECK_MSG_BREAK(aOut[iDst * 2] == iL && aOut[iDst * 2 + 1] == iR,
+                                ("sample %u: got %d/%d, expected %d/%d\n", iDst, aOut[iDst * 2], aOut[iDst * 2 + 1], iL, iR));
+        cChecked++;
+        dstOffset += dstInc;
+    }
+    RTTESTI_CHECK_MSG(cChecked == cSamplesRead, ("checked %u of %u samples\n", cChecked, cSamplesRead));
+
+    AudioMixBufDestroy(&parent);
+    AudioMixBufDestroy(&child);
+
+    return RTTestSubErrorCount(hTest) ? VERR_GENERAL_FAILURE : VINF_SUCCESS;
+}
+
+/* Throughput of the common playback path: S16 stereo at 44.1kHz written to a
+ * child, resampled to a 48kHz parent and read back as S16 stereo. */
+static int tstBenchmark(RTTEST hTest)
+{
+    RTTestSubF(hTest, "Benchmark (S16 stereo, 44.1kHz -> 48kHz)");
+
+    PDMAUDIOSTREAMCFG cfg =
+    {
+        "48000Hz, 2 Channels, S16",
+        PDMAUDIODIR_OUT,
+        { PDMAUDIOPLAYBACKDEST_UNKNOWN },
+        48000,                    /* Hz */
+        2                         /* Channels */,
+        PDMAUDIOFMT_S16           /* Format */,
+        PDMAUDIOENDIANNESS_LITTLE /* ENDIANNESS */
+    };
+    PDMAUDIOPCMPROPS props;
+    int rc = DrvAudioHlpStreamCfgToProps(&cfg, &props);
+    AssertRC(rc);
+
+    uint32_t const cBufSize = _4K;
+    PDMAUDIOMIXBUF parent;
+    RTTESTI_CHECK_RC_OK(AudioMixBufInit(&parent, "Parent", &props, cBufSize));
+
+    cfg.uHz = 44100;
+    rc = DrvAudioHlpStreamCfgToProps(&cfg, &props);
+    AssertRC(rc);
+    PDMAUDIOMIXBUF child;
+    RTTESTI_CHECK_RC_OK(AudioMixBufInit(&child, "Child", &props, cBufSize));
+    RTTESTI_CHECK_RC_OK(AudioMixBufLinkTo(&child, &parent));
+
+    PDMAUDIOVOLUME vol = { false, 255 - 16, 255 - 16 };
+    AudioMixBufSetVolume(&child, &vol);
+
+    /* 10ms worth of data per round, like the device timers. */
+    uint32_t const cChunk = 441;
+    int16_t *paSamples = (int16_t *)RTMemAlloc(cChunk * 2 * sizeof(int16_t));
+    int16_t *paOut     = (int16_t *)RTMemAlloc(cBufSize * 2 * sizeof(int16_t));
+    RTTESTI_CHECK_RET(paSamples && paOut, VERR_NO_MEMORY);
+    for (uint32_t i = 0; i < cChunk * 2; i++)
+        paSamples[i] = (int16_t)RTRandU32Ex(0, UINT16_MAX);
+
+    uint64_t cNsWrite = 0, cNsMix = 0, cNsRead = 0;
+    uint64_t cWritten = 0, cMixed = 0, cRead = 0;
+    uint64_t const nsStart = RTTimeNanoTS();
+    while (RTTimeNanoTS() - nsStart < RT_NS_1SEC / 2)
+    {
+        uint32_t cSamplesWritten, cSamplesMixed, cSamplesRead;
+
+        uint64_t nsTs = RTTimeNanoTS();
+        rc = AudioMixBufWriteCirc(&child, paSamples, cChunk * 2 * sizeof(int16_t), &cSamplesWritten);
+        uint64_t nsNow = RTTimeNanoTS();
+        cNsWrite += nsNow - nsTs;
+        RTTESTI_CHECK_RC_OK_BREAK(rc);
+        cWritten += cSamplesWritten;
+
+        nsTs = nsNow;
+        rc = AudioMixBufMixToParent(&child, cSamplesWritten, &cSamplesMixed);
+        nsNow = RTTimeNanoTS();
+        cNsMix += nsNow - nsTs;
+        RTTESTI_CHECK_RC_OK_BREAK(rc);
+        cMixed += cSamplesMixed;
+
+        nsTs = nsNow;
+        rc = AudioMixBufReadCirc(&parent, paOut, cBufSize * 2 * sizeof(int16_t), &cSamplesRead);
+        nsNow = RTTimeNanoTS();
+        cNsRead += nsNow - nsTs;
+        RTTESTI_CHECK_RC_OK_BREAK(rc);
+        cRead += cSamplesRead;
+        AudioMixBufFinish(&parent, cSamplesRead);
+    }
+
+    RTTestValue(hTest, "Write (S16 -> internal)",  cWritten * RT_NS_1SEC / RT_MAX(cNsWrite, 1), RTTESTUNIT_OCCURRENCES_PER_SEC);
+    RTTestValue(hTest, "Mix (44.1kHz -> 48kHz)",    cMixed   * RT_NS_1SEC / RT_MAX(cNsMix,   1), RTTESTUNIT_OCCURRENCES_PER_SEC);
+    RTTestValue(hTest, "Read (internal -> S16)",   cRead    * RT_NS_1SEC / RT_MAX(cNsRead,  1), RTTESTUNIT_OCCURRENCES_PER_SEC);
+
+    RTMemFree(paSamples);
+    RTMemFree(paOut);
+    AudioMixBufDestroy(&parent);
+    AudioMixBufDestroy(&child);
+
+    return RTTestSubErrorCount(hTest) ? VERR_GENERAL_FAILURE : VINF_SUCCESS;
+}
+
 int main(int argc, char **argv)
 {
     RTR3InitExe(argc, &argv, 0);
@@ -606,6 +893,14 @@ int main(int argc, char **argv)
         rc = tstConversion16(hTest);
     if (RT_SUCCESS(rc))
         rc = tstVolume(hTest);
+    if (RT_SUCCESS(rc))
+        rc = tstVolumeStereo(hTest);
+    if (RT_SUCCESS(rc))
+        rc = tstConversionF32(hTest);
+    if (RT_SUCCESS(rc))
+        rc = tstResampling(hTest);
+    if (RT_SUCCESS(rc))
+        rc = tstBenchmark(hTest);
 
     /*
      * Summary
@@ -81,6 +81,10 @@
  */
 #define VMSVGA_IS_VALID_FIFO_REG(a_iIndex, a_offFifoMin) ( ((a_iIndex) + 1) * sizeof(uint32_t) <= (a_offFifoMin) )
 
+/** The max number of screen update rectangles collected while draining the
+ * FIFO before they are passed on to the display. */
+#define VMSVGA_MAX_PENDING_UPDATES  16
+
 
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
@@ -105,6 +109,18 @@ typedef struct
     PVMSVGAGMRDESCRIPTOR        paDesc;
 } GMR, *PGMR;
 
+/**
+ * Screen update rectangle collected by the FIFO thread, right and bottom
+ * are exclusive.
+ */
+typedef struct
+{
+    uint32_t                    xLeft;
+    uint32_t                    yTop;
+    uint32_t                    xRight;
+    uint32_t                    yBottom;
+} VMSVGAUPDATERECT, *PVMSVGAUPDATERECT;
+
 #ifdef IN_RING3
 /**
  * Internal SVGA ring-3 only state.
@@ -145,6 +161,14 @@ typedef struct VMSVGAR3STATE
     /** Tracks how much time we waste reading SVGA_REG_BUSY with a busy FIFO. */
     STAMPROFILE             StatBusyDelayEmts;
 
+    /** Number of valid entries in aPendingUpdates. */
+    uint32_t                cPendingUpdates;
+    /** Set if a FIFO progress IRQ is owed to the guest, raised once per batch. */
+    bool                    fFifoProgressIrqPending;
+    /** Screen updates from SVGA_CMD_UPDATE not yet passed on to the display,
+     * overlapping and adjacent ones merged. */
+    VMSVGAUPDATERECT        aPendingUpdates[VMSVGA_MAX_PENDING_UPDATES];
+
     STAMPROFILE             StatR3CmdPresent;
     STAMPROFILE             StatR3CmdDrawPrimitive;
     STAMPROFILE             StatR3CmdSurfaceDMA;
@@ -155,6 +179,12 @@ typedef struct VMSVGAR3STATE
     STAMCOUNTER             StatFifoTodoTimeout;
     STAMCOUNTER             StatFifoTodoWoken;
     STAMPROFILE             StatFifoStalls;
+    STAMCOUNTER             StatFifoUpdatesMerged;
+    /** Per command profiling, indexed by SVGAFifoCmdId. */
+    STAMPROFILE             aStatFifoCmd[SVGA_CMD_MAX];
+    /** Per command profiling of the 3D commands, indexed by the command id
+     * minus SVGA_3D_CMD_BASE. */
+    STAMPROFILE             aStatFifoCmd3d[SVGA_3D_CMD_MAX - SVGA_3D_CMD_BASE];
 
 } VMSVGAR3STATE, *PVMSVGAR3STATE;
 #endif /* IN_RING3 */
@@ -222,6 +252,9 @@ static SSMFIELD const g_aVMSVGAR3STATEFields[] =
     SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, hBusyDelayedEmts),
 #endif
     SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, StatBusyDelayEmts),
+    SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, cPendingUpdates),
+    SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, fFifoProgressIrqPending),
+    SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, aPendingUpdates),
     SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, StatR3CmdPresent),
     SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, StatR3CmdDrawPrimitive),
     SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, StatR3CmdSurfaceDMA),
@@ -231,6 +264,9 @@ static SSMFIELD const g_aVMSVGAR3STATEFields[] =
     SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, StatFifoTodoTimeout),
     SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, StatFifoTodoWoken),
     SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, StatFifoStalls),
+    SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, StatFifoUpdatesMerged),
+    SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, aStatFifoCmd),
+    SSMFIELD_ENTRY_IGNORE(      VMSVGAR3STATE, aStatFifoCmd3d),
     SSMFIELD_ENTRY_TERM()
 };
 
@@ -407,9 +443,11 @@ static const char *vmsvgaIndexToString(PVGASTATE pThis)
     }
 }
 
+#endif /* LOG_ENABLED */
+
 #ifdef IN_RING3
 /**
- * FIFO command name lookup
+ * FIFO command name lookup, also used for naming the statistics.
  *
  * @returns FIFO command string or "UNKNOWN"
  * @param   u32Cmd      FIFO command
@@ -526,9 +564,7 @@ static const char *vmsvgaFIFOCmdToString(uint32_t u32Cmd)
         return "UNKNOWN";
     }
 }
-# endif /* IN_RING3 */
-
-#endif /* LOG_ENABLED */
+#endif /* IN_RING3 */
 
 #ifdef IN_RING3
 /**
@@ -2271,6 +2307,140 @@ static void vmsvgaFifoSetNotBusy(PVGASTATE pThis, PVMSVGAR3STATE pSVGAState, uin
     }
 }
 
+/**
+ * Raises the given IRQs along with any FIFO progress IRQ the guest asked for.
+ *
+ * Must enter the critical section before making final decisions here,
+ * otherwise cubebench and others may end up waiting forever.
+ *
+ * @param   pThis           The VGA state.
+ * @param   pSVGAState      Pointer to the ring-3 only SVGA state data.
+ * @param   u32IrqStatus    The IRQ status bits to raise.
+ */
+static void vmsvgaFifoRaiseIrq(PVGASTATE pThis, PVMSVGAR3STATE pSVGAState, uint32_t u32IrqStatus)
+{
+    int rc2 = PDMCritSectEnter(&pThis->CritSect, VERR_IGNORED);
+    AssertRC(rc2);
+
+    pSVGAState->fFifoProgressIrqPending = false;
+
+    /* FIFO progress might trigger an interrupt. */
+    if (pThis->svga.u32IrqMask & SVGA_IRQFLAG_FIFO_PROGRESS)
+    {
+        Log(("vmsvgaFIFOLoop: fifo progress irq\n"));
+        u32IrqStatus |= SVGA_IRQFLAG_FIFO_PROGRESS;
+    }
+
+    /* Unmasked IRQ pending? */
+    if (pThis->svga.u32IrqMask & u32IrqStatus)
+    {
+        Log(("vmsvgaFIFOLoop: Trigger interrupt with status %x\n", u32IrqStatus));
+        ASMAtomicOrU32(&pThis->svga.u32IrqStatus, u32IrqStatus);
+        PDMDevHlpPCISetIrq(pThis->pDevInsR3, 0, 1);
+    }
+
+    PDMCritSectLeave(&pThis->CritSect);
+}
+
+/**
+ * Passes the collected screen updates on to the display.
+ *
+ * @param   pThis           The VGA state.
+ * @param   pSVGAState      Pointer to the ring-3 only SVGA state data.
+ */
+static void vmsvgaFifoFlushUpdates(PVGASTATE pThis, PVMSVGAR3STATE pSVGAState)
+{
+    uint32_t const cUpdates = pSVGAState->cPendingUpdates;
+    pSVGAState->cPendingUpdates = 0;
+    for (uint32_t i = 0; i < cUpdates; i++)
+    {
+        /* The mode may have changed since the update was queued. */
+        PVMSVGAUPDATERECT pRect = &pSVGAState->aPendingUpdates[i];
+        uint32_t const xRight  = RT_MIN(pRect->xRight,  pThis->svga.uWidth);
+        uint32_t const yBottom = RT_MIN(pRect->yBottom, pThis->svga.uHeight);
+        if (pRect->xLeft < xRight && pRect->yTop < yBottom)
+            vgaR3UpdateDisplay(pThis, pRect->xLeft, pRect->yTop, xRight - pRect->xLeft, yBottom - pRect->yTop);
+    }
+}
+
+/**
+ * Checks whether the queued screen updates have to be passed on before a
+ * FIFO command is executed.
+ *
+ * This is the case for fences, as the guest may reuse its framebuffer once
+ * a fence after an update has passed, and for everything reading or writing
+ * the screen contents.
+ *
+ * @returns true if vmsvgaFifoFlushUpdates() must be called first.
+ * @param   enmCmdId        The command about to be executed.
+ */
+static bool vmsvgaFifoCmdNeedsUpdatesFlushed(SVGAFifoCmdId enmCmdId)
+{
+    switch ((uint32_t)enmCmdId)
+    {
+        case SVGA_CMD_FENCE:
+        case SVGA_CMD_RECT_COPY:
+        case SVGA_CMD_FRONT_ROP_FILL:
+        case SVGA_CMD_DEFINE_SCREEN:
+        case SVGA_CMD_DESTROY_SCREEN:
+        case SVGA_CMD_BLIT_GMRFB_TO_SCREEN:
+        case SVGA_CMD_BLIT_SCREEN_TO_GMRFB:
+        case SVGA_3D_CMD_BLIT_SURFACE_TO_SCREEN:
+        case SVGA_3D_CMD_PRESENT:
+        case SVGA_3D_CMD_PRESENT_READBACK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Queues a screen update, merging it with a queued one it overlaps or
+ * touches.
+ *
+ * Guests tend to send lots of small SVGA_CMD_UPDATEs for neighbouring areas,
+ * passing each of them to the display separately costs a lock round trip
+ * and a wake-up of the frontend every time.
+ *
+ * @param   pThis           The VGA state.
+ * @param   pSVGAState      Pointer to the ring-3 only SVGA state data.
+ * @param   x               The left edge.
+ * @param   y               The top edge.
+ * @param   cx              The width.
+ * @param   cy              The height.
+ */
+static void vmsvgaFifoQueueUpdate(PVGASTATE pThis, PVMSVGAR3STATE pSVGAState, uint32_t x, uint32_t y, uint32_t cx, uint32_t cy)
+{
+    VMSVGAUPDATERECT Rect;
+    Rect.xLeft   = RT_MIN(x, pThis->svga.uWidth);
+    Rect.yTop    = RT_MIN(y, pThis->svga.uHeight);
+    Rect.xRight  = (uint32_t)RT_MIN((uint64_t)x + cx, pThis->svga.uWidth);
+    Rect.yBottom = (uint32_t)RT_MIN((uint64_t)y + cy, pThis->svga.uHeight);
+    if (Rect.xLeft >= Rect.xRight || Rect.yTop >= Rect.yBottom)
+        return;
+
+    for (uint32_t i = 0; i < pSVGAState->cPendingUpdates; i++)
+    {
+        PVMSVGAUPDATERECT pRect = &pSVGAState->aPendingUpdates[i];
+        if (   Rect.xLeft   <= pRect->xRight
+            && Rect.xRight  >= pRect->xLeft
+            && Rect.yTop    <= pRect->yBottom
+            && Rect.yBottom >= pRect->yTop)
+        {
+            pRect->xLeft   = RT_MIN(pRect->xLeft,   Rect.xLeft);
+            pRect->yTop    = RT_MIN(pRect->yTop,    Rect.yTop);
+            pRect->xRight  = RT_MAX(pRect->xRight,  Rect.xRight);
+            pRect->yBottom = RT_MAX(pRect->yBottom, Rect.yBottom);
+            STAM_REL_COUNTER_INC(&pSVGAState->StatFifoUpdatesMerged);
+            return;
+        }
+    }
+
+    if (pSVGAState->cPendingUpdates >= RT_ELEMENTS(pSVGAState->aPendingUpdates))
+        vmsvgaFifoFlushUpdates(pThis, pSVGAState);
+    pSVGAState->aPendingUpdates[pSVGAState->cPendingUpdates++] = Rect;
+}
+
 /**
  * Reads (more) payload into the command buffer.
  *
@@ -2369,6 +2539,9 @@ static void *vmsvgaFIFOGetCmdPayload(uint32_t cbPayloadReq, uint32_t volatile *p
          * Insufficient, must wait for it to arrive.
          */
 /** @todo Should clear the busy flag here to maybe encourage the guest to wake us up. */
+        /* The guest may be waiting for FIFO space before writing the rest. */
+        if (pSVGAState->fFifoProgressIrqPending)
+            vmsvgaFifoRaiseIrq(pThis, pSVGAState, 0);
         STAM_REL_PROFILE_START(&pSVGAState->StatFifoStalls, Stall);
         for (uint32_t i = 0;; i++)
         {
@@ -2431,6 +2604,7 @@ static DECLCALLBACK(int) vmsvgaFIFOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
     PVGASTATE       pThis = (PVGASTATE)pThread->pvUser;
     PVMSVGAR3STATE  pSVGAState = pThis->svga.pSvgaR3State;
     int             rc;
+    RT_NOREF(pDevIns);
 
     if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
         return VINF_SUCCESS;
@@ -2637,11 +2811,13 @@ static DECLCALLBACK(int) vmsvgaFIFOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
 
             /* First check any pending actions. */
             if (ASMBitTestAndClear(&pThis->svga.u32ActionFlags, VMSVGA_ACTION_CHANGEMODE_BIT))
+            {
+                /* The queued updates belong to the old mode. */
+                vmsvgaFifoFlushUpdates(pThis, pSVGAState);
 # ifdef VBOX_WITH_VMSVGA3D
                 vmsvga3dChangeMode(pThis);
-# else
-                {/*nothing*/}
 # endif
+            }
             /* Check for pending external commands (reset). */
             if (pThis->svga.u8FIFOExtCommand != VMSVGA_FIFO_EXTCMD_NONE)
                 break;
@@ -2652,6 +2828,15 @@ static DECLCALLBACK(int) vmsvgaFIFOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
             SVGAFifoCmdId const enmCmdId = (SVGAFifoCmdId)pFIFO[offCurrentCmd / sizeof(uint32_t)];
             LogFlow(("vmsvgaFIFOLoop: FIFO command (iCmd=0x%x) %s 0x%x\n",
                      offCurrentCmd / sizeof(uint32_t), vmsvgaFIFOCmdToString(enmCmdId), enmCmdId));
+            PSTAMPROFILE pStatCmd = NULL;
+            if ((uint32_t)enmCmdId < RT_ELEMENTS(pSVGAState->aStatFifoCmd))
+                pStatCmd = &pSVGAState->aStatFifoCmd[enmCmdId];
+            else if ((uint32_t)enmCmdId - SVGA_3D_CMD_BASE < RT_ELEMENTS(pSVGAState->aStatFifoCmd3d))
+                pStatCmd = &pSVGAState->aStatFifoCmd3d[enmCmdId - SVGA_3D_CMD_BASE];
+            if (   pSVGAState->cPendingUpdates
+                && vmsvgaFifoCmdNeedsUpdatesFlushed(enmCmdId))
+                vmsvgaFifoFlushUpdates(pThis, pSVGAState);
+            STAM_REL_PROFILE_START(pStatCmd, Cmd);
             switch (enmCmdId)
             {
             case SVGA_CMD_INVALID_CMD:
@@ -2691,7 +2876,7 @@ static DECLCALLBACK(int) vmsvgaFIFOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
                 SVGAFifoCmdUpdate *pUpdate;
                 VMSVGAFIFO_GET_CMD_BUFFER_BREAK(pUpdate, SVGAFifoCmdUpdate, sizeof(*pUpdate));
                 Log(("vmsvgaFIFOLoop: UPDATE (%d,%d)(%d,%d)\n", pUpdate->x, pUpdate->y, pUpdate->width, pUpdate->height));
-                vgaR3UpdateDisplay(pThis, pUpdate->x, pUpdate->y, pUpdate->width, pUpdate->height);
+                vmsvgaFifoQueueUpdate(pThis, pSVGAState, pUpdate->x, pUpdate->y, pUpdate->width, pUpdate->height);
                 break;
             }
 
@@ -3460,6 +3645,9 @@ static DECLCALLBACK(int) vmsvgaFIFOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
                 }
             }
 
+            if (pStatCmd)
+                STAM_REL_PROFILE_STOP(pStatCmd, Cmd);
+
             /* Go to the next slot */
             Assert(cbPayload + sizeof(uint32_t) <= offFifoMax - offFifoMin);
             offCurrentCmd += RT_ALIGN_32(cbPayload + sizeof(uint32_t), sizeof(uint32_t));
@@ -3473,35 +3661,21 @@ static DECLCALLBACK(int) vmsvgaFIFOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
             STAM_REL_COUNTER_INC(&pSVGAState->StatFifoCommands);
 
             /*
-             * Raise IRQ if required.  Must enter the critical section here
-             * before making final decisions here, otherwise cubebench and
-             * others may end up waiting forever.
+             * Raise IRQ if required.  Plain FIFO progress is reported once for
+             * the whole batch below (or before stalling on the guest) instead
+             * of taking the critical section for every command.
              */
-            if (   u32IrqStatus
-                || (pThis->svga.u32IrqMask & SVGA_IRQFLAG_FIFO_PROGRESS))
-            {
-                int rc2 = PDMCritSectEnter(&pThis->CritSect, VERR_IGNORED);
-                AssertRC(rc2);
-
-                /* FIFO progress might trigger an interrupt. */
-                if (pThis->svga.u32IrqMask & SVGA_IRQFLAG_FIFO_PROGRESS)
-                {
-                    Log(("vmsvgaFIFOLoop: fifo progress irq\n"));
-                    u32IrqStatus |= SVGA_IRQFLAG_FIFO_PROGRESS;
-                }
-
-                /* Unmasked IRQ pending? */
-                if (pThis->svga.u32IrqMask & u32IrqStatus)
-                {
-                    Log(("vmsvgaFIFOLoop: Trigger interrupt with status %x\n", u32IrqStatus));
-                    ASMAtomicOrU32(&pThis->svga.u32IrqStatus, u32IrqStatus);
-                    PDMDevHlpPCISetIrq(pDevIns, 0, 1);
-                }
-
-                PDMCritSectLeave(&pThis->CritSect);
-            }
+            if (u32IrqStatus)
+                vmsvgaFifoRaiseIrq(pThis, pSVGAState, u32IrqStatus);
+            else if (pThis->svga.u32IrqMask & SVGA_IRQFLAG_FIFO_PROGRESS)
+                pSVGAState->fFifoProgressIrqPending = true;
         }
 
+        /* Pass on the screen updates and the progress of the batch. */
+        vmsvgaFifoFlushUpdates(pThis, pSVGAState);
+        if (pSVGAState->fFifoProgressIrqPending)
+            vmsvgaFifoRaiseIrq(pThis, pSVGAState, 0);
+
         /* If really done, clear the busy flag. */
         if (fDone)
         {
@@ -4366,6 +4540,17 @@ int vmsvgaInit(PPDMDEVINS pDevIns)
     STAM_REL_REG(pVM, &pSVGAState->StatFifoTodoTimeout, STAMTYPE_COUNTER, "/Devices/VMSVGA/FifoTodoTimeout",  STAMUNIT_OCCURENCES, "Number of times we discovered pending work after a wait timeout.");
     STAM_REL_REG(pVM, &pSVGAState->StatFifoTodoWoken,   STAMTYPE_COUNTER, "/Devices/VMSVGA/FifoTodoWoken",  STAMUNIT_OCCURENCES, "Number of times we discovered pending work after being woken up.");
     STAM_REL_REG(pVM, &pSVGAState->StatFifoStalls,      STAMTYPE_PROFILE, "/Devices/VMSVGA/FifoStalls",  STAMUNIT_TICKS_PER_CALL, "Profiling of FIFO stalls (waiting for guest to finish copying data).");
+    STAM_REL_REG(pVM, &pSVGAState->StatFifoUpdatesMerged, STAMTYPE_COUNTER, "/Devices/VMSVGA/FifoUpdatesMerged",  STAMUNIT_OCCURENCES, "Number of SVGA_CMD_UPDATEs merged into a queued one.");
+    for (uint32_t i = 0; i < RT_ELEMENTS(pSVGAState->aStatFifoCmd); i++)
+        if (strcmp(vmsvgaFIFOCmdToString(i), "UNKNOWN"))
+            PDMDevHlpSTAMRegisterF(pDevIns, &pSVGAState->aStatFifoCmd[i], STAMTYPE_PROFILE, STAMVISIBILITY_USED,
+                                   STAMUNIT_TICKS_PER_CALL, "Profiling of the FIFO command.",
+                                   "/Devices/VMSVGA/FifoCmd/%s", vmsvgaFIFOCmdToString(i));
+    for (uint32_t i = 0; i < RT_ELEMENTS(pSVGAState->aStatFifoCmd3d); i++)
+        if (strcmp(vmsvgaFIFOCmdToString(SVGA_3D_CMD_BASE + i), "UNKNOWN"))
+            PDMDevHlpSTAMRegisterF(pDevIns, &pSVGAState->aStatFifoCmd3d[i], STAMTYPE_PROFILE, STAMVISIBILITY_USED,
+                                   STAMUNIT_TICKS_PER_CALL, "Profiling of the FIFO command.",
+                                   "/Devices/VMSVGA/FifoCmd/%s", vmsvgaFIFOCmdToString(SVGA_3D_CMD_BASE + i));
 
     /*
      * Info handlers.
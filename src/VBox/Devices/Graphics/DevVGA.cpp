@@ -121,6 +121,9 @@
 # include <iprt/cdefs.h>
 # include <iprt/mem.h>
 # include <iprt/ctype.h>
+# ifdef RT_ARCH_AMD64
+#  include <emmintrin.h>
+# endif
 #endif /* IN_RING3 */
 #include <iprt/assert.h>
 #include <iprt/asm.h>
@@ -2343,6 +2346,100 @@ static int vmsvga_draw_graphic(PVGASTATE pThis, bool full_update, bool fFailOnRe
 /*
  * graphic modes
  */
+/**
+ * Finds the first and the last byte which differ between a scanline in VRAM
+ * and its shadow copy.
+ *
+ * @returns true if the lines differ, false if they are identical.
+ * @param   pbNew       The scanline in VRAM.
+ * @param   pbOld       The shadow copy.
+ * @param   cb          The size of the scanline.
+ * @param   poffFirst   Where to return the offset of the first differing byte.
+ * @param   poffLast    Where to return the offset of the last differing byte.
+ */
+static bool vgaR3ScanlineDiff(const uint8_t *pbNew, const uint8_t *pbOld, uint32_t cb,
+                              uint32_t *poffFirst, uint32_t *poffLast)
+{
+    uint32_t off = 0;
+    uint32_t offFirst = UINT32_MAX;
+
+    /* Search forward for the first difference. */
+#ifdef RT_ARCH_AMD64
+    for (; off + 16 <= cb; off += 16)
+    {
+        uint32_t fDiff = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&pbNew[off]),
+                                                                      _mm_loadu_si128((const __m128i *)&pbOld[off])))
+                       & UINT32_C(0xffff);
+        if (fDiff)
+        {
+            offFirst = off + ASMBitFirstSetU32(fDiff) - 1;
+            break;
+        }
+    }
+    if (offFirst == UINT32_MAX)
+#endif
+        for (; off < cb; off++)
+            if (pbNew[off] != pbOld[off])
+            {
+                offFirst = off;
+                break;
+            }
+    if (offFirst == UINT32_MAX)
+        return false;
+
+    /* Search backward for the last one, stopping at the first. */
+    off = cb;
+#ifdef RT_ARCH_AMD64
+    for (; off >= offFirst + 16; off -= 16)
+    {
+        uint32_t fDiff = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&pbNew[off - 16]),
+                                                                      _mm_loadu_si128((const __m128i *)&pbOld[off - 16])))
+                       & UINT32_C(0xffff);
+        if (fDiff)
+        {
+            *poffFirst = offFirst;
+            *poffLast  = off - 16 + ASMBitLastSetU32(fDiff) - 1;
+            return true;
+        }
+    }
+#endif
+    while (off-- > offFirst)
+        if (pbNew[off] != pbOld[off])
+            break;
+    *poffFirst = offFirst;
+    *poffLast  = off;
+    return true;
+}
+
+/**
+ * Makes sure the scanline shadow copy fits the current mode.
+ *
+ * @returns Pointer to the shadow copy, NULL if not available.
+ * @param   pThis       VGA instance data.
+ * @param   cbLine      The size of a scanline.
+ * @param   cLines      The number of display lines.
+ * @param   pfRefill    Set to true if the shadow copy content is not valid
+ *                      and everything needs to be drawn.
+ */
+static uint8_t *vgaR3ScanlineShadowPrepare(PVGASTATE pThis, uint32_t cbLine, uint32_t cLines, bool *pfRefill)
+{
+    if (   pThis->pbScanlineShadow
+        && pThis->cbScanlineShadow == cbLine
+        && pThis->cScanlinesShadow == cLines)
+        return pThis->pbScanlineShadow;
+
+    RTMemFree(pThis->pbScanlineShadow);
+    pThis->cbScanlineShadow = 0;
+    pThis->cScanlinesShadow = 0;
+    pThis->pbScanlineShadow = (uint8_t *)RTMemAlloc((size_t)cbLine * cLines);
+    if (!pThis->pbScanlineShadow)
+        return NULL;
+    pThis->cbScanlineShadow = cbLine;
+    pThis->cScanlinesShadow = cLines;
+    *pfRefill = true;
+    return pThis->pbScanlineShadow;
+}
+
 static int vga_draw_graphic(PVGASTATE pThis, bool full_update, bool fFailOnResize, bool reset_dirty,
                 PDMIDISPLAYCONNECTOR *pDrv)
 {
@@ -2469,6 +2566,24 @@ static int vga_draw_graphic(PVGASTATE pThis, bool full_update, bool fFailOnResiz
     d = pDrv->pbData;
     linesize = pDrv->cbScanline;
 
+    /* With CompareScanlines the lines in dirty pages are compared against the
+     * shadow copy of what was drawn last time, and only the changed part of a
+     * line is drawn and reported.  Done for the packed pixel modes only, where
+     * a byte range maps directly to a pixel range.  The shadow tracks what
+     * the display driver shows, so it is not touched when drawing into some
+     * other connector (screenshots) or when the dirty bits are kept. */
+    uint8_t *pbShadow = NULL;
+    int cbDstPixel = (pDrv->cBits + 7) >> 3;
+    int x_min = disp_width;
+    int x_max = 0;
+    if (   pThis->fCompareScanlines
+        && pDrv == pThis->pDrv
+        && reset_dirty
+        && bits >= 8
+        && (pDrv->cBits == 8 || pDrv->cBits == 15 || pDrv->cBits == 16 || pDrv->cBits == 32)
+        && !pThis->cursor_draw_line)
+        pbShadow = vgaR3ScanlineShadowPrepare(pThis, bwidth, height, &full_update);
+
     y1 = 0;
     y2 = pThis->cr[0x09] & 0x1F;    /* starting row scan count */
     for(y = 0; y < height; y++) {
@@ -2490,23 +2605,53 @@ static int vga_draw_graphic(PVGASTATE pThis, bool full_update, bool fFailOnResiz
             update |= vga_is_dirty(pThis, page0 + PAGE_SIZE);
         }
         /* explicit invalidation for the hardware cursor */
-        update |= (pThis->invalidated_y_table[y >> 5] >> (y & 0x1f)) & 1;
+        bool const invalidated = (pThis->invalidated_y_table[y >> 5] >> (y & 0x1f)) & 1;
+        update |= invalidated;
+        int x_first = 0;
+        int x_end = width;
         if (update) {
-            if (y_start < 0)
-                y_start = y;
             if (page0 < page_min)
                 page_min = page0;
             if (page1 > page_max)
                 page_max = page1;
+            if (pbShadow) {
+                const uint8_t *pbLine = pThis->CTX_SUFF(vram_ptr) + addr;
+                uint8_t *pbLineShadow = pbShadow + y * bwidth;
+                uint32_t offFirst, offLast;
+                if (full_update || invalidated)
+                    memcpy(pbLineShadow, pbLine, bwidth);
+                else if (!vgaR3ScanlineDiff(pbLine, pbLineShadow, bwidth, &offFirst, &offLast))
+                    update = false;
+                else {
+                    /* The 8 bpp line drawers work in units of 8 pixels. */
+                    x_first = (offFirst * 8 / bits) & ~7;
+                    x_end = RT_MIN(RT_ALIGN_32(offLast * 8 / bits + 1, 8), (uint32_t)width);
+                    memcpy(pbLineShadow + offFirst, pbLine + offFirst, offLast - offFirst + 1);
+                }
+            }
+        }
+        if (update) {
+            if (y_start < 0)
+                y_start = y;
+            if (x_first < x_min)
+                x_min = x_first;
+            if (x_end > x_max)
+                x_max = x_end;
             if (pThis->fRenderVRAM)
-                vga_draw_line(pThis, d, pThis->CTX_SUFF(vram_ptr) + addr, width);
+                vga_draw_line(pThis, d + x_first * cbDstPixel,
+                              pThis->CTX_SUFF(vram_ptr) + addr + x_first * bits / 8, x_end - x_first);
             if (pThis->cursor_draw_line)
                 pThis->cursor_draw_line(pThis, d, y);
         } else {
             if (y_start >= 0) {
                 /* flush to display */
-                pDrv->pfnUpdateRect(pDrv, 0, y_start, disp_width, y - y_start);
+                if (pbShadow)
+                    pDrv->pfnUpdateRect(pDrv, x_min, y_start, x_max - x_min, y - y_start);
+                else
+                    pDrv->pfnUpdateRect(pDrv, 0, y_start, disp_width, y - y_start);
                 y_start = -1;
+                x_min = disp_width;
+                x_max = 0;
             }
         }
         if (!multi_run) {
@@ -2529,7 +2674,10 @@ static int vga_draw_graphic(PVGASTATE pThis, bool full_update, bool fFailOnResiz
     }
     if (y_start >= 0) {
         /* flush to display */
-        pDrv->pfnUpdateRect(pDrv, 0, y_start, disp_width, y - y_start);
+        if (pbShadow)
+            pDrv->pfnUpdateRect(pDrv, x_min, y_start, x_max - x_min, y - y_start);
+        else
+            pDrv->pfnUpdateRect(pDrv, 0, y_start, disp_width, y - y_start);
     }
     /* reset modified pages */
     if (page_max != -1 && reset_dirty) {
@@ -5934,6 +6082,11 @@ static DECLCALLBACK(int) vgaR3Destruct(PPDMDEVINS pDevIns)
         vmsvgaDestruct(pDevIns);
 #endif
 
+#ifdef VBOX_WITH_HGSMI
+    if (pThis->pHGSMI)
+        VBVADestroy(pThis);
+#endif
+
     /*
      * Free MM heap pointers.
      */
@@ -5961,6 +6114,9 @@ static DECLCALLBACK(int) vgaR3Destruct(PPDMDEVINS pDevIns)
         pThis->pszLogoFile = NULL;
     }
 
+    RTMemFree(pThis->pbScanlineShadow);
+    pThis->pbScanlineShadow = NULL;
+
     PDMR3CritSectDelete(&pThis->CritSectIRQ);
     PDMR3CritSectDelete(&pThis->CritSect);
     return VINF_SUCCESS;
@@ -6041,6 +6197,8 @@ static DECLCALLBACK(int)   vgaR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
                                           "ShowBootMenu\0"
                                           "BiosRom\0"
                                           "RealRetrace\0"
+                                          "CompareScanlines\0"
+                                          "VBVAThread\0"
                                           "CustomVideoModes\0"
                                           "HeightReduction\0"
                                           "CustomVideoMode1\0"
@@ -6587,6 +6745,21 @@ static DECLCALLBACK(int)   vgaR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
     rc = CFGMR3QueryBoolDef(pCfg, "RealRetrace", &pThis->fRealRetrace, false);
     AssertLogRelRCReturn(rc, rc);
 
+    /*
+     * Whether to compare dirty scanlines before redrawing them.  Costs a copy
+     * of the visible VRAM, saves the conversion and the display updates when
+     * a guest rewrites whole pages for small changes.
+     */
+    rc = CFGMR3QueryBoolDef(pCfg, "CompareScanlines", &pThis->fCompareScanlines, false);
+    AssertLogRelRCReturn(rc, rc);
+
+    /*
+     * Whether to consume the VBVA rings on a dedicated thread.  The display
+     * refresh then only checks the ring indexes and wakes the thread up.
+     */
+    rc = CFGMR3QueryBoolDef(pCfg, "VBVAThread", &pThis->fVBVAThread, false);
+    AssertLogRelRCReturn(rc, rc);
+
 #ifdef VBE_NEW_DYN_LIST
 
     uint16_t maxBiosXRes;
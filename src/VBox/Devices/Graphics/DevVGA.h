@@ -598,6 +598,21 @@ typedef struct VGAState {
     uint32_t                    Padding9;
 # endif
 
+    /** Shadow copy of the scanlines as last rendered by vga_draw_graphic, one
+     * cbScanlineShadow sized line per display line.  NULL if not allocated. */
+    R3PTRTYPE(uint8_t *)        pbScanlineShadow;
+    /** The size of a scanline in the shadow copy. */
+    uint32_t                    cbScanlineShadow;
+    /** The number of lines in the shadow copy. */
+    uint32_t                    cScanlinesShadow;
+    /** Whether to compare dirty scanlines against the shadow copy and only
+     * redraw the bytes which actually changed (CompareScanlines). */
+    bool                        fCompareScanlines;
+    /** Whether the VBVA rings are consumed by a dedicated thread instead of the
+     * display refresh on the EMT (VBVAThread). */
+    bool                        fVBVAThread;
+    bool                        Padding13[HC_ARCH_BITS == 64 ? 6 : 2];
+
 # ifdef VBOX_WITH_HGSMI
     /** Base port in the assigned PCI I/O space. */
     RTIOPORT                    IOPortBase;
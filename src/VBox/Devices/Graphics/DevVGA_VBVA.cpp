@@ -24,6 +24,7 @@
 #include <VBox/vmm/pdmdev.h>
 #include <VBox/vmm/pgm.h>
 #include <VBox/vmm/ssm.h>
+#include <VBox/vmm/stam.h>
 #include <VBox/VMMDev.h>
 #include <VBox/VBoxVideo.h>
 #include <iprt/alloc.h>
@@ -31,9 +32,7 @@
 #include <iprt/asm.h>
 #include <iprt/string.h>
 #include <iprt/param.h>
-#ifdef VBOX_WITH_VIDEOHWACCEL
 #include <iprt/semaphore.h>
-#endif
 
 #include "DevVGA.h"
 
@@ -102,6 +101,20 @@ typedef struct VBVACONTEXT
     uint32_t xCursor;
     uint32_t yCursor;
     VBVAMODEHINT aModeHints[VBOX_VIDEO_MAX_SCREENS];
+
+    /** The thread consuming the VBVA rings if VBVAThread is configured, NULL if
+     * the rings are flushed on the EMT by the display refresh. */
+    PPDMTHREAD pFlushThread;
+    /** The doorbell the flush thread waits on. */
+    RTSEMEVENT hFlushEvent;
+    /** Set when the doorbell was rung and the flush thread has not picked it up yet. */
+    bool volatile fFlushPending;
+
+    STAMCOUNTER StatRecords;        /**< VBVA records processed. */
+    STAMCOUNTER StatUpdates;        /**< Dirty rectangles reported, the records are coalesced into these. */
+    STAMCOUNTER StatDoorbell;       /**< Times the flush thread was woken up. */
+    STAMCOUNTER StatIdle;           /**< Display refreshes which found all rings empty. */
+    STAMPROFILE StatFlush;          /**< Ring processing on the flush thread. */
 } VBVACONTEXT;
 
 
@@ -383,7 +396,7 @@ static void vbvaReleaseCmd(VBVADATA *pVBVAData, VBVACMDHDR *pHdr, uint32_t cbCmd
     }
 }
 
-static int vbvaFlushProcess(unsigned uScreenId, PVGASTATE pVGAState, VBVADATA *pVBVAData)
+static int vbvaFlushProcess(unsigned uScreenId, PVGASTATE pVGAState, VBVACONTEXT *pCtx, VBVADATA *pVBVAData)
 {
     LOGVBVABUFFER(("uScreenId %d, indexRecordFirst = %d, indexRecordFree = %d, off32Data = %d, off32Free = %d\n",
                   uScreenId, pVBVAData->indexRecordFirst, pVBVAData->guest.pVBVA->indexRecordFree,
@@ -430,6 +443,8 @@ static int vbvaFlushProcess(unsigned uScreenId, PVGASTATE pVGAState, VBVADATA *p
 
         if (cbCmd != 0)
         {
+            STAM_REL_COUNTER_INC(&pCtx->StatRecords);
+
             if (!fUpdate)
             {
                 pVGAState->pDrv->pfnVBVAUpdateBegin(pVGAState->pDrv, uScreenId);
@@ -497,6 +512,7 @@ static int vbvaFlushProcess(unsigned uScreenId, PVGASTATE pVGAState, VBVADATA *p
                      dirtyRect.yBottom - dirtyRect.yTop));
             pVGAState->pDrv->pfnVBVAUpdateEnd(pVGAState->pDrv, uScreenId, dirtyRect.xLeft, dirtyRect.yTop,
                                               dirtyRect.xRight - dirtyRect.xLeft, dirtyRect.yBottom - dirtyRect.yTop);
+            STAM_REL_COUNTER_INC(&pCtx->StatUpdates);
         }
         else
         {
@@ -518,7 +534,7 @@ static int vbvaFlush(PVGASTATE pVGAState, VBVACONTEXT *pCtx)
 
         if (pVBVAData->guest.pVBVA)
         {
-            rc = vbvaFlushProcess(uScreenId, pVGAState, pVBVAData);
+            rc = vbvaFlushProcess(uScreenId, pVGAState, pCtx, pVBVAData);
             if (RT_FAILURE(rc))
             {
                 break;
@@ -2834,6 +2850,72 @@ void VBVAReset (PVGASTATE pVGAState)
 
 }
 
+/**
+ * Checks whether any of the enabled VBVA rings has records the host has not
+ * consumed yet.  Only reads the indexes, the records are validated when
+ * they are fetched.
+ */
+static bool vbvaHasPendingRecords(VBVACONTEXT *pCtx)
+{
+    for (unsigned uScreenId = 0; uScreenId < pCtx->cViews; uScreenId++)
+    {
+        const VBVADATA *pVBVAData = &pCtx->aViews[uScreenId].vbva;
+        if (   pVBVAData->guest.pVBVA
+            && ASMAtomicReadU32(&pVBVAData->guest.pVBVA->indexRecordFree) != pVBVAData->indexRecordFirst)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADDEV, Consumes the VBVA rings when the
+ * display refresh rings the doorbell.}
+ */
+static DECLCALLBACK(int) vbvaFlushThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    RT_NOREF(pDevIns);
+    PVGASTATE pVGAState = (PVGASTATE)pThread->pvUser;
+    VBVACONTEXT *pCtx = (VBVACONTEXT *)HGSMIContext(pVGAState->pHGSMI);
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        RTSemEventWait(pCtx->hFlushEvent, RT_INDEFINITE_WAIT);
+        if (pThread->enmState != PDMTHREADSTATE_RUNNING)
+            break;
+
+        /* Clear the flag first, records arriving while we work ring the doorbell again. */
+        ASMAtomicWriteBool(&pCtx->fFlushPending, false);
+
+        /* The ring state is shared with the enable/disable and flush requests
+         * of the guest, which run on the EMT under the device lock. */
+        int rc = PDMCritSectEnter(&pVGAState->CritSect, VERR_SEM_BUSY);
+        AssertRC(rc);
+        if (!pCtx->fPaused)
+        {
+            STAM_REL_PROFILE_START(&pCtx->StatFlush, a);
+            vbvaFlush(pVGAState, pCtx);
+            STAM_REL_PROFILE_STOP(&pCtx->StatFlush, a);
+        }
+        PDMCritSectLeave(&pVGAState->CritSect);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADWAKEUPDEV}
+ */
+static DECLCALLBACK(int) vbvaFlushThreadWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    RT_NOREF(pDevIns);
+    PVGASTATE pVGAState = (PVGASTATE)pThread->pvUser;
+    VBVACONTEXT *pCtx = (VBVACONTEXT *)HGSMIContext(pVGAState->pHGSMI);
+    return RTSemEventSignal(pCtx->hFlushEvent);
+}
+
 int VBVAUpdateDisplay (PVGASTATE pVGAState)
 {
     int rc = VERR_NOT_SUPPORTED; /* Assuming that the VGA device will have to do updates. */
@@ -2844,7 +2926,24 @@ int VBVAUpdateDisplay (PVGASTATE pVGAState)
     {
         if (!pCtx->fPaused)
         {
-            rc = vbvaFlush (pVGAState, pCtx);
+            if (pCtx->pFlushThread)
+            {
+                /* Leave the records to the flush thread, only wake it when
+                 * there is something to do so idle screens cost nothing. */
+                if (vbvaHasPendingRecords(pCtx))
+                {
+                    if (!ASMAtomicXchgBool(&pCtx->fFlushPending, true))
+                    {
+                        STAM_REL_COUNTER_INC(&pCtx->StatDoorbell);
+                        RTSemEventSignal(pCtx->hFlushEvent);
+                    }
+                }
+                else
+                    STAM_REL_COUNTER_INC(&pCtx->StatIdle);
+                rc = VINF_SUCCESS;
+            }
+            else
+                rc = vbvaFlush (pVGAState, pCtx);
 
             if (RT_SUCCESS (rc))
             {
@@ -2958,6 +3057,27 @@ int VBVAInit (PVGASTATE pVGAState)
              pCtx->fPaused = true;
              memset(pCtx->aModeHints, ~0, sizeof(pCtx->aModeHints));
              pVGAState->fHostCursorCapabilities = 0;
+             pCtx->hFlushEvent = NIL_RTSEMEVENT;
+
+             if (pVGAState->fVBVAThread)
+             {
+                 rc = RTSemEventCreate(&pCtx->hFlushEvent);
+                 if (RT_SUCCESS(rc))
+                     rc = PDMDevHlpThreadCreate(pDevIns, &pCtx->pFlushThread, pVGAState, vbvaFlushThread,
+                                                vbvaFlushThreadWakeUp, 0, RTTHREADTYPE_IO, "VBVA");
+                 if (RT_FAILURE(rc))
+                 {
+                     LogRel(("VBVA: Failed to create the flush thread (%Rrc), flushing on the EMT\n", rc));
+                     pCtx->pFlushThread = NULL;
+                     rc = VINF_SUCCESS;
+                 }
+             }
+
+             STAM_REL_REG(pVM, &pCtx->StatRecords,  STAMTYPE_COUNTER, "/Devices/VGA/VBVA/Records",  STAMUNIT_OCCURENCES,     "VBVA records processed.");
+             STAM_REL_REG(pVM, &pCtx->StatUpdates,  STAMTYPE_COUNTER, "/Devices/VGA/VBVA/Updates",  STAMUNIT_OCCURENCES,     "Dirty rectangles the VBVA records were coalesced into.");
+             STAM_REL_REG(pVM, &pCtx->StatDoorbell, STAMTYPE_COUNTER, "/Devices/VGA/VBVA/Doorbell", STAMUNIT_OCCURENCES,     "Times the VBVA flush thread was woken up.");
+             STAM_REL_REG(pVM, &pCtx->StatIdle,     STAMTYPE_COUNTER, "/Devices/VGA/VBVA/Idle",     STAMUNIT_OCCURENCES,     "Display refreshes which found all VBVA rings empty.");
+             STAM_REL_REG(pVM, &pCtx->StatFlush,    STAMTYPE_PROFILE, "/Devices/VGA/VBVA/Flush",    STAMUNIT_TICKS_PER_CALL, "Processing of the VBVA rings on the flush thread.");
          }
      }
 
@@ -2971,6 +3091,17 @@ void VBVADestroy (PVGASTATE pVGAState)
 
     if (pCtx)
     {
+        if (pCtx->pFlushThread)
+        {
+            PDMR3ThreadDestroy(pCtx->pFlushThread, NULL);
+            pCtx->pFlushThread = NULL;
+        }
+        if (pCtx->hFlushEvent != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pCtx->hFlushEvent);
+            pCtx->hFlushEvent = NIL_RTSEMEVENT;
+        }
+
         pCtx->mouseShapeInfo.fSet = false;
         RTMemFree(pCtx->mouseShapeInfo.pu8Shape);
         pCtx->mouseShapeInfo.pu8Shape = NULL;
@@ -101,6 +101,22 @@
 /** The maximum number of release log entries per device. */
 #define MAX_LOG_REL_ERRORS 1024
 
+/** @name AHCI_PORT_SDB_XXX - Completion batching state of a port (AHCIPort::fSdbState).
+ * @{ */
+/** The I/O thread submits a batch of commands, completions are signalled once at the end. */
+#define AHCI_PORT_SDB_BATCH         RT_BIT_32(0)
+/** A completion was deferred to the end of the batch. */
+#define AHCI_PORT_SDB_PENDING       RT_BIT_32(1)
+/** The coalescing timer is armed. */
+#define AHCI_PORT_SDB_TIMER         RT_BIT_32(2)
+/** @} */
+
+/**
+ * Maximum number of guest pages a request may lock for direct access by the
+ * driver below, larger requests go through the bounce buffer of the driver.
+ */
+#define AHCI_DIRECT_BUF_PAGES_MAX   1024
+
 /**
  * Maximum number of sectors to transfer in a READ/WRITE MULTIPLE request.
  * Set to 1 to disable multi-sector read support. According to the ATA
@@ -260,6 +276,13 @@ typedef struct AHCIREQ
     uint32_t                   fFlags;
     /** SCSI status code. */
     uint8_t                    u8ScsiSts;
+    /** Number of guest page mapping locks held for direct access. */
+    uint32_t                   cPgLcksDirect;
+    /** Segments referencing the locked guest memory, NULL if the request is not
+     * accessed directly by the driver below. */
+    PRTSGSEG                   paSegsDirect;
+    /** The page mapping locks, allocated together with paSegsDirect. */
+    PPGMPAGEMAPLOCK            paPgLcksDirect;
 } AHCIREQ;
 
 /**
@@ -381,6 +404,10 @@ typedef struct AHCIPort
     volatile uint32_t               u32TasksNew;
     /** Bitmap of tasks which must be redone because of a non fatal error. */
     volatile uint32_t               u32TasksRedo;
+    /** Completion batching state, AHCI_PORT_SDB_XXX. */
+    volatile uint32_t               fSdbState;
+    /** Number of queued command completions not signalled to the guest yet. */
+    volatile uint32_t               cSdbCoalesced;
 
     /** Current command slot processed.
      * Accessed by the guest by reading the CMD register.
@@ -427,6 +454,10 @@ typedef struct AHCIPort
     STAMCOUNTER                     StatBytesRead;
     /** Release statistics: Number of I/O requests processed per second. */
     STAMCOUNTER                     StatIORequestsPerSecond;
+    /** Release statistics: Number of requests accessing guest memory directly. */
+    STAMCOUNTER                     StatReqsDirect;
+    /** Release statistics: Number of completions signalled together with others. */
+    STAMCOUNTER                     StatReqsCoalesced;
 #ifdef VBOX_WITH_STATISTICS
     /** Statistics: Time to complete one request. */
     STAMPROFILE                     StatProfileProcessTime;
@@ -445,6 +476,12 @@ typedef struct AHCIPort
 
     uint32_t                        u32Alignment5;
 
+    /** Timer bounding the delay of coalesced completions - R3 ptr. */
+    PTMTIMERR3                      pTimerSdbR3;
+#if HC_ARCH_BITS == 32
+    uint32_t                        u32Alignment6;
+#endif
+
 } AHCIPort;
 /** Pointer to the state of an AHCI port. */
 typedef AHCIPort *PAHCIPort;
@@ -581,6 +618,11 @@ typedef struct AHCI
     uint32_t                        cPortsImpl;
     /** Number of usable command slots for each port. */
     uint32_t                        cCmdSlotsAvail;
+    /** Maximum number of queued command completions signalled with one interrupt,
+     * 0 or 1 disables coalescing. */
+    uint32_t                        cIntrCoalescingMax;
+    /** Maximum delay of a coalesced completion in microseconds. */
+    uint32_t                        cIntrCoalescingTimeoutUs;
 
     /** Flag whether we have written the first 4bytes in an 8byte MMIO write successfully. */
     volatile bool                   f8ByteMMIO4BytesWrittenSuccessfully;
@@ -1975,6 +2017,12 @@ static void ahciPortSwReset(PAHCIPort pAhciPort)
     pAhciPort->u32QueuedTasksFinished = 0;
     pAhciPort->u32CurrentCommandSlot = 0;
 
+    /* Drop coalesced completions, the timer must not signal them after the reset. */
+    if (pAhciPort->pTimerSdbR3)
+        TMTimerStop(pAhciPort->pTimerSdbR3);
+    ASMAtomicAndU32(&pAhciPort->fSdbState, ~AHCI_PORT_SDB_TIMER);
+    pAhciPort->cSdbCoalesced = 0;
+
     if (pAhciPort->pDrvBase)
     {
         pAhciPort->regCMD |= AHCI_PORT_CMD_CPS; /* Indicate that there is a device on that port */
@@ -3649,7 +3697,12 @@ static PAHCIREQ ahciR3ReqAlloc(PAHCIPort pAhciPort, uint32_t uTag)
     int rc = pAhciPort->pDrvMediaEx->pfnIoReqAlloc(pAhciPort->pDrvMediaEx, &hIoReq, (void **)&pAhciReq,
                                                    uTag, PDMIMEDIAEX_F_SUSPEND_ON_RECOVERABLE_ERR);
     if (RT_SUCCESS(rc))
-        pAhciReq->hIoReq = hIoReq;
+    {
+        pAhciReq->hIoReq         = hIoReq;
+        pAhciReq->cPgLcksDirect  = 0;
+        pAhciReq->paSegsDirect   = NULL;
+        pAhciReq->paPgLcksDirect = NULL;
+    }
     else
         pAhciReq = NULL;
     return pAhciReq;
@@ -3672,6 +3725,241 @@ static void ahciR3ReqFree(PAHCIPort pAhciPort, PAHCIREQ pAhciReq)
     }
 }
 
+/**
+ * Releases the guest memory locked for direct access by the driver below.
+ *
+ * @returns nothing.
+ * @param   pAhciPort    The AHCI port.
+ * @param   pAhciReq     The request to release the memory for.
+ */
+static void ahciR3DirectBufRelease(PAHCIPort pAhciPort, PAHCIREQ pAhciReq)
+{
+    PPDMDEVINS pDevIns = pAhciPort->CTX_SUFF(pDevIns);
+
+    for (uint32_t i = 0; i < pAhciReq->cPgLcksDirect; i++)
+        PDMDevHlpPhysReleasePageMappingLock(pDevIns, &pAhciReq->paPgLcksDirect[i]);
+
+    RTMemFree(pAhciReq->paSegsDirect);
+    pAhciReq->paSegsDirect   = NULL;
+    pAhciReq->paPgLcksDirect = NULL;
+    pAhciReq->cPgLcksDirect  = 0;
+}
+
+/**
+ * Locks the guest memory described by the PRDTL of the given request so the
+ * driver below can access it directly.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if the memory can't be accessed directly
+ *          (unaligned or MMIO segments, too large, PRDTL too short).
+ * @param   pAhciPort    The AHCI port.
+ * @param   pAhciReq     The request.
+ * @param   pcSegs       Where to store the number of segments on success.
+ */
+static int ahciR3DirectBufLock(PAHCIPort pAhciPort, PAHCIREQ pAhciReq, unsigned *pcSegs)
+{
+    PPDMDEVINS pDevIns = pAhciPort->CTX_SUFF(pDevIns);
+    bool       fToHost = pAhciReq->enmType == PDMMEDIAEXIOREQTYPE_READ;
+    uint32_t   cPages  = 0;
+    unsigned   cSegs   = 0;
+    int        rc      = VINF_SUCCESS;
+
+    /*
+     * Walk the PRDTL twice, the first pass checks the alignment and counts the
+     * pages to lock, the second one locks them.
+     */
+    for (unsigned iPass = 0; iPass < 2 && RT_SUCCESS(rc); iPass++)
+    {
+        RTGCPHYS GCPhysPrdtl   = pAhciReq->GCPhysPrdtl;
+        unsigned cPrdtlEntries = pAhciReq->cPrdtlEntries;
+        size_t   cbLeft        = pAhciReq->cbTransfer;
+
+        while (   cPrdtlEntries
+               && cbLeft
+               && RT_SUCCESS(rc))
+        {
+            SGLEntry aPrdtlEntries[32];
+            uint32_t cPrdtlEntriesRead = RT_MIN(cPrdtlEntries, RT_ELEMENTS(aPrdtlEntries));
+
+            PDMDevHlpPhysRead(pDevIns, GCPhysPrdtl, &aPrdtlEntries[0], cPrdtlEntriesRead * sizeof(SGLEntry));
+
+            for (uint32_t i = 0; i < cPrdtlEntriesRead && cbLeft && RT_SUCCESS(rc); i++)
+            {
+                RTGCPHYS GCPhys = AHCI_RTGCPHYS_FROM_U32(aPrdtlEntries[i].u32DBAUp, aPrdtlEntries[i].u32DBA);
+                size_t   cbSeg  = RT_MIN((aPrdtlEntries[i].u32DescInf & SGLENTRY_DESCINF_DBC) + 1, cbLeft);
+
+                /* Leave anything not sector aligned to the bounce buffer. */
+                if ((GCPhys | cbSeg) & 511)
+                {
+                    rc = VERR_NOT_SUPPORTED;
+                    break;
+                }
+                cbLeft -= cbSeg;
+
+                while (cbSeg)
+                {
+                    size_t cbPage = RT_MIN(cbSeg, PAGE_SIZE - (GCPhys & PAGE_OFFSET_MASK));
+
+                    if (iPass == 0)
+                        cPages++;
+                    else
+                    {
+                        PPGMPAGEMAPLOCK pPgLck = &pAhciReq->paPgLcksDirect[pAhciReq->cPgLcksDirect];
+                        void *pv;
+
+                        if (fToHost)
+                            rc = PDMDevHlpPhysGCPhys2CCPtr(pDevIns, GCPhys, 0, &pv, pPgLck);
+                        else
+                            rc = PDMDevHlpPhysGCPhys2CCPtrReadOnly(pDevIns, GCPhys, 0, (void const **)&pv, pPgLck);
+                        if (RT_FAILURE(rc))
+                        {
+                            rc = VERR_NOT_SUPPORTED;
+                            break;
+                        }
+                        pAhciReq->cPgLcksDirect++;
+
+                        /* Merge with the previous segment if the host mapping is contiguous. */
+                        if (   cSegs
+                            && (uint8_t *)pAhciReq->paSegsDirect[cSegs - 1].pvSeg
+                               + pAhciReq->paSegsDirect[cSegs - 1].cbSeg == (uint8_t *)pv)
+                            pAhciReq->paSegsDirect[cSegs - 1].cbSeg += cbPage;
+                        else
+                        {
+                            pAhciReq->paSegsDirect[cSegs].pvSeg = pv;
+                            pAhciReq->paSegsDirect[cSegs].cbSeg = cbPage;
+                            cSegs++;
+                        }
+                    }
+
+                    GCPhys += cbPage;
+                    cbSeg  -= cbPage;
+                }
+            }
+
+            GCPhysPrdtl   += cPrdtlEntriesRead * sizeof(SGLEntry);
+            cPrdtlEntries -= cPrdtlEntriesRead;
+        }
+
+        /* An overflow is handled by the copy path. */
+        if (RT_SUCCESS(rc) && cbLeft)
+            rc = VERR_NOT_SUPPORTED;
+
+        if (   RT_SUCCESS(rc)
+            && iPass == 0)
+        {
+            if (!cPages || cPages > AHCI_DIRECT_BUF_PAGES_MAX)
+                rc = VERR_NOT_SUPPORTED;
+            else
+            {
+                pAhciReq->paSegsDirect = (PRTSGSEG)RTMemAlloc(cPages * (sizeof(RTSGSEG) + sizeof(PGMPAGEMAPLOCK)));
+                if (pAhciReq->paSegsDirect)
+                    pAhciReq->paPgLcksDirect = (PPGMPAGEMAPLOCK)&pAhciReq->paSegsDirect[cPages];
+                else
+                    rc = VERR_NOT_SUPPORTED;
+            }
+        }
+    }
+
+    if (RT_SUCCESS(rc))
+        *pcSegs = cSegs;
+    else if (pAhciReq->paSegsDirect)
+        ahciR3DirectBufRelease(pAhciPort, pAhciReq);
+
+    return rc;
+}
+
+/**
+ * Signals completed queued commands to the guest unless the completion can be
+ * delayed to combine it with others.
+ *
+ * Completions are delayed while the I/O thread submits a batch of commands or,
+ * if configured, while other queued commands are still active on the port.
+ * In the latter case a timer bounds the delay.
+ *
+ * @returns nothing.
+ * @param   pAhciPort       The port the commands completed on.
+ * @param   cTasksOther     Number of other still active commands on the port.
+ * @param   fBatchEnd       Flag whether this is called at the end of a batch.
+ */
+static void ahciR3SdbFisSignal(PAHCIPort pAhciPort, uint32_t cTasksOther, bool fBatchEnd)
+{
+    PAHCI pAhci = pAhciPort->CTX_SUFF(pAhci);
+    uint32_t fState = ASMAtomicReadU32(&pAhciPort->fSdbState);
+
+    /* The I/O thread sends one SDB FIS for everything which completed during submission. */
+    while (   !fBatchEnd
+           && (fState & AHCI_PORT_SDB_BATCH))
+    {
+        if (ASMAtomicCmpXchgExU32(&pAhciPort->fSdbState, fState | AHCI_PORT_SDB_PENDING, fState, &fState))
+            return;
+    }
+
+    /*
+     * Combine the completion with later ones if other commands are still active.
+     * The guest CCC feature takes precedence.
+     */
+    if (   pAhci->cIntrCoalescingMax > 1
+        && cTasksOther
+        && !(   (pAhci->regHbaCccCtl & AHCI_HBA_CCC_CTL_EN)
+             && (pAhci->regHbaCccPorts & RT_BIT_32(pAhciPort->iLUN)))
+        && ASMAtomicIncU32(&pAhciPort->cSdbCoalesced) < pAhci->cIntrCoalescingMax)
+    {
+        STAM_REL_COUNTER_INC(&pAhciPort->StatReqsCoalesced);
+
+        fState = ASMAtomicReadU32(&pAhciPort->fSdbState);
+        while (!(fState & AHCI_PORT_SDB_TIMER))
+        {
+            if (ASMAtomicCmpXchgExU32(&pAhciPort->fSdbState, fState | AHCI_PORT_SDB_TIMER, fState, &fState))
+            {
+                TMTimerSetMicro(pAhciPort->pTimerSdbR3, pAhci->cIntrCoalescingTimeoutUs);
+                break;
+            }
+        }
+        return;
+    }
+
+    ASMAtomicWriteU32(&pAhciPort->cSdbCoalesced, 0);
+    ahciSendSDBFis(pAhciPort, 0, true);
+}
+
+/**
+ * @callback_method_impl{FNTMTIMERDEV, Signals coalesced completions when the delay expired.}
+ */
+static DECLCALLBACK(void) ahciR3SdbTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void *pvUser)
+{
+    RT_NOREF(pDevIns, pTimer);
+    PAHCIPort pAhciPort = (PAHCIPort)pvUser;
+
+    /* Clear the flag before checking for pending completions so a new completion rearms the timer. */
+    ASMAtomicAndU32(&pAhciPort->fSdbState, ~AHCI_PORT_SDB_TIMER);
+    if (ASMAtomicXchgU32(&pAhciPort->cSdbCoalesced, 0))
+        ahciSendSDBFis(pAhciPort, 0, true);
+}
+
+/**
+ * Signals the coalesced completions of all ports right away.
+ *
+ * Used when the VM is suspended, powered off or saved as the timer would
+ * otherwise fire only after resuming or never.
+ *
+ * @returns nothing.
+ * @param   pThis           The AHCI controller.
+ */
+static void ahciR3SdbFlushAll(PAHCI pThis)
+{
+    for (uint32_t i = 0; i < RT_ELEMENTS(pThis->ahciPort); i++)
+    {
+        PAHCIPort pAhciPort = &pThis->ahciPort[i];
+        if (!pAhciPort->pTimerSdbR3)
+            continue;
+
+        TMTimerStop(pAhciPort->pTimerSdbR3);
+        ASMAtomicAndU32(&pAhciPort->fSdbState, ~AHCI_PORT_SDB_TIMER);
+        if (ASMAtomicXchgU32(&pAhciPort->cSdbCoalesced, 0))
+            ahciSendSDBFis(pAhciPort, 0, true);
+    }
+}
+
 /**
  * Complete a data transfer task by freeing all occupied resources
  * and notifying the guest.
@@ -3691,6 +3979,9 @@ static bool ahciTransferComplete(PAHCIPort pAhciPort, PAHCIREQ pAhciReq, int rcR
 
     VBOXDD_AHCI_REQ_COMPLETED(pAhciReq, rcReq, pAhciReq->uOffset, pAhciReq->cbTransfer);
 
+    if (pAhciReq->paSegsDirect)
+        ahciR3DirectBufRelease(pAhciPort, pAhciReq);
+
     if (rcReq != VERR_PDM_MEDIAEX_IOREQ_CANCELED)
     {
         if (pAhciReq->enmType == PDMMEDIAEXIOREQTYPE_READ)
@@ -3824,11 +4115,12 @@ static bool ahciTransferComplete(PAHCIPort pAhciPort, PAHCIREQ pAhciReq, int rcR
         if (fFlags & AHCI_REQ_IS_QUEUED)
         {
             /*
-             * Always raise an interrupt after task completion; delaying
-             * this (interrupt coalescing) increases latency and has a significant
-             * impact on performance (see @bugref{5071})
+             * Raise an interrupt after task completion unless coalescing was
+             * configured explicitly; delaying it increases latency and has a
+             * significant impact on performance (see @bugref{5071}). The task is
+             * still counted as active here.
              */
-            ahciSendSDBFis(pAhciPort, 0, true);
+            ahciR3SdbFisSignal(pAhciPort, ASMAtomicReadU32(&pAhciPort->cTasksActive) - 1, false /* fBatchEnd */);
         }
         else
             ahciSendD2HFis(pAhciPort, uTag, &cmdFis[0], true);
@@ -3921,6 +4213,32 @@ static DECLCALLBACK(int) ahciR3IoReqCopyToBuf(PPDMIMEDIAEXPORT pInterface, PDMME
     return rc;
 }
 
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqQueryBuf}
+ */
+static DECLCALLBACK(int) ahciR3IoReqQueryBuf(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                             void *pvIoReqAlloc, PCRTSGSEG *ppaSegs, unsigned *pcSegs)
+{
+    RT_NOREF1(hIoReq);
+    PAHCIPort pAhciPort = RT_FROM_MEMBER(pInterface, AHCIPort, IMediaExPort);
+    PAHCIREQ pIoReq = (PAHCIREQ)pvIoReqAlloc;
+
+    /* Only plain disk reads and writes, ATAPI passthrough relies on seeing the data. */
+    if (   pIoReq->enmType != PDMMEDIAEXIOREQTYPE_READ
+        && pIoReq->enmType != PDMMEDIAEXIOREQTYPE_WRITE)
+        return VERR_NOT_SUPPORTED;
+
+    AssertReturn(!pIoReq->paSegsDirect, VERR_INVALID_STATE);
+    int rc = ahciR3DirectBufLock(pAhciPort, pIoReq, pcSegs);
+    if (RT_SUCCESS(rc))
+    {
+        STAM_REL_COUNTER_INC(&pAhciPort->StatReqsDirect);
+        *ppaSegs = pIoReq->paSegsDirect;
+    }
+
+    return rc;
+}
+
 /**
  * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqQueryDiscardRanges}
  */
@@ -4590,6 +4908,9 @@ static DECLCALLBACK(int) ahciAsyncIOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
             continue;
         }
 
+        /* Defer the completion interrupts for commands completing while submitting the others. */
+        ASMAtomicOrU32(&pAhciPort->fSdbState, AHCI_PORT_SDB_BATCH);
+
         idx = ASMBitFirstSetU32(u32Tasks);
         while (   idx
                && !pAhciPort->fPortReset)
@@ -4623,8 +4944,9 @@ static DECLCALLBACK(int) ahciAsyncIOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
             else /* !Request allocated, use on stack variant to signal the error. */
             {
                 AHCIREQ Req;
-                Req.uTag   = idx;
-                Req.fFlags = AHCI_REQ_IS_ON_STACK;
+                Req.uTag         = idx;
+                Req.fFlags       = AHCI_REQ_IS_ON_STACK;
+                Req.paSegsDirect = NULL;
 
                 bool fContinue = ahciR3CmdPrepare(pAhciPort, &Req);
                 if (fContinue)
@@ -4642,6 +4964,14 @@ static DECLCALLBACK(int) ahciAsyncIOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
             idx = ASMBitFirstSetU32(u32Tasks);
         } /* while tasks available */
 
+        /* Signal everything which completed during submission with one SDB FIS. */
+        uint32_t fSdbState = ASMAtomicReadU32(&pAhciPort->fSdbState);
+        while (!ASMAtomicCmpXchgExU32(&pAhciPort->fSdbState, fSdbState & ~(AHCI_PORT_SDB_BATCH | AHCI_PORT_SDB_PENDING),
+                                      fSdbState, &fSdbState))
+        { /* likely */ }
+        if (fSdbState & AHCI_PORT_SDB_PENDING)
+            ahciR3SdbFisSignal(pAhciPort, ASMAtomicReadU32(&pAhciPort->cTasksActive), true /* fBatchEnd */);
+
         /* Check whether a port reset was active. */
         if (   ASMAtomicReadBool(&pAhciPort->fPortReset)
             && (pAhciPort->regSCTL & AHCI_PORT_SCTL_DET) == AHCI_PORT_SCTL_DET_NINIT)
@@ -4849,6 +5179,9 @@ static DECLCALLBACK(int) ahciR3SaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
 
     Assert(!pThis->f8ByteMMIO4BytesWrittenSuccessfully);
 
+    /* The coalescing state is not saved, signal everything before the registers are. */
+    ahciR3SdbFlushAll(pThis);
+
     /* The config */
     rc = ahciR3LiveExec(pDevIns, pSSM, SSM_PASS_FINAL);
     AssertRCReturn(rc, rc);
@@ -5324,6 +5657,7 @@ static DECLCALLBACK(bool) ahciR3IsAsyncSuspendOrPowerOffDone(PPDMDEVINS pDevIns)
 
     PAHCI pThis = PDMINS_2_DATA(pDevIns, PAHCI);
     ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+    ahciR3SdbFlushAll(pThis);
     return true;
 }
 
@@ -5338,7 +5672,10 @@ static void ahciR3SuspendOrPowerOff(PPDMDEVINS pDevIns)
     if (!ahciR3AllAsyncIOIsFinished(pDevIns))
         PDMDevHlpSetAsyncNotification(pDevIns, ahciR3IsAsyncSuspendOrPowerOffDone);
     else
+    {
         ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+        ahciR3SdbFlushAll(pThis);
+    }
 }
 
 /**
@@ -5765,7 +6102,9 @@ static DECLCALLBACK(int) ahciR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFG
                                     "SecondarySlave\0"
                                     "PortCount\0"
                                     "Bootable\0"
-                                    "CmdSlotsAvail\0"))
+                                    "CmdSlotsAvail\0"
+                                    "IntrCoalescingMax\0"
+                                    "IntrCoalescingTimeoutUs\0"))
         return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
                                 N_("AHCI configuration error: unknown option specified"));
 
@@ -5814,6 +6153,24 @@ static DECLCALLBACK(int) ahciR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFG
                                    N_("AHCI configuration error: CmdSlotsAvail=%u should be at least 1"),
                                    pThis->cCmdSlotsAvail);
 
+    rc = CFGMR3QueryU32Def(pCfg, "IntrCoalescingMax", &pThis->cIntrCoalescingMax, 0);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("AHCI configuration error: failed to read IntrCoalescingMax as integer"));
+    if (pThis->cIntrCoalescingMax > AHCI_NR_COMMAND_SLOTS)
+        return PDMDevHlpVMSetError(pDevIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("AHCI configuration error: IntrCoalescingMax=%u should not exceed %u"),
+                                   pThis->cIntrCoalescingMax, AHCI_NR_COMMAND_SLOTS);
+
+    rc = CFGMR3QueryU32Def(pCfg, "IntrCoalescingTimeoutUs", &pThis->cIntrCoalescingTimeoutUs, 100);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("AHCI configuration error: failed to read IntrCoalescingTimeoutUs as integer"));
+    if (pThis->cIntrCoalescingTimeoutUs < 1)
+        pThis->cIntrCoalescingMax = 0;
+    Log(("%s: cIntrCoalescingMax=%u cIntrCoalescingTimeoutUs=%u\n", __FUNCTION__,
+         pThis->cIntrCoalescingMax, pThis->cIntrCoalescingTimeoutUs));
+
     /*
      * Initialize the instance data (everything touched by the destructor need
      * to be initialized here!).
@@ -5992,6 +6349,18 @@ static DECLCALLBACK(int) ahciR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFG
                                "Amount of data written.", "/Devices/SATA%d/Port%d/WrittenBytes", iInstance, i);
         PDMDevHlpSTAMRegisterF(pDevIns, &pAhciPort->StatIORequestsPerSecond, STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
                                "Number of processed I/O requests per second.", "/Devices/SATA%d/Port%d/IORequestsPerSecond", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pAhciPort->StatReqsDirect, STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
+                               "Number of requests transferring data without a bounce buffer.", "/Devices/SATA%d/Port%d/ReqsDirect", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pAhciPort->StatReqsCoalesced, STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
+                               "Number of completions signalled together with later ones.", "/Devices/SATA%d/Port%d/ReqsCoalesced", iInstance, i);
+
+        if (pThis->cIntrCoalescingMax > 1)
+        {
+            rc = PDMDevHlpTMTimerCreate(pDevIns, TMCLOCK_VIRTUAL, ahciR3SdbTimer, pAhciPort,
+                                        TMTIMER_FLAGS_NO_CRIT_SECT, "AHCI SDB Coalescing", &pAhciPort->pTimerSdbR3);
+            if (RT_FAILURE(rc))
+                return PDMDEV_SET_ERROR(pDevIns, rc, N_("AHCI: Failed to create the completion coalescing timer"));
+        }
 #ifdef VBOX_WITH_STATISTICS
         PDMDevHlpSTAMRegisterF(pDevIns, &pAhciPort->StatProfileProcessTime, STAMTYPE_PROFILE, STAMVISIBILITY_USED, STAMUNIT_NS_PER_CALL,
                                "Amount of time to process one request.", "/Devices/SATA%d/Port%d/ProfileProcessTime", iInstance, i);
@@ -6016,6 +6385,7 @@ static DECLCALLBACK(int) ahciR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFG
         pAhciPort->IMediaExPort.pfnIoReqCompleteNotify     = ahciR3IoReqCompleteNotify;
         pAhciPort->IMediaExPort.pfnIoReqCopyFromBuf        = ahciR3IoReqCopyFromBuf;
         pAhciPort->IMediaExPort.pfnIoReqCopyToBuf          = ahciR3IoReqCopyToBuf;
+        pAhciPort->IMediaExPort.pfnIoReqQueryBuf           = ahciR3IoReqQueryBuf;
         pAhciPort->IMediaExPort.pfnIoReqQueryDiscardRanges = ahciR3IoReqQueryDiscardRanges;
         pAhciPort->IMediaExPort.pfnIoReqStateChanged       = ahciR3IoReqStateChanged;
         pAhciPort->IMediaExPort.pfnMediumEjected           = ahciR3MediumEjected;
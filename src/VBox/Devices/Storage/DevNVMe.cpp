@@ -0,0 +1,4482 @@
+/* $Id$ */
+/** @file
+ * DevNVMe - NVM Express (NVMe) 1.2 controller emulation.
+ *
+ * The controller exposes one admin queue pair and up to QueuesSubmissionMax
+ * I/O submission and QueuesCompletionMax I/O completion queues.  Each
+ * namespace maps to one LUN which is backed by a driver implementing
+ * PDMIMEDIAEX (usually DrvVD).
+ *
+ * Doorbell writes for the I/O queues are handled in R0/RC without going to
+ * ring-3.  A submission queue doorbell only publishes the new tail and kicks
+ * the worker thread the queue is assigned to, the worker then fetches the
+ * commands from guest memory and hands them to the driver below.  Admin
+ * commands are rare and are processed on the EMT in ring-3.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_DEV_NVME
+#include <VBox/vmm/pdmdev.h>
+#include <VBox/vmm/pdmstorageifs.h>
+#include <VBox/vmm/pdmqueue.h>
+#include <VBox/vmm/pdmthread.h>
+#include <VBox/vmm/pdmcritsect.h>
+#include <VBox/msi.h>
+#include <VBox/sup.h>
+#ifdef VBOX_IN_EXTPACK_R3
+# include <VBox/version.h>
+#endif
+#include <iprt/assert.h>
+#include <iprt/asm.h>
+#include <iprt/string.h>
+#include <iprt/list.h>
+#ifdef IN_RING3
+# include <iprt/mem.h>
+# include <iprt/mp.h>
+# include <iprt/param.h>
+# include <iprt/semaphore.h>
+# include <iprt/sg.h>
+# include <iprt/uuid.h>
+#endif
+
+#include "VBoxDD.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The current saved state version. */
+#define NVME_SAVED_STATE_VERSION                    1
+
+/** The PCI vendor ID (Oracle). */
+#define NVME_PCI_VENDOR_ID                          0x80ee
+/** The PCI device ID. */
+#define NVME_PCI_DEVICE_ID                          0x4e56
+
+/** The PCI region holding the register set and the doorbells. */
+#define NVME_PCI_REGION_MMIO                        0
+/** The PCI region holding the Index/Data I/O port pair. */
+#define NVME_PCI_REGION_IO                          2
+/** The PCI region holding the MSI-X table and PBA. */
+#define NVME_PCI_REGION_MSIX                        4
+/** Offset of the MSI-X capability in the PCI config space. */
+#define NVME_PCI_MSIX_CAP_OFFSET                    0x80
+
+/** The NVMe version we implement (1.2). */
+#define NVME_VERSION                                UINT32_C(0x00010200)
+
+/** Maximum number of interrupt vectors. */
+#define NVME_INTR_VEC_MAX                           VBOX_MSIX_MAX_ENTRIES
+/** Maximum number of namespaces. */
+#define NVME_NAMESPACES_MAX                         64
+/** Maximum number of I/O submission queues (not counting the admin queue). */
+#define NVME_QUEUES_MAX                             1024
+/** Maximum number of I/O completion queues, each has its own interrupt vector
+ * and vector 0 belongs to the admin completion queue. */
+#define NVME_QUEUES_COMP_MAX                        (NVME_INTR_VEC_MAX - 1)
+/** Maximum number of entries in a queue. */
+#define NVME_QUEUE_ENTRIES_MAX                      _64K
+/** Maximum number of worker threads. */
+#define NVME_WRK_THRDS_MAX                          64
+/** Maximum number of outstanding asynchronous event requests. */
+#define NVME_ASYNC_EVT_REQS_MAX                     16
+/** Number of submission queue entries a worker fetches in one go. */
+#define NVME_SUBM_QUEUE_BATCH                       16
+
+/** Maximum data transfer size as power of two in units of the minimum page size
+ * (4KB << 5 = 128KB). */
+#define NVME_MDTS                                   5
+/** Maximum number of PRP entries a command can reference (MDTS sized transfer
+ * not aligned to a page boundary). */
+#define NVME_PRPS_MAX                               ((1 << NVME_MDTS) + 1)
+/** The minimum memory page size in bytes. */
+#define NVME_PAGE_SIZE_MIN                          _4K
+/** Maximum memory page size setting supported (4KB << 4 = 64KB). */
+#define NVME_MPS_MAX                                4
+
+/** Size of the serial number string. */
+#define NVME_SERIAL_NUMBER_LENGTH                   20
+/** Size of the model number string. */
+#define NVME_MODEL_NUMBER_LENGTH                    40
+/** Size of the firmware revision string. */
+#define NVME_FIRMWARE_REVISION_LENGTH               8
+
+/** @name Controller registers.
+ * @{ */
+#define NVME_REG_CAP                                0x00
+#define NVME_REG_VS                                 0x08
+#define NVME_REG_INTMS                              0x0c
+#define NVME_REG_INTMC                              0x10
+#define NVME_REG_CC                                 0x14
+#define NVME_REG_CSTS                               0x1c
+#define NVME_REG_NSSR                               0x20
+#define NVME_REG_AQA                                0x24
+#define NVME_REG_ASQ                                0x28
+#define NVME_REG_ACQ                                0x30
+/** Start of the doorbell registers. */
+#define NVME_REG_DOORBELL_FIRST                     0x1000
+/** @} */
+
+/** @name CAP register fields.
+ * @{ */
+#define NVME_CAP_MQES_SET(a)                        ((uint64_t)((a) & 0xffff))
+#define NVME_CAP_CQR                                RT_BIT_64(16)
+#define NVME_CAP_AMS_WRR                            RT_BIT_64(17)
+#define NVME_CAP_TO_SET(a)                          ((uint64_t)((a) & 0xff) << 24)
+#define NVME_CAP_DSTRD_SET(a)                       ((uint64_t)((a) & 0xf) << 32)
+#define NVME_CAP_CSS_NVM                            RT_BIT_64(37)
+#define NVME_CAP_MPSMIN_SET(a)                      ((uint64_t)((a) & 0xf) << 48)
+#define NVME_CAP_MPSMAX_SET(a)                      ((uint64_t)((a) & 0xf) << 52)
+/** @} */
+
+/** @name CC register fields.
+ * @{ */
+#define NVME_CC_EN                                  RT_BIT_32(0)
+#define NVME_CC_CSS_GET(a)                          (((a) >> 4) & 0x7)
+#define NVME_CC_CSS_SET(a)                          (((a) & 0x7) << 4)
+#define NVME_CC_MPS_GET(a)                          (((a) >> 7) & 0xf)
+#define NVME_CC_MPS_SET(a)                          (((a) & 0xf) << 7)
+#define NVME_CC_AMS_GET(a)                          (((a) >> 11) & 0x7)
+#define NVME_CC_AMS_SET(a)                          (((a) & 0x7) << 11)
+#define NVME_CC_SHN_GET(a)                          (((a) >> 14) & 0x3)
+#define NVME_CC_SHN_SET(a)                          (((a) & 0x3) << 14)
+#define NVME_CC_IOSQES_GET(a)                       (((a) >> 16) & 0xf)
+#define NVME_CC_IOSQES_SET(a)                       (((a) & 0xf) << 16)
+#define NVME_CC_IOCQES_GET(a)                       (((a) >> 20) & 0xf)
+#define NVME_CC_IOCQES_SET(a)                       (((a) & 0xf) << 20)
+/** The only command set we support. */
+#define NVME_CC_CSS_NVM                             0
+/** @} */
+
+/** @name CSTS register fields.
+ * @{ */
+#define NVME_CSTS_RDY                               RT_BIT_32(0)
+#define NVME_CSTS_CFS                               RT_BIT_32(1)
+#define NVME_CSTS_SHST_COMPLETE                     (2 << 2)
+/** @} */
+
+/** @name AQA register fields.
+ * @{ */
+#define NVME_AQA_ASQS_GET(a)                        ((a) & 0xfff)
+#define NVME_AQA_ACQS_GET(a)                        (((a) >> 16) & 0xfff)
+/** @} */
+
+/** Size of a submission queue entry as power of two. */
+#define NVME_SUBM_QUEUE_ENTRY_SIZE_LOG2             6
+/** Size of a completion queue entry as power of two. */
+#define NVME_COMP_QUEUE_ENTRY_SIZE_LOG2             4
+
+/** @name Admin command set opcodes.
+ * @{ */
+#define NVME_ADM_OPC_SQ_DELETE                      0x00
+#define NVME_ADM_OPC_SQ_CREATE                      0x01
+#define NVME_ADM_OPC_GET_LOG_PAGE                   0x02
+#define NVME_ADM_OPC_CQ_DELETE                      0x04
+#define NVME_ADM_OPC_CQ_CREATE                      0x05
+#define NVME_ADM_OPC_IDENTIFY                       0x06
+#define NVME_ADM_OPC_ABORT                          0x08
+#define NVME_ADM_OPC_SET_FEATURES                   0x09
+#define NVME_ADM_OPC_GET_FEATURES                   0x0a
+#define NVME_ADM_OPC_ASYNC_EVT_REQ                  0x0c
+/** @} */
+
+/** @name NVM command set opcodes.
+ * @{ */
+#define NVME_NVM_OPC_FLUSH                          0x00
+#define NVME_NVM_OPC_WRITE                          0x01
+#define NVME_NVM_OPC_READ                           0x02
+#define NVME_NVM_OPC_DATASET_MANAGEMENT             0x09
+/** @} */
+
+/** @name Feature identifiers.
+ * @{ */
+#define NVME_FEAT_ARBITRATION                       0x01
+#define NVME_FEAT_POWER_MANAGEMENT                  0x02
+#define NVME_FEAT_TEMPERATURE_THRESHOLD             0x04
+#define NVME_FEAT_ERROR_RECOVERY                    0x05
+#define NVME_FEAT_VOLATILE_WRITE_CACHE              0x06
+#define NVME_FEAT_NUMBER_OF_QUEUES                  0x07
+#define NVME_FEAT_INTR_COALESCING                   0x08
+#define NVME_FEAT_INTR_VEC_CONFIG                   0x09
+#define NVME_FEAT_WRITE_ATOMICITY                   0x0a
+#define NVME_FEAT_ASYNC_EVT_CONFIG                  0x0b
+/** Number of features we keep track of (indexed by the identifier). */
+#define NVME_FEAT_COUNT                             0x0c
+/** @} */
+
+/** @name Status code types.
+ * @{ */
+#define NVME_SCT_GENERIC                            0
+#define NVME_SCT_CMD_SPECIFIC                       1
+#define NVME_SCT_MEDIA_ERROR                        2
+/** @} */
+
+/** @name Generic command status codes.
+ * @{ */
+#define NVME_SC_SUCCESS                             0x00
+#define NVME_SC_INVALID_OPCODE                      0x01
+#define NVME_SC_INVALID_FIELD                       0x02
+#define NVME_SC_CMD_ID_CONFLICT                     0x03
+#define NVME_SC_DATA_XFER_ERROR                     0x04
+#define NVME_SC_INTERNAL_ERROR                      0x06
+#define NVME_SC_ABORT_REQUESTED                     0x07
+#define NVME_SC_ABORT_SQ_DELETED                    0x08
+#define NVME_SC_INVALID_NS_OR_FMT                   0x0b
+#define NVME_SC_INVALID_PRP_OFFSET                  0x13
+#define NVME_SC_LBA_OUT_OF_RANGE                    0x80
+/** @} */
+
+/** @name Command specific status codes.
+ * @{ */
+#define NVME_SC_CS_COMP_QUEUE_INVALID               0x00
+#define NVME_SC_CS_QUEUE_ID_INVALID                 0x01
+#define NVME_SC_CS_QUEUE_SIZE_INVALID               0x02
+#define NVME_SC_CS_ABORT_CMD_LIMIT_EXCEEDED         0x03
+#define NVME_SC_CS_ASYNC_EVT_REQ_LIMIT_EXCEEDED     0x05
+#define NVME_SC_CS_INTR_VEC_INVALID                 0x08
+#define NVME_SC_CS_LOG_PAGE_INVALID                 0x09
+#define NVME_SC_CS_QUEUE_DELETION_INVALID           0x0c
+#define NVME_SC_CS_FEAT_NOT_SAVEABLE                0x0d
+#define NVME_SC_CS_ATTEMPTED_WRITE_TO_RO_RANGE      0x82
+/** @} */
+
+/** @name Media error status codes.
+ * @{ */
+#define NVME_SC_MEDIA_WRITE_FAULT                   0x80
+#define NVME_SC_MEDIA_UNRECOVERED_READ_ERROR        0x81
+/** @} */
+
+/** Builds the status field of a completion queue entry (without the phase tag). */
+#define NVME_STS_MAKE(a_uSct, a_uSc)                ((uint16_t)(((a_uSct) << 9) | ((a_uSc) << 1)))
+/** Success status. */
+#define NVME_STS_SUCCESS                            NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_SUCCESS)
+
+/** Combines the submission queue ID and the command ID into a unique I/O request ID. */
+#define NVME_IOREQID_MAKE(a_u16SqId, a_u16Cid)      ( ((PDMMEDIAEXIOREQID)(a_u16SqId) << 16) | (a_u16Cid) )
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+
+/**
+ * Controller state.
+ */
+typedef enum NVMESTATE
+{
+    /** Invalid state. */
+    NVMESTATE_INVALID = 0,
+    /** Disabled (CC.EN = 0). */
+    NVMESTATE_DISABLED,
+    /** Enabled and ready to process commands. */
+    NVMESTATE_READY,
+    /** A fatal error occurred (CSTS.CFS = 1) and the controller needs a reset. */
+    NVMESTATE_FATAL,
+    /** 32bit hack. */
+    NVMESTATE_32BIT_HACK = 0x7fffffff
+} NVMESTATE;
+
+/**
+ * Queue type.
+ */
+typedef enum NVMEQUEUETYPE
+{
+    /** Invalid type. */
+    NVMEQUEUETYPE_INVALID = 0,
+    /** Submission queue. */
+    NVMEQUEUETYPE_SUBMISSION,
+    /** Completion queue. */
+    NVMEQUEUETYPE_COMPLETION,
+    /** 32bit hack. */
+    NVMEQUEUETYPE_32BIT_HACK = 0x7fffffff
+} NVMEQUEUETYPE;
+
+/**
+ * Queue state.
+ */
+typedef enum NVMEQUEUESTATE
+{
+    /** Invalid state. */
+    NVMEQUEUESTATE_INVALID = 0,
+    /** The queue is not allocated by the guest. */
+    NVMEQUEUESTATE_DEALLOCATED,
+    /** The queue was created by the guest and is active. */
+    NVMEQUEUESTATE_ALLOCATED,
+    /** 32bit hack. */
+    NVMEQUEUESTATE_32BIT_HACK = 0x7fffffff
+} NVMEQUEUESTATE;
+
+/**
+ * Submission queue priority (only used with weighted round robin arbitration).
+ */
+typedef enum NVMEQUEUESUBMPRIO
+{
+    /** Invalid priority. */
+    NVMEQUEUESUBMPRIO_INVALID = 0,
+    /** Urgent. */
+    NVMEQUEUESUBMPRIO_URGENT,
+    /** High. */
+    NVMEQUEUESUBMPRIO_HIGH,
+    /** Medium. */
+    NVMEQUEUESUBMPRIO_MEDIUM,
+    /** Low. */
+    NVMEQUEUESUBMPRIO_LOW,
+    /** 32bit hack. */
+    NVMEQUEUESUBMPRIO_32BIT_HACK = 0x7fffffff
+} NVMEQUEUESUBMPRIO;
+
+/**
+ * Submission queue entry (64 bytes).
+ */
+#pragma pack(1)
+typedef struct NVMECMD
+{
+    /** Opcode. */
+    uint8_t             u8Opc;
+    /** Fused operation and PRP/SGL selection. */
+    uint8_t             u8Flags;
+    /** Command identifier. */
+    uint16_t            u16Cid;
+    /** Namespace identifier. */
+    uint32_t            u32Nsid;
+    /** Reserved. */
+    uint32_t            au32Rsvd[2];
+    /** Metadata pointer. */
+    uint64_t            u64MPtr;
+    /** PRP entry 1. */
+    uint64_t            u64Prp1;
+    /** PRP entry 2. */
+    uint64_t            u64Prp2;
+    /** Command specific dwords 10 to 15. */
+    uint32_t            au32Cdw[6];
+} NVMECMD;
+#pragma pack()
+AssertCompileSize(NVMECMD, 1 << NVME_SUBM_QUEUE_ENTRY_SIZE_LOG2);
+/** Pointer to a submission queue entry. */
+typedef NVMECMD *PNVMECMD;
+/** Pointer to a const submission queue entry. */
+typedef const NVMECMD *PCNVMECMD;
+/** Accessor for command dword 10 to 15. */
+#define NVME_CMD_CDW(a_pCmd, a_iDw)                 ((a_pCmd)->au32Cdw[(a_iDw) - 10])
+
+/**
+ * Completion queue entry (16 bytes).
+ */
+#pragma pack(1)
+typedef struct NVMECQE
+{
+    /** Command specific dword 0. */
+    uint32_t            u32Dw0;
+    /** Reserved. */
+    uint32_t            u32Rsvd;
+    /** Submission queue head pointer. */
+    uint16_t            u16SqHead;
+    /** Submission queue identifier. */
+    uint16_t            u16SqId;
+    /** Command identifier. */
+    uint16_t            u16Cid;
+    /** Status field and phase tag. */
+    uint16_t            u16Sts;
+} NVMECQE;
+#pragma pack()
+AssertCompileSize(NVMECQE, 1 << NVME_COMP_QUEUE_ENTRY_SIZE_LOG2);
+/** Pointer to a completion queue entry. */
+typedef NVMECQE *PNVMECQE;
+
+/**
+ * Common queue header.
+ */
+typedef struct NVMEQUEUEHDR
+{
+    /** Queue identifier. */
+    uint16_t                    u16Id;
+    /** Alignment. */
+    uint16_t                    u16Alignment0;
+    /** Number of entries in the queue. */
+    uint32_t                    cEntries;
+    /** The queue state. */
+    volatile NVMEQUEUESTATE     enmState;
+    /** Alignment. */
+    uint32_t                    u32Alignment1;
+    /** Guest physical base address of the queue. */
+    RTGCPHYS                    GCPhysBase;
+    /** Size of one entry in bytes. */
+    uint32_t                    cbEntry;
+    /** Head index. */
+    volatile uint32_t           idxHead;
+    /** Tail index. */
+    volatile uint32_t           idxTail;
+    /** Flag whether the queue is physically contiguous (always true currently). */
+    bool                        fPhysCont;
+    /** Alignment. */
+    bool                        afAlignment2[3];
+    /** The queue type. */
+    NVMEQUEUETYPE               enmType;
+    /** Alignment. */
+    uint32_t                    u32Alignment3;
+} NVMEQUEUEHDR;
+AssertCompileSizeAlignment(NVMEQUEUEHDR, 8);
+/** Pointer to a queue header. */
+typedef NVMEQUEUEHDR *PNVMEQUEUEHDR;
+
+/** Pointer to a worker thread. */
+typedef struct NVMEWRKTHRD *PNVMEWRKTHRD;
+
+/**
+ * Submission queue.
+ */
+typedef struct NVMEQUEUESUBM
+{
+    /** Common queue header. */
+    NVMEQUEUEHDR                Hdr;
+    /** The completion queue the completions are posted to. */
+    uint16_t                    u16CompletionQueueId;
+    /** Alignment. */
+    uint16_t                    u16Alignment0;
+    /** Priority of the queue. */
+    NVMEQUEUESUBMPRIO           enmPriority;
+    /** The event semaphore of the worker thread processing this queue (copy of
+     * NVMEWRKTHRD::hEvtProcess so it can be signalled from R0). */
+    SUPSEMEVENT                 hEvtProcess;
+    /** The worker thread processing this queue - R3 pointer. */
+    R3PTRTYPE(PNVMEWRKTHRD)     pWrkThrdR3;
+    /** List node for the list of queues assigned to the worker thread. */
+    RTLISTNODER3                NdLstWrkThrdAssgnd;
+    /** Number of requests active for this queue. */
+    volatile uint32_t           cReqsActive;
+    /** Generation of the queue, incremented whenever the queue is deleted so
+     * completions of requests for a previous incarnation are dropped. */
+    volatile uint32_t           uGen;
+    /** Flag whether the guest is deleting the queue, the active requests complete
+     * with NVME_SC_ABORT_SQ_DELETED. */
+    volatile bool               fAborting;
+    /** Flag whether the completion of the delete command waits for the active
+     * requests, see nvmeR3SubmQueueDeleteComplete(). */
+    volatile bool               fDeletePending;
+    /** The command ID of the pending delete command. */
+    uint16_t                    u16CidDelete;
+    /** The generation of the admin submission queue when the pending delete
+     * command was fetched. */
+    uint32_t                    uGenAdmDelete;
+    /** List of active requests (NVMEREQ) for aborting them when the queue is deleted. */
+    RTLISTANCHORR3              LstReqsActive;
+    /** Mutex protecting the list of active requests. */
+    RTSEMFASTMUTEX              hMtxReqs;
+} NVMEQUEUESUBM;
+AssertCompileSizeAlignment(NVMEQUEUESUBM, 8);
+/** Pointer to a submission queue. */
+typedef NVMEQUEUESUBM *PNVMEQUEUESUBM;
+
+/**
+ * Completion queue.
+ */
+typedef struct NVMEQUEUECOMP
+{
+    /** Common queue header. */
+    NVMEQUEUEHDR                Hdr;
+    /** Flag whether interrupts are enabled for this queue. */
+    bool                        fIntrEnabled;
+    /** The current phase tag to post completions with. */
+    bool                        fPhase;
+    /** Flag whether an interrupt is pending for this queue, protected by
+     * NVME::CritSectIntr. */
+    volatile bool               fIntrPending;
+    /** Alignment. */
+    bool                        fAlignment0;
+    /** The interrupt vector assigned to this queue. */
+    uint32_t                    u32IntrVec;
+    /** Number of submission queues using this completion queue. */
+    volatile uint32_t           cSubmQueuesRef;
+    /** Number of completions waiting for room in the queue. */
+    volatile uint32_t           cWaiters;
+    /** List of completions waiting for room in the queue (NVMECOMPWAITER). */
+    RTLISTANCHORR3              LstCompletionsWaiting;
+    /** Mutex protecting the tail index and the waiting list. */
+    RTSEMFASTMUTEX              hMtx;
+} NVMEQUEUECOMP;
+AssertCompileSizeAlignment(NVMEQUEUECOMP, 8);
+/** Pointer to a completion queue. */
+typedef NVMEQUEUECOMP *PNVMEQUEUECOMP;
+
+/**
+ * A completion waiting for room in the completion queue.
+ */
+typedef struct NVMECOMPWAITER
+{
+    /** List node. */
+    RTLISTNODE                  NdLstWait;
+    /** The completion queue entry to post (without the phase tag). */
+    NVMECQE                     Cqe;
+} NVMECOMPWAITER;
+/** Pointer to a waiting completion. */
+typedef NVMECOMPWAITER *PNVMECOMPWAITER;
+
+/** Pointer to the controller instance data. */
+typedef struct NVME *PNVME;
+
+/**
+ * Worker thread processing one or more submission queues.
+ */
+typedef struct NVMEWRKTHRD
+{
+    /** List node for the list of worker threads. */
+    RTLISTNODE                  NdLstWrkThrds;
+    /** The PDM thread handle. */
+    R3PTRTYPE(PPDMTHREAD)       pThrd;
+    /** The owning controller. */
+    R3PTRTYPE(PNVME)            pNvmeR3;
+    /** Event semaphore the thread waits on for work. */
+    SUPSEMEVENT                 hEvtProcess;
+    /** Mutex protecting the list of assigned submission queues. */
+    RTSEMFASTMUTEX              hMtx;
+    /** List of submission queues assigned to this thread (NVMEQUEUESUBM). */
+    RTLISTANCHOR                LstSubmQueues;
+    /** Number of submission queues assigned. */
+    volatile uint32_t           cSubmQueues;
+} NVMEWRKTHRD;
+
+/**
+ * Item for waking up a worker thread from RC.
+ */
+typedef struct NVMEWAKEITEM
+{
+    /** Core part owned by the queue manager. */
+    PDMQUEUEITEMCORE            Core;
+    /** The submission queue which got new entries. */
+    uint16_t                    u16SqId;
+} NVMEWAKEITEM;
+/** Pointer to a wakeup item. */
+typedef NVMEWAKEITEM *PNVMEWAKEITEM;
+
+/**
+ * A namespace (one LUN).
+ */
+typedef struct NVMENAMESPACE
+{
+    /** The owning controller - R3 pointer. */
+    R3PTRTYPE(PNVME)            pNvmeR3;
+    /** The namespace ID (LUN + 1). */
+    uint32_t                    u32Id;
+    /** Number of outstanding requests. */
+    volatile uint32_t           cOutstandingRequests;
+    /** Our base interface. */
+    PDMIBASE                    IBase;
+    /** Media port interface. */
+    PDMIMEDIAPORT               IMediaPort;
+    /** Extended media port interface. */
+    PDMIMEDIAEXPORT             IMediaExPort;
+    /** Led interface. */
+    PDMILEDPORTS                ILed;
+    /** Pointer to the attached driver's base interface. */
+    R3PTRTYPE(PPDMIBASE)        pDrvBase;
+    /** Pointer to the attached driver's media interface. */
+    R3PTRTYPE(PPDMIMEDIA)       pDrvMedia;
+    /** Pointer to the attached driver's extended media interface. */
+    R3PTRTYPE(PPDMIMEDIAEX)     pDrvMediaEx;
+    /** The status LED state for this namespace. */
+    PDMLED                      Led;
+    /** Size of the namespace in logical blocks. */
+    uint64_t                    cBlocks;
+    /** Size of a logical block in bytes. */
+    uint32_t                    cbBlock;
+    /** Flag whether the medium is read-only. */
+    bool                        fReadOnly;
+    /** Flag whether the driver supports discarding blocks. */
+    bool                        fDiscard;
+} NVMENAMESPACE;
+/** Pointer to a namespace. */
+typedef NVMENAMESPACE *PNVMENAMESPACE;
+
+/**
+ * Device instance data of the NVMe controller.
+ */
+typedef struct NVME
+{
+    /** PCI device structure. */
+    PDMPCIDEV                       PciDev;
+    /** Pointer to the device instance - R3 ptr. */
+    PPDMDEVINSR3                    pDevInsR3;
+    /** Pointer to the device instance - R0 ptr. */
+    PPDMDEVINSR0                    pDevInsR0;
+    /** Pointer to the device instance - RC ptr. */
+    PPDMDEVINSRC                    pDevInsRC;
+#if HC_ARCH_BITS == 64
+    uint32_t                        Alignment0;
+#endif
+
+    /** The base interface (status LUN). */
+    PDMIBASE                        IBase;
+    /** Leds interface. */
+    PDMILEDPORTS                    ILeds;
+    /** Status LUN: Partner of ILeds. */
+    R3PTRTYPE(PPDMILEDCONNECTORS)   pLedsConnector;
+    /** Status LUN: Media notifications. */
+    R3PTRTYPE(PPDMIMEDIANOTIFY)     pMediaNotify;
+    /** The support driver session handle. */
+    R3R0PTRTYPE(PSUPDRVSESSION)     pSupDrvSession;
+
+    /** Guest physical address of the MMIO region. */
+    RTGCPHYS                        GCPhysMMIO;
+    /** The base of the Index/Data I/O port pair. */
+    RTIOPORT                        IOPortBase;
+    /** Alignment. */
+    uint16_t                        u16Alignment1;
+
+    /** @name Configuration.
+     * @{ */
+    /** Maximum number of I/O submission queues. */
+    uint32_t                        cQueuesSubmMax;
+    /** Maximum number of I/O completion queues. */
+    uint32_t                        cQueuesCompMax;
+    /** Maximum number of entries per queue. */
+    uint32_t                        cQueueEntriesMax;
+    /** Worst case time in 500ms units until the controller is ready. */
+    uint32_t                        cTimeoutMax;
+    /** Maximum number of worker threads. */
+    uint32_t                        cWrkThrdsMax;
+    /** Number of completions waiting on a completion queue before the
+     * submission queues feeding it are throttled. */
+    uint32_t                        cCompQueuesWaitersMax;
+    /** Number of namespaces. */
+    uint32_t                        cNamespaces;
+    /** The serial number (space padded, not terminated). */
+    char                            szSerialNumber[NVME_SERIAL_NUMBER_LENGTH + 1];
+    /** The model number (space padded, not terminated). */
+    char                            szModelNumber[NVME_MODEL_NUMBER_LENGTH + 1];
+    /** The firmware revision (space padded, not terminated). */
+    char                            szFirmwareRevision[NVME_FIRMWARE_REVISION_LENGTH + 1];
+    /** Flag whether the RC part is enabled. */
+    bool                            fRCEnabled;
+    /** Flag whether the R0 part is enabled. */
+    bool                            fR0Enabled;
+    /** @} */
+
+    /** @name Register state.
+     * @{ */
+    /** The controller state (CC.EN, CSTS.RDY and CSTS.CFS). */
+    volatile NVMESTATE              enmState;
+    /** The interrupt mask (INTMS/INTMC), only used with pin based interrupts. */
+    volatile uint32_t               u32IntrMask;
+    /** Number of completion queues with a pending interrupt per vector. */
+    volatile uint32_t               aIntrVecs[NVME_INTR_VEC_MAX];
+    /** I/O completion queue entry size as power of two (CC.IOCQES). */
+    uint32_t                        u32IoCompletionQueueEntrySize;
+    /** I/O submission queue entry size as power of two (CC.IOSQES). */
+    uint32_t                        u32IoSubmissionQueueEntrySize;
+    /** The last shutdown notification (CC.SHN). */
+    uint8_t                         uShutdwnNotifierLast;
+    /** The arbitration mechanism selected (CC.AMS). */
+    uint8_t                         uAmsSet;
+    /** The memory page size selected (CC.MPS). */
+    uint8_t                         uMpsSet;
+    /** The command set selected (CC.CSS). */
+    uint8_t                         uCssSet;
+    /** The register index selected through the Index/Data I/O port pair. */
+    uint32_t                        u32RegIdx;
+    /** The memory page size in bytes derived from CC.MPS. */
+    uint32_t                        cbPage;
+    /** Flag whether the INTx line is currently asserted. */
+    bool                            fIntxAsserted;
+    /** Alignment. */
+    bool                            afAlignment2[3];
+    /** The feature values (indexed by the feature identifier). */
+    uint32_t                        au32Features[NVME_FEAT_COUNT];
+    /** @} */
+
+    /** Submission queues (index 0 is the admin queue) - R3 pointer. */
+    R3PTRTYPE(PNVMEQUEUESUBM)       paQueuesSubmR3;
+    /** Completion queues (index 0 is the admin queue) - R3 pointer. */
+    R3PTRTYPE(PNVMEQUEUECOMP)       paQueuesCompR3;
+    /** Submission queues - R0 pointer. */
+    R0PTRTYPE(PNVMEQUEUESUBM)       paQueuesSubmR0;
+    /** Completion queues - R0 pointer. */
+    R0PTRTYPE(PNVMEQUEUECOMP)       paQueuesCompR0;
+    /** Submission queues - RC pointer. */
+    RCPTRTYPE(PNVMEQUEUESUBM)       paQueuesSubmRC;
+    /** Completion queues - RC pointer. */
+    RCPTRTYPE(PNVMEQUEUECOMP)       paQueuesCompRC;
+
+    /** Queue for waking up worker threads from RC - R3 pointer. */
+    R3PTRTYPE(PPDMQUEUE)            pWakeQueueR3;
+    /** Queue for waking up worker threads from RC - R0 pointer. */
+    R0PTRTYPE(PPDMQUEUE)            pWakeQueueR0;
+    /** Queue for waking up worker threads from RC - RC pointer. */
+    RCPTRTYPE(PPDMQUEUE)            pWakeQueueRC;
+    /** Alignment. */
+    uint32_t                        u32Alignment3;
+
+    /** Critical section protecting the interrupt state (INTx line and pending
+     * flags), taken by the CQ head doorbells in all contexts. */
+    PDMCRITSECT                     CritSectIntr;
+    /** Critical section serializing register accesses changing the controller
+     * state and the processing of admin commands. */
+    PDMCRITSECT                     CritSectCtrl;
+
+    /** Maximum number of outstanding asynchronous event requests. */
+    uint32_t                        cAsyncEvtReqsMax;
+    /** Number of outstanding asynchronous event requests. */
+    uint32_t                        cAsyncEvtReqsCur;
+    /** Critical section protecting the asynchronous event request state. */
+    PDMCRITSECT                     CritSectAsyncEvtReqs;
+    /** Command IDs of the outstanding asynchronous event requests. */
+    R3PTRTYPE(uint16_t *)           paAsyncEvtReqCids;
+
+    /** The namespaces - R3 pointer. */
+    R3PTRTYPE(PNVMENAMESPACE)       paNamespaces;
+
+    /** Number of worker threads created. */
+    uint32_t                        cWrkThrdsCur;
+    /** Number of worker threads currently processing requests. */
+    volatile uint32_t               cWrkThrdsActive;
+    /** List of worker threads (NVMEWRKTHRD). */
+    RTLISTANCHORR3                  LstWrkThrds;
+    /** Critical section protecting the worker thread list. */
+    PDMCRITSECT                     CritSectWrkThrds;
+
+    /** Commands which were suspended when the state was saved and need to be
+     * resubmitted on resume (NVMEREDO). */
+    RTLISTANCHORR3                  LstRedo;
+
+    /** @name SMART / health information counters.
+     * @{ */
+    /** Number of 512 byte units read by the host. */
+    volatile uint64_t               cDataUnitsRead;
+    /** Number of 512 byte units written by the host. */
+    volatile uint64_t               cDataUnitsWritten;
+    /** Number of read commands completed. */
+    volatile uint64_t               cHostReadCmds;
+    /** Number of write commands completed. */
+    volatile uint64_t               cHostWriteCmds;
+    /** Number of commands completed with a media error. */
+    volatile uint64_t               cMediaErrors;
+    /** @} */
+
+    /** Flag whether we have signalled the async suspend/poweroff/reset notification. */
+    volatile bool                   fSignalIdle;
+    /** Flag whether a fatal error was logged already. */
+    bool                            fFatalLogged;
+
+#ifdef VBOX_WITH_STATISTICS
+    /** Number of submission queue doorbell writes handled in R0/RC. */
+    STAMCOUNTER                     StatSqDoorbellRZ;
+    /** Number of submission queue doorbell writes handled in R3. */
+    STAMCOUNTER                     StatSqDoorbellR3;
+    /** Number of completion queue doorbell writes handled in R0/RC. */
+    STAMCOUNTER                     StatCqDoorbellRZ;
+    /** Number of completion queue doorbell writes handled in R3. */
+    STAMCOUNTER                     StatCqDoorbellR3;
+    /** Number of commands fetched by the worker threads. */
+    STAMCOUNTER                     StatCmdsFetched;
+    /** Number of completions which had to wait for room in the completion queue. */
+    STAMCOUNTER                     StatCompWaiters;
+#endif
+} NVME;
+
+/**
+ * Per I/O request data (allocated by the driver below).
+ */
+typedef struct NVMEREQ
+{
+    /** List node for the list of active requests of the submission queue. */
+    RTLISTNODE                  NdLstActive;
+    /** The namespace the request is for. */
+    PNVMENAMESPACE              pNs;
+    /** The I/O request handle. */
+    PDMMEDIAEXIOREQ             hIoReq;
+    /** The submission queue the command was fetched from. */
+    uint16_t                    u16SqId;
+    /** The command ID. */
+    uint16_t                    u16Cid;
+    /** The opcode. */
+    uint8_t                     u8Opc;
+    /** Flag whether the request was canceled because the queue is deleted. */
+    bool                        fCancelSent;
+    /** Generation of the submission queue when the command was fetched. */
+    uint32_t                    uGen;
+    /** Number of bytes to transfer. */
+    size_t                      cbXfer;
+    /** Number of valid entries in aPrps. */
+    uint32_t                    cPrps;
+    /** Offset into the first page. */
+    uint32_t                    offPrp1;
+    /** The guest physical addresses of the pages making up the data buffer. */
+    RTGCPHYS                    aPrps[NVME_PRPS_MAX];
+    /** Copy of the command. */
+    NVMECMD                     Cmd;
+} NVMEREQ;
+/** Pointer to a request. */
+typedef NVMEREQ *PNVMEREQ;
+
+/**
+ * A command to resubmit on resume after the state was restored.
+ */
+typedef struct NVMEREDO
+{
+    /** List node. */
+    RTLISTNODE                  NdLstRedo;
+    /** The submission queue the command belongs to. */
+    uint16_t                    u16SqId;
+    /** The command. */
+    NVMECMD                     Cmd;
+} NVMEREDO;
+/** Pointer to a command to resubmit. */
+typedef NVMEREDO *PNVMEREDO;
+
+
+#ifndef VBOX_DEVICE_STRUCT_TESTCASE
+
+
+/*********************************************************************************************************************************
+*   Internal Functions                                                                                                           *
+*********************************************************************************************************************************/
+#ifdef IN_RING3
+static void nvmeR3CompQueueFlushWaiters(PNVME pThis, PNVMEQUEUECOMP pQueueComp);
+static void nvmeR3RegWriteCtrl(PNVME pThis, uint32_t offReg, uint32_t u32Value);
+static void nvmeR3AdminQueueProcess(PNVME pThis);
+static void nvmeR3SubmQueueDeleteComplete(PNVME pThis, PNVMEQUEUESUBM pQueueSubm);
+#endif
+
+
+/**
+ * Returns whether the guest enabled MSI-X for the controller.
+ *
+ * @returns true if MSI-X is enabled, false if pin based interrupts are used.
+ * @param   pThis       The NVMe controller instance.
+ */
+DECLINLINE(bool) nvmeIsMsixEnabled(PNVME pThis)
+{
+    return RT_BOOL(  PCIDevGetWord(&pThis->PciDev, NVME_PCI_MSIX_CAP_OFFSET + VBOX_MSIX_CAP_MESSAGE_CONTROL)
+                   & VBOX_PCI_MSIX_FLAGS_ENABLE);
+}
+
+/**
+ * Updates the INTx line from the pending interrupt vectors and the interrupt mask.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ *
+ * @note Caller must own NVME::CritSectIntr.
+ */
+static void nvmeIntxUpdate(PNVME pThis)
+{
+    Assert(PDMCritSectIsOwner(&pThis->CritSectIntr));
+
+    bool fAssert = false;
+    if (!nvmeIsMsixEnabled(pThis))
+    {
+        uint32_t u32IntrMask = ASMAtomicReadU32(&pThis->u32IntrMask);
+        for (unsigned i = 0; i < RT_ELEMENTS(pThis->aIntrVecs) && !fAssert; i++)
+            if (   ASMAtomicReadU32(&pThis->aIntrVecs[i])
+                && !(u32IntrMask & RT_BIT_32(i)))
+                fAssert = true;
+    }
+
+    if (fAssert != pThis->fIntxAsserted)
+    {
+        Log2(("%s: %s INTx\n", __FUNCTION__, fAssert ? "Asserting" : "Deasserting"));
+        pThis->fIntxAsserted = fAssert;
+        PDMDevHlpPCISetIrq(pThis->CTX_SUFF(pDevIns), 0, fAssert ? PDM_IRQ_LEVEL_HIGH : PDM_IRQ_LEVEL_LOW);
+    }
+}
+
+/**
+ * Handles a write to a completion queue head doorbell.
+ *
+ * @returns VBox status code.
+ * @retval  VINF_IOM_R3_MMIO_WRITE if completions are waiting for room in the
+ *          queue and need to be posted from ring-3.  The new head is already
+ *          published at this point, so the access can be safely redone.
+ * @param   pThis       The NVMe controller instance.
+ * @param   u16CqId     The completion queue ID.
+ * @param   u32Value    The new head index.
+ */
+static int nvmeCompQueueHeadUpdate(PNVME pThis, uint16_t u16CqId, uint32_t u32Value)
+{
+    if (RT_UNLIKELY(u16CqId > pThis->cQueuesCompMax))
+    {
+        Log(("%s: Doorbell write for invalid completion queue %u\n", __FUNCTION__, u16CqId));
+        return VINF_SUCCESS;
+    }
+
+    PNVMEQUEUECOMP pQueueComp = &pThis->CTX_SUFF(paQueuesComp)[u16CqId];
+    if (RT_UNLIKELY(   ASMAtomicReadU32((volatile uint32_t *)&pQueueComp->Hdr.enmState) != NVMEQUEUESTATE_ALLOCATED
+                    || u32Value >= pQueueComp->Hdr.cEntries))
+    {
+        Log(("%s: Invalid doorbell write for completion queue %u (u32Value=%u)\n", __FUNCTION__, u16CqId, u32Value));
+        return VINF_SUCCESS;
+    }
+
+    int rc = PDMCritSectEnter(&pThis->CritSectIntr, VINF_IOM_R3_MMIO_WRITE);
+    if (rc != VINF_SUCCESS)
+        return rc;
+
+    ASMAtomicWriteU32(&pQueueComp->Hdr.idxHead, u32Value);
+    if (pQueueComp->fIntrPending)
+    {
+        if (u32Value == ASMAtomicReadU32(&pQueueComp->Hdr.idxTail))
+        {
+            /* Everything consumed, the vector is not pending anymore for this queue. */
+            pQueueComp->fIntrPending = false;
+            ASMAtomicDecU32(&pThis->aIntrVecs[pQueueComp->u32IntrVec]);
+            nvmeIntxUpdate(pThis);
+        }
+        else if (nvmeIsMsixEnabled(pThis))
+        {
+            /* New completions arrived while the guest was processing the queue, fire again. */
+            PDMDevHlpPCISetIrq(pThis->CTX_SUFF(pDevIns), pQueueComp->u32IntrVec, PDM_IRQ_LEVEL_HIGH);
+        }
+    }
+
+    PDMCritSectLeave(&pThis->CritSectIntr);
+
+    /* Completions waiting for room in the queue are posted from ring-3. */
+    if (ASMAtomicReadU32(&pQueueComp->cWaiters))
+    {
+#ifdef IN_RING3
+        nvmeR3CompQueueFlushWaiters(pThis, pQueueComp);
+#else
+        return VINF_IOM_R3_MMIO_WRITE;
+#endif
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Handles a write to a submission queue tail doorbell.
+ *
+ * @returns VBox status code.
+ * @retval  VINF_IOM_R3_MMIO_WRITE for the admin queue or when the worker could
+ *          not be woken up from the current context.
+ * @param   pThis       The NVMe controller instance.
+ * @param   u16SqId     The submission queue ID.
+ * @param   u32Value    The new tail index.
+ */
+static int nvmeSubmQueueTailUpdate(PNVME pThis, uint16_t u16SqId, uint32_t u32Value)
+{
+    if (RT_UNLIKELY(u16SqId > pThis->cQueuesSubmMax))
+    {
+        Log(("%s: Doorbell write for invalid submission queue %u\n", __FUNCTION__, u16SqId));
+        return VINF_SUCCESS;
+    }
+
+    /* Admin commands are processed on the EMT in ring-3. */
+    if (u16SqId == 0)
+    {
+#ifdef IN_RING3
+        int rc = PDMCritSectEnter(&pThis->CritSectCtrl, VERR_IGNORED);
+        AssertRC(rc);
+
+        PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[0];
+        if (   ASMAtomicReadU32((volatile uint32_t *)&pThis->enmState) == NVMESTATE_READY
+            && u32Value < pQueueSubm->Hdr.cEntries)
+        {
+            ASMAtomicWriteU32(&pQueueSubm->Hdr.idxTail, u32Value);
+            nvmeR3AdminQueueProcess(pThis);
+        }
+        else
+            Log(("%s: Invalid doorbell write for the admin queue (u32Value=%u)\n", __FUNCTION__, u32Value));
+
+        PDMCritSectLeave(&pThis->CritSectCtrl);
+        return VINF_SUCCESS;
+#else
+        return VINF_IOM_R3_MMIO_WRITE;
+#endif
+    }
+
+    PNVMEQUEUESUBM pQueueSubm = &pThis->CTX_SUFF(paQueuesSubm)[u16SqId];
+    if (RT_UNLIKELY(   ASMAtomicReadU32((volatile uint32_t *)&pThis->enmState) != NVMESTATE_READY
+                    || ASMAtomicReadU32((volatile uint32_t *)&pQueueSubm->Hdr.enmState) != NVMEQUEUESTATE_ALLOCATED
+                    || u32Value >= pQueueSubm->Hdr.cEntries))
+    {
+        Log(("%s: Invalid doorbell write for submission queue %u (u32Value=%u)\n", __FUNCTION__, u16SqId, u32Value));
+        return VINF_SUCCESS;
+    }
+
+#ifdef IN_RC
+    /* Can't signal a support driver event from RC, let ring-3 do it through the queue. */
+    PNVMEWAKEITEM pItem = (PNVMEWAKEITEM)PDMQueueAlloc(pThis->CTX_SUFF(pWakeQueue));
+    if (RT_UNLIKELY(!pItem))
+        return VINF_IOM_R3_MMIO_WRITE;
+
+    ASMAtomicWriteU32(&pQueueSubm->Hdr.idxTail, u32Value);
+    pItem->u16SqId = u16SqId;
+    PDMQueueInsert(pThis->CTX_SUFF(pWakeQueue), &pItem->Core);
+#else
+    ASMAtomicWriteU32(&pQueueSubm->Hdr.idxTail, u32Value);
+    SUPSEMEVENT hEvtProcess = pQueueSubm->hEvtProcess;
+    if (hEvtProcess != NIL_SUPSEMEVENT) /* Paranoia, the queue might get deleted concurrently. */
+        SUPSemEventSignal(pThis->pSupDrvSession, hEvtProcess);
+#endif
+
+#ifdef IN_RING3
+    STAM_COUNTER_INC(&pThis->StatSqDoorbellR3);
+#else
+    STAM_COUNTER_INC(&pThis->StatSqDoorbellRZ);
+#endif
+    return VINF_SUCCESS;
+}
+
+/**
+ * Reads a controller register.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The NVMe controller instance.
+ * @param   offReg      The register offset (dword aligned).
+ * @param   pu32Value   Where to store the register value.
+ */
+static int nvmeRegRead(PNVME pThis, uint32_t offReg, uint32_t *pu32Value)
+{
+    uint32_t u32Value = 0;
+
+    switch (offReg)
+    {
+        case NVME_REG_CAP:
+        case NVME_REG_CAP + 4:
+        {
+            uint64_t u64Cap =   NVME_CAP_MQES_SET(pThis->cQueueEntriesMax - 1)
+                              | NVME_CAP_CQR
+                              | NVME_CAP_TO_SET(pThis->cTimeoutMax)
+                              | NVME_CAP_DSTRD_SET(0)
+                              | NVME_CAP_CSS_NVM
+                              | NVME_CAP_MPSMIN_SET(0)
+                              | NVME_CAP_MPSMAX_SET(NVME_MPS_MAX);
+            u32Value = offReg == NVME_REG_CAP ? RT_LO_U32(u64Cap) : RT_HI_U32(u64Cap);
+            break;
+        }
+        case NVME_REG_VS:
+            u32Value = NVME_VERSION;
+            break;
+        case NVME_REG_INTMS:
+        case NVME_REG_INTMC:
+            u32Value = ASMAtomicReadU32(&pThis->u32IntrMask);
+            break;
+        case NVME_REG_CC:
+        {
+            NVMESTATE enmState = (NVMESTATE)ASMAtomicReadU32((volatile uint32_t *)&pThis->enmState);
+            u32Value =   (enmState != NVMESTATE_DISABLED ? NVME_CC_EN : 0)
+                       | NVME_CC_CSS_SET(pThis->uCssSet)
+                       | NVME_CC_MPS_SET(pThis->uMpsSet)
+                       | NVME_CC_AMS_SET(pThis->uAmsSet)
+                       | NVME_CC_SHN_SET(pThis->uShutdwnNotifierLast)
+                       | NVME_CC_IOSQES_SET(pThis->u32IoSubmissionQueueEntrySize)
+                       | NVME_CC_IOCQES_SET(pThis->u32IoCompletionQueueEntrySize);
+            break;
+        }
+        case NVME_REG_CSTS:
+        {
+            NVMESTATE enmState = (NVMESTATE)ASMAtomicReadU32((volatile uint32_t *)&pThis->enmState);
+            if (enmState == NVMESTATE_READY)
+                u32Value |= NVME_CSTS_RDY;
+            else if (enmState == NVMESTATE_FATAL)
+                u32Value |= NVME_CSTS_CFS;
+            if (pThis->uShutdwnNotifierLast != 0)
+                u32Value |= NVME_CSTS_SHST_COMPLETE;
+            break;
+        }
+        case NVME_REG_AQA:
+        {
+            uint32_t cEntriesSubm = pThis->CTX_SUFF(paQueuesSubm)[0].Hdr.cEntries;
+            uint32_t cEntriesComp = pThis->CTX_SUFF(paQueuesComp)[0].Hdr.cEntries;
+            u32Value =   (cEntriesSubm ? (cEntriesSubm - 1) & 0xfff : 0)
+                       | ((cEntriesComp ? (cEntriesComp - 1) & 0xfff : 0) << 16);
+            break;
+        }
+        case NVME_REG_ASQ:
+            u32Value = RT_LO_U32(pThis->CTX_SUFF(paQueuesSubm)[0].Hdr.GCPhysBase);
+            break;
+        case NVME_REG_ASQ + 4:
+            u32Value = RT_HI_U32(pThis->CTX_SUFF(paQueuesSubm)[0].Hdr.GCPhysBase);
+            break;
+        case NVME_REG_ACQ:
+            u32Value = RT_LO_U32(pThis->CTX_SUFF(paQueuesComp)[0].Hdr.GCPhysBase);
+            break;
+        case NVME_REG_ACQ + 4:
+            u32Value = RT_HI_U32(pThis->CTX_SUFF(paQueuesComp)[0].Hdr.GCPhysBase);
+            break;
+        default:
+            /* Reserved registers and doorbells read as zero. */
+            break;
+    }
+
+    Log2(("%s: offReg=%#x u32Value=%#x\n", __FUNCTION__, offReg, u32Value));
+    *pu32Value = u32Value;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Writes a controller register.
+ *
+ * @returns VBox status code.
+ * @retval  VINF_IOM_R3_MMIO_WRITE if the write has to be handled in ring-3.
+ * @param   pThis       The NVMe controller instance.
+ * @param   offReg      The register offset (dword aligned).
+ * @param   u32Value    The value to write.
+ */
+static int nvmeRegWrite(PNVME pThis, uint32_t offReg, uint32_t u32Value)
+{
+    Log2(("%s: offReg=%#x u32Value=%#x\n", __FUNCTION__, offReg, u32Value));
+
+    if (offReg >= NVME_REG_DOORBELL_FIRST)
+    {
+        /* The doorbell stride is 4 bytes (CAP.DSTRD = 0): SQ tail followed by CQ head. */
+        uint32_t idxDoorbell = (offReg - NVME_REG_DOORBELL_FIRST) / sizeof(uint32_t);
+        uint32_t idQueue     = idxDoorbell / 2;
+        if (RT_UNLIKELY(idQueue > UINT16_MAX))
+            return VINF_SUCCESS;
+
+        if (idxDoorbell & 1)
+        {
+#ifdef IN_RING3
+            STAM_COUNTER_INC(&pThis->StatCqDoorbellR3);
+#else
+            STAM_COUNTER_INC(&pThis->StatCqDoorbellRZ);
+#endif
+            return nvmeCompQueueHeadUpdate(pThis, (uint16_t)idQueue, u32Value);
+        }
+        return nvmeSubmQueueTailUpdate(pThis, (uint16_t)idQueue, u32Value);
+    }
+
+    switch (offReg)
+    {
+        case NVME_REG_INTMS:
+        case NVME_REG_INTMC:
+        {
+            /* Only valid with pin based interrupts, MSI-X has its own mask. */
+            if (nvmeIsMsixEnabled(pThis))
+                break;
+
+            int rc = PDMCritSectEnter(&pThis->CritSectIntr, VINF_IOM_R3_MMIO_WRITE);
+            if (rc != VINF_SUCCESS)
+                return rc;
+            if (offReg == NVME_REG_INTMS)
+                ASMAtomicOrU32(&pThis->u32IntrMask, u32Value);
+            else
+                ASMAtomicAndU32(&pThis->u32IntrMask, ~u32Value);
+            nvmeIntxUpdate(pThis);
+            PDMCritSectLeave(&pThis->CritSectIntr);
+            break;
+        }
+        case NVME_REG_CC:
+        case NVME_REG_NSSR:
+        case NVME_REG_AQA:
+        case NVME_REG_ASQ:
+        case NVME_REG_ASQ + 4:
+        case NVME_REG_ACQ:
+        case NVME_REG_ACQ + 4:
+#ifdef IN_RING3
+            nvmeR3RegWriteCtrl(pThis, offReg, u32Value);
+            break;
+#else
+            return VINF_IOM_R3_MMIO_WRITE;
+#endif
+        default:
+            /* Read-only or reserved, ignore. */
+            break;
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNIOMMMIOWRITE}
+ */
+PDMBOTHCBDECL(int) nvmeMMIOWrite(PPDMDEVINS pDevIns, void *pvUser, RTGCPHYS GCPhysAddr, void const *pv, unsigned cb)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    uint32_t offReg = (uint32_t)(GCPhysAddr - pThis->GCPhysMMIO);
+    RT_NOREF(pvUser);
+
+    /* IOM splits everything into zero extended dword accesses (IOMMMIO_FLAGS_WRITE_DWORD_ZEROED). */
+    Assert(cb == 4 && !(offReg & 3)); RT_NOREF(cb);
+    return nvmeRegWrite(pThis, offReg, *(uint32_t const *)pv);
+}
+
+/**
+ * @callback_method_impl{FNIOMMMIOREAD}
+ */
+PDMBOTHCBDECL(int) nvmeMMIORead(PPDMDEVINS pDevIns, void *pvUser, RTGCPHYS GCPhysAddr, void *pv, unsigned cb)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    uint32_t offReg = (uint32_t)(GCPhysAddr - pThis->GCPhysMMIO);
+    RT_NOREF(pvUser);
+
+    Assert(cb == 4 && !(offReg & 3)); RT_NOREF(cb);
+    return nvmeRegRead(pThis, offReg, (uint32_t *)pv);
+}
+
+#ifdef IN_RING3
+
+/**
+ * Returns the number of interrupt vectors available to the guest.
+ *
+ * @returns Number of vectors.
+ * @param   pThis       The NVMe controller instance.
+ */
+DECLINLINE(uint32_t) nvmeR3IntrVecCount(PNVME pThis)
+{
+    return pThis->cQueuesCompMax + 1;
+}
+
+/**
+ * Signals an interrupt for the given completion queue if none is pending yet.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueComp  The completion queue which got new entries.
+ */
+static void nvmeR3IntrRaise(PNVME pThis, PNVMEQUEUECOMP pQueueComp)
+{
+    if (!pQueueComp->fIntrEnabled)
+        return;
+
+    int rc = PDMCritSectEnter(&pThis->CritSectIntr, VERR_IGNORED);
+    AssertRC(rc);
+
+    /* Only the transition to pending raises an interrupt, the head doorbell takes care of the rest. */
+    if (!pQueueComp->fIntrPending)
+    {
+        pQueueComp->fIntrPending = true;
+        ASMAtomicIncU32(&pThis->aIntrVecs[pQueueComp->u32IntrVec]);
+        if (nvmeIsMsixEnabled(pThis))
+            PDMDevHlpPCISetIrq(pThis->pDevInsR3, pQueueComp->u32IntrVec, PDM_IRQ_LEVEL_HIGH);
+        else
+            nvmeIntxUpdate(pThis);
+    }
+
+    PDMCritSectLeave(&pThis->CritSectIntr);
+}
+
+/**
+ * Returns whether the given completion queue is full.
+ *
+ * @returns true if full, false otherwise.
+ * @param   pQueueComp  The completion queue.
+ */
+DECLINLINE(bool) nvmeR3CompQueueIsFull(PNVMEQUEUECOMP pQueueComp)
+{
+    return (pQueueComp->Hdr.idxTail + 1) % pQueueComp->Hdr.cEntries == ASMAtomicReadU32(&pQueueComp->Hdr.idxHead);
+}
+
+/**
+ * Writes a completion queue entry at the tail of the given queue.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueComp  The completion queue, caller must own NVMEQUEUECOMP::hMtx
+ *                      and make sure the queue is not full.
+ * @param   pCqe        The entry to post, the phase tag is set here.
+ */
+static void nvmeR3CompQueueEntryWrite(PNVME pThis, PNVMEQUEUECOMP pQueueComp, PNVMECQE pCqe)
+{
+    uint32_t idxTail = pQueueComp->Hdr.idxTail;
+
+    pCqe->u16Sts = (pCqe->u16Sts & ~(uint16_t)1) | (pQueueComp->fPhase ? 1 : 0);
+    PDMDevHlpPCIPhysWrite(pThis->pDevInsR3, pQueueComp->Hdr.GCPhysBase + (RTGCPHYS)idxTail * pQueueComp->Hdr.cbEntry,
+                          pCqe, sizeof(*pCqe));
+
+    idxTail = (idxTail + 1) % pQueueComp->Hdr.cEntries;
+    if (!idxTail)
+        pQueueComp->fPhase = !pQueueComp->fPhase;
+    ASMAtomicWriteU32(&pQueueComp->Hdr.idxTail, idxTail);
+}
+
+/**
+ * Posts as many waiting completions as there is room for in the queue.
+ *
+ * @returns Flag whether anything was posted.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueComp  The completion queue, caller must own NVMEQUEUECOMP::hMtx.
+ */
+static bool nvmeR3CompQueueWaitersPost(PNVME pThis, PNVMEQUEUECOMP pQueueComp)
+{
+    bool fPosted = false;
+
+    while (   pQueueComp->cWaiters
+           && !nvmeR3CompQueueIsFull(pQueueComp))
+    {
+        PNVMECOMPWAITER pWaiter = RTListGetFirst(&pQueueComp->LstCompletionsWaiting, NVMECOMPWAITER, NdLstWait);
+        AssertPtrBreak(pWaiter);
+
+        RTListNodeRemove(&pWaiter->NdLstWait);
+        nvmeR3CompQueueEntryWrite(pThis, pQueueComp, &pWaiter->Cqe);
+        ASMAtomicDecU32(&pQueueComp->cWaiters);
+        RTMemFree(pWaiter);
+        fPosted = true;
+    }
+
+    return fPosted;
+}
+
+/**
+ * Frees all completions waiting for room in the given queue.
+ *
+ * @returns nothing.
+ * @param   pQueueComp  The completion queue.
+ */
+static void nvmeR3CompQueueWaitersFree(PNVMEQUEUECOMP pQueueComp)
+{
+    RTSemFastMutexRequest(pQueueComp->hMtx);
+
+    PNVMECOMPWAITER pIt, pItNext;
+    RTListForEachSafe(&pQueueComp->LstCompletionsWaiting, pIt, pItNext, NVMECOMPWAITER, NdLstWait)
+    {
+        RTListNodeRemove(&pIt->NdLstWait);
+        RTMemFree(pIt);
+    }
+    ASMAtomicWriteU32(&pQueueComp->cWaiters, 0);
+
+    RTSemFastMutexRelease(pQueueComp->hMtx);
+}
+
+/**
+ * Kicks the worker threads of all submission queues feeding the given
+ * completion queue.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   u16CqId     The completion queue ID.
+ */
+static void nvmeR3CompQueueKickSubmQueues(PNVME pThis, uint16_t u16CqId)
+{
+    for (uint32_t i = 1; i <= pThis->cQueuesSubmMax; i++)
+    {
+        PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[i];
+        if (   pQueueSubm->Hdr.enmState == NVMEQUEUESTATE_ALLOCATED
+            && pQueueSubm->u16CompletionQueueId == u16CqId)
+            SUPSemEventSignal(pThis->pSupDrvSession, pQueueSubm->hEvtProcess);
+    }
+}
+
+/**
+ * Posts waiting completions after the guest made room in the completion queue.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueComp  The completion queue.
+ */
+static void nvmeR3CompQueueFlushWaiters(PNVME pThis, PNVMEQUEUECOMP pQueueComp)
+{
+    RTSemFastMutexRequest(pQueueComp->hMtx);
+    bool fPosted = nvmeR3CompQueueWaitersPost(pThis, pQueueComp);
+    uint32_t cWaiters = pQueueComp->cWaiters;
+    RTSemFastMutexRelease(pQueueComp->hMtx);
+
+    if (fPosted)
+    {
+        nvmeR3IntrRaise(pThis, pQueueComp);
+
+        /* Resume the submission queues throttled because of this queue. */
+        if (cWaiters < pThis->cCompQueuesWaitersMax)
+            nvmeR3CompQueueKickSubmQueues(pThis, pQueueComp->Hdr.u16Id);
+    }
+}
+
+/**
+ * Posts a completion for a command.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   u16SqId     The submission queue the command was fetched from.
+ * @param   uGen        The generation of the submission queue when the command
+ *                      was fetched, the completion is dropped if the queue was
+ *                      deleted in the meantime.
+ * @param   u16Cid      The command ID.
+ * @param   u16Sts      The status (without phase tag).
+ * @param   u32Dw0      Command specific dword 0.
+ */
+static void nvmeR3CmdComplete(PNVME pThis, uint16_t u16SqId, uint32_t uGen, uint16_t u16Cid, uint16_t u16Sts, uint32_t u32Dw0)
+{
+    PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[u16SqId];
+    if (RT_UNLIKELY(   pQueueSubm->Hdr.enmState != NVMEQUEUESTATE_ALLOCATED
+                    || ASMAtomicReadU32(&pQueueSubm->uGen) != uGen))
+    {
+        Log(("%s: Dropping completion for command %#x of deleted submission queue %u\n", __FUNCTION__, u16Cid, u16SqId));
+        return;
+    }
+
+    PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[pQueueSubm->u16CompletionQueueId];
+    if (RT_UNLIKELY(pQueueComp->Hdr.enmState != NVMEQUEUESTATE_ALLOCATED))
+    {
+        Log(("%s: Dropping completion for command %#x of deleted completion queue %u\n", __FUNCTION__, u16Cid,
+             pQueueSubm->u16CompletionQueueId));
+        return;
+    }
+
+    NVMECQE Cqe;
+    Cqe.u32Dw0    = u32Dw0;
+    Cqe.u32Rsvd   = 0;
+    Cqe.u16SqHead = (uint16_t)ASMAtomicReadU32(&pQueueSubm->Hdr.idxHead);
+    Cqe.u16SqId   = u16SqId;
+    Cqe.u16Cid    = u16Cid;
+    Cqe.u16Sts    = u16Sts;
+
+    LogFlowFunc(("u16SqId=%u u16Cid=%#x u16Sts=%#x u32Dw0=%#x\n", u16SqId, u16Cid, u16Sts, u32Dw0));
+
+    bool fPosted = false;
+    RTSemFastMutexRequest(pQueueComp->hMtx);
+    if (   !pQueueComp->cWaiters
+        && !nvmeR3CompQueueIsFull(pQueueComp))
+    {
+        nvmeR3CompQueueEntryWrite(pThis, pQueueComp, &Cqe);
+        fPosted = true;
+    }
+    else
+    {
+        PNVMECOMPWAITER pWaiter = (PNVMECOMPWAITER)RTMemAlloc(sizeof(NVMECOMPWAITER));
+        if (RT_LIKELY(pWaiter))
+        {
+            pWaiter->Cqe = Cqe;
+            RTListAppend(&pQueueComp->LstCompletionsWaiting, &pWaiter->NdLstWait);
+            ASMAtomicIncU32(&pQueueComp->cWaiters);
+            STAM_COUNTER_INC(&pThis->StatCompWaiters);
+        }
+        else
+            LogRel(("NVMe#%d: Out of memory, dropping completion for command %#x\n", pThis->pDevInsR3->iInstance, u16Cid));
+
+        /*
+         * The guest might have made room right after we checked above without seeing
+         * the waiter count, so check again now that the waiter is visible.
+         */
+        fPosted = nvmeR3CompQueueWaitersPost(pThis, pQueueComp);
+    }
+    RTSemFastMutexRelease(pQueueComp->hMtx);
+
+    if (fPosted)
+        nvmeR3IntrRaise(pThis, pQueueComp);
+}
+
+/**
+ * Resolves the PRP entries of a command into the list of pages making up the
+ * data buffer.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pReq        The request, NVMEREQ::Cmd and NVMEREQ::cbXfer must be
+ *                      set, the PRP fields are filled in on success.
+ */
+static uint16_t nvmeR3PrpsResolve(PNVME pThis, PNVMEREQ pReq)
+{
+    uint32_t const cbPage = pThis->cbPage;
+    uint64_t const fPageOffMask = cbPage - 1;
+    RTGCPHYS GCPhysPrp1 = pReq->Cmd.u64Prp1;
+
+    pReq->cPrps = 0;
+    if (!pReq->cbXfer)
+        return NVME_STS_SUCCESS;
+
+    if (GCPhysPrp1 & 0x3)
+        return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_PRP_OFFSET);
+
+    pReq->offPrp1  = (uint32_t)(GCPhysPrp1 & fPageOffMask);
+    pReq->aPrps[0] = GCPhysPrp1 & ~fPageOffMask;
+    pReq->cPrps    = 1;
+
+    size_t cbFirst = cbPage - pReq->offPrp1;
+    if (pReq->cbXfer <= cbFirst)
+        return NVME_STS_SUCCESS;
+
+    uint32_t cPrpsLeft = (uint32_t)((pReq->cbXfer - cbFirst + cbPage - 1) / cbPage);
+    if (cPrpsLeft >= RT_ELEMENTS(pReq->aPrps))
+        return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+
+    if (cPrpsLeft == 1)
+    {
+        /* PRP2 points directly to the second page. */
+        if (pReq->Cmd.u64Prp2 & fPageOffMask)
+            return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_PRP_OFFSET);
+        pReq->aPrps[pReq->cPrps++] = pReq->Cmd.u64Prp2;
+        return NVME_STS_SUCCESS;
+    }
+
+    /* PRP2 points to a PRP list, the last entry of a full list page chains to the next one. */
+    RTGCPHYS GCPhysList = pReq->Cmd.u64Prp2;
+    unsigned cListPages = 0;
+    while (cPrpsLeft)
+    {
+        if (   (GCPhysList & 0x7)
+            || ++cListPages > NVME_PRPS_MAX)
+            return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_PRP_OFFSET);
+
+        uint64_t au64Entries[NVME_PRPS_MAX];
+        uint32_t cEntriesPage = (uint32_t)((cbPage - (GCPhysList & fPageOffMask)) / sizeof(uint64_t));
+        bool     fChain       = cPrpsLeft > cEntriesPage;
+        uint32_t cEntries     = fChain ? cEntriesPage : cPrpsLeft;
+        uint32_t cData        = fChain ? cEntries - 1 : cEntries;
+
+        PDMDevHlpPCIPhysRead(pThis->pDevInsR3, GCPhysList, &au64Entries[0], cEntries * sizeof(uint64_t));
+        for (uint32_t i = 0; i < cData; i++)
+        {
+            if (au64Entries[i] & fPageOffMask)
+                return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_PRP_OFFSET);
+            pReq->aPrps[pReq->cPrps++] = au64Entries[i];
+        }
+
+        cPrpsLeft -= cData;
+        if (fChain)
+            GCPhysList = au64Entries[cEntries - 1];
+    }
+
+    return NVME_STS_SUCCESS;
+}
+
+/**
+ * Copies data between the guest buffer described by the PRPs of the given
+ * request and a S/G buffer.
+ *
+ * @returns Number of bytes copied.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pReq        The request with the resolved PRPs.
+ * @param   off         Offset into the guest buffer to start at.
+ * @param   pSgBuf      The S/G buffer to copy from or to.
+ * @param   cbCopy      Number of bytes to copy.
+ * @param   fToGuest    Flag whether to copy to the guest buffer or from it.
+ */
+static size_t nvmeR3PrpCopy(PNVME pThis, PNVMEREQ pReq, uint32_t off, PRTSGBUF pSgBuf, size_t cbCopy, bool fToGuest)
+{
+    uint32_t const cbPage = pThis->cbPage;
+    size_t cbCopied = 0;
+
+    if (off >= pReq->cbXfer)
+        return 0;
+    cbCopy = RT_MIN(cbCopy, pReq->cbXfer - off);
+
+    size_t   offAbs  = (size_t)pReq->offPrp1 + off;
+    uint32_t idxPrp  = (uint32_t)(offAbs / cbPage);
+    uint32_t offPage = (uint32_t)(offAbs % cbPage);
+    while (   cbCopy
+           && idxPrp < pReq->cPrps)
+    {
+        RTGCPHYS GCPhys     = pReq->aPrps[idxPrp] + offPage;
+        size_t   cbThisPage = RT_MIN(cbPage - offPage, cbCopy);
+
+        while (cbThisPage)
+        {
+            size_t cbSeg = cbThisPage;
+            void *pvSeg = RTSgBufGetNextSegment(pSgBuf, &cbSeg);
+            if (!pvSeg)
+                return cbCopied;
+
+            if (fToGuest)
+                PDMDevHlpPCIPhysWrite(pThis->pDevInsR3, GCPhys, pvSeg, cbSeg);
+            else
+                PDMDevHlpPCIPhysRead(pThis->pDevInsR3, GCPhys, pvSeg, cbSeg);
+
+            GCPhys     += cbSeg;
+            cbThisPage -= cbSeg;
+            cbCopy     -= cbSeg;
+            cbCopied   += cbSeg;
+        }
+
+        idxPrp++;
+        offPage = 0;
+    }
+
+    return cbCopied;
+}
+
+/**
+ * Transfers a buffer to the guest for an admin command.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The admin command.
+ * @param   pvBuf       The data to transfer.
+ * @param   cbBuf       Number of bytes to transfer.
+ */
+static uint16_t nvmeR3AdmDataToGuest(PNVME pThis, PCNVMECMD pCmd, const void *pvBuf, size_t cbBuf)
+{
+    NVMEREQ Req;
+    Req.Cmd    = *pCmd;
+    Req.cbXfer = cbBuf;
+
+    uint16_t u16Sts = nvmeR3PrpsResolve(pThis, &Req);
+    if (u16Sts == NVME_STS_SUCCESS)
+    {
+        RTSGSEG Seg;
+        RTSGBUF SgBuf;
+        Seg.pvSeg = (void *)pvBuf;
+        Seg.cbSeg = cbBuf;
+        RTSgBufInit(&SgBuf, &Seg, 1);
+        nvmeR3PrpCopy(pThis, &Req, 0, &SgBuf, cbBuf, true /*fToGuest*/);
+    }
+
+    return u16Sts;
+}
+
+/**
+ * Completes an I/O request.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pNs         The namespace the request is for.
+ * @param   pReq        The request to complete.
+ * @param   rcReq       Status code of the request.
+ */
+static void nvmeR3ReqComplete(PNVME pThis, PNVMENAMESPACE pNs, PNVMEREQ pReq, int rcReq)
+{
+    PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[pReq->u16SqId];
+    uint16_t u16SqId = pReq->u16SqId;
+    uint16_t u16Cid  = pReq->u16Cid;
+    uint32_t uGen    = pReq->uGen;
+    uint16_t u16Sts  = NVME_STS_SUCCESS;
+
+    RTSemFastMutexRequest(pQueueSubm->hMtxReqs);
+    RTListNodeRemove(&pReq->NdLstActive);
+    RTSemFastMutexRelease(pQueueSubm->hMtxReqs);
+
+    if (pReq->u8Opc == NVME_NVM_OPC_READ)
+        pNs->Led.Actual.s.fReading = 0;
+    else if (pReq->u8Opc == NVME_NVM_OPC_WRITE)
+        pNs->Led.Actual.s.fWriting = 0;
+
+    if (RT_SUCCESS(rcReq))
+    {
+        if (pReq->u8Opc == NVME_NVM_OPC_READ)
+        {
+            ASMAtomicIncU64(&pThis->cHostReadCmds);
+            ASMAtomicAddU64(&pThis->cDataUnitsRead, pReq->cbXfer / 512);
+        }
+        else if (pReq->u8Opc == NVME_NVM_OPC_WRITE)
+        {
+            ASMAtomicIncU64(&pThis->cHostWriteCmds);
+            ASMAtomicAddU64(&pThis->cDataUnitsWritten, pReq->cbXfer / 512);
+        }
+    }
+    else if (rcReq == VERR_PDM_MEDIAEX_IOREQ_CANCELED)
+        u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_ABORT_REQUESTED);
+    else if (pReq->u8Opc == NVME_NVM_OPC_READ)
+    {
+        ASMAtomicIncU64(&pThis->cMediaErrors);
+        u16Sts = NVME_STS_MAKE(NVME_SCT_MEDIA_ERROR, NVME_SC_MEDIA_UNRECOVERED_READ_ERROR);
+    }
+    else if (pReq->u8Opc == NVME_NVM_OPC_WRITE)
+    {
+        ASMAtomicIncU64(&pThis->cMediaErrors);
+        u16Sts = NVME_STS_MAKE(NVME_SCT_MEDIA_ERROR, NVME_SC_MEDIA_WRITE_FAULT);
+    }
+    else
+        u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INTERNAL_ERROR);
+
+    if (RT_FAILURE(rcReq) && rcReq != VERR_PDM_MEDIAEX_IOREQ_CANCELED)
+        LogRel(("NVMe#%d: Command %#x (opcode %#x) on namespace %u failed with %Rrc\n",
+                pThis->pDevInsR3->iInstance, u16Cid, pReq->u8Opc, pNs->u32Id, rcReq));
+
+    /* Requests still running when the guest deleted the queue count as aborted, no matter how they ended. */
+    if (   pReq->fCancelSent
+        && ASMAtomicReadBool(&pQueueSubm->fAborting))
+        u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_ABORT_SQ_DELETED);
+
+    /* Free the request before posting the completion so the command ID can be reused immediately. */
+    pNs->pDrvMediaEx->pfnIoReqFree(pNs->pDrvMediaEx, pReq->hIoReq);
+    nvmeR3CmdComplete(pThis, u16SqId, uGen, u16Cid, u16Sts, 0);
+
+    /* The last request of a queue being deleted completes the delete command. */
+    if (   !ASMAtomicDecU32(&pQueueSubm->cReqsActive)
+        && ASMAtomicReadBool(&pQueueSubm->fDeletePending))
+        nvmeR3SubmQueueDeleteComplete(pThis, pQueueSubm);
+
+    if (!ASMAtomicDecU32(&pNs->cOutstandingRequests) && pThis->fSignalIdle)
+        PDMDevHlpAsyncNotificationCompleted(pThis->pDevInsR3);
+}
+
+/**
+ * Processes a command fetched from an I/O submission queue.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   u16SqId     The submission queue the command was fetched from.
+ * @param   uGen        The generation of the submission queue.
+ * @param   pCmd        The command.
+ */
+static void nvmeR3IoCmdProcess(PNVME pThis, uint16_t u16SqId, uint32_t uGen, PCNVMECMD pCmd)
+{
+    PNVMENAMESPACE pNs = NULL;
+    uint16_t u16Sts    = NVME_STS_SUCCESS;
+    uint64_t uLba      = 0;
+    uint32_t cRanges   = 0;
+    size_t   cbXfer    = 0;
+
+    LogFlowFunc(("u16SqId=%u u16Cid=%#x u8Opc=%#x u32Nsid=%u\n", u16SqId, pCmd->u16Cid, pCmd->u8Opc, pCmd->u32Nsid));
+
+    if (   pCmd->u32Nsid == 0
+        || pCmd->u32Nsid > pThis->cNamespaces
+        || !pThis->paNamespaces[pCmd->u32Nsid - 1].pDrvMediaEx)
+        u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_NS_OR_FMT);
+    else if (pCmd->u8Flags & 0xc0) /* SGLs are not supported. */
+        u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+    else
+    {
+        pNs = &pThis->paNamespaces[pCmd->u32Nsid - 1];
+        switch (pCmd->u8Opc)
+        {
+            case NVME_NVM_OPC_FLUSH:
+                break;
+            case NVME_NVM_OPC_READ:
+            case NVME_NVM_OPC_WRITE:
+            {
+                uint32_t cBlocks = (NVME_CMD_CDW(pCmd, 12) & 0xffff) + 1;
+                uLba   = RT_MAKE_U64(NVME_CMD_CDW(pCmd, 10), NVME_CMD_CDW(pCmd, 11));
+                cbXfer = (size_t)cBlocks * pNs->cbBlock;
+                if (   uLba >= pNs->cBlocks
+                    || pNs->cBlocks - uLba < cBlocks)
+                    u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_LBA_OUT_OF_RANGE);
+                else if (cbXfer > (NVME_PAGE_SIZE_MIN << NVME_MDTS))
+                    u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+                else if (   pCmd->u8Opc == NVME_NVM_OPC_WRITE
+                         && pNs->fReadOnly)
+                    u16Sts = NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_ATTEMPTED_WRITE_TO_RO_RANGE);
+                break;
+            }
+            case NVME_NVM_OPC_DATASET_MANAGEMENT:
+            {
+                /* Only deallocate is acted upon, the other attributes are hints and the command is advisory anyway. */
+                if (   !(NVME_CMD_CDW(pCmd, 11) & RT_BIT_32(2))
+                    || !pNs->fDiscard)
+                {
+                    nvmeR3CmdComplete(pThis, u16SqId, uGen, pCmd->u16Cid, NVME_STS_SUCCESS, 0);
+                    return;
+                }
+                if (pNs->fReadOnly)
+                    u16Sts = NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_ATTEMPTED_WRITE_TO_RO_RANGE);
+                cRanges = (NVME_CMD_CDW(pCmd, 10) & 0xff) + 1;
+                cbXfer  = cRanges * 16;
+                break;
+            }
+            default:
+                u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_OPCODE);
+        }
+    }
+
+    if (u16Sts != NVME_STS_SUCCESS)
+    {
+        nvmeR3CmdComplete(pThis, u16SqId, uGen, pCmd->u16Cid, u16Sts, 0);
+        return;
+    }
+
+    PDMMEDIAEXIOREQ hIoReq;
+    PNVMEREQ pReq = NULL;
+    int rc = pNs->pDrvMediaEx->pfnIoReqAlloc(pNs->pDrvMediaEx, &hIoReq, (void **)&pReq,
+                                             NVME_IOREQID_MAKE(u16SqId, pCmd->u16Cid),
+                                             PDMIMEDIAEX_F_SUSPEND_ON_RECOVERABLE_ERR);
+    if (RT_FAILURE(rc))
+    {
+        u16Sts = rc == VERR_PDM_MEDIAEX_IOREQID_CONFLICT
+               ? NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_CMD_ID_CONFLICT)
+               : NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INTERNAL_ERROR);
+        nvmeR3CmdComplete(pThis, u16SqId, uGen, pCmd->u16Cid, u16Sts, 0);
+        return;
+    }
+
+    pReq->pNs     = pNs;
+    pReq->hIoReq  = hIoReq;
+    pReq->u16SqId = u16SqId;
+    pReq->u16Cid  = pCmd->u16Cid;
+    pReq->u8Opc   = pCmd->u8Opc;
+    pReq->fCancelSent = false;
+    pReq->uGen    = uGen;
+    pReq->cbXfer  = cbXfer;
+    pReq->Cmd     = *pCmd;
+
+    u16Sts = nvmeR3PrpsResolve(pThis, pReq);
+    if (u16Sts != NVME_STS_SUCCESS)
+    {
+        pNs->pDrvMediaEx->pfnIoReqFree(pNs->pDrvMediaEx, hIoReq);
+        nvmeR3CmdComplete(pThis, u16SqId, uGen, pCmd->u16Cid, u16Sts, 0);
+        return;
+    }
+
+    PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[u16SqId];
+    RTSemFastMutexRequest(pQueueSubm->hMtxReqs);
+    RTListAppend(&pQueueSubm->LstReqsActive, &pReq->NdLstActive);
+    RTSemFastMutexRelease(pQueueSubm->hMtxReqs);
+
+    ASMAtomicIncU32(&pQueueSubm->cReqsActive);
+    ASMAtomicIncU32(&pNs->cOutstandingRequests);
+
+    switch (pReq->u8Opc)
+    {
+        case NVME_NVM_OPC_FLUSH:
+            rc = pNs->pDrvMediaEx->pfnIoReqFlush(pNs->pDrvMediaEx, hIoReq);
+            break;
+        case NVME_NVM_OPC_READ:
+            pNs->Led.Asserted.s.fReading = pNs->Led.Actual.s.fReading = 1;
+            rc = pNs->pDrvMediaEx->pfnIoReqRead(pNs->pDrvMediaEx, hIoReq, uLba * pNs->cbBlock, cbXfer);
+            break;
+        case NVME_NVM_OPC_WRITE:
+            pNs->Led.Asserted.s.fWriting = pNs->Led.Actual.s.fWriting = 1;
+            rc = pNs->pDrvMediaEx->pfnIoReqWrite(pNs->pDrvMediaEx, hIoReq, uLba * pNs->cbBlock, cbXfer);
+            break;
+        case NVME_NVM_OPC_DATASET_MANAGEMENT:
+            rc = pNs->pDrvMediaEx->pfnIoReqDiscard(pNs->pDrvMediaEx, hIoReq, cRanges);
+            break;
+        default:
+            AssertMsgFailed(("Invalid opcode %#x\n", pReq->u8Opc));
+            rc = VERR_INTERNAL_ERROR;
+    }
+
+    if (rc != VINF_PDM_MEDIAEX_IOREQ_IN_PROGRESS)
+        nvmeR3ReqComplete(pThis, pNs, pReq, rc);
+}
+
+/**
+ * Fetches and processes new commands from the given submission queue.
+ *
+ * @returns Flag whether any command was processed.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueSubm  The submission queue to process.
+ */
+static bool nvmeR3SubmQueueProcess(PNVME pThis, PNVMEQUEUESUBM pQueueSubm)
+{
+    if (   ASMAtomicReadU32((volatile uint32_t *)&pThis->enmState) != NVMESTATE_READY
+        || pQueueSubm->Hdr.enmState != NVMEQUEUESTATE_ALLOCATED)
+        return false;
+
+    /* Throttle the queue if too many completions are waiting for room already. */
+    PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[pQueueSubm->u16CompletionQueueId];
+    if (ASMAtomicReadU32(&pQueueComp->cWaiters) >= pThis->cCompQueuesWaitersMax)
+        return false;
+
+    uint32_t idxHead = pQueueSubm->Hdr.idxHead;
+    uint32_t idxTail = ASMAtomicReadU32(&pQueueSubm->Hdr.idxTail);
+    if (idxHead == idxTail)
+        return false;
+
+    /* Fetch a batch of physically contiguous entries in one go. */
+    NVMECMD  aCmds[NVME_SUBM_QUEUE_BATCH];
+    uint32_t cCmds = idxTail > idxHead ? idxTail - idxHead : pQueueSubm->Hdr.cEntries - idxHead;
+    cCmds = RT_MIN(cCmds, RT_ELEMENTS(aCmds));
+
+    PDMDevHlpPCIPhysRead(pThis->pDevInsR3, pQueueSubm->Hdr.GCPhysBase + (RTGCPHYS)idxHead * pQueueSubm->Hdr.cbEntry,
+                         &aCmds[0], cCmds * sizeof(NVMECMD));
+    ASMAtomicWriteU32(&pQueueSubm->Hdr.idxHead, (idxHead + cCmds) % pQueueSubm->Hdr.cEntries);
+    STAM_COUNTER_ADD(&pThis->StatCmdsFetched, cCmds);
+
+    uint32_t uGen = ASMAtomicReadU32(&pQueueSubm->uGen);
+    for (uint32_t i = 0; i < cCmds; i++)
+        nvmeR3IoCmdProcess(pThis, pQueueSubm->Hdr.u16Id, uGen, &aCmds[i]);
+
+    return true;
+}
+
+/**
+ * Worker thread processing the submission queues assigned to it.
+ *
+ * @returns VBox status code.
+ * @param   pDevIns     The device instance.
+ * @param   pThread     The thread structure.
+ */
+static DECLCALLBACK(int) nvmeR3WrkThrdLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    PNVMEWRKTHRD pWrkThrd = (PNVMEWRKTHRD)pThread->pvUser;
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        bool fWorkDone = false;
+
+        ASMAtomicIncU32(&pThis->cWrkThrdsActive);
+        RTSemFastMutexRequest(pWrkThrd->hMtx);
+
+        PNVMEQUEUESUBM pQueueSubm;
+        RTListForEach(&pWrkThrd->LstSubmQueues, pQueueSubm, NVMEQUEUESUBM, NdLstWrkThrdAssgnd)
+        {
+            if (nvmeR3SubmQueueProcess(pThis, pQueueSubm))
+                fWorkDone = true;
+        }
+
+        RTSemFastMutexRelease(pWrkThrd->hMtx);
+        ASMAtomicDecU32(&pThis->cWrkThrdsActive);
+
+        /* The event latches, so doorbell writes while we were busy are not lost. */
+        if (!fWorkDone)
+        {
+            int rc = SUPSemEventWaitNoResume(pThis->pSupDrvSession, pWrkThrd->hEvtProcess, RT_INDEFINITE_WAIT);
+            AssertLogRelMsgReturn(RT_SUCCESS(rc) || rc == VERR_INTERRUPTED, ("%Rrc\n", rc), rc);
+        }
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Unblock the worker thread so it can respond to a state change.
+ *
+ * @returns VBox status code.
+ * @param   pDevIns     The device instance.
+ * @param   pThread     The send thread.
+ */
+static DECLCALLBACK(int) nvmeR3WrkThrdWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    PNVMEWRKTHRD pWrkThrd = (PNVMEWRKTHRD)pThread->pvUser;
+
+    return SUPSemEventSignal(pThis->pSupDrvSession, pWrkThrd->hEvtProcess);
+}
+
+/**
+ * Creates a new worker thread.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The NVMe controller instance.
+ * @param   ppWrkThrd   Where to store the worker thread on success.
+ *
+ * @note Caller must own NVME::CritSectWrkThrds.
+ */
+static int nvmeR3WrkThrdCreate(PNVME pThis, PNVMEWRKTHRD *ppWrkThrd)
+{
+    PPDMDEVINS pDevIns = pThis->pDevInsR3;
+
+    PNVMEWRKTHRD pWrkThrd = (PNVMEWRKTHRD)RTMemAllocZ(sizeof(NVMEWRKTHRD));
+    if (!pWrkThrd)
+        return VERR_NO_MEMORY;
+
+    pWrkThrd->pNvmeR3 = pThis;
+    RTListInit(&pWrkThrd->LstSubmQueues);
+
+    int rc = SUPSemEventCreate(pThis->pSupDrvSession, &pWrkThrd->hEvtProcess);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTSemFastMutexCreate(&pWrkThrd->hMtx);
+        if (RT_SUCCESS(rc))
+        {
+            char szName[32];
+            RTStrPrintf(szName, sizeof(szName), "NVMe%u-%u", pDevIns->iInstance, pThis->cWrkThrdsCur);
+            rc = PDMDevHlpThreadCreate(pDevIns, &pWrkThrd->pThrd, pWrkThrd, nvmeR3WrkThrdLoop,
+                                       nvmeR3WrkThrdWakeUp, 0, RTTHREADTYPE_IO, szName);
+            if (RT_SUCCESS(rc))
+            {
+                /* Threads created after power on are not resumed by PDM. */
+                VMSTATE enmVMState = PDMDevHlpVMState(pDevIns);
+                if (   enmVMState == VMSTATE_RUNNING
+                    || enmVMState == VMSTATE_RUNNING_LS)
+                    PDMR3ThreadResume(pWrkThrd->pThrd);
+
+                RTListAppend(&pThis->LstWrkThrds, &pWrkThrd->NdLstWrkThrds);
+                pThis->cWrkThrdsCur++;
+                *ppWrkThrd = pWrkThrd;
+                return VINF_SUCCESS;
+            }
+
+            RTSemFastMutexDestroy(pWrkThrd->hMtx);
+        }
+
+        SUPSemEventClose(pThis->pSupDrvSession, pWrkThrd->hEvtProcess);
+    }
+
+    RTMemFree(pWrkThrd);
+    return rc;
+}
+
+/**
+ * Assigns a submission queue to the least loaded worker thread, creating a
+ * new one if all are busy and the limit is not reached yet.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueSubm  The submission queue to assign.
+ */
+static int nvmeR3WrkThrdAssign(PNVME pThis, PNVMEQUEUESUBM pQueueSubm)
+{
+    int rc = PDMCritSectEnter(&pThis->CritSectWrkThrds, VERR_IGNORED);
+    AssertRC(rc);
+
+    PNVMEWRKTHRD pWrkThrd = NULL;
+    PNVMEWRKTHRD pIt;
+    RTListForEach(&pThis->LstWrkThrds, pIt, NVMEWRKTHRD, NdLstWrkThrds)
+    {
+        if (   !pWrkThrd
+            || pIt->cSubmQueues < pWrkThrd->cSubmQueues)
+            pWrkThrd = pIt;
+    }
+
+    if (   (!pWrkThrd || pWrkThrd->cSubmQueues > 0)
+        && pThis->cWrkThrdsCur < pThis->cWrkThrdsMax)
+    {
+        PNVMEWRKTHRD pWrkThrdNew = NULL;
+        rc = nvmeR3WrkThrdCreate(pThis, &pWrkThrdNew);
+        if (RT_SUCCESS(rc))
+            pWrkThrd = pWrkThrdNew;
+        else
+            LogRel(("NVMe#%d: Failed to create worker thread: %Rrc\n", pThis->pDevInsR3->iInstance, rc));
+    }
+
+    if (pWrkThrd)
+    {
+        RTSemFastMutexRequest(pWrkThrd->hMtx);
+        pQueueSubm->pWrkThrdR3  = pWrkThrd;
+        pQueueSubm->hEvtProcess = pWrkThrd->hEvtProcess;
+        RTListAppend(&pWrkThrd->LstSubmQueues, &pQueueSubm->NdLstWrkThrdAssgnd);
+        pWrkThrd->cSubmQueues++;
+        RTSemFastMutexRelease(pWrkThrd->hMtx);
+        rc = VINF_SUCCESS;
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    PDMCritSectLeave(&pThis->CritSectWrkThrds);
+    return rc;
+}
+
+/**
+ * Removes a submission queue from the worker thread it is assigned to.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueSubm  The submission queue to unassign.
+ */
+static void nvmeR3WrkThrdUnassign(PNVME pThis, PNVMEQUEUESUBM pQueueSubm)
+{
+    PNVMEWRKTHRD pWrkThrd = pQueueSubm->pWrkThrdR3;
+    if (!pWrkThrd)
+        return;
+
+    int rc = PDMCritSectEnter(&pThis->CritSectWrkThrds, VERR_IGNORED);
+    AssertRC(rc);
+
+    /* Taking the worker mutex waits for a processing pass over the queue to finish. */
+    RTSemFastMutexRequest(pWrkThrd->hMtx);
+    RTListNodeRemove(&pQueueSubm->NdLstWrkThrdAssgnd);
+    pWrkThrd->cSubmQueues--;
+    pQueueSubm->pWrkThrdR3  = NULL;
+    pQueueSubm->hEvtProcess = NIL_SUPSEMEVENT;
+    RTSemFastMutexRelease(pWrkThrd->hMtx);
+
+    PDMCritSectLeave(&pThis->CritSectWrkThrds);
+}
+
+/**
+ * Copies a string into a fixed size, space padded identify data field.
+ *
+ * @returns nothing.
+ * @param   pbDst       Where to copy the string to.
+ * @param   cbDst       Size of the field.
+ * @param   pszSrc      The string to copy.
+ */
+static void nvmeR3IdentifyStrCopy(uint8_t *pbDst, size_t cbDst, const char *pszSrc)
+{
+    size_t cchSrc = strlen(pszSrc);
+    memset(pbDst, ' ', cbDst);
+    memcpy(pbDst, pszSrc, RT_MIN(cchSrc, cbDst));
+}
+
+/**
+ * Admin command: Identify.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ */
+static uint16_t nvmeR3AdmIdentify(PNVME pThis, PCNVMECMD pCmd)
+{
+    uint8_t abData[_4K];
+    RT_ZERO(abData);
+
+    switch (NVME_CMD_CDW(pCmd, 10) & 0xff)
+    {
+        case 0x00: /* Namespace. */
+        {
+            if (   pCmd->u32Nsid == 0
+                || pCmd->u32Nsid > pThis->cNamespaces)
+                return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_NS_OR_FMT);
+
+            PNVMENAMESPACE pNs = &pThis->paNamespaces[pCmd->u32Nsid - 1];
+            if (pNs->pDrvMedia)
+            {
+                *(uint64_t *)&abData[0]  = pNs->cBlocks;  /* NSZE */
+                *(uint64_t *)&abData[8]  = pNs->cBlocks;  /* NCAP */
+                *(uint64_t *)&abData[16] = pNs->cBlocks;  /* NUSE */
+                abData[25] = 0;                           /* NLBAF: one format. */
+                abData[26] = 0;                           /* FLBAS: format 0 in use. */
+
+                RTUUID Uuid;
+                int rc = pNs->pDrvMedia->pfnGetUuid(pNs->pDrvMedia, &Uuid);
+                if (RT_SUCCESS(rc))
+                    memcpy(&abData[104], &Uuid, sizeof(Uuid)); /* NGUID */
+
+                abData[128 + 2] = (uint8_t)ASMBitFirstSetU32(pNs->cbBlock) - 1; /* LBAF0.LBADS */
+            }
+            /* else: Inactive namespaces return all zeros. */
+            break;
+        }
+        case 0x01: /* Controller. */
+        {
+            *(uint16_t *)&abData[0] = NVME_PCI_VENDOR_ID;                       /* VID */
+            *(uint16_t *)&abData[2] = NVME_PCI_VENDOR_ID;                       /* SSVID */
+            nvmeR3IdentifyStrCopy(&abData[4], NVME_SERIAL_NUMBER_LENGTH, pThis->szSerialNumber);
+            nvmeR3IdentifyStrCopy(&abData[24], NVME_MODEL_NUMBER_LENGTH, pThis->szModelNumber);
+            nvmeR3IdentifyStrCopy(&abData[64], NVME_FIRMWARE_REVISION_LENGTH, pThis->szFirmwareRevision);
+            abData[77] = NVME_MDTS;                                             /* MDTS */
+            *(uint32_t *)&abData[80] = NVME_VERSION;                            /* VER */
+            abData[258] = 3;                                                    /* ACL (0's based) */
+            abData[259] = (uint8_t)(pThis->cAsyncEvtReqsMax - 1);               /* AERL (0's based) */
+            abData[260] = RT_BIT(0) | (1 << 1);                                 /* FRMW: slot 1 read-only, one slot. */
+            abData[512] = (NVME_SUBM_QUEUE_ENTRY_SIZE_LOG2 << 4) | NVME_SUBM_QUEUE_ENTRY_SIZE_LOG2; /* SQES */
+            abData[513] = (NVME_COMP_QUEUE_ENTRY_SIZE_LOG2 << 4) | NVME_COMP_QUEUE_ENTRY_SIZE_LOG2; /* CQES */
+            *(uint32_t *)&abData[516] = pThis->cNamespaces;                     /* NN */
+
+            bool fDiscard = false;
+            for (uint32_t i = 0; i < pThis->cNamespaces; i++)
+                fDiscard |= pThis->paNamespaces[i].fDiscard;
+            *(uint16_t *)&abData[520] = fDiscard ? RT_BIT(2) : 0;               /* ONCS: Dataset Management */
+            abData[525] = RT_BIT(0);                                            /* VWC: present */
+
+            /* Power state descriptor 0: 25W maximum power, no latencies. */
+            *(uint16_t *)&abData[2048] = 2500;
+            break;
+        }
+        case 0x02: /* Active namespace ID list. */
+        {
+            uint32_t *pau32Nsids = (uint32_t *)&abData[0];
+            uint32_t  cNsids = 0;
+            for (uint32_t i = 0; i < pThis->cNamespaces && cNsids < sizeof(abData) / sizeof(uint32_t); i++)
+                if (   pThis->paNamespaces[i].u32Id > pCmd->u32Nsid
+                    && pThis->paNamespaces[i].pDrvBase)
+                    pau32Nsids[cNsids++] = pThis->paNamespaces[i].u32Id;
+            break;
+        }
+        default:
+            return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+    }
+
+    return nvmeR3AdmDataToGuest(pThis, pCmd, &abData[0], sizeof(abData));
+}
+
+/**
+ * Admin command: Get Log Page.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ */
+static uint16_t nvmeR3AdmGetLogPage(PNVME pThis, PCNVMECMD pCmd)
+{
+    uint8_t abData[_4K];
+    RT_ZERO(abData);
+
+    switch (NVME_CMD_CDW(pCmd, 10) & 0xff)
+    {
+        case 0x01: /* Error information, we never log anything there. */
+            break;
+        case 0x02: /* SMART / health information. */
+        {
+            *(uint16_t *)&abData[1] = 273 + 35;                                 /* Composite temperature in Kelvin. */
+            abData[3] = 100;                                                    /* Available spare. */
+            abData[4] = 10;                                                     /* Available spare threshold. */
+            /* Data units are thousands of 512 byte units, rounded up. */
+            *(uint64_t *)&abData[32]  = (ASMAtomicReadU64(&pThis->cDataUnitsRead) + 999) / 1000;
+            *(uint64_t *)&abData[48]  = (ASMAtomicReadU64(&pThis->cDataUnitsWritten) + 999) / 1000;
+            *(uint64_t *)&abData[64]  = ASMAtomicReadU64(&pThis->cHostReadCmds);
+            *(uint64_t *)&abData[80]  = ASMAtomicReadU64(&pThis->cHostWriteCmds);
+            *(uint64_t *)&abData[112] = 1;                                      /* Power cycles. */
+            *(uint64_t *)&abData[160] = ASMAtomicReadU64(&pThis->cMediaErrors);
+            break;
+        }
+        case 0x03: /* Firmware slot information. */
+            abData[0] = 1;                                                      /* AFI: slot 1 active. */
+            nvmeR3IdentifyStrCopy(&abData[8], NVME_FIRMWARE_REVISION_LENGTH, pThis->szFirmwareRevision);
+            break;
+        default:
+            return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_LOG_PAGE_INVALID);
+    }
+
+    /* NUMD is the 0's based number of dwords to return, anything beyond the log reads as zero. */
+    size_t cbXfer = ((NVME_CMD_CDW(pCmd, 10) >> 16) & 0xfff) * sizeof(uint32_t) + sizeof(uint32_t);
+    return nvmeR3AdmDataToGuest(pThis, pCmd, &abData[0], RT_MIN(cbXfer, sizeof(abData)));
+}
+
+/**
+ * Admin command: Create I/O Completion Queue.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ */
+static uint16_t nvmeR3AdmCompQueueCreate(PNVME pThis, PCNVMECMD pCmd)
+{
+    uint16_t u16CqId  = NVME_CMD_CDW(pCmd, 10) & 0xffff;
+    uint32_t cEntries = (NVME_CMD_CDW(pCmd, 10) >> 16) + 1;
+    bool     fPhysCont    = RT_BOOL(NVME_CMD_CDW(pCmd, 11) & RT_BIT_32(0));
+    bool     fIntrEnabled = RT_BOOL(NVME_CMD_CDW(pCmd, 11) & RT_BIT_32(1));
+    uint32_t u32IntrVec   = NVME_CMD_CDW(pCmd, 11) >> 16;
+
+    if (   u16CqId == 0
+        || u16CqId > pThis->cQueuesCompMax
+        || pThis->paQueuesCompR3[u16CqId].Hdr.enmState == NVMEQUEUESTATE_ALLOCATED)
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_QUEUE_ID_INVALID);
+    if (   cEntries < 2
+        || cEntries > pThis->cQueueEntriesMax)
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_QUEUE_SIZE_INVALID);
+    if (u32IntrVec >= nvmeR3IntrVecCount(pThis))
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_INTR_VEC_INVALID);
+    if (   !fPhysCont /* CAP.CQR */
+        || pThis->u32IoCompletionQueueEntrySize != NVME_COMP_QUEUE_ENTRY_SIZE_LOG2)
+        return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+    if (pCmd->u64Prp1 & (pThis->cbPage - 1))
+        return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_PRP_OFFSET);
+
+    PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[u16CqId];
+    pQueueComp->Hdr.cEntries   = cEntries;
+    pQueueComp->Hdr.GCPhysBase = pCmd->u64Prp1;
+    pQueueComp->Hdr.cbEntry    = 1 << pThis->u32IoCompletionQueueEntrySize;
+    pQueueComp->Hdr.idxHead    = 0;
+    pQueueComp->Hdr.idxTail    = 0;
+    pQueueComp->Hdr.fPhysCont  = fPhysCont;
+    pQueueComp->fIntrEnabled   = fIntrEnabled;
+    pQueueComp->fPhase         = true;
+    pQueueComp->fIntrPending   = false;
+    pQueueComp->u32IntrVec     = u32IntrVec;
+    pQueueComp->cSubmQueuesRef = 0;
+    Assert(!pQueueComp->cWaiters);
+    ASMAtomicWriteU32((volatile uint32_t *)&pQueueComp->Hdr.enmState, NVMEQUEUESTATE_ALLOCATED);
+
+    Log(("%s: Created completion queue %u (cEntries=%u GCPhysBase=%RGp vec=%u)\n", __FUNCTION__, u16CqId,
+         cEntries, pQueueComp->Hdr.GCPhysBase, u32IntrVec));
+    return NVME_STS_SUCCESS;
+}
+
+/**
+ * Tears down a completion queue.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueComp  The completion queue.
+ */
+static void nvmeR3CompQueueDestroy(PNVME pThis, PNVMEQUEUECOMP pQueueComp)
+{
+    ASMAtomicWriteU32((volatile uint32_t *)&pQueueComp->Hdr.enmState, NVMEQUEUESTATE_DEALLOCATED);
+    nvmeR3CompQueueWaitersFree(pQueueComp);
+
+    int rc = PDMCritSectEnter(&pThis->CritSectIntr, VERR_IGNORED);
+    AssertRC(rc);
+    if (pQueueComp->fIntrPending)
+    {
+        pQueueComp->fIntrPending = false;
+        ASMAtomicDecU32(&pThis->aIntrVecs[pQueueComp->u32IntrVec]);
+        nvmeIntxUpdate(pThis);
+    }
+    PDMCritSectLeave(&pThis->CritSectIntr);
+}
+
+/**
+ * Admin command: Delete I/O Completion Queue.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ */
+static uint16_t nvmeR3AdmCompQueueDelete(PNVME pThis, PCNVMECMD pCmd)
+{
+    uint16_t u16CqId = NVME_CMD_CDW(pCmd, 10) & 0xffff;
+
+    if (   u16CqId == 0
+        || u16CqId > pThis->cQueuesCompMax
+        || pThis->paQueuesCompR3[u16CqId].Hdr.enmState != NVMEQUEUESTATE_ALLOCATED)
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_QUEUE_ID_INVALID);
+
+    PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[u16CqId];
+    if (ASMAtomicReadU32(&pQueueComp->cSubmQueuesRef))
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_QUEUE_DELETION_INVALID);
+
+    nvmeR3CompQueueDestroy(pThis, pQueueComp);
+    Log(("%s: Deleted completion queue %u\n", __FUNCTION__, u16CqId));
+    return NVME_STS_SUCCESS;
+}
+
+/**
+ * Admin command: Create I/O Submission Queue.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ */
+static uint16_t nvmeR3AdmSubmQueueCreate(PNVME pThis, PCNVMECMD pCmd)
+{
+    uint16_t u16SqId   = NVME_CMD_CDW(pCmd, 10) & 0xffff;
+    uint32_t cEntries  = (NVME_CMD_CDW(pCmd, 10) >> 16) + 1;
+    bool     fPhysCont = RT_BOOL(NVME_CMD_CDW(pCmd, 11) & RT_BIT_32(0));
+    uint32_t uPrio     = (NVME_CMD_CDW(pCmd, 11) >> 1) & 0x3;
+    uint16_t u16CqId   = NVME_CMD_CDW(pCmd, 11) >> 16;
+
+    if (   u16SqId == 0
+        || u16SqId > pThis->cQueuesSubmMax
+        || pThis->paQueuesSubmR3[u16SqId].Hdr.enmState == NVMEQUEUESTATE_ALLOCATED)
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_QUEUE_ID_INVALID);
+    if (   cEntries < 2
+        || cEntries > pThis->cQueueEntriesMax)
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_QUEUE_SIZE_INVALID);
+    if (   u16CqId == 0
+        || u16CqId > pThis->cQueuesCompMax
+        || pThis->paQueuesCompR3[u16CqId].Hdr.enmState != NVMEQUEUESTATE_ALLOCATED)
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_COMP_QUEUE_INVALID);
+    if (   !fPhysCont /* CAP.CQR */
+        || pThis->u32IoSubmissionQueueEntrySize != NVME_SUBM_QUEUE_ENTRY_SIZE_LOG2)
+        return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+    if (pCmd->u64Prp1 & (pThis->cbPage - 1))
+        return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_PRP_OFFSET);
+
+    PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[u16SqId];
+    pQueueSubm->Hdr.cEntries         = cEntries;
+    pQueueSubm->Hdr.GCPhysBase       = pCmd->u64Prp1;
+    pQueueSubm->Hdr.cbEntry          = 1 << pThis->u32IoSubmissionQueueEntrySize;
+    pQueueSubm->Hdr.idxHead          = 0;
+    pQueueSubm->Hdr.idxTail          = 0;
+    pQueueSubm->Hdr.fPhysCont        = fPhysCont;
+    pQueueSubm->u16CompletionQueueId = u16CqId;
+    pQueueSubm->enmPriority          = (NVMEQUEUESUBMPRIO)(NVMEQUEUESUBMPRIO_URGENT + uPrio);
+
+    int rc = nvmeR3WrkThrdAssign(pThis, pQueueSubm);
+    if (RT_FAILURE(rc))
+        return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INTERNAL_ERROR);
+
+    ASMAtomicIncU32(&pThis->paQueuesCompR3[u16CqId].cSubmQueuesRef);
+    ASMAtomicWriteU32((volatile uint32_t *)&pQueueSubm->Hdr.enmState, NVMEQUEUESTATE_ALLOCATED);
+
+    Log(("%s: Created submission queue %u (cEntries=%u GCPhysBase=%RGp CQ=%u)\n", __FUNCTION__, u16SqId,
+         cEntries, pQueueSubm->Hdr.GCPhysBase, u16CqId));
+    return NVME_STS_SUCCESS;
+}
+
+/**
+ * Tears down an I/O submission queue.
+ *
+ * Completions of requests still active for the queue are dropped when they
+ * finish, see nvmeR3SubmQueueReqsAbort() for the guest deleting the queue.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueSubm  The submission queue.
+ */
+static void nvmeR3SubmQueueDestroy(PNVME pThis, PNVMEQUEUESUBM pQueueSubm)
+{
+    ASMAtomicWriteU32((volatile uint32_t *)&pQueueSubm->Hdr.enmState, NVMEQUEUESTATE_DEALLOCATED);
+    ASMAtomicIncU32(&pQueueSubm->uGen);
+    nvmeR3WrkThrdUnassign(pThis, pQueueSubm);
+    if (pQueueSubm->Hdr.u16Id != 0)
+        ASMAtomicDecU32(&pThis->paQueuesCompR3[pQueueSubm->u16CompletionQueueId].cSubmQueuesRef);
+}
+
+/**
+ * Cancels the requests active for a submission queue the guest deletes.
+ *
+ * Their completions are posted as they finish, with NVME_SC_ABORT_SQ_DELETED,
+ * and the last one completes the delete command, see
+ * nvmeR3SubmQueueDeleteComplete().
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueSubm  The submission queue.
+ */
+static void nvmeR3SubmQueueReqsAbort(PNVME pThis, PNVMEQUEUESUBM pQueueSubm)
+{
+    uint32_t const uGen = ASMAtomicReadU32(&pQueueSubm->uGen);
+
+    /* No new commands are fetched from the queue after this. */
+    ASMAtomicWriteBool(&pQueueSubm->fAborting, true);
+    nvmeR3WrkThrdUnassign(pThis, pQueueSubm);
+
+    /*
+     * Cancel the requests one by one, the list mutex can't be held while
+     * canceling as the request might complete right away.
+     */
+    for (;;)
+    {
+        PNVMENAMESPACE    pNs      = NULL;
+        PDMMEDIAEXIOREQID uIoReqId = 0;
+
+        RTSemFastMutexRequest(pQueueSubm->hMtxReqs);
+        PNVMEREQ pReq;
+        RTListForEach(&pQueueSubm->LstReqsActive, pReq, NVMEREQ, NdLstActive)
+        {
+            if (   !pReq->fCancelSent
+                && pReq->uGen == uGen)
+            {
+                pReq->fCancelSent = true;
+                pNs      = pReq->pNs;
+                uIoReqId = NVME_IOREQID_MAKE(pReq->u16SqId, pReq->u16Cid);
+                break;
+            }
+        }
+        RTSemFastMutexRelease(pQueueSubm->hMtxReqs);
+
+        if (!pNs)
+            break;
+        pNs->pDrvMediaEx->pfnIoReqCancel(pNs->pDrvMediaEx, uIoReqId);
+    }
+}
+
+/**
+ * Finishes deleting a submission queue once no requests are active anymore,
+ * posting the completion of the delete command.
+ *
+ * Called on the EMT for deletes which did not have to wait and from the I/O
+ * thread completing the last active request otherwise.  Does nothing if the
+ * delete was completed already or the controller was disabled meanwhile.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pQueueSubm  The submission queue.
+ */
+static void nvmeR3SubmQueueDeleteComplete(PNVME pThis, PNVMEQUEUESUBM pQueueSubm)
+{
+    int rc = PDMCritSectEnter(&pThis->CritSectCtrl, VERR_IGNORED);
+    AssertRC(rc);
+
+    if (ASMAtomicXchgBool(&pQueueSubm->fDeletePending, false))
+    {
+        nvmeR3SubmQueueDestroy(pThis, pQueueSubm);
+        ASMAtomicWriteBool(&pQueueSubm->fAborting, false);
+        Log(("%s: Deleted submission queue %u\n", __FUNCTION__, pQueueSubm->Hdr.u16Id));
+        nvmeR3CmdComplete(pThis, 0, pQueueSubm->uGenAdmDelete, pQueueSubm->u16CidDelete, NVME_STS_SUCCESS, 0);
+    }
+
+    PDMCritSectLeave(&pThis->CritSectCtrl);
+}
+
+/**
+ * Admin command: Delete I/O Submission Queue.
+ *
+ * The completion is posted once the requests active for the queue are done,
+ * so the EMT does not have to wait for them.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ * @param   uGen        The generation of the admin submission queue.
+ * @param   pfDeferred  Where to return whether the completion is posted later
+ *                      by nvmeR3SubmQueueDeleteComplete().
+ */
+static uint16_t nvmeR3AdmSubmQueueDelete(PNVME pThis, PCNVMECMD pCmd, uint32_t uGen, bool *pfDeferred)
+{
+    uint16_t u16SqId = NVME_CMD_CDW(pCmd, 10) & 0xffff;
+
+    if (   u16SqId == 0
+        || u16SqId > pThis->cQueuesSubmMax
+        || pThis->paQueuesSubmR3[u16SqId].Hdr.enmState != NVMEQUEUESTATE_ALLOCATED
+        || ASMAtomicReadBool(&pThis->paQueuesSubmR3[u16SqId].fDeletePending))
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_QUEUE_ID_INVALID);
+
+    PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[u16SqId];
+    nvmeR3SubmQueueReqsAbort(pThis, pQueueSubm);
+
+    /* The last request completing from here on finishes the delete, unless
+     * there is none left in which case it is done right away. */
+    pQueueSubm->u16CidDelete  = pCmd->u16Cid;
+    pQueueSubm->uGenAdmDelete = uGen;
+    ASMAtomicWriteBool(&pQueueSubm->fDeletePending, true);
+    if (!ASMAtomicReadU32(&pQueueSubm->cReqsActive))
+        nvmeR3SubmQueueDeleteComplete(pThis, pQueueSubm);
+    else
+        Log(("%s: Deleting submission queue %u after %u active requests\n", __FUNCTION__, u16SqId,
+             ASMAtomicReadU32(&pQueueSubm->cReqsActive)));
+
+    *pfDeferred = true;
+    return NVME_STS_SUCCESS;
+}
+
+/**
+ * Admin command: Abort.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ * @param   pu32Dw0     Where to store dword 0 of the completion.
+ */
+static uint16_t nvmeR3AdmAbort(PNVME pThis, PCNVMECMD pCmd, uint32_t *pu32Dw0)
+{
+    uint16_t u16SqId = NVME_CMD_CDW(pCmd, 10) & 0xffff;
+    uint16_t u16Cid  = NVME_CMD_CDW(pCmd, 10) >> 16;
+
+    /* Bit 0 set means the command was not aborted, the request ID doesn't tell the namespace so try them all. */
+    *pu32Dw0 = 1;
+    for (uint32_t i = 0; i < pThis->cNamespaces; i++)
+    {
+        PNVMENAMESPACE pNs = &pThis->paNamespaces[i];
+        if (   pNs->pDrvMediaEx
+            && RT_SUCCESS(pNs->pDrvMediaEx->pfnIoReqCancel(pNs->pDrvMediaEx, NVME_IOREQID_MAKE(u16SqId, u16Cid))))
+        {
+            *pu32Dw0 = 0;
+            break;
+        }
+    }
+
+    return NVME_STS_SUCCESS;
+}
+
+/**
+ * Admin command: Set Features.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ * @param   pu32Dw0     Where to store dword 0 of the completion.
+ */
+static uint16_t nvmeR3AdmSetFeatures(PNVME pThis, PCNVMECMD pCmd, uint32_t *pu32Dw0)
+{
+    uint8_t  uFid     = NVME_CMD_CDW(pCmd, 10) & 0xff;
+    uint32_t u32Value = NVME_CMD_CDW(pCmd, 11);
+
+    if (NVME_CMD_CDW(pCmd, 10) & RT_BIT_32(31))
+        return NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_FEAT_NOT_SAVEABLE);
+
+    switch (uFid)
+    {
+        case NVME_FEAT_NUMBER_OF_QUEUES:
+            /* The number of queues is fixed, report what we have (0's based). */
+            if (   (u32Value & 0xffff) == 0xffff
+                || (u32Value >> 16) == 0xffff)
+                return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+            *pu32Dw0 = pThis->au32Features[uFid];
+            return NVME_STS_SUCCESS;
+        case NVME_FEAT_POWER_MANAGEMENT:
+            if (u32Value & 0x1f) /* Only power state 0. */
+                return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+            break;
+        case NVME_FEAT_INTR_VEC_CONFIG:
+            if ((u32Value & 0xffff) >= nvmeR3IntrVecCount(pThis))
+                return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+            /* Interrupt coalescing is not implemented, so CD is fixed to 0. */
+            return NVME_STS_SUCCESS;
+        case NVME_FEAT_ARBITRATION:
+        case NVME_FEAT_TEMPERATURE_THRESHOLD:
+        case NVME_FEAT_ERROR_RECOVERY:
+        case NVME_FEAT_VOLATILE_WRITE_CACHE:
+        case NVME_FEAT_INTR_COALESCING:
+        case NVME_FEAT_WRITE_ATOMICITY:
+        case NVME_FEAT_ASYNC_EVT_CONFIG:
+            break;
+        default:
+            return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+    }
+
+    pThis->au32Features[uFid] = u32Value;
+    return NVME_STS_SUCCESS;
+}
+
+/**
+ * Admin command: Get Features.
+ *
+ * @returns NVMe status (without phase tag).
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ * @param   pu32Dw0     Where to store dword 0 of the completion.
+ */
+static uint16_t nvmeR3AdmGetFeatures(PNVME pThis, PCNVMECMD pCmd, uint32_t *pu32Dw0)
+{
+    uint8_t uFid = NVME_CMD_CDW(pCmd, 10) & 0xff;
+    uint8_t uSel = (NVME_CMD_CDW(pCmd, 10) >> 8) & 0x7;
+
+    if (   uFid == 0
+        || uFid >= NVME_FEAT_COUNT
+        || uFid == 0x03 /* LBA range type is optional and not supported. */)
+        return NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_FIELD);
+
+    if (uSel == 3)
+        *pu32Dw0 = uFid == NVME_FEAT_NUMBER_OF_QUEUES ? 0 : RT_BIT_32(2); /* Changeable but not saveable. */
+    else if (uFid == NVME_FEAT_INTR_VEC_CONFIG)
+        *pu32Dw0 = NVME_CMD_CDW(pCmd, 11) & 0xffff; /* CD is always 0. */
+    else
+        *pu32Dw0 = pThis->au32Features[uFid];
+    return NVME_STS_SUCCESS;
+}
+
+/**
+ * Resets the feature values to their defaults.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ */
+static void nvmeR3FeaturesReset(PNVME pThis)
+{
+    RT_ZERO(pThis->au32Features);
+    pThis->au32Features[NVME_FEAT_TEMPERATURE_THRESHOLD] = 273 + 85;
+    pThis->au32Features[NVME_FEAT_VOLATILE_WRITE_CACHE]  = RT_BIT_32(0);
+    pThis->au32Features[NVME_FEAT_NUMBER_OF_QUEUES]      =   ((pThis->cQueuesCompMax - 1) << 16)
+                                                           | (pThis->cQueuesSubmMax - 1);
+}
+
+/**
+ * Processes an admin command.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pCmd        The command.
+ */
+static void nvmeR3AdminCmdProcess(PNVME pThis, PCNVMECMD pCmd)
+{
+    uint32_t uGen   = pThis->paQueuesSubmR3[0].uGen;
+    uint32_t u32Dw0 = 0;
+    bool     fDeferred = false;
+    uint16_t u16Sts;
+
+    LogFlowFunc(("u16Cid=%#x u8Opc=%#x\n", pCmd->u16Cid, pCmd->u8Opc));
+
+    switch (pCmd->u8Opc)
+    {
+        case NVME_ADM_OPC_SQ_DELETE:
+            u16Sts = nvmeR3AdmSubmQueueDelete(pThis, pCmd, uGen, &fDeferred);
+            break;
+        case NVME_ADM_OPC_SQ_CREATE:
+            u16Sts = nvmeR3AdmSubmQueueCreate(pThis, pCmd);
+            break;
+        case NVME_ADM_OPC_GET_LOG_PAGE:
+            u16Sts = nvmeR3AdmGetLogPage(pThis, pCmd);
+            break;
+        case NVME_ADM_OPC_CQ_DELETE:
+            u16Sts = nvmeR3AdmCompQueueDelete(pThis, pCmd);
+            break;
+        case NVME_ADM_OPC_CQ_CREATE:
+            u16Sts = nvmeR3AdmCompQueueCreate(pThis, pCmd);
+            break;
+        case NVME_ADM_OPC_IDENTIFY:
+            u16Sts = nvmeR3AdmIdentify(pThis, pCmd);
+            break;
+        case NVME_ADM_OPC_ABORT:
+            u16Sts = nvmeR3AdmAbort(pThis, pCmd, &u32Dw0);
+            break;
+        case NVME_ADM_OPC_SET_FEATURES:
+            u16Sts = nvmeR3AdmSetFeatures(pThis, pCmd, &u32Dw0);
+            break;
+        case NVME_ADM_OPC_GET_FEATURES:
+            u16Sts = nvmeR3AdmGetFeatures(pThis, pCmd, &u32Dw0);
+            break;
+        case NVME_ADM_OPC_ASYNC_EVT_REQ:
+        {
+            /* Completed when an event occurs, we don't generate any yet. */
+            int rc = PDMCritSectEnter(&pThis->CritSectAsyncEvtReqs, VERR_IGNORED);
+            AssertRC(rc);
+            if (pThis->cAsyncEvtReqsCur < pThis->cAsyncEvtReqsMax)
+            {
+                pThis->paAsyncEvtReqCids[pThis->cAsyncEvtReqsCur++] = pCmd->u16Cid;
+                PDMCritSectLeave(&pThis->CritSectAsyncEvtReqs);
+                return;
+            }
+            PDMCritSectLeave(&pThis->CritSectAsyncEvtReqs);
+            u16Sts = NVME_STS_MAKE(NVME_SCT_CMD_SPECIFIC, NVME_SC_CS_ASYNC_EVT_REQ_LIMIT_EXCEEDED);
+            break;
+        }
+        default:
+            u16Sts = NVME_STS_MAKE(NVME_SCT_GENERIC, NVME_SC_INVALID_OPCODE);
+    }
+
+    if (!fDeferred)
+        nvmeR3CmdComplete(pThis, 0, uGen, pCmd->u16Cid, u16Sts, u32Dw0);
+}
+
+/**
+ * Processes all new commands in the admin submission queue.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ *
+ * @note Caller must own NVME::CritSectCtrl.
+ */
+static void nvmeR3AdminQueueProcess(PNVME pThis)
+{
+    PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[0];
+
+    while (   pThis->enmState == NVMESTATE_READY
+           && pQueueSubm->Hdr.idxHead != ASMAtomicReadU32(&pQueueSubm->Hdr.idxTail))
+    {
+        NVMECMD Cmd;
+        uint32_t idxHead = pQueueSubm->Hdr.idxHead;
+
+        PDMDevHlpPCIPhysRead(pThis->pDevInsR3, pQueueSubm->Hdr.GCPhysBase + (RTGCPHYS)idxHead * pQueueSubm->Hdr.cbEntry,
+                             &Cmd, sizeof(Cmd));
+        ASMAtomicWriteU32(&pQueueSubm->Hdr.idxHead, (idxHead + 1) % pQueueSubm->Hdr.cEntries);
+        nvmeR3AdminCmdProcess(pThis, &Cmd);
+    }
+}
+
+/**
+ * Enables the controller (CC.EN transition from 0 to 1).
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ */
+static void nvmeR3CtrlEnable(PNVME pThis)
+{
+    PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[0];
+    PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[0];
+
+    if (   pThis->uCssSet != NVME_CC_CSS_NVM
+        || pThis->uMpsSet > NVME_MPS_MAX
+        || pQueueSubm->Hdr.cEntries < 2
+        || pQueueComp->Hdr.cEntries < 2
+        || !pQueueSubm->Hdr.GCPhysBase
+        || !pQueueComp->Hdr.GCPhysBase)
+    {
+        if (!pThis->fFatalLogged)
+        {
+            LogRel(("NVMe#%d: Guest enabled the controller with invalid settings (CSS=%u MPS=%u ASQ=%RGp/%u ACQ=%RGp/%u)\n",
+                    pThis->pDevInsR3->iInstance, pThis->uCssSet, pThis->uMpsSet, pQueueSubm->Hdr.GCPhysBase,
+                    pQueueSubm->Hdr.cEntries, pQueueComp->Hdr.GCPhysBase, pQueueComp->Hdr.cEntries));
+            pThis->fFatalLogged = true;
+        }
+        ASMAtomicWriteU32((volatile uint32_t *)&pThis->enmState, NVMESTATE_FATAL);
+        return;
+    }
+
+    pThis->cbPage = NVME_PAGE_SIZE_MIN << pThis->uMpsSet;
+
+    pQueueComp->Hdr.cbEntry    = sizeof(NVMECQE);
+    pQueueComp->Hdr.idxHead    = 0;
+    pQueueComp->Hdr.idxTail    = 0;
+    pQueueComp->Hdr.fPhysCont  = true;
+    pQueueComp->fIntrEnabled   = true;
+    pQueueComp->fPhase         = true;
+    pQueueComp->fIntrPending   = false;
+    pQueueComp->u32IntrVec     = 0;
+    pQueueComp->cSubmQueuesRef = 1;
+    ASMAtomicWriteU32((volatile uint32_t *)&pQueueComp->Hdr.enmState, NVMEQUEUESTATE_ALLOCATED);
+
+    pQueueSubm->Hdr.cbEntry          = sizeof(NVMECMD);
+    pQueueSubm->Hdr.idxHead          = 0;
+    pQueueSubm->Hdr.idxTail          = 0;
+    pQueueSubm->Hdr.fPhysCont        = true;
+    pQueueSubm->u16CompletionQueueId = 0;
+    pQueueSubm->enmPriority          = NVMEQUEUESUBMPRIO_URGENT;
+    ASMAtomicWriteU32((volatile uint32_t *)&pQueueSubm->Hdr.enmState, NVMEQUEUESTATE_ALLOCATED);
+
+    ASMAtomicWriteU32((volatile uint32_t *)&pThis->enmState, NVMESTATE_READY);
+    LogRel(("NVMe#%d: Controller enabled (page size %u)\n", pThis->pDevInsR3->iInstance, pThis->cbPage));
+}
+
+/**
+ * Disables the controller, tearing down all queues and canceling outstanding
+ * requests (CC.EN transition from 1 to 0 and device reset).
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   fResetRegs  Flag whether to reset the register state as well.
+ */
+static void nvmeR3CtrlDisable(PNVME pThis, bool fResetRegs)
+{
+    ASMAtomicWriteU32((volatile uint32_t *)&pThis->enmState, NVMESTATE_DISABLED);
+
+    for (uint32_t i = 0; i < pThis->cNamespaces; i++)
+    {
+        PNVMENAMESPACE pNs = &pThis->paNamespaces[i];
+        if (pNs->pDrvMediaEx)
+            pNs->pDrvMediaEx->pfnIoReqCancelAll(pNs->pDrvMediaEx);
+    }
+
+    /* Deletes waiting for their requests are dropped along with the admin queue,
+     * the lock keeps nvmeR3SubmQueueDeleteComplete() from racing us. */
+    int rc = PDMCritSectEnter(&pThis->CritSectCtrl, VERR_IGNORED);
+    AssertRC(rc);
+    for (uint32_t i = 0; i <= pThis->cQueuesSubmMax; i++)
+    {
+        ASMAtomicWriteBool(&pThis->paQueuesSubmR3[i].fDeletePending, false);
+        ASMAtomicWriteBool(&pThis->paQueuesSubmR3[i].fAborting, false);
+        if (pThis->paQueuesSubmR3[i].Hdr.enmState == NVMEQUEUESTATE_ALLOCATED)
+            nvmeR3SubmQueueDestroy(pThis, &pThis->paQueuesSubmR3[i]);
+    }
+
+    for (uint32_t i = 0; i <= pThis->cQueuesCompMax; i++)
+        if (pThis->paQueuesCompR3[i].Hdr.enmState == NVMEQUEUESTATE_ALLOCATED)
+            nvmeR3CompQueueDestroy(pThis, &pThis->paQueuesCompR3[i]);
+    PDMCritSectLeave(&pThis->CritSectCtrl);
+
+    rc = PDMCritSectEnter(&pThis->CritSectIntr, VERR_IGNORED);
+    AssertRC(rc);
+    for (unsigned i = 0; i < RT_ELEMENTS(pThis->aIntrVecs); i++)
+        ASMAtomicWriteU32(&pThis->aIntrVecs[i], 0);
+    if (fResetRegs)
+        ASMAtomicWriteU32(&pThis->u32IntrMask, 0);
+    nvmeIntxUpdate(pThis);
+    PDMCritSectLeave(&pThis->CritSectIntr);
+
+    rc = PDMCritSectEnter(&pThis->CritSectAsyncEvtReqs, VERR_IGNORED);
+    AssertRC(rc);
+    pThis->cAsyncEvtReqsCur = 0;
+    PDMCritSectLeave(&pThis->CritSectAsyncEvtReqs);
+
+    pThis->uShutdwnNotifierLast = 0;
+    pThis->fFatalLogged         = false;
+
+    if (fResetRegs)
+    {
+        pThis->uCssSet                       = 0;
+        pThis->uMpsSet                       = 0;
+        pThis->uAmsSet                       = 0;
+        pThis->u32IoCompletionQueueEntrySize = 0;
+        pThis->u32IoSubmissionQueueEntrySize = 0;
+        pThis->u32RegIdx                     = 0;
+        pThis->cbPage                        = NVME_PAGE_SIZE_MIN;
+        pThis->paQueuesSubmR3[0].Hdr.cEntries   = 0;
+        pThis->paQueuesSubmR3[0].Hdr.GCPhysBase = 0;
+        pThis->paQueuesCompR3[0].Hdr.cEntries   = 0;
+        pThis->paQueuesCompR3[0].Hdr.GCPhysBase = 0;
+        nvmeR3FeaturesReset(pThis);
+    }
+}
+
+/**
+ * Handles writes to the registers controlling the controller state, called
+ * on the EMT in ring-3.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   offReg      The register offset.
+ * @param   u32Value    The value to write.
+ */
+static void nvmeR3RegWriteCtrl(PNVME pThis, uint32_t offReg, uint32_t u32Value)
+{
+    int rc = PDMCritSectEnter(&pThis->CritSectCtrl, VERR_IGNORED);
+    AssertRC(rc);
+
+    bool fDisabled = pThis->enmState == NVMESTATE_DISABLED;
+    PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[0];
+    PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[0];
+
+    switch (offReg)
+    {
+        case NVME_REG_CC:
+        {
+            if (fDisabled)
+            {
+                pThis->uCssSet = NVME_CC_CSS_GET(u32Value);
+                pThis->uMpsSet = NVME_CC_MPS_GET(u32Value);
+                pThis->uAmsSet = NVME_CC_AMS_GET(u32Value);
+            }
+            pThis->u32IoSubmissionQueueEntrySize = NVME_CC_IOSQES_GET(u32Value);
+            pThis->u32IoCompletionQueueEntrySize = NVME_CC_IOCQES_GET(u32Value);
+
+            uint8_t uShn = NVME_CC_SHN_GET(u32Value);
+            if (uShn != pThis->uShutdwnNotifierLast)
+            {
+                /* Nothing is cached in the controller, so shutdown processing completes immediately. */
+                Log(("%s: Shutdown notification %u\n", __FUNCTION__, uShn));
+                pThis->uShutdwnNotifierLast = uShn;
+            }
+
+            if ((u32Value & NVME_CC_EN) && fDisabled)
+                nvmeR3CtrlEnable(pThis);
+            else if (!(u32Value & NVME_CC_EN) && !fDisabled)
+            {
+                LogRel(("NVMe#%d: Controller disabled\n", pThis->pDevInsR3->iInstance));
+                nvmeR3CtrlDisable(pThis, false /*fResetRegs*/);
+            }
+            break;
+        }
+        case NVME_REG_NSSR:
+            /* NVM subsystem resets are not supported (CAP.NSSRS = 0). */
+            break;
+        case NVME_REG_AQA:
+            if (fDisabled)
+            {
+                pQueueSubm->Hdr.cEntries = NVME_AQA_ASQS_GET(u32Value) + 1;
+                pQueueComp->Hdr.cEntries = NVME_AQA_ACQS_GET(u32Value) + 1;
+            }
+            break;
+        case NVME_REG_ASQ:
+            if (fDisabled)
+                pQueueSubm->Hdr.GCPhysBase = RT_MAKE_U64(u32Value & ~(uint32_t)0xfff, RT_HI_U32(pQueueSubm->Hdr.GCPhysBase));
+            break;
+        case NVME_REG_ASQ + 4:
+            if (fDisabled)
+                pQueueSubm->Hdr.GCPhysBase = RT_MAKE_U64(RT_LO_U32(pQueueSubm->Hdr.GCPhysBase), u32Value);
+            break;
+        case NVME_REG_ACQ:
+            if (fDisabled)
+                pQueueComp->Hdr.GCPhysBase = RT_MAKE_U64(u32Value & ~(uint32_t)0xfff, RT_HI_U32(pQueueComp->Hdr.GCPhysBase));
+            break;
+        case NVME_REG_ACQ + 4:
+            if (fDisabled)
+                pQueueComp->Hdr.GCPhysBase = RT_MAKE_U64(RT_LO_U32(pQueueComp->Hdr.GCPhysBase), u32Value);
+            break;
+        default:
+            AssertMsgFailed(("Invalid register %#x\n", offReg));
+    }
+
+    PDMCritSectLeave(&pThis->CritSectCtrl);
+}
+
+/**
+ * @callback_method_impl{FNIOMIOPORTOUT, Index/Data register access.}
+ */
+static DECLCALLBACK(int) nvmeR3IOPortWrite(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, uint32_t u32, unsigned cb)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    RT_NOREF(pvUser);
+
+    if (cb != 4)
+        return VINF_SUCCESS;
+
+    if (Port - pThis->IOPortBase == 0)
+        pThis->u32RegIdx = u32 & ~(uint32_t)3;
+    else
+        nvmeRegWrite(pThis, pThis->u32RegIdx, u32);
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNIOMIOPORTIN, Index/Data register access.}
+ */
+static DECLCALLBACK(int) nvmeR3IOPortRead(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, uint32_t *pu32, unsigned cb)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    RT_NOREF(pvUser);
+
+    if (cb != 4)
+        return VERR_IOM_IOPORT_UNUSED;
+
+    if (Port - pThis->IOPortBase == 0)
+        *pu32 = pThis->u32RegIdx;
+    else
+        nvmeRegRead(pThis, pThis->u32RegIdx, pu32);
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNPCIIOREGIONMAP}
+ */
+static DECLCALLBACK(int) nvmeR3Map(PPDMDEVINS pDevIns, PPDMPCIDEV pPciDev, uint32_t iRegion,
+                                   RTGCPHYS GCPhysAddress, RTGCPHYS cb, PCIADDRESSSPACE enmType)
+{
+    RT_NOREF(pPciDev);
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    int   rc    = VINF_SUCCESS;
+
+    Log2(("%s: registering region %u at GCPhysAddr=%RGp cb=%RGp\n", __FUNCTION__, iRegion, GCPhysAddress, cb));
+
+    if (iRegion == NVME_PCI_REGION_MMIO)
+    {
+        Assert(enmType == (PCI_ADDRESS_SPACE_MEM | PCI_ADDRESS_SPACE_BAR64));
+        rc = PDMDevHlpMMIORegister(pDevIns, GCPhysAddress, cb, NULL /*pvUser*/,
+                                   IOMMMIO_FLAGS_READ_DWORD | IOMMMIO_FLAGS_WRITE_DWORD_ZEROED,
+                                   nvmeMMIOWrite, nvmeMMIORead, "NVMe");
+        if (RT_FAILURE(rc))
+            return rc;
+
+        if (pThis->fR0Enabled)
+        {
+            rc = PDMDevHlpMMIORegisterR0(pDevIns, GCPhysAddress, cb, NIL_RTR0PTR /*pvUser*/,
+                                         "nvmeMMIOWrite", "nvmeMMIORead");
+            if (RT_FAILURE(rc))
+                return rc;
+        }
+
+        if (pThis->fRCEnabled)
+        {
+            rc = PDMDevHlpMMIORegisterRC(pDevIns, GCPhysAddress, cb, NIL_RTRCPTR /*pvUser*/,
+                                         "nvmeMMIOWrite", "nvmeMMIORead");
+            if (RT_FAILURE(rc))
+                return rc;
+        }
+
+        pThis->GCPhysMMIO = GCPhysAddress;
+    }
+    else if (iRegion == NVME_PCI_REGION_IO)
+    {
+        Assert(enmType == PCI_ADDRESS_SPACE_IO); RT_NOREF(enmType);
+        rc = PDMDevHlpIOPortRegister(pDevIns, (RTIOPORT)GCPhysAddress, 8, NULL,
+                                     nvmeR3IOPortWrite, nvmeR3IOPortRead, NULL, NULL, "NVMe Index/Data");
+        if (RT_FAILURE(rc))
+            return rc;
+
+        pThis->IOPortBase = (RTIOPORT)GCPhysAddress;
+    }
+    else
+        AssertMsgFailed(("Invalid region %u\n", iRegion));
+
+    return rc;
+}
+
+/**
+ * @callback_method_impl{FNPDMQUEUEDEV, Wakes up the worker of a submission
+ *                      queue written from RC.}
+ */
+static DECLCALLBACK(bool) nvmeR3NotifyQueueConsumer(PPDMDEVINS pDevIns, PPDMQUEUEITEMCORE pItem)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    PNVMEWAKEITEM pWakeItem = (PNVMEWAKEITEM)pItem;
+
+    AssertReturn(pWakeItem->u16SqId <= pThis->cQueuesSubmMax, true);
+    SUPSEMEVENT hEvtProcess = pThis->paQueuesSubmR3[pWakeItem->u16SqId].hEvtProcess;
+    if (hEvtProcess != NIL_SUPSEMEVENT)
+    {
+        int rc = SUPSemEventSignal(pThis->pSupDrvSession, hEvtProcess);
+        AssertRC(rc);
+    }
+    return true;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAPORT,pfnQueryDeviceLocation}
+ */
+static DECLCALLBACK(int) nvmeR3QueryDeviceLocation(PPDMIMEDIAPORT pInterface, const char **ppcszController,
+                                                   uint32_t *piInstance, uint32_t *piLUN)
+{
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, IMediaPort);
+    PPDMDEVINS pDevIns = pNs->pNvmeR3->pDevInsR3;
+
+    AssertPtrReturn(ppcszController, VERR_INVALID_POINTER);
+    AssertPtrReturn(piInstance, VERR_INVALID_POINTER);
+    AssertPtrReturn(piLUN, VERR_INVALID_POINTER);
+
+    *ppcszController = pDevIns->pReg->szName;
+    *piInstance = pDevIns->iInstance;
+    *piLUN = pNs->u32Id - 1;
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqCopyFromBuf}
+ */
+static DECLCALLBACK(int) nvmeR3IoReqCopyFromBuf(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                void *pvIoReqAlloc, uint32_t offDst, PRTSGBUF pSgBuf,
+                                                size_t cbCopy)
+{
+    RT_NOREF1(hIoReq);
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, IMediaExPort);
+    PNVMEREQ pReq = (PNVMEREQ)pvIoReqAlloc;
+
+    size_t cbCopied = nvmeR3PrpCopy(pNs->pNvmeR3, pReq, offDst, pSgBuf, cbCopy, true /*fToGuest*/);
+    return cbCopied == cbCopy ? VINF_SUCCESS : VERR_PDM_MEDIAEX_IOBUF_OVERFLOW;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqCopyToBuf}
+ */
+static DECLCALLBACK(int) nvmeR3IoReqCopyToBuf(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                              void *pvIoReqAlloc, uint32_t offSrc, PRTSGBUF pSgBuf,
+                                              size_t cbCopy)
+{
+    RT_NOREF1(hIoReq);
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, IMediaExPort);
+    PNVMEREQ pReq = (PNVMEREQ)pvIoReqAlloc;
+
+    size_t cbCopied = nvmeR3PrpCopy(pNs->pNvmeR3, pReq, offSrc, pSgBuf, cbCopy, false /*fToGuest*/);
+    return cbCopied == cbCopy ? VINF_SUCCESS : VERR_PDM_MEDIAEX_IOBUF_UNDERRUN;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqQueryDiscardRanges}
+ */
+static DECLCALLBACK(int) nvmeR3IoReqQueryDiscardRanges(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                       void *pvIoReqAlloc, uint32_t idxRangeStart,
+                                                       uint32_t cRanges, PRTRANGE paRanges,
+                                                       uint32_t *pcRanges)
+{
+    RT_NOREF1(hIoReq);
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, IMediaExPort);
+    PNVMEREQ pReq = (PNVMEREQ)pvIoReqAlloc;
+    uint32_t cRangesTotal = (uint32_t)(pReq->cbXfer / 16);
+    uint32_t cRangesDone  = 0;
+
+    /* Each DSM range is 16 bytes: context attributes, length in blocks and the starting LBA. */
+    while (   cRangesDone < cRanges
+           && idxRangeStart + cRangesDone < cRangesTotal)
+    {
+        uint32_t au32Range[4];
+        RTSGSEG Seg;
+        RTSGBUF SgBuf;
+        Seg.pvSeg = &au32Range[0];
+        Seg.cbSeg = sizeof(au32Range);
+        RTSgBufInit(&SgBuf, &Seg, 1);
+
+        size_t cbCopied = nvmeR3PrpCopy(pNs->pNvmeR3, pReq, (idxRangeStart + cRangesDone) * sizeof(au32Range),
+                                        &SgBuf, sizeof(au32Range), false /*fToGuest*/);
+        if (cbCopied != sizeof(au32Range))
+            return VERR_PDM_MEDIAEX_IOBUF_UNDERRUN;
+
+        uint64_t uLba    = RT_MAKE_U64(au32Range[2], au32Range[3]);
+        uint32_t cBlocks = au32Range[1];
+        if (   uLba >= pNs->cBlocks
+            || pNs->cBlocks - uLba < cBlocks)
+            return VERR_INVALID_PARAMETER;
+
+        paRanges[cRangesDone].offStart = uLba * pNs->cbBlock;
+        paRanges[cRangesDone].cbRange  = (size_t)cBlocks * pNs->cbBlock;
+        cRangesDone++;
+    }
+
+    *pcRanges = cRangesDone;
+    return VINF_SUCCESS;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqCompleteNotify}
+ */
+static DECLCALLBACK(int) nvmeR3IoReqCompleteNotify(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                   void *pvIoReqAlloc, int rcReq)
+{
+    RT_NOREF(hIoReq);
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, IMediaExPort);
+    nvmeR3ReqComplete(pNs->pNvmeR3, pNs, (PNVMEREQ)pvIoReqAlloc, rcReq);
+    return VINF_SUCCESS;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqStateChanged}
+ */
+static DECLCALLBACK(void) nvmeR3IoReqStateChanged(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                  void *pvIoReqAlloc, PDMMEDIAEXIOREQSTATE enmState)
+{
+    RT_NOREF2(hIoReq, pvIoReqAlloc);
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, IMediaExPort);
+    PNVME pThis = pNs->pNvmeR3;
+
+    switch (enmState)
+    {
+        case PDMMEDIAEXIOREQSTATE_SUSPENDED:
+        {
+            /* Make sure the request is not accounted for so the VM can suspend successfully. */
+            uint32_t cTasksActive = ASMAtomicDecU32(&pNs->cOutstandingRequests);
+            if (!cTasksActive && pThis->fSignalIdle)
+                PDMDevHlpAsyncNotificationCompleted(pThis->pDevInsR3);
+            break;
+        }
+        case PDMMEDIAEXIOREQSTATE_ACTIVE:
+            /* Make sure the request is accounted for so the VM suspends only when the request is complete. */
+            ASMAtomicIncU32(&pNs->cOutstandingRequests);
+            break;
+        default:
+            AssertMsgFailed(("Invalid request state given %u\n", enmState));
+    }
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnMediumEjected}
+ */
+static DECLCALLBACK(void) nvmeR3MediumEjected(PPDMIMEDIAEXPORT pInterface)
+{
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, IMediaExPort);
+    PNVME pThis = pNs->pNvmeR3;
+
+    if (pThis->pMediaNotify)
+    {
+        int rc = VMR3ReqCallNoWait(PDMDevHlpGetVM(pThis->pDevInsR3), VMCPUID_ANY,
+                                   (PFNRT)pThis->pMediaNotify->pfnEjected, 2,
+                                   pThis->pMediaNotify, pNs->u32Id - 1);
+        AssertRC(rc);
+    }
+}
+
+/**
+ * @interface_method_impl{PDMILEDPORTS,pfnQueryStatusLed, For a namespace.}
+ */
+static DECLCALLBACK(int) nvmeR3NsQueryStatusLed(PPDMILEDPORTS pInterface, unsigned iLUN, PPDMLED *ppLed)
+{
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, ILed);
+    if (iLUN == 0)
+    {
+        *ppLed = &pNs->Led;
+        Assert((*ppLed)->u32Magic == PDMLED_MAGIC);
+        return VINF_SUCCESS;
+    }
+    return VERR_PDM_LUN_NOT_FOUND;
+}
+
+/**
+ * @interface_method_impl{PDMIBASE,pfnQueryInterface}
+ */
+static DECLCALLBACK(void *) nvmeR3NsQueryInterface(PPDMIBASE pInterface, const char *pszIID)
+{
+    PNVMENAMESPACE pNs = RT_FROM_MEMBER(pInterface, NVMENAMESPACE, IBase);
+
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBASE, &pNs->IBase);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIMEDIAPORT, &pNs->IMediaPort);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIMEDIAEXPORT, &pNs->IMediaExPort);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMILEDPORTS, &pNs->ILed);
+    return NULL;
+}
+
+/**
+ * Gets the pointer to the status LED of a namespace.
+ *
+ * @returns VBox status code.
+ * @param   pInterface      Pointer to the interface structure containing the called function pointer.
+ * @param   iLUN            The unit which status LED we desire.
+ * @param   ppLed           Where to store the LED pointer.
+ */
+static DECLCALLBACK(int) nvmeR3StatusQueryStatusLed(PPDMILEDPORTS pInterface, unsigned iLUN, PPDMLED *ppLed)
+{
+    PNVME pThis = RT_FROM_MEMBER(pInterface, NVME, ILeds);
+    if (iLUN < pThis->cNamespaces)
+    {
+        *ppLed = &pThis->paNamespaces[iLUN].Led;
+        Assert((*ppLed)->u32Magic == PDMLED_MAGIC);
+        return VINF_SUCCESS;
+    }
+    return VERR_PDM_LUN_NOT_FOUND;
+}
+
+/**
+ * @interface_method_impl{PDMIBASE,pfnQueryInterface}
+ */
+static DECLCALLBACK(void *) nvmeR3StatusQueryInterface(PPDMIBASE pInterface, const char *pszIID)
+{
+    PNVME pThis = RT_FROM_MEMBER(pInterface, NVME, IBase);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBASE, &pThis->IBase);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMILEDPORTS, &pThis->ILeds);
+    return NULL;
+}
+
+/**
+ * @callback_method_impl{FNDBGFHANDLERDEV}
+ */
+static DECLCALLBACK(void) nvmeR3Info(PPDMDEVINS pDevIns, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    RT_NOREF(pszArgs);
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    pHlp->pfnPrintf(pHlp, "%s#%d: state=%d MMIO=%RGp IOPort=%RTiop MSI-X=%RTbool INTx=%RTbool IntrMask=%#x\n",
+                    pDevIns->pReg->szName, pDevIns->iInstance, pThis->enmState, pThis->GCPhysMMIO, pThis->IOPortBase,
+                    nvmeIsMsixEnabled(pThis), pThis->fIntxAsserted, pThis->u32IntrMask);
+    pHlp->pfnPrintf(pHlp, "cbPage=%u IOSQES=%u IOCQES=%u AERs=%u/%u workers=%u (active %u)\n",
+                    pThis->cbPage, pThis->u32IoSubmissionQueueEntrySize, pThis->u32IoCompletionQueueEntrySize,
+                    pThis->cAsyncEvtReqsCur, pThis->cAsyncEvtReqsMax, pThis->cWrkThrdsCur, pThis->cWrkThrdsActive);
+
+    for (uint32_t i = 0; i <= pThis->cQueuesCompMax; i++)
+    {
+        PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[i];
+        if (pQueueComp->Hdr.enmState == NVMEQUEUESTATE_ALLOCATED)
+            pHlp->pfnPrintf(pHlp, "CQ%u: base=%RGp entries=%u head=%u tail=%u phase=%RTbool vec=%u pending=%RTbool waiters=%u SQs=%u\n",
+                            i, pQueueComp->Hdr.GCPhysBase, pQueueComp->Hdr.cEntries, pQueueComp->Hdr.idxHead,
+                            pQueueComp->Hdr.idxTail, pQueueComp->fPhase, pQueueComp->u32IntrVec, pQueueComp->fIntrPending,
+                            pQueueComp->cWaiters, pQueueComp->cSubmQueuesRef);
+    }
+
+    for (uint32_t i = 0; i <= pThis->cQueuesSubmMax; i++)
+    {
+        PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[i];
+        if (pQueueSubm->Hdr.enmState == NVMEQUEUESTATE_ALLOCATED)
+            pHlp->pfnPrintf(pHlp, "SQ%u: base=%RGp entries=%u head=%u tail=%u CQ=%u active=%u\n",
+                            i, pQueueSubm->Hdr.GCPhysBase, pQueueSubm->Hdr.cEntries, pQueueSubm->Hdr.idxHead,
+                            pQueueSubm->Hdr.idxTail, pQueueSubm->u16CompletionQueueId, pQueueSubm->cReqsActive);
+    }
+
+    for (uint32_t i = 0; i < pThis->cNamespaces; i++)
+    {
+        PNVMENAMESPACE pNs = &pThis->paNamespaces[i];
+        pHlp->pfnPrintf(pHlp, "NS%u: attached=%RTbool blocks=%llu cbBlock=%u outstanding=%u\n",
+                        pNs->u32Id, pNs->pDrvBase != NULL, pNs->cBlocks, pNs->cbBlock, pNs->cOutstandingRequests);
+    }
+}
+
+/**
+ * Saves the controller configuration.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pSSM        SSM operation handle.
+ */
+static void nvmeR3SaveConfig(PNVME pThis, PSSMHANDLE pSSM)
+{
+    SSMR3PutU32(pSSM, pThis->cQueuesSubmMax);
+    SSMR3PutU32(pSSM, pThis->cQueuesCompMax);
+    SSMR3PutU32(pSSM, pThis->cQueueEntriesMax);
+    SSMR3PutU32(pSSM, pThis->cNamespaces);
+    SSMR3PutU32(pSSM, pThis->cAsyncEvtReqsMax);
+}
+
+/**
+ * @callback_method_impl{FNSSMDEVLIVEEXEC}
+ */
+static DECLCALLBACK(int) nvmeR3LiveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint32_t uPass)
+{
+    RT_NOREF(uPass);
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    nvmeR3SaveConfig(pThis, pSSM);
+    return VINF_SSM_DONT_CALL_AGAIN;
+}
+
+/**
+ * Saves a command which needs to be resubmitted after the state was loaded.
+ *
+ * @returns nothing.
+ * @param   pSSM        SSM operation handle.
+ * @param   u16SqId     The submission queue the command was fetched from.
+ * @param   pCmd        The command.
+ */
+static void nvmeR3SaveRedoCmd(PSSMHANDLE pSSM, uint16_t u16SqId, PCNVMECMD pCmd)
+{
+    SSMR3PutU16(pSSM, u16SqId);
+    SSMR3PutMem(pSSM, pCmd, sizeof(*pCmd));
+}
+
+/**
+ * @callback_method_impl{FNSSMDEVSAVEEXEC}
+ */
+static DECLCALLBACK(int) nvmeR3SaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    nvmeR3SaveConfig(pThis, pSSM);
+
+    /* Controller registers. */
+    SSMR3PutU32(pSSM, pThis->enmState);
+    SSMR3PutU32(pSSM, pThis->u32IntrMask);
+    SSMR3PutU32(pSSM, pThis->u32IoCompletionQueueEntrySize);
+    SSMR3PutU32(pSSM, pThis->u32IoSubmissionQueueEntrySize);
+    SSMR3PutU8 (pSSM, pThis->uShutdwnNotifierLast);
+    SSMR3PutU8 (pSSM, pThis->uAmsSet);
+    SSMR3PutU8 (pSSM, pThis->uMpsSet);
+    SSMR3PutU8 (pSSM, pThis->uCssSet);
+    SSMR3PutU32(pSSM, pThis->u32RegIdx);
+    SSMR3PutU32(pSSM, pThis->cbPage);
+    SSMR3PutMem(pSSM, &pThis->au32Features[0], sizeof(pThis->au32Features));
+    SSMR3PutU64(pSSM, pThis->cDataUnitsRead);
+    SSMR3PutU64(pSSM, pThis->cDataUnitsWritten);
+    SSMR3PutU64(pSSM, pThis->cHostReadCmds);
+    SSMR3PutU64(pSSM, pThis->cHostWriteCmds);
+    SSMR3PutU64(pSSM, pThis->cMediaErrors);
+
+    /* Submission queues. */
+    for (uint32_t i = 0; i <= pThis->cQueuesSubmMax; i++)
+    {
+        PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[i];
+        SSMR3PutU32   (pSSM, pQueueSubm->Hdr.enmState);
+        SSMR3PutU32   (pSSM, pQueueSubm->Hdr.cEntries);
+        SSMR3PutGCPhys(pSSM, pQueueSubm->Hdr.GCPhysBase);
+        SSMR3PutU32   (pSSM, pQueueSubm->Hdr.cbEntry);
+        SSMR3PutU32   (pSSM, pQueueSubm->Hdr.idxHead);
+        SSMR3PutU32   (pSSM, pQueueSubm->Hdr.idxTail);
+        SSMR3PutU16   (pSSM, pQueueSubm->u16CompletionQueueId);
+        SSMR3PutU32   (pSSM, pQueueSubm->enmPriority);
+    }
+
+    /* Completion queues including the completions waiting for room. */
+    for (uint32_t i = 0; i <= pThis->cQueuesCompMax; i++)
+    {
+        PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[i];
+        SSMR3PutU32   (pSSM, pQueueComp->Hdr.enmState);
+        SSMR3PutU32   (pSSM, pQueueComp->Hdr.cEntries);
+        SSMR3PutGCPhys(pSSM, pQueueComp->Hdr.GCPhysBase);
+        SSMR3PutU32   (pSSM, pQueueComp->Hdr.cbEntry);
+        SSMR3PutU32   (pSSM, pQueueComp->Hdr.idxHead);
+        SSMR3PutU32   (pSSM, pQueueComp->Hdr.idxTail);
+        SSMR3PutBool  (pSSM, pQueueComp->fIntrEnabled);
+        SSMR3PutBool  (pSSM, pQueueComp->fPhase);
+        SSMR3PutBool  (pSSM, pQueueComp->fIntrPending);
+        SSMR3PutU32   (pSSM, pQueueComp->u32IntrVec);
+        SSMR3PutU32   (pSSM, pQueueComp->cSubmQueuesRef);
+
+        RTSemFastMutexRequest(pQueueComp->hMtx);
+        SSMR3PutU32(pSSM, pQueueComp->cWaiters);
+        PNVMECOMPWAITER pWaiter;
+        RTListForEach(&pQueueComp->LstCompletionsWaiting, pWaiter, NVMECOMPWAITER, NdLstWait)
+        {
+            SSMR3PutMem(pSSM, &pWaiter->Cqe, sizeof(pWaiter->Cqe));
+        }
+        RTSemFastMutexRelease(pQueueComp->hMtx);
+    }
+
+    /* Outstanding asynchronous event requests. */
+    SSMR3PutU32(pSSM, pThis->cAsyncEvtReqsCur);
+    for (uint32_t i = 0; i < pThis->cAsyncEvtReqsCur; i++)
+        SSMR3PutU16(pSSM, pThis->paAsyncEvtReqCids[i]);
+
+    /* Suspended requests are saved as commands to resubmit after loading. */
+    for (uint32_t i = 0; i < pThis->cNamespaces; i++)
+    {
+        PNVMENAMESPACE pNs = &pThis->paNamespaces[i];
+        uint32_t cReqsSuspended = 0;
+
+        if (pNs->pDrvMediaEx)
+            cReqsSuspended = pNs->pDrvMediaEx->pfnIoReqGetSuspendedCount(pNs->pDrvMediaEx);
+
+        SSMR3PutU32(pSSM, cReqsSuspended);
+        if (cReqsSuspended)
+        {
+            PDMMEDIAEXIOREQ hIoReq;
+            PNVMEREQ pReq;
+            int rc = pNs->pDrvMediaEx->pfnIoReqQuerySuspendedStart(pNs->pDrvMediaEx, &hIoReq, (void **)&pReq);
+            AssertRCReturn(rc, rc);
+
+            for (;;)
+            {
+                nvmeR3SaveRedoCmd(pSSM, pReq->u16SqId, &pReq->Cmd);
+
+                cReqsSuspended--;
+                if (!cReqsSuspended)
+                    break;
+
+                rc = pNs->pDrvMediaEx->pfnIoReqQuerySuspendedNext(pNs->pDrvMediaEx, hIoReq, &hIoReq, (void **)&pReq);
+                AssertRCReturn(rc, rc);
+            }
+        }
+    }
+
+    /* Commands restored from an earlier saved state which were not resubmitted yet. */
+    uint32_t  cRedo = 0;
+    PNVMEREDO pRedo;
+    RTListForEach(&pThis->LstRedo, pRedo, NVMEREDO, NdLstRedo)
+    {
+        cRedo++;
+    }
+    SSMR3PutU32(pSSM, cRedo);
+    RTListForEach(&pThis->LstRedo, pRedo, NVMEREDO, NdLstRedo)
+    {
+        nvmeR3SaveRedoCmd(pSSM, pRedo->u16SqId, &pRedo->Cmd);
+    }
+
+    return SSMR3PutU32(pSSM, UINT32_MAX); /* sanity/terminator */
+}
+
+/**
+ * Loads a list of commands to resubmit and appends them to the redo list.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pSSM        SSM operation handle.
+ */
+static int nvmeR3LoadRedoCmds(PNVME pThis, PSSMHANDLE pSSM)
+{
+    uint32_t cCmds = 0;
+    int rc = SSMR3GetU32(pSSM, &cCmds);
+    AssertRCReturn(rc, rc);
+
+    for (uint32_t i = 0; i < cCmds; i++)
+    {
+        PNVMEREDO pRedo = (PNVMEREDO)RTMemAllocZ(sizeof(NVMEREDO));
+        if (!pRedo)
+            return VERR_NO_MEMORY;
+
+        SSMR3GetU16(pSSM, &pRedo->u16SqId);
+        rc = SSMR3GetMem(pSSM, &pRedo->Cmd, sizeof(pRedo->Cmd));
+        if (   RT_FAILURE(rc)
+            || pRedo->u16SqId == 0
+            || pRedo->u16SqId > pThis->cQueuesSubmMax)
+        {
+            RTMemFree(pRedo);
+            return RT_FAILURE(rc) ? rc : VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+        }
+
+        RTListAppend(&pThis->LstRedo, &pRedo->NdLstRedo);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNSSMDEVLOADEXEC}
+ */
+static DECLCALLBACK(int) nvmeR3LoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    PNVME    pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    uint32_t u32;
+    int      rc;
+
+    if (uVersion != NVME_SAVED_STATE_VERSION)
+        return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
+
+    /* Verify the configuration. */
+    static const char * const s_apszCfg[] =
+    { "QueuesSubmissionMax", "QueuesCompletionMax", "QueueEntriesMax", "NamespacesMax", "AsyncEvtReqsMax" };
+    uint32_t const au32Cfg[] =
+    { pThis->cQueuesSubmMax, pThis->cQueuesCompMax, pThis->cQueueEntriesMax, pThis->cNamespaces, pThis->cAsyncEvtReqsMax };
+    AssertCompile(RT_ELEMENTS(s_apszCfg) == RT_ELEMENTS(au32Cfg));
+    for (unsigned i = 0; i < RT_ELEMENTS(au32Cfg); i++)
+    {
+        rc = SSMR3GetU32(pSSM, &u32);
+        AssertRCReturn(rc, rc);
+        if (u32 != au32Cfg[i])
+            return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("Config mismatch - saved %s=%u config=%u"),
+                                    s_apszCfg[i], u32, au32Cfg[i]);
+    }
+
+    if (uPass != SSM_PASS_FINAL)
+        return VINF_SUCCESS;
+
+    /* Start from a clean slate, this tears down any queues and worker assignments. */
+    nvmeR3CtrlDisable(pThis, true /*fResetRegs*/);
+
+    SSMR3GetU32(pSSM, &u32);
+    NVMESTATE enmState = (NVMESTATE)u32;
+    SSMR3GetU32(pSSM, &u32);
+    ASMAtomicWriteU32(&pThis->u32IntrMask, u32);
+    SSMR3GetU32(pSSM, &pThis->u32IoCompletionQueueEntrySize);
+    SSMR3GetU32(pSSM, &pThis->u32IoSubmissionQueueEntrySize);
+    SSMR3GetU8 (pSSM, &pThis->uShutdwnNotifierLast);
+    SSMR3GetU8 (pSSM, &pThis->uAmsSet);
+    SSMR3GetU8 (pSSM, &pThis->uMpsSet);
+    SSMR3GetU8 (pSSM, &pThis->uCssSet);
+    SSMR3GetU32(pSSM, &pThis->u32RegIdx);
+    SSMR3GetU32(pSSM, &pThis->cbPage);
+    SSMR3GetMem(pSSM, &pThis->au32Features[0], sizeof(pThis->au32Features));
+    SSMR3GetU64(pSSM, (uint64_t *)&pThis->cDataUnitsRead);
+    SSMR3GetU64(pSSM, (uint64_t *)&pThis->cDataUnitsWritten);
+    SSMR3GetU64(pSSM, (uint64_t *)&pThis->cHostReadCmds);
+    SSMR3GetU64(pSSM, (uint64_t *)&pThis->cHostWriteCmds);
+    rc = SSMR3GetU64(pSSM, (uint64_t *)&pThis->cMediaErrors);
+    AssertRCReturn(rc, rc);
+
+    for (uint32_t i = 0; i <= pThis->cQueuesSubmMax; i++)
+    {
+        PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[i];
+
+        SSMR3GetU32   (pSSM, &u32);
+        pQueueSubm->Hdr.enmState = (NVMEQUEUESTATE)u32;
+        SSMR3GetU32   (pSSM, &pQueueSubm->Hdr.cEntries);
+        SSMR3GetGCPhys(pSSM, &pQueueSubm->Hdr.GCPhysBase);
+        SSMR3GetU32   (pSSM, &pQueueSubm->Hdr.cbEntry);
+        SSMR3GetU32   (pSSM, (uint32_t *)&pQueueSubm->Hdr.idxHead);
+        SSMR3GetU32   (pSSM, (uint32_t *)&pQueueSubm->Hdr.idxTail);
+        SSMR3GetU16   (pSSM, &pQueueSubm->u16CompletionQueueId);
+        rc = SSMR3GetU32(pSSM, &u32);
+        AssertRCReturn(rc, rc);
+        pQueueSubm->enmPriority = (NVMEQUEUESUBMPRIO)u32;
+
+        if (   pQueueSubm->Hdr.enmState == NVMEQUEUESTATE_ALLOCATED
+            && (   pQueueSubm->u16CompletionQueueId > pThis->cQueuesCompMax
+                || pQueueSubm->Hdr.cEntries < 2
+                || pQueueSubm->Hdr.cEntries > pThis->cQueueEntriesMax
+                || pQueueSubm->Hdr.idxHead >= pQueueSubm->Hdr.cEntries
+                || pQueueSubm->Hdr.idxTail >= pQueueSubm->Hdr.cEntries))
+            return VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+    }
+
+    for (uint32_t i = 0; i <= pThis->cQueuesCompMax; i++)
+    {
+        PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[i];
+
+        SSMR3GetU32   (pSSM, &u32);
+        pQueueComp->Hdr.enmState = (NVMEQUEUESTATE)u32;
+        SSMR3GetU32   (pSSM, &pQueueComp->Hdr.cEntries);
+        SSMR3GetGCPhys(pSSM, &pQueueComp->Hdr.GCPhysBase);
+        SSMR3GetU32   (pSSM, &pQueueComp->Hdr.cbEntry);
+        SSMR3GetU32   (pSSM, (uint32_t *)&pQueueComp->Hdr.idxHead);
+        SSMR3GetU32   (pSSM, (uint32_t *)&pQueueComp->Hdr.idxTail);
+        SSMR3GetBool  (pSSM, &pQueueComp->fIntrEnabled);
+        SSMR3GetBool  (pSSM, &pQueueComp->fPhase);
+        SSMR3GetBool  (pSSM, (bool *)&pQueueComp->fIntrPending);
+        SSMR3GetU32   (pSSM, &pQueueComp->u32IntrVec);
+        SSMR3GetU32   (pSSM, (uint32_t *)&pQueueComp->cSubmQueuesRef);
+
+        uint32_t cWaiters = 0;
+        rc = SSMR3GetU32(pSSM, &cWaiters);
+        AssertRCReturn(rc, rc);
+        if (   pQueueComp->u32IntrVec >= NVME_INTR_VEC_MAX
+            || (   pQueueComp->Hdr.enmState == NVMEQUEUESTATE_ALLOCATED
+                && (   pQueueComp->Hdr.cEntries < 2
+                    || pQueueComp->Hdr.cEntries > pThis->cQueueEntriesMax
+                    || pQueueComp->Hdr.idxHead >= pQueueComp->Hdr.cEntries
+                    || pQueueComp->Hdr.idxTail >= pQueueComp->Hdr.cEntries)))
+            return VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+
+        for (uint32_t iWaiter = 0; iWaiter < cWaiters; iWaiter++)
+        {
+            PNVMECOMPWAITER pWaiter = (PNVMECOMPWAITER)RTMemAllocZ(sizeof(NVMECOMPWAITER));
+            if (!pWaiter)
+                return VERR_NO_MEMORY;
+
+            rc = SSMR3GetMem(pSSM, &pWaiter->Cqe, sizeof(pWaiter->Cqe));
+            if (RT_FAILURE(rc))
+            {
+                RTMemFree(pWaiter);
+                return rc;
+            }
+            RTListAppend(&pQueueComp->LstCompletionsWaiting, &pWaiter->NdLstWait);
+            pQueueComp->cWaiters++;
+        }
+
+        if (pQueueComp->fIntrPending)
+            ASMAtomicIncU32(&pThis->aIntrVecs[pQueueComp->u32IntrVec]);
+    }
+
+    rc = SSMR3GetU32(pSSM, &pThis->cAsyncEvtReqsCur);
+    AssertRCReturn(rc, rc);
+    if (pThis->cAsyncEvtReqsCur > pThis->cAsyncEvtReqsMax)
+        return VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+    for (uint32_t i = 0; i < pThis->cAsyncEvtReqsCur; i++)
+        SSMR3GetU16(pSSM, &pThis->paAsyncEvtReqCids[i]);
+
+    /* Suspended commands of each namespace followed by the not yet resubmitted ones. */
+    for (uint32_t i = 0; i < pThis->cNamespaces + 1; i++)
+    {
+        rc = nvmeR3LoadRedoCmds(pThis, pSSM);
+        AssertRCReturn(rc, rc);
+    }
+
+    rc = SSMR3GetU32(pSSM, &u32);
+    AssertRCReturn(rc, rc);
+    AssertMsgReturn(u32 == UINT32_MAX, ("%#x\n", u32), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+
+    /* Hand the I/O submission queues to the worker threads again. */
+    for (uint32_t i = 1; i <= pThis->cQueuesSubmMax; i++)
+    {
+        PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[i];
+        if (pQueueSubm->Hdr.enmState == NVMEQUEUESTATE_ALLOCATED)
+        {
+            rc = nvmeR3WrkThrdAssign(pThis, pQueueSubm);
+            AssertRCReturn(rc, rc);
+        }
+    }
+
+    rc = PDMCritSectEnter(&pThis->CritSectIntr, VERR_IGNORED);
+    AssertRC(rc);
+    nvmeIntxUpdate(pThis);
+    PDMCritSectLeave(&pThis->CritSectIntr);
+
+    ASMAtomicWriteU32((volatile uint32_t *)&pThis->enmState, enmState);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Frees all commands on the redo list.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ */
+static void nvmeR3RedoListFree(PNVME pThis)
+{
+    PNVMEREDO pIt, pItNext;
+    RTListForEachSafe(&pThis->LstRedo, pIt, pItNext, NVMEREDO, NdLstRedo)
+    {
+        RTListNodeRemove(&pIt->NdLstRedo);
+        RTMemFree(pIt);
+    }
+}
+
+/**
+ * Checks if all asynchronous I/O is finished.
+ *
+ * Used by nvmeR3Reset, nvmeR3Suspend and nvmeR3PowerOff.
+ *
+ * @returns true if quiesced, false if busy.
+ * @param   pDevIns         The device instance.
+ */
+static bool nvmeR3AllAsyncIOIsFinished(PPDMDEVINS pDevIns)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    for (uint32_t i = 0; i < pThis->cNamespaces; i++)
+    {
+        PNVMENAMESPACE pNs = &pThis->paNamespaces[i];
+        if (   pNs->pDrvBase
+            && pNs->cOutstandingRequests != 0)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @callback_method_impl{FNPDMDEVASYNCNOTIFY,
+ * Callback employed by nvmeR3Suspend and nvmeR3PowerOff.}
+ */
+static DECLCALLBACK(bool) nvmeR3IsAsyncSuspendOrPowerOffDone(PPDMDEVINS pDevIns)
+{
+    if (!nvmeR3AllAsyncIOIsFinished(pDevIns))
+        return false;
+
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+    return true;
+}
+
+/**
+ * Common worker for nvmeR3Suspend and nvmeR3PowerOff.
+ */
+static void nvmeR3SuspendOrPowerOff(PPDMDEVINS pDevIns)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    ASMAtomicWriteBool(&pThis->fSignalIdle, true);
+    if (!nvmeR3AllAsyncIOIsFinished(pDevIns))
+        PDMDevHlpSetAsyncNotification(pDevIns, nvmeR3IsAsyncSuspendOrPowerOffDone);
+    else
+        ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnSuspend}
+ */
+static DECLCALLBACK(void) nvmeR3Suspend(PPDMDEVINS pDevIns)
+{
+    Log(("nvmeR3Suspend\n"));
+    nvmeR3SuspendOrPowerOff(pDevIns);
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnResume}
+ */
+static DECLCALLBACK(void) nvmeR3Resume(PPDMDEVINS pDevIns)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    Log(("nvmeR3Resume\n"));
+
+    /* Resubmit the commands which were suspended when the state was saved. */
+    PNVMEREDO pIt, pItNext;
+    RTListForEachSafe(&pThis->LstRedo, pIt, pItNext, NVMEREDO, NdLstRedo)
+    {
+        RTListNodeRemove(&pIt->NdLstRedo);
+        PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[pIt->u16SqId];
+        if (   pThis->enmState == NVMESTATE_READY
+            && pQueueSubm->Hdr.enmState == NVMEQUEUESTATE_ALLOCATED)
+            nvmeR3IoCmdProcess(pThis, pIt->u16SqId, ASMAtomicReadU32(&pQueueSubm->uGen), &pIt->Cmd);
+        RTMemFree(pIt);
+    }
+
+    /* Kick all workers in case doorbells were written while the state was loaded. */
+    int rc = PDMCritSectEnter(&pThis->CritSectWrkThrds, VERR_IGNORED);
+    AssertRC(rc);
+    PNVMEWRKTHRD pWrkThrd;
+    RTListForEach(&pThis->LstWrkThrds, pWrkThrd, NVMEWRKTHRD, NdLstWrkThrds)
+    {
+        rc = SUPSemEventSignal(pThis->pSupDrvSession, pWrkThrd->hEvtProcess);
+        AssertRC(rc);
+    }
+    PDMCritSectLeave(&pThis->CritSectWrkThrds);
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnPowerOff}
+ */
+static DECLCALLBACK(void) nvmeR3PowerOff(PPDMDEVINS pDevIns)
+{
+    Log(("nvmeR3PowerOff\n"));
+    nvmeR3SuspendOrPowerOff(pDevIns);
+}
+
+/**
+ * Common reset worker.
+ *
+ * @param   pDevIns     The device instance data.
+ */
+static void nvmeR3ResetCommon(PPDMDEVINS pDevIns)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    nvmeR3RedoListFree(pThis);
+    nvmeR3CtrlDisable(pThis, true /*fResetRegs*/);
+}
+
+/**
+ * @callback_method_impl{FNPDMDEVASYNCNOTIFY, Callback employed by nvmeR3Reset.}
+ */
+static DECLCALLBACK(bool) nvmeR3IsAsyncResetDone(PPDMDEVINS pDevIns)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    if (!nvmeR3AllAsyncIOIsFinished(pDevIns))
+        return false;
+    ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+
+    nvmeR3ResetCommon(pDevIns);
+    return true;
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnReset}
+ */
+static DECLCALLBACK(void) nvmeR3Reset(PPDMDEVINS pDevIns)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    /* Stop fetching new commands and cancel what is in flight before waiting for the I/O to drain. */
+    nvmeR3CtrlDisable(pThis, false /*fResetRegs*/);
+
+    ASMAtomicWriteBool(&pThis->fSignalIdle, true);
+    if (!nvmeR3AllAsyncIOIsFinished(pDevIns))
+        PDMDevHlpSetAsyncNotification(pDevIns, nvmeR3IsAsyncResetDone);
+    else
+    {
+        ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+        nvmeR3ResetCommon(pDevIns);
+    }
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnRelocate}
+ */
+static DECLCALLBACK(void) nvmeR3Relocate(PPDMDEVINS pDevIns, RTGCINTPTR offDelta)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    pThis->pDevInsRC    = PDMDEVINS_2_RCPTR(pDevIns);
+    pThis->pWakeQueueRC = PDMQueueRCPtr(pThis->pWakeQueueR3);
+
+    /* Relocate queues. */
+    pThis->paQueuesSubmRC += offDelta;
+    pThis->paQueuesCompRC += offDelta;
+}
+
+/**
+ * Attaches the driver of a namespace and queries the medium properties.
+ *
+ * @returns VBox status code.
+ * @param   pDevIns     The device instance.
+ * @param   pThis       The NVMe controller instance.
+ * @param   pNs         The namespace to attach.
+ */
+static int nvmeR3NsAttach(PPDMDEVINS pDevIns, PNVME pThis, PNVMENAMESPACE pNs)
+{
+    RT_NOREF(pThis);
+    char *pszDesc = NULL;
+    if (RTStrAPrintf(&pszDesc, "NVMe namespace %u", pNs->u32Id) < 0)
+        return VERR_NO_MEMORY;
+
+    int rc = PDMDevHlpDriverAttach(pDevIns, pNs->u32Id - 1, &pNs->IBase, &pNs->pDrvBase, pszDesc);
+    if (RT_SUCCESS(rc))
+    {
+        /* Query the media interface. */
+        pNs->pDrvMedia = PDMIBASE_QUERY_INTERFACE(pNs->pDrvBase, PDMIMEDIA);
+        AssertMsgReturn(VALID_PTR(pNs->pDrvMedia),
+                        ("NVMe configuration error: LUN#%u misses the basic media interface!\n", pNs->u32Id - 1),
+                        VERR_PDM_MISSING_INTERFACE);
+
+        /* Get the extended media interface. */
+        pNs->pDrvMediaEx = PDMIBASE_QUERY_INTERFACE(pNs->pDrvBase, PDMIMEDIAEX);
+        AssertMsgReturn(VALID_PTR(pNs->pDrvMediaEx),
+                        ("NVMe configuration error: LUN#%u misses the extended media interface!\n", pNs->u32Id - 1),
+                        VERR_PDM_MISSING_INTERFACE);
+
+        rc = pNs->pDrvMediaEx->pfnIoReqAllocSizeSet(pNs->pDrvMediaEx, sizeof(NVMEREQ));
+        AssertMsgRCReturn(rc, ("NVMe configuration error: LUN#%u: Failed to set I/O request size!\n", pNs->u32Id - 1),
+                          rc);
+
+        uint32_t fFeatures = 0;
+        rc = pNs->pDrvMediaEx->pfnQueryFeatures(pNs->pDrvMediaEx, &fFeatures);
+        AssertRCReturn(rc, rc);
+
+        pNs->cbBlock   = pNs->pDrvMedia->pfnGetSectorSize(pNs->pDrvMedia);
+        AssertReturn(pNs->cbBlock >= 512 && RT_IS_POWER_OF_TWO(pNs->cbBlock), VERR_INVALID_PARAMETER);
+        pNs->cBlocks   = pNs->pDrvMedia->pfnGetSize(pNs->pDrvMedia) / pNs->cbBlock;
+        pNs->fReadOnly = pNs->pDrvMedia->pfnIsReadOnly(pNs->pDrvMedia);
+        pNs->fDiscard  = RT_BOOL(fFeatures & PDMIMEDIAEX_FEATURE_F_DISCARD);
+
+        LogRel(("NVMe#%d: Namespace %u: %llu blocks of %u bytes%s%s\n", pDevIns->iInstance, pNs->u32Id,
+                pNs->cBlocks, pNs->cbBlock, pNs->fReadOnly ? ", read-only" : "", pNs->fDiscard ? ", discard" : ""));
+    }
+    else if (rc == VERR_PDM_NO_ATTACHED_DRIVER)
+    {
+        pNs->pDrvBase    = NULL;
+        pNs->pDrvMedia   = NULL;
+        pNs->pDrvMediaEx = NULL;
+        pNs->cBlocks     = 0;
+        pNs->cbBlock     = 0;
+        RTStrFree(pszDesc);
+        rc = VINF_SUCCESS;
+        LogRel(("NVMe#%d: No driver attached to namespace %u\n", pDevIns->iInstance, pNs->u32Id));
+    }
+    else
+    {
+        RTStrFree(pszDesc);
+        AssertLogRelMsgFailed(("NVMe#%d: Failed to attach namespace %u: %Rrc\n", pDevIns->iInstance, pNs->u32Id, rc));
+    }
+
+    return rc;
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnDetach}
+ *
+ * One harddisk at one port has been unplugged.
+ * The VM is suspended at this point.
+ */
+static DECLCALLBACK(void) nvmeR3Detach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t fFlags)
+{
+    RT_NOREF(fFlags);
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    if (iLUN >= pThis->cNamespaces)
+        return;
+
+    AssertMsg(fFlags & PDM_TACH_FLAGS_NOT_HOT_PLUG,
+              ("NVMe: Device does not support hotplugging\n"));
+
+    Log(("%s:\n", __FUNCTION__));
+
+    /*
+     * Zero some important members.
+     */
+    PNVMENAMESPACE pNs = &pThis->paNamespaces[iLUN];
+    pNs->pDrvBase    = NULL;
+    pNs->pDrvMedia   = NULL;
+    pNs->pDrvMediaEx = NULL;
+    pNs->cBlocks     = 0;
+    pNs->cbBlock     = 0;
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnAttach}
+ */
+static DECLCALLBACK(int) nvmeR3Attach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t fFlags)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+
+    if (iLUN >= pThis->cNamespaces)
+        return VERR_PDM_LUN_NOT_FOUND;
+
+    AssertMsgReturn(fFlags & PDM_TACH_FLAGS_NOT_HOT_PLUG,
+                    ("NVMe: Device does not support hotplugging\n"),
+                    VERR_INVALID_PARAMETER);
+
+    /* the usual paranoia */
+    PNVMENAMESPACE pNs = &pThis->paNamespaces[iLUN];
+    AssertRelease(!pNs->pDrvBase);
+    AssertRelease(!pNs->pDrvMedia);
+    AssertRelease(!pNs->pDrvMediaEx);
+
+    int rc = nvmeR3NsAttach(pDevIns, pThis, pNs);
+    if (RT_SUCCESS(rc) && !pNs->pDrvBase)
+        rc = VERR_PDM_NO_ATTACHED_DRIVER;
+    if (RT_FAILURE(rc))
+    {
+        pNs->pDrvBase    = NULL;
+        pNs->pDrvMedia   = NULL;
+        pNs->pDrvMediaEx = NULL;
+    }
+
+    return rc;
+}
+
+/**
+ * Destroys all worker threads.
+ *
+ * @returns nothing.
+ * @param   pThis       The NVMe controller instance.
+ */
+static void nvmeR3WrkThrdsDestroy(PNVME pThis)
+{
+    PNVMEWRKTHRD pIt, pItNext;
+    RTListForEachSafe(&pThis->LstWrkThrds, pIt, pItNext, NVMEWRKTHRD, NdLstWrkThrds)
+    {
+        /* PDM destroys device threads only after the destructor, so do it here before freeing the state. */
+        if (pIt->pThrd)
+        {
+            int rcThrd;
+            PDMR3ThreadDestroy(pIt->pThrd, &rcThrd);
+            pIt->pThrd = NULL;
+        }
+
+        SUPSemEventClose(pThis->pSupDrvSession, pIt->hEvtProcess);
+        RTSemFastMutexDestroy(pIt->hMtx);
+        RTListNodeRemove(&pIt->NdLstWrkThrds);
+        RTMemFree(pIt);
+    }
+
+    pThis->cWrkThrdsCur = 0;
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnDestruct}
+ */
+static DECLCALLBACK(int) nvmeR3Destruct(PPDMDEVINS pDevIns)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    PDMDEV_CHECK_VERSIONS_RETURN_QUIET(pDevIns);
+
+    if (pThis->LstWrkThrds.pNext)
+        nvmeR3WrkThrdsDestroy(pThis);
+
+    if (pThis->LstRedo.pNext)
+        nvmeR3RedoListFree(pThis);
+
+    if (pThis->paQueuesCompR3)
+    {
+        for (uint32_t i = 0; i <= pThis->cQueuesCompMax; i++)
+        {
+            PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[i];
+            if (pQueueComp->hMtx != NIL_RTSEMFASTMUTEX)
+            {
+                nvmeR3CompQueueWaitersFree(pQueueComp);
+                RTSemFastMutexDestroy(pQueueComp->hMtx);
+                pQueueComp->hMtx = NIL_RTSEMFASTMUTEX;
+            }
+        }
+    }
+
+    if (pThis->paQueuesSubmR3)
+    {
+        for (uint32_t i = 0; i <= pThis->cQueuesSubmMax; i++)
+        {
+            PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[i];
+            if (pQueueSubm->hMtxReqs != NIL_RTSEMFASTMUTEX)
+            {
+                RTSemFastMutexDestroy(pQueueSubm->hMtxReqs);
+                pQueueSubm->hMtxReqs = NIL_RTSEMFASTMUTEX;
+            }
+        }
+    }
+
+    if (PDMCritSectIsInitialized(&pThis->CritSectIntr))
+        PDMR3CritSectDelete(&pThis->CritSectIntr);
+    if (PDMCritSectIsInitialized(&pThis->CritSectCtrl))
+        PDMR3CritSectDelete(&pThis->CritSectCtrl);
+    if (PDMCritSectIsInitialized(&pThis->CritSectAsyncEvtReqs))
+        PDMR3CritSectDelete(&pThis->CritSectAsyncEvtReqs);
+    if (PDMCritSectIsInitialized(&pThis->CritSectWrkThrds))
+        PDMR3CritSectDelete(&pThis->CritSectWrkThrds);
+
+    PVM pVM = PDMDevHlpGetVM(pDevIns);
+    if (pThis->paQueuesSubmR3)
+    {
+        MMHyperFree(pVM, (void *)pThis->paQueuesSubmR3);
+        pThis->paQueuesSubmR3 = NULL;
+    }
+    if (pThis->paQueuesCompR3)
+    {
+        MMHyperFree(pVM, (void *)pThis->paQueuesCompR3);
+        pThis->paQueuesCompR3 = NULL;
+    }
+
+    if (pThis->paAsyncEvtReqCids)
+    {
+        PDMDevHlpMMHeapFree(pDevIns, pThis->paAsyncEvtReqCids);
+        pThis->paAsyncEvtReqCids = NULL;
+    }
+    if (pThis->paNamespaces)
+    {
+        PDMDevHlpMMHeapFree(pDevIns, pThis->paNamespaces);
+        pThis->paNamespaces = NULL;
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnConstruct}
+ */
+static DECLCALLBACK(int) nvmeR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFGMNODE pCfg)
+{
+    PNVME pThis = PDMINS_2_DATA(pDevIns, PNVME);
+    int   rc    = VINF_SUCCESS;
+    PDMDEV_CHECK_VERSIONS_RETURN(pDevIns);
+
+    /*
+     * Initialize enough of the state to make the destructor not trip up.
+     */
+    RTListInit(&pThis->LstWrkThrds);
+    RTListInit(&pThis->LstRedo);
+
+    /*
+     * Validate and read configuration.
+     */
+    rc = CFGMR3AreValuesValid(pCfg, "RCEnabled\0"
+                                    "R0Enabled\0"
+                                    "NamespacesMax\0"
+                                    "QueuesSubmissionMax\0"
+                                    "QueuesCompletionMax\0"
+                                    "QueueEntriesMax\0"
+                                    "TimeoutMax\0"
+                                    "WorkerThreadsMax\0"
+                                    "CompletionQueuesWaitersMax\0"
+                                    "AsyncEvtReqsMax\0"
+                                    "SerialNumber\0"
+                                    "ModelNumber\0"
+                                    "FirmwareRevision\0");
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
+                                N_("NVMe configuration error: unknown option specified"));
+
+    rc = CFGMR3QueryBoolDef(pCfg, "RCEnabled", &pThis->fRCEnabled, true);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read RCEnabled as boolean"));
+
+    rc = CFGMR3QueryBoolDef(pCfg, "R0Enabled", &pThis->fR0Enabled, true);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read R0Enabled as boolean"));
+
+    rc = CFGMR3QueryU32Def(pCfg, "NamespacesMax", &pThis->cNamespaces, 1);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read NamespacesMax as integer"));
+    if (   !pThis->cNamespaces
+        || pThis->cNamespaces > NVME_NAMESPACES_MAX)
+        return PDMDevHlpVMSetError(pDevIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NVMe configuration error: NamespacesMax=%u is out of range (1..%u)"),
+                                   pThis->cNamespaces, NVME_NAMESPACES_MAX);
+
+    rc = CFGMR3QueryU32Def(pCfg, "QueuesSubmissionMax", &pThis->cQueuesSubmMax, 64);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read QueuesSubmissionMax as integer"));
+
+    rc = CFGMR3QueryU32Def(pCfg, "QueuesCompletionMax", &pThis->cQueuesCompMax, NVME_QUEUES_COMP_MAX);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read QueuesCompletionMax as integer"));
+    if (   !pThis->cQueuesSubmMax
+        || pThis->cQueuesSubmMax > NVME_QUEUES_MAX)
+        return PDMDevHlpVMSetError(pDevIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NVMe configuration error: QueuesSubmissionMax=%u is out of range (1..%u)"),
+                                   pThis->cQueuesSubmMax, NVME_QUEUES_MAX);
+    if (   !pThis->cQueuesCompMax
+        || pThis->cQueuesCompMax > NVME_QUEUES_COMP_MAX)
+        return PDMDevHlpVMSetError(pDevIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NVMe configuration error: QueuesCompletionMax=%u is out of range (1..%u)"),
+                                   pThis->cQueuesCompMax, NVME_QUEUES_COMP_MAX);
+
+    rc = CFGMR3QueryU32Def(pCfg, "QueueEntriesMax", &pThis->cQueueEntriesMax, 1024);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read QueueEntriesMax as integer"));
+    if (   pThis->cQueueEntriesMax < 2
+        || pThis->cQueueEntriesMax > NVME_QUEUE_ENTRIES_MAX)
+        return PDMDevHlpVMSetError(pDevIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NVMe configuration error: QueueEntriesMax=%u is out of range (2..%u)"),
+                                   pThis->cQueueEntriesMax, NVME_QUEUE_ENTRIES_MAX);
+
+    rc = CFGMR3QueryU32Def(pCfg, "TimeoutMax", &pThis->cTimeoutMax, 20);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read TimeoutMax as integer"));
+    pThis->cTimeoutMax = RT_MIN(RT_MAX(pThis->cTimeoutMax, 1), 255);
+
+    rc = CFGMR3QueryU32Def(pCfg, "WorkerThreadsMax", &pThis->cWrkThrdsMax,
+                           RT_MIN(RT_MAX(RTMpGetOnlineCount(), 1), 8));
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read WorkerThreadsMax as integer"));
+    pThis->cWrkThrdsMax = RT_MIN(RT_MAX(pThis->cWrkThrdsMax, 1), NVME_WRK_THRDS_MAX);
+
+    rc = CFGMR3QueryU32Def(pCfg, "CompletionQueuesWaitersMax", &pThis->cCompQueuesWaitersMax, 64);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read CompletionQueuesWaitersMax as integer"));
+
+    rc = CFGMR3QueryU32Def(pCfg, "AsyncEvtReqsMax", &pThis->cAsyncEvtReqsMax, 4);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read AsyncEvtReqsMax as integer"));
+    pThis->cAsyncEvtReqsMax = RT_MIN(RT_MAX(pThis->cAsyncEvtReqsMax, 1), NVME_ASYNC_EVT_REQS_MAX);
+
+    /* The serial number defaults to something unique derived from the instance and a UUID. */
+    char szSerialDef[NVME_SERIAL_NUMBER_LENGTH + 1];
+    RTUUID Uuid;
+    RTUuidCreate(&Uuid);
+    RTStrPrintf(szSerialDef, sizeof(szSerialDef), "VB%02x%08x-%04x%04x",
+                iInstance & 0xff, Uuid.au32[0], Uuid.au16[2], Uuid.au16[3]);
+    rc = CFGMR3QueryStringDef(pCfg, "SerialNumber", pThis->szSerialNumber, sizeof(pThis->szSerialNumber), szSerialDef);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read SerialNumber as string"));
+
+    rc = CFGMR3QueryStringDef(pCfg, "ModelNumber", pThis->szModelNumber, sizeof(pThis->szModelNumber), "VBOX NVME");
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read ModelNumber as string"));
+
+    rc = CFGMR3QueryStringDef(pCfg, "FirmwareRevision", pThis->szFirmwareRevision,
+                              sizeof(pThis->szFirmwareRevision), "1.0");
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("NVMe configuration error: failed to read FirmwareRevision as string"));
+
+    LogRel(("NVMe#%d: NS=%u SQ=%u CQ=%u entries=%u workers=%u RC=%RTbool R0=%RTbool\n", iInstance,
+            pThis->cNamespaces, pThis->cQueuesSubmMax, pThis->cQueuesCompMax, pThis->cQueueEntriesMax,
+            pThis->cWrkThrdsMax, pThis->fRCEnabled, pThis->fR0Enabled));
+
+    pThis->pDevInsR3      = pDevIns;
+    pThis->pDevInsR0      = PDMDEVINS_2_R0PTR(pDevIns);
+    pThis->pDevInsRC      = PDMDEVINS_2_RCPTR(pDevIns);
+    pThis->pSupDrvSession = PDMDevHlpGetSupDrvSession(pDevIns);
+    pThis->IBase.pfnQueryInterface    = nvmeR3StatusQueryInterface;
+    pThis->ILeds.pfnQueryStatusLed    = nvmeR3StatusQueryStatusLed;
+
+    /*
+     * We use our own critical sections, the device one is not needed.
+     */
+    rc = PDMDevHlpSetDeviceCritSect(pDevIns, PDMDevHlpCritSectGetNop(pDevIns));
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot set critical section"));
+
+    rc = PDMDevHlpCritSectInit(pDevIns, &pThis->CritSectIntr, RT_SRC_POS, "NVMe%uIntr", iInstance);
+    if (RT_SUCCESS(rc))
+        rc = PDMDevHlpCritSectInit(pDevIns, &pThis->CritSectCtrl, RT_SRC_POS, "NVMe%uCtrl", iInstance);
+    if (RT_SUCCESS(rc))
+        rc = PDMDevHlpCritSectInit(pDevIns, &pThis->CritSectAsyncEvtReqs, RT_SRC_POS, "NVMe%uAer", iInstance);
+    if (RT_SUCCESS(rc))
+        rc = PDMDevHlpCritSectInit(pDevIns, &pThis->CritSectWrkThrds, RT_SRC_POS, "NVMe%uWrk", iInstance);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot create critical sections"));
+
+    /*
+     * Allocate the queue state in the hyper heap so the doorbell handlers in R0 and RC can reach it,
+     * entry 0 is the admin queue pair.
+     */
+    PVM pVM = PDMDevHlpGetVM(pDevIns);
+    rc = MMHyperAlloc(pVM, (pThis->cQueuesSubmMax + 1) * sizeof(NVMEQUEUESUBM), 1, MM_TAG_PDM_DEVICE_USER,
+                      (void **)&pThis->paQueuesSubmR3);
+    if (RT_SUCCESS(rc))
+        rc = MMHyperAlloc(pVM, (pThis->cQueuesCompMax + 1) * sizeof(NVMEQUEUECOMP), 1, MM_TAG_PDM_DEVICE_USER,
+                          (void **)&pThis->paQueuesCompR3);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot allocate queue memory"));
+
+    pThis->paQueuesSubmR0 = MMHyperR3ToR0(pVM, (void *)pThis->paQueuesSubmR3);
+    pThis->paQueuesSubmRC = MMHyperR3ToRC(pVM, (void *)pThis->paQueuesSubmR3);
+    pThis->paQueuesCompR0 = MMHyperR3ToR0(pVM, (void *)pThis->paQueuesCompR3);
+    pThis->paQueuesCompRC = MMHyperR3ToRC(pVM, (void *)pThis->paQueuesCompR3);
+
+    for (uint32_t i = 0; i <= pThis->cQueuesCompMax; i++)
+    {
+        PNVMEQUEUECOMP pQueueComp = &pThis->paQueuesCompR3[i];
+        pQueueComp->Hdr.u16Id    = (uint16_t)i;
+        pQueueComp->Hdr.enmType  = NVMEQUEUETYPE_COMPLETION;
+        pQueueComp->Hdr.enmState = NVMEQUEUESTATE_DEALLOCATED;
+        pQueueComp->hMtx         = NIL_RTSEMFASTMUTEX;
+        RTListInit(&pQueueComp->LstCompletionsWaiting);
+        rc = RTSemFastMutexCreate(&pQueueComp->hMtx);
+        if (RT_FAILURE(rc))
+            return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot create completion queue mutex"));
+    }
+
+    for (uint32_t i = 0; i <= pThis->cQueuesSubmMax; i++)
+    {
+        PNVMEQUEUESUBM pQueueSubm = &pThis->paQueuesSubmR3[i];
+        pQueueSubm->Hdr.u16Id    = (uint16_t)i;
+        pQueueSubm->Hdr.enmType  = NVMEQUEUETYPE_SUBMISSION;
+        pQueueSubm->Hdr.enmState = NVMEQUEUESTATE_DEALLOCATED;
+        pQueueSubm->hEvtProcess  = NIL_SUPSEMEVENT;
+        pQueueSubm->hMtxReqs     = NIL_RTSEMFASTMUTEX;
+        RTListInit(&pQueueSubm->LstReqsActive);
+        rc = RTSemFastMutexCreate(&pQueueSubm->hMtxReqs);
+        if (RT_FAILURE(rc))
+            return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot create submission queue mutex"));
+    }
+
+    pThis->paAsyncEvtReqCids = (uint16_t *)PDMDevHlpMMHeapAllocZ(pDevIns, pThis->cAsyncEvtReqsMax * sizeof(uint16_t));
+    pThis->paNamespaces      = (PNVMENAMESPACE)PDMDevHlpMMHeapAllocZ(pDevIns, pThis->cNamespaces * sizeof(NVMENAMESPACE));
+    if (   !pThis->paAsyncEvtReqCids
+        || !pThis->paNamespaces)
+        return PDMDEV_SET_ERROR(pDevIns, VERR_NO_MEMORY, N_("NVMe cannot allocate memory"));
+
+    /*
+     * Set up the PCI device.
+     */
+    PCIDevSetVendorId         (&pThis->PciDev, NVME_PCI_VENDOR_ID);
+    PCIDevSetDeviceId         (&pThis->PciDev, NVME_PCI_DEVICE_ID);
+    PCIDevSetClassProg        (&pThis->PciDev, 0x02); /* NVM Express */
+    PCIDevSetClassSub         (&pThis->PciDev, 0x08); /* Non-Volatile memory controller */
+    PCIDevSetClassBase        (&pThis->PciDev, 0x01); /* Mass storage */
+    PCIDevSetSubSystemVendorId(&pThis->PciDev, NVME_PCI_VENDOR_ID);
+    PCIDevSetSubSystemId      (&pThis->PciDev, NVME_PCI_DEVICE_ID);
+    PCIDevSetInterruptPin     (&pThis->PciDev, 0x01);
+# ifdef VBOX_WITH_MSI_DEVICES
+    PCIDevSetStatus(&pThis->PciDev, VBOX_PCI_STATUS_CAP_LIST);
+    PCIDevSetCapabilityList(&pThis->PciDev, NVME_PCI_MSIX_CAP_OFFSET);
+# endif
+
+    rc = PDMDevHlpPCIRegister(pDevIns, &pThis->PciDev);
+    if (RT_FAILURE(rc))
+        return rc;
+
+# ifdef VBOX_WITH_MSI_DEVICES
+    /* One vector for the admin completion queue and one for each I/O completion queue. */
+    PDMMSIREG MsiReg;
+    RT_ZERO(MsiReg);
+    MsiReg.cMsixVectors    = (uint16_t)nvmeR3IntrVecCount(pThis);
+    MsiReg.iMsixCapOffset  = NVME_PCI_MSIX_CAP_OFFSET;
+    MsiReg.iMsixNextOffset = 0x00;
+    MsiReg.iMsixBar        = NVME_PCI_REGION_MSIX;
+    rc = PDMDevHlpPCIRegisterMsi(pDevIns, &MsiReg);
+    if (RT_FAILURE(rc))
+    {
+        PCIDevSetCapabilityList(&pThis->PciDev, 0x0);
+        /* That's OK, we can work without MSI-X. */
+        LogRel(("NVMe#%d: Failed to register MSI-X, using INTx only: %Rrc\n", iInstance, rc));
+    }
+# endif
+
+    /* The register file followed by a doorbell pair for each queue, rounded up to a power of two. */
+    uint32_t cbMmio = NVME_REG_DOORBELL_FIRST + 2 * sizeof(uint32_t) * (RT_MAX(pThis->cQueuesSubmMax, pThis->cQueuesCompMax) + 1);
+    cbMmio = RT_MAX(RT_BIT_32(ASMBitLastSetU32(cbMmio - 1)), _16K);
+    rc = PDMDevHlpPCIIORegionRegister(pDevIns, NVME_PCI_REGION_MMIO, cbMmio,
+                                      (PCIADDRESSSPACE)(PCI_ADDRESS_SPACE_MEM | PCI_ADDRESS_SPACE_BAR64), nvmeR3Map);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot register PCI memory region for registers"));
+
+    rc = PDMDevHlpPCIIORegionRegister(pDevIns, NVME_PCI_REGION_IO, 8, PCI_ADDRESS_SPACE_IO, nvmeR3Map);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot register PCI I/O region"));
+
+    /*
+     * Queue for waking up the workers of doorbells written in RC, R0 and R3 signal the event directly.
+     */
+    rc = PDMDevHlpQueueCreate(pDevIns, sizeof(NVMEWAKEITEM), 64, 0,
+                              nvmeR3NotifyQueueConsumer, true, "NVMe-Wake", &pThis->pWakeQueueR3);
+    if (RT_FAILURE(rc))
+        return rc;
+    pThis->pWakeQueueR0 = PDMQueueR0Ptr(pThis->pWakeQueueR3);
+    pThis->pWakeQueueRC = PDMQueueRCPtr(pThis->pWakeQueueR3);
+
+    /*
+     * Attach the namespaces.
+     */
+    for (uint32_t i = 0; i < pThis->cNamespaces; i++)
+    {
+        PNVMENAMESPACE pNs = &pThis->paNamespaces[i];
+
+        pNs->pNvmeR3                            = pThis;
+        pNs->u32Id                              = i + 1;
+        pNs->IBase.pfnQueryInterface            = nvmeR3NsQueryInterface;
+        pNs->IMediaPort.pfnQueryDeviceLocation  = nvmeR3QueryDeviceLocation;
+        pNs->IMediaExPort.pfnIoReqCompleteNotify     = nvmeR3IoReqCompleteNotify;
+        pNs->IMediaExPort.pfnIoReqCopyFromBuf        = nvmeR3IoReqCopyFromBuf;
+        pNs->IMediaExPort.pfnIoReqCopyToBuf          = nvmeR3IoReqCopyToBuf;
+        pNs->IMediaExPort.pfnIoReqQueryDiscardRanges = nvmeR3IoReqQueryDiscardRanges;
+        pNs->IMediaExPort.pfnIoReqStateChanged       = nvmeR3IoReqStateChanged;
+        pNs->IMediaExPort.pfnMediumEjected           = nvmeR3MediumEjected;
+        pNs->ILed.pfnQueryStatusLed             = nvmeR3NsQueryStatusLed;
+        pNs->Led.u32Magic                       = PDMLED_MAGIC;
+
+        rc = nvmeR3NsAttach(pDevIns, pThis, pNs);
+        if (RT_FAILURE(rc))
+            return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
+                                       N_("NVMe: Failed to attach driver to namespace %u"), pNs->u32Id);
+    }
+
+    /*
+     * Attach status driver (optional).
+     */
+    PPDMIBASE pBase;
+    rc = PDMDevHlpDriverAttach(pDevIns, PDM_STATUS_LUN, &pThis->IBase, &pBase, "Status Port");
+    if (RT_SUCCESS(rc))
+    {
+        pThis->pLedsConnector = PDMIBASE_QUERY_INTERFACE(pBase, PDMILEDCONNECTORS);
+        pThis->pMediaNotify   = PDMIBASE_QUERY_INTERFACE(pBase, PDMIMEDIANOTIFY);
+    }
+    else if (rc != VERR_PDM_NO_ATTACHED_DRIVER)
+    {
+        AssertMsgFailed(("Failed to attach to status driver. rc=%Rrc\n", rc));
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot attach to status driver"));
+    }
+
+    /* Register save state handlers. */
+    rc = PDMDevHlpSSMRegisterEx(pDevIns, NVME_SAVED_STATE_VERSION, sizeof(*pThis), NULL,
+                                NULL, nvmeR3LiveExec, NULL,
+                                NULL, nvmeR3SaveExec, NULL,
+                                NULL, nvmeR3LoadExec, NULL);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("NVMe cannot register save state handlers"));
+
+    /*
+     * Register the info item.
+     */
+    char szTmp[128];
+    RTStrPrintf(szTmp, sizeof(szTmp), "%s%u", pDevIns->pReg->szName, pDevIns->iInstance);
+    PDMDevHlpDBGFInfoRegister(pDevIns, szTmp, "NVMe controller info.", nvmeR3Info);
+
+# ifdef VBOX_WITH_STATISTICS
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatSqDoorbellRZ, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Submission queue doorbell writes in RZ", "/Devices/NVMe%u/SqDoorbellRZ", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatSqDoorbellR3, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Submission queue doorbell writes in R3", "/Devices/NVMe%u/SqDoorbellR3", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatCqDoorbellRZ, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Completion queue doorbell writes in RZ", "/Devices/NVMe%u/CqDoorbellRZ", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatCqDoorbellR3, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Completion queue doorbell writes in R3", "/Devices/NVMe%u/CqDoorbellR3", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatCmdsFetched, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Commands fetched from the I/O submission queues", "/Devices/NVMe%u/CmdsFetched", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatCompWaiters, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Completions which had to wait for room in a full completion queue", "/Devices/NVMe%u/CompWaiters", iInstance);
+# endif
+
+    /* Perform hard reset. */
+    nvmeR3CtrlDisable(pThis, true /*fResetRegs*/);
+    return rc;
+}
+
+/**
+ * The device registration structure.
+ */
+const PDMDEVREG g_DeviceNVMe =
+{
+    /* u32Version */
+    PDM_DEVREG_VERSION,
+    /* szName */
+    "nvme",
+    /* szRCMod */
+# ifdef VBOX_IN_EXTPACK
+    "VBoxNvmeRC.rc",
+# else
+    "VBoxDDRC.rc",
+# endif
+    /* szR0Mod */
+# ifdef VBOX_IN_EXTPACK
+    "VBoxNvmeR0.r0",
+# else
+    "VBoxDDR0.r0",
+# endif
+    /* pszDescription */
+    "Non-Volatile Memory Host Controller Interface (NVMe) controller.\n",
+    /* fFlags */
+      PDM_DEVREG_FLAGS_DEFAULT_BITS | PDM_DEVREG_FLAGS_RC | PDM_DEVREG_FLAGS_R0
+    | PDM_DEVREG_FLAGS_FIRST_SUSPEND_NOTIFICATION | PDM_DEVREG_FLAGS_FIRST_POWEROFF_NOTIFICATION,
+    /* fClass */
+    PDM_DEVREG_CLASS_STORAGE,
+    /* cMaxInstances */
+    ~0U,
+    /* cbInstance */
+    sizeof(NVME),
+    /* pfnConstruct */
+    nvmeR3Construct,
+    /* pfnDestruct */
+    nvmeR3Destruct,
+    /* pfnRelocate */
+    nvmeR3Relocate,
+    /* pfnMemSetup */
+    NULL,
+    /* pfnPowerOn */
+    NULL,
+    /* pfnReset */
+    nvmeR3Reset,
+    /* pfnSuspend */
+    nvmeR3Suspend,
+    /* pfnResume */
+    nvmeR3Resume,
+    /* pfnAttach */
+    nvmeR3Attach,
+    /* pfnDetach */
+    nvmeR3Detach,
+    /* pfnQueryInterface. */
+    NULL,
+    /* pfnInitComplete */
+    NULL,
+    /* pfnPowerOff */
+    nvmeR3PowerOff,
+    /* pfnSoftReset */
+    NULL,
+    /* u32VersionEnd */
+    PDM_DEVREG_VERSION
+};
+
+# ifdef VBOX_IN_EXTPACK_R3
+/**
+ * @callback_method_impl{FNPDMVBOXDEVICESREGISTER}
+ */
+extern "C" DECLEXPORT(int) VBoxDevicesRegister(PPDMDEVREGCB pCallbacks, uint32_t u32Version)
+{
+    AssertLogRelMsgReturn(u32Version >= VBOX_VERSION,
+                          ("VirtualBox version %#x, expected %#x or higher\n", u32Version, VBOX_VERSION),
+                          VERR_VERSION_MISMATCH);
+    AssertLogRelMsgReturn(pCallbacks->u32Version == PDM_DEVREG_CB_VERSION,
+                          ("callback version %#x, expected %#x\n", pCallbacks->u32Version, PDM_DEVREG_CB_VERSION),
+                          VERR_VERSION_MISMATCH);
+
+    return pCallbacks->pfnRegister(pCallbacks, &g_DeviceNVMe);
+}
+# endif /* VBOX_IN_EXTPACK_R3 */
+
+#endif /* IN_RING3 */
+#endif /* !VBOX_DEVICE_STRUCT_TESTCASE */
@@ -0,0 +1,2181 @@
+/* $Id$ */
+/** @file
+ * DevVirtioSCSI - Virtio SCSI host device.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_dev_virtio_scsi   Virtio SCSI Host Device
+ *
+ * The device implements the legacy virtio SCSI host interface on top of the
+ * common virtio PCI code (see Virtio.cpp).  Every target is a LUN of the device
+ * instance with the generic SCSI driver (DrvSCSI and VSCSI below it) attached,
+ * so the command semantics are not duplicated here and the device only moves
+ * CDBs, sense data and payload between the virtqueues and PDMIMEDIAEX.
+ *
+ * There is one control queue, one event queue and a configurable number of
+ * request queues.  Each request queue is serviced by its own worker thread.  A
+ * queue kick only signals the worker from the context it happens in (R0 or R3,
+ * RC goes through a PDM queue) and is ignored entirely while the worker is busy
+ * draining the queue, in which case notifications are disabled on the ring as
+ * well.  The descriptors are handed to the driver as they are, the payload is
+ * copied straight between guest memory and the driver buffers in the
+ * PDMIMEDIAEXPORT copy callbacks without any intermediate bounce buffer.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_DEV_VIRTIO_SCSI
+#include <VBox/vmm/pdmdev.h>
+#include <VBox/vmm/pdmstorageifs.h>
+#include <VBox/scsi.h>
+#include <VBox/sup.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/list.h>
+#include <iprt/string.h>
+#ifdef IN_RING3
+# include <iprt/mem.h>
+# include <iprt/sg.h>
+# include <iprt/uuid.h>
+#endif
+#include "VBoxDD.h"
+#include "../VirtIO/Virtio.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The current saved state version. */
+#define VIRTIOSCSI_SAVED_STATE_VERSION          1
+
+/** PCI class of the device (mass storage, SCSI). */
+#define VIRTIOSCSI_PCI_CLASS                    0x0100
+/** Instance name format. */
+#define VIRTIOSCSI_NAME_FMT                     "VScsi%d"
+
+/** Index of the control queue. */
+#define VIRTIOSCSI_QUEUE_CTRL                   0
+/** Index of the event queue. */
+#define VIRTIOSCSI_QUEUE_EVENT                  1
+/** Index of the first request queue. */
+#define VIRTIOSCSI_QUEUE_REQ_FIRST              2
+/** Maximum number of request queues. */
+#define VIRTIOSCSI_REQ_QUEUES_MAX               (VIRTIO_MAX_NQUEUES - VIRTIOSCSI_QUEUE_REQ_FIRST)
+/** Default number of request queues. */
+#define VIRTIOSCSI_REQ_QUEUES_DEFAULT           4
+/** Number of descriptors in the control and event queue. */
+#define VIRTIOSCSI_CTRL_QUEUE_SIZE              64
+/** Number of descriptors in a request queue. */
+#define VIRTIOSCSI_REQ_QUEUE_SIZE               128
+
+/** Maximum number of data segments of a request reported to the guest. */
+#define VIRTIOSCSI_SEG_MAX                      126
+/** Maximum number of segments of a request including the request and response header. */
+#define VIRTIOSCSI_SEGS_TOTAL_MAX               (VIRTIOSCSI_SEG_MAX + 2)
+/** Maximum transfer size of a single request in 512 byte sectors. */
+#define VIRTIOSCSI_MAX_SECTORS                  0xffff
+/** Maximum number of targets, the target is a single byte of the LUN field. */
+#define VIRTIOSCSI_TARGETS_MAX                  256
+/** Default number of targets. */
+#define VIRTIOSCSI_TARGETS_DEFAULT              16
+/** The maximum (and default) CDB size. */
+#define VIRTIOSCSI_CDB_SIZE_MAX                 32
+/** The maximum (and default) sense buffer size. */
+#define VIRTIOSCSI_SENSE_SIZE_MAX               96
+/** Size of an event queue element. */
+#define VIRTIOSCSI_EVENT_INFO_SIZE              16
+/** Command timeout handed to the SCSI driver. */
+#define VIRTIOSCSI_CMD_TIMEOUT_MS               (30 * RT_MS_1SEC)
+
+/** @name Control queue request types.
+ * @{ */
+#define VIRTIOSCSI_T_TMF                        UINT32_C(0)
+#define VIRTIOSCSI_T_AN_QUERY                   UINT32_C(1)
+#define VIRTIOSCSI_T_AN_SUBSCRIBE               UINT32_C(2)
+/** @} */
+
+/** @name Task management function subtypes.
+ * @{ */
+#define VIRTIOSCSI_T_TMF_ABORT_TASK             UINT32_C(0)
+#define VIRTIOSCSI_T_TMF_ABORT_TASK_SET         UINT32_C(1)
+#define VIRTIOSCSI_T_TMF_CLEAR_ACA              UINT32_C(2)
+#define VIRTIOSCSI_T_TMF_CLEAR_TASK_SET         UINT32_C(3)
+#define VIRTIOSCSI_T_TMF_I_T_NEXUS_RESET        UINT32_C(4)
+#define VIRTIOSCSI_T_TMF_LOGICAL_UNIT_RESET     UINT32_C(5)
+#define VIRTIOSCSI_T_TMF_QUERY_TASK             UINT32_C(6)
+#define VIRTIOSCSI_T_TMF_QUERY_TASK_SET         UINT32_C(7)
+/** @} */
+
+/** @name Response codes.
+ * @{ */
+#define VIRTIOSCSI_S_OK                         0
+#define VIRTIOSCSI_S_FUNCTION_COMPLETE          0
+#define VIRTIOSCSI_S_OVERRUN                    1
+#define VIRTIOSCSI_S_ABORTED                    2
+#define VIRTIOSCSI_S_BAD_TARGET                 3
+#define VIRTIOSCSI_S_RESET                      4
+#define VIRTIOSCSI_S_BUSY                       5
+#define VIRTIOSCSI_S_TRANSPORT_FAILURE          6
+#define VIRTIOSCSI_S_TARGET_FAILURE             7
+#define VIRTIOSCSI_S_NEXUS_FAILURE              8
+#define VIRTIOSCSI_S_FAILURE                    9
+#define VIRTIOSCSI_S_FUNCTION_SUCCEEDED         10
+#define VIRTIOSCSI_S_FUNCTION_REJECTED          11
+#define VIRTIOSCSI_S_INCORRECT_LUN              12
+/** @} */
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+
+/**
+ * The device specific part of the PCI configuration space.
+ */
+typedef struct VIRTIOSCSICONFIG
+{
+    /** Number of request queues. */
+    uint32_t                        uNumQueues;
+    /** Maximum number of data segments in a request. */
+    uint32_t                        uSegMax;
+    /** Maximum transfer size in sectors. */
+    uint32_t                        uMaxSectors;
+    /** Maximum number of linked commands per LUN. */
+    uint32_t                        uCmdPerLun;
+    /** Size of an event queue buffer. */
+    uint32_t                        uEventInfoSize;
+    /** Size of the sense buffer in the response, writable by the guest. */
+    uint32_t                        uSenseSize;
+    /** Size of the CDB in the request, writable by the guest. */
+    uint32_t                        uCdbSize;
+    /** Highest channel number. */
+    uint16_t                        uMaxChannel;
+    /** Highest target number. */
+    uint16_t                        uMaxTarget;
+    /** Highest LUN number. */
+    uint32_t                        uMaxLun;
+} VIRTIOSCSICONFIG;
+AssertCompileSize(VIRTIOSCSICONFIG, 36);
+
+#pragma pack(1)
+/**
+ * Request header at the start of the device readable part of a request,
+ * the CDB has the size the guest configured in VIRTIOSCSICONFIG::uCdbSize.
+ */
+typedef struct VIRTIOSCSIREQHDR
+{
+    /** The LUN: 1, target, LUN in the flat addressing format, zero. */
+    uint8_t                         abLun[8];
+    /** Command identifier. */
+    uint64_t                        u64Tag;
+    /** The task attribute. */
+    uint8_t                         u8TaskAttr;
+    /** SAM command priority. */
+    uint8_t                         u8Prio;
+    /** Command reference number. */
+    uint8_t                         u8Crn;
+    /** The CDB. */
+    uint8_t                         abCdb[VIRTIOSCSI_CDB_SIZE_MAX];
+} VIRTIOSCSIREQHDR;
+AssertCompileSize(VIRTIOSCSIREQHDR, 51);
+typedef const VIRTIOSCSIREQHDR *PCVIRTIOSCSIREQHDR;
+
+/**
+ * Response header at the start of the device writable part of a request, the
+ * sense buffer has the size the guest configured in VIRTIOSCSICONFIG::uSenseSize.
+ */
+typedef struct VIRTIOSCSIRESPHDR
+{
+    /** Number of valid sense bytes. */
+    uint32_t                        cbSense;
+    /** Residual byte count. */
+    uint32_t                        cbResidual;
+    /** Status qualifier. */
+    uint16_t                        u16StatusQualifier;
+    /** The SCSI status. */
+    uint8_t                         u8Status;
+    /** The response code (VIRTIOSCSI_S_XXX). */
+    uint8_t                         u8Response;
+    /** The sense data. */
+    uint8_t                         abSense[VIRTIOSCSI_SENSE_SIZE_MAX];
+} VIRTIOSCSIRESPHDR;
+AssertCompileSize(VIRTIOSCSIRESPHDR, 108);
+
+/**
+ * Task management function request on the control queue.
+ */
+typedef struct VIRTIOSCSICTRLTMF
+{
+    /** The request type, VIRTIOSCSI_T_TMF. */
+    uint32_t                        u32Type;
+    /** The function (VIRTIOSCSI_T_TMF_XXX). */
+    uint32_t                        u32Subtype;
+    /** The LUN addressed. */
+    uint8_t                         abLun[8];
+    /** Tag of the command to abort for VIRTIOSCSI_T_TMF_ABORT_TASK. */
+    uint64_t                        u64Id;
+} VIRTIOSCSICTRLTMF;
+AssertCompileSize(VIRTIOSCSICTRLTMF, 24);
+
+/**
+ * Asynchronous notification query/subscribe request on the control queue.
+ */
+typedef struct VIRTIOSCSICTRLAN
+{
+    /** The request type, VIRTIOSCSI_T_AN_QUERY or VIRTIOSCSI_T_AN_SUBSCRIBE. */
+    uint32_t                        u32Type;
+    /** The LUN addressed. */
+    uint8_t                         abLun[8];
+    /** The events requested. */
+    uint32_t                        fEventsRequested;
+} VIRTIOSCSICTRLAN;
+AssertCompileSize(VIRTIOSCSICTRLAN, 16);
+
+/**
+ * Response to an asynchronous notification request.
+ */
+typedef struct VIRTIOSCSICTRLANRESP
+{
+    /** The events supported. */
+    uint32_t                        fEventsActual;
+    /** The response code. */
+    uint8_t                         u8Response;
+} VIRTIOSCSICTRLANRESP;
+AssertCompileSize(VIRTIOSCSICTRLANRESP, 5);
+#pragma pack()
+
+/**
+ * Guest memory segment of a descriptor chain.
+ */
+typedef struct VIRTIOSCSISEG
+{
+    /** Guest physical address. */
+    RTGCPHYS                        GCPhys;
+    /** Size of the segment. */
+    uint32_t                        cb;
+} VIRTIOSCSISEG;
+/** Pointer to a segment. */
+typedef VIRTIOSCSISEG *PVIRTIOSCSISEG;
+/** Pointer to a const segment. */
+typedef const VIRTIOSCSISEG *PCVIRTIOSCSISEG;
+
+/** Pointer to the device instance data. */
+typedef struct VIRTIOSCSI *PVIRTIOSCSI;
+
+/**
+ * A target, i.e. a LUN of the device instance.
+ */
+typedef struct VIRTIOSCSITARGET
+{
+    /** Pointer to the owning device instance - R3. */
+    R3PTRTYPE(PVIRTIOSCSI)          pVirtioScsiR3;
+    /** The target number. */
+    uint32_t                        iTarget;
+    /** Number of requests active in the driver. */
+    volatile uint32_t               cReqsActive;
+
+    /** Our base interface. */
+    PDMIBASE                        IBase;
+    /** Media port interface. */
+    PDMIMEDIAPORT                   IMediaPort;
+    /** Extended media port interface. */
+    PDMIMEDIAEXPORT                 IMediaExPort;
+    /** The LED port interface. */
+    PDMILEDPORTS                    ILed;
+    /** The status LED of the target. */
+    PDMLED                          Led;
+
+    /** The base interface of the attached driver, NULL if the target is empty. */
+    R3PTRTYPE(PPDMIBASE)            pDrvBase;
+    /** The media interface of the attached driver. */
+    R3PTRTYPE(PPDMIMEDIA)           pDrvMedia;
+    /** The extended media interface of the attached driver. */
+    R3PTRTYPE(PPDMIMEDIAEX)         pDrvMediaEx;
+} VIRTIOSCSITARGET;
+/** Pointer to a target. */
+typedef VIRTIOSCSITARGET *PVIRTIOSCSITARGET;
+
+/**
+ * Request queue state.
+ */
+typedef struct VIRTIOSCSIREQQUEUE
+{
+    /** The event semaphore the worker waits on, signalled by the kicks. */
+    SUPSEMEVENT                     hEvtProcess;
+    /** Flag whether the worker is about to sleep and needs a wakeup on a kick. */
+    volatile bool                   fSleeping;
+    /** Explicit padding. */
+    bool                            afPadding[7];
+    /** The worker thread servicing the queue - R3. */
+    R3PTRTYPE(PPDMTHREAD)           pThrd;
+    /** Element the worker fetches descriptor chains into - R3. */
+    R3PTRTYPE(PVQUEUEELEM)          pElem;
+    /** Number of kicks for the queue. */
+    STAMCOUNTER                     StatKicks;
+    /** Number of kicks which had to wake up the worker. */
+    STAMCOUNTER                     StatKicksWakeup;
+    /** Number of requests processed. */
+    STAMCOUNTER                     StatReqs;
+} VIRTIOSCSIREQQUEUE;
+/** Pointer to the state of a request queue. */
+typedef VIRTIOSCSIREQQUEUE *PVIRTIOSCSIREQQUEUE;
+
+/**
+ * Virtio SCSI device instance data.
+ *
+ * @extends     VPCISTATE
+ */
+typedef struct VIRTIOSCSI
+{
+    /* VPCISTATE must be the first member! */
+    VPCISTATE                       VPCI;
+
+    /** Array of targets - R3. */
+    R3PTRTYPE(PVIRTIOSCSITARGET)    paTargetsR3;
+    /** Element for the control queue, only used on EMT with the critical section held - R3. */
+    R3PTRTYPE(PVQUEUEELEM)          pElemCtrlR3;
+    /** Worker wakeup queue for kicks in RC - R3. */
+    R3PTRTYPE(PPDMQUEUE)            pWakeQueueR3;
+    /** Worker wakeup queue for kicks in RC - R0. */
+    R0PTRTYPE(PPDMQUEUE)            pWakeQueueR0;
+    /** Worker wakeup queue for kicks in RC - RC. */
+    RCPTRTYPE(PPDMQUEUE)            pWakeQueueRC;
+    /** Number of targets. */
+    uint32_t                        cTargets;
+    /** The support driver session handle. */
+    R3R0PTRTYPE(PSUPDRVSESSION)     pSupDrvSession;
+    /** Number of request queues. */
+    uint32_t                        cReqQueues;
+    /** Device generation, incremented on every device reset so requests taken
+     * from the rings before the reset don't complete into the new ones. */
+    volatile uint32_t               uGeneration;
+    /** Flag whether we need to notify PDM once all requests completed. */
+    volatile bool                   fSignalIdle;
+    /** Explicit padding. */
+    bool                            afPadding[3];
+    /** The device specific configuration space. */
+    VIRTIOSCSICONFIG                Config;
+    /** List of requests to resubmit on resume after the state was loaded - R3. */
+    RTLISTANCHORR3                  LstRedo;
+    /** The request queues. */
+    VIRTIOSCSIREQQUEUE              aReqQueues[VIRTIOSCSI_REQ_QUEUES_MAX];
+} VIRTIOSCSI;
+
+/**
+ * Request data, allocated by the driver along with the I/O request.
+ */
+typedef struct VIRTIOSCSIREQ
+{
+    /** The I/O request handle. */
+    PDMMEDIAEXIOREQ                 hIoReq;
+    /** The target the request is for. */
+    PVIRTIOSCSITARGET               pTarget;
+    /** Device generation the request was taken from the ring in. */
+    uint32_t                        uGeneration;
+    /** Index of the queue the request came from. */
+    uint16_t                        idxQueue;
+    /** Index of the head descriptor of the chain. */
+    uint16_t                        uHeadIdx;
+    /** Size of the request header (including the CDB). */
+    uint32_t                        cbReqHdr;
+    /** Size of the response header (including the sense buffer). */
+    uint32_t                        cbRespHdr;
+    /** Number of bytes to transfer to the device. */
+    uint32_t                        cbDataOut;
+    /** Number of bytes to transfer from the device. */
+    uint32_t                        cbDataIn;
+    /** The transfer direction. */
+    PDMMEDIAEXIOREQSCSITXDIR        enmTxDir;
+    /** The SCSI status. */
+    uint8_t                         u8ScsiSts;
+    /** Size of the CDB. */
+    uint8_t                         cbCdb;
+    /** The CDB. */
+    uint8_t                         abCdb[VIRTIOSCSI_CDB_SIZE_MAX];
+    /** The sense buffer. */
+    uint8_t                         abSense[VIRTIOSCSI_SENSE_SIZE_MAX];
+    /** Number of device readable segments. */
+    uint32_t                        cSegsOut;
+    /** Number of device writable segments following the readable ones. */
+    uint32_t                        cSegsIn;
+    /** The segments of the descriptor chain, readable ones first. */
+    VIRTIOSCSISEG                   aSegs[VIRTIOSCSI_SEGS_TOTAL_MAX];
+} VIRTIOSCSIREQ;
+/** Pointer to a request. */
+typedef VIRTIOSCSIREQ *PVIRTIOSCSIREQ;
+
+/**
+ * Request to resubmit on resume after the state was loaded.
+ */
+typedef struct VIRTIOSCSIREDO
+{
+    /** Node for the redo list. */
+    RTLISTNODE                      NdLstRedo;
+    /** Index of the queue the request came from. */
+    uint16_t                        idxQueue;
+    /** Index of the head descriptor of the chain. */
+    uint16_t                        uHeadIdx;
+    /** Number of device readable segments. */
+    uint32_t                        cSegsOut;
+    /** Number of device writable segments. */
+    uint32_t                        cSegsIn;
+    /** The segments, variable in size. */
+    VIRTIOSCSISEG                   aSegs[1];
+} VIRTIOSCSIREDO;
+/** Pointer to a request to resubmit. */
+typedef VIRTIOSCSIREDO *PVIRTIOSCSIREDO;
+
+/**
+ * Item for the wakeup queue.
+ */
+typedef struct VIRTIOSCSIWAKEITEM
+{
+    /** The core part owned by the queue manager. */
+    PDMQUEUEITEMCORE                Core;
+    /** Index of the request queue to wake the worker for. */
+    uint32_t                        iReqQueue;
+} VIRTIOSCSIWAKEITEM;
+/** Pointer to a wakeup queue item. */
+typedef VIRTIOSCSIWAKEITEM *PVIRTIOSCSIWAKEITEM;
+
+#ifndef VBOX_DEVICE_STRUCT_TESTCASE
+
+#define INSTANCE(pThis) (pThis)->VPCI.szInstance
+
+AssertCompileMemberOffset(VIRTIOSCSI, VPCI, 0);
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+#ifdef IN_RING3
+/** Names of the request queues for logging. */
+static const char * const g_apszReqQueueNames[VIRTIOSCSI_REQ_QUEUES_MAX] =
+{
+    "REQ0",  "REQ1",  "REQ2",  "REQ3",  "REQ4",  "REQ5",  "REQ6",  "REQ7",
+    "REQ8",  "REQ9",  "REQ10", "REQ11", "REQ12", "REQ13", "REQ14", "REQ15"
+};
+#endif
+
+
+/*********************************************************************************************************************************
+*   I/O callbacks of the common virtio code                                                                                      *
+*********************************************************************************************************************************/
+
+static DECLCALLBACK(uint32_t) virtioScsiIoCb_GetHostFeatures(void *pvState)
+{
+    RT_NOREF_PV(pvState);
+
+    /* Neither bidirectional transfers nor hotplug or parameter change events. */
+    return 0;
+}
+
+static DECLCALLBACK(uint32_t) virtioScsiIoCb_GetHostMinimalFeatures(void *pvState)
+{
+    RT_NOREF_PV(pvState);
+    return 0;
+}
+
+static DECLCALLBACK(void) virtioScsiIoCb_SetHostFeatures(void *pvState, uint32_t fFeatures)
+{
+    PVIRTIOSCSI pThis = (PVIRTIOSCSI)pvState;
+    LogFlow(("%s virtioScsiIoCb_SetHostFeatures: fFeatures=%x\n", INSTANCE(pThis), fFeatures));
+    RT_NOREF2(pThis, fFeatures);
+}
+
+static DECLCALLBACK(int) virtioScsiIoCb_GetConfig(void *pvState, uint32_t offCfg, uint32_t cb, void *pvData)
+{
+    PVIRTIOSCSI pThis = (PVIRTIOSCSI)pvState;
+    if (offCfg + cb > sizeof(VIRTIOSCSICONFIG))
+    {
+        Log(("%s virtioScsiIoCb_GetConfig: Read beyond the config structure is attempted (offCfg=%#x cb=%x).\n",
+             INSTANCE(pThis), offCfg, cb));
+        return VERR_IOM_IOPORT_UNUSED;
+    }
+    memcpy(pvData, (uint8_t *)&pThis->Config + offCfg, cb);
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) virtioScsiIoCb_SetConfig(void *pvState, uint32_t offCfg, uint32_t cb, void *pvData)
+{
+    PVIRTIOSCSI pThis = (PVIRTIOSCSI)pvState;
+
+    /* Only the sense and CDB size are writable, we can't deal with anything larger than the defaults. */
+    if (   offCfg == RT_OFFSETOF(VIRTIOSCSICONFIG, uSenseSize)
+        && cb == sizeof(uint32_t))
+        pThis->Config.uSenseSize = RT_MIN(*(uint32_t *)pvData, VIRTIOSCSI_SENSE_SIZE_MAX);
+    else if (   offCfg == RT_OFFSETOF(VIRTIOSCSICONFIG, uCdbSize)
+             && cb == sizeof(uint32_t))
+        pThis->Config.uCdbSize = RT_MIN(*(uint32_t *)pvData, VIRTIOSCSI_CDB_SIZE_MAX);
+    else
+        Log(("%s virtioScsiIoCb_SetConfig: Write to read-only config field (offCfg=%#x cb=%x).\n",
+             INSTANCE(pThis), offCfg, cb));
+    return VINF_SUCCESS;
+}
+
+#ifdef IN_RING3
+static void virtioScsiR3HwReset(PVIRTIOSCSI pThis);
+#endif
+
+/**
+ * Device reset triggered by the guest.
+ */
+static DECLCALLBACK(int) virtioScsiIoCb_Reset(void *pvState)
+{
+#ifdef IN_RING3
+    PVIRTIOSCSI pThis = (PVIRTIOSCSI)pvState;
+    Log(("%s Reset triggered\n", INSTANCE(pThis)));
+    virtioScsiR3HwReset(pThis);
+    return VINF_SUCCESS;
+#else
+    RT_NOREF_PV(pvState);
+    return VINF_IOM_R3_IOPORT_WRITE;
+#endif
+}
+
+static DECLCALLBACK(void) virtioScsiIoCb_Ready(void *pvState)
+{
+    PVIRTIOSCSI pThis = (PVIRTIOSCSI)pvState;
+    Log(("%s Driver became ready\n", INSTANCE(pThis)));
+    RT_NOREF_PV(pThis);
+}
+
+/**
+ * I/O port callbacks.
+ */
+static const VPCIIOCALLBACKS g_IOCallbacks =
+{
+     virtioScsiIoCb_GetHostFeatures,
+     virtioScsiIoCb_GetHostMinimalFeatures,
+     virtioScsiIoCb_SetHostFeatures,
+     virtioScsiIoCb_GetConfig,
+     virtioScsiIoCb_SetConfig,
+     virtioScsiIoCb_Reset,
+     virtioScsiIoCb_Ready,
+};
+
+
+/**
+ * Wakes up the worker of the given request queue if it is sleeping.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The device instance data.
+ * @param   iReqQueue   The request queue index (not the virtqueue index).
+ */
+static int virtioScsiReqQueueKick(PVIRTIOSCSI pThis, uint32_t iReqQueue)
+{
+    PVIRTIOSCSIREQQUEUE pReqQueue = &pThis->aReqQueues[iReqQueue];
+
+    STAM_COUNTER_INC(&pReqQueue->StatKicks);
+
+    /* A busy worker picks up the new requests when it checks the ring again. */
+    if (!ASMAtomicReadBool(&pReqQueue->fSleeping))
+        return VINF_SUCCESS;
+
+    STAM_COUNTER_INC(&pReqQueue->StatKicksWakeup);
+#ifdef IN_RC
+    /* Can't signal a support driver event from RC, let ring-3 do it through the queue. */
+    PVIRTIOSCSIWAKEITEM pItem = (PVIRTIOSCSIWAKEITEM)PDMQueueAlloc(pThis->CTX_SUFF(pWakeQueue));
+    if (RT_UNLIKELY(!pItem))
+        return VINF_IOM_R3_IOPORT_WRITE;
+    pItem->iReqQueue = iReqQueue;
+    PDMQueueInsert(pThis->CTX_SUFF(pWakeQueue), &pItem->Core);
+#else
+    int rc = SUPSemEventSignal(pThis->pSupDrvSession, pReqQueue->hEvtProcess);
+    AssertRC(rc);
+#endif
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNIOMIOPORTIN}
+ */
+PDMBOTHCBDECL(int) virtioScsiIOPortIn(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT uPort, uint32_t *pu32, unsigned cb)
+{
+    return vpciIOPortIn(pDevIns, pvUser, uPort, pu32, cb, &g_IOCallbacks);
+}
+
+
+/**
+ * @callback_method_impl{FNIOMIOPORTOUT}
+ */
+PDMBOTHCBDECL(int) virtioScsiIOPortOut(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT uPort, uint32_t u32, unsigned cb)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+
+    /*
+     * Kicks of the request queues are handled here in any context, the common
+     * code would go to ring-3 and call the queue callback on the EMT.
+     */
+    if (   uPort - pThis->VPCI.IOPortBase == VPCI_QUEUE_NOTIFY
+        && cb == sizeof(uint16_t))
+    {
+        uint16_t idxQueue = (uint16_t)u32;
+        if (   idxQueue >= VIRTIOSCSI_QUEUE_REQ_FIRST
+            && idxQueue < VIRTIOSCSI_QUEUE_REQ_FIRST + pThis->cReqQueues)
+            return virtioScsiReqQueueKick(pThis, idxQueue - VIRTIOSCSI_QUEUE_REQ_FIRST);
+    }
+
+    return vpciIOPortOut(pDevIns, pvUser, uPort, u32, cb, &g_IOCallbacks);
+}
+
+
+#ifdef IN_RING3
+
+/**
+ * Returns the total size of the given segments.
+ */
+static uint32_t virtioScsiR3SegsSize(PCVIRTIOSCSISEG paSegs, uint32_t cSegs)
+{
+    uint64_t cbTotal = 0;
+    for (uint32_t i = 0; i < cSegs; i++)
+        cbTotal += paSegs[i].cb;
+    return (uint32_t)RT_MIN(cbTotal, UINT32_MAX);
+}
+
+/**
+ * Copies data between the given guest segments and a S/G buffer.
+ *
+ * @returns Number of bytes copied.
+ * @param   pThis       The device instance data.
+ * @param   paSegs      The guest segments.
+ * @param   cSegs       Number of segments.
+ * @param   offSegs     Where to start in the guest segments.
+ * @param   pSgBuf      The S/G buffer to copy from or to.
+ * @param   cbCopy      Number of bytes to copy.
+ * @param   fToGuest    Flag whether to copy from the S/G buffer to the guest.
+ */
+static size_t virtioScsiR3SegsCopy(PVIRTIOSCSI pThis, PCVIRTIOSCSISEG paSegs, uint32_t cSegs, size_t offSegs,
+                                   PRTSGBUF pSgBuf, size_t cbCopy, bool fToGuest)
+{
+    PPDMDEVINS pDevIns = pThis->VPCI.CTX_SUFF(pDevIns);
+    size_t     cbCopied = 0;
+    uint32_t   iSeg = 0;
+
+    /* Skip to the segment containing the start offset. */
+    while (   iSeg < cSegs
+           && offSegs >= paSegs[iSeg].cb)
+        offSegs -= paSegs[iSeg++].cb;
+
+    while (   iSeg < cSegs
+           && cbCopy)
+    {
+        RTGCPHYS GCPhys = paSegs[iSeg].GCPhys + offSegs;
+        size_t   cbSeg  = RT_MIN(cbCopy, paSegs[iSeg].cb - offSegs);
+
+        while (cbSeg)
+        {
+            size_t cbThis = cbSeg;
+            void *pvBuf = RTSgBufGetNextSegment(pSgBuf, &cbThis);
+            if (!pvBuf)
+                return cbCopied;
+
+            if (fToGuest)
+                PDMDevHlpPCIPhysWrite(pDevIns, GCPhys, pvBuf, cbThis);
+            else
+                PDMDevHlpPCIPhysRead(pDevIns, GCPhys, pvBuf, cbThis);
+
+            GCPhys   += cbThis;
+            cbSeg    -= cbThis;
+            cbCopy   -= cbThis;
+            cbCopied += cbThis;
+        }
+
+        offSegs = 0;
+        iSeg++;
+    }
+
+    return cbCopied;
+}
+
+/**
+ * Reads from the given guest segments into a flat buffer.
+ */
+static size_t virtioScsiR3SegsRead(PVIRTIOSCSI pThis, PCVIRTIOSCSISEG paSegs, uint32_t cSegs, size_t offSegs,
+                                   void *pvBuf, size_t cbRead)
+{
+    RTSGSEG Seg;
+    RTSGBUF SgBuf;
+
+    Seg.pvSeg = pvBuf;
+    Seg.cbSeg = cbRead;
+    RTSgBufInit(&SgBuf, &Seg, 1);
+    return virtioScsiR3SegsCopy(pThis, paSegs, cSegs, offSegs, &SgBuf, cbRead, false /*fToGuest*/);
+}
+
+/**
+ * Writes a flat buffer to the given guest segments.
+ */
+static size_t virtioScsiR3SegsWrite(PVIRTIOSCSI pThis, PCVIRTIOSCSISEG paSegs, uint32_t cSegs, size_t offSegs,
+                                    const void *pvBuf, size_t cbWrite)
+{
+    RTSGSEG Seg;
+    RTSGBUF SgBuf;
+
+    Seg.pvSeg = (void *)pvBuf;
+    Seg.cbSeg = cbWrite;
+    RTSgBufInit(&SgBuf, &Seg, 1);
+    return virtioScsiR3SegsCopy(pThis, paSegs, cSegs, offSegs, &SgBuf, cbWrite, true /*fToGuest*/);
+}
+
+/**
+ * Converts the segments of a virtqueue element.
+ */
+static void virtioScsiR3SegsFromElem(PVIRTIOSCSISEG paSegs, const VQUEUESEG *paElemSegs, uint32_t cSegs)
+{
+    for (uint32_t i = 0; i < cSegs; i++)
+    {
+        paSegs[i].GCPhys = paElemSegs[i].addr;
+        paSegs[i].cb     = paElemSegs[i].cb;
+    }
+}
+
+/**
+ * Returns the target addressed by the given LUN field.
+ *
+ * @returns Pointer to the target or NULL if it doesn't exist or is empty.
+ * @param   pThis       The device instance data.
+ * @param   pabLun      The LUN field of the request.
+ */
+static PVIRTIOSCSITARGET virtioScsiR3TargetFromLun(PVIRTIOSCSI pThis, const uint8_t *pabLun)
+{
+    if (   pabLun[0] != 1
+        || pabLun[1] >= pThis->cTargets)
+        return NULL;
+
+    PVIRTIOSCSITARGET pTarget = &pThis->paTargetsR3[pabLun[1]];
+    return pTarget->pDrvMediaEx ? pTarget : NULL;
+}
+
+/**
+ * Puts a descriptor chain on the used ring of the given queue and notifies the guest.
+ *
+ * @param   pThis       The device instance data.
+ * @param   idxQueue    The queue index.
+ * @param   uHeadIdx    Index of the head descriptor.
+ * @param   cbWritten   Number of bytes written to the device writable segments.
+ * @param   uGeneration Device generation the chain was taken from the ring in.
+ */
+static void virtioScsiR3ReqPut(PVIRTIOSCSI pThis, uint16_t idxQueue, uint16_t uHeadIdx, uint32_t cbWritten,
+                               uint32_t uGeneration)
+{
+    int rc = vpciCsEnter(&pThis->VPCI, VERR_IGNORED);
+    AssertRC(rc);
+
+    /* The rings are gone if the guest reset the device in the meantime. */
+    if (uGeneration == pThis->uGeneration)
+    {
+        PVQUEUE pQueue = &pThis->VPCI.Queues[idxQueue];
+        vqueuePutIndex(&pThis->VPCI, pQueue, uHeadIdx, cbWritten);
+        vqueueSync(&pThis->VPCI, pQueue);
+    }
+    else
+        Log(("%s Dropping completion of request %u on queue %u from before the reset\n",
+             INSTANCE(pThis), uHeadIdx, idxQueue));
+
+    vpciCsLeave(&pThis->VPCI);
+}
+
+/**
+ * Completes a request which didn't make it to the driver.
+ *
+ * @param   pThis       The device instance data.
+ * @param   idxQueue    The queue index.
+ * @param   uHeadIdx    Index of the head descriptor.
+ * @param   paSegsIn    The device writable segments.
+ * @param   cSegsIn     Number of device writable segments.
+ * @param   u8Response  The response code (VIRTIOSCSI_S_XXX).
+ * @param   uGeneration Device generation the chain was taken from the ring in.
+ */
+static void virtioScsiR3ReqCompleteEarly(PVIRTIOSCSI pThis, uint16_t idxQueue, uint16_t uHeadIdx,
+                                         PCVIRTIOSCSISEG paSegsIn, uint32_t cSegsIn, uint8_t u8Response,
+                                         uint32_t uGeneration)
+{
+    VIRTIOSCSIRESPHDR RespHdr;
+    RT_ZERO(RespHdr);
+    RespHdr.u8Response = u8Response;
+
+    size_t cbWritten = virtioScsiR3SegsWrite(pThis, paSegsIn, cSegsIn, 0, &RespHdr,
+                                             RT_OFFSETOF(VIRTIOSCSIRESPHDR, abSense) + pThis->Config.uSenseSize);
+    virtioScsiR3ReqPut(pThis, idxQueue, uHeadIdx, (uint32_t)cbWritten, uGeneration);
+}
+
+/**
+ * Completes a request and frees it.
+ *
+ * @param   pThis       The device instance data.
+ * @param   pReq        The request to complete.
+ * @param   rcReq       Status code of the request.
+ */
+static void virtioScsiR3ReqComplete(PVIRTIOSCSI pThis, PVIRTIOSCSIREQ pReq, int rcReq)
+{
+    PVIRTIOSCSITARGET pTarget    = pReq->pTarget;
+    PPDMIMEDIAEX      pIfMediaEx = pTarget->pDrvMediaEx;
+    uint32_t          cbXfer     = pReq->cbDataOut ? pReq->cbDataOut : pReq->cbDataIn;
+    uint32_t          cbWritten  = pReq->cbRespHdr;
+
+    VIRTIOSCSIRESPHDR RespHdr;
+    RT_ZERO(RespHdr);
+    if (rcReq == VERR_PDM_MEDIAEX_IOREQ_CANCELED)
+        RespHdr.u8Response = VIRTIOSCSI_S_ABORTED;
+    else if (RT_FAILURE(rcReq))
+        RespHdr.u8Response = VIRTIOSCSI_S_FAILURE;
+    else
+    {
+        size_t cbResidual = 0;
+        int rc = pIfMediaEx->pfnIoReqQueryResidual(pIfMediaEx, pReq->hIoReq, &cbResidual);
+        AssertRC(rc);
+        cbResidual = RT_MIN(cbResidual, cbXfer);
+
+        RespHdr.u8Response = VIRTIOSCSI_S_OK;
+        RespHdr.u8Status   = pReq->u8ScsiSts;
+        RespHdr.cbResidual = (uint32_t)cbResidual;
+        if (pReq->u8ScsiSts == SCSI_STATUS_CHECK_CONDITION)
+        {
+            /* Fixed and descriptor format both have the additional length at byte 7. */
+            uint32_t cbSense = RT_MIN(8 + (uint32_t)pReq->abSense[7], sizeof(pReq->abSense));
+            RespHdr.cbSense = RT_MIN(cbSense, pReq->cbRespHdr - RT_OFFSETOF(VIRTIOSCSIRESPHDR, abSense));
+            memcpy(&RespHdr.abSense[0], &pReq->abSense[0], RespHdr.cbSense);
+        }
+
+        if (pReq->enmTxDir == PDMMEDIAEXIOREQSCSITXDIR_FROM_DEVICE)
+            cbWritten += pReq->cbDataIn - (uint32_t)cbResidual;
+    }
+
+    virtioScsiR3SegsWrite(pThis, &pReq->aSegs[pReq->cSegsOut], pReq->cSegsIn, 0, &RespHdr, pReq->cbRespHdr);
+
+    if (pReq->enmTxDir == PDMMEDIAEXIOREQSCSITXDIR_FROM_DEVICE)
+        pTarget->Led.Actual.s.fReading = 0;
+    else if (pReq->enmTxDir == PDMMEDIAEXIOREQSCSITXDIR_TO_DEVICE)
+        pTarget->Led.Actual.s.fWriting = 0;
+
+    /*
+     * Free the request before handing the chain back so the guest can reuse the
+     * tag right away without running into an ID conflict.
+     */
+    uint16_t idxQueue    = pReq->idxQueue;
+    uint16_t uHeadIdx    = pReq->uHeadIdx;
+    uint32_t uGeneration = pReq->uGeneration;
+    pIfMediaEx->pfnIoReqFree(pIfMediaEx, pReq->hIoReq);
+
+    virtioScsiR3ReqPut(pThis, idxQueue, uHeadIdx, cbWritten, uGeneration);
+
+    uint32_t cReqsActive = ASMAtomicDecU32(&pTarget->cReqsActive);
+    if (!cReqsActive && pThis->fSignalIdle)
+        PDMDevHlpAsyncNotificationCompleted(pThis->VPCI.pDevInsR3);
+}
+
+/**
+ * Submits a request queue descriptor chain to the driver.
+ *
+ * @param   pThis       The device instance data.
+ * @param   idxQueue    The queue index.
+ * @param   uHeadIdx    Index of the head descriptor.
+ * @param   paSegs      The segments of the chain, device readable ones first.
+ * @param   cSegsOut    Number of device readable segments.
+ * @param   cSegsIn     Number of device writable segments.
+ * @param   uGeneration Device generation the chain was taken from the ring in.
+ */
+static void virtioScsiR3ReqSubmit(PVIRTIOSCSI pThis, uint16_t idxQueue, uint16_t uHeadIdx,
+                                  PCVIRTIOSCSISEG paSegs, uint32_t cSegsOut, uint32_t cSegsIn,
+                                  uint32_t uGeneration)
+{
+    PCVIRTIOSCSISEG paSegsIn  = &paSegs[cSegsOut];
+    uint32_t        cbOut     = virtioScsiR3SegsSize(paSegs, cSegsOut);
+    uint32_t        cbIn      = virtioScsiR3SegsSize(paSegsIn, cSegsIn);
+    uint32_t        cbCdb     = pThis->Config.uCdbSize;
+    uint32_t        cbReqHdr  = RT_OFFSETOF(VIRTIOSCSIREQHDR, abCdb) + cbCdb;
+    uint32_t        cbRespHdr = RT_OFFSETOF(VIRTIOSCSIRESPHDR, abSense) + pThis->Config.uSenseSize;
+
+    Assert(cSegsOut + cSegsIn <= VIRTIOSCSI_SEGS_TOTAL_MAX);
+
+    if (RT_UNLIKELY(cbIn < cbRespHdr))
+    {
+        /* No room to say anything, just hand the chain back. */
+        Log(("%s Request %u on queue %u has no room for the response (cbIn=%u)\n", INSTANCE(pThis), uHeadIdx, idxQueue, cbIn));
+        virtioScsiR3ReqPut(pThis, idxQueue, uHeadIdx, 0, uGeneration);
+        return;
+    }
+
+    if (RT_UNLIKELY(cbOut < cbReqHdr))
+    {
+        Log(("%s Request %u on queue %u is too short (cbOut=%u)\n", INSTANCE(pThis), uHeadIdx, idxQueue, cbOut));
+        virtioScsiR3ReqCompleteEarly(pThis, idxQueue, uHeadIdx, paSegsIn, cSegsIn, VIRTIOSCSI_S_FAILURE, uGeneration);
+        return;
+    }
+
+    VIRTIOSCSIREQHDR ReqHdr;
+    virtioScsiR3SegsRead(pThis, paSegs, cSegsOut, 0, &ReqHdr, cbReqHdr);
+
+    PVIRTIOSCSITARGET pTarget = virtioScsiR3TargetFromLun(pThis, &ReqHdr.abLun[0]);
+    if (!pTarget)
+    {
+        virtioScsiR3ReqCompleteEarly(pThis, idxQueue, uHeadIdx, paSegsIn, cSegsIn, VIRTIOSCSI_S_BAD_TARGET, uGeneration);
+        return;
+    }
+
+    uint32_t cbDataOut = cbOut - cbReqHdr;
+    uint32_t cbDataIn  = cbIn - cbRespHdr;
+    if (RT_UNLIKELY(cbDataOut && cbDataIn))
+    {
+        /* Bidirectional commands require VIRTIO_SCSI_F_INOUT which we don't offer. */
+        virtioScsiR3ReqCompleteEarly(pThis, idxQueue, uHeadIdx, paSegsIn, cSegsIn, VIRTIOSCSI_S_FAILURE, uGeneration);
+        return;
+    }
+
+    PPDMIMEDIAEX    pIfMediaEx = pTarget->pDrvMediaEx;
+    PDMMEDIAEXIOREQ hIoReq;
+    PVIRTIOSCSIREQ  pReq;
+    int rc = pIfMediaEx->pfnIoReqAlloc(pIfMediaEx, &hIoReq, (void **)&pReq, ReqHdr.u64Tag,
+                                       PDMIMEDIAEX_F_SUSPEND_ON_RECOVERABLE_ERR);
+    if (RT_FAILURE(rc))
+    {
+        Log(("%s Failed to allocate request for tag %#RX64 (%Rrc)\n", INSTANCE(pThis), ReqHdr.u64Tag, rc));
+        virtioScsiR3ReqCompleteEarly(pThis, idxQueue, uHeadIdx, paSegsIn, cSegsIn,
+                                     rc == VERR_NO_MEMORY ? VIRTIOSCSI_S_BUSY : VIRTIOSCSI_S_FAILURE, uGeneration);
+        return;
+    }
+
+    pReq->hIoReq      = hIoReq;
+    pReq->pTarget     = pTarget;
+    pReq->uGeneration = uGeneration;
+    pReq->idxQueue    = idxQueue;
+    pReq->uHeadIdx    = uHeadIdx;
+    pReq->cbReqHdr    = cbReqHdr;
+    pReq->cbRespHdr   = cbRespHdr;
+    pReq->cbDataOut   = cbDataOut;
+    pReq->cbDataIn    = cbDataIn;
+    pReq->u8ScsiSts   = SCSI_STATUS_OK;
+    pReq->cbCdb       = (uint8_t)cbCdb;
+    pReq->cSegsOut    = cSegsOut;
+    pReq->cSegsIn     = cSegsIn;
+    memcpy(&pReq->abCdb[0], &ReqHdr.abCdb[0], cbCdb);
+    memcpy(&pReq->aSegs[0], paSegs, (cSegsOut + cSegsIn) * sizeof(VIRTIOSCSISEG));
+
+    if (cbDataOut)
+    {
+        pReq->enmTxDir = PDMMEDIAEXIOREQSCSITXDIR_TO_DEVICE;
+        pTarget->Led.Asserted.s.fWriting = pTarget->Led.Actual.s.fWriting = 1;
+    }
+    else if (cbDataIn)
+    {
+        pReq->enmTxDir = PDMMEDIAEXIOREQSCSITXDIR_FROM_DEVICE;
+        pTarget->Led.Asserted.s.fReading = pTarget->Led.Actual.s.fReading = 1;
+    }
+    else
+        pReq->enmTxDir = PDMMEDIAEXIOREQSCSITXDIR_NONE;
+
+    /* The LUN uses the flat space addressing method, only LUN 0 is reported to the guest. */
+    uint32_t uLun = ((ReqHdr.abLun[2] & 0x3f) << 8) | ReqHdr.abLun[3];
+
+    ASMAtomicIncU32(&pTarget->cReqsActive);
+    rc = pIfMediaEx->pfnIoReqSendScsiCmd(pIfMediaEx, hIoReq, uLun, &pReq->abCdb[0], cbCdb, pReq->enmTxDir,
+                                         cbDataOut + cbDataIn, &pReq->abSense[0], sizeof(pReq->abSense),
+                                         &pReq->u8ScsiSts, VIRTIOSCSI_CMD_TIMEOUT_MS);
+    if (rc != VINF_PDM_MEDIAEX_IOREQ_IN_PROGRESS)
+        virtioScsiR3ReqComplete(pThis, pReq, rc);
+}
+
+/**
+ * Submits a descriptor chain fetched from a request queue.
+ *
+ * @param   pThis       The device instance data.
+ * @param   idxQueue    The queue index.
+ * @param   pElem       The element holding the chain.
+ * @param   uGeneration Device generation the chain was taken from the ring in.
+ */
+static void virtioScsiR3ReqSubmitElem(PVIRTIOSCSI pThis, uint16_t idxQueue, PVQUEUEELEM pElem, uint32_t uGeneration)
+{
+    VIRTIOSCSISEG aSegs[VIRTIOSCSI_SEGS_TOTAL_MAX];
+
+    if (RT_UNLIKELY(pElem->nOut + pElem->nIn > RT_ELEMENTS(aSegs)))
+    {
+        /* The response header is at the start of the writable part, that's all we need. */
+        Log(("%s Request %u on queue %u has too many segments (%u)\n",
+             INSTANCE(pThis), pElem->uIndex, idxQueue, pElem->nOut + pElem->nIn));
+        uint32_t cSegsIn = RT_MIN(pElem->nIn, RT_ELEMENTS(aSegs));
+        virtioScsiR3SegsFromElem(&aSegs[0], &pElem->aSegsIn[0], cSegsIn);
+        virtioScsiR3ReqCompleteEarly(pThis, idxQueue, (uint16_t)pElem->uIndex, &aSegs[0], cSegsIn,
+                                     VIRTIOSCSI_S_FAILURE, uGeneration);
+        return;
+    }
+
+    virtioScsiR3SegsFromElem(&aSegs[0], &pElem->aSegsOut[0], pElem->nOut);
+    virtioScsiR3SegsFromElem(&aSegs[pElem->nOut], &pElem->aSegsIn[0], pElem->nIn);
+    virtioScsiR3ReqSubmit(pThis, idxQueue, (uint16_t)pElem->uIndex, &aSegs[0], pElem->nOut, pElem->nIn, uGeneration);
+}
+
+/**
+ * Drains the given request queue.
+ *
+ * Kicks are disabled on the ring while the worker is busy and enabled again
+ * once the queue is empty, the queue is checked once more afterwards to close
+ * the race with the guest adding a request in between.
+ *
+ * @param   pThis       The device instance data.
+ * @param   iReqQueue   The request queue index.
+ */
+static void virtioScsiR3ReqQueueProcess(PVIRTIOSCSI pThis, uint32_t iReqQueue)
+{
+    PVIRTIOSCSIREQQUEUE pReqQueue  = &pThis->aReqQueues[iReqQueue];
+    uint16_t            idxQueue   = VIRTIOSCSI_QUEUE_REQ_FIRST + iReqQueue;
+    PVQUEUE             pQueue     = &pThis->VPCI.Queues[idxQueue];
+    bool                fKicksOff  = false;
+
+    for (;;)
+    {
+        int rc = vpciCsEnter(&pThis->VPCI, VERR_IGNORED);
+        AssertRC(rc);
+
+        if (!vqueueIsReady(&pThis->VPCI, pQueue))
+        {
+            vpciCsLeave(&pThis->VPCI);
+            break;
+        }
+
+        bool fGot = vqueueGet(&pThis->VPCI, pQueue, pReqQueue->pElem);
+        if (!fGot && fKicksOff)
+        {
+            vringSetNotification(&pThis->VPCI, &pQueue->VRing, true);
+            fKicksOff = false;
+            fGot = vqueueGet(&pThis->VPCI, pQueue, pReqQueue->pElem);
+        }
+        if (fGot && !fKicksOff)
+        {
+            vringSetNotification(&pThis->VPCI, &pQueue->VRing, false);
+            fKicksOff = true;
+        }
+
+        uint32_t uGeneration = pThis->uGeneration;
+        vpciCsLeave(&pThis->VPCI);
+
+        if (!fGot)
+            break;
+
+        STAM_COUNTER_INC(&pReqQueue->StatReqs);
+        virtioScsiR3ReqSubmitElem(pThis, idxQueue, pReqQueue->pElem, uGeneration);
+    }
+}
+
+/**
+ * Checks whether the given request queue has anything to process.
+ */
+static bool virtioScsiR3ReqQueueHasWork(PVIRTIOSCSI pThis, uint32_t iReqQueue)
+{
+    PVQUEUE pQueue = &pThis->VPCI.Queues[VIRTIOSCSI_QUEUE_REQ_FIRST + iReqQueue];
+
+    int rc = vpciCsEnter(&pThis->VPCI, VERR_IGNORED);
+    AssertRC(rc);
+    bool fWork =    vqueueIsReady(&pThis->VPCI, pQueue)
+                 && !vqueueIsEmpty(&pThis->VPCI, pQueue);
+    vpciCsLeave(&pThis->VPCI);
+    return fWork;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADDEV, Request queue worker.}
+ */
+static DECLCALLBACK(int) virtioScsiR3WorkerLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PVIRTIOSCSI         pThis     = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    PVIRTIOSCSIREQQUEUE pReqQueue = (PVIRTIOSCSIREQQUEUE)pThread->pvUser;
+    uint32_t            iReqQueue = (uint32_t)(pReqQueue - &pThis->aReqQueues[0]);
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        /*
+         * Announce the sleep before checking the ring, a kick after the check
+         * then always finds the flag set and the event latches.
+         */
+        ASMAtomicWriteBool(&pReqQueue->fSleeping, true);
+        if (!virtioScsiR3ReqQueueHasWork(pThis, iReqQueue))
+        {
+            int rc = SUPSemEventWaitNoResume(pThis->pSupDrvSession, pReqQueue->hEvtProcess, RT_INDEFINITE_WAIT);
+            AssertLogRelMsgReturn(RT_SUCCESS(rc) || rc == VERR_INTERRUPTED, ("%Rrc\n", rc), rc);
+            if (RT_UNLIKELY(pThread->enmState != PDMTHREADSTATE_RUNNING))
+                break;
+        }
+        ASMAtomicWriteBool(&pReqQueue->fSleeping, false);
+
+        virtioScsiR3ReqQueueProcess(pThis, iReqQueue);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADWAKEUPDEV}
+ */
+static DECLCALLBACK(int) virtioScsiR3WorkerWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PVIRTIOSCSI         pThis     = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    PVIRTIOSCSIREQQUEUE pReqQueue = (PVIRTIOSCSIREQQUEUE)pThread->pvUser;
+
+    return SUPSemEventSignal(pThis->pSupDrvSession, pReqQueue->hEvtProcess);
+}
+
+/**
+ * @callback_method_impl{FNPDMQUEUEDEV, Wakes up the worker of a request queue
+ *                      kicked in RC.}
+ */
+static DECLCALLBACK(bool) virtioScsiR3NotifyQueueConsumer(PPDMDEVINS pDevIns, PPDMQUEUEITEMCORE pItem)
+{
+    PVIRTIOSCSI         pThis     = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    PVIRTIOSCSIWAKEITEM pWakeItem = (PVIRTIOSCSIWAKEITEM)pItem;
+
+    AssertReturn(pWakeItem->iReqQueue < pThis->cReqQueues, true);
+    int rc = SUPSemEventSignal(pThis->pSupDrvSession, pThis->aReqQueues[pWakeItem->iReqQueue].hEvtProcess);
+    AssertRC(rc);
+    return true;
+}
+
+/**
+ * Processes a single control queue request.
+ *
+ * @returns Number of bytes written to the device writable segments.
+ * @param   pThis       The device instance data.
+ * @param   paSegs      The segments of the chain, device readable ones first.
+ * @param   cSegsOut    Number of device readable segments.
+ * @param   cSegsIn     Number of device writable segments.
+ */
+static uint32_t virtioScsiR3CtrlProcess(PVIRTIOSCSI pThis, PCVIRTIOSCSISEG paSegs, uint32_t cSegsOut, uint32_t cSegsIn)
+{
+    PCVIRTIOSCSISEG paSegsIn = &paSegs[cSegsOut];
+    union
+    {
+        uint32_t            u32Type;
+        VIRTIOSCSICTRLTMF   Tmf;
+        VIRTIOSCSICTRLAN    An;
+    } uReq;
+    RT_ZERO(uReq);
+
+    size_t cbReq = virtioScsiR3SegsRead(pThis, paSegs, cSegsOut, 0, &uReq, sizeof(uReq));
+    if (cbReq < sizeof(uint32_t))
+        return 0;
+
+    switch (uReq.u32Type)
+    {
+        case VIRTIOSCSI_T_TMF:
+        {
+            if (cbReq < sizeof(uReq.Tmf))
+                return 0;
+
+            uint8_t u8Response = VIRTIOSCSI_S_FUNCTION_COMPLETE;
+            PVIRTIOSCSITARGET pTarget = virtioScsiR3TargetFromLun(pThis, &uReq.Tmf.abLun[0]);
+            if (!pTarget)
+                u8Response = VIRTIOSCSI_S_BAD_TARGET;
+            else
+            {
+                PPDMIMEDIAEX pIfMediaEx = pTarget->pDrvMediaEx;
+
+                Log(("%s TMF %u for target %u (id=%#RX64)\n", INSTANCE(pThis), uReq.Tmf.u32Subtype,
+                     pTarget->iTarget, uReq.Tmf.u64Id));
+                switch (uReq.Tmf.u32Subtype)
+                {
+                    case VIRTIOSCSI_T_TMF_ABORT_TASK:
+                        /* The command might have completed already, the guest gets its completion then. */
+                        pIfMediaEx->pfnIoReqCancel(pIfMediaEx, uReq.Tmf.u64Id);
+                        break;
+                    case VIRTIOSCSI_T_TMF_ABORT_TASK_SET:
+                    case VIRTIOSCSI_T_TMF_CLEAR_TASK_SET:
+                    case VIRTIOSCSI_T_TMF_LOGICAL_UNIT_RESET:
+                    case VIRTIOSCSI_T_TMF_I_T_NEXUS_RESET:
+                        pIfMediaEx->pfnIoReqCancelAll(pIfMediaEx);
+                        break;
+                    default:
+                        u8Response = VIRTIOSCSI_S_FUNCTION_REJECTED;
+                        break;
+                }
+            }
+
+            return (uint32_t)virtioScsiR3SegsWrite(pThis, paSegsIn, cSegsIn, 0, &u8Response, sizeof(u8Response));
+        }
+        case VIRTIOSCSI_T_AN_QUERY:
+        case VIRTIOSCSI_T_AN_SUBSCRIBE:
+        {
+            /* We don't report any asynchronous events. */
+            VIRTIOSCSICTRLANRESP Resp;
+            Resp.fEventsActual = 0;
+            Resp.u8Response    = VIRTIOSCSI_S_OK;
+            return (uint32_t)virtioScsiR3SegsWrite(pThis, paSegsIn, cSegsIn, 0, &Resp, sizeof(Resp));
+        }
+        default:
+            Log(("%s Unknown control queue request type %u\n", INSTANCE(pThis), uReq.u32Type));
+            return 0;
+    }
+}
+
+/**
+ * @callback_method_impl{FNVPCIQUEUECALLBACK, Control queue.}
+ */
+static DECLCALLBACK(void) virtioScsiR3QueueControl(void *pvState, PVQUEUE pQueue)
+{
+    PVIRTIOSCSI pThis = (PVIRTIOSCSI)pvState;
+    PVQUEUEELEM pElem = pThis->pElemCtrlR3;
+
+    for (;;)
+    {
+        int rc = vpciCsEnter(&pThis->VPCI, VERR_IGNORED);
+        AssertRC(rc);
+        if (!vqueueGet(&pThis->VPCI, pQueue, pElem))
+        {
+            vpciCsLeave(&pThis->VPCI);
+            break;
+        }
+        uint32_t uGeneration = pThis->uGeneration;
+        vpciCsLeave(&pThis->VPCI);
+
+        /* The requests are tiny, a few segments are plenty. */
+        VIRTIOSCSISEG aSegs[8];
+        uint32_t cSegsOut = RT_MIN(pElem->nOut, RT_ELEMENTS(aSegs) / 2);
+        uint32_t cSegsIn  = RT_MIN(pElem->nIn, RT_ELEMENTS(aSegs) / 2);
+        virtioScsiR3SegsFromElem(&aSegs[0], &pElem->aSegsOut[0], cSegsOut);
+        virtioScsiR3SegsFromElem(&aSegs[cSegsOut], &pElem->aSegsIn[0], cSegsIn);
+
+        /* Cancelling requests may complete them on this thread, so the lock must not be held here. */
+        uint32_t cbWritten = virtioScsiR3CtrlProcess(pThis, &aSegs[0], cSegsOut, cSegsIn);
+        virtioScsiR3ReqPut(pThis, VIRTIOSCSI_QUEUE_CTRL, (uint16_t)pElem->uIndex, cbWritten, uGeneration);
+    }
+}
+
+/**
+ * @callback_method_impl{FNVPCIQUEUECALLBACK, Event queue.}
+ */
+static DECLCALLBACK(void) virtioScsiR3QueueEvent(void *pvState, PVQUEUE pQueue)
+{
+    RT_NOREF(pQueue);
+    PVIRTIOSCSI pThis = (PVIRTIOSCSI)pvState;
+
+    /* We don't report any events, the buffers stay with us until the next reset. */
+    Log2(("%s Event queue kicked\n", INSTANCE(pThis)));
+    RT_NOREF_PV(pThis);
+}
+
+
+/*********************************************************************************************************************************
+*   Media and LED interfaces                                                                                                     *
+*********************************************************************************************************************************/
+
+/**
+ * @interface_method_impl{PDMIMEDIAPORT,pfnQueryDeviceLocation}
+ */
+static DECLCALLBACK(int) virtioScsiR3QueryDeviceLocation(PPDMIMEDIAPORT pInterface, const char **ppcszController,
+                                                         uint32_t *piInstance, uint32_t *piLUN)
+{
+    PVIRTIOSCSITARGET pTarget = RT_FROM_MEMBER(pInterface, VIRTIOSCSITARGET, IMediaPort);
+    PPDMDEVINS pDevIns = pTarget->pVirtioScsiR3->VPCI.pDevInsR3;
+
+    AssertPtrReturn(ppcszController, VERR_INVALID_POINTER);
+    AssertPtrReturn(piInstance, VERR_INVALID_POINTER);
+    AssertPtrReturn(piLUN, VERR_INVALID_POINTER);
+
+    *ppcszController = pDevIns->pReg->szName;
+    *piInstance = pDevIns->iInstance;
+    *piLUN = pTarget->iTarget;
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqCopyFromBuf}
+ */
+static DECLCALLBACK(int) virtioScsiR3IoReqCopyFromBuf(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                      void *pvIoReqAlloc, uint32_t offDst, PRTSGBUF pSgBuf,
+                                                      size_t cbCopy)
+{
+    RT_NOREF1(hIoReq);
+    PVIRTIOSCSITARGET pTarget = RT_FROM_MEMBER(pInterface, VIRTIOSCSITARGET, IMediaExPort);
+    PVIRTIOSCSIREQ pReq = (PVIRTIOSCSIREQ)pvIoReqAlloc;
+
+    if (RT_UNLIKELY((uint64_t)offDst + cbCopy > pReq->cbDataIn))
+        return VERR_PDM_MEDIAEX_IOBUF_OVERFLOW;
+
+    /* The data follows the response header in the device writable part. */
+    size_t cbCopied = virtioScsiR3SegsCopy(pTarget->pVirtioScsiR3, &pReq->aSegs[pReq->cSegsOut], pReq->cSegsIn,
+                                           pReq->cbRespHdr + offDst, pSgBuf, cbCopy, true /*fToGuest*/);
+    return cbCopied == cbCopy ? VINF_SUCCESS : VERR_PDM_MEDIAEX_IOBUF_OVERFLOW;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqCopyToBuf}
+ */
+static DECLCALLBACK(int) virtioScsiR3IoReqCopyToBuf(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                    void *pvIoReqAlloc, uint32_t offSrc, PRTSGBUF pSgBuf,
+                                                    size_t cbCopy)
+{
+    RT_NOREF1(hIoReq);
+    PVIRTIOSCSITARGET pTarget = RT_FROM_MEMBER(pInterface, VIRTIOSCSITARGET, IMediaExPort);
+    PVIRTIOSCSIREQ pReq = (PVIRTIOSCSIREQ)pvIoReqAlloc;
+
+    if (RT_UNLIKELY((uint64_t)offSrc + cbCopy > pReq->cbDataOut))
+        return VERR_PDM_MEDIAEX_IOBUF_UNDERRUN;
+
+    /* The data follows the request header in the device readable part. */
+    size_t cbCopied = virtioScsiR3SegsCopy(pTarget->pVirtioScsiR3, &pReq->aSegs[0], pReq->cSegsOut,
+                                           pReq->cbReqHdr + offSrc, pSgBuf, cbCopy, false /*fToGuest*/);
+    return cbCopied == cbCopy ? VINF_SUCCESS : VERR_PDM_MEDIAEX_IOBUF_UNDERRUN;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqCompleteNotify}
+ */
+static DECLCALLBACK(int) virtioScsiR3IoReqCompleteNotify(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                         void *pvIoReqAlloc, int rcReq)
+{
+    RT_NOREF(hIoReq);
+    PVIRTIOSCSITARGET pTarget = RT_FROM_MEMBER(pInterface, VIRTIOSCSITARGET, IMediaExPort);
+    virtioScsiR3ReqComplete(pTarget->pVirtioScsiR3, (PVIRTIOSCSIREQ)pvIoReqAlloc, rcReq);
+    return VINF_SUCCESS;
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqStateChanged}
+ */
+static DECLCALLBACK(void) virtioScsiR3IoReqStateChanged(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
+                                                        void *pvIoReqAlloc, PDMMEDIAEXIOREQSTATE enmState)
+{
+    RT_NOREF2(hIoReq, pvIoReqAlloc);
+    PVIRTIOSCSITARGET pTarget = RT_FROM_MEMBER(pInterface, VIRTIOSCSITARGET, IMediaExPort);
+    PVIRTIOSCSI pThis = pTarget->pVirtioScsiR3;
+
+    switch (enmState)
+    {
+        case PDMMEDIAEXIOREQSTATE_SUSPENDED:
+        {
+            /* Make sure the request is not accounted for so the VM can suspend successfully. */
+            uint32_t cReqsActive = ASMAtomicDecU32(&pTarget->cReqsActive);
+            if (!cReqsActive && pThis->fSignalIdle)
+                PDMDevHlpAsyncNotificationCompleted(pThis->VPCI.pDevInsR3);
+            break;
+        }
+        case PDMMEDIAEXIOREQSTATE_ACTIVE:
+            /* Make sure the request is accounted for so the VM suspends only when the request is complete. */
+            ASMAtomicIncU32(&pTarget->cReqsActive);
+            break;
+        default:
+            AssertMsgFailed(("Invalid request state given %u\n", enmState));
+    }
+}
+
+/**
+ * @interface_method_impl{PDMIMEDIAEXPORT,pfnMediumEjected}
+ */
+static DECLCALLBACK(void) virtioScsiR3MediumEjected(PPDMIMEDIAEXPORT pInterface)
+{
+    RT_NOREF(pInterface);
+}
+
+/**
+ * @interface_method_impl{PDMILEDPORTS,pfnQueryStatusLed}
+ */
+static DECLCALLBACK(int) virtioScsiR3TargetQueryStatusLed(PPDMILEDPORTS pInterface, unsigned iLUN, PPDMLED *ppLed)
+{
+    PVIRTIOSCSITARGET pTarget = RT_FROM_MEMBER(pInterface, VIRTIOSCSITARGET, ILed);
+    if (iLUN == 0)
+    {
+        *ppLed = &pTarget->Led;
+        Assert((*ppLed)->u32Magic == PDMLED_MAGIC);
+        return VINF_SUCCESS;
+    }
+    return VERR_PDM_LUN_NOT_FOUND;
+}
+
+/**
+ * @interface_method_impl{PDMIBASE,pfnQueryInterface, Target}
+ */
+static DECLCALLBACK(void *) virtioScsiR3TargetQueryInterface(PPDMIBASE pInterface, const char *pszIID)
+{
+    PVIRTIOSCSITARGET pTarget = RT_FROM_MEMBER(pInterface, VIRTIOSCSITARGET, IBase);
+
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBASE, &pTarget->IBase);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIMEDIAPORT, &pTarget->IMediaPort);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIMEDIAEXPORT, &pTarget->IMediaExPort);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMILEDPORTS, &pTarget->ILed);
+    return NULL;
+}
+
+
+/*********************************************************************************************************************************
+*   Saved state                                                                                                                  *
+*********************************************************************************************************************************/
+
+/**
+ * Saves the configuration part of the state.
+ */
+static void virtioScsiR3SaveConfig(PVIRTIOSCSI pThis, PSSMHANDLE pSSM)
+{
+    SSMR3PutU32(pSSM, pThis->cTargets);
+    SSMR3PutU32(pSSM, pThis->cReqQueues);
+    for (uint32_t i = 0; i < pThis->cTargets; i++)
+        SSMR3PutBool(pSSM, pThis->paTargetsR3[i].pDrvBase != NULL);
+}
+
+/**
+ * @callback_method_impl{FNSSMDEVLIVEEXEC}
+ */
+static DECLCALLBACK(int) virtioScsiR3LiveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint32_t uPass)
+{
+    RT_NOREF(uPass);
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    virtioScsiR3SaveConfig(pThis, pSSM);
+    return VINF_SSM_DONT_CALL_AGAIN;
+}
+
+/**
+ * @callback_method_impl{FNSSMDEVSAVEEXEC}
+ */
+static DECLCALLBACK(int) virtioScsiR3SaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+
+    virtioScsiR3SaveConfig(pThis, pSSM);
+
+    int rc = vpciSaveExec(&pThis->VPCI, pSSM);
+    AssertRCReturn(rc, rc);
+
+    SSMR3PutU32(pSSM, pThis->Config.uSenseSize);
+    SSMR3PutU32(pSSM, pThis->Config.uCdbSize);
+
+    /*
+     * Requests suspended by the driver because of a recoverable error are lost
+     * with the driver state, save the chains so they can be resubmitted.
+     */
+    uint32_t cReqsRedo = 0;
+    for (uint32_t i = 0; i < pThis->cTargets; i++)
+    {
+        PVIRTIOSCSITARGET pTarget = &pThis->paTargetsR3[i];
+        AssertMsg(!pTarget->cReqsActive, ("There are still active requests on target %u\n", i));
+        if (pTarget->pDrvMediaEx)
+            cReqsRedo += pTarget->pDrvMediaEx->pfnIoReqGetSuspendedCount(pTarget->pDrvMediaEx);
+    }
+
+    SSMR3PutU32(pSSM, cReqsRedo);
+    for (uint32_t i = 0; i < pThis->cTargets && cReqsRedo; i++)
+    {
+        PPDMIMEDIAEX pIfMediaEx = pThis->paTargetsR3[i].pDrvMediaEx;
+        if (!pIfMediaEx)
+            continue;
+
+        uint32_t cReqsTarget = pIfMediaEx->pfnIoReqGetSuspendedCount(pIfMediaEx);
+        if (!cReqsTarget)
+            continue;
+
+        PDMMEDIAEXIOREQ hIoReq;
+        PVIRTIOSCSIREQ pReq;
+        rc = pIfMediaEx->pfnIoReqQuerySuspendedStart(pIfMediaEx, &hIoReq, (void **)&pReq);
+        AssertRCReturn(rc, rc);
+
+        for (;;)
+        {
+            SSMR3PutU16(pSSM, pReq->idxQueue);
+            SSMR3PutU16(pSSM, pReq->uHeadIdx);
+            SSMR3PutU32(pSSM, pReq->cSegsOut);
+            SSMR3PutU32(pSSM, pReq->cSegsIn);
+            for (uint32_t iSeg = 0; iSeg < pReq->cSegsOut + pReq->cSegsIn; iSeg++)
+            {
+                SSMR3PutGCPhys(pSSM, pReq->aSegs[iSeg].GCPhys);
+                SSMR3PutU32(pSSM, pReq->aSegs[iSeg].cb);
+            }
+
+            cReqsRedo--;
+            cReqsTarget--;
+            if (!cReqsTarget)
+                break;
+
+            rc = pIfMediaEx->pfnIoReqQuerySuspendedNext(pIfMediaEx, hIoReq, &hIoReq, (void **)&pReq);
+            AssertRCReturn(rc, rc);
+        }
+    }
+
+    return SSMR3PutU32(pSSM, UINT32_MAX); /* sanity/terminator */
+}
+
+/**
+ * Frees all requests on the redo list.
+ */
+static void virtioScsiR3RedoListFree(PVIRTIOSCSI pThis)
+{
+    PVIRTIOSCSIREDO pIt, pItNext;
+    RTListForEachSafe(&pThis->LstRedo, pIt, pItNext, VIRTIOSCSIREDO, NdLstRedo)
+    {
+        RTListNodeRemove(&pIt->NdLstRedo);
+        RTMemFree(pIt);
+    }
+}
+
+/**
+ * @callback_method_impl{FNSSMDEVLOADEXEC}
+ */
+static DECLCALLBACK(int) virtioScsiR3LoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    int rc;
+
+    if (uVersion != VIRTIOSCSI_SAVED_STATE_VERSION)
+        return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
+
+    /* Verify the config. */
+    uint32_t cTargets;
+    uint32_t cReqQueues;
+    SSMR3GetU32(pSSM, &cTargets);
+    rc = SSMR3GetU32(pSSM, &cReqQueues);
+    AssertRCReturn(rc, rc);
+    if (cTargets != pThis->cTargets)
+        return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("Config mismatch - saved Targets=%u configured Targets=%u"),
+                                cTargets, pThis->cTargets);
+    if (cReqQueues != pThis->cReqQueues)
+        return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("Config mismatch - saved RequestQueues=%u configured RequestQueues=%u"),
+                                cReqQueues, pThis->cReqQueues);
+
+    for (uint32_t i = 0; i < pThis->cTargets; i++)
+    {
+        bool fPresent;
+        rc = SSMR3GetBool(pSSM, &fPresent);
+        AssertRCReturn(rc, rc);
+        if (fPresent != (pThis->paTargetsR3[i].pDrvBase != NULL))
+            return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("Target %u config mismatch: saved=%RTbool config=%RTbool"),
+                                    i, fPresent, pThis->paTargetsR3[i].pDrvBase != NULL);
+    }
+
+    if (uPass != SSM_PASS_FINAL)
+        return VINF_SUCCESS;
+
+    rc = vpciLoadExec(&pThis->VPCI, pSSM, VIRTIO_SAVEDSTATE_VERSION, uPass, VIRTIOSCSI_QUEUE_REQ_FIRST + cReqQueues);
+    AssertRCReturn(rc, rc);
+    if (pThis->VPCI.nQueues != VIRTIOSCSI_QUEUE_REQ_FIRST + cReqQueues)
+        return SSMR3SetLoadError(pSSM, VERR_SSM_DATA_UNIT_FORMAT_CHANGED, RT_SRC_POS,
+                                 N_("Saved state has %u queues instead of %u"),
+                                 pThis->VPCI.nQueues, VIRTIOSCSI_QUEUE_REQ_FIRST + cReqQueues);
+
+    SSMR3GetU32(pSSM, &pThis->Config.uSenseSize);
+    rc = SSMR3GetU32(pSSM, &pThis->Config.uCdbSize);
+    AssertRCReturn(rc, rc);
+    if (   pThis->Config.uSenseSize > VIRTIOSCSI_SENSE_SIZE_MAX
+        || pThis->Config.uCdbSize > VIRTIOSCSI_CDB_SIZE_MAX)
+        return SSMR3SetLoadError(pSSM, VERR_SSM_DATA_UNIT_FORMAT_CHANGED, RT_SRC_POS,
+                                 N_("Invalid sense (%u) or CDB (%u) size"),
+                                 pThis->Config.uSenseSize, pThis->Config.uCdbSize);
+
+    /* The requests to resubmit on resume. */
+    virtioScsiR3RedoListFree(pThis);
+    uint32_t cReqsRedo;
+    rc = SSMR3GetU32(pSSM, &cReqsRedo);
+    AssertRCReturn(rc, rc);
+    for (uint32_t i = 0; i < cReqsRedo; i++)
+    {
+        uint16_t idxQueue;
+        uint16_t uHeadIdx;
+        uint32_t cSegsOut;
+        uint32_t cSegsIn;
+        SSMR3GetU16(pSSM, &idxQueue);
+        SSMR3GetU16(pSSM, &uHeadIdx);
+        SSMR3GetU32(pSSM, &cSegsOut);
+        rc = SSMR3GetU32(pSSM, &cSegsIn);
+        AssertRCReturn(rc, rc);
+        if (   idxQueue < VIRTIOSCSI_QUEUE_REQ_FIRST
+            || idxQueue >= pThis->VPCI.nQueues
+            || cSegsOut + cSegsIn > VIRTIOSCSI_SEGS_TOTAL_MAX)
+            return SSMR3SetLoadError(pSSM, VERR_SSM_DATA_UNIT_FORMAT_CHANGED, RT_SRC_POS,
+                                     N_("Invalid request to resubmit (queue %u, %u+%u segments)"),
+                                     idxQueue, cSegsOut, cSegsIn);
+
+        PVIRTIOSCSIREDO pRedo = (PVIRTIOSCSIREDO)RTMemAllocZ(RT_OFFSETOF(VIRTIOSCSIREDO, aSegs[cSegsOut + cSegsIn]));
+        if (!pRedo)
+            return VERR_NO_MEMORY;
+
+        pRedo->idxQueue = idxQueue;
+        pRedo->uHeadIdx = uHeadIdx;
+        pRedo->cSegsOut = cSegsOut;
+        pRedo->cSegsIn  = cSegsIn;
+        RTListAppend(&pThis->LstRedo, &pRedo->NdLstRedo);
+
+        for (uint32_t iSeg = 0; iSeg < cSegsOut + cSegsIn; iSeg++)
+        {
+            SSMR3GetGCPhys(pSSM, &pRedo->aSegs[iSeg].GCPhys);
+            rc = SSMR3GetU32(pSSM, &pRedo->aSegs[iSeg].cb);
+            AssertRCReturn(rc, rc);
+        }
+    }
+
+    uint32_t u32;
+    rc = SSMR3GetU32(pSSM, &u32);
+    if (RT_FAILURE(rc))
+        return rc;
+    AssertMsgReturn(u32 == UINT32_MAX, ("%#x\n", u32), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+    return VINF_SUCCESS;
+}
+
+
+/*********************************************************************************************************************************
+*   Device interface                                                                                                             *
+*********************************************************************************************************************************/
+
+/**
+ * Resets the device, cancelling all outstanding requests.
+ *
+ * @param   pThis       The device instance data.
+ */
+static void virtioScsiR3HwReset(PVIRTIOSCSI pThis)
+{
+    int rc = vpciCsEnter(&pThis->VPCI, VERR_IGNORED);
+    AssertRC(rc);
+    ASMAtomicIncU32(&pThis->uGeneration);
+    vpciReset(&pThis->VPCI);
+    pThis->Config.uSenseSize = VIRTIOSCSI_SENSE_SIZE_MAX;
+    pThis->Config.uCdbSize   = VIRTIOSCSI_CDB_SIZE_MAX;
+    vpciCsLeave(&pThis->VPCI);
+
+    /* The completions are dropped because of the new generation. */
+    for (uint32_t i = 0; i < pThis->cTargets; i++)
+    {
+        PPDMIMEDIAEX pIfMediaEx = pThis->paTargetsR3[i].pDrvMediaEx;
+        if (pIfMediaEx)
+            pIfMediaEx->pfnIoReqCancelAll(pIfMediaEx);
+    }
+
+    virtioScsiR3RedoListFree(pThis);
+}
+
+/**
+ * @callback_method_impl{FNPCIIOREGIONMAP}
+ */
+static DECLCALLBACK(int) virtioScsiR3Map(PPDMDEVINS pDevIns, PPDMPCIDEV pPciDev, uint32_t iRegion,
+                                         RTGCPHYS GCPhysAddress, RTGCPHYS cb, PCIADDRESSSPACE enmType)
+{
+    RT_NOREF(pPciDev, iRegion);
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    int rc;
+
+    AssertReturn(enmType == PCI_ADDRESS_SPACE_IO, VERR_INTERNAL_ERROR);
+
+    pThis->VPCI.IOPortBase = (RTIOPORT)GCPhysAddress;
+    rc = PDMDevHlpIOPortRegister(pDevIns, pThis->VPCI.IOPortBase, cb, 0,
+                                 virtioScsiIOPortOut, virtioScsiIOPortIn, NULL, NULL, "VirtioSCSI");
+    AssertRCReturn(rc, rc);
+    rc = PDMDevHlpIOPortRegisterR0(pDevIns, pThis->VPCI.IOPortBase, cb, 0,
+                                   "virtioScsiIOPortOut", "virtioScsiIOPortIn", NULL, NULL, "VirtioSCSI");
+    AssertRCReturn(rc, rc);
+    rc = PDMDevHlpIOPortRegisterRC(pDevIns, pThis->VPCI.IOPortBase, cb, 0,
+                                   "virtioScsiIOPortOut", "virtioScsiIOPortIn", NULL, NULL, "VirtioSCSI");
+    AssertRC(rc);
+    return rc;
+}
+
+/**
+ * Checks if all asynchronous I/O is finished.
+ *
+ * Used by virtioScsiR3Reset, virtioScsiR3Suspend and virtioScsiR3PowerOff.
+ *
+ * @returns true if quiesced, false if busy.
+ * @param   pDevIns         The device instance.
+ */
+static bool virtioScsiR3AllAsyncIOIsFinished(PPDMDEVINS pDevIns)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+
+    for (uint32_t i = 0; i < pThis->cTargets; i++)
+        if (ASMAtomicReadU32(&pThis->paTargetsR3[i].cReqsActive))
+            return false;
+
+    return true;
+}
+
+/**
+ * @callback_method_impl{FNPDMDEVASYNCNOTIFY,
+ * Callback employed by virtioScsiR3Suspend and virtioScsiR3PowerOff.}
+ */
+static DECLCALLBACK(bool) virtioScsiR3IsAsyncSuspendOrPowerOffDone(PPDMDEVINS pDevIns)
+{
+    if (!virtioScsiR3AllAsyncIOIsFinished(pDevIns))
+        return false;
+
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+    return true;
+}
+
+/**
+ * Common worker for virtioScsiR3Suspend and virtioScsiR3PowerOff.
+ */
+static void virtioScsiR3SuspendOrPowerOff(PPDMDEVINS pDevIns)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+
+    ASMAtomicWriteBool(&pThis->fSignalIdle, true);
+    if (!virtioScsiR3AllAsyncIOIsFinished(pDevIns))
+        PDMDevHlpSetAsyncNotification(pDevIns, virtioScsiR3IsAsyncSuspendOrPowerOffDone);
+    else
+        ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnSuspend}
+ */
+static DECLCALLBACK(void) virtioScsiR3Suspend(PPDMDEVINS pDevIns)
+{
+    Log(("virtioScsiR3Suspend\n"));
+    virtioScsiR3SuspendOrPowerOff(pDevIns);
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnPowerOff}
+ */
+static DECLCALLBACK(void) virtioScsiR3PowerOff(PPDMDEVINS pDevIns)
+{
+    Log(("virtioScsiR3PowerOff\n"));
+    virtioScsiR3SuspendOrPowerOff(pDevIns);
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnResume}
+ */
+static DECLCALLBACK(void) virtioScsiR3Resume(PPDMDEVINS pDevIns)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+
+    Log(("virtioScsiR3Resume\n"));
+
+    /* Resubmit the requests which were suspended when the state was saved. */
+    PVIRTIOSCSIREDO pIt, pItNext;
+    RTListForEachSafe(&pThis->LstRedo, pIt, pItNext, VIRTIOSCSIREDO, NdLstRedo)
+    {
+        RTListNodeRemove(&pIt->NdLstRedo);
+        virtioScsiR3ReqSubmit(pThis, pIt->idxQueue, pIt->uHeadIdx, &pIt->aSegs[0], pIt->cSegsOut, pIt->cSegsIn,
+                              pThis->uGeneration);
+        RTMemFree(pIt);
+    }
+}
+
+/**
+ * @callback_method_impl{FNPDMDEVASYNCNOTIFY, Callback employed by virtioScsiR3Reset.}
+ */
+static DECLCALLBACK(bool) virtioScsiR3IsAsyncResetDone(PPDMDEVINS pDevIns)
+{
+    if (!virtioScsiR3AllAsyncIOIsFinished(pDevIns))
+        return false;
+
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+    virtioScsiR3HwReset(pThis);
+    return true;
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnReset}
+ */
+static DECLCALLBACK(void) virtioScsiR3Reset(PPDMDEVINS pDevIns)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+
+    ASMAtomicWriteBool(&pThis->fSignalIdle, true);
+    if (!virtioScsiR3AllAsyncIOIsFinished(pDevIns))
+        PDMDevHlpSetAsyncNotification(pDevIns, virtioScsiR3IsAsyncResetDone);
+    else
+    {
+        ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+        virtioScsiR3HwReset(pThis);
+    }
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnRelocate}
+ */
+static DECLCALLBACK(void) virtioScsiR3Relocate(PPDMDEVINS pDevIns, RTGCINTPTR offDelta)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    vpciRelocate(pDevIns, offDelta);
+    pThis->pWakeQueueRC = PDMQueueRCPtr(pThis->pWakeQueueR3);
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnDetach}
+ */
+static DECLCALLBACK(void) virtioScsiR3Detach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t fFlags)
+{
+    RT_NOREF(fFlags);
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+
+    if (iLUN >= pThis->cTargets)
+        return;
+
+    AssertMsg(fFlags & PDM_TACH_FLAGS_NOT_HOT_PLUG,
+              ("VirtioSCSI: Device does not support hotplugging\n"));
+
+    PVIRTIOSCSITARGET pTarget = &pThis->paTargetsR3[iLUN];
+    pTarget->pDrvBase    = NULL;
+    pTarget->pDrvMedia   = NULL;
+    pTarget->pDrvMediaEx = NULL;
+}
+
+/**
+ * Attaches the driver of the given target and queries its interfaces.
+ *
+ * @returns VBox status code.
+ * @param   pDevIns     The device instance.
+ * @param   pTarget     The target.
+ * @param   pszDesc     Description of the target.
+ */
+static int virtioScsiR3TargetAttach(PPDMDEVINS pDevIns, PVIRTIOSCSITARGET pTarget, const char *pszDesc)
+{
+    int rc = PDMDevHlpDriverAttach(pDevIns, pTarget->iTarget, &pTarget->IBase, &pTarget->pDrvBase, pszDesc);
+    if (RT_SUCCESS(rc))
+    {
+        pTarget->pDrvMedia = PDMIBASE_QUERY_INTERFACE(pTarget->pDrvBase, PDMIMEDIA);
+        AssertMsgReturn(VALID_PTR(pTarget->pDrvMedia),
+                        ("VirtioSCSI configuration error: LUN#%u misses the basic media interface!\n", pTarget->iTarget),
+                        VERR_PDM_MISSING_INTERFACE);
+
+        pTarget->pDrvMediaEx = PDMIBASE_QUERY_INTERFACE(pTarget->pDrvBase, PDMIMEDIAEX);
+        AssertMsgReturn(VALID_PTR(pTarget->pDrvMediaEx),
+                        ("VirtioSCSI configuration error: LUN#%u misses the extended media interface!\n", pTarget->iTarget),
+                        VERR_PDM_MISSING_INTERFACE);
+
+        rc = pTarget->pDrvMediaEx->pfnIoReqAllocSizeSet(pTarget->pDrvMediaEx, sizeof(VIRTIOSCSIREQ));
+        if (RT_FAILURE(rc))
+            return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
+                                       N_("VirtioSCSI configuration error: LUN#%u: Failed to set I/O request size!"),
+                                       pTarget->iTarget);
+    }
+
+    if (RT_FAILURE(rc))
+    {
+        pTarget->pDrvBase    = NULL;
+        pTarget->pDrvMedia   = NULL;
+        pTarget->pDrvMediaEx = NULL;
+    }
+    return rc;
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnAttach}
+ */
+static DECLCALLBACK(int) virtioScsiR3Attach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t fFlags)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+
+    if (iLUN >= pThis->cTargets)
+        return VERR_PDM_LUN_NOT_FOUND;
+
+    AssertMsgReturn(fFlags & PDM_TACH_FLAGS_NOT_HOT_PLUG,
+                    ("VirtioSCSI: Device does not support hotplugging\n"),
+                    VERR_INVALID_PARAMETER);
+
+    PVIRTIOSCSITARGET pTarget = &pThis->paTargetsR3[iLUN];
+
+    /* the usual paranoia */
+    AssertRelease(!pTarget->pDrvBase);
+    AssertRelease(!pTarget->pDrvMedia);
+    AssertRelease(!pTarget->pDrvMediaEx);
+
+    int rc = virtioScsiR3TargetAttach(pDevIns, pTarget, NULL);
+    AssertMsg(RT_SUCCESS(rc), ("Failed to attach LUN#%u. rc=%Rrc\n", iLUN, rc));
+    return rc;
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnDestruct}
+ */
+static DECLCALLBACK(int) virtioScsiR3Destruct(PPDMDEVINS pDevIns)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    PDMDEV_CHECK_VERSIONS_RETURN_QUIET(pDevIns);
+
+    for (uint32_t i = 0; i < RT_ELEMENTS(pThis->aReqQueues); i++)
+    {
+        PVIRTIOSCSIREQQUEUE pReqQueue = &pThis->aReqQueues[i];
+
+        if (pReqQueue->pThrd)
+        {
+            int rcThrd;
+            int rc = PDMR3ThreadDestroy(pReqQueue->pThrd, &rcThrd);
+            AssertRC(rc);
+            AssertRC(rcThrd);
+            pReqQueue->pThrd = NULL;
+        }
+
+        if (pReqQueue->hEvtProcess != NIL_SUPSEMEVENT)
+        {
+            SUPSemEventClose(pThis->pSupDrvSession, pReqQueue->hEvtProcess);
+            pReqQueue->hEvtProcess = NIL_SUPSEMEVENT;
+        }
+
+        if (pReqQueue->pElem)
+        {
+            RTMemFree(pReqQueue->pElem);
+            pReqQueue->pElem = NULL;
+        }
+    }
+
+    if (pThis->LstRedo.pNext)
+        virtioScsiR3RedoListFree(pThis);
+
+    if (pThis->pElemCtrlR3)
+    {
+        RTMemFree(pThis->pElemCtrlR3);
+        pThis->pElemCtrlR3 = NULL;
+    }
+
+    if (pThis->paTargetsR3)
+    {
+        RTMemFree(pThis->paTargetsR3);
+        pThis->paTargetsR3 = NULL;
+    }
+
+    return vpciDestruct(&pThis->VPCI);
+}
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnConstruct}
+ */
+static DECLCALLBACK(int) virtioScsiR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFGMNODE pCfg)
+{
+    PVIRTIOSCSI pThis = PDMINS_2_DATA(pDevIns, PVIRTIOSCSI);
+    int         rc;
+    PDMDEV_CHECK_VERSIONS_RETURN(pDevIns);
+
+    /* Initialize the instance data suffiencently for the destructor not to blow up. */
+    RTListInit(&pThis->LstRedo);
+    for (uint32_t i = 0; i < RT_ELEMENTS(pThis->aReqQueues); i++)
+        pThis->aReqQueues[i].hEvtProcess = NIL_SUPSEMEVENT;
+    pThis->pSupDrvSession = PDMDevHlpGetSupDrvSession(pDevIns);
+
+    /*
+     * Validate and read configuration.
+     */
+    if (!CFGMR3AreValuesValid(pCfg, "Targets\0" "RequestQueues\0"))
+        return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
+                                N_("VirtioSCSI configuration error: unknown option specified"));
+
+    rc = CFGMR3QueryU32Def(pCfg, "Targets", &pThis->cTargets, VIRTIOSCSI_TARGETS_DEFAULT);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("VirtioSCSI configuration error: failed to read Targets as integer"));
+    if (!pThis->cTargets || pThis->cTargets > VIRTIOSCSI_TARGETS_MAX)
+        return PDMDevHlpVMSetError(pDevIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("VirtioSCSI configuration error: Targets=%u must be between 1 and %u"),
+                                   pThis->cTargets, VIRTIOSCSI_TARGETS_MAX);
+
+    rc = CFGMR3QueryU32Def(pCfg, "RequestQueues", &pThis->cReqQueues, VIRTIOSCSI_REQ_QUEUES_DEFAULT);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("VirtioSCSI configuration error: failed to read RequestQueues as integer"));
+    if (!pThis->cReqQueues || pThis->cReqQueues > VIRTIOSCSI_REQ_QUEUES_MAX)
+        return PDMDevHlpVMSetError(pDevIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("VirtioSCSI configuration error: RequestQueues=%u must be between 1 and %u"),
+                                   pThis->cReqQueues, VIRTIOSCSI_REQ_QUEUES_MAX);
+
+    /* Do our own locking. */
+    rc = PDMDevHlpSetDeviceCritSect(pDevIns, PDMDevHlpCritSectGetNop(pDevIns));
+    AssertRCReturn(rc, rc);
+
+    /*
+     * Initialize the common virtio PCI part and the queues.
+     */
+    pThis->VPCI.IBase.pfnQueryInterface = vpciQueryInterface;
+    rc = vpciConstruct(pDevIns, &pThis->VPCI, iInstance, VIRTIOSCSI_NAME_FMT, VIRTIO_SCSI_ID,
+                       VIRTIOSCSI_PCI_CLASS, VIRTIOSCSI_QUEUE_REQ_FIRST + pThis->cReqQueues);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    vpciAddQueue(&pThis->VPCI, VIRTIOSCSI_CTRL_QUEUE_SIZE, virtioScsiR3QueueControl, "CTRL");
+    vpciAddQueue(&pThis->VPCI, VIRTIOSCSI_CTRL_QUEUE_SIZE, virtioScsiR3QueueEvent,   "EVT ");
+    for (uint32_t i = 0; i < pThis->cReqQueues; i++)
+        vpciAddQueue(&pThis->VPCI, VIRTIOSCSI_REQ_QUEUE_SIZE, NULL, g_apszReqQueueNames[i]);
+
+    pThis->Config.uNumQueues     = pThis->cReqQueues;
+    pThis->Config.uSegMax        = VIRTIOSCSI_SEG_MAX;
+    pThis->Config.uMaxSectors    = VIRTIOSCSI_MAX_SECTORS;
+    pThis->Config.uCmdPerLun     = VIRTIOSCSI_REQ_QUEUE_SIZE;
+    pThis->Config.uEventInfoSize = VIRTIOSCSI_EVENT_INFO_SIZE;
+    pThis->Config.uSenseSize     = VIRTIOSCSI_SENSE_SIZE_MAX;
+    pThis->Config.uCdbSize       = VIRTIOSCSI_CDB_SIZE_MAX;
+    pThis->Config.uMaxChannel    = 0;
+    pThis->Config.uMaxTarget     = (uint16_t)(pThis->cTargets - 1);
+    pThis->Config.uMaxLun        = 0;
+
+    pThis->pElemCtrlR3 = (PVQUEUEELEM)RTMemAllocZ(sizeof(VQUEUEELEM));
+    if (!pThis->pElemCtrlR3)
+        return VERR_NO_MEMORY;
+
+    rc = PDMDevHlpPCIIORegionRegister(pDevIns, 0, VPCI_CONFIG + sizeof(VIRTIOSCSICONFIG),
+                                      PCI_ADDRESS_SPACE_IO, virtioScsiR3Map);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /*
+     * The queue for waking up the workers from RC.
+     */
+    rc = PDMDevHlpQueueCreate(pDevIns, sizeof(VIRTIOSCSIWAKEITEM), VIRTIOSCSI_REQ_QUEUES_MAX * 2, 0,
+                              virtioScsiR3NotifyQueueConsumer, true, "VirtioSCSI-Wake", &pThis->pWakeQueueR3);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("VirtioSCSI: Failed to create the wakeup queue"));
+    pThis->pWakeQueueR0 = PDMQueueR0Ptr(pThis->pWakeQueueR3);
+    pThis->pWakeQueueRC = PDMQueueRCPtr(pThis->pWakeQueueR3);
+
+    /*
+     * The workers, one for each request queue.
+     */
+    for (uint32_t i = 0; i < pThis->cReqQueues; i++)
+    {
+        PVIRTIOSCSIREQQUEUE pReqQueue = &pThis->aReqQueues[i];
+        char szName[32];
+
+        pReqQueue->pElem = (PVQUEUEELEM)RTMemAllocZ(sizeof(VQUEUEELEM));
+        if (!pReqQueue->pElem)
+            return VERR_NO_MEMORY;
+
+        rc = SUPSemEventCreate(pThis->pSupDrvSession, &pReqQueue->hEvtProcess);
+        if (RT_FAILURE(rc))
+            return PDMDEV_SET_ERROR(pDevIns, rc, N_("VirtioSCSI: Failed to create SUP event semaphore"));
+
+        RTStrPrintf(szName, sizeof(szName), "VSCSI%u-Q%u", iInstance, i);
+        rc = PDMDevHlpThreadCreate(pDevIns, &pReqQueue->pThrd, pReqQueue, virtioScsiR3WorkerLoop,
+                                   virtioScsiR3WorkerWakeUp, 0, RTTHREADTYPE_IO, szName);
+        if (RT_FAILURE(rc))
+            return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
+                                       N_("VirtioSCSI: Failed to create worker thread %s"), szName);
+    }
+
+    /*
+     * The targets.
+     */
+    pThis->paTargetsR3 = (PVIRTIOSCSITARGET)RTMemAllocZ(sizeof(VIRTIOSCSITARGET) * pThis->cTargets);
+    if (!pThis->paTargetsR3)
+        return PDMDEV_SET_ERROR(pDevIns, VERR_NO_MEMORY, N_("VirtioSCSI: Failed to allocate memory for the targets"));
+
+    for (uint32_t i = 0; i < pThis->cTargets; i++)
+    {
+        PVIRTIOSCSITARGET pTarget = &pThis->paTargetsR3[i];
+        char *pszName;
+
+        if (RTStrAPrintf(&pszName, "Target%u", i) < 0)
+            return VERR_NO_MEMORY;
+
+        pTarget->pVirtioScsiR3                         = pThis;
+        pTarget->iTarget                               = i;
+        pTarget->Led.u32Magic                          = PDMLED_MAGIC;
+        pTarget->IBase.pfnQueryInterface               = virtioScsiR3TargetQueryInterface;
+        pTarget->IMediaPort.pfnQueryDeviceLocation     = virtioScsiR3QueryDeviceLocation;
+        pTarget->IMediaExPort.pfnIoReqCompleteNotify   = virtioScsiR3IoReqCompleteNotify;
+        pTarget->IMediaExPort.pfnIoReqCopyFromBuf      = virtioScsiR3IoReqCopyFromBuf;
+        pTarget->IMediaExPort.pfnIoReqCopyToBuf        = virtioScsiR3IoReqCopyToBuf;
+        pTarget->IMediaExPort.pfnIoReqQueryDiscardRanges = NULL;
+        pTarget->IMediaExPort.pfnIoReqStateChanged     = virtioScsiR3IoReqStateChanged;
+        pTarget->IMediaExPort.pfnMediumEjected         = virtioScsiR3MediumEjected;
+        pTarget->ILed.pfnQueryStatusLed                = virtioScsiR3TargetQueryStatusLed;
+
+        /* The name is kept by PDM for the lifetime of the VM. */
+        rc = virtioScsiR3TargetAttach(pDevIns, pTarget, pszName);
+        if (rc == VERR_PDM_NO_ATTACHED_DRIVER)
+        {
+            Log(("%s: no driver attached to %s\n", INSTANCE(pThis), pszName));
+            rc = VINF_SUCCESS;
+        }
+        else if (RT_FAILURE(rc))
+            return PDMDEV_SET_ERROR(pDevIns, rc, N_("VirtioSCSI: Failed to attach a target"));
+    }
+
+    rc = PDMDevHlpSSMRegisterEx(pDevIns, VIRTIOSCSI_SAVED_STATE_VERSION, sizeof(*pThis), NULL,
+                                NULL, virtioScsiR3LiveExec, NULL,
+                                NULL, virtioScsiR3SaveExec, NULL,
+                                NULL, virtioScsiR3LoadExec, NULL);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("VirtioSCSI cannot register save state handlers"));
+
+    /*
+     * Statistics.
+     */
+    for (uint32_t i = 0; i < pThis->cReqQueues; i++)
+    {
+        PVIRTIOSCSIREQQUEUE pReqQueue = &pThis->aReqQueues[i];
+        PDMDevHlpSTAMRegisterF(pDevIns, &pReqQueue->StatKicks,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Number of kicks",                      "/Devices/VScsi%d/ReqQueue%u/Kicks", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pReqQueue->StatKicksWakeup, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Number of kicks waking up the worker", "/Devices/VScsi%d/ReqQueue%u/KicksWakeup", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pReqQueue->StatReqs,        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Number of requests processed",         "/Devices/VScsi%d/ReqQueue%u/Requests", iInstance, i);
+    }
+
+    LogRel(("%s: %u targets, %u request queues\n", INSTANCE(pThis), pThis->cTargets, pThis->cReqQueues));
+    return VINF_SUCCESS;
+}
+
+/**
+ * The device registration structure.
+ */
+const PDMDEVREG g_DeviceVirtioSCSI =
+{
+    /* Structure version. PDM_DEVREG_VERSION defines the current version. */
+    PDM_DEVREG_VERSION,
+    /* Device name. */
+    "virtio-scsi",
+    /* Name of guest context module (no path).
+     * Only evalutated if PDM_DEVREG_FLAGS_RC is set. */
+    "VBoxDDRC.rc",
+    /* Name of ring-0 module (no path).
+     * Only evalutated if PDM_DEVREG_FLAGS_RC is set. */
+    "VBoxDDR0.r0",
+    /* The description of the device. The UTF-8 string pointed to shall, like this structure,
+     * remain unchanged from registration till VM destruction. */
+    "Virtio SCSI host.\n",
+
+    /* Flags, combination of the PDM_DEVREG_FLAGS_* \#defines. */
+    PDM_DEVREG_FLAGS_DEFAULT_BITS | PDM_DEVREG_FLAGS_RC | PDM_DEVREG_FLAGS_R0
+    | PDM_DEVREG_FLAGS_FIRST_SUSPEND_NOTIFICATION | PDM_DEVREG_FLAGS_FIRST_POWEROFF_NOTIFICATION
+    | PDM_DEVREG_FLAGS_FIRST_RESET_NOTIFICATION,
+    /* Device class(es), combination of the PDM_DEVREG_CLASS_* \#defines. */
+    PDM_DEVREG_CLASS_STORAGE,
+    /* Maximum number of instances (per VM). */
+    ~0U,
+    /* Size of the instance data. */
+    sizeof(VIRTIOSCSI),
+
+    /* pfnConstruct */
+    virtioScsiR3Construct,
+    /* pfnDestruct */
+    virtioScsiR3Destruct,
+    /* pfnRelocate */
+    virtioScsiR3Relocate,
+    /* pfnMemSetup. */
+    NULL,
+    /* pfnPowerOn */
+    NULL,
+    /* pfnReset */
+    virtioScsiR3Reset,
+    /* pfnSuspend */
+    virtioScsiR3Suspend,
+    /* pfnResume */
+    virtioScsiR3Resume,
+    /* pfnAttach */
+    virtioScsiR3Attach,
+    /* pfnDetach */
+    virtioScsiR3Detach,
+    /* pfnQueryInterface */
+    NULL,
+    /* pfnInitComplete */
+    NULL,
+    /* pfnPowerOff */
+    virtioScsiR3PowerOff,
+    /* pfnSoftReset */
+    NULL,
+
+    /* u32VersionEnd */
+    PDM_DEVREG_VERSION
+};
+
+#endif /* IN_RING3 */
+#endif /* !VBOX_DEVICE_STRUCT_TESTCASE */
@@ -33,10 +33,29 @@
 #include <iprt/time.h>
 #include <iprt/semaphore.h>
 #include <iprt/asm.h>
+#include <iprt/crc.h>
+#include <iprt/memcache.h>
+#include <iprt/thread.h>
 
 #include "VBoxDD.h"
 
 
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The sector size consistency checking works with. */
+#define DRVDISKINT_SECTOR_SIZE          512
+/** Number of sectors tracked by one chunk. */
+#define DRVDISKINT_CHUNK_SECTORS        256
+/** Size of the disk area covered by one chunk. */
+#define DRVDISKINT_CHUNK_SIZE           (DRVDISKINT_CHUNK_SECTORS * DRVDISKINT_SECTOR_SIZE)
+/** Number of sectors to calculate the CRC for in one go. */
+#define DRVDISKINT_CRC_BATCH            8
+/** Maximum number of read verification jobs queued before falling back to
+ * synchronous verification. */
+#define DRVDISKINT_VERIFY_JOBS_MAX      1024
+
+
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
@@ -95,34 +114,65 @@ typedef struct DRVDISKAIOREQ
 } DRVDISKAIOREQ, *PDRVDISKAIOREQ;
 
 /**
- * I/O log entry.
+ * Chunk of tracked disk sectors.
+ *
+ * Only a CRC32C of every written sector is kept instead of a copy of the data.
+ * Chunks have a fixed size, are aligned to it and are allocated from a memory
+ * cache, so the memory overhead stays below 1% of the touched disk space.
  */
-typedef struct IOLOGENT
+typedef struct DRVDISKCHUNK
 {
-    /** Start offset */
+    /** AVL core, the key range covers the whole chunk. */
+    AVLRFOFFNODECORE Core;
+    /** Start offset of the last write touching this chunk. */
+    uint64_t         offLastWrite;
+    /** Size of the last write touching this chunk. */
+    size_t           cbLastWrite;
+    /** Number of sectors with a valid CRC. */
+    uint32_t         cSectorsValid;
+    /** Bitmap of sectors with a valid CRC. */
+    uint32_t         bmValid[DRVDISKINT_CHUNK_SECTORS / 32];
+    /** CRC32C of each sector. */
+    uint32_t         au32Crc[DRVDISKINT_CHUNK_SECTORS];
+} DRVDISKCHUNK, *PDRVDISKCHUNK;
+
+/**
+ * Last write information of a chunk for reporting.
+ */
+typedef struct DRVDISKLASTWRITE
+{
+    /** Start offset, 0 if nothing was written. */
     uint64_t         off;
-    /** Write size */
-    size_t           cbWrite;
-    /** Number of references to this entry. */
-    unsigned         cRefs;
-} IOLOGENT, *PIOLOGENT;
+    /** Number of bytes written, 0 if nothing was written. */
+    size_t           cb;
+} DRVDISKLASTWRITE, *PDRVDISKLASTWRITE;
 
 /**
- * Disk segment.
+ * Read verification job.
+ *
+ * Holds a snapshot of the expected sector CRCs taken when the read completed,
+ * so the read data can be checked later on by the verifier thread without
+ * accessing the chunk tree.
  */
-typedef struct DRVDISKSEGMENT
+typedef struct DRVDISKVERIFYJOB
 {
-    /** AVL core. */
-    AVLRFOFFNODECORE Core;
-    /** Size of the segment */
-    size_t           cbSeg;
-    /** Data for this segment */
-    uint8_t         *pbSeg;
-    /** Number of entries in the I/O array. */
-    unsigned         cIoLogEntries;
-    /** Array of I/O log references. */
-    PIOLOGENT        apIoLog[1];
-} DRVDISKSEGMENT, *PDRVDISKSEGMENT;
+    /** Next job in the list. */
+    struct DRVDISKVERIFYJOB *pNext;
+    /** Start offset of the read. */
+    uint64_t                 off;
+    /** Size of the read in bytes. */
+    size_t                   cbRead;
+    /** The read data if the job is queued (owned by the job). */
+    void                    *pvBuf;
+    /** Number of sectors covered. */
+    uint32_t                 cSectors;
+    /** Last write information for every chunk touched, indexed relative to the first chunk. */
+    PDRVDISKLASTWRITE        paLastWrite;
+    /** Expected CRC32C for every sector. */
+    uint32_t                *pau32Crc;
+    /** Bitmap of sectors which need checking. */
+    uint32_t                *pbmCheck;
+} DRVDISKVERIFYJOB, *PDRVDISKVERIFYJOB;
 
 /**
  * Active requests list entry.
@@ -169,8 +219,30 @@ typedef struct DRVDISKINTEGRITY
     bool                    fCheckConsistency;
     /** Flag whether the RAM disk was prepopulated. */
     bool                    fPrepopulateRamDisk;
-    /** AVL tree containing the disk blocks to check. */
-    PAVLRFOFFTREE           pTreeSegments;
+    /** AVL tree containing the chunks with the sector CRCs to check. */
+    PAVLRFOFFTREE           pTreeChunks;
+    /** Memory cache the chunks are allocated from. */
+    RTMEMCACHE              hMemCacheChunks;
+    /** The chunk accessed last. */
+    PDRVDISKCHUNK           pChunkHint;
+    /** Number of chunks allocated. */
+    uint32_t                cChunks;
+    /** CRC32C of a sector filled with zeros. */
+    uint32_t                u32CrcZeroSector;
+
+    /** Flag whether reads of the extended media interface are verified
+     * by a separate thread. */
+    bool                    fVerifyAsync;
+    /** Flag whether the verifier thread should run. */
+    volatile bool           fVerifyRunning;
+    /** The verifier thread. */
+    RTTHREAD                hThreadVerify;
+    /** Event semaphore to wake up the verifier thread. */
+    RTSEMEVENT              hEvtVerify;
+    /** List of queued verification jobs (LIFO). */
+    PDRVDISKVERIFYJOB volatile pVerifyJobsHead;
+    /** Number of verification jobs not processed yet. */
+    volatile uint32_t       cVerifyJobsPending;
 
     /** Flag whether async request tracing is enabled. */
     bool                    fTraceRequests;
@@ -242,11 +314,91 @@ static void drvdiskintIoReqCheckForDoubleCompletion(PDRVDISKINTEGRITY pThis, PDR
     }
 }
 
-static void drvdiskintIoLogEntryRelease(PIOLOGENT pIoLogEnt)
+/**
+ * Calculates the CRC32C of the given number of sectors.
+ *
+ * Several sectors are processed at once to make use of the multi-buffer
+ * CRC32C implementation.
+ *
+ * @returns nothing.
+ * @param   pSgBuf      The S/G buffer to read the sector data from, advanced.
+ * @param   cSectors    Number of sectors to process.
+ * @param   pau32Crc    Where to store the CRC of each sector.
+ */
+static void drvdiskintSectorsCrc(PRTSGBUF pSgBuf, uint32_t cSectors, uint32_t *pau32Crc)
+{
+    uint8_t     abBounce[DRVDISKINT_CRC_BATCH][DRVDISKINT_SECTOR_SIZE];
+    void const *apvSector[DRVDISKINT_CRC_BATCH];
+    size_t      acbSector[DRVDISKINT_CRC_BATCH];
+
+    while (cSectors)
+    {
+        uint32_t cThisBatch = RT_MIN(cSectors, DRVDISKINT_CRC_BATCH);
+
+        for (uint32_t i = 0; i < cThisBatch; i++)
+        {
+            size_t cbSeg = DRVDISKINT_SECTOR_SIZE;
+            void *pvSeg = RTSgBufGetNextSegment(pSgBuf, &cbSeg);
+            if (cbSeg < DRVDISKINT_SECTOR_SIZE)
+            {
+                /* The sector crosses a segment boundary. */
+                memcpy(&abBounce[i][0], pvSeg, cbSeg);
+                RTSgBufCopyToBuf(pSgBuf, &abBounce[i][cbSeg], DRVDISKINT_SECTOR_SIZE - cbSeg);
+                pvSeg = &abBounce[i][0];
+            }
+
+            apvSector[i] = pvSeg;
+            acbSector[i] = DRVDISKINT_SECTOR_SIZE;
+            pau32Crc[i]  = RTCrc32CStart();
+        }
+
+        RTCrc32CProcessMulti(pau32Crc, apvSector, acbSector, cThisBatch);
+        for (uint32_t i = 0; i < cThisBatch; i++)
+            pau32Crc[i] = RTCrc32CFinish(pau32Crc[i]);
+
+        pau32Crc += cThisBatch;
+        cSectors -= cThisBatch;
+    }
+}
+
+/**
+ * Returns the chunk starting at the given offset.
+ *
+ * Consecutive requests tend to hit the same chunk, so the last chunk found
+ * is remembered and checked first.
+ *
+ * @returns Pointer to the chunk or NULL if nothing was recorded for it.
+ * @param   pThis       Disk integrity driver instance data.
+ * @param   offChunk    Start offset of the chunk.
+ */
+DECLINLINE(PDRVDISKCHUNK) drvdiskintChunkGet(PDRVDISKINTEGRITY pThis, uint64_t offChunk)
 {
-    pIoLogEnt->cRefs--;
-    if (!pIoLogEnt->cRefs)
-        RTMemFree(pIoLogEnt);
+    PDRVDISKCHUNK pChunk = pThis->pChunkHint;
+
+    if (   !pChunk
+        || pChunk->Core.Key != (RTFOFF)offChunk)
+    {
+        pChunk = (PDRVDISKCHUNK)RTAvlrFileOffsetGet(pThis->pTreeChunks, (RTFOFF)offChunk);
+        if (pChunk)
+            pThis->pChunkHint = pChunk;
+    }
+
+    return pChunk;
+}
+
+/**
+ * Frees the given chunk, it must be removed from the tree already.
+ *
+ * @returns nothing.
+ * @param   pThis       Disk integrity driver instance data.
+ * @param   pChunk      The chunk to free.
+ */
+static void drvdiskintChunkFree(PDRVDISKINTEGRITY pThis, PDRVDISKCHUNK pChunk)
+{
+    if (pThis->pChunkHint == pChunk)
+        pThis->pChunkHint = NULL;
+    pThis->cChunks--;
+    RTMemCacheFree(pThis->hMemCacheChunks, pChunk);
 }
 
 /**
@@ -262,108 +414,200 @@ static void drvdiskintIoLogEntryRelease(PIOLOGENT pIoLogEnt)
 static int drvdiskintWriteRecord(PDRVDISKINTEGRITY pThis, PCRTSGSEG paSeg, unsigned cSeg,
                                  uint64_t off, size_t cbWrite)
 {
-    int rc = VINF_SUCCESS;
-
     LogFlowFunc(("pThis=%#p paSeg=%#p cSeg=%u off=%llx cbWrite=%u\n",
                  pThis, paSeg, cSeg, off, cbWrite));
 
-    /* Update the segments */
-    size_t cbLeft   = cbWrite;
-    RTFOFF offCurr  = (RTFOFF)off;
-    RTSGBUF SgBuf;
-    PIOLOGENT pIoLogEnt = (PIOLOGENT)RTMemAllocZ(sizeof(IOLOGENT));
-    if (!pIoLogEnt)
-        return VERR_NO_MEMORY;
+    Assert(off % DRVDISKINT_SECTOR_SIZE == 0);
+    Assert(cbWrite % DRVDISKINT_SECTOR_SIZE == 0);
 
-    pIoLogEnt->off     = off;
-    pIoLogEnt->cbWrite = cbWrite;
-    pIoLogEnt->cRefs   = 0;
+    /* Update the chunks */
+    size_t   cbLeft   = cbWrite;
+    uint64_t offCurr  = off;
+    RTSGBUF  SgBuf;
 
     RTSgBufInit(&SgBuf, paSeg, cSeg);
 
     while (cbLeft)
     {
-        PDRVDISKSEGMENT pSeg = (PDRVDISKSEGMENT)RTAvlrFileOffsetRangeGet(pThis->pTreeSegments, offCurr);
-        size_t cbRange  = 0;
-        bool fSet       = false;
-        unsigned offSeg = 0;
+        uint64_t offChunk = offCurr & ~(uint64_t)(DRVDISKINT_CHUNK_SIZE - 1);
+        uint32_t iSector  = (uint32_t)((offCurr - offChunk) / DRVDISKINT_SECTOR_SIZE);
+        uint32_t cSectors = (uint32_t)RT_MIN(cbLeft / DRVDISKINT_SECTOR_SIZE, DRVDISKINT_CHUNK_SECTORS - iSector);
+        PDRVDISKCHUNK pChunk = drvdiskintChunkGet(pThis, offChunk);
 
-        if (!pSeg)
+        if (!pChunk)
         {
-            /* Get next segment */
-            pSeg = (PDRVDISKSEGMENT)RTAvlrFileOffsetGetBestFit(pThis->pTreeSegments, offCurr, true);
-            if (   !pSeg
-                || offCurr + (RTFOFF)cbLeft <= pSeg->Core.Key)
-                cbRange = cbLeft;
-            else
-                cbRange = pSeg->Core.Key - offCurr;
+            /* Create new chunk */
+            pChunk = (PDRVDISKCHUNK)RTMemCacheAlloc(pThis->hMemCacheChunks);
+            if (!pChunk)
+                return VERR_NO_MEMORY;
+
+            RT_BZERO(pChunk, sizeof(*pChunk));
+            pChunk->Core.Key     = (RTFOFF)offChunk;
+            pChunk->Core.KeyLast = (RTFOFF)offChunk + DRVDISKINT_CHUNK_SIZE - 1;
+            bool fInserted = RTAvlrFileOffsetInsert(pThis->pTreeChunks, &pChunk->Core);
+            AssertMsg(fInserted, ("Bug!\n")); RT_NOREF(fInserted);
+            pThis->pChunkHint = pChunk;
+            pThis->cChunks++;
+        }
+
+        drvdiskintSectorsCrc(&SgBuf, cSectors, &pChunk->au32Crc[iSector]);
+        for (uint32_t i = iSector; i < iSector + cSectors; i++)
+            if (!ASMBitTestAndSet(&pChunk->bmValid[0], i))
+                pChunk->cSectorsValid++;
 
-            Assert(cbRange % 512 == 0);
+        pChunk->offLastWrite = off;
+        pChunk->cbLastWrite  = cbWrite;
+
+        offCurr += cSectors * DRVDISKINT_SECTOR_SIZE;
+        cbLeft  -= cSectors * DRVDISKINT_SECTOR_SIZE;
+    }
+
+    return VINF_SUCCESS;
+}
 
-            /* Create new segment */
-            pSeg = (PDRVDISKSEGMENT)RTMemAllocZ(RT_OFFSETOF(DRVDISKSEGMENT, apIoLog[cbRange / 512]));
-            if (pSeg)
+/**
+ * Creates a verification job for a read, taking a snapshot of the expected
+ * sector CRCs.
+ *
+ * All chunks the read touches are looked up once, sectors which were never
+ * written are only checked if the RAM disk was prepopulated (they must be 0
+ * then).
+ *
+ * @returns Pointer to the job or NULL if out of memory.
+ * @param   pThis    Disk integrity driver instance data.
+ * @param   off      Start offset of the read.
+ * @param   cbRead   Number of bytes read.
+ */
+static PDRVDISKVERIFYJOB drvdiskintVerifyJobCreate(PDRVDISKINTEGRITY pThis, uint64_t off, size_t cbRead)
+{
+    Assert(off % DRVDISKINT_SECTOR_SIZE == 0);
+    Assert(cbRead % DRVDISKINT_SECTOR_SIZE == 0);
+
+    uint64_t offChunkFirst = off & ~(uint64_t)(DRVDISKINT_CHUNK_SIZE - 1);
+    uint32_t cChunks       = (uint32_t)((off + cbRead - offChunkFirst + DRVDISKINT_CHUNK_SIZE - 1) / DRVDISKINT_CHUNK_SIZE);
+    uint32_t cSectors      = (uint32_t)(cbRead / DRVDISKINT_SECTOR_SIZE);
+    size_t   cbJob         = RT_ALIGN_Z(sizeof(DRVDISKVERIFYJOB), 8)
+                           + cChunks * sizeof(DRVDISKLASTWRITE)
+                           + cSectors * sizeof(uint32_t)
+                           + RT_ALIGN_32(cSectors, 32) / 8;
+    PDRVDISKVERIFYJOB pJob = (PDRVDISKVERIFYJOB)RTMemAllocZ(cbJob);
+    if (!pJob)
+        return NULL;
+
+    pJob->off         = off;
+    pJob->cbRead      = cbRead;
+    pJob->cSectors    = cSectors;
+    pJob->paLastWrite = (PDRVDISKLASTWRITE)((uint8_t *)pJob + RT_ALIGN_Z(sizeof(DRVDISKVERIFYJOB), 8));
+    pJob->pau32Crc    = (uint32_t *)&pJob->paLastWrite[cChunks];
+    pJob->pbmCheck    = &pJob->pau32Crc[cSectors];
+
+    uint64_t offCurr = off;
+    uint32_t iSectorJob = 0;
+    while (iSectorJob < cSectors)
+    {
+        uint64_t offChunk = offCurr & ~(uint64_t)(DRVDISKINT_CHUNK_SIZE - 1);
+        uint32_t iSector  = (uint32_t)((offCurr - offChunk) / DRVDISKINT_SECTOR_SIZE);
+        uint32_t cSectorsChunk = RT_MIN(cSectors - iSectorJob, DRVDISKINT_CHUNK_SECTORS - iSector);
+        PDRVDISKCHUNK pChunk = drvdiskintChunkGet(pThis, offChunk);
+
+        if (pChunk)
+        {
+            PDRVDISKLASTWRITE pLastWrite = &pJob->paLastWrite[(offChunk - offChunkFirst) / DRVDISKINT_CHUNK_SIZE];
+            pLastWrite->off = pChunk->offLastWrite;
+            pLastWrite->cb  = pChunk->cbLastWrite;
+
+            for (uint32_t i = 0; i < cSectorsChunk; i++)
             {
-                pSeg->Core.Key      = offCurr;
-                pSeg->Core.KeyLast  = offCurr + (RTFOFF)cbRange - 1;
-                pSeg->cbSeg         = cbRange;
-                pSeg->pbSeg         = (uint8_t *)RTMemAllocZ(cbRange);
-                pSeg->cIoLogEntries = cbRange / 512;
-                if (!pSeg->pbSeg)
-                    RTMemFree(pSeg);
-                else
+                if (ASMBitTest(&pChunk->bmValid[0], iSector + i))
                 {
-                    bool fInserted = RTAvlrFileOffsetInsert(pThis->pTreeSegments, &pSeg->Core);
-                    AssertMsg(fInserted, ("Bug!\n")); RT_NOREF(fInserted);
-                    fSet = true;
+                    pJob->pau32Crc[iSectorJob + i] = pChunk->au32Crc[iSector + i];
+                    ASMBitSet(pJob->pbmCheck, iSectorJob + i);
+                }
+                else if (pThis->fPrepopulateRamDisk)
+                {
+                    pJob->pau32Crc[iSectorJob + i] = pThis->u32CrcZeroSector;
+                    ASMBitSet(pJob->pbmCheck, iSectorJob + i);
                 }
             }
         }
-        else
+        else if (pThis->fPrepopulateRamDisk)
         {
-            fSet    = true;
-            offSeg  = offCurr - pSeg->Core.Key;
-            cbRange = RT_MIN(cbLeft, (size_t)(pSeg->Core.KeyLast + 1 - offCurr));
+            /* No chunk means everything should be 0 for this part. */
+            for (uint32_t i = 0; i < cSectorsChunk; i++)
+            {
+                pJob->pau32Crc[iSectorJob + i] = pThis->u32CrcZeroSector;
+                ASMBitSet(pJob->pbmCheck, iSectorJob + i);
+            }
         }
 
-        if (fSet)
-        {
-            AssertPtr(pSeg);
-            size_t cbCopied = RTSgBufCopyToBuf(&SgBuf, pSeg->pbSeg + offSeg, cbRange);
-            Assert(cbCopied == cbRange); RT_NOREF(cbCopied);
-
-            /* Update the I/O log pointers */
-            Assert(offSeg % 512 == 0);
-            Assert(cbRange % 512 == 0);
-            while (offSeg < cbRange)
-            {
-                uint32_t uSector = offSeg / 512;
-                PIOLOGENT pIoLogOld = NULL;
+        offCurr    += cSectorsChunk * DRVDISKINT_SECTOR_SIZE;
+        iSectorJob += cSectorsChunk;
+    }
 
-                AssertMsg(uSector < pSeg->cIoLogEntries, ("Internal bug!\n"));
+    return pJob;
+}
 
-                pIoLogOld = pSeg->apIoLog[uSector];
-                if (pIoLogOld)
-                {
-                    pIoLogOld->cRefs--;
-                    if (!pIoLogOld->cRefs)
-                        RTMemFree(pIoLogOld);
-                }
+/**
+ * Destroys a verification job.
+ *
+ * @returns nothing.
+ * @param   pJob     The job to destroy.
+ */
+static void drvdiskintVerifyJobDestroy(PDRVDISKVERIFYJOB pJob)
+{
+    if (pJob->pvBuf)
+        RTMemFree(pJob->pvBuf);
+    RTMemFree(pJob);
+}
 
-                pSeg->apIoLog[uSector] = pIoLogEnt;
-                pIoLogEnt->cRefs++;
+/**
+ * Checks the read data against the snapshot in the given job.
+ *
+ * @returns nothing.
+ * @param   pJob     The verification job.
+ * @param   pSgBuf   The read data.
+ */
+static void drvdiskintVerifyJobCheck(PDRVDISKVERIFYJOB pJob, PRTSGBUF pSgBuf)
+{
+    uint32_t au32Crc[DRVDISKINT_CRC_BATCH * 8];
+    uint32_t iSectorJob = 0;
+
+    /* Nothing was written to this area so far. */
+    if (ASMBitFirstSet(pJob->pbmCheck, RT_ALIGN_32(pJob->cSectors, 32)) == -1)
+        return;
+
+    while (iSectorJob < pJob->cSectors)
+    {
+        uint32_t cThisCheck = RT_MIN(pJob->cSectors - iSectorJob, RT_ELEMENTS(au32Crc));
+
+        drvdiskintSectorsCrc(pSgBuf, cThisCheck, &au32Crc[0]);
+        for (uint32_t i = 0; i < cThisCheck; i++)
+        {
+            uint32_t iSector = iSectorJob + i;
+
+            if (   ASMBitTest(pJob->pbmCheck, iSector)
+                && au32Crc[i] != pJob->pau32Crc[iSector])
+            {
+                uint64_t offSector = pJob->off + (uint64_t)iSector * DRVDISKINT_SECTOR_SIZE;
+                uint64_t offChunkFirst = pJob->off & ~(uint64_t)(DRVDISKINT_CHUNK_SIZE - 1);
+                PDRVDISKLASTWRITE pLastWrite = &pJob->paLastWrite[(offSector - offChunkFirst) / DRVDISKINT_CHUNK_SIZE];
+
+                RTMsgError("Corrupted disk at offset %llu (%u bytes in the current read buffer)!\n",
+                           offSector, iSector * DRVDISKINT_SECTOR_SIZE);
+                if (pLastWrite->cb)
+                    RTMsgError("Last write to this chunk started at offset %llu with %zu bytes\n",
+                               pLastWrite->off, pLastWrite->cb);
+                else
+                    RTMsgError("Expected the sector to be 0\n");
+                RTAssertDebugBreak();
 
-                offSeg += 512;
+                /* Report only the first corrupted sector of a read. */
+                return;
             }
         }
-        else
-            RTSgBufAdvance(&SgBuf, cbRange);
 
-        offCurr += cbRange;
-        cbLeft  -= cbRange;
+        iSectorJob += cThisCheck;
     }
-
-    return rc;
 }
 
 /**
@@ -379,93 +623,54 @@ static int drvdiskintWriteRecord(PDRVDISKINTEGRITY pThis, PCRTSGSEG paSeg, unsig
 static int drvdiskintReadVerify(PDRVDISKINTEGRITY pThis, PCRTSGSEG paSeg, unsigned cSeg,
                                 uint64_t off, size_t cbRead)
 {
-    int rc = VINF_SUCCESS;
-
     LogFlowFunc(("pThis=%#p paSeg=%#p cSeg=%u off=%llx cbRead=%u\n",
                  pThis, paSeg, cSeg, off, cbRead));
 
-    Assert(off % 512 == 0);
-    Assert(cbRead % 512 == 0);
+    PDRVDISKVERIFYJOB pJob = drvdiskintVerifyJobCreate(pThis, off, cbRead);
+    if (!pJob)
+        return VERR_NO_MEMORY;
 
-    /* Compare read data */
-    size_t cbLeft   = cbRead;
-    RTFOFF offCurr  = (RTFOFF)off;
     RTSGBUF SgBuf;
-
     RTSgBufInit(&SgBuf, paSeg, cSeg);
+    drvdiskintVerifyJobCheck(pJob, &SgBuf);
+    drvdiskintVerifyJobDestroy(pJob);
 
-    while (cbLeft)
-    {
-        PDRVDISKSEGMENT pSeg = (PDRVDISKSEGMENT)RTAvlrFileOffsetRangeGet(pThis->pTreeSegments, offCurr);
-        size_t cbRange  = 0;
-        bool fCmp       = false;
-        unsigned offSeg = 0;
-
-        if (!pSeg)
-        {
-            /* Get next segment */
-            pSeg = (PDRVDISKSEGMENT)RTAvlrFileOffsetGetBestFit(pThis->pTreeSegments, offCurr, true);
-            if (!pSeg)
-            {
-                /* No data in the tree for this read. Assume everything is ok. */
-                cbRange = cbLeft;
-            }
-            else if (offCurr + (RTFOFF)cbLeft <= pSeg->Core.Key)
-                cbRange = cbLeft;
-            else
-                cbRange = pSeg->Core.Key - offCurr;
-
-            if (pThis->fPrepopulateRamDisk)
-            {
-                /* No segment means everything should be 0 for this part. */
-                if (!RTSgBufIsZero(&SgBuf, cbRange))
-                {
-                    RTMsgError("Corrupted disk at offset %llu (expected everything to be 0)!\n",
-                               offCurr);
-                    RTAssertDebugBreak();
-                }
-            }
-        }
-        else
-        {
-            fCmp    = true;
-            offSeg  = offCurr - pSeg->Core.Key;
-            cbRange = RT_MIN(cbLeft, (size_t)(pSeg->Core.KeyLast + 1 - offCurr));
-        }
+    return VINF_SUCCESS;
+}
 
-        if (fCmp)
-        {
-            RTSGSEG Seg;
-            RTSGBUF SgBufCmp;
-            size_t cbOff = 0;
+/**
+ * Hands a completed read of the extended media interface to the verifier
+ * thread, taking over the data buffer of the request.
+ *
+ * The read is verified synchronously if too many jobs are pending already.
+ *
+ * @returns VBox status code.
+ * @param   pThis    Disk integrity driver instance data.
+ * @param   pIoReq   The completed read request.
+ */
+static int drvdiskintReadVerifyAsync(PDRVDISKINTEGRITY pThis, PDRVDISKAIOREQ pIoReq)
+{
+    if (ASMAtomicReadU32(&pThis->cVerifyJobsPending) >= DRVDISKINT_VERIFY_JOBS_MAX)
+        return drvdiskintReadVerify(pThis, &pIoReq->IoSeg, 1, pIoReq->off, pIoReq->cbTransfer);
 
-            Seg.cbSeg = cbRange;
-            Seg.pvSeg = pSeg->pbSeg + offSeg;
+    PDRVDISKVERIFYJOB pJob = drvdiskintVerifyJobCreate(pThis, pIoReq->off, pIoReq->cbTransfer);
+    if (!pJob)
+        return VERR_NO_MEMORY;
 
-            RTSgBufInit(&SgBufCmp, &Seg, 1);
-            if (RTSgBufCmpEx(&SgBuf, &SgBufCmp, cbRange, &cbOff, true))
-            {
-                /* Corrupted disk, print I/O log entry of the last write which accessed this range. */
-                uint32_t cSector = (offSeg + cbOff) / 512;
-                AssertMsg(cSector < pSeg->cIoLogEntries, ("Internal bug!\n"));
+    pJob->pvBuf = pIoReq->IoSeg.pvSeg;
+    pIoReq->IoSeg.pvSeg = NULL;
+    pIoReq->IoSeg.cbSeg = 0;
 
-                RTMsgError("Corrupted disk at offset %llu (%u bytes in the current read buffer)!\n",
-                           offCurr + cbOff, cbOff);
-                RTMsgError("Last write to this sector started at offset %llu with %u bytes (%u references to this log entry)\n",
-                           pSeg->apIoLog[cSector]->off,
-                           pSeg->apIoLog[cSector]->cbWrite,
-                           pSeg->apIoLog[cSector]->cRefs);
-                RTAssertDebugBreak();
-            }
-        }
-        else
-            RTSgBufAdvance(&SgBuf, cbRange);
+    ASMAtomicIncU32(&pThis->cVerifyJobsPending);
 
-        offCurr += cbRange;
-        cbLeft  -= cbRange;
-    }
+    PDRVDISKVERIFYJOB pHead;
+    do
+    {
+        pHead = ASMAtomicReadPtrT(&pThis->pVerifyJobsHead, PDRVDISKVERIFYJOB);
+        pJob->pNext = pHead;
+    } while (!ASMAtomicCmpXchgPtr(&pThis->pVerifyJobsHead, pJob, pHead));
 
-    return rc;
+    return RTSemEventSignal(pThis->hEvtVerify);
 }
 
 /**
@@ -478,136 +683,56 @@ static int drvdiskintReadVerify(PDRVDISKINTEGRITY pThis, PCRTSGSEG paSeg, unsign
  */
 static int drvdiskintDiscardRecords(PDRVDISKINTEGRITY pThis, PCRTRANGE paRanges, unsigned cRanges)
 {
-    int rc = VINF_SUCCESS;
-
     LogFlowFunc(("pThis=%#p paRanges=%#p cRanges=%u\n", pThis, paRanges, cRanges));
 
     for (unsigned i = 0; i < cRanges; i++)
     {
-        uint64_t offStart = paRanges[i].offStart;
-        size_t cbLeft = paRanges[i].cbRange;
+        uint64_t offCurr = paRanges[i].offStart;
+        size_t   cbLeft  = paRanges[i].cbRange;
+
+        LogFlowFunc(("Discarding off=%llu cbRange=%zu\n", offCurr, cbLeft));
 
-        LogFlowFunc(("Discarding off=%llu cbRange=%zu\n", offStart, cbLeft));
+        Assert(!(offCurr % DRVDISKINT_SECTOR_SIZE));
+        Assert(!(cbLeft % DRVDISKINT_SECTOR_SIZE));
 
         while (cbLeft)
         {
-            size_t cbRange;
-            PDRVDISKSEGMENT pSeg = (PDRVDISKSEGMENT)RTAvlrFileOffsetRangeGet(pThis->pTreeSegments, offStart);
+            uint64_t offChunk = offCurr & ~(uint64_t)(DRVDISKINT_CHUNK_SIZE - 1);
+            uint32_t iSector  = (uint32_t)((offCurr - offChunk) / DRVDISKINT_SECTOR_SIZE);
+            size_t   cbRange  = RT_MIN(cbLeft, (size_t)(DRVDISKINT_CHUNK_SECTORS - iSector) * DRVDISKINT_SECTOR_SIZE);
+            PDRVDISKCHUNK pChunk = drvdiskintChunkGet(pThis, offChunk);
 
-            if (!pSeg)
+            if (pChunk)
             {
-                /* Get next segment */
-                pSeg = (PDRVDISKSEGMENT)RTAvlrFileOffsetGetBestFit(pThis->pTreeSegments, offStart, true);
-                if (   !pSeg
-                    || (RTFOFF)offStart + (RTFOFF)cbLeft <= pSeg->Core.Key)
-                    cbRange = cbLeft;
-                else
-                    cbRange = pSeg->Core.Key - offStart;
+                for (uint32_t idx = iSector; idx < iSector + cbRange / DRVDISKINT_SECTOR_SIZE; idx++)
+                    if (ASMBitTestAndClear(&pChunk->bmValid[0], idx))
+                        pChunk->cSectorsValid--;
 
-                Assert(!(cbRange % 512));
+                if (!pChunk->cSectorsValid)
+                {
+                    /* Just free the whole chunk. */
+                    LogFlowFunc(("Freeing whole chunk pChunk=%#p\n", pChunk));
+                    RTAvlrFileOffsetRemove(pThis->pTreeChunks, pChunk->Core.Key);
+                    drvdiskintChunkFree(pThis, pChunk);
+                }
             }
             else
             {
-                size_t cbPreLeft, cbPostLeft;
-
-                cbRange    = RT_MIN(cbLeft, pSeg->Core.KeyLast - offStart + 1);
-                cbPreLeft  = offStart - pSeg->Core.Key;
-                cbPostLeft = pSeg->cbSeg - cbRange - cbPreLeft;
-
-                Assert(!(cbRange % 512));
-                Assert(!(cbPreLeft % 512));
-                Assert(!(cbPostLeft % 512));
-
-                LogFlowFunc(("cbRange=%zu cbPreLeft=%zu cbPostLeft=%zu\n",
-                             cbRange, cbPreLeft, cbPostLeft));
-
-                RTAvlrFileOffsetRemove(pThis->pTreeSegments, pSeg->Core.Key);
-
-                if (!cbPreLeft && !cbPostLeft)
-                {
-                    /* Just free the whole segment. */
-                    LogFlowFunc(("Freeing whole segment pSeg=%#p\n", pSeg));
-                    RTMemFree(pSeg->pbSeg);
-                    for (unsigned idx = 0; idx < pSeg->cIoLogEntries; idx++)
-                        drvdiskintIoLogEntryRelease(pSeg->apIoLog[idx]);
-                    RTMemFree(pSeg);
-                }
-                else if (cbPreLeft && !cbPostLeft)
-                {
-                    /* Realloc to new size and insert. */
-                    LogFlowFunc(("Realloc segment pSeg=%#p\n", pSeg));
-                    pSeg->pbSeg = (uint8_t *)RTMemRealloc(pSeg->pbSeg, cbPreLeft);
-                    for (unsigned idx = cbPreLeft / 512; idx < pSeg->cIoLogEntries; idx++)
-                        drvdiskintIoLogEntryRelease(pSeg->apIoLog[idx]);
-                    pSeg = (PDRVDISKSEGMENT)RTMemRealloc(pSeg, RT_OFFSETOF(DRVDISKSEGMENT, apIoLog[cbPreLeft / 512]));
-                    pSeg->Core.KeyLast = pSeg->Core.Key + cbPreLeft - 1;
-                    pSeg->cbSeg = cbPreLeft;
-                    pSeg->cIoLogEntries = cbPreLeft / 512;
-                    bool fInserted = RTAvlrFileOffsetInsert(pThis->pTreeSegments, &pSeg->Core);
-                    Assert(fInserted); RT_NOREF(fInserted);
-                }
-                else if (!cbPreLeft && cbPostLeft)
-                {
-                    /* Move data to the front and realloc. */
-                    LogFlowFunc(("Move data and realloc segment pSeg=%#p\n", pSeg));
-                    memmove(pSeg->pbSeg, pSeg->pbSeg + cbRange, cbPostLeft);
-                    for (unsigned idx = 0; idx < cbRange / 512; idx++)
-                        drvdiskintIoLogEntryRelease(pSeg->apIoLog[idx]);
-                    for (unsigned idx = 0; idx < cbPostLeft /512; idx++)
-                        pSeg->apIoLog[idx] = pSeg->apIoLog[(cbRange / 512) + idx];
-                    pSeg = (PDRVDISKSEGMENT)RTMemRealloc(pSeg, RT_OFFSETOF(DRVDISKSEGMENT, apIoLog[cbPostLeft / 512]));
-                    pSeg->pbSeg = (uint8_t *)RTMemRealloc(pSeg->pbSeg, cbPostLeft);
-                    pSeg->Core.Key += cbRange;
-                    pSeg->cbSeg = cbPostLeft;
-                    pSeg->cIoLogEntries = cbPostLeft / 512;
-                    bool fInserted = RTAvlrFileOffsetInsert(pThis->pTreeSegments, &pSeg->Core);
-                    Assert(fInserted); RT_NOREF(fInserted);
-                }
+                /* Skip everything up to the next chunk in one go, discards can be huge. */
+                pChunk = (PDRVDISKCHUNK)RTAvlrFileOffsetGetBestFit(pThis->pTreeChunks, (RTFOFF)offCurr, true);
+                if (   !pChunk
+                    || offCurr + cbLeft <= (uint64_t)pChunk->Core.Key)
+                    cbRange = cbLeft;
                 else
-                {
-                    /* Split the segment into 2 new segments. */
-                    LogFlowFunc(("Split segment pSeg=%#p\n", pSeg));
-                    PDRVDISKSEGMENT pSegPost = (PDRVDISKSEGMENT)RTMemAllocZ(RT_OFFSETOF(DRVDISKSEGMENT, apIoLog[cbPostLeft / 512]));
-                    if (pSegPost)
-                    {
-                        pSegPost->Core.Key      = pSeg->Core.Key + cbPreLeft + cbRange;
-                        pSegPost->Core.KeyLast  = pSeg->Core.KeyLast;
-                        pSegPost->cbSeg         = cbPostLeft;
-                        pSegPost->pbSeg         = (uint8_t *)RTMemAllocZ(cbPostLeft);
-                        pSegPost->cIoLogEntries = cbPostLeft / 512;
-                        if (!pSegPost->pbSeg)
-                            RTMemFree(pSegPost);
-                        else
-                        {
-                            memcpy(pSegPost->pbSeg, pSeg->pbSeg + cbPreLeft + cbRange, cbPostLeft);
-                            for (unsigned idx = 0; idx < cbPostLeft / 512; idx++)
-                                pSegPost->apIoLog[idx] = pSeg->apIoLog[((cbPreLeft + cbRange) / 512) + idx];
-
-                            bool fInserted = RTAvlrFileOffsetInsert(pThis->pTreeSegments, &pSegPost->Core);
-                            Assert(fInserted); RT_NOREF(fInserted);
-                        }
-                    }
-
-                    /* Shrink the current segment. */
-                    pSeg->pbSeg = (uint8_t *)RTMemRealloc(pSeg->pbSeg, cbPreLeft);
-                    for (unsigned idx = cbPreLeft / 512; idx < (cbPreLeft + cbRange) / 512; idx++)
-                        drvdiskintIoLogEntryRelease(pSeg->apIoLog[idx]);
-                    pSeg = (PDRVDISKSEGMENT)RTMemRealloc(pSeg, RT_OFFSETOF(DRVDISKSEGMENT, apIoLog[cbPreLeft / 512]));
-                    pSeg->Core.KeyLast = pSeg->Core.Key + cbPreLeft - 1;
-                    pSeg->cbSeg = cbPreLeft;
-                    pSeg->cIoLogEntries = cbPreLeft / 512;
-                    bool fInserted = RTAvlrFileOffsetInsert(pThis->pTreeSegments, &pSeg->Core);
-                    Assert(fInserted); RT_NOREF(fInserted);
-                } /* if (cbPreLeft && cbPostLeft) */
+                    cbRange = (size_t)(pChunk->Core.Key - offCurr);
             }
 
-            offStart += cbRange;
-            cbLeft   -= cbRange;
+            offCurr += cbRange;
+            cbLeft  -= cbRange;
         }
     }
 
-    LogFlowFunc(("returns rc=%Rrc\n", rc));
-    return rc;
+    return VINF_SUCCESS;
 }
 
 /**
@@ -692,6 +817,62 @@ static DECLCALLBACK(int) drvdiskIntIoReqExpiredCheck(RTTHREAD pThread, void *pvU
     return VINF_SUCCESS;
 }
 
+/**
+ * Thread verifying the reads queued by drvdiskintReadVerifyAsync().
+ *
+ * @returns IPRT status code.
+ * @param   hThread    Thread handle.
+ * @param   pvUser     Opaque user data.
+ */
+static DECLCALLBACK(int) drvdiskintVerifyThread(RTTHREAD hThread, void *pvUser)
+{
+    PDRVDISKINTEGRITY pThis = (PDRVDISKINTEGRITY)pvUser;
+
+    RT_NOREF(hThread);
+
+    for (;;)
+    {
+        PDRVDISKVERIFYJOB pJobs = ASMAtomicXchgPtrT(&pThis->pVerifyJobsHead, NULL, PDRVDISKVERIFYJOB);
+        if (!pJobs)
+        {
+            /* Everything queued is processed before the thread terminates. */
+            if (!ASMAtomicReadBool(&pThis->fVerifyRunning))
+                break;
+
+            int rc = RTSemEventWait(pThis->hEvtVerify, RT_INDEFINITE_WAIT);
+            Assert(RT_SUCCESS(rc) || rc == VERR_INTERRUPTED); RT_NOREF(rc);
+            continue;
+        }
+
+        /* Reverse the list to process the jobs in the order they were queued. */
+        PDRVDISKVERIFYJOB pJobsRev = NULL;
+        while (pJobs)
+        {
+            PDRVDISKVERIFYJOB pNext = pJobs->pNext;
+            pJobs->pNext = pJobsRev;
+            pJobsRev = pJobs;
+            pJobs = pNext;
+        }
+
+        while (pJobsRev)
+        {
+            PDRVDISKVERIFYJOB pJob = pJobsRev;
+            pJobsRev = pJob->pNext;
+
+            RTSGSEG Seg;
+            RTSGBUF SgBuf;
+            Seg.pvSeg = pJob->pvBuf;
+            Seg.cbSeg = pJob->cbRead;
+            RTSgBufInit(&SgBuf, &Seg, 1);
+            drvdiskintVerifyJobCheck(pJob, &SgBuf);
+            drvdiskintVerifyJobDestroy(pJob);
+            ASMAtomicDecU32(&pThis->cVerifyJobsPending);
+        }
+    }
+
+    return VINF_SUCCESS;
+}
+
 /**
  * Verify a completed read after write request.
  *
@@ -998,7 +1179,11 @@ static DECLCALLBACK(int) drvdiskintIoReqCompleteNotify(PPDMIMEDIAEXPORT pInterfa
     if (RT_SUCCESS(rcReq) && pThis->fCheckConsistency)
     {
         if (pIoReq->enmTxDir == DRVDISKAIOTXDIR_READ)
-            rc = drvdiskintReadVerify(pThis, &pIoReq->IoSeg, 1, pIoReq->off, pIoReq->cbTransfer);
+        {
+            /* The asynchronous verification takes over the buffer, so it is queued last. */
+            if (!pThis->fVerifyAsync)
+                rc = drvdiskintReadVerify(pThis, &pIoReq->IoSeg, 1, pIoReq->off, pIoReq->cbTransfer);
+        }
         else if (   pIoReq->enmTxDir == DRVDISKAIOTXDIR_WRITE
                  && !pThis->fRecordWriteBeforeCompletion)
             rc = drvdiskintWriteRecord(pThis, &pIoReq->IoSeg, 1, pIoReq->off, pIoReq->cbTransfer);
@@ -1051,6 +1236,15 @@ static DECLCALLBACK(int) drvdiskintIoReqCompleteNotify(PPDMIMEDIAEXPORT pInterfa
         AssertRC(rc2);
     }
 
+    if (   RT_SUCCESS(rcReq)
+        && pThis->fCheckConsistency
+        && pThis->fVerifyAsync
+        && pIoReq->enmTxDir == DRVDISKAIOTXDIR_READ)
+    {
+        rc = drvdiskintReadVerifyAsync(pThis, pIoReq);
+        AssertRC(rc);
+    }
+
     if (   pThis->fReadAfterWrite
         && pIoReq->enmTxDir == DRVDISKAIOTXDIR_WRITE)
     {
@@ -1296,7 +1490,8 @@ static DECLCALLBACK(int) drvdiskintIoReqRead(PPDMIMEDIAEX pInterface, PDMMEDIAEX
     if (rc == VINF_SUCCESS)
     {
         /* Verify the read now. */
-        if (pThis->fCheckConsistency)
+        if (   pThis->fCheckConsistency
+            && !pThis->fVerifyAsync)
         {
             int rc2 = drvdiskintReadVerify(pThis, &pIoReq->IoSeg, 1, off, cbRead);
             AssertRC(rc2);
@@ -1312,6 +1507,13 @@ static DECLCALLBACK(int) drvdiskintIoReqRead(PPDMIMEDIAEX pInterface, PDMMEDIAEX
             AssertRC(rc2);
         }
 
+        if (   pThis->fCheckConsistency
+            && pThis->fVerifyAsync)
+        {
+            int rc2 = drvdiskintReadVerifyAsync(pThis, pIoReq);
+            AssertRC(rc2);
+        }
+
         if (pThis->fTraceRequests)
             drvdiskintIoReqRemove(pThis, pIoReq);
     }
@@ -1523,12 +1725,9 @@ static DECLCALLBACK(void *)  drvdiskintQueryInterface(PPDMIBASE pInterface, cons
 
 static DECLCALLBACK(int) drvdiskintTreeDestroy(PAVLRFOFFNODECORE pNode, void *pvUser)
 {
-    PDRVDISKSEGMENT pSeg = (PDRVDISKSEGMENT)pNode;
-
-    RT_NOREF(pvUser);
+    PDRVDISKINTEGRITY pThis = (PDRVDISKINTEGRITY)pvUser;
 
-    RTMemFree(pSeg->pbSeg);
-    RTMemFree(pSeg);
+    drvdiskintChunkFree(pThis, (PDRVDISKCHUNK)pNode);
     return VINF_SUCCESS;
 }
 
@@ -1539,10 +1738,35 @@ static DECLCALLBACK(void) drvdiskintDestruct(PPDMDRVINS pDrvIns)
 {
     PDRVDISKINTEGRITY pThis = PDMINS_2_DATA(pDrvIns, PDRVDISKINTEGRITY);
 
-    if (pThis->pTreeSegments)
+    if (pThis->hThreadVerify != NIL_RTTHREAD)
+    {
+        /* The thread processes all outstanding jobs before it terminates. */
+        ASMAtomicWriteBool(&pThis->fVerifyRunning, false);
+        RTSemEventSignal(pThis->hEvtVerify);
+        int rc = RTThreadWait(pThis->hThreadVerify, RT_INDEFINITE_WAIT, NULL);
+        AssertRC(rc);
+        pThis->hThreadVerify = NIL_RTTHREAD;
+    }
+
+    if (pThis->hEvtVerify != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(pThis->hEvtVerify);
+        pThis->hEvtVerify = NIL_RTSEMEVENT;
+    }
+
+    if (pThis->pTreeChunks)
     {
-        RTAvlrFileOffsetDestroy(pThis->pTreeSegments, drvdiskintTreeDestroy, NULL);
-        RTMemFree(pThis->pTreeSegments);
+        LogRel(("DiskIntegrity: %u chunks tracking %llu MB allocated at the end\n",
+                pThis->cChunks, (uint64_t)pThis->cChunks * DRVDISKINT_CHUNK_SIZE / _1M));
+        RTAvlrFileOffsetDestroy(pThis->pTreeChunks, drvdiskintTreeDestroy, pThis);
+        RTMemFree(pThis->pTreeChunks);
+        pThis->pTreeChunks = NULL;
+    }
+
+    if (pThis->hMemCacheChunks != NIL_RTMEMCACHE)
+    {
+        RTMemCacheDestroy(pThis->hMemCacheChunks);
+        pThis->hMemCacheChunks = NIL_RTMEMCACHE;
     }
 
     if (pThis->fTraceRequests)
@@ -1592,7 +1816,8 @@ static DECLCALLBACK(int) drvdiskintConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg,
                                     "PrepopulateRamDisk\0"
                                     "ReadAfterWrite\0"
                                     "RecordWriteBeforeCompletion\0"
-                                    "ValidateMemoryBuffers\0"))
+                                    "ValidateMemoryBuffers\0"
+                                    "VerifyAsync\0"))
         return VERR_PDM_DRVINS_UNKNOWN_CFG_VALUES;
 
     rc = CFGMR3QueryBoolDef(pCfg, "CheckConsistency", &pThis->fCheckConsistency, false);
@@ -1615,6 +1840,8 @@ static DECLCALLBACK(int) drvdiskintConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg,
     AssertRC(rc);
     rc = CFGMR3QueryBoolDef(pCfg, "ValidateMemoryBuffers", &pThis->fValidateMemBufs, true);
     AssertRC(rc);
+    rc = CFGMR3QueryBoolDef(pCfg, "VerifyAsync", &pThis->fVerifyAsync, false);
+    AssertRC(rc);
 
     char *pszIoLogFilename = NULL;
     rc = CFGMR3QueryStringAlloc(pCfg, "IoLog", &pszIoLogFilename);
@@ -1624,6 +1851,9 @@ static DECLCALLBACK(int) drvdiskintConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg,
      * Initialize most of the data members.
      */
     pThis->pDrvIns                       = pDrvIns;
+    pThis->hMemCacheChunks               = NIL_RTMEMCACHE;
+    pThis->hThreadVerify                 = NIL_RTTHREAD;
+    pThis->hEvtVerify                    = NIL_RTSEMEVENT;
 
     /* IBase. */
     pDrvIns->IBase.pfnQueryInterface     = drvdiskintQueryInterface;
@@ -1701,10 +1931,38 @@ static DECLCALLBACK(int) drvdiskintConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg,
     if (pThis->fCheckConsistency)
     {
         /* Create the AVL tree. */
-        pThis->pTreeSegments = (PAVLRFOFFTREE)RTMemAllocZ(sizeof(AVLRFOFFTREE));
-        if (!pThis->pTreeSegments)
-            rc = VERR_NO_MEMORY;
+        pThis->pTreeChunks = (PAVLRFOFFTREE)RTMemAllocZ(sizeof(AVLRFOFFTREE));
+        if (!pThis->pTreeChunks)
+            return VERR_NO_MEMORY;
+
+        rc = RTMemCacheCreate(&pThis->hMemCacheChunks, sizeof(DRVDISKCHUNK), 0, UINT32_MAX,
+                              NULL, NULL, NULL, 0);
+        if (RT_FAILURE(rc))
+            return PDMDRV_SET_ERROR(pDrvIns, rc, N_("DiskIntegrity: Failed to create the chunk cache"));
+
+        uint8_t abZero[DRVDISKINT_SECTOR_SIZE];
+        RT_ZERO(abZero);
+        pThis->u32CrcZeroSector = RTCrc32C(abZero, sizeof(abZero));
+
+        /* The asynchronous verification needs a private buffer, so it works with the extended media interface only. */
+        if (   pThis->fVerifyAsync
+            && pThis->pDrvMediaEx)
+        {
+            rc = RTSemEventCreate(&pThis->hEvtVerify);
+            if (RT_FAILURE(rc))
+                return rc;
+
+            pThis->fVerifyRunning = true;
+            rc = RTThreadCreate(&pThis->hThreadVerify, drvdiskintVerifyThread, pThis,
+                                0, RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "DiskIntVerify");
+            if (RT_FAILURE(rc))
+                return PDMDRV_SET_ERROR(pDrvIns, rc, N_("DiskIntegrity: Failed to create the verifier thread"));
+        }
+        else
+            pThis->fVerifyAsync = false;
     }
+    else
+        pThis->fVerifyAsync = false;
 
     if (pThis->fTraceRequests)
     {
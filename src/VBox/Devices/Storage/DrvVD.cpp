@@ -101,6 +101,10 @@ extern bool DevINIPConfigured(void);
 #define DRVVD_IOREQ_SAVED_STATE_VERSION UINT32_C(1)
 /** Maximum number of request errors in the release log before muting. */
 #define DRVVD_MAX_LOG_REL_ERRORS        100
+/** Maximum amount of dirty data the destage thread writes in one go. */
+#define DRVVD_CACHE_DESTAGE_MAX         _8M
+/** How long the destage thread sleeps when the cache is clean, in milliseconds. */
+#define DRVVD_CACHE_DESTAGE_INTERVAL_MS 1000
 
 /** Forward declaration for the dis kcontainer. */
 typedef struct VBOXDISK *PVBOXDISK;
@@ -134,6 +138,9 @@ typedef struct DRVVDSTORAGEBACKEND
     PPDMASYNCCOMPLETIONTEMPLATE pTemplate;
     /** Event semaphore for synchronous operations. */
     RTSEMEVENT                  EventSem;
+    /** Serializes synchronous operations, the cache destage thread issues them
+     * concurrently with the EMT. */
+    RTCRITSECT                  CritSectSync;
     /** Flag whether a synchronous operation is currently pending. */
     volatile bool               fSyncIoPending;
     /** Return code of the last completed request. */
@@ -203,6 +210,9 @@ typedef struct PDMMEDIAEXIOREQINT
             size_t                        cbReqLeft;
             /** Size of the allocated I/O buffer. */
             size_t                        cbIoBuf;
+            /** Flag whether the S/G buffer references the memory of the request owner
+             * directly instead of a buffer allocated from the I/O buffer manager. */
+            bool                          fDirectBuf;
             /** I/O buffer descriptor. */
             IOBUFDESC                     IoBuf;
         } ReadWrite;
@@ -393,6 +403,20 @@ typedef struct VBOXDISK
     /** Number of errors logged so far. */
     unsigned                 cErrors;
     /** @} */
+
+    /** @name Write-back cache support specific members.
+     * @{ */
+    /** Thread writing dirty data from the cache to the image. */
+    PPDMTHREAD               pThreadDestage;
+    /** Event semaphore the destage thread waits on. */
+    RTSEMEVENT               hEvtDestage;
+    /** Cache statistics, updated by the destage thread. */
+    VDCACHESTATS             CacheStats;
+    /** Read hit ratio of the cache in percent. */
+    uint32_t                 uCacheReadHitRatio;
+    /** Flag whether the destage thread logged an error already. */
+    bool                     fDestageErrorLogged;
+    /** @} */
 } VBOXDISK;
 
 
@@ -579,6 +603,8 @@ static DECLCALLBACK(int) drvvdAsyncIOOpen(void *pvUser, const char *pszLocation,
         pStorageBackend->pfnCompleted   = pfnCompleted;
 
         rc = RTSemEventCreate(&pStorageBackend->EventSem);
+        if (RT_SUCCESS(rc))
+            rc = RTCritSectInit(&pStorageBackend->CritSectSync);
         if (RT_SUCCESS(rc))
         {
             rc = PDMDrvHlpAsyncCompletionTemplateCreate(pThis->pDrvIns, &pStorageBackend->pTemplate,
@@ -619,8 +645,10 @@ static DECLCALLBACK(int) drvvdAsyncIOOpen(void *pvUser, const char *pszLocation,
 
                 PDMR3AsyncCompletionTemplateDestroy(pStorageBackend->pTemplate);
             }
-            RTSemEventDestroy(pStorageBackend->EventSem);
+            RTCritSectDelete(&pStorageBackend->CritSectSync);
         }
+        if (pStorageBackend->EventSem != NIL_RTSEMEVENT)
+            RTSemEventDestroy(pStorageBackend->EventSem);
         RTMemFree(pStorageBackend);
     }
     else
@@ -643,6 +671,7 @@ static DECLCALLBACK(int) drvvdAsyncIOClose(void *pvUser, void *pStorage)
 
     PDMR3AsyncCompletionEpClose(pStorageBackend->pEndpoint);
     PDMR3AsyncCompletionTemplateDestroy(pStorageBackend->pTemplate);
+    RTCritSectDelete(&pStorageBackend->CritSectSync);
     RTSemEventDestroy(pStorageBackend->EventSem);
     RTMemFree(pStorageBackend);
     return VINF_SUCCESS;;
@@ -656,6 +685,7 @@ static DECLCALLBACK(int) drvvdAsyncIOReadSync(void *pvUser, void *pStorage, uint
     RTSGSEG DataSeg;
     PPDMASYNCCOMPLETIONTASK pTask;
 
+    RTCritSectEnter(&pStorageBackend->CritSectSync);
     bool fOld = ASMAtomicXchgBool(&pStorageBackend->fSyncIoPending, true);
     Assert(!fOld); NOREF(fOld);
     DataSeg.cbSeg = cbRead;
@@ -663,7 +693,11 @@ static DECLCALLBACK(int) drvvdAsyncIOReadSync(void *pvUser, void *pStorage, uint
 
     int rc = PDMR3AsyncCompletionEpRead(pStorageBackend->pEndpoint, uOffset, &DataSeg, 1, cbRead, NULL, &pTask);
     if (RT_FAILURE(rc))
+    {
+        ASMAtomicXchgBool(&pStorageBackend->fSyncIoPending, false);
+        RTCritSectLeave(&pStorageBackend->CritSectSync);
         return rc;
+    }
 
     if (rc == VINF_AIO_TASK_PENDING)
     {
@@ -677,7 +711,9 @@ static DECLCALLBACK(int) drvvdAsyncIOReadSync(void *pvUser, void *pStorage, uint
     if (pcbRead)
         *pcbRead = cbRead;
 
-    return pStorageBackend->rcReqLast;
+    rc = pStorageBackend->rcReqLast;
+    RTCritSectLeave(&pStorageBackend->CritSectSync);
+    return rc;
 }
 
 static DECLCALLBACK(int) drvvdAsyncIOWriteSync(void *pvUser, void *pStorage, uint64_t uOffset,
@@ -688,6 +724,7 @@ static DECLCALLBACK(int) drvvdAsyncIOWriteSync(void *pvUser, void *pStorage, uin
     RTSGSEG DataSeg;
     PPDMASYNCCOMPLETIONTASK pTask;
 
+    RTCritSectEnter(&pStorageBackend->CritSectSync);
     bool fOld = ASMAtomicXchgBool(&pStorageBackend->fSyncIoPending, true);
     Assert(!fOld); NOREF(fOld);
     DataSeg.cbSeg = cbWrite;
@@ -695,7 +732,11 @@ static DECLCALLBACK(int) drvvdAsyncIOWriteSync(void *pvUser, void *pStorage, uin
 
     int rc = PDMR3AsyncCompletionEpWrite(pStorageBackend->pEndpoint, uOffset, &DataSeg, 1, cbWrite, NULL, &pTask);
     if (RT_FAILURE(rc))
+    {
+        ASMAtomicXchgBool(&pStorageBackend->fSyncIoPending, false);
+        RTCritSectLeave(&pStorageBackend->CritSectSync);
         return rc;
+    }
 
     if (rc == VINF_AIO_TASK_PENDING)
     {
@@ -709,7 +750,9 @@ static DECLCALLBACK(int) drvvdAsyncIOWriteSync(void *pvUser, void *pStorage, uin
     if (pcbWritten)
         *pcbWritten = cbWrite;
 
-    return pStorageBackend->rcReqLast;
+    rc = pStorageBackend->rcReqLast;
+    RTCritSectLeave(&pStorageBackend->CritSectSync);
+    return rc;
 }
 
 static DECLCALLBACK(int) drvvdAsyncIOFlushSync(void *pvUser, void *pStorage)
@@ -720,12 +763,17 @@ static DECLCALLBACK(int) drvvdAsyncIOFlushSync(void *pvUser, void *pStorage)
 
     LogFlowFunc(("pvUser=%#p pStorage=%#p\n", pvUser, pStorage));
 
+    RTCritSectEnter(&pStorageBackend->CritSectSync);
     bool fOld = ASMAtomicXchgBool(&pStorageBackend->fSyncIoPending, true);
     Assert(!fOld); NOREF(fOld);
 
     int rc = PDMR3AsyncCompletionEpFlush(pStorageBackend->pEndpoint, NULL, &pTask);
     if (RT_FAILURE(rc))
+    {
+        ASMAtomicXchgBool(&pStorageBackend->fSyncIoPending, false);
+        RTCritSectLeave(&pStorageBackend->CritSectSync);
         return rc;
+    }
 
     if (rc == VINF_AIO_TASK_PENDING)
     {
@@ -737,7 +785,9 @@ static DECLCALLBACK(int) drvvdAsyncIOFlushSync(void *pvUser, void *pStorage)
     else
         ASMAtomicXchgBool(&pStorageBackend->fSyncIoPending, false);
 
-    return pStorageBackend->rcReqLast;
+    rc = pStorageBackend->rcReqLast;
+    RTCritSectLeave(&pStorageBackend->CritSectSync);
+    return rc;
 }
 
 static DECLCALLBACK(int) drvvdAsyncIOReadAsync(void *pvUser, void *pStorage, uint64_t uOffset,
@@ -808,6 +858,14 @@ static DECLCALLBACK(int) drvvdAsyncIOSetAllocationSize(void *pvUser, void *pvSto
     return VERR_NOT_SUPPORTED;
 }
 
+static DECLCALLBACK(int) drvvdAsyncIOPunchHole(void *pvUser, void *pStorage, uint64_t off, uint64_t cb)
+{
+    RT_NOREF(pvUser);
+    PDRVVDSTORAGEBACKEND pStorageBackend = (PDRVVDSTORAGEBACKEND)pStorage;
+
+    return PDMR3AsyncCompletionEpPunchHole(pStorageBackend->pEndpoint, off, cb);
+}
+
 #endif /* VBOX_WITH_PDM_ASYNC_COMPLETION */
 
 
@@ -2625,6 +2683,10 @@ DECLINLINE(int) drvvdMediaExIoReqBufSync(PVBOXDISK pThis, PPDMMEDIAEXIOREQINT pI
     Assert(pIoReq->enmType == PDMMEDIAEXIOREQTYPE_READ || pIoReq->enmType == PDMMEDIAEXIOREQTYPE_WRITE);
     Assert(pIoReq->ReadWrite.cbIoBuf > 0);
 
+    /* Nothing to do if the data goes straight to/from the memory of the request owner. */
+    if (pIoReq->ReadWrite.fDirectBuf)
+        return VINF_SUCCESS;
+
     /* Make sure the buffer is reset. */
     RTSgBufReset(&pIoReq->ReadWrite.IoBuf.SgBuf);
 
@@ -2901,6 +2963,33 @@ DECLINLINE(int) drvvdMediaExIoReqBufAlloc(PVBOXDISK pThis, PPDMMEDIAEXIOREQINT p
 {
     LogFlowFunc(("pThis=%#p pIoReq=%#p cb=%zu\n", pThis, pIoReq, cb));
 
+    /*
+     * Try to use the memory of the request owner directly first. This is only done for
+     * asynchronous requests without encryption, the synchronous path can only deal with
+     * a single segment and the crypto filter works in place on the buffer.
+     */
+    pIoReq->ReadWrite.fDirectBuf = false;
+    if (   pThis->pDrvMediaExPort->pfnIoReqQueryBuf
+        && pThis->fAsyncIOSupported
+        && !pThis->pCfgCrypto
+        && !(pIoReq->fFlags & PDMIMEDIAEX_F_SYNC))
+    {
+        PCRTSGSEG paSegs = NULL;
+        unsigned  cSegs  = 0;
+        int rc = pThis->pDrvMediaExPort->pfnIoReqQueryBuf(pThis->pDrvMediaExPort, pIoReq, &pIoReq->abAlloc[0],
+                                                          &paSegs, &cSegs);
+        if (RT_SUCCESS(rc))
+        {
+            Assert(cSegs > 0 && VALID_PTR(paSegs));
+            RTSgBufInit(&pIoReq->ReadWrite.IoBuf.SgBuf, paSegs, cSegs);
+            pIoReq->ReadWrite.cbIoBuf    = cb;
+            pIoReq->ReadWrite.fDirectBuf = true;
+            LogFlowFunc(("Using %u segments of the request owner directly\n", cSegs));
+            return VINF_SUCCESS;
+        }
+        Assert(rc == VERR_NOT_SUPPORTED);
+    }
+
     int rc = IOBUFMgrAllocBuf(pThis->hIoBufMgr, &pIoReq->ReadWrite.IoBuf, cb, &pIoReq->ReadWrite.cbIoBuf);
     if (rc == VERR_NO_MEMORY)
     {
@@ -3166,8 +3255,15 @@ DECLINLINE(void) drvvdMediaExIoReqBufFree(PVBOXDISK pThis, PPDMMEDIAEXIOREQINT p
 {
     LogFlowFunc(("pThis=%#p pIoReq=%#p{.cbIoBuf=%zu}\n", pThis, pIoReq, pIoReq->ReadWrite.cbIoBuf));
 
-    if (   pIoReq->enmType == PDMMEDIAEXIOREQTYPE_READ
-        || pIoReq->enmType == PDMMEDIAEXIOREQTYPE_WRITE)
+    if (   (   pIoReq->enmType == PDMMEDIAEXIOREQTYPE_READ
+            || pIoReq->enmType == PDMMEDIAEXIOREQTYPE_WRITE)
+        && pIoReq->ReadWrite.fDirectBuf)
+    {
+        /* The memory belongs to the request owner, nothing was freed which waiting requests could use. */
+        pIoReq->ReadWrite.fDirectBuf = false;
+    }
+    else if (   pIoReq->enmType == PDMMEDIAEXIOREQTYPE_READ
+             || pIoReq->enmType == PDMMEDIAEXIOREQTYPE_WRITE)
     {
         IOBUFMgrFreeBuf(&pIoReq->ReadWrite.IoBuf);
 
@@ -3833,6 +3929,7 @@ static DECLCALLBACK(int) drvvdIoReqSuspendedLoad(PPDMIMEDIAEX pInterface, PSSMHA
              * waitign list instead of the redo list.
              */
             pIoReq->ReadWrite.cbIoBuf = 0;
+            pIoReq->ReadWrite.fDirectBuf = false;
             rc = IOBUFMgrAllocBuf(pThis->hIoBufMgr, &pIoReq->ReadWrite.IoBuf, pIoReq->ReadWrite.cbReqLeft,
                                   &pIoReq->ReadWrite.cbIoBuf);
             if (rc == VERR_NO_MEMORY)
@@ -4087,6 +4184,124 @@ static DECLCALLBACK(int) drvvdLoadDone(PPDMDRVINS pDrvIns, PSSMHANDLE pSSM)
 }
 
 
+/*********************************************************************************************************************************
+*   Write-back cache support                                                                                                     *
+*********************************************************************************************************************************/
+
+/**
+ * Updates the cache statistics exposed through STAM.
+ *
+ * @returns nothing.
+ * @param   pThis     VBox disk container instance data.
+ */
+static void drvvdCacheStatsUpdate(PVBOXDISK pThis)
+{
+    VDCACHESTATS Stats;
+    int rc = VDCacheQueryStatistics(pThis->pDisk, &Stats);
+    if (RT_SUCCESS(rc))
+    {
+        pThis->CacheStats = Stats;
+        uint64_t const cReads = Stats.cReadHits + Stats.cReadMisses;
+        pThis->uCacheReadHitRatio = cReads ? (uint32_t)(Stats.cReadHits * 100 / cReads) : 0;
+    }
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADDRV, Writes dirty data from the cache to the image.}
+ */
+static DECLCALLBACK(int) drvvdCacheDestageThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PVBOXDISK pThis = PDMINS_2_DATA(pDrvIns, PVBOXDISK);
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        uint64_t cbDirty = 0;
+
+        /* The images are read-only while the VM is suspended for a snapshot. */
+        if (!pThis->fTempReadOnly)
+        {
+            int rc = VDCacheDestage(pThis->pDisk, DRVVD_CACHE_DESTAGE_MAX, &cbDirty);
+            if (RT_FAILURE(rc) && !pThis->fDestageErrorLogged)
+            {
+                LogRel(("VD#%u: Writing dirty data from the cache failed with %Rrc\n", pDrvIns->iInstance, rc));
+                pThis->fDestageErrorLogged = true;
+            }
+            else if (RT_SUCCESS(rc))
+                pThis->fDestageErrorLogged = false;
+        }
+        drvvdCacheStatsUpdate(pThis);
+
+        /* Keep going without a break if there is a backlog, the destaging takes a while on its own. */
+        if (   !cbDirty
+            || pThis->fDestageErrorLogged)
+            RTSemEventWait(pThis->hEvtDestage, DRVVD_CACHE_DESTAGE_INTERVAL_MS);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADWAKEUPDRV}
+ */
+static DECLCALLBACK(int) drvvdCacheDestageThreadWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    RT_NOREF(pThread);
+    PVBOXDISK pThis = PDMINS_2_DATA(pDrvIns, PVBOXDISK);
+    return RTSemEventSignal(pThis->hEvtDestage);
+}
+
+/**
+ * Sets up the statistics and the destage thread after the cache image was opened.
+ *
+ * @returns VBox status code.
+ * @param   pThis           VBox disk container instance data.
+ * @param   fWriteBack      Flag whether the cache is used in write-back mode.
+ */
+static int drvvdCacheInit(PVBOXDISK pThis, bool fWriteBack)
+{
+    PPDMDRVINS pDrvIns = pThis->pDrvIns;
+    int rc = VINF_SUCCESS;
+
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->CacheStats.cReadHits, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                           "Number of reads served from the cache.", "/Drivers/VD%u/Cache/ReadHits", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->CacheStats.cReadMisses, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                           "Number of reads which missed the cache.", "/Drivers/VD%u/Cache/ReadMisses", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->uCacheReadHitRatio, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_PCT,
+                           "Read hit ratio.", "/Drivers/VD%u/Cache/ReadHitRatio", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->CacheStats.cbReadHit, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                           "Amount of data read from the cache.", "/Drivers/VD%u/Cache/ReadHitBytes", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->CacheStats.cbReadMiss, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                           "Amount of data read from the image.", "/Drivers/VD%u/Cache/ReadMissBytes", pDrvIns->iInstance);
+
+    if (fWriteBack)
+    {
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->CacheStats.cbWriteBack, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                               "Amount of data written to the cache.", "/Drivers/VD%u/Cache/WriteBackBytes", pDrvIns->iInstance);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->CacheStats.cbWriteThrough, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                               "Amount of data written to the image because the cache was full.",
+                               "/Drivers/VD%u/Cache/WriteThroughBytes", pDrvIns->iInstance);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->CacheStats.cbDestaged, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                               "Amount of dirty data written from the cache to the image.",
+                               "/Drivers/VD%u/Cache/DestagedBytes", pDrvIns->iInstance);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->CacheStats.cbDirty, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                               "Amount of dirty data in the cache.", "/Drivers/VD%u/Cache/DirtyBytes", pDrvIns->iInstance);
+
+        rc = RTSemEventCreate(&pThis->hEvtDestage);
+        if (RT_SUCCESS(rc))
+            rc = PDMDrvHlpThreadCreate(pDrvIns, &pThis->pThreadDestage, pThis, drvvdCacheDestageThread,
+                                       drvvdCacheDestageThreadWakeup, 0, RTTHREADTYPE_IO, "VDDestage");
+        if (RT_FAILURE(rc))
+            rc = PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS,
+                                     N_("DrvVD: Failed to create the cache destage thread"));
+    }
+
+    return rc;
+}
+
+
 /*********************************************************************************************************************************
 *   Driver methods                                                                                                               *
 *********************************************************************************************************************************/
@@ -4123,6 +4338,20 @@ static void drvvdPowerOffOrDestructOrUnmount(PPDMDRVINS pDrvIns)
         pThis->pBlkCache = NULL;
     }
 
+    /* The destage thread must not touch the disk while it is destroyed, closing the cache writes the rest. */
+    if (pThis->pThreadDestage)
+    {
+        int rcThread;
+        int rc = PDMR3ThreadDestroy(pThis->pThreadDestage, &rcThread);
+        AssertRC(rc);
+        pThis->pThreadDestage = NULL;
+    }
+    if (pThis->hEvtDestage != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(pThis->hEvtDestage);
+        pThis->hEvtDestage = NIL_RTSEMEVENT;
+    }
+
     if (RT_VALID_PTR(pThis->pDisk))
     {
         VDDestroy(pThis->pDisk);
@@ -4356,6 +4585,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
     bool fReadOnly = false;      /* True if the media is read-only. */
     bool fMaybeReadOnly = false; /* True if the media may or may not be read-only. */
     bool fHonorZeroWrites = false; /* True if zero blocks should be written. */
+    bool fCacheWriteBack = false; /* True if the cache image is used in write-back mode. */
 
     /*
      * Init the static parts.
@@ -4367,6 +4597,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
     pThis->fAsyncIOSupported            = false;
     pThis->fShareable                   = false;
     pThis->fMergePending                = false;
+    pThis->hEvtDestage                  = NIL_RTSEMEVENT;
     pThis->MergeCompleteMutex           = NIL_RTSEMFASTMUTEX;
     pThis->MergeLock                    = NIL_RTSEMRW;
     pThis->uMergeSource                 = VD_LAST_IMAGE;
@@ -4508,7 +4739,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
                                           "ReadOnly\0MaybeReadOnly\0TempReadOnly\0Shareable\0HonorZeroWrites\0"
                                           "HostIPStack\0UseNewIo\0BootAcceleration\0BootAccelerationBuffer\0"
                                           "SetupMerge\0MergeSource\0MergeTarget\0BwGroup\0Type\0BlockCache\0"
-                                          "CachePath\0CacheFormat\0Discard\0InformAboutZeroBlocks\0"
+                                          "CachePath\0CacheFormat\0CacheWriteBack\0Discard\0InformAboutZeroBlocks\0"
                                           "SkipConsistencyChecks\0"
                                           "Locked\0BIOSVisible\0Cylinders\0Heads\0Sectors\0Mountable\0"
                                           "EmptyDrive\0IoBufMax\0NonRotationalMedium\0"
@@ -4698,6 +4929,20 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
                                           N_("DrvVD: Configuration error: Querying \"CacheFormat\" as string failed"));
                     break;
                 }
+
+                rc = CFGMR3QueryBoolDef(pCurNode, "CacheWriteBack", &fCacheWriteBack, false);
+                if (RT_FAILURE(rc))
+                {
+                    rc = PDMDRV_SET_ERROR(pDrvIns, rc,
+                                          N_("DrvVD: Configuration error: Querying \"CacheWriteBack\" as boolean failed"));
+                    break;
+                }
+                if (fCacheWriteBack && (fReadOnly || pThis->fShareable))
+                {
+                    rc = PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                             N_("DrvVD: Configuration error: Write-back caching requires a writable, non-shareable medium"));
+                    break;
+                }
             }
 
             /* Mountable */
@@ -5043,6 +5288,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
                 pImage->VDIfIo.pfnGetSize           = drvvdAsyncIOGetSize;
                 pImage->VDIfIo.pfnSetSize           = drvvdAsyncIOSetSize;
                 pImage->VDIfIo.pfnSetAllocationSize = drvvdAsyncIOSetAllocationSize;
+                pImage->VDIfIo.pfnPunchHole         = drvvdAsyncIOPunchHole;
                 pImage->VDIfIo.pfnReadSync          = drvvdAsyncIOReadSync;
                 pImage->VDIfIo.pfnWriteSync         = drvvdAsyncIOWriteSync;
                 pImage->VDIfIo.pfnFlushSync         = drvvdAsyncIOFlushSync;
@@ -5171,9 +5417,13 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
                 AssertRC(rc);
             }
 
-            rc = VDCacheOpen(pThis->pDisk, pszCacheFormat, pszCachePath, VD_OPEN_FLAGS_NORMAL, pThis->pVDIfsCache);
+            rc = VDCacheOpen(pThis->pDisk, pszCacheFormat, pszCachePath,
+                             fCacheWriteBack ? VD_OPEN_FLAGS_CACHE_WRITE_BACK : VD_OPEN_FLAGS_NORMAL,
+                             pThis->pVDIfsCache);
             if (RT_FAILURE(rc))
                 rc = PDMDRV_SET_ERROR(pDrvIns, rc, N_("DrvVD: Could not open cache image"));
+            else
+                rc = drvvdCacheInit(pThis, fCacheWriteBack);
         }
 
         if (RT_VALID_PTR(pszCachePath))
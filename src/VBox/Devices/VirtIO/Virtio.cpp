@@ -244,6 +244,24 @@ void vqueuePut(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, uint32_t uL
     vringWriteUsedElem(pState, &pQueue->VRing, pQueue->uNextUsedIndex++, pElem->uIndex, uLen);
 }
 
+/**
+ * Puts a descriptor chain on the used ring without touching its segments.
+ *
+ * For devices which write the in segments themselves and therefore do not keep
+ * the (rather large) VQUEUEELEM around until the request completes.
+ *
+ * @param   pState      The device state structure.
+ * @param   pQueue      The queue the chain was taken from.
+ * @param   uHeadIdx    Index of the head descriptor of the chain.
+ * @param   uLen        Number of bytes written to the in segments.
+ */
+void vqueuePutIndex(PVPCISTATE pState, PVQUEUE pQueue, uint32_t uHeadIdx, uint32_t uLen)
+{
+    Log2(("%s vqueuePutIndex: %s used_idx=%u id=%u len=%u\n", INSTANCE(pState),
+          QUEUENAME(pState, pQueue), pQueue->uNextUsedIndex, uHeadIdx, uLen));
+    vringWriteUsedElem(pState, &pQueue->VRing, pQueue->uNextUsedIndex++, uHeadIdx, uLen);
+}
+
 void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue)
 {
     LogFlow(("%s vqueueNotify: %s availFlags=%x guestFeatures=%x vqueue is %sempty\n",
@@ -780,7 +798,7 @@ static DECLCALLBACK(void) vpciConfigure(PDMPCIDEV& pci,
 {
     /* Configure PCI Device, assume 32-bit mode ******************************/
     PCIDevSetVendorId(&pci, DEVICE_PCI_VENDOR_ID);
-    PCIDevSetDeviceId(&pci, DEVICE_PCI_BASE_ID + uDeviceId);
+    PCIDevSetDeviceId(&pci, uDeviceId == VIRTIO_SCSI_ID ? DEVICE_PCI_SCSI_ID : DEVICE_PCI_BASE_ID + uDeviceId);
     PDMPciDevSetWord(&pci,  VBOX_PCI_SUBSYSTEM_VENDOR_ID, DEVICE_PCI_SUBSYSTEM_VENDOR_ID);
     PDMPciDevSetWord(&pci,  VBOX_PCI_SUBSYSTEM_ID, DEVICE_PCI_SUBSYSTEM_BASE_ID + uDeviceId);
 
@@ -861,9 +879,12 @@ int vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
     /* Status driver */
     PPDMIBASE pBase;
     rc = PDMDevHlpDriverAttach(pDevIns, PDM_STATUS_LUN, &pState->IBase, &pBase, "Status Port");
-    if (RT_FAILURE(rc))
+    if (RT_SUCCESS(rc))
+        pState->pLedsConnector = PDMIBASE_QUERY_INTERFACE(pBase, PDMILEDCONNECTORS);
+    else if (rc == VERR_PDM_NO_ATTACHED_DRIVER)
+        rc = VINF_SUCCESS; /* Optional, devices configured by hand have no status driver. */
+    else
         return PDMDEV_SET_ERROR(pDevIns, rc, N_("Failed to attach the status LUN"));
-    pState->pLedsConnector = PDMIBASE_QUERY_INTERFACE(pBase, PDMILEDCONNECTORS);
 
     pState->nQueues = nQueues;
 
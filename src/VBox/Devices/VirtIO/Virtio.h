@@ -35,8 +35,11 @@
 #define DEVICE_PCI_BASE_ID                  0x1000
 #define DEVICE_PCI_SUBSYSTEM_VENDOR_ID      0x1AF4
 #define DEVICE_PCI_SUBSYSTEM_BASE_ID       1
+/** The legacy SCSI host device ID does not follow DEVICE_PCI_BASE_ID + type. */
+#define DEVICE_PCI_SCSI_ID                  0x1004
 
-#define VIRTIO_MAX_NQUEUES                  3
+/** Control and event queue plus up to 16 request queues for virtio-scsi. */
+#define VIRTIO_MAX_NQUEUES                  18
 
 #define VPCI_HOST_FEATURES                  0x0
 #define VPCI_GUEST_FEATURES                 0x4
@@ -152,6 +155,7 @@ enum VirtioDeviceType
 {
     VIRTIO_NET_ID = 0,
     VIRTIO_BLK_ID = 1,
+    VIRTIO_SCSI_ID = 7,
     VIRTIO_32BIT_HACK = 0x7fffffff
 };
 
@@ -302,6 +306,7 @@ DECLINLINE(uint16_t) vringReadAvailIndex(PVPCISTATE pState, PVRING pVRing)
 bool vqueueSkip(PVPCISTATE pState, PVQUEUE pQueue);
 bool vqueueGet(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, bool fRemove = true);
 void vqueuePut(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, uint32_t uLen, uint32_t uReserved = 0);
+void vqueuePutIndex(PVPCISTATE pState, PVQUEUE pQueue, uint32_t uHeadIdx, uint32_t uLen);
 void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue);
 void vqueueSync(PVPCISTATE pState, PVQUEUE pQueue);
 
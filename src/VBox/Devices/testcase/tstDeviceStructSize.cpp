@@ -46,6 +46,8 @@
 #ifdef VBOX_WITH_VIRTIO
 # undef LOG_GROUP
 # include "../Network/DevVirtioNet.cpp"
+# undef LOG_GROUP
+# include "../Storage/DevVirtioSCSI.cpp"
 #endif
 #undef LOG_GROUP
 #include "../PC/DevACPI.cpp"
@@ -304,6 +306,7 @@ int main()
 #endif
 #ifdef VBOX_WITH_VIRTIO
     CHECK_MEMBER_ALIGNMENT(VNETSTATE, StatReceiveBytes, 8);
+    CHECK_MEMBER_ALIGNMENT(VIRTIOSCSI, aReqQueues[0].StatKicks, 8);
 #endif
     //CHECK_MEMBER_ALIGNMENT(E1KSTATE, csTx, 8);
 #ifdef VBOX_WITH_USB
@@ -344,6 +347,20 @@ int main()
     CHECK_MEMBER_ALIGNMENT(LSILOGISCSI, ReplyFreeQueueCritSect, 8);
     CHECK_MEMBER_ALIGNMENT(LSILOGISCSI, uReplyFreeQueueNextEntryFreeWrite, 8);
     CHECK_MEMBER_ALIGNMENT(LSILOGISCSI, VBoxSCSI, 8);
+#ifdef VBOX_WITH_NVME_IMPL
+    CHECK_MEMBER_ALIGNMENT(NVME, GCPhysMMIO, 8);
+    CHECK_MEMBER_ALIGNMENT(NVME, CritSectIntr, 8);
+    CHECK_MEMBER_ALIGNMENT(NVME, CritSectCtrl, 8);
+    CHECK_MEMBER_ALIGNMENT(NVME, CritSectAsyncEvtReqs, 8);
+    CHECK_MEMBER_ALIGNMENT(NVME, CritSectWrkThrds, 8);
+    CHECK_MEMBER_ALIGNMENT(NVME, cDataUnitsRead, 8);
+# ifdef VBOX_WITH_STATISTICS
+    CHECK_MEMBER_ALIGNMENT(NVME, StatSqDoorbellRZ, 8);
+# endif
+    CHECK_MEMBER_ALIGNMENT(NVMEQUEUESUBM, Hdr.GCPhysBase, 8);
+    CHECK_MEMBER_ALIGNMENT(NVMEQUEUESUBM, LstReqsActive, 8);
+    CHECK_MEMBER_ALIGNMENT(NVMEQUEUECOMP, LstCompletionsWaiting, 8);
+#endif
 #ifdef VBOX_WITH_USB
     CHECK_MEMBER_ALIGNMENT(OHCI, RootHub, 8);
 # ifdef VBOX_WITH_STATISTICS
@@ -96,6 +96,8 @@
 #ifdef VBOX_WITH_VIRTIO
 # undef LOG_GROUP
 # include "../Network/DevVirtioNet.cpp"
+# undef LOG_GROUP
+# include "../Storage/DevVirtioSCSI.cpp"
 #endif
 #ifdef VBOX_WITH_BUSLOGIC
 # undef LOG_GROUP
@@ -1328,6 +1330,7 @@ int main()
     GEN_CHECK_OFF(AHCIPort, StatBytesWritten);
     GEN_CHECK_OFF(AHCIPort, StatBytesRead);
     GEN_CHECK_OFF(AHCIPort, StatIORequestsPerSecond);
+    GEN_CHECK_OFF(AHCIPort, StatReqsDirect);
 #ifdef VBOX_WITH_STATISTICS
     GEN_CHECK_OFF(AHCIPort, StatProfileProcessTime);
     GEN_CHECK_OFF(AHCIPort, StatProfileReadWrite);
@@ -1528,6 +1531,25 @@ int main()
     GEN_CHECK_OFF(VNETSTATE, pCtlQueue);
     GEN_CHECK_OFF(VNETSTATE, fMaybeOutOfSpace);
     GEN_CHECK_OFF(VNETSTATE, hEventMoreRxDescAvail);
+
+    /* Storage/DevVirtioSCSI.cpp */
+    GEN_CHECK_SIZE(VIRTIOSCSI);
+    GEN_CHECK_OFF(VIRTIOSCSI, VPCI);
+    GEN_CHECK_OFF(VIRTIOSCSI, paTargetsR3);
+    GEN_CHECK_OFF(VIRTIOSCSI, pElemCtrlR3);
+    GEN_CHECK_OFF(VIRTIOSCSI, pWakeQueueR3);
+    GEN_CHECK_OFF(VIRTIOSCSI, pWakeQueueR0);
+    GEN_CHECK_OFF(VIRTIOSCSI, pWakeQueueRC);
+    GEN_CHECK_OFF(VIRTIOSCSI, cTargets);
+    GEN_CHECK_OFF(VIRTIOSCSI, pSupDrvSession);
+    GEN_CHECK_OFF(VIRTIOSCSI, cReqQueues);
+    GEN_CHECK_OFF(VIRTIOSCSI, uGeneration);
+    GEN_CHECK_OFF(VIRTIOSCSI, fSignalIdle);
+    GEN_CHECK_OFF(VIRTIOSCSI, Config);
+    GEN_CHECK_OFF(VIRTIOSCSI, LstRedo);
+    GEN_CHECK_OFF(VIRTIOSCSI, aReqQueues);
+    GEN_CHECK_OFF(VIRTIOSCSI, aReqQueues[1]);
+    GEN_CHECK_OFF(VIRTIOSCSI, aReqQueues[VIRTIOSCSI_REQ_QUEUES_MAX - 1].StatReqs);
 #endif /* VBOX_WITH_VIRTIO */
 
 #ifdef VBOX_WITH_SCSI
@@ -1891,6 +1913,10 @@ int main()
     GEN_CHECK_OFF(HDASTATE, pTimer);
     GEN_CHECK_OFF(HDASTATE, cTimerTicks);
     GEN_CHECK_OFF(HDASTATE, uTimerTS);
+    GEN_CHECK_OFF(HDASTATE, cTimerTicksCur);
+    GEN_CHECK_OFF(HDASTATE, fIOThread);
+    GEN_CHECK_OFF(HDASTATE, pIOThread);
+    GEN_CHECK_OFF(HDASTATE, hIOThreadEvent);
 #endif
 #ifdef VBOX_WITH_STATISTICS
 # ifndef VBOX_WITH_AUDIO_CALLBACKS
@@ -1934,10 +1960,19 @@ int main()
     GEN_CHECK_OFF(NVMEQUEUESUBM, pWrkThrdR3);
     GEN_CHECK_OFF(NVMEQUEUESUBM, NdLstWrkThrdAssgnd);
     GEN_CHECK_OFF(NVMEQUEUESUBM, cReqsActive);
+    GEN_CHECK_OFF(NVMEQUEUESUBM, uGen);
+    GEN_CHECK_OFF(NVMEQUEUESUBM, fAborting);
+    GEN_CHECK_OFF(NVMEQUEUESUBM, fDeletePending);
+    GEN_CHECK_OFF(NVMEQUEUESUBM, u16CidDelete);
+    GEN_CHECK_OFF(NVMEQUEUESUBM, uGenAdmDelete);
+    GEN_CHECK_OFF(NVMEQUEUESUBM, LstReqsActive);
+    GEN_CHECK_OFF(NVMEQUEUESUBM, hMtxReqs);
 
     GEN_CHECK_SIZE(NVMEQUEUECOMP);
     GEN_CHECK_OFF(NVMEQUEUECOMP, Hdr);
     GEN_CHECK_OFF(NVMEQUEUECOMP, fIntrEnabled);
+    GEN_CHECK_OFF(NVMEQUEUECOMP, fPhase);
+    GEN_CHECK_OFF(NVMEQUEUECOMP, fIntrPending);
     GEN_CHECK_OFF(NVMEQUEUECOMP, u32IntrVec);
     GEN_CHECK_OFF(NVMEQUEUECOMP, cSubmQueuesRef);
     GEN_CHECK_OFF(NVMEQUEUECOMP, cWaiters);
@@ -1952,6 +1987,7 @@ int main()
     GEN_CHECK_OFF(NVME, IBase);
     GEN_CHECK_OFF(NVME, ILeds);
     GEN_CHECK_OFF(NVME, pLedsConnector);
+    GEN_CHECK_OFF(NVME, pMediaNotify);
     GEN_CHECK_OFF(NVME, pSupDrvSession);
     GEN_CHECK_OFF(NVME, GCPhysMMIO);
     GEN_CHECK_OFF(NVME, IOPortBase);
@@ -1978,6 +2014,8 @@ int main()
     GEN_CHECK_OFF(NVME, uCssSet);
     GEN_CHECK_OFF(NVME, u32RegIdx);
     GEN_CHECK_OFF(NVME, cbPage);
+    GEN_CHECK_OFF(NVME, fIntxAsserted);
+    GEN_CHECK_OFF(NVME, au32Features);
     GEN_CHECK_OFF(NVME, paQueuesSubmR3);
     GEN_CHECK_OFF(NVME, paQueuesCompR3);
     GEN_CHECK_OFF(NVME, paQueuesSubmR0);
@@ -1987,7 +2025,10 @@ int main()
     GEN_CHECK_OFF(NVME, pWakeQueueR3);
     GEN_CHECK_OFF(NVME, pWakeQueueR0);
     GEN_CHECK_OFF(NVME, pWakeQueueRC);
+    GEN_CHECK_OFF(NVME, CritSectIntr);
+    GEN_CHECK_OFF(NVME, CritSectCtrl);
     GEN_CHECK_OFF(NVME, cAsyncEvtReqsMax);
+    GEN_CHECK_OFF(NVME, cAsyncEvtReqsCur);
     GEN_CHECK_OFF(NVME, CritSectAsyncEvtReqs);
     GEN_CHECK_OFF(NVME, paAsyncEvtReqCids);
     GEN_CHECK_OFF(NVME, paNamespaces);
@@ -1995,7 +2036,15 @@ int main()
     GEN_CHECK_OFF(NVME, cWrkThrdsActive);
     GEN_CHECK_OFF(NVME, LstWrkThrds);
     GEN_CHECK_OFF(NVME, CritSectWrkThrds);
+    GEN_CHECK_OFF(NVME, LstRedo);
+    GEN_CHECK_OFF(NVME, cDataUnitsRead);
+    GEN_CHECK_OFF(NVME, cMediaErrors);
     GEN_CHECK_OFF(NVME, fSignalIdle);
+    GEN_CHECK_OFF(NVME, fFatalLogged);
+# ifdef VBOX_WITH_STATISTICS
+    GEN_CHECK_OFF(NVME, StatSqDoorbellRZ);
+    GEN_CHECK_OFF(NVME, StatCompWaiters);
+# endif
 #endif
 
     return (0);
@@ -27,10 +27,13 @@
 
 #include <iprt/asm.h>
 #include <iprt/alloca.h>
+#include <iprt/crc.h>
+#include <iprt/critsect.h>
 #include <iprt/ldr.h>
 #include <iprt/param.h>
 #include <iprt/path.h>
 #include <iprt/mem.h>
+#include <iprt/semaphore.h>
 #include <iprt/socket.h>
 #include <iprt/stream.h>
 #include <iprt/string.h>
@@ -43,6 +46,10 @@
 
 #include <rfb/rfb.h>
 
+#ifdef RT_ARCH_AMD64
+# include <emmintrin.h>
+#endif
+
 #ifdef LIBVNCSERVER_IPv6
 // enable manually!
 // #define VBOX_USE_IPV6
@@ -57,6 +64,10 @@
 #define VNC_ADDRESSSIZE         60
 #define VNC_PORTSSIZE           20
 #define VNC_ADDRESS_OPTION_MAX  500
+/** Log2 of the width and height of the tiles used for damage tracking. */
+#define VNC_TILE_SHIFT          6
+/** Width and height of the tiles used for damage tracking. */
+#define VNC_TILE_SIZE           (1 << VNC_TILE_SHIFT)
 
 
 /*********************************************************************************************************************************
@@ -72,10 +83,24 @@ public:
         mScreenBuffer = NULL;
         mCursor = NULL;
         uClients = 0;
+        RT_ZERO(FrameInfo);
+        RT_ZERO(mTileCritSect);
+        mTileEvent = NIL_RTSEMEVENT;
+        mTileThread = NIL_RTTHREAD;
+        mfTileShutdown = false;
+        mfTileWorkPending = false;
+        mfTileForceAll = false;
+        mcTilesX = 0;
+        mcTilesY = 0;
+        mpau32TileDirty = NULL;
+        mpau64TileHash = NULL;
     }
 
     ~VNCServerImpl()
     {
+        tileWorkerStop();
+        RTMemFree((void *)mpau32TileDirty);
+        RTMemFree(mpau64TileHash);
         if (mFrameBuffer)
             RTMemFree(mFrameBuffer);
         if (mCursor)
@@ -103,6 +128,37 @@ private:
     unsigned char *mScreenBuffer;
     unsigned char *mFrameBuffer;
     uint32_t uClients;
+
+    // Tile based damage tracking.  VRDEUpdate only marks the tiles an update
+    // touches, the tile worker then hashes the source pixels of each marked
+    // tile and only converts and sends the tiles which really changed.
+    // protects the frame buffers and the tile arrays against VRDEResize
+    RTCRITSECT mTileCritSect;
+    // wakes up the tile worker
+    RTSEMEVENT mTileEvent;
+    RTTHREAD mTileThread;
+    bool volatile mfTileShutdown;
+    // set when the worker has been signalled and not yet picked up the work
+    bool volatile mfTileWorkPending;
+    // convert and send all marked tiles regardless of their hash (after resizing),
+    // or the whole frame if the tile arrays could not be allocated
+    bool volatile mfTileForceAll;
+    uint32_t mcTilesX;
+    uint32_t mcTilesY;
+    // bitmap of the tiles touched by updates since the last worker pass
+    uint32_t volatile *mpau32TileDirty;
+    // CRC64 of the source pixels of each tile as last converted
+    uint64_t *mpau64TileHash;
+
+    int  tileWorkerStart();
+    void tileWorkerStop();
+    int  tileSetup(uint32_t cWidth, uint32_t cHeight);
+    void tileMarkDirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+    void tileKickWorker();
+    void tileProcess(uint32_t iTile, bool fForce);
+    void tileProcessFrame();
+    static DECLCALLBACK(int) tileWorker(RTTHREAD hThreadSelf, void *pvUser);
+
     static enum rfbNewClientAction rfbNewClientEvent(rfbClientPtr cl);
     static void vncMouseEvent(int buttonMask, int x, int y, rfbClientPtr cl);
     static void vncKeyboardEvent(rfbBool down, rfbKeySym keySym, rfbClientPtr cl);
@@ -192,6 +248,7 @@ VRDEENTRYPOINTS_4 VNCServerImpl::Entries = {
 DECLCALLBACK(void) VNCServerImpl::VRDEDestroy(HVRDESERVER hServer)
 {
     VNCServerImpl *instance = (VNCServerImpl *)hServer;
+    instance->tileWorkerStop();
     rfbShutdownServer(instance->mVNCServer, TRUE);
 
     uint32_t port = UINT32_MAX;
@@ -280,6 +337,14 @@ DECLCALLBACK(int) VNCServerImpl::VRDEEnableConnections(HVRDESERVER hServer, bool
     instance->mScreenBuffer = (unsigned char *)info.pu8Bits;
     instance->FrameInfo = info;
 
+    // Without the tile arrays the worker falls back to whole-frame updates.
+    int rcTiles = instance->tileSetup(info.cWidth, info.cHeight);
+    if (RT_FAILURE(rcTiles))
+        LogRel(("VNC: failed to set up the tiles for %ux%u: %Rrc\n", info.cWidth, info.cHeight, rcTiles));
+    rcTiles = instance->tileWorkerStart();
+    if (RT_FAILURE(rcTiles))
+        LogRel(("VNC: failed to start the tile worker: %Rrc\n", rcTiles));
+
     vncServer->serverFormat.redShift = 16;
     vncServer->serverFormat.greenShift = 8;
     vncServer->serverFormat.blueShift = 0;
@@ -718,6 +783,304 @@ static inline void convert16To32bpp(uint8_t msb, uint8_t lsb, uint8_t &r, uint8_
     b = (px << 3) & 0xf8;
 }
 
+/**
+ * Converts a row of pixels from the VRDE framebuffer to the RGBA buffer
+ * handed to libvncserver, swapping red and blue.
+ *
+ * @param pbDst         Where to store the RGBA pixels.
+ * @param pbSrc         The source pixels.
+ * @param cBitsPerPixel The source depth, 16, 24 or 32.
+ * @param cPixels       Number of pixels to convert.
+ */
+static void convertRowTo32bpp(uint8_t *pbDst, const uint8_t *pbSrc, unsigned cBitsPerPixel, uint32_t cPixels)
+{
+    uint32_t i = 0;
+    if (cBitsPerPixel == 32)
+    {
+#ifdef RT_ARCH_AMD64
+        __m128i const uMaskG  = _mm_set1_epi32(0x0000ff00);
+        __m128i const uMaskLo = _mm_set1_epi32(0x000000ff);
+        for (; i + 4 <= cPixels; i += 4)
+        {
+            __m128i const uPix = _mm_loadu_si128((const __m128i *)&pbSrc[i * 4]);
+            __m128i const uRes = _mm_or_si128(_mm_and_si128(uPix, uMaskG),
+                                              _mm_or_si128(_mm_and_si128(_mm_srli_epi32(uPix, 16), uMaskLo),
+                                                           _mm_slli_epi32(_mm_and_si128(uPix, uMaskLo), 16)));
+            _mm_storeu_si128((__m128i *)&pbDst[i * VNC_SIZEOFRGBA], uRes);
+        }
+#endif
+        for (; i < cPixels; i++)
+        {
+            pbDst[i * VNC_SIZEOFRGBA]     = pbSrc[i * 4 + 2];
+            pbDst[i * VNC_SIZEOFRGBA + 1] = pbSrc[i * 4 + 1];
+            pbDst[i * VNC_SIZEOFRGBA + 2] = pbSrc[i * 4];
+            pbDst[i * VNC_SIZEOFRGBA + 3] = 0;
+        }
+    }
+    else if (cBitsPerPixel == 24)
+    {
+        for (; i < cPixels; i++)
+        {
+            pbDst[i * VNC_SIZEOFRGBA]     = pbSrc[i * 3 + 2];
+            pbDst[i * VNC_SIZEOFRGBA + 1] = pbSrc[i * 3 + 1];
+            pbDst[i * VNC_SIZEOFRGBA + 2] = pbSrc[i * 3];
+            pbDst[i * VNC_SIZEOFRGBA + 3] = 0;
+        }
+    }
+    else if (cBitsPerPixel == 16)
+    {
+#ifdef RT_ARCH_AMD64
+        for (; i + 8 <= cPixels; i += 8)
+        {
+            __m128i const uPix = _mm_loadu_si128((const __m128i *)&pbSrc[i * 2]);
+            __m128i const uR   = _mm_and_si128(_mm_srli_epi16(uPix, 8), _mm_set1_epi16(0xf8));
+            __m128i const uG   = _mm_and_si128(_mm_srli_epi16(uPix, 3), _mm_set1_epi16(0xfc));
+            __m128i const uB   = _mm_and_si128(_mm_slli_epi16(uPix, 3), _mm_set1_epi16(0xf8));
+            __m128i const uRG  = _mm_or_si128(uR, _mm_slli_epi16(uG, 8));
+            _mm_storeu_si128((__m128i *)&pbDst[i * VNC_SIZEOFRGBA],      _mm_unpacklo_epi16(uRG, uB));
+            _mm_storeu_si128((__m128i *)&pbDst[i * VNC_SIZEOFRGBA + 16], _mm_unpackhi_epi16(uRG, uB));
+        }
+#endif
+        for (; i < cPixels; i++)
+        {
+            convert16To32bpp(pbSrc[i * 2], pbSrc[i * 2 + 1],
+                             pbDst[i * VNC_SIZEOFRGBA], pbDst[i * VNC_SIZEOFRGBA + 1], pbDst[i * VNC_SIZEOFRGBA + 2]);
+            pbDst[i * VNC_SIZEOFRGBA + 3] = 0;
+        }
+    }
+}
+
+/**
+ * Allocates the tile arrays for the given resolution and marks all tiles
+ * for a forced update.
+ *
+ * On failure the tile arrays of the previous resolution are freed and the
+ * worker sends the whole frame for every update until the next resize.
+ *
+ * @returns IPRT status code.
+ * @param cWidth  The framebuffer width.
+ * @param cHeight The framebuffer height.
+ *
+ * @note Must be called with mTileCritSect held once the worker is running.
+ */
+int VNCServerImpl::tileSetup(uint32_t cWidth, uint32_t cHeight)
+{
+    uint32_t const cTilesX = (cWidth  + VNC_TILE_SIZE - 1) >> VNC_TILE_SHIFT;
+    uint32_t const cTilesY = (cHeight + VNC_TILE_SIZE - 1) >> VNC_TILE_SHIFT;
+    uint32_t const cTiles  = cTilesX * cTilesY;
+
+    uint32_t *pau32Dirty = (uint32_t *)RTMemAlloc(RT_ALIGN_32(cTiles, 32) / 8);
+    uint64_t *pau64Hash  = (uint64_t *)RTMemAllocZ(cTiles * sizeof(uint64_t));
+
+    RTMemFree((void *)mpau32TileDirty);
+    RTMemFree(mpau64TileHash);
+    if (!pau32Dirty || !pau64Hash)
+    {
+        RTMemFree(pau32Dirty);
+        RTMemFree(pau64Hash);
+        mpau32TileDirty = NULL;
+        mpau64TileHash  = NULL;
+        mcTilesX = 0;
+        mcTilesY = 0;
+        ASMAtomicWriteBool(&mfTileForceAll, true);
+        return VERR_NO_MEMORY;
+    }
+    memset(pau32Dirty, 0xff, RT_ALIGN_32(cTiles, 32) / 8);
+
+    mpau32TileDirty = pau32Dirty;
+    mpau64TileHash  = pau64Hash;
+    mcTilesX = cTilesX;
+    mcTilesY = cTilesY;
+    ASMAtomicWriteBool(&mfTileForceAll, true);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Marks the tiles covered by the given rectangle for the worker, or the whole
+ * frame if there are no tiles.
+ */
+void VNCServerImpl::tileMarkDirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    if (!mpau32TileDirty)
+    {
+        ASMAtomicWriteBool(&mfTileForceAll, true);
+        return;
+    }
+    if (   x >= FrameInfo.cWidth
+        || y >= FrameInfo.cHeight
+        || !w
+        || !h)
+        return;
+
+    uint32_t const xTileFirst = x >> VNC_TILE_SHIFT;
+    uint32_t const yTileFirst = y >> VNC_TILE_SHIFT;
+    uint32_t const xTileLast  = (RT_MIN(x + w, FrameInfo.cWidth)  - 1) >> VNC_TILE_SHIFT;
+    uint32_t const yTileLast  = (RT_MIN(y + h, FrameInfo.cHeight) - 1) >> VNC_TILE_SHIFT;
+    for (uint32_t yTile = yTileFirst; yTile <= yTileLast; yTile++)
+        for (uint32_t xTile = xTileFirst; xTile <= xTileLast; xTile++)
+            ASMAtomicBitSet(mpau32TileDirty, (int32_t)(yTile * mcTilesX + xTile));
+}
+
+/**
+ * Wakes up the tile worker unless it has been told already.
+ */
+void VNCServerImpl::tileKickWorker()
+{
+    if (   mTileEvent != NIL_RTSEMEVENT
+        && !ASMAtomicXchgBool(&mfTileWorkPending, true))
+        RTSemEventSignal(mTileEvent);
+}
+
+/**
+ * Converts a tile and tells the clients about it if the source pixels changed
+ * since the last time.
+ *
+ * @param iTile  The tile index.
+ * @param fForce Whether to skip the hash check.
+ *
+ * @note Called by the worker with mTileCritSect held.
+ */
+void VNCServerImpl::tileProcess(uint32_t iTile, bool fForce)
+{
+    uint32_t const x = (iTile % mcTilesX) << VNC_TILE_SHIFT;
+    uint32_t const y = (iTile / mcTilesX) << VNC_TILE_SHIFT;
+    if (x >= FrameInfo.cWidth || y >= FrameInfo.cHeight)
+        return;
+    uint32_t const w = RT_MIN(VNC_TILE_SIZE, FrameInfo.cWidth  - x);
+    uint32_t const h = RT_MIN(VNC_TILE_SIZE, FrameInfo.cHeight - y);
+
+    uint32_t const cbPixel   = FrameInfo.cBitsPerPixel / 8;
+    uint32_t const cbSrcLine = FrameInfo.cbLine ? FrameInfo.cbLine : FrameInfo.cWidth * cbPixel;
+    const uint8_t *pbSrc     = mScreenBuffer + y * cbSrcLine + x * cbPixel;
+
+    uint64_t uHash = RTCrc64Start();
+    for (uint32_t iRow = 0; iRow < h; iRow++)
+        uHash = RTCrc64Process(uHash, pbSrc + iRow * cbSrcLine, w * cbPixel);
+    uHash = RTCrc64Finish(uHash);
+    if (!fForce && uHash == mpau64TileHash[iTile])
+        return;
+    mpau64TileHash[iTile] = uHash;
+
+    uint8_t *pbDst = mFrameBuffer + (y * FrameInfo.cWidth + x) * VNC_SIZEOFRGBA;
+    for (uint32_t iRow = 0; iRow < h; iRow++)
+        convertRowTo32bpp(pbDst + iRow * FrameInfo.cWidth * VNC_SIZEOFRGBA, pbSrc + iRow * cbSrcLine,
+                          FrameInfo.cBitsPerPixel, w);
+
+    rfbMarkRectAsModified(mVNCServer, x, y, x + w, y + h);
+}
+
+/**
+ * Converts the whole frame and tells the clients about it, the fallback for
+ * when the tile arrays could not be allocated.
+ *
+ * @note Called by the worker with mTileCritSect held.
+ */
+void VNCServerImpl::tileProcessFrame()
+{
+    uint32_t const cbPixel   = FrameInfo.cBitsPerPixel / 8;
+    uint32_t const cbSrcLine = FrameInfo.cbLine ? FrameInfo.cbLine : FrameInfo.cWidth * cbPixel;
+
+    for (uint32_t y = 0; y < FrameInfo.cHeight; y++)
+        convertRowTo32bpp(mFrameBuffer + y * FrameInfo.cWidth * VNC_SIZEOFRGBA, mScreenBuffer + y * cbSrcLine,
+                          FrameInfo.cBitsPerPixel, FrameInfo.cWidth);
+
+    rfbMarkRectAsModified(mVNCServer, 0, 0, FrameInfo.cWidth, FrameInfo.cHeight);
+}
+
+/**
+ * The tile worker thread, converting the changed tiles off the display thread.
+ */
+DECLCALLBACK(int) VNCServerImpl::tileWorker(RTTHREAD hThreadSelf, void *pvUser)
+{
+    RT_NOREF(hThreadSelf);
+    VNCServerImpl *instance = (VNCServerImpl *)pvUser;
+
+    while (!ASMAtomicReadBool(&instance->mfTileShutdown))
+    {
+        int rc = RTSemEventWait(instance->mTileEvent, RT_INDEFINITE_WAIT);
+        if (RT_FAILURE(rc) && rc != VERR_INTERRUPTED)
+            break;
+        if (ASMAtomicReadBool(&instance->mfTileShutdown))
+            break;
+
+        RTCritSectEnter(&instance->mTileCritSect);
+        ASMAtomicWriteBool(&instance->mfTileWorkPending, false);
+        bool const fForce = ASMAtomicXchgBool(&instance->mfTileForceAll, false);
+        if (   instance->mScreenBuffer
+            && instance->mFrameBuffer
+            && !instance->mpau32TileDirty)
+        {
+            if (fForce)
+                instance->tileProcessFrame();
+        }
+        else if (   instance->mScreenBuffer
+                 && instance->mFrameBuffer)
+        {
+            uint32_t const cWords = RT_ALIGN_32(instance->mcTilesX * instance->mcTilesY, 32) / 32;
+            for (uint32_t iWord = 0; iWord < cWords; iWord++)
+            {
+                uint32_t u32Dirty = ASMAtomicXchgU32(&instance->mpau32TileDirty[iWord], 0);
+                while (u32Dirty)
+                {
+                    unsigned const iBit = ASMBitFirstSetU32(u32Dirty) - 1;
+                    u32Dirty &= ~RT_BIT_32(iBit);
+                    instance->tileProcess(iWord * 32 + iBit, fForce);
+                }
+            }
+        }
+        RTCritSectLeave(&instance->mTileCritSect);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Starts the tile worker if not running yet.
+ *
+ * @returns IPRT status code.
+ */
+int VNCServerImpl::tileWorkerStart()
+{
+    if (mTileThread != NIL_RTTHREAD)
+        return VINF_SUCCESS;
+
+    int rc = RTCritSectInit(&mTileCritSect);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTSemEventCreate(&mTileEvent);
+        if (RT_SUCCESS(rc))
+        {
+            mfTileShutdown = false;
+            rc = RTThreadCreate(&mTileThread, tileWorker, this, 0, RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "VNCTiles");
+            if (RT_SUCCESS(rc))
+                return VINF_SUCCESS;
+            mTileThread = NIL_RTTHREAD;
+            RTSemEventDestroy(mTileEvent);
+            mTileEvent = NIL_RTSEMEVENT;
+        }
+        RTCritSectDelete(&mTileCritSect);
+    }
+    return rc;
+}
+
+/**
+ * Stops the tile worker if running.
+ */
+void VNCServerImpl::tileWorkerStop()
+{
+    if (mTileThread == NIL_RTTHREAD)
+        return;
+
+    ASMAtomicWriteBool(&mfTileShutdown, true);
+    RTSemEventSignal(mTileEvent);
+    int rc = RTThreadWait(mTileThread, RT_INDEFINITE_WAIT, NULL);
+    AssertRC(rc);
+    mTileThread = NIL_RTTHREAD;
+    RTSemEventDestroy(mTileEvent);
+    mTileEvent = NIL_RTSEMEVENT;
+    RTCritSectDelete(&mTileCritSect);
+}
+
 /**
  * Inform the server that the display was resized.
  * The server will query information about display
@@ -735,36 +1098,15 @@ DECLCALLBACK(void) VNCServerImpl::VRDEResize(HVRDESERVER hServer)
 
     LogRel(("VNCServerImpl::VRDEResize to %dx%dx%dbpp\n", info.cWidth, info.cHeight, info.cBitsPerPixel));
 
-    // we always alloc an RGBA buffer
-    unsigned char *FrameBuffer = (unsigned char *)RTMemAlloc(info.cWidth * info.cHeight * VNC_SIZEOFRGBA); // RGBA
-    if (info.cBitsPerPixel == 32 || info.cBitsPerPixel == 24)
-    {
-        // Convert RGB (windows/vbox) to BGR(vnc)
-        uint32_t i, j;
-        for (i = 0, j = 0; i < info.cWidth * info.cHeight * VNC_SIZEOFRGBA; i += VNC_SIZEOFRGBA, j += info.cBitsPerPixel / 8)
-        {
-            unsigned char r = info.pu8Bits[j];
-            unsigned char g = info.pu8Bits[j + 1];
-            unsigned char b = info.pu8Bits[j + 2];
-            FrameBuffer[i]     = b;
-            FrameBuffer[i + 1] = g;
-            FrameBuffer[i + 2] = r;
-        }
-    }
-    else if (info.cBitsPerPixel == 16)
-    {
-        uint32_t i, j;
-        for (i = 0, j = 0;
-             i < info.cWidth * info.cHeight * VNC_SIZEOFRGBA;
-             i += VNC_SIZEOFRGBA, j += info.cBitsPerPixel / 8)
-        {
-            convert16To32bpp(info.pu8Bits[j],
-                             info.pu8Bits[j + 1],
-                             FrameBuffer[i],
-                             FrameBuffer[i + 1],
-                             FrameBuffer[i + 2]);
-        }
-    }
+    // we always alloc an RGBA buffer, the tile worker fills it in
+    unsigned char *FrameBuffer = (unsigned char *)RTMemAllocZ(info.cWidth * info.cHeight * VNC_SIZEOFRGBA); // RGBA
+    if (!FrameBuffer)
+        return;
+
+    bool const fWorker = instance->mTileThread != NIL_RTTHREAD;
+    if (fWorker)
+        RTCritSectEnter(&instance->mTileCritSect);
+
     rfbNewFramebuffer(instance->mVNCServer, (char *)FrameBuffer, info.cWidth, info.cHeight, 8, 3, VNC_SIZEOFRGBA);
 
     void *temp = instance->mFrameBuffer;
@@ -773,6 +1115,14 @@ DECLCALLBACK(void) VNCServerImpl::VRDEResize(HVRDESERVER hServer)
     instance->FrameInfo = info;
     if (temp)
         RTMemFree(temp);
+
+    int rc = instance->tileSetup(info.cWidth, info.cHeight);
+    if (RT_FAILURE(rc))
+        LogRel(("VNC: failed to set up the tiles for %ux%u: %Rrc\n", info.cWidth, info.cHeight, rc));
+
+    if (fWorker)
+        RTCritSectLeave(&instance->mTileCritSect);
+    instance->tileKickWorker();
 }
 
 /**
@@ -798,7 +1148,7 @@ DECLCALLBACK(void) VNCServerImpl::VRDEUpdate(HVRDESERVER hServer, unsigned uScre
          * The server can now process redraw requests from clients or initial
          * fullscreen updates for new clients.
          */
-
+        instance->tileKickWorker();
     }
     else
     {
@@ -814,52 +1164,16 @@ DECLCALLBACK(void) VNCServerImpl::VRDEUpdate(HVRDESERVER hServer, unsigned uScre
                     VRDEORDERSOLIDRECT *solidrect = (VRDEORDERSOLIDRECT *)ptr;
                     rfbFillRect(instance->mVNCServer, solidrect->x, solidrect->y,
                         solidrect->x + solidrect->w, solidrect->y + solidrect->h, RGB2BGR(solidrect->rgb));
-                    return;
+                    // Still mark the tiles so their hashes get refreshed, otherwise a
+                    // tile going back to its previous content would not be sent.
+                    break;
                 }
             /// @todo more orders
             }
         }
 
-        uint32_t width = instance->FrameInfo.cWidth;
-        uint32_t bpp = instance->FrameInfo.cBitsPerPixel / 8;
-        uint32_t joff = order->y * width + order->x;
-        uint32_t srcx, srcy, destx, desty;
-        if (instance->FrameInfo.cBitsPerPixel == 32 || instance->FrameInfo.cBitsPerPixel == 24)
-        {
-            for (srcy = joff * bpp, desty = joff * VNC_SIZEOFRGBA;
-                 desty < (joff + order->h * width) * VNC_SIZEOFRGBA;
-                 srcy += width * bpp, desty += width * VNC_SIZEOFRGBA)
-            {
-                // RGB to BGR
-                for (srcx = srcy, destx = desty;
-                     destx < desty + order->w * VNC_SIZEOFRGBA;
-                     srcx += bpp, destx += VNC_SIZEOFRGBA)
-                {
-                    instance->mFrameBuffer[destx]     = instance->mScreenBuffer[srcx + 2];
-                    instance->mFrameBuffer[destx + 1] = instance->mScreenBuffer[srcx + 1];
-                    instance->mFrameBuffer[destx + 2] = instance->mScreenBuffer[srcx];
-                }
-            }
-        }
-        else if (instance->FrameInfo.cBitsPerPixel == 16)
-        {
-            for (srcy = joff * bpp, desty = joff * VNC_SIZEOFRGBA;
-                 desty < (joff + order->h * width) * VNC_SIZEOFRGBA;
-                 srcy += width * bpp, desty += width * VNC_SIZEOFRGBA)
-            {
-                for (srcx = srcy, destx = desty;
-                     destx < desty + order->w * VNC_SIZEOFRGBA;
-                     srcx += bpp, destx += VNC_SIZEOFRGBA)
-                {
-                    convert16To32bpp(instance->mScreenBuffer[srcx],
-                                     instance->mScreenBuffer[srcx + 1],
-                                     instance->mFrameBuffer[destx],
-                                     instance->mFrameBuffer[destx + 1],
-                                     instance->mFrameBuffer[destx + 2]);
-                }
-            }
-        }
-        rfbMarkRectAsModified(instance->mVNCServer, order->x, order->y, order->x+order->w, order->y+order->h);
+        // The worker converts and sends the tiles which really changed.
+        instance->tileMarkDirty(order->x, order->y, order->w, order->h);
     }
 }
 
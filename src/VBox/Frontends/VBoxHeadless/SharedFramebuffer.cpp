@@ -0,0 +1,569 @@
+/* $Id$ */
+/** @file
+ * VBoxHeadless - Framebuffer exporting the guest screen as shared memory.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#include <VBox/com/com.h>
+#include <VBox/com/array.h>
+#include <VBox/com/string.h>
+#include <VBox/com/VirtualBox.h>
+
+using namespace com;
+
+#define LOG_GROUP LOG_GROUP_GUI
+#include <VBox/log.h>
+#include <VBox/err.h>
+#include <iprt/asm.h>
+#include <iprt/mem.h>
+#include <iprt/process.h>
+#include <iprt/string.h>
+#include <iprt/utf16.h>
+
+#ifndef RT_OS_WINDOWS
+# include <errno.h>
+# include <fcntl.h>
+# include <signal.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#include "SharedFramebuffer.h"
+
+#if defined(VBOX_WITH_XPCOM)
+NS_IMPL_THREADSAFE_ISUPPORTS1_CI(SharedFramebuffer, IFramebuffer)
+NS_DECL_CLASSINFO(SharedFramebuffer)
+#endif
+
+
+//
+// Constructor / destructor
+//
+
+SharedFramebuffer::SharedFramebuffer()
+    : mScreenId(0)
+    , mpbSource(NULL)
+    , mcbSourceLine(0)
+    , mWidth(0)
+    , mHeight(0)
+    , mpHdr(NULL)
+    , mcbSegment(0)
+#ifdef RT_OS_WINDOWS
+    , mhMapping(NULL)
+#else
+    , mpszShmName(NULL)
+#endif
+{
+    RT_ZERO(mCritSect);
+}
+
+SharedFramebuffer::~SharedFramebuffer()
+{
+    uninit();
+    if (RTCritSectIsInitialized(&mCritSect))
+        RTCritSectDelete(&mCritSect);
+}
+
+HRESULT SharedFramebuffer::FinalConstruct()
+{
+    return S_OK;
+}
+
+void SharedFramebuffer::FinalRelease()
+{
+    uninit();
+}
+
+/**
+ * Creates the shared memory segment.
+ *
+ * @returns COM status code
+ * @param   aDisplay    The display to query the source bitmaps from.
+ * @param   aScreenId   The guest screen this framebuffer will be attached to.
+ * @param   pszName     The base name of the segment, "-<screen>" is appended.
+ * @param   cbMaxFrame  The size of the pixel area, modes needing more are
+ *                      flagged with VBOXSHAREDFB_F_TOO_BIG.
+ */
+HRESULT SharedFramebuffer::init(const ComPtr<IDisplay> &aDisplay, ULONG aScreenId, const char *pszName, size_t cbMaxFrame)
+{
+    LogFlow(("SharedFramebuffer::init: screen %u name %s cbMaxFrame %#zx\n", aScreenId, pszName, cbMaxFrame));
+
+    mDisplay  = aDisplay;
+    mScreenId = aScreenId;
+
+    int rc = RTCritSectInit(&mCritSect);
+    AssertRCReturn(rc, E_FAIL);
+
+    size_t const offPixels = RT_ALIGN_Z(sizeof(VBOXSHAREDFBHDR), _4K);
+    cbMaxFrame = RT_ALIGN_Z(cbMaxFrame, _4K);
+    if (cbMaxFrame > UINT32_MAX - offPixels)
+        return E_INVALIDARG;
+
+    char *pszSegment = RTStrAPrintf2("%s-%u", pszName, aScreenId);
+    if (!pszSegment)
+        return E_OUTOFMEMORY;
+    rc = createSegment(pszSegment, offPixels + cbMaxFrame);
+    RTStrFree(pszSegment);
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("VBoxHeadless: Failed to create the shared framebuffer '%s-%u': %Rrc\n", pszName, aScreenId, rc));
+        return E_FAIL;
+    }
+
+    /* A fresh segment is zero filled. */
+    mpHdr->u32Version    = VBOXSHAREDFB_VERSION;
+    mpHdr->offPixels     = (uint32_t)offPixels;
+    mpHdr->cbPixels      = (uint32_t)cbMaxFrame;
+    mpHdr->uScreenId     = aScreenId;
+    mpHdr->uWriterPid    = (uint32_t)RTProcSelf();
+    mpHdr->fFlags        = VBOXSHAREDFB_F_BLANK;
+    mpHdr->cBitsPerPixel = 32;
+    ASMAtomicWriteU32(&mpHdr->u32Magic, VBOXSHAREDFB_MAGIC);
+
+#ifdef RT_OS_WINDOWS
+    HRESULT hr = CoCreateFreeThreadedMarshaler(this, m_pUnkMarshaler.asOutParam());
+    Log(("CoCreateFreeThreadedMarshaler hr %08X\n", hr)); NOREF(hr);
+#endif
+    return S_OK;
+}
+
+/**
+ * Marks the segment as terminated and releases it.  Consumers which still
+ * have it mapped keep the last frame.
+ *
+ * Late notifications from the display are ignored afterwards, the lock stays
+ * until the object is destroyed.
+ */
+void SharedFramebuffer::uninit()
+{
+    if (RTCritSectIsInitialized(&mCritSect))
+    {
+        RTCritSectEnter(&mCritSect);
+        if (mpHdr)
+            ASMAtomicOrU32(&mpHdr->fFlags, VBOXSHAREDFB_F_TERMINATED);
+        destroySegment();
+        mSourceBitmap.setNull();
+        mpbSource = NULL;
+        mDisplay.setNull();
+        RTCritSectLeave(&mCritSect);
+    }
+}
+
+/**
+ * Creates and maps a named shared memory segment.
+ *
+ * @returns IPRT status code.
+ * @param   pszName     The segment name.
+ * @param   cbSegment   The segment size.
+ */
+int SharedFramebuffer::createSegment(const char *pszName, size_t cbSegment)
+{
+#ifdef RT_OS_WINDOWS
+    char *pszMapping = RTStrAPrintf2("Local\\%s", pszName);
+    if (!pszMapping)
+        return VERR_NO_STR_MEMORY;
+    PRTUTF16 pwszMapping;
+    int rc = RTStrToUtf16(pszMapping, &pwszMapping);
+    RTStrFree(pszMapping);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    mhMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                   (DWORD)((uint64_t)cbSegment >> 32), (DWORD)cbSegment, pwszMapping);
+    DWORD dwErr = GetLastError();
+    RTUtf16Free(pwszMapping);
+    if (!mhMapping)
+        return RTErrConvertFromWin32(dwErr);
+    if (dwErr == ERROR_ALREADY_EXISTS)
+    {
+        /* Someone else owns this name, possibly another VM. */
+        CloseHandle(mhMapping);
+        mhMapping = NULL;
+        return VERR_ALREADY_EXISTS;
+    }
+
+    void *pv = MapViewOfFile(mhMapping, FILE_MAP_WRITE, 0, 0, cbSegment);
+    if (!pv)
+    {
+        rc = RTErrConvertFromWin32(GetLastError());
+        CloseHandle(mhMapping);
+        mhMapping = NULL;
+        return rc;
+    }
+#else
+    mpszShmName = RTStrAPrintf2("/%s", pszName);
+    if (!mpszShmName)
+        return VERR_NO_STR_MEMORY;
+
+    /* Consumers in the same group may map it read-only.  An existing segment
+     * of that name is only replaced if it was left behind by a writer which
+     * is gone (crashed VM), otherwise someone else owns the name. */
+    int fd = shm_open(mpszShmName, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP);
+    int iErr = fd < 0 ? errno : 0;
+    if (   iErr == EEXIST
+        && isStaleSegment(mpszShmName))
+    {
+        LogRel(("VBoxHeadless: Replacing stale shared framebuffer '%s'\n", mpszShmName));
+        shm_unlink(mpszShmName);
+        fd = shm_open(mpszShmName, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP);
+        iErr = fd < 0 ? errno : 0;
+    }
+    if (fd < 0)
+    {
+        /* Someone else owns this name, possibly another VM. */
+        int rc = iErr == EEXIST ? VERR_ALREADY_EXISTS : RTErrConvertFromErrno(iErr);
+        RTStrFree(mpszShmName);
+        mpszShmName = NULL;
+        return rc;
+    }
+
+    void *pv = MAP_FAILED;
+    int rc = VINF_SUCCESS;
+    if (ftruncate(fd, (off_t)cbSegment) == 0)
+    {
+        pv = mmap(NULL, cbSegment, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (pv == MAP_FAILED)
+            rc = RTErrConvertFromErrno(errno);
+    }
+    else
+        rc = RTErrConvertFromErrno(errno);
+    close(fd);
+    if (RT_FAILURE(rc))
+    {
+        shm_unlink(mpszShmName);
+        RTStrFree(mpszShmName);
+        mpszShmName = NULL;
+        return rc;
+    }
+#endif
+
+    mpHdr      = (PVBOXSHAREDFBHDR)pv;
+    mcbSegment = cbSegment;
+    return VINF_SUCCESS;
+}
+
+#ifndef RT_OS_WINDOWS
+/**
+ * Checks whether an existing shared memory segment was left behind by a writer
+ * process which no longer exists.
+ *
+ * @returns true if the segment is ours to replace, false if it is in use or
+ *          doesn't look like one of our segments.
+ * @param   pszShmName  The POSIX shared memory object name.
+ */
+/*static*/ bool SharedFramebuffer::isStaleSegment(const char *pszShmName)
+{
+    int fd = shm_open(pszShmName, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    bool        fStale = false;
+    struct stat St;
+    if (   fstat(fd, &St) == 0
+        && St.st_size >= (off_t)sizeof(VBOXSHAREDFBHDR))
+    {
+        void *pv = mmap(NULL, sizeof(VBOXSHAREDFBHDR), PROT_READ, MAP_SHARED, fd, 0);
+        if (pv != MAP_FAILED)
+        {
+            PVBOXSHAREDFBHDR  pHdr = (PVBOXSHAREDFBHDR)pv;
+            pid_t const       pid  = (pid_t)pHdr->uWriterPid;
+            if (   ASMAtomicReadU32(&pHdr->u32Magic) == VBOXSHAREDFB_MAGIC
+                && pid > 0
+                && kill(pid, 0) != 0
+                && errno == ESRCH)
+                fStale = true;
+            munmap(pv, sizeof(VBOXSHAREDFBHDR));
+        }
+    }
+    close(fd);
+    return fStale;
+}
+#endif
+
+/**
+ * Unmaps and removes the shared memory segment.
+ */
+void SharedFramebuffer::destroySegment()
+{
+#ifdef RT_OS_WINDOWS
+    if (mpHdr)
+        UnmapViewOfFile((void *)mpHdr);
+    if (mhMapping)
+        CloseHandle(mhMapping);
+    mhMapping = NULL;
+#else
+    if (mpHdr)
+        munmap((void *)mpHdr, mcbSegment);
+    if (mpszShmName)
+    {
+        shm_unlink(mpszShmName);
+        RTStrFree(mpszShmName);
+        mpszShmName = NULL;
+    }
+#endif
+    mpHdr      = NULL;
+    mcbSegment = 0;
+}
+
+/**
+ * Appends a rectangle to the damage ring and bumps the generation.
+ *
+ * @remarks Caller owns mCritSect, the pixels must have been copied already.
+ */
+void SharedFramebuffer::publishDamage(uint32_t x, uint32_t y, uint32_t cx, uint32_t cy)
+{
+    uint64_t const     iEntry = mpHdr->u64Generation;
+    PVBOXSHAREDFBDAMAGE pEntry = &mpHdr->aDamage[iEntry % VBOXSHAREDFB_DAMAGE_ENTRIES];
+
+    /* Invalidate the entry while rewriting it, so a consumer reading the
+     * previous lap's rectangle notices. */
+    ASMAtomicWriteU64(&pEntry->u64Generation, 0);
+    pEntry->x  = x;
+    pEntry->y  = y;
+    pEntry->cx = cx;
+    pEntry->cy = cy;
+    ASMAtomicWriteU64(&pEntry->u64Generation, iEntry + 1);
+    ASMAtomicWriteU64(&mpHdr->u64Generation, iEntry + 1);
+}
+
+/**
+ * Copies a rectangle from the source bitmap to the pixel area.
+ *
+ * @remarks Caller owns mCritSect and has clipped the rectangle.
+ */
+void SharedFramebuffer::copyRect(uint32_t x, uint32_t y, uint32_t cx, uint32_t cy)
+{
+    uint32_t const cbDstLine = mWidth * 4;
+    const uint8_t *pbSrc = mpbSource + (size_t)y * mcbSourceLine + x * 4;
+    uint8_t       *pbDst = (uint8_t *)mpHdr + mpHdr->offPixels + (size_t)y * cbDstLine + x * 4;
+    if (cx == mWidth && mcbSourceLine == cbDstLine)
+        memcpy(pbDst, pbSrc, (size_t)cy * cbDstLine);
+    else
+        for (uint32_t i = 0; i < cy; i++, pbSrc += mcbSourceLine, pbDst += cbDstLine)
+            memcpy(pbDst, pbSrc, cx * 4);
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(Width)(ULONG *width)
+{
+    if (!width)
+        return E_INVALIDARG;
+    *width = mWidth;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(Height)(ULONG *height)
+{
+    if (!height)
+        return E_INVALIDARG;
+    *height = mHeight;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(BitsPerPixel)(ULONG *bitsPerPixel)
+{
+    if (!bitsPerPixel)
+        return E_INVALIDARG;
+    *bitsPerPixel = 32;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(BytesPerLine)(ULONG *bytesPerLine)
+{
+    if (!bytesPerLine)
+        return E_INVALIDARG;
+    *bytesPerLine = mWidth * 4;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(PixelFormat)(BitmapFormat_T *pixelFormat)
+{
+    if (!pixelFormat)
+        return E_POINTER;
+    *pixelFormat = BitmapFormat_BGR;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(HeightReduction)(ULONG *heightReduction)
+{
+    if (!heightReduction)
+        return E_POINTER;
+    *heightReduction = 0;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(Overlay)(IFramebufferOverlay **aOverlay)
+{
+    if (!aOverlay)
+        return E_POINTER;
+    *aOverlay = NULL;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(WinId)(LONG64 *winId)
+{
+    if (!winId)
+        return E_POINTER;
+    *winId = 0;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::COMGETTER(Capabilities)(ComSafeArrayOut(FramebufferCapabilities_T, aCapabilities))
+{
+    if (ComSafeArrayOutIsNull(aCapabilities))
+        return E_POINTER;
+
+    /* No caps, the pixels are taken straight from the source bitmap. */
+    com::SafeArray<FramebufferCapabilities_T> caps;
+    caps.detachTo(ComSafeArrayOutArg(aCapabilities));
+    return S_OK;
+}
+
+/**
+ * Copies the updated rectangle to the segment and publishes it.
+ *
+ * @returns COM status code
+ * @param   x        Update region upper left corner x value.
+ * @param   y        Update region upper left corner y value.
+ * @param   w        Update region width in pixels.
+ * @param   h        Update region height in pixels.
+ */
+STDMETHODIMP SharedFramebuffer::NotifyUpdate(ULONG x, ULONG y, ULONG w, ULONG h)
+{
+    RTCritSectEnter(&mCritSect);
+    if (   mpHdr
+        && mpbSource
+        && !(mpHdr->fFlags & (VBOXSHAREDFB_F_BLANK | VBOXSHAREDFB_F_TOO_BIG))
+        && x < mWidth
+        && y < mHeight)
+    {
+        w = RT_MIN(w, mWidth - x);
+        h = RT_MIN(h, mHeight - y);
+        if (w && h)
+        {
+            copyRect(x, y, w, h);
+            publishDamage(x, y, w, h);
+        }
+    }
+    RTCritSectLeave(&mCritSect);
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::NotifyUpdateImage(ULONG aX, ULONG aY, ULONG aWidth, ULONG aHeight,
+                                                  ComSafeArrayIn(BYTE, aImage))
+{
+    /* Not requested in the capabilities. */
+    RT_NOREF(aX, aY, aWidth, aHeight); ComSafeArrayNoRef(aImage);
+    return E_NOTIMPL;
+}
+
+/**
+ * Switches to the new source bitmap and republishes the whole screen.
+ */
+STDMETHODIMP SharedFramebuffer::NotifyChange(ULONG aScreenId, ULONG aXOrigin, ULONG aYOrigin, ULONG aWidth, ULONG aHeight)
+{
+    LogRel2(("VBoxHeadless: Shared framebuffer change: %d %d,%d %dx%d\n", aScreenId, aXOrigin, aYOrigin, aWidth, aHeight));
+
+    ComPtr<IDisplaySourceBitmap> pSourceBitmap;
+    BYTE          *pbAddress      = NULL;
+    ULONG          ulWidth        = 0;
+    ULONG          ulHeight       = 0;
+    ULONG          ulBitsPerPixel = 0;
+    ULONG          ulBytesPerLine = 0;
+    BitmapFormat_T enmFormat      = BitmapFormat_Opaque;
+
+    RTCritSectEnter(&mCritSect);
+    ComPtr<IDisplay> pDisplay = mDisplay;
+    RTCritSectLeave(&mCritSect);
+    if (!pDisplay.isNull())
+    {
+        pDisplay->QuerySourceBitmap(aScreenId, pSourceBitmap.asOutParam());
+        if (!pSourceBitmap.isNull())
+            pSourceBitmap->QueryBitmapInfo(&pbAddress, &ulWidth, &ulHeight, &ulBitsPerPixel, &ulBytesPerLine, &enmFormat);
+    }
+
+    RTCritSectEnter(&mCritSect);
+
+    mSourceBitmap = pSourceBitmap;
+    mpbSource     = ulBitsPerPixel == 32 ? pbAddress : NULL;
+    mcbSourceLine = ulBytesPerLine;
+    mWidth        = ulWidth;
+    mHeight       = ulHeight;
+
+    if (mpHdr)
+    {
+        uint32_t fFlags = 0;
+        if (!mpbSource || !ulWidth || !ulHeight)
+            fFlags |= VBOXSHAREDFB_F_BLANK;
+        else if ((uint64_t)ulWidth * 4 * ulHeight > mpHdr->cbPixels)
+        {
+            LogRel(("VBoxHeadless: Screen %u mode %ux%u does not fit into the shared framebuffer\n",
+                    aScreenId, ulWidth, ulHeight));
+            fFlags |= VBOXSHAREDFB_F_TOO_BIG;
+        }
+
+        ASMAtomicIncU32(&mpHdr->u32ModeSeq);
+        mpHdr->fFlags        = fFlags;
+        mpHdr->cx            = ulWidth;
+        mpHdr->cy            = ulHeight;
+        mpHdr->cbLine        = ulWidth * 4;
+        mpHdr->cBitsPerPixel = 32;
+        mpHdr->xOrigin       = (int32_t)aXOrigin;
+        mpHdr->yOrigin       = (int32_t)aYOrigin;
+        ASMAtomicIncU32(&mpHdr->u32ModeSeq);
+
+        if (!fFlags)
+        {
+            copyRect(0, 0, ulWidth, ulHeight);
+            publishDamage(0, 0, ulWidth, ulHeight);
+        }
+    }
+
+    RTCritSectLeave(&mCritSect);
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::VideoModeSupported(ULONG width, ULONG height, ULONG bpp, BOOL *supported)
+{
+    RT_NOREF(width, height, bpp);
+    if (!supported)
+        return E_POINTER;
+    /* Modes which don't fit are flagged rather than refused. */
+    *supported = TRUE;
+    return S_OK;
+}
+
+STDMETHODIMP SharedFramebuffer::GetVisibleRegion(BYTE *aRectangles, ULONG aCount, ULONG *aCountCopied)
+{
+    RT_NOREF(aRectangles, aCount, aCountCopied);
+    return E_NOTIMPL;
+}
+
+STDMETHODIMP SharedFramebuffer::SetVisibleRegion(BYTE *aRectangles, ULONG aCount)
+{
+    RT_NOREF(aRectangles, aCount);
+    return E_NOTIMPL;
+}
+
+STDMETHODIMP SharedFramebuffer::ProcessVHWACommand(BYTE *pCommand)
+{
+    RT_NOREF(pCommand);
+    return E_NOTIMPL;
+}
+
+STDMETHODIMP SharedFramebuffer::Notify3DEvent(ULONG uType, ComSafeArrayIn(BYTE, aData))
+{
+    RT_NOREF(uType); ComSafeArrayNoRef(aData);
+    return E_NOTIMPL;
+}
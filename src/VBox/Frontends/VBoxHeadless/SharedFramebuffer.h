@@ -0,0 +1,124 @@
+/* $Id$ */
+/** @file
+ * VBoxHeadless - Framebuffer exporting the guest screen as shared memory.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ___VBoxHeadless_SharedFramebuffer_h
+#define ___VBoxHeadless_SharedFramebuffer_h
+
+#include <VBox/com/com.h>
+#include <VBox/com/ptr.h>
+#include <VBox/com/VirtualBox.h>
+#include <VBox/VBoxSharedFB.h>
+
+#include <iprt/critsect.h>
+
+#ifdef RT_OS_WINDOWS
+# include <windows.h>
+#endif
+
+
+/**
+ * Framebuffer which keeps a copy of one guest screen in a named shared memory
+ * segment, see VBoxSharedFB.h for the layout.
+ *
+ * The pixels come from the display source bitmap and are copied once per
+ * update into the segment, consumers map the segment read-only and only read
+ * the damaged rectangles.
+ */
+class ATL_NO_VTABLE SharedFramebuffer :
+    public ATL::CComObjectRootEx<ATL::CComMultiThreadModel>,
+    VBOX_SCRIPTABLE_IMPL(IFramebuffer)
+{
+public:
+    SharedFramebuffer();
+    virtual ~SharedFramebuffer();
+
+    HRESULT init(const ComPtr<IDisplay> &aDisplay, ULONG aScreenId, const char *pszName, size_t cbMaxFrame);
+    void uninit();
+
+    DECLARE_NOT_AGGREGATABLE(SharedFramebuffer)
+
+    DECLARE_PROTECT_FINAL_CONSTRUCT()
+
+    BEGIN_COM_MAP(SharedFramebuffer)
+        COM_INTERFACE_ENTRY(IFramebuffer)
+        COM_INTERFACE_ENTRY2(IDispatch,IFramebuffer)
+        COM_INTERFACE_ENTRY_AGGREGATE(IID_IMarshal, m_pUnkMarshaler.m_p)
+    END_COM_MAP()
+
+    HRESULT FinalConstruct();
+    void FinalRelease();
+
+    STDMETHOD(COMGETTER(Width))(ULONG *width);
+    STDMETHOD(COMGETTER(Height))(ULONG *height);
+    STDMETHOD(COMGETTER(BitsPerPixel))(ULONG *bitsPerPixel);
+    STDMETHOD(COMGETTER(BytesPerLine))(ULONG *bytesPerLine);
+    STDMETHOD(COMGETTER(PixelFormat))(BitmapFormat_T *pixelFormat);
+    STDMETHOD(COMGETTER(HeightReduction))(ULONG *heightReduction);
+    STDMETHOD(COMGETTER(Overlay))(IFramebufferOverlay **aOverlay);
+    STDMETHOD(COMGETTER(WinId))(LONG64 *winId);
+    STDMETHOD(COMGETTER(Capabilities))(ComSafeArrayOut(FramebufferCapabilities_T, aCapabilities));
+
+    STDMETHOD(NotifyUpdate)(ULONG x, ULONG y, ULONG w, ULONG h);
+    STDMETHOD(NotifyUpdateImage)(ULONG x, ULONG y, ULONG w, ULONG h, ComSafeArrayIn(BYTE, aImage));
+    STDMETHOD(NotifyChange)(ULONG aScreenId, ULONG aXOrigin, ULONG aYOrigin, ULONG aWidth, ULONG aHeight);
+    STDMETHOD(VideoModeSupported)(ULONG width, ULONG height, ULONG bpp, BOOL *supported);
+    STDMETHOD(GetVisibleRegion)(BYTE *aRectangles, ULONG aCount, ULONG *aCountCopied);
+    STDMETHOD(SetVisibleRegion)(BYTE *aRectangles, ULONG aCount);
+    STDMETHOD(ProcessVHWACommand)(BYTE *pCommand);
+    STDMETHOD(Notify3DEvent)(ULONG uType, ComSafeArrayIn(BYTE, aData));
+
+private:
+    int  createSegment(const char *pszName, size_t cbSegment);
+    void destroySegment();
+#ifndef RT_OS_WINDOWS
+    static bool isStaleSegment(const char *pszShmName);
+#endif
+    void publishDamage(uint32_t x, uint32_t y, uint32_t cx, uint32_t cy);
+    void copyRect(uint32_t x, uint32_t y, uint32_t cx, uint32_t cy);
+
+    /** The display we get the source bitmaps from. */
+    ComPtr<IDisplay> mDisplay;
+    /** The screen this framebuffer is attached to. */
+    ULONG mScreenId;
+    /** Protects the source bitmap and the segment against concurrent updates. */
+    RTCRITSECT mCritSect;
+    /** The current source bitmap. */
+    ComPtr<IDisplaySourceBitmap> mSourceBitmap;
+    /** The pixels of the source bitmap, NULL if there is nothing to show. */
+    uint8_t *mpbSource;
+    /** Bytes per line in the source bitmap. */
+    ULONG mcbSourceLine;
+    /** Width of the current mode. */
+    ULONG mWidth;
+    /** Height of the current mode. */
+    ULONG mHeight;
+
+    /** The mapped segment, NULL if not created. */
+    PVBOXSHAREDFBHDR mpHdr;
+    /** The size of the mapping. */
+    size_t mcbSegment;
+#ifdef RT_OS_WINDOWS
+    /** The file mapping handle. */
+    HANDLE mhMapping;
+    ComPtr<IUnknown> m_pUnkMarshaler;
+#else
+    /** The name of the shared memory object, for unlinking it again. */
+    char *mpszShmName;
+#endif
+};
+
+#endif /* !___VBoxHeadless_SharedFramebuffer_h */
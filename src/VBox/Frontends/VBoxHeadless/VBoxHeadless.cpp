@@ -43,6 +43,8 @@ using namespace com;
 #include <VBox/err.h>
 #include <VBox/VBoxVideo.h>
 
+#include "SharedFramebuffer.h"
+
 #ifdef VBOX_WITH_VPX
 # include <cstdlib>
 # include <cerrno>
@@ -463,6 +465,9 @@ static void show_usage()
              "   --settingspwfile <file>           Specify a file containing the\n"
              "                                       settings password\n"
              "   -start-paused, --start-paused     Start the VM in paused state\n"
+             "   --shared-framebuffer <name>       Export each guest screen as shared memory\n"
+             "                                       named <name>-<screen> for external\n"
+             "                                       viewers (see VBox/VBoxSharedFB.h)\n"
 #ifdef VBOX_WITH_VPX
              "   -c, -capture, --capture           Record the VM screen output to a file\n"
              "   -w, --width                       Frame width when recording\n"
@@ -625,6 +630,7 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
     unsigned fPATM  = ~0U;
     unsigned fCSAM  = ~0U;
     unsigned fPaused = 0;
+    const char *pszSharedFB = NULL;
 #ifdef VBOX_WITH_VPX
     bool fVideoRec = 0;
     unsigned long ulFrameWidth = 800;
@@ -660,7 +666,8 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
         OPT_SETTINGSPW,
         OPT_SETTINGSPW_FILE,
         OPT_COMMENT,
-        OPT_PAUSED
+        OPT_PAUSED,
+        OPT_SHARED_FB
     };
 
     static const RTGETOPTDEF s_aOptions[] =
@@ -706,7 +713,8 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
         { "-comment", OPT_COMMENT, RTGETOPT_REQ_STRING },
         { "--comment", OPT_COMMENT, RTGETOPT_REQ_STRING },
         { "-start-paused", OPT_PAUSED, 0 },
-        { "--start-paused", OPT_PAUSED, 0 }
+        { "--start-paused", OPT_PAUSED, 0 },
+        { "--shared-framebuffer", OPT_SHARED_FB, RTGETOPT_REQ_STRING }
     };
 
     const char *pcszNameOrUUID = NULL;
@@ -779,6 +787,9 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
             case OPT_PAUSED:
                 fPaused = true;
                 break;
+            case OPT_SHARED_FB:
+                pszSharedFB = ValueUnion.psz;
+                break;
 #ifdef VBOX_WITH_VPX
             case 'c':
                 fVideoRec = true;
@@ -880,6 +891,8 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
     ComPtr<IEventListener> vboxClientListener;
     ComPtr<IEventListener> vboxListener;
     ComObjPtr<ConsoleEventListenerImpl> consoleListener;
+    ComObjPtr<SharedFramebuffer> aSharedFBs[64];
+    Bstr aSharedFBIds[64];
 
     do
     {
@@ -957,6 +970,30 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
         ComPtr<IDisplay> display;
         CHECK_ERROR_BREAK(console, COMGETTER(Display)(display.asOutParam()));
 
+        if (pszSharedFB)
+        {
+            /* The pixel area of each screen is sized like the VRAM, which is
+             * what a 32 bpp mode can use at most. */
+            ULONG cMonitors = 1;
+            ULONG cMBVRAM = 0;
+            CHECK_ERROR_BREAK(machine, COMGETTER(MonitorCount)(&cMonitors));
+            CHECK_ERROR_BREAK(machine, COMGETTER(VRAMSize)(&cMBVRAM));
+            cMonitors = RT_MIN(cMonitors, (ULONG)RT_ELEMENTS(aSharedFBs));
+            for (ULONG i = 0; i < cMonitors; i++)
+            {
+                aSharedFBs[i].createObject();
+                rc = aSharedFBs[i]->init(display, i, pszSharedFB, (size_t)cMBVRAM * _1M);
+                if (FAILED(rc))
+                {
+                    RTPrintf("Error: Failed to create the shared framebuffer '%s-%u'\n", pszSharedFB, i);
+                    break;
+                }
+                CHECK_ERROR_BREAK(display, AttachFramebuffer(i, aSharedFBs[i], aSharedFBIds[i].asOutParam()));
+            }
+            if (FAILED(rc))
+                break;
+        }
+
 #ifdef VBOX_WITH_VPX
         if (fVideoRec)
         {
@@ -1297,6 +1334,21 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
         vboxClientListener.setNull();
     }
 
+    /* Detach the shared framebuffers and remove their segments. */
+    for (ULONG i = 0; i < RT_ELEMENTS(aSharedFBs); i++)
+        if (!aSharedFBs[i].isNull())
+        {
+            if (gConsole && !aSharedFBIds[i].isEmpty())
+            {
+                ComPtr<IDisplay> display;
+                gConsole->COMGETTER(Display)(display.asOutParam());
+                if (!display.isNull())
+                    display->DetachFramebuffer(i, aSharedFBIds[i].raw());
+            }
+            aSharedFBs[i]->uninit();
+            aSharedFBs[i].setNull();
+        }
+
     /* No more access to the 'console' object, which will be uninitialized by the next session->Close call. */
     gConsole = NULL;
 
@@ -23,14 +23,25 @@
 #include "shflhandle.h"
 #include "vbsf.h"
 #include <iprt/alloc.h>
+#include <iprt/asm.h>
 #include <iprt/string.h>
 #include <iprt/assert.h>
+#include <iprt/critsect.h>
+#include <iprt/list.h>
+#include <iprt/req.h>
+#include <iprt/semaphore.h>
+#include <iprt/time.h>
 #include <VBox/vmm/ssm.h>
 #include <VBox/vmm/pdmifs.h>
 
 #define SHFL_SSM_VERSION_FOLDERNAME_UTF16   2
 #define SHFL_SSM_VERSION                    3
 
+/** Maximum number of worker threads executing guest requests. */
+#define SHFL_ASYNC_MAX_THREADS              8
+/** Milliseconds a worker thread may be idle before it is shut down. */
+#define SHFL_ASYNC_IDLE_MS                  10000
+
 
 /** @page pg_shfl_svc   Shared Folders Host Service
  *
@@ -73,12 +84,97 @@
 PVBOXHGCMSVCHELPERS g_pHelpers;
 static PPDMLED      pStatusLed = NULL;
 
+/**
+ * A guest request which is executed on a worker thread.
+ */
+typedef struct SHFLASYNCREQ
+{
+    /** Node in g_lstAsyncReqs. */
+    RTLISTNODE          Node;
+    /** The HGCM call to complete. */
+    VBOXHGCMCALLHANDLE  callHandle;
+    /** The client the request came from. */
+    SHFLCLIENTDATA     *pClient;
+    /** The SHFL_FN_XXX function. */
+    uint32_t            u32Function;
+    /** Number of parameters. */
+    uint32_t            cParms;
+    /** The parameters, valid until the call is completed. */
+    VBOXHGCMSVCPARM    *paParms;
+    /** The handle the request works on. */
+    SHFLHANDLE          Handle;
+    /** The root the handle belongs to, SHFL_ROOT_NIL if not known. */
+    SHFLROOT            root;
+    /** When the request was received (RTTimeNanoTS). */
+    uint64_t            nsReceived;
+} SHFLASYNCREQ;
+/** Pointer to an asynchronous guest request. */
+typedef SHFLASYNCREQ *PSHFLASYNCREQ;
+
+/**
+ * Per function statistics, written to the release log when the service is unloaded.
+ */
+typedef struct SHFLFNSTATS
+{
+    /** Number of calls. */
+    uint64_t            cCalls;
+    /** Number of calls executed on a worker thread. */
+    uint64_t            cAsync;
+    /** Total nanoseconds from receiving to completing the calls. */
+    uint64_t            cNsTotal;
+    /** The longest call in nanoseconds. */
+    uint64_t            cNsMax;
+} SHFLFNSTATS;
+
+/** The worker threads, NIL_RTREQPOOL if everything is done on the service thread. */
+static RTREQPOOL        g_hAsyncPool = NIL_RTREQPOOL;
+/** Protects the request list and the statistics. */
+static RTCRITSECT       g_AsyncCritSect;
+/** The requests handed to the worker threads, in the order they were received. */
+static RTLISTANCHOR     g_lstAsyncReqs;
+/** Signalled whenever a worker thread has finished a request. */
+static RTSEMEVENT       g_hAsyncDoneEvent = NIL_RTSEMEVENT;
+/** Number of requests in g_lstAsyncReqs. */
+static uint32_t         g_cAsyncReqs;
+/** The highest g_cAsyncReqs seen. */
+static uint32_t         g_cAsyncReqsMax;
+/** Call statistics indexed by SHFL_FN_XXX. */
+static SHFLFNSTATS      g_aFnStats[SHFL_FN_SET_SYMLINKS + 1];
+/** Number of reads in progress, the reading LED is on while not zero. */
+static uint32_t volatile g_cLedReading;
+/** Number of writes in progress, the writing LED is on while not zero. */
+static uint32_t volatile g_cLedWriting;
+#ifdef UNITTEST
+/** Set by the testcase before loading the service to get the worker threads.
+ * Most of the tests expect every call to be completed right away. */
+bool                    g_fTestUseWorkerThreads = false;
+#endif
+
+static void svcAsyncWait(SHFLCLIENTDATA *pClient, SHFLROOT root);
+static void svcStatsReport(void);
+
 static DECLCALLBACK(int) svcUnload (void *)
 {
     int rc = VINF_SUCCESS;
 
     Log(("svcUnload\n"));
 
+    svcAsyncWait(NULL, SHFL_ROOT_NIL);
+    svcStatsReport();
+
+    if (g_hAsyncPool != NIL_RTREQPOOL)
+    {
+        RTReqPoolRelease(g_hAsyncPool);
+        g_hAsyncPool = NIL_RTREQPOOL;
+    }
+    if (g_hAsyncDoneEvent != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(g_hAsyncDoneEvent);
+        g_hAsyncDoneEvent = NIL_RTSEMEVENT;
+    }
+    if (RTCritSectIsInitialized(&g_AsyncCritSect))
+        RTCritSectDelete(&g_AsyncCritSect);
+
     return rc;
 }
 
@@ -100,6 +196,9 @@ static DECLCALLBACK(int) svcDisconnect (void *, uint32_t u32ClientID, void *pvCl
 
     Log(("SharedFolders host service: disconnected, u32ClientID = %u\n", u32ClientID));
 
+    /* The worker threads must be done with the client's handles. */
+    svcAsyncWait(pClient, SHFL_ROOT_NIL);
+
     vbsfDisconnect(pClient);
     return rc;
 }
@@ -118,6 +217,9 @@ static DECLCALLBACK(int) svcSaveState(void *, uint32_t u32ClientID, void *pvClie
 
     Log(("SharedFolders host service: saving state, u32ClientID = %u\n", u32ClientID));
 
+    /* Let the worker threads complete what they are doing. */
+    svcAsyncWait(pClient, SHFL_ROOT_NIL);
+
     int rc = SSMR3PutU32(pSSM, SHFL_SSM_VERSION);
     AssertRCReturn(rc, rc);
 
@@ -295,24 +397,55 @@ static DECLCALLBACK(int) svcLoadState(void *, uint32_t u32ClientID, void *pvClie
     return VINF_SUCCESS;
 }
 
-static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32_t u32ClientID, void *pvClient, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[])
+/**
+ * Turns on the reading or writing LED for a request.
+ *
+ * Requests are executed concurrently by the worker threads, so the LED stays
+ * on until the last of them called svcLedOff().
+ *
+ * @param   fLed            PDMLED_READING or PDMLED_WRITING.
+ */
+static void svcLedOn(uint32_t fLed)
 {
-    RT_NOREF1(u32ClientID);
-    int rc = VINF_SUCCESS;
-
-    Log(("SharedFolders host service: svcCall: u32ClientID = %u, fn = %u, cParms = %u, pparms = %p\n", u32ClientID, u32Function, cParms, paParms));
-
-    SHFLCLIENTDATA *pClient = (SHFLCLIENTDATA *)pvClient;
-
-    bool fAsynchronousProcessing = false;
+    if (!pStatusLed)
+        return;
+    Assert(pStatusLed->u32Magic == PDMLED_MAGIC);
+    ASMAtomicIncU32(fLed == PDMLED_READING ? &g_cLedReading : &g_cLedWriting);
+    ASMAtomicOrU32(&pStatusLed->Actual.u32, fLed);
+    ASMAtomicOrU32(&pStatusLed->Asserted.u32, fLed);
+}
 
-#ifdef LOG_ENABLED
-    for (uint32_t i = 0; i < cParms; i++)
+/**
+ * Turns off the reading or writing LED when no other request is using it.
+ *
+ * @param   fLed            PDMLED_READING or PDMLED_WRITING.
+ */
+static void svcLedOff(uint32_t fLed)
+{
+    if (!pStatusLed)
+        return;
+    uint32_t volatile *pcActive = fLed == PDMLED_READING ? &g_cLedReading : &g_cLedWriting;
+    if (ASMAtomicDecU32(pcActive) == 0)
     {
-        /** @todo parameters other than 32 bit */
-        Log(("    pparms[%d]: type %u, value %u\n", i, paParms[i].type, paParms[i].u.uint32));
+        ASMAtomicAndU32(&pStatusLed->Actual.u32, ~fLed);
+        /* Another request may have turned it on before we turned it off. */
+        if (ASMAtomicReadU32(pcActive) != 0)
+            ASMAtomicOrU32(&pStatusLed->Actual.u32, fLed);
     }
-#endif
+}
+
+/**
+ * Executes a guest request, either on the service thread or on a worker thread.
+ *
+ * @returns VBox status code to complete the call with.
+ * @param   pClient         The client data.
+ * @param   u32Function     The SHFL_FN_XXX function.
+ * @param   cParms          Number of parameters.
+ * @param   paParms         The parameters.
+ */
+static int svcCallExecute(SHFLCLIENTDATA *pClient, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[])
+{
+    int rc = VINF_SUCCESS;
 
     switch (u32Function)
     {
@@ -555,15 +688,9 @@ static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32
                 else
                 {
                     /* Execute the function. */
-                    if (pStatusLed)
-                    {
-                        Assert(pStatusLed->u32Magic == PDMLED_MAGIC);
-                        pStatusLed->Asserted.s.fReading = pStatusLed->Actual.s.fReading = 1;
-                    }
-
+                    svcLedOn(PDMLED_READING);
                     rc = vbsfRead (pClient, root, Handle, offset, &count, pBuffer);
-                    if (pStatusLed)
-                        pStatusLed->Actual.s.fReading = 0;
+                    svcLedOff(PDMLED_READING);
 
                     if (RT_SUCCESS(rc))
                     {
@@ -622,15 +749,9 @@ static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32
                 else
                 {
                     /* Execute the function. */
-                    if (pStatusLed)
-                    {
-                        Assert(pStatusLed->u32Magic == PDMLED_MAGIC);
-                        pStatusLed->Asserted.s.fWriting = pStatusLed->Actual.s.fWriting = 1;
-                    }
-
+                    svcLedOn(PDMLED_WRITING);
                     rc = vbsfWrite (pClient, root, Handle, offset, &count, pBuffer);
-                    if (pStatusLed)
-                        pStatusLed->Actual.s.fWriting = 0;
+                    svcLedOff(PDMLED_WRITING);
 
                     if (RT_SUCCESS(rc))
                     {
@@ -687,15 +808,9 @@ static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32
                 else if (flags & SHFL_LOCK_WAIT)
                 {
                     /** @todo This should be properly implemented by the shared folders service.
-                     *       The service thread must never block. If an operation requires
-                     *       blocking, it must be processed by another thread and when it is
-                     *       completed, the another thread must call
-                     *
-                     *           g_pHelpers->pfnCallComplete (callHandle, rc);
-                     *
-                     * The operation is async.
-                     * fAsynchronousProcessing = true;
-                     */
+                     *       The service thread must never block, and a worker thread waiting
+                     *       here would hold up all other requests for the handle, including
+                     *       the one releasing the lock. */
 
                     /* Here the operation must be posted to another thread. At the moment it is not implemented.
                      * Until it is implemented, try to perform the operation without waiting.
@@ -776,17 +891,10 @@ static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32
                 }
                 else
                 {
-                    if (pStatusLed)
-                    {
-                        Assert(pStatusLed->u32Magic == PDMLED_MAGIC);
-                        pStatusLed->Asserted.s.fReading = pStatusLed->Actual.s.fReading = 1;
-                    }
-
                     /* Execute the function. */
+                    svcLedOn(PDMLED_READING);
                     rc = vbsfDirList (pClient, root, Handle, pPath, flags, &length, pBuffer, &resumePoint, &cFiles);
-
-                    if (pStatusLed)
-                        pStatusLed->Actual.s.fReading = 0;
+                    svcLedOff(PDMLED_READING);
 
                     if (rc == VERR_NO_MORE_FILES && cFiles != 0)
                         rc = VINF_SUCCESS; /* Successfully return these files. */
@@ -992,6 +1100,11 @@ static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32
                 /* Fetch parameters. */
                 SHFLROOT    root       = (SHFLROOT)paParms[0].u.uint32;
 
+                /* The worker threads must be done with the mapping before it
+                 * can go away.  Only this thread submits requests, so no new
+                 * ones show up while waiting. */
+                svcAsyncWait(NULL, root);
+
                 /* Execute the function. */
                 rc = vbsfUnmapFolder (pClient, root);
 
@@ -1267,15 +1380,260 @@ static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32
     }
 
     LogFlow(("SharedFolders host service: svcCall: rc=%Rrc\n", rc));
+    return rc;
+}
 
-    if (   !fAsynchronousProcessing
-        || RT_FAILURE (rc))
+/**
+ * Accounts a completed call in the statistics.
+ *
+ * @param   u32Function     The SHFL_FN_XXX function.
+ * @param   nsReceived      When the call was received (RTTimeNanoTS).
+ * @param   fAsync          Whether it was executed on a worker thread.
+ */
+static void svcStatsAdd(uint32_t u32Function, uint64_t nsReceived, bool fAsync)
+{
+    if (u32Function >= RT_ELEMENTS(g_aFnStats))
+        return;
+
+    uint64_t const cNs = RTTimeNanoTS() - nsReceived;
+
+    RTCritSectEnter(&g_AsyncCritSect);
+    SHFLFNSTATS *pStats = &g_aFnStats[u32Function];
+    pStats->cCalls++;
+    if (fAsync)
+        pStats->cAsync++;
+    pStats->cNsTotal += cNs;
+    if (cNs > pStats->cNsMax)
+        pStats->cNsMax = cNs;
+    RTCritSectLeave(&g_AsyncCritSect);
+}
+
+/**
+ * Writes the call statistics to the release log.
+ */
+static void svcStatsReport(void)
+{
+    if (!RTCritSectIsInitialized(&g_AsyncCritSect))
+        return;
+
+    RTCritSectEnter(&g_AsyncCritSect);
+    LogRel(("SharedFolders: At most %u requests were queued for the worker threads\n", g_cAsyncReqsMax));
+    for (uint32_t i = 0; i < RT_ELEMENTS(g_aFnStats); i++)
     {
-        /* Complete the operation if it was unsuccessful or
-         * it was processed synchronously.
-         */
-        g_pHelpers->pfnCallComplete (callHandle, rc);
+        SHFLFNSTATS const *pStats = &g_aFnStats[i];
+        if (pStats->cCalls)
+            LogRel(("SharedFolders: Function %2u: %RU64 calls (%RU64 on worker threads), average %RU64 us, max %RU64 us\n",
+                    i, pStats->cCalls, pStats->cAsync, pStats->cNsTotal / pStats->cCalls / RT_NS_1US,
+                    pStats->cNsMax / RT_NS_1US));
     }
+    RTCritSectLeave(&g_AsyncCritSect);
+}
+
+/**
+ * Looks for the oldest request for a handle.
+ *
+ * @returns The request, NULL if none. Caller must own g_AsyncCritSect.
+ * @param   pClient         The client data.
+ * @param   Handle          The handle.
+ */
+static PSHFLASYNCREQ svcAsyncFindHandle(SHFLCLIENTDATA *pClient, SHFLHANDLE Handle)
+{
+    PSHFLASYNCREQ pReq;
+    RTListForEach(&g_lstAsyncReqs, pReq, SHFLASYNCREQ, Node)
+    {
+        if (   pReq->pClient == pClient
+            && pReq->Handle  == Handle)
+            return pReq;
+    }
+    return NULL;
+}
+
+/**
+ * Worker thread function, executes a request and then all requests
+ * for the same handle which were queued behind it.
+ *
+ * @param   pReq            The request.
+ */
+static DECLCALLBACK(void) svcAsyncWorker(PSHFLASYNCREQ pReq)
+{
+    for (;;)
+    {
+        int rc = svcCallExecute(pReq->pClient, pReq->u32Function, pReq->cParms, pReq->paParms);
+        svcStatsAdd(pReq->u32Function, pReq->nsReceived, true);
+        g_pHelpers->pfnCallComplete(pReq->callHandle, rc);
+
+        /* Only now the request is gone, requests for the handle received
+         * in the meantime were queued and are picked up next. */
+        RTCritSectEnter(&g_AsyncCritSect);
+        RTListNodeRemove(&pReq->Node);
+        g_cAsyncReqs--;
+        PSHFLASYNCREQ pNext = svcAsyncFindHandle(pReq->pClient, pReq->Handle);
+        RTCritSectLeave(&g_AsyncCritSect);
+
+        RTMemFree(pReq);
+        RTSemEventSignal(g_hAsyncDoneEvent);
+
+        if (!pNext)
+            break;
+        pReq = pNext;
+    }
+}
+
+/**
+ * Hands a guest request over to the worker threads if that is worth it.
+ *
+ * Reads, writes, flushes and directory listings are executed on the worker
+ * threads.  Requests for the same handle are executed one after the other in
+ * the order they were received, so closing or querying a handle with requests
+ * pending is queued as well.  Everything else is done on the service thread.
+ *
+ * @returns true if the request was taken over and is completed later,
+ *          false if the caller has to execute it.
+ * @param   callHandle      The HGCM call handle.
+ * @param   pClient         The client data.
+ * @param   u32Function     The SHFL_FN_XXX function.
+ * @param   cParms          Number of parameters.
+ * @param   paParms         The parameters.
+ * @param   nsReceived      When the call was received (RTTimeNanoTS).
+ */
+static bool svcAsyncSubmit(VBOXHGCMCALLHANDLE callHandle, SHFLCLIENTDATA *pClient, uint32_t u32Function,
+                           uint32_t cParms, VBOXHGCMSVCPARM paParms[], uint64_t nsReceived)
+{
+    if (g_hAsyncPool == NIL_RTREQPOOL)
+        return false;
+
+    bool fAsync;
+    switch (u32Function)
+    {
+        case SHFL_FN_READ:
+        case SHFL_FN_WRITE:
+        case SHFL_FN_LIST:
+        case SHFL_FN_FLUSH:
+            fAsync = true;
+            break;
+        case SHFL_FN_CLOSE:
+        case SHFL_FN_LOCK:
+        case SHFL_FN_INFORMATION:
+            fAsync = false;
+            break;
+        default:
+            return false;
+    }
+
+    /* All of them take the handle as second parameter, leave malformed requests to svcCallExecute. */
+    if (   cParms < 2
+        || paParms[1].type != VBOX_HGCM_SVC_PARM_64BIT)
+        return false;
+    SHFLHANDLE const Handle = paParms[1].u.uint64;
+
+    RTCritSectEnter(&g_AsyncCritSect);
+
+    bool const fBusy = svcAsyncFindHandle(pClient, Handle) != NULL;
+    if (!fAsync && !fBusy)
+    {
+        RTCritSectLeave(&g_AsyncCritSect);
+        return false;
+    }
+
+    PSHFLASYNCREQ pReq = (PSHFLASYNCREQ)RTMemAlloc(sizeof(*pReq));
+    if (!pReq)
+    {
+        RTCritSectLeave(&g_AsyncCritSect);
+        if (!fBusy)
+            return false;
+        /* Cannot execute it here while the handle is in use. */
+        g_pHelpers->pfnCallComplete(callHandle, VERR_NO_MEMORY);
+        return true;
+    }
+    pReq->callHandle  = callHandle;
+    pReq->pClient     = pClient;
+    pReq->u32Function = u32Function;
+    pReq->cParms      = cParms;
+    pReq->paParms     = paParms;
+    pReq->Handle      = Handle;
+    pReq->root        = paParms[0].type == VBOX_HGCM_SVC_PARM_32BIT ? (SHFLROOT)paParms[0].u.uint32 : SHFL_ROOT_NIL;
+    pReq->nsReceived  = nsReceived;
+    RTListAppend(&g_lstAsyncReqs, &pReq->Node);
+    g_cAsyncReqs++;
+    if (g_cAsyncReqs > g_cAsyncReqsMax)
+        g_cAsyncReqsMax = g_cAsyncReqs;
+
+    /* A busy handle has a worker thread which picks the request up when done. */
+    if (!fBusy)
+    {
+        int rc = RTReqPoolCallVoidNoWait(g_hAsyncPool, (PFNRT)svcAsyncWorker, 1, pReq);
+        if (RT_FAILURE(rc))
+        {
+            RTListNodeRemove(&pReq->Node);
+            g_cAsyncReqs--;
+            RTMemFree(pReq);
+            RTCritSectLeave(&g_AsyncCritSect);
+            return false;
+        }
+    }
+
+    RTCritSectLeave(&g_AsyncCritSect);
+    return true;
+}
+
+/**
+ * Waits for the worker threads to finish the requests of a client or for a root.
+ *
+ * @param   pClient         The client data, NULL for all clients.
+ * @param   root            The root, SHFL_ROOT_NIL for all roots.
+ */
+static void svcAsyncWait(SHFLCLIENTDATA *pClient, SHFLROOT root)
+{
+    if (g_hAsyncPool == NIL_RTREQPOOL)
+        return;
+
+    for (;;)
+    {
+        bool fPending = false;
+        RTCritSectEnter(&g_AsyncCritSect);
+        PSHFLASYNCREQ pReq;
+        RTListForEach(&g_lstAsyncReqs, pReq, SHFLASYNCREQ, Node)
+        {
+            if (   (!pClient || pReq->pClient == pClient)
+                && (   root == SHFL_ROOT_NIL
+                    || pReq->root == root
+                    || pReq->root == SHFL_ROOT_NIL))
+            {
+                fPending = true;
+                break;
+            }
+        }
+        RTCritSectLeave(&g_AsyncCritSect);
+
+        if (!fPending)
+            break;
+        RTSemEventWait(g_hAsyncDoneEvent, 100);
+    }
+}
+
+static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32_t u32ClientID, void *pvClient, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[])
+{
+    RT_NOREF1(u32ClientID);
+    uint64_t const nsReceived = RTTimeNanoTS();
+
+    Log(("SharedFolders host service: svcCall: u32ClientID = %u, fn = %u, cParms = %u, pparms = %p\n", u32ClientID, u32Function, cParms, paParms));
+
+    SHFLCLIENTDATA *pClient = (SHFLCLIENTDATA *)pvClient;
+
+#ifdef LOG_ENABLED
+    for (uint32_t i = 0; i < cParms; i++)
+    {
+        /** @todo parameters other than 32 bit */
+        Log(("    pparms[%d]: type %u, value %u\n", i, paParms[i].type, paParms[i].u.uint32));
+    }
+#endif
+
+    if (svcAsyncSubmit(callHandle, pClient, u32Function, cParms, paParms, nsReceived))
+        return;
+
+    int rc = svcCallExecute(pClient, u32Function, cParms, paParms);
+    svcStatsAdd(u32Function, nsReceived, false);
+    g_pHelpers->pfnCallComplete (callHandle, rc);
 
     LogFlow(("\n"));        /* Add a new line to differentiate between calls more easily. */
 }
@@ -1398,6 +1756,11 @@ static DECLCALLBACK(int) svcHostCall (void *, uint32_t u32Function, uint32_t cPa
             }
             else
             {
+                /* The worker threads must be done with the mapping before it
+                 * can go away.  Host calls are processed by the service thread
+                 * as well, so no new requests show up while waiting. */
+                svcAsyncWait(NULL, SHFL_ROOT_NIL);
+
                 /* Execute the function. */
                 rc = vbsfMappingsRemove (pString);
 
@@ -1502,6 +1865,29 @@ extern "C" DECLCALLBACK(DECLEXPORT(int)) VBoxHGCMSvcLoad (VBOXHGCMSVCFNTABLE *pt
         AssertRC(rc);
 
         vbsfMappingInit();
+
+        RTListInit(&g_lstAsyncReqs);
+        rc = RTCritSectInit(&g_AsyncCritSect);
+        AssertRC(rc);
+        /* Reads, writes and listings go to worker threads so that a slow host
+         * file system does not hold up the other requests. Without the threads
+         * everything is done on the service thread as before. */
+#ifdef UNITTEST
+        if (RT_SUCCESS(rc) && g_fTestUseWorkerThreads && g_hAsyncPool == NIL_RTREQPOOL)
+#else
+        if (RT_SUCCESS(rc))
+#endif
+        {
+            int rc2 = RTSemEventCreate(&g_hAsyncDoneEvent);
+            if (RT_SUCCESS(rc2))
+                rc2 = RTReqPoolCreate(SHFL_ASYNC_MAX_THREADS, SHFL_ASYNC_IDLE_MS, UINT32_MAX, 0 /* no push back */,
+                                      "ShFl", &g_hAsyncPool);
+            if (RT_FAILURE(rc2))
+            {
+                LogRel(("SharedFolders: Failed to create the worker threads (%Rrc), executing all requests on the service thread\n", rc2));
+                g_hAsyncPool = NIL_RTREQPOOL;
+            }
+        }
     }
 
     return rc;
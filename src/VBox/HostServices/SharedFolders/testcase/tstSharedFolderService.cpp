@@ -30,12 +30,16 @@
 #include "vbsf.h"
 
 #include <iprt/fs.h>
+#include <iprt/asm.h>
 #include <iprt/dir.h>
 #include <iprt/file.h>
 #include <iprt/path.h>
+#include <iprt/semaphore.h>
 #include <iprt/symlink.h>
 #include <iprt/stream.h>
 #include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
 
 #include "teststubs.h"
 
@@ -44,12 +48,18 @@
 *   Global Variables                                                                                                             *
 *********************************************************************************************************************************/
 static RTTEST g_hTest = NIL_RTTEST;
+/** Number of guest calls completed so far. */
+static uint32_t volatile g_cCallsCompleted = 0;
+/** Signalled when a guest call is completed, if created. */
+static RTSEMEVENT g_hCallCompletedEvent = NIL_RTSEMEVENT;
 
 
 /*********************************************************************************************************************************
 *   Declarations                                                                                                                 *
 *********************************************************************************************************************************/
 extern "C" DECLCALLBACK(DECLEXPORT(int)) VBoxHGCMSvcLoad (VBOXHGCMSVCFNTABLE *ptable);
+/* Code in service.cpp. */
+extern bool g_fTestUseWorkerThreads;
 
 
 /*********************************************************************************************************************************
@@ -61,12 +71,35 @@ struct VBOXHGCMCALLHANDLE_TYPEDEF
 {
     /** Where to store the result code */
     int32_t rc;
+    /** Set on completion to the value of g_cCallsCompleted, which tells the
+     * order in which the calls were completed. */
+    uint32_t volatile iCompleted;
 };
 
 /** Call completion callback for guest calls. */
 static DECLCALLBACK(void) callComplete(VBOXHGCMCALLHANDLE callHandle, int32_t rc)
 {
     callHandle->rc = rc;
+    ASMAtomicWriteU32(&callHandle->iCompleted, ASMAtomicIncU32(&g_cCallsCompleted));
+    if (g_hCallCompletedEvent != NIL_RTSEMEVENT)
+        RTSemEventSignal(g_hCallCompletedEvent);
+}
+
+/**
+ * Waits for a guest call which the service completes on a worker thread.
+ * @returns true if completed, false if it took more than ten seconds
+ * @param  callHandle the call handle passed to pfnCall
+ */
+static bool waitForCall(VBOXHGCMCALLHANDLE callHandle)
+{
+    uint64_t const msStart = RTTimeMilliTS();
+    while (!ASMAtomicReadU32(&callHandle->iCompleted))
+    {
+        if (RTTimeMilliTS() - msStart > 10 * RT_MS_1SEC)
+            return false;
+        RTSemEventWait(g_hCallCompletedEvent, 10);
+    }
+    return true;
 }
 
 /**
@@ -214,11 +247,24 @@ extern int testRTDirSetTimes(PRTDIR pDir, PCRTTIMESPEC pAccessTime, PCRTTIMESPEC
     return VINF_SUCCESS;
 }
 
+/** The file operations done, one letter each ('R'ead, 'W'rite, 'C'lose), for
+ * checking the order in which the worker threads executed them. */
+static char g_achTestFileOps[16];
+static uint32_t volatile g_cTestFileOps;
+
+static void testRecordFileOp(char chOp)
+{
+    uint32_t iOp = ASMAtomicIncU32(&g_cTestFileOps) - 1;
+    if (iOp < sizeof(g_achTestFileOps) - 1)
+        g_achTestFileOps[iOp] = chOp;
+}
+
 static RTFILE g_testRTFileCloseFile;
 
 extern int  testRTFileClose(RTFILE File)
 {
  /* RTPrintf("%s: File=%p\n", __PRETTY_FUNCTION__, File); */
+    testRecordFileOp('C');
     g_testRTFileCloseFile = File;
     return 0;
 }
@@ -290,10 +336,15 @@ extern int  testRTFileQueryInfo(RTFILE hFile, PRTFSOBJINFO pObjInfo, RTFSOBJATTR
 }
 
 static const char *testRTFileReadData;
+/** If created, reads wait for this to be signalled before returning. */
+static RTSEMEVENT g_hTestRTFileReadGate = NIL_RTSEMEVENT;
 
 extern int  testRTFileRead(RTFILE File, void *pvBuf, size_t cbToRead, size_t *pcbRead)
 {
     RT_NOREF1(File);
+    if (g_hTestRTFileReadGate != NIL_RTSEMEVENT)
+        RTSemEventWait(g_hTestRTFileReadGate, 10 * RT_MS_1SEC);
+    testRecordFileOp('R');
  /* RTPrintf("%s : File=%p, cbToRead=%llu\n", __PRETTY_FUNCTION__, File,
              LLUIFY(cbToRead)); */
     bufferFromPath(pvBuf, cbToRead, testRTFileReadData);
@@ -376,6 +427,7 @@ extern int  testRTFileWrite(RTFILE File, const void *pvBuf, size_t cbToWrite, si
     RT_NOREF2(File, cbToWrite);
  /* RTPrintf("%s: File=%p, pvBuf=%.*s, cbToWrite=%llu\n", __PRETTY_FUNCTION__,
              File, cbToWrite, (const char *)pvBuf, LLUIFY(cbToWrite)); */
+    testRecordFileOp('W');
     ARRAY_FROM_PATH(testRTFileWriteData, (const char *)pvBuf);
     if (pcbWritten)
         *pcbWritten = strlen(testRTFileWriteData) + 1;
@@ -860,6 +912,150 @@ void testWriteFileSimple(RTTEST hTest)
     RTTestGuardedFree(hTest, svcTable.pvService);
 }
 
+/**
+ * Loads the service with its worker threads, maps a folder and opens a file
+ * for checking the order in which requests are executed.
+ */
+static SHFLROOT initWithWorkerThreads(RTTEST hTest,
+                                      VBOXHGCMSVCFNTABLE *psvcTable,
+                                      VBOXHGCMSVCHELPERS *psvcHelpers,
+                                      RTFILE hcFile, SHFLHANDLE *pHandle)
+{
+    SHFLROOT Root;
+    int rc;
+
+    g_fTestUseWorkerThreads = true;
+    Root = initWithWritableMapping(hTest, psvcTable, psvcHelpers,
+                                   "/test/mapping", "testname");
+    g_fTestUseWorkerThreads = false;
+    testRTFileOpenpFile = hcFile;
+    rc = createFile(psvcTable, Root, "/test/file", SHFL_CF_ACCESS_READWRITE,
+                    pHandle, NULL);
+    RTTEST_CHECK_RC_OK(hTest, rc);
+    AssertReleaseRC(RTSemEventCreate(&g_hCallCompletedEvent));
+    AssertReleaseRC(RTSemEventCreate(&g_hTestRTFileReadGate));
+    RT_ZERO(g_achTestFileOps);
+    g_cTestFileOps = 0;
+    return Root;
+}
+
+static void termWithWorkerThreads(RTTEST hTest, VBOXHGCMSVCFNTABLE *psvcTable,
+                                  SHFLROOT Root)
+{
+    unmapAndRemoveMapping(hTest, psvcTable, Root, "testname");
+    AssertReleaseRC(psvcTable->pfnDisconnect(NULL, 0, psvcTable->pvService));
+    /* Stops the worker threads again. */
+    AssertReleaseRC(psvcTable->pfnUnload(NULL));
+    RTTestGuardedFree(hTest, psvcTable->pvService);
+    RTSemEventDestroy(g_hTestRTFileReadGate);
+    g_hTestRTFileReadGate = NIL_RTSEMEVENT;
+    RTSemEventDestroy(g_hCallCompletedEvent);
+    g_hCallCompletedEvent = NIL_RTSEMEVENT;
+}
+
+void testReadWriteQueued(RTTEST hTest)
+{
+    VBOXHGCMSVCFNTABLE  svcTable;
+    VBOXHGCMSVCHELPERS  svcHelpers;
+    SHFLROOT Root;
+    const RTFILE hcFile = (RTFILE) 0x10000;
+    SHFLHANDLE Handle;
+    const char *pcszReadData = "Data to read";
+    const char *pcszWrittenData = "Data to write";
+    uint32_t cbToWrite = (uint32_t)strlen(pcszWrittenData) + 1;
+    char acBuf[sizeof(pcszReadData) + 10];
+    VBOXHGCMSVCPARM aReadParms[SHFL_CPARMS_READ];
+    VBOXHGCMSVCPARM aWriteParms[SHFL_CPARMS_WRITE];
+    VBOXHGCMCALLHANDLE_TYPEDEF ReadCall = { VINF_SUCCESS };
+    VBOXHGCMCALLHANDLE_TYPEDEF WriteCall = { VINF_SUCCESS };
+
+    RTTestSub(hTest, "Read and write queued on one handle");
+    Root = initWithWorkerThreads(hTest, &svcTable, &svcHelpers, hcFile, &Handle);
+    testRTFileReadData = pcszReadData;
+    aReadParms[0].setUInt32(Root);
+    aReadParms[1].setUInt64((uint64_t) Handle);
+    aReadParms[2].setUInt64(0);
+    aReadParms[3].setUInt32((uint32_t)strlen(pcszReadData) + 1);
+    aReadParms[4].setPointer(acBuf, (uint32_t)sizeof(acBuf));
+    svcTable.pfnCall(svcTable.pvService, &ReadCall, 0, svcTable.pvService,
+                     SHFL_FN_READ, RT_ELEMENTS(aReadParms), aReadParms);
+    aWriteParms[0].setUInt32(Root);
+    aWriteParms[1].setUInt64((uint64_t) Handle);
+    aWriteParms[2].setUInt64(0);
+    aWriteParms[3].setUInt32(cbToWrite);
+    aWriteParms[4].setPointer((void *)pcszWrittenData, cbToWrite);
+    svcTable.pfnCall(svcTable.pvService, &WriteCall, 0, svcTable.pvService,
+                     SHFL_FN_WRITE, RT_ELEMENTS(aWriteParms), aWriteParms);
+    /* The read is held up in testRTFileRead, the write has to wait for it
+     * instead of going to a second worker thread. */
+    RTThreadSleep(50);
+    RTTEST_CHECK_MSG(hTest, !ReadCall.iCompleted && !WriteCall.iCompleted,
+                     (hTest, "Read=%u Write=%u\n", ReadCall.iCompleted, WriteCall.iCompleted));
+    RTSemEventSignal(g_hTestRTFileReadGate);
+    RTTEST_CHECK(hTest, waitForCall(&ReadCall));
+    RTTEST_CHECK(hTest, waitForCall(&WriteCall));
+    RTTEST_CHECK_RC_OK(hTest, ReadCall.rc);
+    RTTEST_CHECK_RC_OK(hTest, WriteCall.rc);
+    RTTEST_CHECK_MSG(hTest, ReadCall.iCompleted < WriteCall.iCompleted,
+                     (hTest, "Read=%u Write=%u\n", ReadCall.iCompleted, WriteCall.iCompleted));
+    RTTEST_CHECK_MSG(hTest, !strcmp(g_achTestFileOps, "RW"),
+                     (hTest, "Ops=%s\n", g_achTestFileOps));
+    RTTEST_CHECK_MSG(hTest,
+                     !strncmp(acBuf, pcszReadData, sizeof(acBuf)),
+                     (hTest, "pvBuf=%.*s\n", sizeof(acBuf), acBuf));
+    RTTEST_CHECK_MSG(hTest,
+                     !strcmp(testRTFileWriteData, pcszWrittenData),
+                     (hTest, "pvBuf=%s\n", testRTFileWriteData));
+    termWithWorkerThreads(hTest, &svcTable, Root);
+}
+
+void testCloseQueuedBehindRead(RTTEST hTest)
+{
+    VBOXHGCMSVCFNTABLE  svcTable;
+    VBOXHGCMSVCHELPERS  svcHelpers;
+    SHFLROOT Root;
+    const RTFILE hcFile = (RTFILE) 0x10000;
+    SHFLHANDLE Handle;
+    const char *pcszReadData = "Data to read";
+    char acBuf[sizeof(pcszReadData) + 10];
+    VBOXHGCMSVCPARM aReadParms[SHFL_CPARMS_READ];
+    VBOXHGCMSVCPARM aCloseParms[SHFL_CPARMS_CLOSE];
+    VBOXHGCMCALLHANDLE_TYPEDEF ReadCall = { VINF_SUCCESS };
+    VBOXHGCMCALLHANDLE_TYPEDEF CloseCall = { VINF_SUCCESS };
+
+    RTTestSub(hTest, "Close queued behind a read");
+    Root = initWithWorkerThreads(hTest, &svcTable, &svcHelpers, hcFile, &Handle);
+    g_testRTFileCloseFile = NIL_RTFILE;
+    testRTFileReadData = pcszReadData;
+    aReadParms[0].setUInt32(Root);
+    aReadParms[1].setUInt64((uint64_t) Handle);
+    aReadParms[2].setUInt64(0);
+    aReadParms[3].setUInt32((uint32_t)strlen(pcszReadData) + 1);
+    aReadParms[4].setPointer(acBuf, (uint32_t)sizeof(acBuf));
+    svcTable.pfnCall(svcTable.pvService, &ReadCall, 0, svcTable.pvService,
+                     SHFL_FN_READ, RT_ELEMENTS(aReadParms), aReadParms);
+    aCloseParms[0].setUInt32(Root);
+    aCloseParms[1].setUInt64((uint64_t) Handle);
+    svcTable.pfnCall(svcTable.pvService, &CloseCall, 0, svcTable.pvService,
+                     SHFL_FN_CLOSE, RT_ELEMENTS(aCloseParms), aCloseParms);
+    /* Closing is normally done on the service thread, but not while the
+     * handle is still in use by the held up read. */
+    RTThreadSleep(50);
+    RTTEST_CHECK_MSG(hTest, !CloseCall.iCompleted && g_testRTFileCloseFile == NIL_RTFILE,
+                     (hTest, "Close=%u File=%u\n", CloseCall.iCompleted, g_testRTFileCloseFile));
+    RTSemEventSignal(g_hTestRTFileReadGate);
+    RTTEST_CHECK(hTest, waitForCall(&ReadCall));
+    RTTEST_CHECK(hTest, waitForCall(&CloseCall));
+    RTTEST_CHECK_RC_OK(hTest, ReadCall.rc);
+    RTTEST_CHECK_RC_OK(hTest, CloseCall.rc);
+    RTTEST_CHECK_MSG(hTest, ReadCall.iCompleted < CloseCall.iCompleted,
+                     (hTest, "Read=%u Close=%u\n", ReadCall.iCompleted, CloseCall.iCompleted));
+    RTTEST_CHECK_MSG(hTest, !strcmp(g_achTestFileOps, "RC"),
+                     (hTest, "Ops=%s\n", g_achTestFileOps));
+    RTTEST_CHECK_MSG(hTest, g_testRTFileCloseFile == hcFile, (hTest, "File=%u\n", g_testRTFileCloseFile));
+    termWithWorkerThreads(hTest, &svcTable, Root);
+}
+
 void testFlushFileSimple(RTTEST hTest)
 {
     VBOXHGCMSVCFNTABLE  svcTable;
@@ -59,11 +59,13 @@ void testCreateBadParameters(RTTEST hTest);
 void testClose(RTTEST hTest);
 /* Sub-tests for testClose(). */
 void testCloseBadParameters(RTTEST hTest);
+void testCloseQueuedBehindRead(RTTEST hTest);
 
 void testRead(RTTEST hTest);
 /* Sub-tests for testRead(). */
 void testReadBadParameters(RTTEST hTest);
 void testReadFileSimple(RTTEST hTest);
+void testReadWriteQueued(RTTEST hTest);
 
 void testWrite(RTTEST hTest);
 /* Sub-tests for testWrite(). */
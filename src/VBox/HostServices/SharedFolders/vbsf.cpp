@@ -898,6 +898,8 @@ void testClose(RTTEST hTest)
 {
     /* If the API parameters are invalid the API should fail. */
     testCloseBadParameters(hTest);
+    /* Closing a handle which is still being read from waits for the read. */
+    testCloseQueuedBehindRead(hTest);
     /* Add tests as required... */
 }
 #endif
@@ -944,6 +946,8 @@ void testRead(RTTEST hTest)
     testReadBadParameters(hTest);
     /* Basic reading from a file. */
     testReadFileSimple(hTest);
+    /* Reads and writes on one handle are executed in the order received. */
+    testReadWriteQueued(hTest);
     /* Add tests as required... */
 }
 #endif
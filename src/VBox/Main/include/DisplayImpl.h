@@ -265,6 +265,12 @@ private:
                                           ULONG aHeight,
                                           BitmapFormat_T aBitmapFormat,
                                           std::vector<BYTE> &aScreenData);
+    virtual HRESULT takeScreenShotsToArray(const std::vector<ULONG> &aScreenIds,
+                                           ULONG aWidth,
+                                           ULONG aHeight,
+                                           BitmapFormat_T aBitmapFormat,
+                                           std::vector<ULONG> &aScreenSizes,
+                                           std::vector<BYTE> &aScreenData);
     virtual HRESULT drawToScreen(ULONG aScreenId,
                                  BYTE *aAddress,
                                  ULONG aX,
@@ -529,6 +535,10 @@ void videoAccelLeaveVMMDev(VIDEOACCEL *pVideoAccel);
 /* helper function, code in DisplayResampleImage.cpp */
 void BitmapScale32(uint8_t *dst, int dstW, int dstH,
                    const uint8_t *src, int iDeltaLine, int srcW, int srcH);
+void BitmapScale32Bilinear(uint8_t *dst, int dstW, int dstH,
+                           const uint8_t *src, int iDeltaLine, int srcW, int srcH);
+void BitmapScale32Lanczos(uint8_t *dst, int dstW, int dstH,
+                          const uint8_t *src, int iDeltaLine, int srcW, int srcH);
 
 /* helper function, code in DisplayPNGUtul.cpp */
 int DisplayMakePNG(uint8_t *pbData, uint32_t cx, uint32_t cy,
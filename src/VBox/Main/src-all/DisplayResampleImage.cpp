@@ -16,6 +16,18 @@
  */
 
 #include <iprt/types.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/err.h>
+#include <iprt/mem.h>
+#include <iprt/mp.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+
+#ifdef RT_ARCH_AMD64
+# include <emmintrin.h>
+#endif
+#include <math.h>
 
 DECLINLINE(void) imageSetPixel (uint8_t *im, int x, int y, int color, int w)
 {
@@ -36,12 +48,14 @@ typedef int32_t FIXEDPOINT;
 #define FIXEDPOINT_FLOOR(v) ((v) & ~0xF)
 #define FIXEDPOINT_FRACTION(v) ((v) & 0xF)
 
-/* For 32 bit source only. */
-void BitmapScale32 (uint8_t *dst,
-                    int dstW, int dstH,
-                    const uint8_t *src,
-                    int iDeltaLine,
-                    int srcW, int srcH)
+/* For 32 bit source only.
+ * The per pixel version, used when the memory for the separable one is not
+ * available. */
+static void bitmapScale32Generic(uint8_t *dst,
+                                 int dstW, int dstH,
+                                 const uint8_t *src,
+                                 int iDeltaLine,
+                                 int srcW, int srcH)
 {
     int x, y;
 
@@ -148,3 +162,648 @@ void BitmapScale32 (uint8_t *dst,
         }
     }
 }
+
+
+/** Source images with at least this many pixels are scaled by several threads. */
+#define BITMAPSCALE_MT_MIN_PIXELS   (1024 * 768)
+/** The maximum number of threads to scale one image with. */
+#define BITMAPSCALE_MAX_THREADS     4
+
+/**
+ * The source pixels contributing to each destination column or row.
+ *
+ * The contributions are the same as in bitmapScale32Generic, so the result is
+ * identical, but each pixel weight is the product of a column and a row weight
+ * which only depend on the coordinate.  That makes the filter separable: the
+ * rows are first summed up per source column and the columns are then summed
+ * up per destination pixel.
+ */
+typedef struct BITMAPSCALEAXIS
+{
+    /** The first source pixel, per destination pixel. */
+    uint32_t   *paiFirst;
+    /** The number of source pixels, per destination pixel. */
+    uint32_t   *pacTaps;
+    /** Index of the first weight in paWeights, per destination pixel. */
+    uint32_t   *paoffTaps;
+    /** The sum of the weights, per destination pixel. */
+    FIXEDPOINT *paSpan;
+    /** The weights. */
+    FIXEDPOINT *paWeights;
+} BITMAPSCALEAXIS;
+
+/**
+ * The parameters of a scaling job, one per thread.
+ */
+typedef struct BITMAPSCALEJOB
+{
+    uint8_t                *dst;
+    int                     dstW;
+    const uint8_t          *src;
+    int                     iDeltaLine;
+    int                     srcW;
+    const BITMAPSCALEAXIS  *pAxisX;
+    const BITMAPSCALEAXIS  *pAxisY;
+    /** The destination rows to produce. */
+    int                     yFirst;
+    int                     yEnd;
+    /** Column sums, 4 per source pixel. */
+    int32_t                *paAcc;
+    /** Whether the axes hold interpolation kernel weights (bitmapScaleKernelRows)
+     * rather than box filter ones (bitmapScaleRows). */
+    bool                    fKernel;
+} BITMAPSCALEJOB;
+
+
+static void bitmapScaleAxisDelete(BITMAPSCALEAXIS *pAxis)
+{
+    RTMemFree(pAxis->paiFirst);
+    RTMemFree(pAxis->pacTaps);
+    RTMemFree(pAxis->paoffTaps);
+    RTMemFree(pAxis->paSpan);
+    RTMemFree(pAxis->paWeights);
+}
+
+/**
+ * Calculates the contributions for one direction.
+ *
+ * @returns false if out of memory.
+ */
+static bool bitmapScaleAxisInit(BITMAPSCALEAXIS *pAxis, int cSrc, int cDst)
+{
+    /* Every destination pixel covers its share of the source plus at most
+     * one partial pixel on either side. */
+    uint32_t const cMaxTaps = (uint32_t)cSrc + 2 * (uint32_t)cDst + 1;
+
+    pAxis->paiFirst  = (uint32_t *)RTMemAlloc(cDst * sizeof(uint32_t));
+    pAxis->pacTaps   = (uint32_t *)RTMemAlloc(cDst * sizeof(uint32_t));
+    pAxis->paoffTaps = (uint32_t *)RTMemAlloc(cDst * sizeof(uint32_t));
+    pAxis->paSpan    = (FIXEDPOINT *)RTMemAlloc(cDst * sizeof(FIXEDPOINT));
+    pAxis->paWeights = (FIXEDPOINT *)RTMemAlloc(cMaxTaps * sizeof(FIXEDPOINT));
+    if (   !pAxis->paiFirst
+        || !pAxis->pacTaps
+        || !pAxis->paoffTaps
+        || !pAxis->paSpan
+        || !pAxis->paWeights)
+        return false;
+
+    uint32_t offTaps = 0;
+    for (int i = 0; i < cDst; i++)
+    {
+        FIXEDPOINT s1 = INT_TO_FIXEDPOINT(i * cSrc) / cDst;
+        FIXEDPOINT s2 = INT_TO_FIXEDPOINT((i + 1) * cSrc) / cDst;
+
+        pAxis->paiFirst[i]  = FIXEDPOINT_TO_INT(s1);
+        pAxis->paoffTaps[i] = offTaps;
+        pAxis->paSpan[i]    = s2 - s1;
+
+        FIXEDPOINT s = s1;
+        do
+        {
+            FIXEDPOINT portion;
+            if (FIXEDPOINT_FLOOR(s) == FIXEDPOINT_FLOOR(s1))
+            {
+                portion = INT_TO_FIXEDPOINT(1) - FIXEDPOINT_FRACTION(s);
+                if (portion > s2 - s1)
+                    portion = s2 - s1;
+                s = FIXEDPOINT_FLOOR(s);
+            }
+            else if (s == FIXEDPOINT_FLOOR(s2))
+                portion = FIXEDPOINT_FRACTION(s2);
+            else
+                portion = INT_TO_FIXEDPOINT(1);
+
+            AssertReturn(offTaps < cMaxTaps, false);
+            pAxis->paWeights[offTaps++] = portion;
+
+            s += INT_TO_FIXEDPOINT(1);
+        } while (s < s2);
+
+        pAxis->pacTaps[i] = offTaps - pAxis->paoffTaps[i];
+    }
+    return true;
+}
+
+/**
+ * Sums up the weighted source rows contributing to a destination row, per
+ * source column and colour component.
+ */
+static void bitmapScaleSumRows(int32_t *paAcc, const uint8_t *pu8SrcLine, int iDeltaLine, int srcW,
+                               const FIXEDPOINT *paWeights, uint32_t cTaps, FIXEDPOINT span)
+{
+    int x = 0;
+#ifdef RT_ARCH_AMD64
+    /* 4 pixels per iteration, with the sums kept in registers.  A weight is at
+     * most 16, so the products fit into 16 bits, and so do the sums as long as
+     * the weights add up to no more than 256. */
+    __m128i const uZero = _mm_setzero_si128();
+    if (span * 255 <= 0xffff)
+    {
+        for (; x + 4 <= srcW; x += 4)
+        {
+            __m128i uLo = uZero;
+            __m128i uHi = uZero;
+            const uint8_t *pu8Src = pu8SrcLine + x * 4;
+            for (uint32_t iTap = 0; iTap < cTaps; iTap++, pu8Src += iDeltaLine)
+            {
+                __m128i const uWeight = _mm_set1_epi16((int16_t)paWeights[iTap]);
+                __m128i const uPix    = _mm_loadu_si128((const __m128i *)pu8Src);
+                uLo = _mm_add_epi16(uLo, _mm_mullo_epi16(_mm_unpacklo_epi8(uPix, uZero), uWeight));
+                uHi = _mm_add_epi16(uHi, _mm_mullo_epi16(_mm_unpackhi_epi8(uPix, uZero), uWeight));
+            }
+            __m128i *pAcc = (__m128i *)(paAcc + x * 4);
+            _mm_storeu_si128(pAcc,     _mm_unpacklo_epi16(uLo, uZero));
+            _mm_storeu_si128(pAcc + 1, _mm_unpackhi_epi16(uLo, uZero));
+            _mm_storeu_si128(pAcc + 2, _mm_unpacklo_epi16(uHi, uZero));
+            _mm_storeu_si128(pAcc + 3, _mm_unpackhi_epi16(uHi, uZero));
+        }
+    }
+    else
+    {
+        for (; x + 4 <= srcW; x += 4)
+        {
+            __m128i uSum0 = uZero, uSum1 = uZero, uSum2 = uZero, uSum3 = uZero;
+            const uint8_t *pu8Src = pu8SrcLine + x * 4;
+            for (uint32_t iTap = 0; iTap < cTaps; iTap++, pu8Src += iDeltaLine)
+            {
+                __m128i const uWeight = _mm_set1_epi16((int16_t)paWeights[iTap]);
+                __m128i const uPix    = _mm_loadu_si128((const __m128i *)pu8Src);
+                __m128i const uLo     = _mm_mullo_epi16(_mm_unpacklo_epi8(uPix, uZero), uWeight);
+                __m128i const uHi     = _mm_mullo_epi16(_mm_unpackhi_epi8(uPix, uZero), uWeight);
+                uSum0 = _mm_add_epi32(uSum0, _mm_unpacklo_epi16(uLo, uZero));
+                uSum1 = _mm_add_epi32(uSum1, _mm_unpackhi_epi16(uLo, uZero));
+                uSum2 = _mm_add_epi32(uSum2, _mm_unpacklo_epi16(uHi, uZero));
+                uSum3 = _mm_add_epi32(uSum3, _mm_unpackhi_epi16(uHi, uZero));
+            }
+            __m128i *pAcc = (__m128i *)(paAcc + x * 4);
+            _mm_storeu_si128(pAcc,     uSum0);
+            _mm_storeu_si128(pAcc + 1, uSum1);
+            _mm_storeu_si128(pAcc + 2, uSum2);
+            _mm_storeu_si128(pAcc + 3, uSum3);
+        }
+    }
+#else
+    RT_NOREF(span);
+#endif
+    for (; x < srcW; x++)
+    {
+        int32_t blue = 0, green = 0, red = 0;
+        const uint8_t *pu8Src = pu8SrcLine + x * 4;
+        for (uint32_t iTap = 0; iTap < cTaps; iTap++, pu8Src += iDeltaLine)
+        {
+            blue  += pu8Src[0] * paWeights[iTap];
+            green += pu8Src[1] * paWeights[iTap];
+            red   += pu8Src[2] * paWeights[iTap];
+        }
+        paAcc[x * 4]     = blue;
+        paAcc[x * 4 + 1] = green;
+        paAcc[x * 4 + 2] = red;
+    }
+}
+
+/**
+ * A divisor prepared for dividing by multiplication.
+ */
+typedef struct BITMAPSCALEDIVISOR
+{
+    FIXEDPOINT  iDivisor;
+    uint64_t    u64Mul;
+    unsigned    cShift;
+} BITMAPSCALEDIVISOR;
+
+/**
+ * Prepares a divisor, see bitmapScaleDiv.
+ */
+static void bitmapScaleDivInit(BITMAPSCALEDIVISOR *pDivisor, FIXEDPOINT iDivisor)
+{
+    pDivisor->iDivisor = iDivisor;
+    pDivisor->u64Mul   = 0;
+    pDivisor->cShift   = 0;
+    if (iDivisor > 0)
+    {
+        /* With l bits in the divisor, m = 2^(31 + l) / d + 1 gives the exact
+         * quotient as (n * m) >> (31 + l) for any n below 2^31, and the
+         * product fits into 64 bits. */
+        pDivisor->cShift = 31 + ASMBitLastSetU32((uint32_t)iDivisor);
+        pDivisor->u64Mul = RT_BIT_64(pDivisor->cShift) / (uint32_t)iDivisor + 1;
+    }
+}
+
+/**
+ * Divides like the / operator, but with a multiplication as integer divisions
+ * would take most of the time otherwise.
+ */
+DECLINLINE(FIXEDPOINT) bitmapScaleDiv(FIXEDPOINT iValue, const BITMAPSCALEDIVISOR *pDivisor)
+{
+    if (RT_LIKELY(iValue >= 0 && pDivisor->iDivisor > 0))
+        return (FIXEDPOINT)(((uint64_t)iValue * pDivisor->u64Mul) >> pDivisor->cShift);
+    return iValue / pDivisor->iDivisor;
+}
+
+/**
+ * Produces the destination rows of a job.
+ */
+static void bitmapScaleRows(BITMAPSCALEJOB *pJob)
+{
+    const BITMAPSCALEAXIS *pAxisX = pJob->pAxisX;
+    const BITMAPSCALEAXIS *pAxisY = pJob->pAxisY;
+
+    for (int y = pJob->yFirst; y < pJob->yEnd; y++)
+    {
+        /* Sum up the contributing rows per source column. */
+        bitmapScaleSumRows(pJob->paAcc, pJob->src + pJob->iDeltaLine * (int)pAxisY->paiFirst[y], pJob->iDeltaLine,
+                           pJob->srcW, &pAxisY->paWeights[pAxisY->paoffTaps[y]], pAxisY->pacTaps[y],
+                           pAxisY->paSpan[y]);
+
+        /* Sum up the contributing columns per destination pixel.  The sums of
+         * the column weights take at most two different values, so there are
+         * at most two different divisors per row. */
+        uint32_t *pu32Dst = (uint32_t *)(pJob->dst + y * pJob->dstW * 4);
+        BITMAPSCALEDIVISOR aDivisors[2];
+        bitmapScaleDivInit(&aDivisors[0], pAxisX->paSpan[0] * pAxisY->paSpan[y]);
+        aDivisors[1] = aDivisors[0];
+        for (int x = 0; x < pJob->dstW; x++)
+        {
+            FIXEDPOINT red = 0, green = 0, blue = 0;
+            const int32_t    *pAcc       = &pJob->paAcc[pAxisX->paiFirst[x] * 4];
+            const FIXEDPOINT *paWeightsX = &pAxisX->paWeights[pAxisX->paoffTaps[x]];
+            for (uint32_t iTap = 0; iTap < pAxisX->pacTaps[x]; iTap++, pAcc += 4)
+            {
+                blue  += pAcc[0] * paWeightsX[iTap];
+                green += pAcc[1] * paWeightsX[iTap];
+                red   += pAcc[2] * paWeightsX[iTap];
+            }
+
+            FIXEDPOINT spixels = pAxisX->paSpan[x] * pAxisY->paSpan[y];
+            if (spixels != 0)
+            {
+                if (spixels != aDivisors[0].iDivisor)
+                {
+                    if (spixels != aDivisors[1].iDivisor)
+                        bitmapScaleDivInit(&aDivisors[1], spixels);
+                    BITMAPSCALEDIVISOR Tmp = aDivisors[0];
+                    aDivisors[0] = aDivisors[1];
+                    aDivisors[1] = Tmp;
+                }
+                red   = bitmapScaleDiv(red,   &aDivisors[0]);
+                green = bitmapScaleDiv(green, &aDivisors[0]);
+                blue  = bitmapScaleDiv(blue,  &aDivisors[0]);
+            }
+            /* Clamping to allow for rounding errors above */
+            if (red > 255)
+                red = 255;
+            if (green > 255)
+                green = 255;
+            if (blue > 255)
+                blue = 255;
+            pu32Dst[x] = (((int)red) << 16) + (((int)green) << 8) + ((int)blue);
+        }
+    }
+}
+
+/** The interpolation kernel weights add up to this. */
+#define BITMAPSCALE_KERNEL_ONE      (1 << 14)
+/** M_PI is not available everywhere. */
+#define BITMAPSCALE_PI              3.14159265358979323846
+
+/**
+ * The interpolation kernels for BitmapScale32Bilinear and BitmapScale32Lanczos.
+ */
+typedef enum BITMAPSCALEKERNEL
+{
+    BITMAPSCALEKERNEL_BILINEAR = 0,
+    BITMAPSCALEKERNEL_LANCZOS3
+} BITMAPSCALEKERNEL;
+
+/**
+ * Evaluates an interpolation kernel at distance @a t from the sample.
+ */
+static double bitmapScaleKernelValue(BITMAPSCALEKERNEL enmKernel, double t)
+{
+    t = fabs(t);
+    if (enmKernel == BITMAPSCALEKERNEL_BILINEAR)
+        return t < 1.0 ? 1.0 - t : 0.0;
+
+    if (t < 1e-9)
+        return 1.0;
+    if (t >= 3.0)
+        return 0.0;
+    double const x = BITMAPSCALE_PI * t;
+    return 3.0 * sin(x) * sin(x / 3.0) / (x * x);
+}
+
+/**
+ * Calculates the interpolation kernel weights for one direction.
+ *
+ * The kernel is centered on the destination pixel center mapped into the
+ * source and widened by the scaling factor when downscaling, so that every
+ * source pixel contributes.  Taps beyond the image edges are folded onto the
+ * edge pixels.  The weights are in units of 1/BITMAPSCALE_KERNEL_ONE and may
+ * be negative for Lanczos.
+ *
+ * @returns false if out of memory.
+ */
+static bool bitmapScaleKernelAxisInit(BITMAPSCALEAXIS *pAxis, int cSrc, int cDst, BITMAPSCALEKERNEL enmKernel)
+{
+    double const dScale   = (double)cSrc / cDst;
+    double const dStretch = RT_MAX(dScale, 1.0);
+    double const dRadius  = (enmKernel == BITMAPSCALEKERNEL_BILINEAR ? 1.0 : 3.0) * dStretch;
+    uint32_t const cMaxTapsPerPixel = RT_MIN((uint32_t)ceil(dRadius) * 2 + 1, (uint32_t)cSrc);
+
+    pAxis->paiFirst  = (uint32_t *)RTMemAlloc(cDst * sizeof(uint32_t));
+    pAxis->pacTaps   = (uint32_t *)RTMemAlloc(cDst * sizeof(uint32_t));
+    pAxis->paoffTaps = (uint32_t *)RTMemAlloc(cDst * sizeof(uint32_t));
+    pAxis->paSpan    = NULL;
+    pAxis->paWeights = (FIXEDPOINT *)RTMemAlloc((size_t)cDst * cMaxTapsPerPixel * sizeof(FIXEDPOINT));
+    double *padWeights = (double *)RTMemAlloc(cMaxTapsPerPixel * sizeof(double));
+    if (   !pAxis->paiFirst
+        || !pAxis->pacTaps
+        || !pAxis->paoffTaps
+        || !pAxis->paWeights
+        || !padWeights)
+    {
+        RTMemFree(padWeights);
+        return false;
+    }
+
+    uint32_t offTaps = 0;
+    for (int i = 0; i < cDst; i++)
+    {
+        double const dCenter = (i + 0.5) * dScale - 0.5;
+        int const iFirst = RT_MAX((int)floor(dCenter - dRadius) + 1, 0);
+        int const iLast  = RT_MIN((int)ceil(dCenter + dRadius) - 1, cSrc - 1);
+        int const cTaps  = RT_MIN(RT_MAX(iLast - iFirst + 1, 1), (int)cMaxTapsPerPixel);
+        int const iBase  = RT_MIN(iFirst, cSrc - cTaps);
+
+        /* The kernel over the full support, with the part outside the image
+         * added to the edge taps. */
+        double dSum = 0.0;
+        for (int iTap = 0; iTap < cTaps; iTap++)
+            padWeights[iTap] = 0.0;
+        for (int j = (int)floor(dCenter - dRadius) + 1; j <= (int)ceil(dCenter + dRadius) - 1; j++)
+        {
+            double const dWeight = bitmapScaleKernelValue(enmKernel, (j - dCenter) / dStretch);
+            int iTap = RT_MIN(RT_MAX(j, 0), cSrc - 1) - iBase;
+            iTap = RT_MIN(RT_MAX(iTap, 0), cTaps - 1);
+            padWeights[iTap] += dWeight;
+            dSum += dWeight;
+        }
+        if (dSum == 0.0)
+        {
+            padWeights[RT_MIN(RT_MAX((int)floor(dCenter + 0.5) - iBase, 0), cTaps - 1)] = 1.0;
+            dSum = 1.0;
+        }
+
+        /* Convert to fixed point, giving the rounding error to the largest tap
+         * so the weights add up exactly and flat areas stay flat. */
+        FIXEDPOINT *paWeights = &pAxis->paWeights[offTaps];
+        int32_t iTotal = 0;
+        int iMax = 0;
+        for (int iTap = 0; iTap < cTaps; iTap++)
+        {
+            paWeights[iTap] = (FIXEDPOINT)floor(padWeights[iTap] / dSum * BITMAPSCALE_KERNEL_ONE + 0.5);
+            iTotal += paWeights[iTap];
+            if (paWeights[iTap] > paWeights[iMax])
+                iMax = iTap;
+        }
+        paWeights[iMax] += BITMAPSCALE_KERNEL_ONE - iTotal;
+
+        pAxis->paiFirst[i]  = (uint32_t)iBase;
+        pAxis->pacTaps[i]   = (uint32_t)cTaps;
+        pAxis->paoffTaps[i] = offTaps;
+        offTaps += (uint32_t)cTaps;
+    }
+
+    RTMemFree(padWeights);
+    return true;
+}
+
+/**
+ * Sums up the source rows contributing to a destination row with the signed
+ * kernel weights, per source column and colour component.
+ */
+static void bitmapScaleKernelSumRows(int32_t *paAcc, const uint8_t *pu8SrcLine, int iDeltaLine, int srcW,
+                                     const FIXEDPOINT *paWeights, uint32_t cTaps)
+{
+    int x = 0;
+#ifdef RT_ARCH_AMD64
+    /* 4 pixels per iteration.  The weights stay below 2 in magnitude and so fit
+     * into 16 signed bits, the full 32 bit products are assembled from the low
+     * and high halves. */
+    __m128i const uZero = _mm_setzero_si128();
+    for (; x + 4 <= srcW; x += 4)
+    {
+        __m128i uSum0 = uZero, uSum1 = uZero, uSum2 = uZero, uSum3 = uZero;
+        const uint8_t *pu8Src = pu8SrcLine + x * 4;
+        for (uint32_t iTap = 0; iTap < cTaps; iTap++, pu8Src += iDeltaLine)
+        {
+            __m128i const uWeight = _mm_set1_epi16((int16_t)paWeights[iTap]);
+            __m128i const uPix    = _mm_loadu_si128((const __m128i *)pu8Src);
+            __m128i const uPixLo  = _mm_unpacklo_epi8(uPix, uZero);
+            __m128i const uPixHi  = _mm_unpackhi_epi8(uPix, uZero);
+            __m128i const uLoLo   = _mm_mullo_epi16(uPixLo, uWeight);
+            __m128i const uLoHi   = _mm_mulhi_epi16(uPixLo, uWeight);
+            __m128i const uHiLo   = _mm_mullo_epi16(uPixHi, uWeight);
+            __m128i const uHiHi   = _mm_mulhi_epi16(uPixHi, uWeight);
+            uSum0 = _mm_add_epi32(uSum0, _mm_unpacklo_epi16(uLoLo, uLoHi));
+            uSum1 = _mm_add_epi32(uSum1, _mm_unpackhi_epi16(uLoLo, uLoHi));
+            uSum2 = _mm_add_epi32(uSum2, _mm_unpacklo_epi16(uHiLo, uHiHi));
+            uSum3 = _mm_add_epi32(uSum3, _mm_unpackhi_epi16(uHiLo, uHiHi));
+        }
+        __m128i *pAcc = (__m128i *)(paAcc + x * 4);
+        _mm_storeu_si128(pAcc,     uSum0);
+        _mm_storeu_si128(pAcc + 1, uSum1);
+        _mm_storeu_si128(pAcc + 2, uSum2);
+        _mm_storeu_si128(pAcc + 3, uSum3);
+    }
+#endif
+    for (; x < srcW; x++)
+    {
+        int32_t blue = 0, green = 0, red = 0;
+        const uint8_t *pu8Src = pu8SrcLine + x * 4;
+        for (uint32_t iTap = 0; iTap < cTaps; iTap++, pu8Src += iDeltaLine)
+        {
+            blue  += pu8Src[0] * paWeights[iTap];
+            green += pu8Src[1] * paWeights[iTap];
+            red   += pu8Src[2] * paWeights[iTap];
+        }
+        paAcc[x * 4]     = blue;
+        paAcc[x * 4 + 1] = green;
+        paAcc[x * 4 + 2] = red;
+    }
+}
+
+/**
+ * Clamps a colour component summed up with two sets of kernel weights.
+ */
+DECLINLINE(uint32_t) bitmapScaleKernelClamp(int64_t iValue)
+{
+    iValue += (int64_t)BITMAPSCALE_KERNEL_ONE * BITMAPSCALE_KERNEL_ONE / 2;
+    if (iValue <= 0)
+        return 0;
+    iValue /= (int64_t)BITMAPSCALE_KERNEL_ONE * BITMAPSCALE_KERNEL_ONE;
+    return iValue > 255 ? 255 : (uint32_t)iValue;
+}
+
+/**
+ * Produces the destination rows of a job using interpolation kernel weights.
+ */
+static void bitmapScaleKernelRows(BITMAPSCALEJOB *pJob)
+{
+    const BITMAPSCALEAXIS *pAxisX = pJob->pAxisX;
+    const BITMAPSCALEAXIS *pAxisY = pJob->pAxisY;
+
+    for (int y = pJob->yFirst; y < pJob->yEnd; y++)
+    {
+        bitmapScaleKernelSumRows(pJob->paAcc, pJob->src + pJob->iDeltaLine * (int)pAxisY->paiFirst[y], pJob->iDeltaLine,
+                                 pJob->srcW, &pAxisY->paWeights[pAxisY->paoffTaps[y]], pAxisY->pacTaps[y]);
+
+        uint32_t *pu32Dst = (uint32_t *)(pJob->dst + y * pJob->dstW * 4);
+        for (int x = 0; x < pJob->dstW; x++)
+        {
+            int64_t red = 0, green = 0, blue = 0;
+            const int32_t    *pAcc       = &pJob->paAcc[pAxisX->paiFirst[x] * 4];
+            const FIXEDPOINT *paWeightsX = &pAxisX->paWeights[pAxisX->paoffTaps[x]];
+            for (uint32_t iTap = 0; iTap < pAxisX->pacTaps[x]; iTap++, pAcc += 4)
+            {
+                blue  += (int64_t)pAcc[0] * paWeightsX[iTap];
+                green += (int64_t)pAcc[1] * paWeightsX[iTap];
+                red   += (int64_t)pAcc[2] * paWeightsX[iTap];
+            }
+            pu32Dst[x] = (bitmapScaleKernelClamp(red) << 16) + (bitmapScaleKernelClamp(green) << 8)
+                       + bitmapScaleKernelClamp(blue);
+        }
+    }
+}
+
+static DECLCALLBACK(int) bitmapScaleThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    RT_NOREF(hThreadSelf);
+    BITMAPSCALEJOB *pJob = (BITMAPSCALEJOB *)pvUser;
+    if (pJob->fKernel)
+        bitmapScaleKernelRows(pJob);
+    else
+        bitmapScaleRows(pJob);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Scales the image with the prepared axes, splitting large images into bands
+ * of destination rows which are scaled in parallel.
+ *
+ * @returns false if out of memory.
+ */
+static bool bitmapScaleRun(uint8_t *dst, int dstW, int dstH, const uint8_t *src, int iDeltaLine, int srcW, int srcH,
+                           const BITMAPSCALEAXIS *pAxisX, const BITMAPSCALEAXIS *pAxisY, bool fKernel)
+{
+    unsigned cJobs = 1;
+    if ((int64_t)srcW * srcH >= BITMAPSCALE_MT_MIN_PIXELS)
+        cJobs = RT_MIN(RT_MIN(RTMpGetOnlineCount(), BITMAPSCALE_MAX_THREADS), (unsigned)dstH);
+    cJobs = RT_MAX(cJobs, 1);
+
+    int32_t *paAcc = (int32_t *)RTMemAlloc(cJobs * srcW * 4 * sizeof(int32_t));
+    if (!paAcc)
+        return false;
+
+    BITMAPSCALEJOB aJobs[BITMAPSCALE_MAX_THREADS];
+    for (unsigned i = 0; i < cJobs; i++)
+    {
+        aJobs[i].dst        = dst;
+        aJobs[i].dstW       = dstW;
+        aJobs[i].src        = src;
+        aJobs[i].iDeltaLine = iDeltaLine;
+        aJobs[i].srcW       = srcW;
+        aJobs[i].pAxisX     = pAxisX;
+        aJobs[i].pAxisY     = pAxisY;
+        aJobs[i].yFirst     = (int)((int64_t)dstH * i / cJobs);
+        aJobs[i].yEnd       = (int)((int64_t)dstH * (i + 1) / cJobs);
+        aJobs[i].paAcc      = paAcc + i * srcW * 4;
+        aJobs[i].fKernel    = fKernel;
+    }
+
+    /* The calling thread does the first band, and any band which did not
+     * get a thread of its own. */
+    RTTHREAD ahThreads[BITMAPSCALE_MAX_THREADS];
+    for (unsigned i = 1; i < cJobs; i++)
+        if (RT_FAILURE(RTThreadCreate(&ahThreads[i], bitmapScaleThread, &aJobs[i], 0,
+                                      RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "BmpScale")))
+            ahThreads[i] = NIL_RTTHREAD;
+    bitmapScaleThread(NIL_RTTHREAD, &aJobs[0]);
+    for (unsigned i = 1; i < cJobs; i++)
+    {
+        if (ahThreads[i] != NIL_RTTHREAD)
+            RTThreadWait(ahThreads[i], RT_INDEFINITE_WAIT, NULL);
+        else
+            bitmapScaleThread(NIL_RTTHREAD, &aJobs[i]);
+    }
+
+    RTMemFree(paAcc);
+    return true;
+}
+
+/* For 32 bit source only.
+ * Large images are split into bands of destination rows which are scaled in
+ * parallel. */
+void BitmapScale32(uint8_t *dst,
+                   int dstW, int dstH,
+                   const uint8_t *src,
+                   int iDeltaLine,
+                   int srcW, int srcH)
+{
+    if (dstW <= 0 || dstH <= 0 || srcW <= 0 || srcH <= 0)
+        return;
+
+    BITMAPSCALEAXIS AxisX, AxisY;
+    RT_ZERO(AxisX);
+    RT_ZERO(AxisY);
+    if (   !bitmapScaleAxisInit(&AxisX, srcW, dstW)
+        || !bitmapScaleAxisInit(&AxisY, srcH, dstH)
+        || !bitmapScaleRun(dst, dstW, dstH, src, iDeltaLine, srcW, srcH, &AxisX, &AxisY, false /*fKernel*/))
+        bitmapScale32Generic(dst, dstW, dstH, src, iDeltaLine, srcW, srcH);
+
+    bitmapScaleAxisDelete(&AxisX);
+    bitmapScaleAxisDelete(&AxisY);
+}
+
+static void bitmapScale32Kernel(uint8_t *dst, int dstW, int dstH, const uint8_t *src, int iDeltaLine, int srcW, int srcH,
+                                BITMAPSCALEKERNEL enmKernel)
+{
+    if (dstW <= 0 || dstH <= 0 || srcW <= 0 || srcH <= 0)
+        return;
+
+    /* Falls back on the box filter, which needs no tables, when out of memory. */
+    BITMAPSCALEAXIS AxisX, AxisY;
+    RT_ZERO(AxisX);
+    RT_ZERO(AxisY);
+    if (   !bitmapScaleKernelAxisInit(&AxisX, srcW, dstW, enmKernel)
+        || !bitmapScaleKernelAxisInit(&AxisY, srcH, dstH, enmKernel)
+        || !bitmapScaleRun(dst, dstW, dstH, src, iDeltaLine, srcW, srcH, &AxisX, &AxisY, true /*fKernel*/))
+        bitmapScale32Generic(dst, dstW, dstH, src, iDeltaLine, srcW, srcH);
+
+    bitmapScaleAxisDelete(&AxisX);
+    bitmapScaleAxisDelete(&AxisY);
+}
+
+/* For 32 bit source only.
+ * Like BitmapScale32, but interpolates with a triangle filter (bilinear when
+ * upscaling), which is cheaper and less blurry for small scaling factors. */
+void BitmapScale32Bilinear(uint8_t *dst,
+                           int dstW, int dstH,
+                           const uint8_t *src,
+                           int iDeltaLine,
+                           int srcW, int srcH)
+{
+    bitmapScale32Kernel(dst, dstW, dstH, src, iDeltaLine, srcW, srcH, BITMAPSCALEKERNEL_BILINEAR);
+}
+
+/* For 32 bit source only.
+ * Like BitmapScale32, but with a three lobed Lanczos filter which keeps text
+ * and edges sharper at the cost of some ringing. */
+void BitmapScale32Lanczos(uint8_t *dst,
+                          int dstW, int dstH,
+                          const uint8_t *src,
+                          int iDeltaLine,
+                          int srcW, int srcH)
+{
+    bitmapScale32Kernel(dst, dstW, dstH, src, iDeltaLine, srcW, srcH, BITMAPSCALEKERNEL_LANCZOS3);
+}
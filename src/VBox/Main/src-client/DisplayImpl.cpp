@@ -2258,6 +2258,49 @@ HRESULT Display::takeScreenShotToArray(ULONG aScreenId,
     return rc;
 }
 
+HRESULT Display::takeScreenShotsToArray(const std::vector<ULONG> &aScreenIds,
+                                        ULONG aWidth,
+                                        ULONG aHeight,
+                                        BitmapFormat_T aBitmapFormat,
+                                        std::vector<ULONG> &aScreenSizes,
+                                        std::vector<BYTE> &aScreenData)
+{
+    HRESULT rc = S_OK;
+
+    LogRelFlowFunc(("%zu screens, width=%d, height=%d, format 0x%08X\n",
+                     aScreenIds.size(), aWidth, aHeight, aBitmapFormat));
+
+    CheckComArgExpr(aWidth, aWidth != 0 && aWidth <= 32767);
+    CheckComArgExpr(aHeight, aHeight != 0 && aHeight <= 32767);
+
+    /* Every image takes at most the 32bpp size, so allocate that once and
+     * pack the results behind each other. */
+    const size_t cbData = aWidth * 4 * aHeight;
+    aScreenSizes.resize(aScreenIds.size());
+    aScreenData.resize(cbData * aScreenIds.size());
+
+    size_t offData = 0;
+    for (size_t i = 0; i < aScreenIds.size(); i++)
+    {
+        ULONG cbOut = 0;
+        rc = takeScreenShotWorker(aScreenIds[i], &aScreenData[offData], aWidth, aHeight, aBitmapFormat, &cbOut);
+        if (FAILED(rc))
+            break;
+        aScreenSizes[i] = cbOut;
+        offData += cbOut;
+    }
+
+    if (FAILED(rc))
+    {
+        aScreenSizes.clear();
+        offData = 0;
+    }
+    aScreenData.resize(offData);
+
+    LogRelFlowFunc(("%Rhrc\n", rc));
+    return rc;
+}
+
 
 int Display::i_VideoCaptureEnableScreens(ComSafeArrayIn(BOOL, aScreens))
 {
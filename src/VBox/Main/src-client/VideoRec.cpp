@@ -29,6 +29,7 @@
 
 #include "EbmlWriter.h"
 #include "VideoRec.h"
+#include "VideoRecColorConv.h"
 
 #define VPX_CODEC_DISABLE_COMPAT 1
 #include <vpx/vp8cx.h>
@@ -37,8 +38,15 @@
 /** Default VPX codec to use */
 #define DEFAULTCODEC (vpx_codec_vp8_cx())
 
+/** Default number of frames a stream can queue up for its encoder. */
+#define VIDEOREC_QUEUE_DEFAULT  3
+/** Maximum number of frames a stream can queue up for its encoder. */
+#define VIDEOREC_QUEUE_MAX      16
+
+typedef struct VIDEORECFRAME *PVIDEORECFRAME;
+
 static int videoRecEncodeAndWrite(PVIDEORECSTREAM pStrm);
-static int videoRecRGBToYUV(PVIDEORECSTREAM pStrm);
+static int videoRecRGBToYUV(PVIDEORECSTREAM pStrm, PVIDEORECFRAME pFrame);
 
 /* state to synchronized between threads */
 enum
@@ -56,6 +64,23 @@ enum
 static uint32_t g_enmState = VIDREC_UNINITIALIZED;
 
 
+/**
+ * A captured frame waiting in the queue of a stream.
+ */
+typedef struct VIDEORECFRAME
+{
+    /* RGB buffer, large enough for the target resolution at 32 bpp */
+    uint8_t             *pu8RgbBuf;
+    /* pixel format of the frame */
+    VIDEORECPIXFMT      enmPixFmt;
+    /* X resolution of the last source picture copied to this buffer */
+    uint32_t            uLastSourceWidth;
+    /* Y resolution of the last source picture copied to this buffer */
+    uint32_t            uLastSourceHeight;
+    /* time stamp of the frame */
+    uint64_t            u64TimeStamp;
+} VIDEORECFRAME;
+
 typedef struct VIDEORECSTREAM
 {
     /* container context */
@@ -68,44 +93,48 @@ typedef struct VIDEORECSTREAM
     uint32_t            uTargetWidth;
     /* Y resolution */
     uint32_t            uTargetHeight;
-    /* X resolution of the last encoded picture */
-    uint32_t            uLastSourceWidth;
-    /* Y resolution of the last encoded picture */
-    uint32_t            uLastSourceHeight;
+    /* screen number */
+    uint32_t            uScreen;
     /* current frame number */
     uint32_t            cFrame;
-    /* RGB buffer containing the most recent frame of the framebuffer */
-    uint8_t             *pu8RgbBuf;
     /* YUV buffer the encode function fetches the frame from */
     uint8_t             *pu8YuvBuf;
     /* VPX image context */
     vpx_image_t         VpxRawImage;
     /* true if video recording is enabled */
     bool                fEnabled;
-    /* true if the RGB buffer is filled */
-    bool                fRgbFilled;
-    /* pixel format of the current frame */
-    uint32_t            u32PixelFormat;
     /* minimal delay between two frames */
     uint32_t            uDelay;
-    /* time stamp of the last frame we encoded */
+    /* time stamp of the last frame accepted from the framebuffer */
     uint64_t            u64LastTimeStamp;
-    /* time stamp of the current frame */
+    /* time stamp of the frame being encoded */
     uint64_t            u64TimeStamp;
     /* encoder deadline */
     unsigned int        uEncoderDeadline;
+    /* semaphore to signal the encoding worker thread */
+    RTSEMEVENT          WaitEvent;
+    /* encoding worker thread */
+    RTTHREAD            Thread;
+    /* frame queue, a ring buffer with one producer (EMT) and one consumer (worker) */
+    PVIDEORECFRAME      paFrames;
+    /* number of entries in paFrames */
+    uint32_t            cFrames;
+    /* index of the next frame to encode, only touched by the worker */
+    uint32_t            iFrameRead;
+    /* index of the next frame to fill, only touched by the producer */
+    uint32_t            iFrameWrite;
+    /* number of queued frames */
+    uint32_t volatile   cFramesQueued;
+    /* encoding errors left to report in the release log */
+    uint32_t            cErrorsToLog;
 } VIDEORECSTREAM;
 
 typedef struct VIDEORECCONTEXT
 {
-    /* semaphore to signal the encoding worker thread */
-    RTSEMEVENT          WaitEvent;
     /* semaphore required during termination */
     RTSEMEVENT          TermEvent;
     /* true if video recording is enabled */
     bool                fEnabled;
-    /* worker thread */
-    RTTHREAD            Thread;
     /* number of stream contexts */
     uint32_t            cScreens;
     /* maximal time stamp */
@@ -118,305 +147,41 @@ typedef struct VIDEORECCONTEXT
 
 
 /**
- * Iterator class for running through a BGRA32 image buffer and converting
- * it to RGB.
- */
-class ColorConvBGRA32Iter
-{
-private:
-    enum { PIX_SIZE = 4 };
-public:
-    ColorConvBGRA32Iter(unsigned aWidth, unsigned aHeight, uint8_t *aBuf)
-    {
-        LogFlow(("width = %d height=%d aBuf=%lx\n", aWidth, aHeight, aBuf));
-        mPos = 0;
-        mSize = aWidth * aHeight * PIX_SIZE;
-        mBuf = aBuf;
-    }
-    /**
-     * Convert the next pixel to RGB.
-     * @returns true on success, false if we have reached the end of the buffer
-     * @param   aRed    where to store the red value
-     * @param   aGreen  where to store the green value
-     * @param   aBlue   where to store the blue value
-     */
-    bool getRGB(unsigned *aRed, unsigned *aGreen, unsigned *aBlue)
-    {
-        bool rc = false;
-        if (mPos + PIX_SIZE <= mSize)
-        {
-            *aRed   = mBuf[mPos + 2];
-            *aGreen = mBuf[mPos + 1];
-            *aBlue  = mBuf[mPos    ];
-            mPos += PIX_SIZE;
-            rc = true;
-        }
-        return rc;
-    }
-
-    /**
-     * Skip forward by a certain number of pixels
-     * @param aPixels  how many pixels to skip
-     */
-    void skip(unsigned aPixels)
-    {
-        mPos += PIX_SIZE * aPixels;
-    }
-private:
-    /** Size of the picture buffer */
-    unsigned mSize;
-    /** Current position in the picture buffer */
-    unsigned mPos;
-    /** Address of the picture buffer */
-    uint8_t *mBuf;
-};
-
-/**
- * Iterator class for running through an BGR24 image buffer and converting
- * it to RGB.
- */
-class ColorConvBGR24Iter
-{
-private:
-    enum { PIX_SIZE = 3 };
-public:
-    ColorConvBGR24Iter(unsigned aWidth, unsigned aHeight, uint8_t *aBuf)
-    {
-        mPos = 0;
-        mSize = aWidth * aHeight * PIX_SIZE;
-        mBuf = aBuf;
-    }
-    /**
-     * Convert the next pixel to RGB.
-     * @returns true on success, false if we have reached the end of the buffer
-     * @param   aRed    where to store the red value
-     * @param   aGreen  where to store the green value
-     * @param   aBlue   where to store the blue value
-     */
-    bool getRGB(unsigned *aRed, unsigned *aGreen, unsigned *aBlue)
-    {
-        bool rc = false;
-        if (mPos + PIX_SIZE <= mSize)
-        {
-            *aRed   = mBuf[mPos + 2];
-            *aGreen = mBuf[mPos + 1];
-            *aBlue  = mBuf[mPos    ];
-            mPos += PIX_SIZE;
-            rc = true;
-        }
-        return rc;
-    }
-
-    /**
-     * Skip forward by a certain number of pixels
-     * @param aPixels  how many pixels to skip
-     */
-    void skip(unsigned aPixels)
-    {
-        mPos += PIX_SIZE * aPixels;
-    }
-private:
-    /** Size of the picture buffer */
-    unsigned mSize;
-    /** Current position in the picture buffer */
-    unsigned mPos;
-    /** Address of the picture buffer */
-    uint8_t *mBuf;
-};
-
-/**
- * Iterator class for running through an BGR565 image buffer and converting
- * it to RGB.
- */
-class ColorConvBGR565Iter
-{
-private:
-    enum { PIX_SIZE = 2 };
-public:
-    ColorConvBGR565Iter(unsigned aWidth, unsigned aHeight, uint8_t *aBuf)
-    {
-        mPos = 0;
-        mSize = aWidth * aHeight * PIX_SIZE;
-        mBuf = aBuf;
-    }
-    /**
-     * Convert the next pixel to RGB.
-     * @returns true on success, false if we have reached the end of the buffer
-     * @param   aRed    where to store the red value
-     * @param   aGreen  where to store the green value
-     * @param   aBlue   where to store the blue value
-     */
-    bool getRGB(unsigned *aRed, unsigned *aGreen, unsigned *aBlue)
-    {
-        bool rc = false;
-        if (mPos + PIX_SIZE <= mSize)
-        {
-            unsigned uFull =  (((unsigned) mBuf[mPos + 1]) << 8)
-                             | ((unsigned) mBuf[mPos]);
-            *aRed   = (uFull >> 8) & ~7;
-            *aGreen = (uFull >> 3) & ~3 & 0xff;
-            *aBlue  = (uFull << 3) & ~7 & 0xff;
-            mPos += PIX_SIZE;
-            rc = true;
-        }
-        return rc;
-    }
-
-    /**
-     * Skip forward by a certain number of pixels
-     * @param aPixels  how many pixels to skip
-     */
-    void skip(unsigned aPixels)
-    {
-        mPos += PIX_SIZE * aPixels;
-    }
-private:
-    /** Size of the picture buffer */
-    unsigned mSize;
-    /** Current position in the picture buffer */
-    unsigned mPos;
-    /** Address of the picture buffer */
-    uint8_t *mBuf;
-};
-
-/**
- * Convert an image to YUV420p format
- * @returns true on success, false on failure
- * @param aWidth    width of image
- * @param aHeight   height of image
- * @param aDestBuf  an allocated memory buffer large enough to hold the
- *                  destination image (i.e. width * height * 12bits)
- * @param aSrcBuf   the source image as an array of bytes
- */
-template <class T>
-inline bool colorConvWriteYUV420p(unsigned aWidth, unsigned aHeight, uint8_t *aDestBuf, uint8_t *aSrcBuf)
-{
-    AssertReturn(!(aWidth & 1), false);
-    AssertReturn(!(aHeight & 1), false);
-    bool fRc = true;
-    T iter1(aWidth, aHeight, aSrcBuf);
-    T iter2 = iter1;
-    iter2.skip(aWidth);
-    unsigned cPixels = aWidth * aHeight;
-    unsigned offY = 0;
-    unsigned offU = cPixels;
-    unsigned offV = cPixels + cPixels / 4;
-    unsigned const cyHalf = aHeight / 2;
-    unsigned const cxHalf = aWidth  / 2;
-    for (unsigned i = 0; i < cyHalf && fRc; ++i)
-    {
-        for (unsigned j = 0; j < cxHalf; ++j)
-        {
-            unsigned red, green, blue;
-            fRc = iter1.getRGB(&red, &green, &blue);
-            AssertReturn(fRc, false);
-            aDestBuf[offY] = ((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16;
-            unsigned u = (((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128) / 4;
-            unsigned v = (((112 * red - 94 * green -  18 * blue + 128) >> 8) + 128) / 4;
-
-            fRc = iter1.getRGB(&red, &green, &blue);
-            AssertReturn(fRc, false);
-            aDestBuf[offY + 1] = ((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16;
-            u += (((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128) / 4;
-            v += (((112 * red - 94 * green -  18 * blue + 128) >> 8) + 128) / 4;
-
-            fRc = iter2.getRGB(&red, &green, &blue);
-            AssertReturn(fRc, false);
-            aDestBuf[offY + aWidth] = ((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16;
-            u += (((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128) / 4;
-            v += (((112 * red - 94 * green -  18 * blue + 128) >> 8) + 128) / 4;
-
-            fRc = iter2.getRGB(&red, &green, &blue);
-            AssertReturn(fRc, false);
-            aDestBuf[offY + aWidth + 1] = ((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16;
-            u += (((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128) / 4;
-            v += (((112 * red - 94 * green -  18 * blue + 128) >> 8) + 128) / 4;
-
-            aDestBuf[offU] = u;
-            aDestBuf[offV] = v;
-            offY += 2;
-            ++offU;
-            ++offV;
-        }
-
-        iter1.skip(aWidth);
-        iter2.skip(aWidth);
-        offY += aWidth;
-    }
-
-    return true;
-}
-
-/**
- * Convert an image to RGB24 format
- * @returns true on success, false on failure
- * @param aWidth    width of image
- * @param aHeight   height of image
- * @param aDestBuf  an allocated memory buffer large enough to hold the
- *                  destination image (i.e. width * height * 12bits)
- * @param aSrcBuf   the source image as an array of bytes
- */
-template <class T>
-inline bool colorConvWriteRGB24(unsigned aWidth, unsigned aHeight,
-                                uint8_t *aDestBuf, uint8_t *aSrcBuf)
-{
-    enum { PIX_SIZE = 3 };
-    bool rc = true;
-    AssertReturn(0 == (aWidth & 1), false);
-    AssertReturn(0 == (aHeight & 1), false);
-    T iter(aWidth, aHeight, aSrcBuf);
-    unsigned cPixels = aWidth * aHeight;
-    for (unsigned i = 0; i < cPixels && rc; ++i)
-    {
-        unsigned red, green, blue;
-        rc = iter.getRGB(&red, &green, &blue);
-        if (rc)
-        {
-            aDestBuf[i * PIX_SIZE    ] = red;
-            aDestBuf[i * PIX_SIZE + 1] = green;
-            aDestBuf[i * PIX_SIZE + 2] = blue;
-        }
-    }
-    return rc;
-}
-
-/**
- * Worker thread for all streams.
+ * Worker thread of a stream.
  *
- * RGB/YUV conversion and encoding.
+ * RGB/YUV conversion and encoding of the queued frames.
  */
 static DECLCALLBACK(int) videoRecThread(RTTHREAD hThreadSelf, void *pvUser)
 {
     RT_NOREF(hThreadSelf);
-    PVIDEORECCONTEXT pCtx = (PVIDEORECCONTEXT)pvUser;
+    PVIDEORECSTREAM pStrm = (PVIDEORECSTREAM)pvUser;
     for (;;)
     {
-        int rc = RTSemEventWait(pCtx->WaitEvent, RT_INDEFINITE_WAIT);
+        int rc = RTSemEventWait(pStrm->WaitEvent, RT_INDEFINITE_WAIT);
         AssertRCBreak(rc);
 
-        if (ASMAtomicReadU32(&g_enmState) == VIDREC_TERMINATING)
-            break;
-        for (unsigned uScreen = 0; uScreen < pCtx->cScreens; uScreen++)
+        while (   ASMAtomicReadU32(&g_enmState) != VIDREC_TERMINATING
+               && ASMAtomicReadU32(&pStrm->cFramesQueued) > 0)
         {
-            PVIDEORECSTREAM pStrm = &pCtx->Strm[uScreen];
-            if (   pStrm->fEnabled
-                && ASMAtomicReadBool(&pStrm->fRgbFilled))
+            PVIDEORECFRAME pFrame = &pStrm->paFrames[pStrm->iFrameRead];
+            rc = videoRecRGBToYUV(pStrm, pFrame);
+            pStrm->u64TimeStamp = pFrame->u64TimeStamp;
+
+            /* The RGB buffer can take the next frame as soon as it is converted. */
+            pStrm->iFrameRead = (pStrm->iFrameRead + 1) % pStrm->cFrames;
+            ASMAtomicDecU32(&pStrm->cFramesQueued);
+
+            if (RT_SUCCESS(rc))
+                rc = videoRecEncodeAndWrite(pStrm);
+            if (RT_FAILURE(rc) && pStrm->cErrorsToLog > 0)
             {
-                rc = videoRecRGBToYUV(pStrm);
-                ASMAtomicWriteBool(&pStrm->fRgbFilled, false);
-                if (RT_SUCCESS(rc))
-                    rc = videoRecEncodeAndWrite(pStrm);
-                if (RT_FAILURE(rc))
-                {
-                    static unsigned cErrors = 100;
-                    if (cErrors > 0)
-                    {
-                        LogRel(("Error %Rrc encoding / writing video frame\n", rc));
-                        cErrors--;
-                    }
-                }
+                LogRel(("Error %Rrc encoding / writing video frame of screen %u\n", rc, pStrm->uScreen));
+                pStrm->cErrorsToLog--;
             }
         }
+
+        if (ASMAtomicReadU32(&g_enmState) == VIDREC_TERMINATING)
+            break;
     }
 
     return VINF_SUCCESS;
@@ -444,16 +209,10 @@ int VideoRecContextCreate(PVIDEORECCONTEXT *ppCtx, uint32_t cScreens)
          * it is required to call placement new for correct initialization
          * of the object. */
         new (&pCtx->Strm[uScreen] + RT_OFFSETOF(VIDEORECSTREAM, Ebml)) WebMWriter();
+        pCtx->Strm[uScreen].uScreen = uScreen;
     }
 
-    int rc = RTSemEventCreate(&pCtx->WaitEvent);
-    AssertRCReturn(rc, rc);
-
-    rc = RTSemEventCreate(&pCtx->TermEvent);
-    AssertRCReturn(rc, rc);
-
-    rc = RTThreadCreate(&pCtx->Thread, videoRecThread, (void*)pCtx, 0,
-                        RTTHREADTYPE_MAIN_WORKER, RTTHREADFLAGS_WAITABLE, "VideoRec");
+    int rc = RTSemEventCreate(&pCtx->TermEvent);
     AssertRCReturn(rc, rc);
 
     ASMAtomicWriteU32(&g_enmState, VIDREC_IDLE);
@@ -469,6 +228,11 @@ int VideoRecContextCreate(PVIDEORECCONTEXT *ppCtx, uint32_t cScreens)
  * @param   strFile             File to save the recorded data
  * @param   uTargetWidth        Width of the target image in the video recoriding file (movie)
  * @param   uTargetHeight       Height of the target image in video recording file.
+ * @param   pszOptions          Comma separated key=value list of advanced options:
+ *                              - quality=realtime|good|best|<deadline in us>: encoder deadline
+ *                              - cpu_used=<-16..16>: VP8 speed/quality trade-off, higher is faster
+ *                              - threads=<n>: number of VPX encoder threads for this screen
+ *                              - queue=<n>: number of frames buffered for the encoder thread
  */
 int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFile,
                      uint32_t uWidth, uint32_t uHeight, uint32_t uRate, uint32_t uFps,
@@ -483,9 +247,8 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
     PVIDEORECSTREAM pStrm = &pCtx->Strm[uScreen];
     pStrm->uTargetWidth  = uWidth;
     pStrm->uTargetHeight = uHeight;
-    pStrm->pu8RgbBuf = (uint8_t *)RTMemAllocZ(uWidth * uHeight * 4);
-    AssertReturn(pStrm->pu8RgbBuf, VERR_NO_MEMORY);
     pStrm->uEncoderDeadline = VPX_DL_REALTIME;
+    pStrm->cErrorsToLog = 100;
 
     /* Play safe: the file must not exist, overwriting is potentially
      * hazardous as nothing prevents the user from picking a file name of some
@@ -505,6 +268,11 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
         return VERR_INVALID_PARAMETER;
     }
 
+    uint32_t cFrames   = VIDEOREC_QUEUE_DEFAULT;
+    uint32_t cThreads  = 0;
+    bool     fCpuUsed  = false;
+    int32_t  iCpuUsed  = 0;
+
     com::Utf8Str options(pszOptions);
     size_t pos = 0;
 
@@ -533,6 +301,15 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
                 pStrm->uEncoderDeadline = value.toUInt32();
             }
         }
+        else if (key == "cpu_used")
+        {
+            iCpuUsed = value.toInt32();
+            fCpuUsed = true;
+        }
+        else if (key == "threads")
+            cThreads = value.toUInt32();
+        else if (key == "queue")
+            cFrames = RT_MIN(RT_MAX(value.toUInt32(), 1), VIDEOREC_QUEUE_MAX);
         else LogRel(("Getting unknown option: %s=%s\n", key.c_str(), value.c_str()));
 
     } while(pos != com::Utf8Str::npos);
@@ -546,8 +323,8 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
     /* 1ms per frame */
     pStrm->VpxConfig.g_timebase.num = 1;
     pStrm->VpxConfig.g_timebase.den = 1000;
-    /* disable multithreading */
-    pStrm->VpxConfig.g_threads = 0;
+    /* multithreading within the encoder, disabled by default as every screen has its own thread */
+    pStrm->VpxConfig.g_threads = cThreads;
 
     pStrm->uDelay = 1000 / uFps;
 
@@ -563,6 +340,13 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
         return VERR_INVALID_PARAMETER;
     }
 
+    if (fCpuUsed)
+    {
+        rcv = vpx_codec_control(&pStrm->VpxCodec, VP8E_SET_CPUUSED, iCpuUsed);
+        if (rcv != VPX_CODEC_OK)
+            LogRel(("Failed to set the VP8 encoder speed to %d: %s\n", iCpuUsed, vpx_codec_err_to_string(rcv)));
+    }
+
     if (!vpx_img_alloc(&pStrm->VpxRawImage, VPX_IMG_FMT_I420, uWidth, uHeight, 1))
     {
         LogFlow(("Failed to allocate image %dx%d", uWidth, uHeight));
@@ -570,6 +354,22 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
     }
     pStrm->pu8YuvBuf = pStrm->VpxRawImage.planes[0];
 
+    pStrm->paFrames = (PVIDEORECFRAME)RTMemAllocZ(cFrames * sizeof(VIDEORECFRAME));
+    AssertReturn(pStrm->paFrames, VERR_NO_MEMORY);
+    pStrm->cFrames = cFrames;
+    for (uint32_t i = 0; i < cFrames; i++)
+    {
+        pStrm->paFrames[i].pu8RgbBuf = (uint8_t *)RTMemAllocZ(uWidth * uHeight * 4);
+        AssertReturn(pStrm->paFrames[i].pu8RgbBuf, VERR_NO_MEMORY);
+    }
+
+    rc = RTSemEventCreate(&pStrm->WaitEvent);
+    AssertRCReturn(rc, rc);
+
+    rc = RTThreadCreateF(&pStrm->Thread, videoRecThread, pStrm, 0,
+                         RTTHREADTYPE_MAIN_WORKER, RTTHREADFLAGS_WAITABLE, "VideoRec%u", uScreen);
+    AssertRCReturn(rc, rc);
+
     pCtx->fEnabled = true;
     pStrm->fEnabled = true;
     return VINF_SUCCESS;
@@ -599,9 +399,18 @@ void VideoRecContextClose(PVIDEORECCONTEXT pCtx)
         AssertRC(rc);
     }
 
-    RTSemEventSignal(pCtx->WaitEvent);
-    RTThreadWait(pCtx->Thread, 10000, NULL);
-    RTSemEventDestroy(pCtx->WaitEvent);
+    for (unsigned uScreen = 0; uScreen < pCtx->cScreens; uScreen++)
+    {
+        PVIDEORECSTREAM pStrm = &pCtx->Strm[uScreen];
+        if (pStrm->Thread != NIL_RTTHREAD)
+        {
+            RTSemEventSignal(pStrm->WaitEvent);
+            RTThreadWait(pStrm->Thread, 10000, NULL);
+            pStrm->Thread = NIL_RTTHREAD;
+        }
+        RTSemEventDestroy(pStrm->WaitEvent);
+        pStrm->WaitEvent = NIL_RTSEMEVENT;
+    }
     RTSemEventDestroy(pCtx->TermEvent);
 
     for (unsigned uScreen = 0; uScreen < pCtx->cScreens; uScreen++)
@@ -615,8 +424,13 @@ void VideoRecContextClose(PVIDEORECCONTEXT pCtx)
             vpx_img_free(&pStrm->VpxRawImage);
             vpx_codec_err_t rcv = vpx_codec_destroy(&pStrm->VpxCodec);
             Assert(rcv == VPX_CODEC_OK); RT_NOREF(rcv);
-            RTMemFree(pStrm->pu8RgbBuf);
-            pStrm->pu8RgbBuf = NULL;
+        }
+        if (pStrm->paFrames)
+        {
+            for (uint32_t i = 0; i < pStrm->cFrames; i++)
+                RTMemFree(pStrm->paFrames[i].pu8RgbBuf);
+            RTMemFree(pStrm->paFrames);
+            pStrm->paFrames = NULL;
         }
         /* Explicitly deinitilize Ebml object since it was created using placement new. */
         pStrm->Ebml.~WebMWriter();
@@ -663,7 +477,7 @@ bool VideoRecIsReady(PVIDEORECCONTEXT pCtx, uint32_t uScreen, uint64_t u64TimeSt
     if (u64TimeStamp < pStrm->u64LastTimeStamp + pStrm->uDelay)
         return false;
 
-    if (ASMAtomicReadBool(&pStrm->fRgbFilled))
+    if (ASMAtomicReadU32(&pStrm->cFramesQueued) >= pStrm->cFrames)
         return false;
 
     return true;
@@ -755,40 +569,13 @@ static int videoRecEncodeAndWrite(PVIDEORECSTREAM pStrm)
  * VideoRec utility function to convert RGB to YUV.
  *
  * @returns IPRT status code.
- * @param   pCtx      Pointer to video recording context.
+ * @param   pStrm     Pointer to the stream.
+ * @param   pFrame    The queued frame to convert.
  */
-static int videoRecRGBToYUV(PVIDEORECSTREAM pStrm)
+static int videoRecRGBToYUV(PVIDEORECSTREAM pStrm, PVIDEORECFRAME pFrame)
 {
-    switch (pStrm->u32PixelFormat)
-    {
-        case VPX_IMG_FMT_RGB32:
-            LogFlow(("32 bit\n"));
-            if (!colorConvWriteYUV420p<ColorConvBGRA32Iter>(pStrm->uTargetWidth,
-                                                            pStrm->uTargetHeight,
-                                                            pStrm->pu8YuvBuf,
-                                                            pStrm->pu8RgbBuf))
-                return VERR_GENERAL_FAILURE;
-            break;
-        case VPX_IMG_FMT_RGB24:
-            LogFlow(("24 bit\n"));
-            if (!colorConvWriteYUV420p<ColorConvBGR24Iter>(pStrm->uTargetWidth,
-                                                           pStrm->uTargetHeight,
-                                                           pStrm->pu8YuvBuf,
-                                                           pStrm->pu8RgbBuf))
-                return VERR_GENERAL_FAILURE;
-            break;
-        case VPX_IMG_FMT_RGB565:
-            LogFlow(("565 bit\n"));
-            if (!colorConvWriteYUV420p<ColorConvBGR565Iter>(pStrm->uTargetWidth,
-                                                            pStrm->uTargetHeight,
-                                                            pStrm->pu8YuvBuf,
-                                                            pStrm->pu8RgbBuf))
-                return VERR_GENERAL_FAILURE;
-            break;
-        default:
-            return VERR_GENERAL_FAILURE;
-    }
-    return VINF_SUCCESS;
+    return VideoRecColorConvToI420(pFrame->enmPixFmt, pStrm->uTargetWidth, pStrm->uTargetHeight,
+                                   pFrame->pu8RgbBuf, pStrm->pu8YuvBuf);
 }
 
 /**
@@ -838,11 +625,12 @@ int VideoRecCopyToIntBuf(PVIDEORECCONTEXT pCtx, uint32_t uScreen, uint32_t x, ui
             rc = VINF_TRY_AGAIN; /* respect maximum frames per second */
             break;
         }
-        if (ASMAtomicReadBool(&pStrm->fRgbFilled))
+        if (ASMAtomicReadU32(&pStrm->cFramesQueued) >= pStrm->cFrames)
         {
-            rc = VERR_TRY_AGAIN; /* previous frame not yet encoded */
+            rc = VERR_TRY_AGAIN; /* queue full, previous frames not yet encoded */
             break;
         }
+        PVIDEORECFRAME pFrame = &pStrm->paFrames[pStrm->iFrameWrite];
 
         pStrm->u64LastTimeStamp = u64TimeStamp;
 
@@ -897,20 +685,21 @@ int VideoRecCopyToIntBuf(PVIDEORECCONTEXT pCtx, uint32_t uScreen, uint32_t x, ui
 
         /* Calculate bytes per pixel */
         uint32_t bpp = 1;
+        pFrame->enmPixFmt = VIDEORECPIXFMT_INVALID;
         if (uPixelFormat == BitmapFormat_BGR)
         {
             switch (uBitsPerPixel)
             {
                 case 32:
-                    pStrm->u32PixelFormat = VPX_IMG_FMT_RGB32;
+                    pFrame->enmPixFmt = VIDEORECPIXFMT_BGRA32;
                     bpp = 4;
                     break;
                 case 24:
-                    pStrm->u32PixelFormat = VPX_IMG_FMT_RGB24;
+                    pFrame->enmPixFmt = VIDEORECPIXFMT_BGR24;
                     bpp = 3;
                     break;
                 case 16:
-                    pStrm->u32PixelFormat = VPX_IMG_FMT_RGB565;
+                    pFrame->enmPixFmt = VIDEORECPIXFMT_BGR565;
                     bpp = 2;
                     break;
                 default:
@@ -921,14 +710,15 @@ int VideoRecCopyToIntBuf(PVIDEORECCONTEXT pCtx, uint32_t uScreen, uint32_t x, ui
         else
             AssertMsgFailed(("Unknown pixel format! mPixelFormat=%d\n", uPixelFormat));
 
-        /* One of the dimensions of the current frame is smaller than before so
-         * clear the entire buffer to prevent artifacts from the previous frame */
-        if (   uSourceWidth  < pStrm->uLastSourceWidth
-            || uSourceHeight < pStrm->uLastSourceHeight)
-            memset(pStrm->pu8RgbBuf, 0, pStrm->uTargetWidth * pStrm->uTargetHeight * 4);
+        /* One of the dimensions of the current frame is smaller than the one
+         * last copied to this buffer so clear the entire buffer to prevent
+         * artifacts from the previous frame */
+        if (   uSourceWidth  < pFrame->uLastSourceWidth
+            || uSourceHeight < pFrame->uLastSourceHeight)
+            memset(pFrame->pu8RgbBuf, 0, pStrm->uTargetWidth * pStrm->uTargetHeight * 4);
 
-        pStrm->uLastSourceWidth  = uSourceWidth;
-        pStrm->uLastSourceHeight = uSourceHeight;
+        pFrame->uLastSourceWidth  = uSourceWidth;
+        pFrame->uLastSourceHeight = uSourceHeight;
 
         /* Calculate start offset in source and destination buffers */
         uint32_t offSrc = y * uBytesPerLine + x * bpp;
@@ -939,15 +729,16 @@ int VideoRecCopyToIntBuf(PVIDEORECCONTEXT pCtx, uint32_t uScreen, uint32_t x, ui
             /* Overflow check */
             Assert(offSrc + w * bpp <= uSourceHeight * uBytesPerLine);
             Assert(offDst + w * bpp <= pStrm->uTargetHeight * pStrm->uTargetWidth * bpp);
-            memcpy(pStrm->pu8RgbBuf + offDst, pu8BufAddr + offSrc, w * bpp);
+            memcpy(pFrame->pu8RgbBuf + offDst, pu8BufAddr + offSrc, w * bpp);
             offSrc += uBytesPerLine;
             offDst += pStrm->uTargetWidth * bpp;
         }
 
-        pStrm->u64TimeStamp = u64TimeStamp;
+        pFrame->u64TimeStamp = u64TimeStamp;
 
-        ASMAtomicWriteBool(&pStrm->fRgbFilled, true);
-        RTSemEventSignal(pCtx->WaitEvent);
+        pStrm->iFrameWrite = (pStrm->iFrameWrite + 1) % pStrm->cFrames;
+        ASMAtomicIncU32(&pStrm->cFramesQueued);
+        RTSemEventSignal(pStrm->WaitEvent);
     } while (0);
 
     if (!ASMAtomicCmpXchgU32(&g_enmState, VIDREC_IDLE, VIDREC_COPYING))
@@ -0,0 +1,179 @@
+/* $Id$ */
+/** @file
+ * Video recording: AVX2 RGB to I420 color space conversion.
+ *
+ * This file must be compiled with AVX2 code generation enabled (gcc: -mavx2),
+ * so nothing in here may be called without VideoRecColorConvIsSupported()
+ * saying yes first.  See VideoRecColorConv.cpp for the arithmetic.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#include <iprt/assert.h>
+#include <iprt/string.h>
+
+#include "VideoRecColorConv.h"
+
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+# include <immintrin.h>
+
+
+/**
+ * Converts 16 pixels worth of 16-bit components to luma, returning 16 words.
+ */
+DECLINLINE(__m256i) videoRecColorConvAvx2Y(__m256i uRed, __m256i uGreen, __m256i uBlue)
+{
+    __m256i uSum = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(uRed,   _mm256_set1_epi16(66)),
+                                                     _mm256_mullo_epi16(uGreen, _mm256_set1_epi16(129))),
+                                    _mm256_add_epi16(_mm256_mullo_epi16(uBlue,  _mm256_set1_epi16(25)),
+                                                     _mm256_set1_epi16(128)));
+    return _mm256_add_epi16(_mm256_srli_epi16(uSum, 8), _mm256_set1_epi16(16));
+}
+
+
+/**
+ * Converts 16 pixels worth of 16-bit components to a quarter of their chroma
+ * contribution and sums up horizontal pairs, returning 8 dwords.
+ */
+DECLINLINE(__m256i) videoRecColorConvAvx2C4Pairs(__m256i uRed, __m256i uGreen, __m256i uBlue,
+                                                 __m256i uRedMul, __m256i uGreenMul, __m256i uBlueMul)
+{
+    __m256i uSum = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(uRed,   uRedMul),
+                                                     _mm256_mullo_epi16(uGreen, uGreenMul)),
+                                    _mm256_add_epi16(_mm256_mullo_epi16(uBlue,  uBlueMul),
+                                                     _mm256_set1_epi16(128)));
+    uSum = _mm256_srli_epi16(_mm256_add_epi16(_mm256_srai_epi16(uSum, 8), _mm256_set1_epi16(128)), 2);
+    return _mm256_madd_epi16(uSum, _mm256_set1_epi16(1));
+}
+
+
+/**
+ * Splits 16 pixels given as two sets of 8 32-bit BGRX pixels into 16-bit
+ * components.
+ */
+DECLINLINE(void) videoRecColorConvAvx2SplitBGRX(__m256i uLo, __m256i uHi, __m256i *puRed, __m256i *puGreen, __m256i *puBlue)
+{
+    /* The packs work per 128-bit lane, the permutation puts the pixels back in order. */
+    __m256i const uMask = _mm256_set1_epi32(0xff);
+    *puBlue  = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(uLo, uMask),
+                                                           _mm256_and_si256(uHi, uMask)), 0xd8);
+    *puGreen = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(uLo, 8), uMask),
+                                                           _mm256_and_si256(_mm256_srli_epi32(uHi, 8), uMask)), 0xd8);
+    *puRed   = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(uLo, 16), uMask),
+                                                           _mm256_and_si256(_mm256_srli_epi32(uHi, 16), uMask)), 0xd8);
+}
+
+
+/**
+ * Loads 16 pixels, splitting them into 16-bit components.
+ *
+ * @note For BGR24 this reads 4 bytes beyond the 16th pixel.
+ */
+DECLINLINE(void) videoRecColorConvAvx2Load(VIDEORECPIXFMT enmFmt, const uint8_t *pb,
+                                           __m256i *puRed, __m256i *puGreen, __m256i *puBlue)
+{
+    switch (enmFmt)
+    {
+        case VIDEORECPIXFMT_BGRA32:
+            videoRecColorConvAvx2SplitBGRX(_mm256_loadu_si256((const __m256i *)pb),
+                                           _mm256_loadu_si256((const __m256i *)(pb + 32)),
+                                           puRed, puGreen, puBlue);
+            break;
+
+        case VIDEORECPIXFMT_BGR24:
+        {
+            /* Four pixels per 128-bit lane, expanded to BGRX with a byte shuffle. */
+            __m256i const uShuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            __m256i uLo = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)pb)),
+                                                  _mm_loadu_si128((const __m128i *)(pb + 12)), 1);
+            __m256i uHi = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(pb + 24))),
+                                                  _mm_loadu_si128((const __m128i *)(pb + 36)), 1);
+            videoRecColorConvAvx2SplitBGRX(_mm256_shuffle_epi8(uLo, uShuffle), _mm256_shuffle_epi8(uHi, uShuffle),
+                                           puRed, puGreen, puBlue);
+            break;
+        }
+
+        default:
+        {
+            Assert(enmFmt == VIDEORECPIXFMT_BGR565);
+            __m256i const uPix = _mm256_loadu_si256((const __m256i *)pb);
+            *puRed   = _mm256_and_si256(_mm256_srli_epi16(uPix, 8), _mm256_set1_epi16(0xf8));
+            *puGreen = _mm256_and_si256(_mm256_srli_epi16(uPix, 3), _mm256_set1_epi16(0xfc));
+            *puBlue  = _mm256_and_si256(_mm256_slli_epi16(uPix, 3), _mm256_set1_epi16(0xf8));
+            break;
+        }
+    }
+}
+
+
+/**
+ * AVX2 row pair converter, 16 pixels per row and iteration.
+ */
+DECLINLINE(uint32_t) videoRecColorConvRowsAvx2(VIDEORECPIXFMT enmFmt, const uint8_t *pbSrc, size_t cbSrcLine,
+                                               uint8_t *pbY, uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    uint32_t const cbPixel = VideoRecColorConvBytesPerPixel(enmFmt);
+    /* The BGR24 loader reads a little beyond the 16 pixels, keep that inside the row. */
+    uint32_t const cxSlack = enmFmt == VIDEORECPIXFMT_BGR24 ? 2 : 0;
+    uint32_t       x       = 0;
+    for (; x + 16 + cxSlack <= cx; x += 16)
+    {
+        __m256i uRed0, uGreen0, uBlue0, uRed1, uGreen1, uBlue1;
+        videoRecColorConvAvx2Load(enmFmt, pbSrc + x * cbPixel,             &uRed0, &uGreen0, &uBlue0);
+        videoRecColorConvAvx2Load(enmFmt, pbSrc + x * cbPixel + cbSrcLine, &uRed1, &uGreen1, &uBlue1);
+
+        /* The byte packing works per lane, so put the low quadwords of both lanes next to each other. */
+        __m256i const uY0 = videoRecColorConvAvx2Y(uRed0, uGreen0, uBlue0);
+        __m256i const uY1 = videoRecColorConvAvx2Y(uRed1, uGreen1, uBlue1);
+        _mm_storeu_si128((__m128i *)(pbY + x),
+                         _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(uY0, uY0), 0xd8)));
+        _mm_storeu_si128((__m128i *)(pbY + x + cx),
+                         _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(uY1, uY1), 0xd8)));
+
+        __m256i const uRedMulU = _mm256_set1_epi16(-38), uGreenMulU = _mm256_set1_epi16(-74), uBlueMulU = _mm256_set1_epi16(112);
+        __m256i const uRedMulV = _mm256_set1_epi16(112), uGreenMulV = _mm256_set1_epi16(-94), uBlueMulV = _mm256_set1_epi16(-18);
+        __m256i const uU = _mm256_add_epi32(videoRecColorConvAvx2C4Pairs(uRed0, uGreen0, uBlue0, uRedMulU, uGreenMulU, uBlueMulU),
+                                            videoRecColorConvAvx2C4Pairs(uRed1, uGreen1, uBlue1, uRedMulU, uGreenMulU, uBlueMulU));
+        __m256i const uV = _mm256_add_epi32(videoRecColorConvAvx2C4Pairs(uRed0, uGreen0, uBlue0, uRedMulV, uGreenMulV, uBlueMulV),
+                                            videoRecColorConvAvx2C4Pairs(uRed1, uGreen1, uBlue1, uRedMulV, uGreenMulV, uBlueMulV));
+
+        /* After the permutation the low lane holds the 8 U words and the high lane the 8 V words. */
+        __m256i uUV = _mm256_permute4x64_epi64(_mm256_packs_epi32(uU, uV), 0xd8);
+        uUV = _mm256_packus_epi16(uUV, uUV);
+        _mm_storel_epi64((__m128i *)(pbU + x / 2), _mm256_castsi256_si128(uUV));
+        _mm_storel_epi64((__m128i *)(pbV + x / 2), _mm256_extracti128_si256(uUV, 1));
+    }
+    return x;
+}
+
+
+DECLHIDDEN(DECLCALLBACK(uint32_t)) videoRecColorConvRowsBGRA32Avx2(const uint8_t *pbSrc, size_t cbSrcLine, uint8_t *pbY,
+                                                                   uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    return videoRecColorConvRowsAvx2(VIDEORECPIXFMT_BGRA32, pbSrc, cbSrcLine, pbY, pbU, pbV, cx);
+}
+
+DECLHIDDEN(DECLCALLBACK(uint32_t)) videoRecColorConvRowsBGR24Avx2(const uint8_t *pbSrc, size_t cbSrcLine, uint8_t *pbY,
+                                                                  uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    return videoRecColorConvRowsAvx2(VIDEORECPIXFMT_BGR24, pbSrc, cbSrcLine, pbY, pbU, pbV, cx);
+}
+
+DECLHIDDEN(DECLCALLBACK(uint32_t)) videoRecColorConvRowsBGR565Avx2(const uint8_t *pbSrc, size_t cbSrcLine, uint8_t *pbY,
+                                                                   uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    return videoRecColorConvRowsAvx2(VIDEORECPIXFMT_BGR565, pbSrc, cbSrcLine, pbY, pbU, pbV, cx);
+}
+
+#endif /* RT_ARCH_AMD64 || RT_ARCH_X86 */
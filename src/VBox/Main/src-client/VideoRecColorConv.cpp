@@ -0,0 +1,454 @@
+/* $Id$ */
+/** @file
+ * Video recording: RGB to I420 color space conversion.
+ *
+ * The encoder wants I420 (BT.601, studio swing) while the frame buffer comes
+ * as BGRA32, BGR24 or RGB565.  The conversion runs over the whole frame for
+ * every encoded picture, so it is done on pairs of rows: each 2x2 block gives
+ * four luma samples and one sample for each chroma plane.
+ *
+ * All implementations produce bit identical output.  The chroma of a 2x2
+ * block is the sum of the four per pixel values divided by four first, as the
+ * original per pixel iterator code did it, and not the rounded average.
+ *
+ * The SSE2 code here and the AVX2 code in VideoRecColorConv-avx2.cpp work on
+ * 16-bit lanes, which is enough for the BT.601 coefficients: the luma sum
+ * fits unsigned and the chroma sums fit signed 16 bits.  The generic code
+ * handles what is left at the end of a row.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#define LOG_GROUP LOG_GROUP_MAIN
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/err.h>
+#include <iprt/string.h>
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+# include <iprt/asm-amd64-x86.h>
+# include <iprt/x86.h>
+# include <emmintrin.h>
+#endif
+
+#include "VideoRecColorConv.h"
+
+
+/** @name VIDEORECCC_F_XXX - Host features the converters can use.
+ * @{ */
+#define VIDEORECCC_F_SSE2           RT_BIT_32(0)
+#define VIDEORECCC_F_AVX2           RT_BIT_32(1)
+#define VIDEORECCC_F_INITIALIZED    RT_BIT_32(31)
+/** @} */
+
+/** VIDEORECCC_F_XXX, lazily initialized. */
+static uint32_t volatile g_fVideoRecCCFeatures = 0;
+
+
+/**
+ * Queries the host features the SIMD converters can make use of.
+ *
+ * @returns VIDEORECCC_F_XXX.
+ */
+static uint32_t videoRecColorConvGetFeatures(void)
+{
+    uint32_t fFeatures = g_fVideoRecCCFeatures;
+    if (RT_LIKELY(fFeatures & VIDEORECCC_F_INITIALIZED))
+        return fFeatures;
+
+    /* Racing here is harmless, everyone arrives at the same result. */
+    fFeatures = VIDEORECCC_F_INITIALIZED;
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+    if (ASMHasCpuId())
+    {
+        uint32_t uEAX, uEBX, uECX, uEDX;
+        ASMCpuId(0, &uEAX, &uEBX, &uECX, &uEDX);
+        uint32_t const uMaxLeaf = uEAX;
+
+        ASMCpuId(1, &uEAX, &uEBX, &uECX, &uEDX);
+        if (uEDX & X86_CPUID_FEATURE_EDX_SSE2)
+        {
+            fFeatures |= VIDEORECCC_F_SSE2;
+
+            /* AVX2 also needs the OS to save the upper YMM halves. */
+            if (   (uECX & (X86_CPUID_FEATURE_ECX_AVX | X86_CPUID_FEATURE_ECX_OSXSAVE))
+                       == (X86_CPUID_FEATURE_ECX_AVX | X86_CPUID_FEATURE_ECX_OSXSAVE)
+                && uMaxLeaf >= 7
+                && (ASMGetXcr0() & (XSAVE_C_SSE | XSAVE_C_YMM)) == (XSAVE_C_SSE | XSAVE_C_YMM))
+            {
+                ASMCpuId_Idx_ECX(7, 0, &uEAX, &uEBX, &uECX, &uEDX);
+                if (uEBX & X86_CPUID_STEXT_FEATURE_EBX_AVX2)
+                    fFeatures |= VIDEORECCC_F_AVX2;
+            }
+        }
+    }
+#endif
+    ASMAtomicWriteU32(&g_fVideoRecCCFeatures, fFeatures);
+    return fFeatures;
+}
+
+
+/**
+ * Returns the size of one source pixel in bytes.
+ *
+ * @returns Bytes per pixel, 0 for invalid formats.
+ * @param   enmFmt      The source pixel format.
+ */
+uint32_t VideoRecColorConvBytesPerPixel(VIDEORECPIXFMT enmFmt)
+{
+    switch (enmFmt)
+    {
+        case VIDEORECPIXFMT_BGRA32: return 4;
+        case VIDEORECPIXFMT_BGR24:  return 3;
+        case VIDEORECPIXFMT_BGR565: return 2;
+        default:                    return 0;
+    }
+}
+
+
+/**
+ * Checks whether the given implementation can be used on this host.
+ *
+ * @returns true if supported, false if not.
+ * @param   enmImpl     The implementation to check.
+ */
+bool VideoRecColorConvIsSupported(VIDEORECCOLORCONVIMPL enmImpl)
+{
+    switch (enmImpl)
+    {
+        case VIDEORECCOLORCONVIMPL_AUTO:
+        case VIDEORECCOLORCONVIMPL_SCALAR:
+            return true;
+        case VIDEORECCOLORCONVIMPL_SSE2:
+            return RT_BOOL(videoRecColorConvGetFeatures() & VIDEORECCC_F_SSE2);
+        case VIDEORECCOLORCONVIMPL_AVX2:
+            return RT_BOOL(videoRecColorConvGetFeatures() & VIDEORECCC_F_AVX2);
+        default:
+            return false;
+    }
+}
+
+
+/**
+ * Returns a short name for the given implementation.
+ *
+ * @returns Read-only string.
+ * @param   enmImpl     The implementation.
+ */
+const char *VideoRecColorConvImplName(VIDEORECCOLORCONVIMPL enmImpl)
+{
+    switch (enmImpl)
+    {
+        case VIDEORECCOLORCONVIMPL_AUTO:    return "auto";
+        case VIDEORECCOLORCONVIMPL_SCALAR:  return "scalar";
+        case VIDEORECCOLORCONVIMPL_SSE2:    return "sse2";
+        case VIDEORECCOLORCONVIMPL_AVX2:    return "avx2";
+        default:                            return "invalid";
+    }
+}
+
+
+/**
+ * Loads one source pixel and expands it to 8-bit components.
+ */
+DECLINLINE(void) videoRecColorConvLoadPixel(VIDEORECPIXFMT enmFmt, const uint8_t *pb,
+                                            unsigned *puRed, unsigned *puGreen, unsigned *puBlue)
+{
+    if (enmFmt == VIDEORECPIXFMT_BGR565)
+    {
+        unsigned const uFull = ((unsigned)pb[1] << 8) | pb[0];
+        *puRed   = (uFull >> 8) & 0xf8;
+        *puGreen = (uFull >> 3) & 0xfc;
+        *puBlue  = (uFull << 3) & 0xf8;
+    }
+    else
+    {
+        /* BGRA32 and BGR24 only differ in the pixel size. */
+        *puRed   = pb[2];
+        *puGreen = pb[1];
+        *puBlue  = pb[0];
+    }
+}
+
+
+/** Luma of one pixel. */
+#define VIDEORECCC_Y(r, g, b)   ((( 66 * (int)(r) + 129 * (int)(g) +  25 * (int)(b) + 128) >> 8) + 16)
+/** Quarter of the U contribution of one pixel (the shift is arithmetic). */
+#define VIDEORECCC_U4(r, g, b)  ((((-38 * (int)(r) -  74 * (int)(g) + 112 * (int)(b) + 128) >> 8) + 128) >> 2)
+/** Quarter of the V contribution of one pixel (the shift is arithmetic). */
+#define VIDEORECCC_V4(r, g, b)  ((((112 * (int)(r) -  94 * (int)(g) -  18 * (int)(b) + 128) >> 8) + 128) >> 2)
+
+
+/**
+ * Generic row pair converter, starting at pixel @a xStart.
+ *
+ * @param   enmFmt      The source pixel format.
+ * @param   xStart      The first pixel to convert, even.
+ * @param   pbSrc       See FNVIDEORECCOLORCONVROWS.
+ * @param   cbSrcLine   See FNVIDEORECCOLORCONVROWS.
+ * @param   pbY         See FNVIDEORECCOLORCONVROWS.
+ * @param   pbU         See FNVIDEORECCOLORCONVROWS.
+ * @param   pbV         See FNVIDEORECCOLORCONVROWS.
+ * @param   cx          See FNVIDEORECCOLORCONVROWS.
+ */
+static void videoRecColorConvRowsGeneric(VIDEORECPIXFMT enmFmt, uint32_t xStart, const uint8_t *pbSrc, size_t cbSrcLine,
+                                         uint8_t *pbY, uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    uint32_t const cbPixel = VideoRecColorConvBytesPerPixel(enmFmt);
+    for (uint32_t x = xStart; x < cx; x += 2)
+    {
+        const uint8_t *apbPixel[4];
+        apbPixel[0] = pbSrc + x * cbPixel;
+        apbPixel[1] = apbPixel[0] + cbPixel;
+        apbPixel[2] = apbPixel[0] + cbSrcLine;
+        apbPixel[3] = apbPixel[2] + cbPixel;
+        uint8_t *apbY[4];
+        apbY[0] = pbY + x;
+        apbY[1] = apbY[0] + 1;
+        apbY[2] = apbY[0] + cx;
+        apbY[3] = apbY[2] + 1;
+
+        unsigned u = 0;
+        unsigned v = 0;
+        for (unsigned i = 0; i < 4; i++)
+        {
+            unsigned uRed, uGreen, uBlue;
+            videoRecColorConvLoadPixel(enmFmt, apbPixel[i], &uRed, &uGreen, &uBlue);
+            *apbY[i] = (uint8_t)VIDEORECCC_Y(uRed, uGreen, uBlue);
+            u += VIDEORECCC_U4(uRed, uGreen, uBlue);
+            v += VIDEORECCC_V4(uRed, uGreen, uBlue);
+        }
+        pbU[x / 2] = (uint8_t)u;
+        pbV[x / 2] = (uint8_t)v;
+    }
+}
+
+
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+
+/**
+ * Converts 8 pixels worth of 16-bit components to luma, returning 8 words.
+ */
+DECLINLINE(__m128i) videoRecColorConvSse2Y(__m128i uRed, __m128i uGreen, __m128i uBlue)
+{
+    /* The sum is at most 56228, so it is fine as unsigned 16-bit value. */
+    __m128i uSum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(uRed,   _mm_set1_epi16(66)),
+                                               _mm_mullo_epi16(uGreen, _mm_set1_epi16(129))),
+                                 _mm_add_epi16(_mm_mullo_epi16(uBlue,  _mm_set1_epi16(25)),
+                                               _mm_set1_epi16(128)));
+    return _mm_add_epi16(_mm_srli_epi16(uSum, 8), _mm_set1_epi16(16));
+}
+
+
+/**
+ * Converts 8 pixels worth of 16-bit components to a quarter of their chroma
+ * contribution, returning 8 words.
+ */
+DECLINLINE(__m128i) videoRecColorConvSse2C4(__m128i uRed, __m128i uGreen, __m128i uBlue,
+                                            __m128i uRedMul, __m128i uGreenMul, __m128i uBlueMul)
+{
+    /* The sum is within +/-28688, so it is fine as signed 16-bit value. */
+    __m128i uSum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(uRed,   uRedMul),
+                                               _mm_mullo_epi16(uGreen, uGreenMul)),
+                                 _mm_add_epi16(_mm_mullo_epi16(uBlue,  uBlueMul),
+                                               _mm_set1_epi16(128)));
+    return _mm_srli_epi16(_mm_add_epi16(_mm_srai_epi16(uSum, 8), _mm_set1_epi16(128)), 2);
+}
+
+
+/**
+ * Loads 8 pixels, splitting them into 16-bit components.
+ */
+DECLINLINE(void) videoRecColorConvSse2Load(VIDEORECPIXFMT enmFmt, const uint8_t *pb,
+                                           __m128i *puRed, __m128i *puGreen, __m128i *puBlue)
+{
+    switch (enmFmt)
+    {
+        case VIDEORECPIXFMT_BGRA32:
+        {
+            __m128i const uMask = _mm_set1_epi32(0xff);
+            __m128i const uLo   = _mm_loadu_si128((const __m128i *)pb);
+            __m128i const uHi   = _mm_loadu_si128((const __m128i *)(pb + 16));
+            *puBlue  = _mm_packs_epi32(_mm_and_si128(uLo, uMask), _mm_and_si128(uHi, uMask));
+            *puGreen = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(uLo, 8), uMask),
+                                       _mm_and_si128(_mm_srli_epi32(uHi, 8), uMask));
+            *puRed   = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(uLo, 16), uMask),
+                                       _mm_and_si128(_mm_srli_epi32(uHi, 16), uMask));
+            break;
+        }
+
+        case VIDEORECPIXFMT_BGR24:
+            /* There is no byte shuffle before SSSE3, so gather.  The arithmetic still pays off. */
+            *puBlue  = _mm_setr_epi16(pb[0], pb[3], pb[6], pb[ 9], pb[12], pb[15], pb[18], pb[21]);
+            *puGreen = _mm_setr_epi16(pb[1], pb[4], pb[7], pb[10], pb[13], pb[16], pb[19], pb[22]);
+            *puRed   = _mm_setr_epi16(pb[2], pb[5], pb[8], pb[11], pb[14], pb[17], pb[20], pb[23]);
+            break;
+
+        default:
+        {
+            Assert(enmFmt == VIDEORECPIXFMT_BGR565);
+            __m128i const uPix = _mm_loadu_si128((const __m128i *)pb);
+            *puRed   = _mm_and_si128(_mm_srli_epi16(uPix, 8), _mm_set1_epi16(0xf8));
+            *puGreen = _mm_and_si128(_mm_srli_epi16(uPix, 3), _mm_set1_epi16(0xfc));
+            *puBlue  = _mm_and_si128(_mm_slli_epi16(uPix, 3), _mm_set1_epi16(0xf8));
+            break;
+        }
+    }
+}
+
+
+/**
+ * SSE2 row pair converter, 8 pixels per row and iteration.
+ */
+DECLINLINE(uint32_t) videoRecColorConvRowsSse2(VIDEORECPIXFMT enmFmt, const uint8_t *pbSrc, size_t cbSrcLine,
+                                               uint8_t *pbY, uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    uint32_t const cbPixel = VideoRecColorConvBytesPerPixel(enmFmt);
+    __m128i const  uOnes   = _mm_set1_epi16(1);
+    uint32_t       x       = 0;
+    for (; x + 8 <= cx; x += 8)
+    {
+        __m128i uRed0, uGreen0, uBlue0, uRed1, uGreen1, uBlue1;
+        videoRecColorConvSse2Load(enmFmt, pbSrc + x * cbPixel,             &uRed0, &uGreen0, &uBlue0);
+        videoRecColorConvSse2Load(enmFmt, pbSrc + x * cbPixel + cbSrcLine, &uRed1, &uGreen1, &uBlue1);
+
+        __m128i const uY0 = videoRecColorConvSse2Y(uRed0, uGreen0, uBlue0);
+        __m128i const uY1 = videoRecColorConvSse2Y(uRed1, uGreen1, uBlue1);
+        _mm_storel_epi64((__m128i *)(pbY + x),      _mm_packus_epi16(uY0, uY0));
+        _mm_storel_epi64((__m128i *)(pbY + x + cx), _mm_packus_epi16(uY1, uY1));
+
+        /* Sum up horizontal pairs in each row, then the two rows, giving four dwords each. */
+        __m128i const uRedMulU = _mm_set1_epi16(-38), uGreenMulU = _mm_set1_epi16(-74), uBlueMulU = _mm_set1_epi16(112);
+        __m128i const uRedMulV = _mm_set1_epi16(112), uGreenMulV = _mm_set1_epi16(-94), uBlueMulV = _mm_set1_epi16(-18);
+        __m128i const uU = _mm_add_epi32(_mm_madd_epi16(videoRecColorConvSse2C4(uRed0, uGreen0, uBlue0,
+                                                                                uRedMulU, uGreenMulU, uBlueMulU), uOnes),
+                                         _mm_madd_epi16(videoRecColorConvSse2C4(uRed1, uGreen1, uBlue1,
+                                                                                uRedMulU, uGreenMulU, uBlueMulU), uOnes));
+        __m128i const uV = _mm_add_epi32(_mm_madd_epi16(videoRecColorConvSse2C4(uRed0, uGreen0, uBlue0,
+                                                                                uRedMulV, uGreenMulV, uBlueMulV), uOnes),
+                                         _mm_madd_epi16(videoRecColorConvSse2C4(uRed1, uGreen1, uBlue1,
+                                                                                uRedMulV, uGreenMulV, uBlueMulV), uOnes));
+
+        /* Bytes 0..3 are U, 4..7 are V. */
+        __m128i uUV = _mm_packs_epi32(uU, uV);
+        uUV = _mm_packus_epi16(uUV, uUV);
+        uint32_t const u32U = (uint32_t)_mm_cvtsi128_si32(uUV);
+        uint32_t const u32V = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(uUV, 4));
+        memcpy(pbU + x / 2, &u32U, sizeof(u32U));
+        memcpy(pbV + x / 2, &u32V, sizeof(u32V));
+    }
+    return x;
+}
+
+static DECLCALLBACK(uint32_t) videoRecColorConvRowsBGRA32Sse2(const uint8_t *pbSrc, size_t cbSrcLine, uint8_t *pbY,
+                                                              uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    return videoRecColorConvRowsSse2(VIDEORECPIXFMT_BGRA32, pbSrc, cbSrcLine, pbY, pbU, pbV, cx);
+}
+
+static DECLCALLBACK(uint32_t) videoRecColorConvRowsBGR24Sse2(const uint8_t *pbSrc, size_t cbSrcLine, uint8_t *pbY,
+                                                             uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    return videoRecColorConvRowsSse2(VIDEORECPIXFMT_BGR24, pbSrc, cbSrcLine, pbY, pbU, pbV, cx);
+}
+
+static DECLCALLBACK(uint32_t) videoRecColorConvRowsBGR565Sse2(const uint8_t *pbSrc, size_t cbSrcLine, uint8_t *pbY,
+                                                              uint8_t *pbU, uint8_t *pbV, uint32_t cx)
+{
+    return videoRecColorConvRowsSse2(VIDEORECPIXFMT_BGR565, pbSrc, cbSrcLine, pbY, pbU, pbV, cx);
+}
+
+#endif /* RT_ARCH_AMD64 || RT_ARCH_X86 */
+
+
+/**
+ * Converts a packed RGB image to I420 using a specific implementation.
+ *
+ * @returns IPRT status code.
+ * @retval  VERR_NOT_SUPPORTED if @a enmImpl is not available on this host.
+ * @param   enmImpl     The implementation to use.
+ * @param   enmFmt      The source pixel format.
+ * @param   cx          Image width, even.
+ * @param   cy          Image height, even.
+ * @param   pbSrc       The source image, rows packed without padding.
+ * @param   pbDst       The destination buffer, cx * cy * 3 / 2 bytes for the
+ *                      Y plane followed by the U and V planes.
+ */
+int VideoRecColorConvToI420Ex(VIDEORECCOLORCONVIMPL enmImpl, VIDEORECPIXFMT enmFmt, uint32_t cx, uint32_t cy,
+                              const uint8_t *pbSrc, uint8_t *pbDst)
+{
+    AssertPtrReturn(pbSrc, VERR_INVALID_POINTER);
+    AssertPtrReturn(pbDst, VERR_INVALID_POINTER);
+    AssertReturn(!(cx & 1) && !(cy & 1), VERR_INVALID_PARAMETER);
+    uint32_t const cbPixel = VideoRecColorConvBytesPerPixel(enmFmt);
+    AssertReturn(cbPixel, VERR_INVALID_PARAMETER);
+
+    if (enmImpl == VIDEORECCOLORCONVIMPL_AUTO)
+    {
+        uint32_t const fFeatures = videoRecColorConvGetFeatures();
+        if (fFeatures & VIDEORECCC_F_AVX2)
+            enmImpl = VIDEORECCOLORCONVIMPL_AVX2;
+        else if (fFeatures & VIDEORECCC_F_SSE2)
+            enmImpl = VIDEORECCOLORCONVIMPL_SSE2;
+        else
+            enmImpl = VIDEORECCOLORCONVIMPL_SCALAR;
+    }
+    else if (!VideoRecColorConvIsSupported(enmImpl))
+        return VERR_NOT_SUPPORTED;
+
+    PFNVIDEORECCOLORCONVROWS pfnRows = NULL;
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+    if (enmImpl == VIDEORECCOLORCONVIMPL_AVX2)
+        pfnRows = enmFmt == VIDEORECPIXFMT_BGRA32 ? videoRecColorConvRowsBGRA32Avx2
+                : enmFmt == VIDEORECPIXFMT_BGR24  ? videoRecColorConvRowsBGR24Avx2
+                :                                   videoRecColorConvRowsBGR565Avx2;
+    else if (enmImpl == VIDEORECCOLORCONVIMPL_SSE2)
+        pfnRows = enmFmt == VIDEORECPIXFMT_BGRA32 ? videoRecColorConvRowsBGRA32Sse2
+                : enmFmt == VIDEORECPIXFMT_BGR24  ? videoRecColorConvRowsBGR24Sse2
+                :                                   videoRecColorConvRowsBGR565Sse2;
+#endif
+
+    size_t const cbSrcLine = (size_t)cx * cbPixel;
+    uint8_t *pbY = pbDst;
+    uint8_t *pbU = pbDst + (size_t)cx * cy;
+    uint8_t *pbV = pbU + (size_t)cx * cy / 4;
+    for (uint32_t y = 0; y < cy; y += 2)
+    {
+        uint32_t const xDone = pfnRows ? pfnRows(pbSrc, cbSrcLine, pbY, pbU, pbV, cx) : 0;
+        if (xDone < cx)
+            videoRecColorConvRowsGeneric(enmFmt, xDone, pbSrc, cbSrcLine, pbY, pbU, pbV, cx);
+        pbSrc += 2 * cbSrcLine;
+        pbY   += 2 * cx;
+        pbU   += cx / 2;
+        pbV   += cx / 2;
+    }
+
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Converts a packed RGB image to I420 using the fastest implementation
+ * available.
+ *
+ * @returns IPRT status code.
+ * @param   enmFmt      The source pixel format.
+ * @param   cx          Image width, even.
+ * @param   cy          Image height, even.
+ * @param   pbSrc       The source image, rows packed without padding.
+ * @param   pbDst       The destination buffer, see VideoRecColorConvToI420Ex.
+ */
+int VideoRecColorConvToI420(VIDEORECPIXFMT enmFmt, uint32_t cx, uint32_t cy, const uint8_t *pbSrc, uint8_t *pbDst)
+{
+    return VideoRecColorConvToI420Ex(VIDEORECCOLORCONVIMPL_AUTO, enmFmt, cx, cy, pbSrc, pbDst);
+}
@@ -0,0 +1,89 @@
+/* $Id$ */
+/** @file
+ * Video recording: RGB to I420 color space conversion.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ____H_VIDEORECCOLORCONV
+#define ____H_VIDEORECCOLORCONV
+
+#include <iprt/types.h>
+
+/**
+ * Source pixel formats the I420 conversion understands.
+ */
+typedef enum VIDEORECPIXFMT
+{
+    VIDEORECPIXFMT_INVALID = 0,
+    /** 32 bits per pixel, bytes in B, G, R, X order. */
+    VIDEORECPIXFMT_BGRA32,
+    /** 24 bits per pixel, bytes in B, G, R order. */
+    VIDEORECPIXFMT_BGR24,
+    /** 16 bits per pixel, 5-6-5 with red in the high bits. */
+    VIDEORECPIXFMT_BGR565,
+    VIDEORECPIXFMT_32BIT_HACK = 0x7fffffff
+} VIDEORECPIXFMT;
+
+/**
+ * Conversion implementations, for testing and benchmarking.
+ */
+typedef enum VIDEORECCOLORCONVIMPL
+{
+    /** Pick the fastest one the host supports. */
+    VIDEORECCOLORCONVIMPL_AUTO = 0,
+    /** Portable C code. */
+    VIDEORECCOLORCONVIMPL_SCALAR,
+    /** SSE2, 8 pixels per row and iteration. */
+    VIDEORECCOLORCONVIMPL_SSE2,
+    /** AVX2, 16 pixels per row and iteration. */
+    VIDEORECCOLORCONVIMPL_AVX2,
+    VIDEORECCOLORCONVIMPL_END
+} VIDEORECCOLORCONVIMPL;
+
+uint32_t VideoRecColorConvBytesPerPixel(VIDEORECPIXFMT enmFmt);
+bool VideoRecColorConvIsSupported(VIDEORECCOLORCONVIMPL enmImpl);
+const char *VideoRecColorConvImplName(VIDEORECCOLORCONVIMPL enmImpl);
+int VideoRecColorConvToI420(VIDEORECPIXFMT enmFmt, uint32_t cx, uint32_t cy, const uint8_t *pbSrc, uint8_t *pbDst);
+int VideoRecColorConvToI420Ex(VIDEORECCOLORCONVIMPL enmImpl, VIDEORECPIXFMT enmFmt, uint32_t cx, uint32_t cy,
+                              const uint8_t *pbSrc, uint8_t *pbDst);
+
+
+/** @name Internal, used by VideoRecColorConv.cpp and VideoRecColorConv-avx2.cpp only.
+ * @{ */
+/**
+ * Converts two source rows into two luma rows and one row of each chroma plane.
+ *
+ * @returns Number of pixels per row converted, always even.  The caller
+ *          handles the remainder.
+ * @param   pbSrc       The first source row, the second one follows at
+ *                      @a cbSrcLine.
+ * @param   cbSrcLine   Bytes per source row.
+ * @param   pbY         The first luma row, the second one follows at @a cx.
+ * @param   pbU         The U row.
+ * @param   pbV         The V row.
+ * @param   cx          Pixels per row, even.
+ */
+typedef DECLCALLBACK(uint32_t) FNVIDEORECCOLORCONVROWS(const uint8_t *pbSrc, size_t cbSrcLine, uint8_t *pbY,
+                                                       uint8_t *pbU, uint8_t *pbV, uint32_t cx);
+/** Pointer to a row pair converter. */
+typedef FNVIDEORECCOLORCONVROWS *PFNVIDEORECCOLORCONVROWS;
+
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+DECLHIDDEN(FNVIDEORECCOLORCONVROWS) videoRecColorConvRowsBGRA32Avx2;
+DECLHIDDEN(FNVIDEORECCOLORCONVROWS) videoRecColorConvRowsBGR24Avx2;
+DECLHIDDEN(FNVIDEORECCOLORCONVROWS) videoRecColorConvRowsBGR565Avx2;
+#endif
+/** @} */
+
+#endif /* !____H_VIDEORECCOLORCONV */
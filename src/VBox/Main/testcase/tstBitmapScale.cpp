@@ -0,0 +1,330 @@
+/* $Id$ */
+/** @file
+ * Screenshot/thumbnail scaling testcase - BitmapScale32 correctness and throughput.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <iprt/err.h>
+#include <iprt/mem.h>
+#include <iprt/rand.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** How long to run each benchmark for, in nanoseconds. */
+#define TST_BENCH_NS        (RT_NS_1SEC / 2)
+
+
+/* Code in DisplayResampleImage.cpp. */
+void BitmapScale32(uint8_t *dst, int dstW, int dstH,
+                   const uint8_t *src, int iDeltaLine, int srcW, int srcH);
+void BitmapScale32Bilinear(uint8_t *dst, int dstW, int dstH,
+                           const uint8_t *src, int iDeltaLine, int srcW, int srcH);
+void BitmapScale32Lanczos(uint8_t *dst, int dstW, int dstH,
+                          const uint8_t *src, int iDeltaLine, int srcW, int srcH);
+
+typedef void FNBITMAPSCALE32(uint8_t *dst, int dstW, int dstH,
+                             const uint8_t *src, int iDeltaLine, int srcW, int srcH);
+
+
+/**
+ * Reference implementation, the per pixel area averaging of the original
+ * DisplayResampleImage.cpp code with the same 1/16 pixel fixed point steps.
+ */
+static void tstRefScale32(uint8_t *dst, int dstW, int dstH, const uint8_t *src, int iDeltaLine, int srcW, int srcH)
+{
+    for (int y = 0; y < dstH; y++)
+    {
+        int32_t sy1 = (y * srcH * 16) / dstH;
+        int32_t sy2 = ((y + 1) * srcH * 16) / dstH;
+        for (int x = 0; x < dstW; x++)
+        {
+            int32_t red = 0, green = 0, blue = 0;
+            int32_t sx1 = (x * srcW * 16) / dstW;
+            int32_t sx2 = ((x + 1) * srcW * 16) / dstW;
+            int32_t spixels = (sx2 - sx1) * (sy2 - sy1);
+            int32_t sy = sy1;
+            do
+            {
+                int32_t yportion;
+                if ((sy & ~0xf) == (sy1 & ~0xf))
+                {
+                    yportion = RT_MIN(16 - (sy & 0xf), sy2 - sy1);
+                    sy &= ~0xf;
+                }
+                else if (sy == (sy2 & ~0xf))
+                    yportion = sy2 & 0xf;
+                else
+                    yportion = 16;
+
+                const uint8_t *pu8SrcLine = src + iDeltaLine * (sy >> 4);
+                int32_t sx = sx1;
+                do
+                {
+                    int32_t xportion;
+                    if ((sx & ~0xf) == (sx1 & ~0xf))
+                    {
+                        xportion = RT_MIN(16 - (sx & 0xf), sx2 - sx1);
+                        sx &= ~0xf;
+                    }
+                    else if (sx == (sx2 & ~0xf))
+                        xportion = sx2 & 0xf;
+                    else
+                        xportion = 16;
+                    const uint8_t *pb = pu8SrcLine + (sx >> 4) * 4;
+                    red   += pb[2] * xportion * yportion;
+                    green += pb[1] * xportion * yportion;
+                    blue  += pb[0] * xportion * yportion;
+                    sx += 16;
+                } while (sx < sx2);
+                sy += 16;
+            } while (sy < sy2);
+
+            if (spixels != 0)
+            {
+                red /= spixels;
+                green /= spixels;
+                blue /= spixels;
+            }
+            *(uint32_t *)(dst + (y * dstW + x) * 4) = (RT_MIN(red, 255) << 16) | (RT_MIN(green, 255) << 8) | RT_MIN(blue, 255);
+        }
+    }
+}
+
+
+/**
+ * Compares BitmapScale32 against the reference code for downscaling,
+ * upscaling and odd sizes exercising the SIMD tails.
+ *
+ * The 32 bit sums overflow once a destination pixel covers more than about
+ * 32K source pixels, in the reference as well as in the original code, so the
+ * sizes stay below that.
+ */
+static void tstCompare(void)
+{
+    RTTestISub("reference comparison");
+
+    static int const s_aSizes[][4] =
+    {
+        { 1, 1, 1, 1 }, { 7, 5, 3, 2 }, { 3, 2, 7, 5 }, { 13, 11, 13, 11 }, { 1, 1, 64, 64 }, { 33, 17, 10, 9 },
+        { 640, 480, 100, 75 }, { 800, 600, 20, 15 }, { 1024, 768, 1023, 767 }, { 1920, 1080, 1024, 576 },
+        { 2000, 4000, 30, 70 }, { 2560, 1600, 256, 160 }
+    };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_aSizes); i++)
+    {
+        int const srcW = s_aSizes[i][0];
+        int const srcH = s_aSizes[i][1];
+        int const dstW = s_aSizes[i][2];
+        int const dstH = s_aSizes[i][3];
+        int const iDeltaLine = srcW * 4 + 12;
+        uint8_t *pbSrc    = (uint8_t *)RTMemAlloc((size_t)iDeltaLine * srcH);
+        uint8_t *pbExpect = (uint8_t *)RTMemAlloc((size_t)dstW * dstH * 4);
+        uint8_t *pbDst    = (uint8_t *)RTMemAlloc((size_t)dstW * dstH * 4);
+        RTTESTI_CHECK_RETV(pbSrc && pbExpect && pbDst);
+        RTRandBytes(pbSrc, (size_t)iDeltaLine * srcH);
+
+        tstRefScale32(pbExpect, dstW, dstH, pbSrc, iDeltaLine, srcW, srcH);
+        memset(pbDst, 0xcc, (size_t)dstW * dstH * 4);
+        BitmapScale32(pbDst, dstW, dstH, pbSrc, iDeltaLine, srcW, srcH);
+        if (memcmp(pbDst, pbExpect, (size_t)dstW * dstH * 4))
+            RTTestIFailed("%dx%d -> %dx%d: output differs from the reference", srcW, srcH, dstW, dstH);
+
+        RTMemFree(pbSrc);
+        RTMemFree(pbExpect);
+        RTMemFree(pbDst);
+    }
+}
+
+
+/**
+ * Checks the interpolating filters: scaling to the same size must not change
+ * the image, flat areas must stay flat, and bilinear upscaling by two must
+ * match a straight forward interpolation.
+ */
+static void tstKernelFilters(void)
+{
+    RTTestISub("interpolating filters");
+
+    static struct { FNBITMAPSCALE32 *pfn; const char *pszName; } const s_aFilters[] =
+    {
+        { BitmapScale32Bilinear, "bilinear" }, { BitmapScale32Lanczos, "Lanczos" }
+    };
+    static int const s_aSizes[][4] =
+    {
+        { 1, 1, 1, 1 }, { 7, 5, 3, 2 }, { 3, 2, 7, 5 }, { 13, 11, 13, 11 }, { 1, 1, 64, 64 }, { 33, 17, 10, 9 },
+        { 640, 480, 100, 75 }, { 800, 600, 2, 1 }, { 1920, 1080, 1024, 576 }, { 2000, 4000, 3, 7 }
+    };
+    for (unsigned iFilter = 0; iFilter < RT_ELEMENTS(s_aFilters); iFilter++)
+    {
+        for (unsigned i = 0; i < RT_ELEMENTS(s_aSizes); i++)
+        {
+            int const srcW = s_aSizes[i][0];
+            int const srcH = s_aSizes[i][1];
+            int const dstW = s_aSizes[i][2];
+            int const dstH = s_aSizes[i][3];
+            int const iDeltaLine = srcW * 4 + 12;
+            uint8_t *pbSrc = (uint8_t *)RTMemAlloc((size_t)iDeltaLine * srcH);
+            uint8_t *pbDst = (uint8_t *)RTMemAlloc((size_t)RT_MAX(dstW * dstH, srcW * srcH) * 4);
+            RTTESTI_CHECK_RETV(pbSrc && pbDst);
+
+            /* Same size. */
+            RTRandBytes(pbSrc, (size_t)iDeltaLine * srcH);
+            s_aFilters[iFilter].pfn(pbDst, srcW, srcH, pbSrc, iDeltaLine, srcW, srcH);
+            for (int y = 0; y < srcH; y++)
+                for (int x = 0; x < srcW; x++)
+                {
+                    uint32_t const u32Src = *(uint32_t *)(pbSrc + y * iDeltaLine + x * 4) & UINT32_C(0xffffff);
+                    uint32_t const u32Dst = *(uint32_t *)(pbDst + (y * srcW + x) * 4);
+                    if (u32Src != u32Dst)
+                    {
+                        RTTestIFailed("%s %dx%d: pixel %d,%d is %#x instead of %#x",
+                                      s_aFilters[iFilter].pszName, srcW, srcH, x, y, u32Dst, u32Src);
+                        y = srcH;
+                        break;
+                    }
+                }
+
+            /* A single colour, the alpha channel is random and must be ignored. */
+            uint32_t const u32Colour = RTRandU32() & UINT32_C(0xffffff);
+            for (int y = 0; y < srcH; y++)
+                for (int x = 0; x < srcW; x++)
+                    *(uint32_t *)(pbSrc + y * iDeltaLine + x * 4) = u32Colour | (RTRandU32() & UINT32_C(0xff000000));
+            s_aFilters[iFilter].pfn(pbDst, dstW, dstH, pbSrc, iDeltaLine, srcW, srcH);
+            for (int iPixel = 0; iPixel < dstW * dstH; iPixel++)
+                if (((uint32_t *)pbDst)[iPixel] != u32Colour)
+                {
+                    RTTestIFailed("%s %dx%d -> %dx%d: flat colour %#x became %#x", s_aFilters[iFilter].pszName,
+                                  srcW, srcH, dstW, dstH, u32Colour, ((uint32_t *)pbDst)[iPixel]);
+                    break;
+                }
+
+            RTMemFree(pbSrc);
+            RTMemFree(pbDst);
+        }
+    }
+
+    /* Bilinear upscaling by two samples a quarter pixel off the source pixels. */
+    int const srcW = 37, srcH = 23, dstW = srcW * 2, dstH = srcH * 2;
+    uint8_t *pbSrc = (uint8_t *)RTMemAlloc((size_t)srcW * srcH * 4);
+    uint8_t *pbDst = (uint8_t *)RTMemAlloc((size_t)dstW * dstH * 4);
+    RTTESTI_CHECK_RETV(pbSrc && pbDst);
+    RTRandBytes(pbSrc, (size_t)srcW * srcH * 4);
+    BitmapScale32Bilinear(pbDst, dstW, dstH, pbSrc, srcW * 4, srcW, srcH);
+    for (int y = 0; y < dstH; y++)
+        for (int x = 0; x < dstW; x++)
+        {
+            int    const x0  = RT_MAX(x / 2 - 1 + (x & 1), 0);
+            int    const x1  = RT_MIN(x0 + 1, srcW - 1);
+            int    const y0  = RT_MAX(y / 2 - 1 + (y & 1), 0);
+            int    const y1  = RT_MIN(y0 + 1, srcH - 1);
+            double const fx  = x == 0 ? 0.0 : x == dstW - 1 ? 1.0 : (x & 1) ? 0.25 : 0.75;
+            double const fy  = y == 0 ? 0.0 : y == dstH - 1 ? 1.0 : (y & 1) ? 0.25 : 0.75;
+            for (unsigned iComp = 0; iComp < 3; iComp++)
+            {
+                double const dExpect = (1 - fy) * ((1 - fx) * pbSrc[(y0 * srcW + x0) * 4 + iComp]
+                                                 +      fx  * pbSrc[(y0 * srcW + x1) * 4 + iComp])
+                                     +      fy  * ((1 - fx) * pbSrc[(y1 * srcW + x0) * 4 + iComp]
+                                                 +      fx  * pbSrc[(y1 * srcW + x1) * 4 + iComp]);
+                int const iDiff = pbDst[(y * dstW + x) * 4 + iComp] - (int)(dExpect + 0.5);
+                if (iDiff < -1 || iDiff > 1)
+                {
+                    RTTestIFailed("bilinear %dx%d -> %dx%d: component %u of pixel %d,%d is %u instead of %.1f",
+                                  srcW, srcH, dstW, dstH, iComp, x, y, pbDst[(y * dstW + x) * 4 + iComp], dExpect);
+                    x = dstW;
+                    y = dstH;
+                    break;
+                }
+            }
+        }
+    RTMemFree(pbSrc);
+    RTMemFree(pbDst);
+}
+
+
+/**
+ * Reports the scaled frames per second for typical thumbnail sizes.
+ */
+static void tstBenchmark(void)
+{
+    RTTestISub("benchmarks");
+
+    static int const s_aSizes[][4] =
+    {
+        { 1920, 1080, 1024, 576 }, { 2560, 1600, 256, 160 }, { 1024, 768, 64, 48 }
+    };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_aSizes); i++)
+    {
+        int const srcW = s_aSizes[i][0];
+        int const srcH = s_aSizes[i][1];
+        int const dstW = s_aSizes[i][2];
+        int const dstH = s_aSizes[i][3];
+        uint8_t *pbSrc = (uint8_t *)RTMemAlloc((size_t)srcW * srcH * 4);
+        uint8_t *pbDst = (uint8_t *)RTMemAlloc((size_t)dstW * dstH * 4);
+        RTTESTI_CHECK_RETV(pbSrc && pbDst);
+        RTRandBytes(pbSrc, (size_t)srcW * srcH * 4);
+
+        for (unsigned iImpl = 0; iImpl < 4; iImpl++)
+        {
+            uint64_t cFrames = 0;
+            uint64_t nsStart = RTTimeNanoTS();
+            uint64_t cNsElapsed;
+            do
+            {
+                if (iImpl == 0)
+                    tstRefScale32(pbDst, dstW, dstH, pbSrc, srcW * 4, srcW, srcH);
+                else if (iImpl == 1)
+                    BitmapScale32(pbDst, dstW, dstH, pbSrc, srcW * 4, srcW, srcH);
+                else if (iImpl == 2)
+                    BitmapScale32Bilinear(pbDst, dstW, dstH, pbSrc, srcW * 4, srcW, srcH);
+                else
+                    BitmapScale32Lanczos(pbDst, dstW, dstH, pbSrc, srcW * 4, srcW, srcH);
+                cFrames++;
+                cNsElapsed = RTTimeNanoTS() - nsStart;
+            } while (cNsElapsed < TST_BENCH_NS);
+
+            uint64_t const cFramesPerSec = cFrames * RT_NS_1SEC / RT_MAX(cNsElapsed, 1);
+            RTTestIValueF(cFramesPerSec, RTTESTUNIT_FRAMES_PER_SEC, "%s %dx%d -> %dx%d",
+                          iImpl == 0 ? "reference" : iImpl == 1 ? "BitmapScale32"
+                          : iImpl == 2 ? "BitmapScale32Bilinear" : "BitmapScale32Lanczos", srcW, srcH, dstW, dstH);
+        }
+
+        RTMemFree(pbSrc);
+        RTMemFree(pbDst);
+    }
+}
+
+
+int main()
+{
+    RTTEST hTest;
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstBitmapScale", &hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(hTest);
+
+    tstCompare();
+    tstKernelFilters();
+    if (!RTTestErrorCount(hTest))
+        tstBenchmark();
+
+    return RTTestSummaryAndDestroy(hTest);
+}
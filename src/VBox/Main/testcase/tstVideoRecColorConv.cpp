@@ -0,0 +1,222 @@
+/* $Id$ */
+/** @file
+ * Video recording testcase - RGB to I420 conversion, correctness and throughput.
+ *
+ * Usage: tstVideoRecColorConv [width height]
+ * The benchmark runs at 1920x1080 unless told otherwise.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include "../src-client/VideoRecColorConv.h"
+
+#include <iprt/err.h>
+#include <iprt/mem.h>
+#include <iprt/rand.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** How long to run each benchmark for, in nanoseconds. */
+#define TST_BENCH_NS        (RT_NS_1SEC / 2)
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+static struct
+{
+    VIDEORECPIXFMT  enmFmt;
+    const char     *pszName;
+} const g_aFormats[] =
+{
+    { VIDEORECPIXFMT_BGRA32, "BGRA32" },
+    { VIDEORECPIXFMT_BGR24,  "BGR24"  },
+    { VIDEORECPIXFMT_BGR565, "BGR565" },
+};
+
+
+/**
+ * Reference implementation, the per pixel arithmetic of the original
+ * VideoRec.cpp iterator code.
+ */
+static void tstRefToI420(VIDEORECPIXFMT enmFmt, uint32_t cx, uint32_t cy, const uint8_t *pbSrc, uint8_t *pbDst)
+{
+    uint32_t const cbPixel = VideoRecColorConvBytesPerPixel(enmFmt);
+    uint8_t *pbU = pbDst + cx * cy;
+    uint8_t *pbV = pbU + cx * cy / 4;
+    for (uint32_t y = 0; y < cy; y += 2)
+        for (uint32_t x = 0; x < cx; x += 2)
+        {
+            unsigned u = 0;
+            unsigned v = 0;
+            for (unsigned i = 0; i < 4; i++)
+            {
+                uint32_t const off = (y + i / 2) * cx + x + i % 2;
+                const uint8_t *pb  = pbSrc + off * cbPixel;
+                unsigned red, green, blue;
+                if (enmFmt == VIDEORECPIXFMT_BGR565)
+                {
+                    unsigned uFull = ((unsigned)pb[1] << 8) | pb[0];
+                    red   = (uFull >> 8) & ~7;
+                    green = (uFull >> 3) & ~3 & 0xff;
+                    blue  = (uFull << 3) & ~7 & 0xff;
+                }
+                else
+                {
+                    red   = pb[2];
+                    green = pb[1];
+                    blue  = pb[0];
+                }
+                pbDst[off] = (uint8_t)(((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16);
+                u += (((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128) / 4;
+                v += (((112 * red - 94 * green -  18 * blue + 128) >> 8) + 128) / 4;
+            }
+            pbU[y / 2 * cx / 2 + x / 2] = (uint8_t)u;
+            pbV[y / 2 * cx / 2 + x / 2] = (uint8_t)v;
+        }
+}
+
+
+/**
+ * Compares all implementations against the reference code, using sizes which
+ * exercise the SIMD loops as well as the generic tail handling.
+ */
+static void tstCompare(uint32_t cxBench, uint32_t cyBench)
+{
+    RTTestISub("reference comparison");
+
+    static uint32_t const s_aSizes[][2] =
+    {
+        { 2, 2 }, { 8, 2 }, { 16, 4 }, { 18, 2 }, { 34, 6 }, { 62, 10 }, { 640, 480 }, { 1026, 770 }
+    };
+    for (unsigned iSize = 0; iSize <= RT_ELEMENTS(s_aSizes); iSize++)
+    {
+        uint32_t const cx = iSize < RT_ELEMENTS(s_aSizes) ? s_aSizes[iSize][0] : cxBench;
+        uint32_t const cy = iSize < RT_ELEMENTS(s_aSizes) ? s_aSizes[iSize][1] : cyBench;
+        size_t const   cbSrc = (size_t)cx * cy * 4;
+        size_t const   cbDst = (size_t)cx * cy * 3 / 2;
+        uint8_t *pbSrc    = (uint8_t *)RTMemAlloc(cbSrc);
+        uint8_t *pbExpect = (uint8_t *)RTMemAlloc(cbDst);
+        uint8_t *pbDst    = (uint8_t *)RTMemAlloc(cbDst);
+        RTTESTI_CHECK_RETV(pbSrc && pbExpect && pbDst);
+        RTRandBytes(pbSrc, cbSrc);
+
+        for (unsigned iFmt = 0; iFmt < RT_ELEMENTS(g_aFormats); iFmt++)
+        {
+            tstRefToI420(g_aFormats[iFmt].enmFmt, cx, cy, pbSrc, pbExpect);
+            for (int iImpl = VIDEORECCOLORCONVIMPL_AUTO; iImpl < VIDEORECCOLORCONVIMPL_END; iImpl++)
+            {
+                VIDEORECCOLORCONVIMPL enmImpl = (VIDEORECCOLORCONVIMPL)iImpl;
+                if (!VideoRecColorConvIsSupported(enmImpl))
+                    continue;
+                memset(pbDst, 0xcc, cbDst);
+                int rc = VideoRecColorConvToI420Ex(enmImpl, g_aFormats[iFmt].enmFmt, cx, cy, pbSrc, pbDst);
+                if (RT_FAILURE(rc))
+                    RTTestIFailed("%s/%s %ux%u: %Rrc", g_aFormats[iFmt].pszName, VideoRecColorConvImplName(enmImpl),
+                                  cx, cy, rc);
+                else if (memcmp(pbDst, pbExpect, cbDst))
+                    RTTestIFailed("%s/%s %ux%u: output differs from the reference", g_aFormats[iFmt].pszName,
+                                  VideoRecColorConvImplName(enmImpl), cx, cy);
+            }
+        }
+
+        RTMemFree(pbSrc);
+        RTMemFree(pbExpect);
+        RTMemFree(pbDst);
+    }
+}
+
+
+/**
+ * Reports the frames per second for each format and implementation.
+ */
+static void tstBenchmark(uint32_t cx, uint32_t cy)
+{
+    RTTestISubF("benchmarks %ux%u", cx, cy);
+
+    uint8_t *pbSrc = (uint8_t *)RTMemAlloc((size_t)cx * cy * 4);
+    uint8_t *pbDst = (uint8_t *)RTMemAlloc((size_t)cx * cy * 3 / 2);
+    RTTESTI_CHECK_RETV(pbSrc && pbDst);
+    RTRandBytes(pbSrc, (size_t)cx * cy * 4);
+
+    for (unsigned iFmt = 0; iFmt < RT_ELEMENTS(g_aFormats); iFmt++)
+        for (int iImpl = VIDEORECCOLORCONVIMPL_SCALAR; iImpl < VIDEORECCOLORCONVIMPL_END; iImpl++)
+        {
+            VIDEORECCOLORCONVIMPL enmImpl = (VIDEORECCOLORCONVIMPL)iImpl;
+            if (!VideoRecColorConvIsSupported(enmImpl))
+            {
+                RTTestIPrintf(RTTESTLVL_ALWAYS, "%-6s %-6s: not supported by the host\n",
+                              g_aFormats[iFmt].pszName, VideoRecColorConvImplName(enmImpl));
+                continue;
+            }
+
+            uint64_t cFrames = 0;
+            uint64_t nsStart = RTTimeNanoTS();
+            uint64_t cNsElapsed;
+            do
+            {
+                VideoRecColorConvToI420Ex(enmImpl, g_aFormats[iFmt].enmFmt, cx, cy, pbSrc, pbDst);
+                cFrames++;
+                cNsElapsed = RTTimeNanoTS() - nsStart;
+            } while (cNsElapsed < TST_BENCH_NS);
+
+            uint64_t const cFramesPerSec100 = cFrames * RT_NS_1SEC * 100 / RT_MAX(cNsElapsed, 1);
+            RTTestIValueF(cFramesPerSec100 / 100, RTTESTUNIT_FRAMES_PER_SEC, "%s %s %ux%u",
+                          g_aFormats[iFmt].pszName, VideoRecColorConvImplName(enmImpl), cx, cy);
+            RTTestIPrintf(RTTESTLVL_ALWAYS, "%-6s %-6s: %u.%02u frames/s\n", g_aFormats[iFmt].pszName,
+                          VideoRecColorConvImplName(enmImpl), (unsigned)(cFramesPerSec100 / 100),
+                          (unsigned)(cFramesPerSec100 % 100));
+        }
+
+    RTMemFree(pbSrc);
+    RTMemFree(pbDst);
+}
+
+
+int main(int argc, char **argv)
+{
+    RTTEST hTest;
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstVideoRecColorConv", &hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(hTest);
+
+    uint32_t cx = 1920;
+    uint32_t cy = 1080;
+    if (argc == 3)
+    {
+        cx = RTStrToUInt32(argv[1]);
+        cy = RTStrToUInt32(argv[2]);
+    }
+    if (   argc != 1
+        && (argc != 3 || !cx || !cy || (cx & 1) || (cy & 1)))
+    {
+        RTTestFailed(hTest, "Usage: %s [width height], both even and not zero", argv[0]);
+        return RTTestSummaryAndDestroy(hTest);
+    }
+
+    tstCompare(cx, cy);
+    if (!RTTestErrorCount(hTest))
+        tstBenchmark(cx, cy);
+
+    return RTTestSummaryAndDestroy(hTest);
+}
@@ -553,6 +553,7 @@ RTDECL(PRTLOGGER) RTLogDefaultInit(void)
     ASSERT_LOG_GROUP(VD_VHD);
     ASSERT_LOG_GROUP(VD_VHDX);
     ASSERT_LOG_GROUP(VD_VMDK);
+    ASSERT_LOG_GROUP(VD_VWC);
     ASSERT_LOG_GROUP(VM);
     ASSERT_LOG_GROUP(VMM);
     ASSERT_LOG_GROUP(VRDE);
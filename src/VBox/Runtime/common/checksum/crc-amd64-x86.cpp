@@ -0,0 +1,315 @@
+/* $Id$ */
+/** @file
+ * IPRT - CRC32, CRC32C and CRC64 acceleration using SSE4.2 and PCLMULQDQ.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+/*
+ * All the CRCs IPRT implements are reflected ones, which means the folding
+ * method from Intel's "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ Instruction" paper works for all of them with just a different
+ * set of constants.  Instead of doing the final Barrett reduction we leave
+ * the last 16 bytes to the table (or CRC32 instruction) code of the caller,
+ * which keeps the constant tables small and the code shared.
+ *
+ * This file must be compiled with SSE4.2 and PCLMUL code generation enabled
+ * (gcc: -msse4.2 -mpclmul), so nothing in here may be called without checking
+ * rtCrcAmd64X86GetFeatures() first.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include "internal/iprt.h"
+#include <iprt/crc.h>
+
+#include <iprt/asm.h>
+#include <iprt/asm-amd64-x86.h>
+#include <iprt/assert.h>
+#include <iprt/x86.h>
+#include "internal/crc.h"
+
+#include <emmintrin.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** RTCRC_AMD64_X86_F_XXX, lazily initialized. */
+static uint32_t volatile g_fRtCrcAmd64X86Features = 0;
+
+/*
+ * The folding constants are x^(D+64-S) mod P and x^(D-S) mod P, bit reflected,
+ * where D is the folding distance in bits and S is 33 for the 32-bit CRCs and
+ * 1 for CRC64 (which lines the carry-less product up with the lane).
+ */
+
+/** Folding constants for CRC32 (polynomial 0x04c11db7). */
+DECLHIDDEN(RTCRCFOLDCONSTS const) g_rtCrc32FoldConsts =
+{
+    { UINT64_C(0x000000008f352d95), UINT64_C(0x000000001d9513d7) },
+    { UINT64_C(0x00000000ae689191), UINT64_C(0x00000000ccaa009e) }
+};
+
+/** Folding constants for CRC32C (polynomial 0x1edc6f41). */
+static RTCRCFOLDCONSTS const g_Crc32CFoldConsts =
+{
+    { UINT64_C(0x00000000740eef02), UINT64_C(0x000000009e4addf8) },
+    { UINT64_C(0x00000000f20c0dfe), UINT64_C(0x00000000493c7d27) }
+};
+
+/** Folding constants for CRC64 (ISO polynomial 0x000000000000001b). */
+DECLHIDDEN(RTCRCFOLDCONSTS const) g_rtCrc64FoldConsts =
+{
+    { UINT64_C(0x01b001b1b0000001), UINT64_C(0xb100010100000001) },
+    { UINT64_C(0x6b70000000000001), UINT64_C(0xf500000000000001) }
+};
+
+
+/**
+ * Queries the CPU features the accelerated CRC code can make use of.
+ *
+ * @returns RTCRC_AMD64_X86_F_XXX.
+ */
+DECLHIDDEN(uint32_t) rtCrcAmd64X86GetFeatures(void)
+{
+    uint32_t fFeatures = g_fRtCrcAmd64X86Features;
+    if (RT_LIKELY(fFeatures & RTCRC_AMD64_X86_F_INITIALIZED))
+        return fFeatures;
+
+    /* Racing here is harmless, everyone arrives at the same result. */
+    fFeatures = RTCRC_AMD64_X86_F_INITIALIZED;
+    if (ASMHasCpuId())
+    {
+        uint32_t uEAX, uEBX, uECX, uEDX;
+        ASMCpuId(1, &uEAX, &uEBX, &uECX, &uEDX);
+        if (uEDX & X86_CPUID_FEATURE_EDX_SSE2)
+        {
+            if (uECX & X86_CPUID_FEATURE_ECX_SSE4_2)
+                fFeatures |= RTCRC_AMD64_X86_F_SSE42;
+            if (uECX & X86_CPUID_FEATURE_ECX_PCLMUL)
+                fFeatures |= RTCRC_AMD64_X86_F_PCLMUL;
+        }
+    }
+    ASMAtomicWriteU32(&g_fRtCrcAmd64X86Features, fFeatures);
+    return fFeatures;
+}
+
+
+/**
+ * Folds one 128-bit chunk over @a uData.
+ */
+DECLINLINE(__m128i) rtCrcFold(__m128i uChunk, __m128i uConsts, __m128i uData)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(uChunk, uConsts, 0x00),
+                                       _mm_clmulepi64_si128(uChunk, uConsts, 0x11)),
+                         uData);
+}
+
+
+/**
+ * Folds the bulk of a buffer into 16 bytes using PCLMULQDQ.
+ *
+ * The CRC of the returned state (with a zero initial value) followed by the
+ * unprocessed tail equals the CRC of the whole buffer.
+ *
+ * @returns Number of bytes consumed, always a multiple of 16.
+ * @param   uCrc        The current CRC register value (not inverted by the
+ *                      finish step yet), zero extended.
+ * @param   pv          The data.
+ * @param   cb          Size of the data, at least RTCRC_FOLD_MIN_SIZE bytes.
+ * @param   pConsts     The folding constants for the polynomial.
+ * @param   pabState    Where to store the folded 16 bytes.
+ */
+DECLHIDDEN(size_t) rtCrcFoldPclmul(uint64_t uCrc, void const *pv, size_t cb, PCRTCRCFOLDCONSTS pConsts, uint8_t *pabState)
+{
+    Assert(cb >= RTCRC_FOLD_MIN_SIZE);
+    Assert(rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_PCLMUL);
+
+    __m128i const *pu     = (__m128i const *)pv;
+    size_t         cLeft  = cb / 16;
+    __m128i const  uK128  = _mm_loadu_si128((__m128i const *)&pConsts->au64Fold128[0]);
+    __m128i        uX0    = _mm_xor_si128(_mm_loadu_si128(pu),
+                                          _mm_set_epi32(0, 0, (int)(uint32_t)(uCrc >> 32), (int)(uint32_t)uCrc));
+    pu++;
+    cLeft--;
+
+    if (cLeft >= 7)
+    {
+        /* Four independent chains to hide the PCLMULQDQ latency. */
+        __m128i const uK512 = _mm_loadu_si128((__m128i const *)&pConsts->au64Fold512[0]);
+        __m128i       uX1   = _mm_loadu_si128(&pu[0]);
+        __m128i       uX2   = _mm_loadu_si128(&pu[1]);
+        __m128i       uX3   = _mm_loadu_si128(&pu[2]);
+        pu    += 3;
+        cLeft -= 3;
+        while (cLeft >= 4)
+        {
+            uX0 = rtCrcFold(uX0, uK512, _mm_loadu_si128(&pu[0]));
+            uX1 = rtCrcFold(uX1, uK512, _mm_loadu_si128(&pu[1]));
+            uX2 = rtCrcFold(uX2, uK512, _mm_loadu_si128(&pu[2]));
+            uX3 = rtCrcFold(uX3, uK512, _mm_loadu_si128(&pu[3]));
+            pu    += 4;
+            cLeft -= 4;
+        }
+        uX0 = rtCrcFold(uX0, uK128, uX1);
+        uX0 = rtCrcFold(uX0, uK128, uX2);
+        uX0 = rtCrcFold(uX0, uK128, uX3);
+    }
+
+    while (cLeft > 0)
+    {
+        uX0 = rtCrcFold(uX0, uK128, _mm_loadu_si128(pu));
+        pu++;
+        cLeft--;
+    }
+
+    _mm_storeu_si128((__m128i *)pabState, uX0);
+    return cb & ~(size_t)15;
+}
+
+
+/**
+ * Processes a buffer with the CRC32 instruction only.
+ */
+DECLINLINE(uint32_t) rtCrc32CProcessSse42Simple(uint32_t uCrc32C, uint8_t const *pb, size_t cb)
+{
+    /* Align the buffer. */
+    while (cb > 0 && ((uintptr_t)pb & (sizeof(RTCCUINTREG) - 1)))
+    {
+        uCrc32C = _mm_crc32_u8(uCrc32C, *pb++);
+        cb--;
+    }
+
+#if ARCH_BITS == 64
+    uint64_t uCrc64 = uCrc32C;
+    while (cb >= sizeof(uint64_t))
+    {
+        uCrc64 = _mm_crc32_u64(uCrc64, *(uint64_t const *)pb);
+        pb += sizeof(uint64_t);
+        cb -= sizeof(uint64_t);
+    }
+    uCrc32C = (uint32_t)uCrc64;
+#else
+    while (cb >= sizeof(uint32_t))
+    {
+        uCrc32C = _mm_crc32_u32(uCrc32C, *(uint32_t const *)pb);
+        pb += sizeof(uint32_t);
+        cb -= sizeof(uint32_t);
+    }
+#endif
+
+    while (cb > 0)
+    {
+        uCrc32C = _mm_crc32_u8(uCrc32C, *pb++);
+        cb--;
+    }
+    return uCrc32C;
+}
+
+
+/**
+ * RTCrc32CProcess worker using the CRC32 instruction, and PCLMULQDQ folding
+ * for larger buffers.
+ *
+ * @returns Updated CRC32C register.
+ * @param   uCrc32C     The current CRC32C register value.
+ * @param   pv          The data.
+ * @param   cb          Size of the data.
+ */
+DECLHIDDEN(uint32_t) rtCrc32CProcessSse42(uint32_t uCrc32C, void const *pv, size_t cb)
+{
+    Assert(rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_SSE42);
+    uint8_t const *pb = (uint8_t const *)pv;
+
+    /* The CRC32 instruction has a latency of three, so a single chain only
+       does a third of what folding manages on anything but short buffers. */
+    if (   cb >= RTCRC_FOLD_MIN_SIZE * 4
+        && (rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_PCLMUL))
+    {
+        uint8_t abState[16];
+        size_t const cbFolded = rtCrcFoldPclmul(uCrc32C, pb, cb, &g_Crc32CFoldConsts, abState);
+        uCrc32C = rtCrc32CProcessSse42Simple(0, abState, sizeof(abState));
+        pb += cbFolded;
+        cb -= cbFolded;
+    }
+
+    return rtCrc32CProcessSse42Simple(uCrc32C, pb, cb);
+}
+
+
+/**
+ * RTCrc32CProcessMulti worker interleaving three streams at a time so the
+ * CRC32 instruction latency is hidden.
+ *
+ * @param   pauCrc32C   Array of @a cBufs CRC32C register values, updated.
+ * @param   papvBufs    Array of @a cBufs data pointers.
+ * @param   pacbBufs    Array of @a cBufs data sizes.
+ * @param   cBufs       Number of streams.
+ */
+DECLHIDDEN(void) rtCrc32CProcessMultiSse42(uint32_t *pauCrc32C, void const * const *papvBufs, size_t const *pacbBufs,
+                                           size_t cBufs)
+{
+    Assert(rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_SSE42);
+
+    size_t i = 0;
+    for (; i + 3 <= cBufs; i += 3)
+    {
+        uint8_t const *pb0 = (uint8_t const *)papvBufs[i];
+        uint8_t const *pb1 = (uint8_t const *)papvBufs[i + 1];
+        uint8_t const *pb2 = (uint8_t const *)papvBufs[i + 2];
+        size_t const   cbCommon = RT_MIN(pacbBufs[i], RT_MIN(pacbBufs[i + 1], pacbBufs[i + 2])) & ~(size_t)(sizeof(RTCCUINTREG) - 1);
+#if ARCH_BITS == 64
+        uint64_t uCrc0 = pauCrc32C[i];
+        uint64_t uCrc1 = pauCrc32C[i + 1];
+        uint64_t uCrc2 = pauCrc32C[i + 2];
+        for (size_t off = 0; off < cbCommon; off += sizeof(uint64_t))
+        {
+            uCrc0 = _mm_crc32_u64(uCrc0, *(uint64_t const *)&pb0[off]);
+            uCrc1 = _mm_crc32_u64(uCrc1, *(uint64_t const *)&pb1[off]);
+            uCrc2 = _mm_crc32_u64(uCrc2, *(uint64_t const *)&pb2[off]);
+        }
+#else
+        uint32_t uCrc0 = pauCrc32C[i];
+        uint32_t uCrc1 = pauCrc32C[i + 1];
+        uint32_t uCrc2 = pauCrc32C[i + 2];
+        for (size_t off = 0; off < cbCommon; off += sizeof(uint32_t))
+        {
+            uCrc0 = _mm_crc32_u32(uCrc0, *(uint32_t const *)&pb0[off]);
+            uCrc1 = _mm_crc32_u32(uCrc1, *(uint32_t const *)&pb1[off]);
+            uCrc2 = _mm_crc32_u32(uCrc2, *(uint32_t const *)&pb2[off]);
+        }
+#endif
+
+        /* The rest of each stream. */
+        pauCrc32C[i]     = rtCrc32CProcessSse42((uint32_t)uCrc0, pb0 + cbCommon, pacbBufs[i]     - cbCommon);
+        pauCrc32C[i + 1] = rtCrc32CProcessSse42((uint32_t)uCrc1, pb1 + cbCommon, pacbBufs[i + 1] - cbCommon);
+        pauCrc32C[i + 2] = rtCrc32CProcessSse42((uint32_t)uCrc2, pb2 + cbCommon, pacbBufs[i + 2] - cbCommon);
+    }
+
+    for (; i < cBufs; i++)
+        pauCrc32C[i] = rtCrc32CProcessSse42(pauCrc32C[i], papvBufs[i], pacbBufs[i]);
+}
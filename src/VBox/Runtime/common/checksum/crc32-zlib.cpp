@@ -30,6 +30,7 @@
 *********************************************************************************************************************************/
 #include "internal/iprt.h"
 #include <iprt/crc.h>
+#include "internal/crc.h"
 
 #include <zlib.h>
 
@@ -53,12 +54,7 @@ static uint32_t rtCrc32ProcessTooBig(uint32_t uCRC32, const void *pv, size_t cb)
 
 RTDECL(uint32_t) RTCrc32(const void *pv, register size_t cb)
 {
-    uint32_t uCrc = crc32(0, NULL, 0);
-    if (RT_UNLIKELY((uInt)cb == cb))
-        uCrc = crc32(uCrc, (const Bytef *)pv, (uInt)cb);
-    else
-        uCrc = rtCrc32ProcessTooBig(uCrc, pv, cb);
-    return uCrc;
+    return RTCrc32Process(crc32(0, NULL, 0), pv, cb);
 }
 RT_EXPORT_SYMBOL(RTCrc32);
 
@@ -72,6 +68,18 @@ RT_EXPORT_SYMBOL(RTCrc32Start);
 
 RTDECL(uint32_t) RTCrc32Process(uint32_t uCRC32, const void *pv, size_t cb)
 {
+#ifdef IPRT_WITH_CRC_AMD64_X86
+    /* Note! zlib keeps the CRC inverted between calls, the folding wants the register. */
+    if (   cb >= RTCRC_FOLD_MIN_SIZE
+        && (rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_PCLMUL))
+    {
+        uint8_t abState[16];
+        size_t const cbFolded = rtCrcFoldPclmul(~uCRC32, pv, cb, &g_rtCrc32FoldConsts, abState);
+        uCRC32 = crc32(~(uint32_t)0, abState, sizeof(abState));
+        pv  = (const uint8_t *)pv + cbFolded;
+        cb -= cbFolded;
+    }
+#endif
     if (RT_UNLIKELY((uInt)cb == cb))
         uCRC32 = crc32(uCRC32, (const Bytef *)pv, (uInt)cb);
     else
@@ -76,6 +76,7 @@ __FBSDID("$FreeBSD: src/sys/libkern/crc32.c,v 1.2 2003/06/11 05:23:04 obrien Exp
 #else
 # include <iprt/crc.h>
 # include "internal/iprt.h"
+# include "internal/crc.h"
 #endif
 
 #if 0
@@ -150,13 +151,18 @@ crc32(const void *buf, size_t size)
 
 
 
-RTDECL(uint32_t) RTCrc32(const void *pv, size_t cb)
+DECLINLINE(uint32_t) rtCrc32ProcessWithTable(uint32_t uCRC32, const void *pv, size_t cb)
 {
     const uint8_t  *pu8 = (const uint8_t *)pv;
-    uint32_t        uCRC32 = ~0U;
     while (cb--)
         uCRC32 = g_au32CRC32[(uCRC32 ^ *pu8++) & 0xff] ^ (uCRC32 >> 8);
-    return uCRC32 ^ ~0U;
+    return uCRC32;
+}
+
+
+RTDECL(uint32_t) RTCrc32(const void *pv, size_t cb)
+{
+    return RTCrc32Process(~0U, pv, cb) ^ ~0U;
 }
 RT_EXPORT_SYMBOL(RTCrc32);
 
@@ -170,10 +176,18 @@ RT_EXPORT_SYMBOL(RTCrc32Start);
 
 RTDECL(uint32_t) RTCrc32Process(uint32_t uCRC32, const void *pv, size_t cb)
 {
-    const uint8_t  *pu8 = (const uint8_t *)pv;
-    while (cb--)
-        uCRC32 = g_au32CRC32[(uCRC32 ^ *pu8++) & 0xff] ^ (uCRC32 >> 8);
-    return uCRC32;
+#ifdef IPRT_WITH_CRC_AMD64_X86
+    if (   cb >= RTCRC_FOLD_MIN_SIZE
+        && (rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_PCLMUL))
+    {
+        uint8_t abState[16];
+        size_t const cbFolded = rtCrcFoldPclmul(uCRC32, pv, cb, &g_rtCrc32FoldConsts, abState);
+        uCRC32 = rtCrc32ProcessWithTable(0, abState, sizeof(abState));
+        pv  = (const uint8_t *)pv + cbFolded;
+        cb -= cbFolded;
+    }
+#endif
+    return rtCrc32ProcessWithTable(uCRC32, pv, cb);
 }
 RT_EXPORT_SYMBOL(RTCrc32Process);
 
@@ -26,6 +26,7 @@
 
 #include <iprt/crc.h>
 #include "internal/iprt.h"
+#include "internal/crc.h"
 
 /**
  * Generated using the pycrc tool using model crc-32c.
@@ -108,7 +109,7 @@ RTDECL(uint32_t) RTCrc32C(const void *pv, size_t cb)
 {
     uint32_t uCrc32C = RTCrc32CStart();
 
-    uCrc32C = rtCrc32CProcessWithTable(g_au32Crc32C, uCrc32C, pv, cb);
+    uCrc32C = RTCrc32CProcess(uCrc32C, pv, cb);
     return RTCrc32CFinish(uCrc32C);
 }
 RT_EXPORT_SYMBOL(RTCrc32C);
@@ -116,7 +117,26 @@ RT_EXPORT_SYMBOL(RTCrc32C);
 
 RTDECL(uint32_t) RTCrc32CProcess(uint32_t uCrc32C, const void *pv, size_t cb)
 {
-    return rtCrc32CProcessWithTable(g_au32Crc32C, uCrc32C, pv, cb);;
+#ifdef IPRT_WITH_CRC_AMD64_X86
+    if (rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_SSE42)
+        return rtCrc32CProcessSse42(uCrc32C, pv, cb);
+#endif
+    return rtCrc32CProcessWithTable(g_au32Crc32C, uCrc32C, pv, cb);
 }
 RT_EXPORT_SYMBOL(RTCrc32CProcess);
 
+
+RTDECL(void) RTCrc32CProcessMulti(uint32_t *pauCrc32C, void const * const *papvBufs, size_t const *pacbBufs, size_t cBufs)
+{
+#ifdef IPRT_WITH_CRC_AMD64_X86
+    if (rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_SSE42)
+    {
+        rtCrc32CProcessMultiSse42(pauCrc32C, papvBufs, pacbBufs, cBufs);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < cBufs; i++)
+        pauCrc32C[i] = rtCrc32CProcessWithTable(g_au32Crc32C, pauCrc32C[i], papvBufs[i], pacbBufs[i]);
+}
+RT_EXPORT_SYMBOL(RTCrc32CProcessMulti);
+
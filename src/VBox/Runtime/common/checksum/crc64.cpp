@@ -35,6 +35,7 @@
 *********************************************************************************************************************************/
 #include <iprt/crc.h>
 #include "internal/iprt.h"
+#include "internal/crc.h"
 
 
 /*********************************************************************************************************************************
@@ -150,6 +151,15 @@ static const uint64_t g_au64CRC64[] =
 };
 
 
+DECLINLINE(uint64_t) rtCrc64ProcessWithTable(uint64_t uCRC64, const void *pv, size_t cb)
+{
+    const uint8_t *pu8 = (const uint8_t *)pv;
+    while (cb--)
+        uCRC64 = g_au64CRC64[(uCRC64 ^ *pu8++) & 0xff] ^ (uCRC64 >> 8);
+    return uCRC64;
+}
+
+
 /**
  * Calculate CRC64 for a memory block.
  *
@@ -159,11 +169,7 @@ static const uint64_t g_au64CRC64[] =
  */
 RTDECL(uint64_t) RTCrc64(const void *pv, size_t cb)
 {
-    const uint8_t  *pu8 = (const uint8_t *)pv;
-    uint64_t        uCRC64 = 0ULL;
-    while (cb--)
-        uCRC64 = g_au64CRC64[(uCRC64 ^ *pu8++) & 0xff] ^ (uCRC64 >> 8);
-    return uCRC64;
+    return RTCrc64Process(0ULL, pv, cb);
 }
 RT_EXPORT_SYMBOL(RTCrc64);
 
@@ -190,10 +196,18 @@ RT_EXPORT_SYMBOL(RTCrc64Start);
  */
 RTDECL(uint64_t) RTCrc64Process(uint64_t uCRC64, const void *pv, size_t cb)
 {
-    const uint8_t *pu8 = (const uint8_t *)pv;
-    while (cb--)
-        uCRC64 = g_au64CRC64[(uCRC64 ^ *pu8++) & 0xff] ^ (uCRC64 >> 8);
-    return uCRC64;
+#ifdef IPRT_WITH_CRC_AMD64_X86
+    if (   cb >= RTCRC_FOLD_MIN_SIZE
+        && (rtCrcAmd64X86GetFeatures() & RTCRC_AMD64_X86_F_PCLMUL))
+    {
+        uint8_t abState[16];
+        size_t const cbFolded = rtCrcFoldPclmul(uCRC64, pv, cb, &g_rtCrc64FoldConsts, abState);
+        uCRC64 = rtCrc64ProcessWithTable(0, abState, sizeof(abState));
+        pv  = (const uint8_t *)pv + cbFolded;
+        cb -= cbFolded;
+    }
+#endif
+    return rtCrc64ProcessWithTable(uCRC64, pv, cb);
 }
 RT_EXPORT_SYMBOL(RTCrc64Process);
 
@@ -0,0 +1,87 @@
+/* $Id$ */
+/** @file
+ * IPRT - Internal RTCrc header.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+#ifndef ___internal_crc_h
+#define ___internal_crc_h
+
+#include <iprt/types.h>
+
+RT_C_DECLS_BEGIN
+
+/** @def IPRT_WITH_CRC_AMD64_X86
+ * Indicates that the SSE4.2 and PCLMULQDQ accelerated CRC code in
+ * crc-amd64-x86.cpp is available.  Ring-3 only, as the other contexts would
+ * have to save the SSE state first. */
+#if defined(IN_RING3) && (defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)) && !defined(IPRT_WITHOUT_CRC_AMD64_X86)
+# define IPRT_WITH_CRC_AMD64_X86
+#endif
+
+#ifdef IPRT_WITH_CRC_AMD64_X86
+
+/** @name RTCRC_AMD64_X86_F_XXX - CPU features used by the accelerated code.
+ * @{ */
+/** The CRC32 instruction (SSE4.2) is available, only CRC32C uses it. */
+# define RTCRC_AMD64_X86_F_SSE42        RT_BIT_32(0)
+/** PCLMULQDQ is available, used for folding large buffers. */
+# define RTCRC_AMD64_X86_F_PCLMUL       RT_BIT_32(1)
+/** Set when the features have been queried. */
+# define RTCRC_AMD64_X86_F_INITIALIZED  RT_BIT_32(31)
+/** @} */
+
+/** The smallest buffer which is worth folding with PCLMULQDQ. */
+# define RTCRC_FOLD_MIN_SIZE            64
+
+/**
+ * Constants for folding a reflected CRC with PCLMULQDQ.
+ *
+ * Each pair multiplies the low and high quadword of a 128-bit chunk so the
+ * result is congruent to the chunk moved the given distance further down the
+ * message.
+ */
+typedef struct RTCRCFOLDCONSTS
+{
+    /** Constants for folding across 512 bits (four interleaved chunks). */
+    uint64_t        au64Fold512[2];
+    /** Constants for folding across 128 bits. */
+    uint64_t        au64Fold128[2];
+} RTCRCFOLDCONSTS;
+/** Pointer to const folding constants. */
+typedef RTCRCFOLDCONSTS const *PCRTCRCFOLDCONSTS;
+
+extern DECLHIDDEN(RTCRCFOLDCONSTS const) g_rtCrc32FoldConsts;
+extern DECLHIDDEN(RTCRCFOLDCONSTS const) g_rtCrc64FoldConsts;
+
+DECLHIDDEN(uint32_t) rtCrcAmd64X86GetFeatures(void);
+DECLHIDDEN(size_t)   rtCrcFoldPclmul(uint64_t uCrc, void const *pv, size_t cb, PCRTCRCFOLDCONSTS pConsts, uint8_t *pabState);
+DECLHIDDEN(uint32_t) rtCrc32CProcessSse42(uint32_t uCrc32C, void const *pv, size_t cb);
+DECLHIDDEN(void)     rtCrc32CProcessMultiSse42(uint32_t *pauCrc32C, void const * const *papvBufs, size_t const *pacbBufs,
+                                               size_t cBufs);
+
+#endif /* IPRT_WITH_CRC_AMD64_X86 */
+
+RT_C_DECLS_END
+
+#endif
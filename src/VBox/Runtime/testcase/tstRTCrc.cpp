@@ -0,0 +1,270 @@
+/* $Id$ */
+/** @file
+ * IPRT Testcase - RTCrc32, RTCrc32C and RTCrc64, correctness and throughput.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <iprt/crc.h>
+
+#include <iprt/err.h>
+#include <iprt/mem.h>
+#include <iprt/rand.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** Size of the random test buffer. */
+#define TST_BUF_SIZE        _1M
+/** How long to run each benchmark for, in nanoseconds. */
+#define TST_BENCH_NS        (RT_NS_1SEC / 4)
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The random test data. */
+static uint8_t *g_pbBuf;
+
+
+/**
+ * Bitwise reference implementation for the reflected 32-bit CRCs.
+ */
+static uint32_t tstRefCrc32(uint32_t uPoly, uint32_t uCrc, uint8_t const *pb, size_t cb)
+{
+    while (cb-- > 0)
+    {
+        uCrc ^= *pb++;
+        for (unsigned iBit = 0; iBit < 8; iBit++)
+            uCrc = uCrc & 1 ? (uCrc >> 1) ^ uPoly : uCrc >> 1;
+    }
+    return uCrc;
+}
+
+
+/**
+ * Bitwise reference implementation for the reflected 64-bit CRC.
+ */
+static uint64_t tstRefCrc64(uint64_t uCrc, uint8_t const *pb, size_t cb)
+{
+    while (cb-- > 0)
+    {
+        uCrc ^= *pb++;
+        for (unsigned iBit = 0; iBit < 8; iBit++)
+            uCrc = uCrc & 1 ? (uCrc >> 1) ^ UINT64_C(0xd800000000000000) : uCrc >> 1;
+    }
+    return uCrc;
+}
+
+
+static void tstKnownAnswers(void)
+{
+    RTTestISub("known answers");
+
+    static const char s_szCheck[] = "123456789";
+    RTTESTI_CHECK_MSG(RTCrc32(s_szCheck, 9) == UINT32_C(0xcbf43926), ("%#x\n", RTCrc32(s_szCheck, 9)));
+    RTTESTI_CHECK_MSG(RTCrc32C(s_szCheck, 9) == UINT32_C(0xe3069283), ("%#x\n", RTCrc32C(s_szCheck, 9)));
+    RTTESTI_CHECK_MSG(RTCrc64(s_szCheck, 9) == UINT64_C(0x46a5a9388a5beffe), ("%#llx\n", RTCrc64(s_szCheck, 9)));
+}
+
+
+/**
+ * Compares the CRC functions against the bitwise reference code for a range
+ * of sizes and alignments, so both the accelerated and the table code paths
+ * as well as the transitions between them are covered.
+ */
+static void tstCompare(void)
+{
+    RTTestISub("reference comparison");
+
+    for (uint32_t i = 0; i < 2048; i++)
+    {
+        size_t const   off = RTRandU32Ex(0, 63);
+        size_t const   cb  = i < 1024 ? i : RTRandU32Ex(0, TST_BUF_SIZE - 64);
+        uint8_t const *pb  = &g_pbBuf[off];
+
+        uint32_t const uCrc32Start = RTRandU32();
+        uint32_t uExpect32 = tstRefCrc32(UINT32_C(0x82f63b78), uCrc32Start, pb, cb);
+        uint32_t uCrc32    = RTCrc32CProcess(uCrc32Start, pb, cb);
+        if (uCrc32 != uExpect32)
+            RTTestIFailed("RTCrc32CProcess: off=%zu cb=%zu: %#x, expected %#x", off, cb, uCrc32, uExpect32);
+
+        uExpect32 = tstRefCrc32(UINT32_C(0xedb88320), UINT32_MAX, pb, cb) ^ UINT32_MAX;
+        uCrc32    = RTCrc32(pb, cb);
+        if (uCrc32 != uExpect32)
+            RTTestIFailed("RTCrc32: off=%zu cb=%zu: %#x, expected %#x", off, cb, uCrc32, uExpect32);
+
+        /* Split the buffer at a random place to check the intermediate value handling. */
+        size_t const cbFirst = cb ? RTRandU32Ex(0, (uint32_t)cb - 1) : 0;
+        uCrc32 = RTCrc32Start();
+        uCrc32 = RTCrc32Process(uCrc32, pb, cbFirst);
+        uCrc32 = RTCrc32Process(uCrc32, pb + cbFirst, cb - cbFirst);
+        uCrc32 = RTCrc32Finish(uCrc32);
+        if (uCrc32 != uExpect32)
+            RTTestIFailed("RTCrc32Process: off=%zu cb=%zu split=%zu: %#x, expected %#x", off, cb, cbFirst, uCrc32, uExpect32);
+
+        uint64_t const uCrc64Start = RTRandU64();
+        uint64_t const uExpect64   = tstRefCrc64(uCrc64Start, pb, cb);
+        uint64_t const uCrc64      = RTCrc64Process(uCrc64Start, pb, cb);
+        if (uCrc64 != uExpect64)
+            RTTestIFailed("RTCrc64Process: off=%zu cb=%zu: %#llx, expected %#llx", off, cb, uCrc64, uExpect64);
+    }
+
+    RTTestISub("multi-buffer CRC32C");
+    for (uint32_t i = 0; i < 512; i++)
+    {
+        uint32_t    auCrc[9];
+        uint32_t    auExpect[9];
+        void const *apv[9];
+        size_t      acb[9];
+        size_t const cBufs = RTRandU32Ex(1, RT_ELEMENTS(auCrc));
+        for (size_t iBuf = 0; iBuf < cBufs; iBuf++)
+        {
+            apv[iBuf]  = &g_pbBuf[RTRandU32Ex(0, _4K)];
+            acb[iBuf]  = RTRandU32Ex(0, i & 1 ? _64K : 100);
+            auCrc[iBuf] = RTRandU32();
+            auExpect[iBuf] = tstRefCrc32(UINT32_C(0x82f63b78), auCrc[iBuf], (uint8_t const *)apv[iBuf], acb[iBuf]);
+        }
+        RTCrc32CProcessMulti(auCrc, apv, acb, cBufs);
+        for (size_t iBuf = 0; iBuf < cBufs; iBuf++)
+            if (auCrc[iBuf] != auExpect[iBuf])
+                RTTestIFailed("RTCrc32CProcessMulti: #%zu of %zu cb=%zu: %#x, expected %#x",
+                              iBuf, cBufs, acb[iBuf], auCrc[iBuf], auExpect[iBuf]);
+    }
+}
+
+
+/**
+ * Reports the throughput for @a cbTotal bytes processed in @a cNsElapsed.
+ */
+static void tstReportThroughput(const char *pszWhat, size_t cbBlock, uint64_t cbTotal, uint64_t cNsElapsed)
+{
+    uint64_t const cbPerSec = cbTotal * RT_NS_1SEC / RT_MAX(cNsElapsed, 1);
+    RTTestIValueF(cbPerSec / _1M, RTTESTUNIT_MEGABYTES_PER_SEC, "%s %zu bytes", pszWhat, cbBlock);
+    RTTestIPrintf(RTTESTLVL_ALWAYS, "%s %7zu bytes: %u.%02u GB/s\n", pszWhat, cbBlock,
+                  (unsigned)(cbPerSec / 1000000000), (unsigned)(cbPerSec / 10000000 % 100));
+}
+
+
+static void tstBenchmark(void)
+{
+    RTTestISub("benchmarks");
+
+    static size_t const s_acbBlocks[] = { 64, 512, _4K, _64K, _1M };
+    for (unsigned iBlock = 0; iBlock < RT_ELEMENTS(s_acbBlocks); iBlock++)
+    {
+        size_t const cbBlock = s_acbBlocks[iBlock];
+        uint32_t volatile uSink32 = 0;
+        uint64_t volatile uSink64 = 0;
+
+        uint64_t cbTotal = 0;
+        uint64_t nsStart = RTTimeNanoTS();
+        uint64_t cNsElapsed;
+        do
+        {
+            for (unsigned i = 0; i < 64; i++)
+                uSink32 += RTCrc32C(g_pbBuf, cbBlock);
+            cbTotal += 64 * cbBlock;
+            cNsElapsed = RTTimeNanoTS() - nsStart;
+        } while (cNsElapsed < TST_BENCH_NS);
+        tstReportThroughput("RTCrc32C", cbBlock, cbTotal, cNsElapsed);
+
+        cbTotal = 0;
+        nsStart = RTTimeNanoTS();
+        do
+        {
+            for (unsigned i = 0; i < 64; i++)
+                uSink32 += RTCrc32(g_pbBuf, cbBlock);
+            cbTotal += 64 * cbBlock;
+            cNsElapsed = RTTimeNanoTS() - nsStart;
+        } while (cNsElapsed < TST_BENCH_NS);
+        tstReportThroughput("RTCrc32 ", cbBlock, cbTotal, cNsElapsed);
+
+        cbTotal = 0;
+        nsStart = RTTimeNanoTS();
+        do
+        {
+            for (unsigned i = 0; i < 64; i++)
+                uSink64 += RTCrc64(g_pbBuf, cbBlock);
+            cbTotal += 64 * cbBlock;
+            cNsElapsed = RTTimeNanoTS() - nsStart;
+        } while (cNsElapsed < TST_BENCH_NS);
+        tstReportThroughput("RTCrc64 ", cbBlock, cbTotal, cNsElapsed);
+
+        /* Eight independent streams, like the digests of a bunch of iSCSI PDUs or sectors. */
+        void const *apv[8];
+        size_t      acb[8];
+        uint32_t    auCrc[8];
+        for (unsigned iBuf = 0; iBuf < RT_ELEMENTS(apv); iBuf++)
+        {
+            apv[iBuf]   = &g_pbBuf[(iBuf * cbBlock) % (TST_BUF_SIZE - cbBlock + 1)];
+            acb[iBuf]   = cbBlock;
+            auCrc[iBuf] = RTCrc32CStart();
+        }
+        cbTotal = 0;
+        nsStart = RTTimeNanoTS();
+        do
+        {
+            for (unsigned i = 0; i < 8; i++)
+                RTCrc32CProcessMulti(auCrc, apv, acb, RT_ELEMENTS(apv));
+            cbTotal += 8 * RT_ELEMENTS(apv) * cbBlock;
+            cNsElapsed = RTTimeNanoTS() - nsStart;
+        } while (cNsElapsed < TST_BENCH_NS);
+        tstReportThroughput("RTCrc32CProcessMulti x8", cbBlock, cbTotal, cNsElapsed);
+        NOREF(uSink32); NOREF(uSink64);
+    }
+}
+
+
+int main()
+{
+    RTTEST hTest;
+    int rc = RTTestInitAndCreate("tstRTCrc", &hTest);
+    if (rc)
+        return rc;
+    RTTestBanner(hTest);
+
+    g_pbBuf = (uint8_t *)RTMemAlloc(TST_BUF_SIZE);
+    if (g_pbBuf)
+    {
+        RTRandBytes(g_pbBuf, TST_BUF_SIZE);
+
+        tstKnownAnswers();
+        tstCompare();
+        if (!RTTestErrorCount(hTest))
+            tstBenchmark();
+
+        RTMemFree(g_pbBuf);
+    }
+    else
+        RTTestIFailed("Out of memory");
+
+    return RTTestSummaryAndDestroy(hTest);
+}
@@ -32,6 +32,7 @@
 #include <iprt/thread.h>
 #include <iprt/semaphore.h>
 #include <iprt/md5.h>
+#include <iprt/crc.h>
 #include <iprt/tcp.h>
 #include <iprt/time.h>
 #include <VBox/scsi.h>
@@ -112,8 +113,11 @@ typedef enum SCSIDEVTYPE
  * s_iscsiConfigDefaultWriteSplit. */
 #define ISCSI_DATA_LENGTH_MAX _256K
 
-/** Maximum PDU size we can handle in one piece. */
-#define ISCSI_RECV_PDU_BUFFER_SIZE (ISCSI_DATA_LENGTH_MAX + ISCSI_BHS_SIZE)
+/** Maximum PDU size we can handle in one piece, including the header and data digests. */
+#define ISCSI_RECV_PDU_BUFFER_SIZE (ISCSI_DATA_LENGTH_MAX + ISCSI_BHS_SIZE + 2 * ISCSI_DIGEST_SIZE)
+
+/** Largest MaxBurstLength we negotiate. RFC3720 limits it to 2^24-1, keep it sector aligned. */
+#define ISCSI_BURST_LENGTH_MAX (_16M - 512)
 
 
 /** Version of the iSCSI standard which this initiator driver can handle. */
@@ -123,6 +127,9 @@ typedef enum SCSIDEVTYPE
 /** Length of ISCSI basic header segment. */
 #define ISCSI_BHS_SIZE 48
 
+/** Length of a header or data digest (CRC32C). */
+#define ISCSI_DIGEST_SIZE 4
+
 
 /** Reserved task tag value. */
 #define ISCSI_TASK_TAG_RSVD 0xffffffff
@@ -222,8 +229,9 @@ typedef enum ISCSIOPCODE
 /** ISCSI BHS word 0: response includes status. */
 #define ISCSI_STATUS_BIT 0x00010000
 
-/** Maximum number of scatter/gather segments needed to send a PDU. */
-#define ISCSI_SG_SEGMENTS_MAX 4
+/** Maximum number of scatter/gather segments needed to send a PDU
+ * (BHS, header digest, data, padding and data digest). */
+#define ISCSI_SG_SEGMENTS_MAX 8
 
 /** Number of entries in the command table. */
 #define ISCSI_CMD_WAITING_ENTRIES 32
@@ -428,6 +436,13 @@ typedef struct ISCSICMD
     void                 *pvUser;
     /** Command to execute. */
     ISCSICMDTYPE          enmCmdType;
+    /** Number of Data-Out PDUs for this command which are queued or being sent. */
+    uint32_t              cDataOutPending;
+    /** Flag whether the target completed the command while Data-Out PDUs
+     * were still being sent, the command is completed when the last one is out. */
+    bool                  fCompletePending;
+    /** Status code to complete the command with when fCompletePending is set. */
+    int                   rcCompletePending;
     /** Command type dependent data. */
     union
     {
@@ -466,6 +481,12 @@ typedef struct ISCSIPDUTX
     size_t      cbSgLeft;
     /** The iSCSI command this PDU belongs to. */
     PISCSICMD   pIScsiCmd;
+    /** Flag whether this is a Data-Out PDU answering a R2T for pIScsiCmd. */
+    bool        fDataOut;
+    /** The header digest if enabled. */
+    uint32_t    u32HdrDigest;
+    /** The data digest if enabled. */
+    uint32_t    u32DataDigest;
     /** Number of segments in the request segments array. */
     unsigned    cISCSIReq;
     /** The request segments - variable in size. */
@@ -501,6 +522,14 @@ typedef struct ISCSIIMAGE
      * written in a single write. This is negotiated with the target, so
      * the actual size might be smaller. */
     uint32_t            cbWriteSplit;
+    /** The MaxBurstLength to propose to the target. */
+    uint32_t            cbMaxBurstLengthCfg;
+    /** The MaxOutstandingR2T value to propose to the target. */
+    uint32_t            cMaxOutstandingR2TCfg;
+    /** Flag whether to propose CRC32C header digests. */
+    bool                fHeaderDigestCfg;
+    /** Flag whether to propose CRC32C data digests. */
+    bool                fDataDigestCfg;
     /** Initiator session identifier. */
     uint64_t            ISID;
     /** SCSI Logical Unit Number. */
@@ -528,10 +557,26 @@ typedef struct ISCSIIMAGE
     /** Total volume size in bytes. Easier than multiplying the above values all the time. */
     uint64_t            cbSize;
 
-    /** Negotiated maximum data length when sending to target. */
+    /** Negotiated maximum data segment length when sending to target. */
     uint32_t            cbSendDataLength;
     /** Negotiated maximum data length when receiving from target. */
     uint32_t            cbRecvDataLength;
+    /** Maximum amount of immediate data sent along with a write command. */
+    uint32_t            cbFirstBurstLength;
+    /** Negotiated maximum burst length, limits the size of a single read or write. */
+    uint32_t            cbMaxBurstLength;
+    /** Negotiated number of R2Ts the target may have outstanding per task. */
+    uint32_t            cMaxOutstandingR2T;
+    /** Flag whether the target accepts immediate data. */
+    bool                fImmediateData;
+    /** Flag whether header digests are used in the full feature phase. */
+    bool                fHeaderDigest;
+    /** Flag whether data digests are used in the full feature phase. */
+    bool                fDataDigest;
+    /** Header digest negotiation result, becomes active after the login. */
+    bool                fHeaderDigestPending;
+    /** Data digest negotiation result, becomes active after the login. */
+    bool                fDataDigestPending;
 
     /** Current state of the connection/session. */
     ISCSISTATE          state;
@@ -635,8 +680,17 @@ static const char *s_iscsiConfigDefaultLUN = "0";
 /** Default timeout, 10 seconds. */
 static const char *s_iscsiConfigDefaultTimeout = "10000";
 
-/** Default write split value, less or equal to ISCSI_DATA_LENGTH_MAX. */
-static const char *s_iscsiConfigDefaultWriteSplit = "262144";
+/** Default write split value, writes are additionally limited by the negotiated MaxBurstLength. */
+static const char *s_iscsiConfigDefaultWriteSplit = "16776704";
+
+/** Default MaxBurstLength to propose, 1MB. */
+static const char *s_iscsiConfigDefaultMaxBurstLength = "1048576";
+
+/** Default MaxOutstandingR2T to propose. */
+static const char *s_iscsiConfigDefaultMaxOutstandingR2T = "4";
+
+/** Default header and data digest configuration value. */
+static const char *s_iscsiConfigDefaultDigest = "0";
 
 /** Default host IP stack. */
 static const char *s_iscsiConfigDefaultHostIPStack = "1";
@@ -657,6 +711,10 @@ static const VDCONFIGINFO s_iscsiConfigInfo[] =
     { "TargetUsername",       NULL,                                      VDCFGVALUETYPE_STRING,  VD_CFGKEY_EXPERT },
     { "TargetSecret",         NULL,                                      VDCFGVALUETYPE_BYTES,   VD_CFGKEY_EXPERT },
     { "WriteSplit",           s_iscsiConfigDefaultWriteSplit,            VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "MaxBurstLength",       s_iscsiConfigDefaultMaxBurstLength,        VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "MaxOutstandingR2T",    s_iscsiConfigDefaultMaxOutstandingR2T,     VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "HeaderDigest",         s_iscsiConfigDefaultDigest,                VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "DataDigest",           s_iscsiConfigDefaultDigest,                VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
     { "Timeout",              s_iscsiConfigDefaultTimeout,               VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
     { "HostIPStack",          s_iscsiConfigDefaultHostIPStack,           VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
     { "DumpMalformedPackets", s_iscsiConfigDefaultDumpMalformedPackets,  VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
@@ -677,8 +735,10 @@ static int iscsiSendPDUAsync(PISCSIIMAGE pImage);
 static int iscsiValidatePDU(PISCSIRES paRes, uint32_t cnRes);
 static int iscsiRecvPDUProcess(PISCSIIMAGE pImage, PISCSIRES paRes, uint32_t cnRes);
 static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd);
+static int iscsiR2TProcess(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, const uint32_t *paResBHS);
 static int iscsiRecvPDUUpdateRequest(PISCSIIMAGE pImage, PISCSIRES paRes, uint32_t cnRes);
 static void iscsiCmdComplete(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, int rcCmd);
+static void iscsiCmdDataOutDone(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd);
 static int iscsiTextAddKeyValue(uint8_t *pbBuf, size_t cbBuf, size_t *pcbBufCurr, const char *pcszKey, const char *pcszValue, size_t cbValue);
 static int iscsiTextGetKeyValue(const uint8_t *pbBuf, size_t cbBuf, const char *pcszKey, const char **ppcszValue);
 static int iscsiStrToBinary(const char *pcszValue, uint8_t *pbValue, size_t *pcbValue);
@@ -848,6 +908,124 @@ static void iscsiDumpPacket(PISCSIIMAGE pImage, PISCSIREQ paISCSISegs, unsigned
     }
 }
 
+/**
+ * Calculates a CRC32C header or data digest over the given segments.
+ *
+ * @returns The digest in the byte order used on the wire.
+ * @param   paSegs         The segments to calculate the digest for, padding included.
+ * @param   cSegs          Number of segments.
+ */
+static uint32_t iscsiDigestCalc(PCRTSGSEG paSegs, unsigned cSegs)
+{
+    uint32_t uCrc32C = RTCrc32CStart();
+
+    for (unsigned i = 0; i < cSegs; i++)
+        uCrc32C = RTCrc32CProcess(uCrc32C, paSegs[i].pvSeg, paSegs[i].cbSeg);
+
+    return RT_H2LE_U32(RTCrc32CFinish(uCrc32C));
+}
+
+/**
+ * Returns the number of bytes of a PDU following the BHS, i.e. the additional
+ * header segments, the data segment, padding and the digests if enabled.
+ *
+ * @returns Number of bytes.
+ * @param   pImage         The iSCSI image instance data.
+ * @param   u32Word1       The second word of the BHS in host byte order.
+ */
+static size_t iscsiPDUSizeAfterBHS(PISCSIIMAGE pImage, uint32_t u32Word1)
+{
+    size_t cbAHSLength = (u32Word1 & 0xff000000) >> 24;
+    cbAHSLength = ((cbAHSLength - 1) | 3) + 1;      /* Add padding. */
+    size_t cbDataLength = u32Word1 & 0x00ffffff;
+    cbDataLength = ((cbDataLength - 1) | 3) + 1;    /* Add padding. */
+
+    size_t cbPDU = cbAHSLength + cbDataLength;
+    if (pImage->fHeaderDigest)
+        cbPDU += ISCSI_DIGEST_SIZE;
+    if (pImage->fDataDigest && cbDataLength)
+        cbPDU += ISCSI_DIGEST_SIZE;
+    return cbPDU;
+}
+
+/**
+ * Verifies the digests of a completely received PDU if enabled and strips
+ * them, so the PDU looks like one received without digests afterwards.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_IO_CRC if a digest doesn't match.
+ * @param   pImage         The iSCSI image instance data.
+ * @param   pRes           The buffer holding the PDU, updated on success.
+ */
+static int iscsiRecvPDUDigestsCheck(PISCSIIMAGE pImage, PISCSIRES pRes)
+{
+    if (!pImage->fHeaderDigest && !pImage->fDataDigest)
+        return VINF_SUCCESS;
+
+    uint8_t *pbPDU = (uint8_t *)pRes->pvSeg;
+    uint32_t u32Word1 = RT_N2H_U32(((uint32_t *)pbPDU)[1]);
+    size_t cbHdr = (u32Word1 & 0xff000000) >> 24;
+    cbHdr = ISCSI_BHS_SIZE + ((cbHdr - 1) | 3) + 1;
+    size_t cbData = u32Word1 & 0x00ffffff;
+    cbData = ((cbData - 1) | 3) + 1;
+
+    if (pImage->fHeaderDigest)
+    {
+        RTSGSEG Seg;
+        Seg.pvSeg = pbPDU;
+        Seg.cbSeg = cbHdr;
+        if (iscsiDigestCalc(&Seg, 1) != *(uint32_t *)(pbPDU + cbHdr))
+            return VERR_IO_CRC;
+
+        /* Move the header over the digest, cheaper than moving the data. */
+        memmove(pbPDU + ISCSI_DIGEST_SIZE, pbPDU, cbHdr);
+        pbPDU += ISCSI_DIGEST_SIZE;
+        pRes->pvSeg  = pbPDU;
+        pRes->cbSeg -= ISCSI_DIGEST_SIZE;
+    }
+
+    if (pImage->fDataDigest && cbData)
+    {
+        RTSGSEG Seg;
+        Seg.pvSeg = pbPDU + cbHdr;
+        Seg.cbSeg = cbData;
+        if (iscsiDigestCalc(&Seg, 1) != *(uint32_t *)(pbPDU + cbHdr + cbData))
+            return VERR_IO_CRC;
+        pRes->cbSeg -= ISCSI_DIGEST_SIZE;
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Initializes the BHS of a Data-Out PDU answering a R2T.
+ *
+ * @param   pImage         The iSCSI image instance data.
+ * @param   paReqBHS       The BHS to initialize.
+ * @param   Itt            The initiator task tag of the command (network byte order).
+ * @param   Ttt            The target transfer tag from the R2T (network byte order).
+ * @param   DataSN         The data sequence number of the PDU in the R2T sequence.
+ * @param   offBuffer      Offset of the data in the command data buffer.
+ * @param   cbData         Number of bytes in the data segment.
+ * @param   fFinal         Flag whether this is the last PDU for the R2T.
+ */
+static void iscsiDataOutBHSInit(PISCSIIMAGE pImage, uint32_t *paReqBHS, uint32_t Itt, uint32_t Ttt,
+                                uint32_t DataSN, uint32_t offBuffer, uint32_t cbData, bool fFinal)
+{
+    paReqBHS[0] = RT_H2N_U32((fFinal ? ISCSI_FINAL_BIT : 0) | ISCSIOP_SCSI_DATA_OUT);
+    paReqBHS[1] = RT_H2N_U32(cbData & 0xffffff); /* TotalAHSLength=0 */
+    paReqBHS[2] = RT_H2N_U32(pImage->LUN >> 32);
+    paReqBHS[3] = RT_H2N_U32(pImage->LUN & 0xffffffff);
+    paReqBHS[4] = Itt;
+    paReqBHS[5] = Ttt;
+    paReqBHS[6] = 0;            /* reserved */
+    paReqBHS[7] = RT_H2N_U32(pImage->ExpStatSN);
+    paReqBHS[8] = 0;            /* reserved */
+    paReqBHS[9] = RT_H2N_U32(DataSN);
+    paReqBHS[10] = RT_H2N_U32(offBuffer);
+    paReqBHS[11] = 0;           /* reserved */
+}
+
 static int iscsiTransportConnect(PISCSIIMAGE pImage)
 {
     int rc;
@@ -919,7 +1097,7 @@ static int iscsiTransportRead(PISCSIIMAGE pImage, PISCSIRES paResponse, unsigned
 {
     int rc = VINF_SUCCESS;
     unsigned int i = 0;
-    size_t cbToRead, cbActuallyRead, residual, cbSegActual = 0, cbAHSLength, cbDataLength;
+    size_t cbToRead, cbActuallyRead, residual, cbSegActual = 0, cbPDURest;
     char *pDst;
 
     LogFlowFunc(("cnResponse=%d (%s:%d)\n", cnResponse, pImage->pszHostname, pImage->uPort));
@@ -969,15 +1147,12 @@ static int iscsiTransportRead(PISCSIIMAGE pImage, PISCSIRES paResponse, unsigned
                 {
                     /* Enough data read to figure out the actual PDU size. */
                     uint32_t word1 = RT_N2H_U32(((uint32_t *)(paResponse[0].pvSeg))[1]);
-                    cbAHSLength = (word1 & 0xff000000) >> 24;
-                    cbAHSLength = ((cbAHSLength - 1) | 3) + 1;      /* Add padding. */
-                    cbDataLength = word1 & 0x00ffffff;
-                    cbDataLength = ((cbDataLength - 1) | 3) + 1;    /* Add padding. */
-                    cbToRead = residual + cbAHSLength + cbDataLength;
+                    cbPDURest = iscsiPDUSizeAfterBHS(pImage, word1);
+                    cbToRead = residual + cbPDURest;
                     residual += paResponse[0].cbSeg - ISCSI_BHS_SIZE;
                     if (residual > cbToRead)
                         residual = cbToRead;
-                    cbSegActual = ISCSI_BHS_SIZE + cbAHSLength + cbDataLength;
+                    cbSegActual = ISCSI_BHS_SIZE + cbPDURest;
                     /* Check whether we are already done with this PDU (no payload). */
                     if (cbToRead == 0)
                         break;
@@ -1053,7 +1228,7 @@ static int iscsiTransportWrite(PISCSIIMAGE pImage, PISCSIREQ paRequest, unsigned
     if (RT_SUCCESS(rc))
     {
         /* Construct scatter/gather buffer for entire request, worst case
-         * needs twice as many entries to allow for padding. */
+         * needs twice as many entries to allow for padding plus the digests. */
         unsigned cBuf = 0;
         for (i = 0; i < cnRequest; i++)
         {
@@ -1061,14 +1236,19 @@ static int iscsiTransportWrite(PISCSIIMAGE pImage, PISCSIREQ paRequest, unsigned
             if (paRequest[i].cbSeg & 3)
                 cBuf++;
         }
-        Assert(cBuf < ISCSI_SG_SEGMENTS_MAX);
+        Assert(cBuf + 2 <= ISCSI_SG_SEGMENTS_MAX);
         RTSGBUF buf;
         RTSGSEG aSeg[ISCSI_SG_SEGMENTS_MAX];
         static char aPad[4] = { 0, 0, 0, 0 };
-        RTSgBufInit(&buf, &aSeg[0], cBuf);
+        uint32_t u32HdrDigest = 0;
+        uint32_t u32DataDigest = 0;
         unsigned iBuf = 0;
+        unsigned iBufData = 0;
         for (i = 0; i < cnRequest; i++)
         {
+            /* Skip empty data segments, they would get a data digest otherwise. */
+            if (i > 0 && !paRequest[i].cbSeg)
+                continue;
             /* Actual data chunk. */
             aSeg[iBuf].pvSeg = (void *)paRequest[i].pcvSeg;
             aSeg[iBuf].cbSeg = paRequest[i].cbSeg;
@@ -1080,7 +1260,28 @@ static int iscsiTransportWrite(PISCSIIMAGE pImage, PISCSIREQ paRequest, unsigned
                 aSeg[iBuf].cbSeg = 4 - (paRequest[i].cbSeg & 3);
                 iBuf++;
             }
+            /* The header digest follows the BHS (we never send additional header segments). */
+            if (i == 0)
+            {
+                if (pImage->fHeaderDigest)
+                {
+                    u32HdrDigest = iscsiDigestCalc(&aSeg[0], iBuf);
+                    aSeg[iBuf].pvSeg = &u32HdrDigest;
+                    aSeg[iBuf].cbSeg = sizeof(u32HdrDigest);
+                    iBuf++;
+                }
+                iBufData = iBuf;
+            }
         }
+        if (   pImage->fDataDigest
+            && iBuf > iBufData)
+        {
+            u32DataDigest = iscsiDigestCalc(&aSeg[iBufData], iBuf - iBufData);
+            aSeg[iBuf].pvSeg = &u32DataDigest;
+            aSeg[iBuf].cbSeg = sizeof(u32DataDigest);
+            iBuf++;
+        }
+        RTSgBufInit(&buf, &aSeg[0], iBuf);
         /* Send out the request, the socket is set to send data immediately,
          * avoiding unnecessary delays. */
         rc = pImage->pIfNet->pfnSgWrite(pImage->Socket, &buf);
@@ -1292,26 +1493,42 @@ static int iscsiLogin(PISCSIIMAGE pImage)
     uint32_t aResBHS[12];
     char *pszNext;
     bool fParameterNeg = true;
-    pImage->cbRecvDataLength = ISCSI_DATA_LENGTH_MAX;
-    pImage->cbSendDataLength = RT_MIN(ISCSI_DATA_LENGTH_MAX, pImage->cbWriteSplit);
+    pImage->cbRecvDataLength     = ISCSI_DATA_LENGTH_MAX;
+    pImage->cbSendDataLength     = ISCSI_DATA_LENGTH_MAX;
+    pImage->cbMaxBurstLength     = pImage->cbMaxBurstLengthCfg;
+    pImage->cbFirstBurstLength   = RT_MIN(ISCSI_DATA_LENGTH_MAX, pImage->cbMaxBurstLength);
+    pImage->cMaxOutstandingR2T   = pImage->cMaxOutstandingR2TCfg;
+    pImage->fImmediateData       = true;
+    pImage->fHeaderDigest        = false;
+    pImage->fDataDigest          = false;
+    pImage->fHeaderDigestPending = false;
+    pImage->fDataDigestPending   = false;
     char szMaxDataLength[16];
     RTStrPrintf(szMaxDataLength, sizeof(szMaxDataLength), "%u", ISCSI_DATA_LENGTH_MAX);
+    char szMaxBurstLength[16];
+    RTStrPrintf(szMaxBurstLength, sizeof(szMaxBurstLength), "%u", pImage->cbMaxBurstLength);
+    char szFirstBurstLength[16];
+    RTStrPrintf(szFirstBurstLength, sizeof(szFirstBurstLength), "%u", pImage->cbFirstBurstLength);
+    char szMaxOutstandingR2T[16];
+    RTStrPrintf(szMaxOutstandingR2T, sizeof(szMaxOutstandingR2T), "%u", pImage->cMaxOutstandingR2T);
+    /* The immediate data is additionally limited by the configured write split. */
+    pImage->cbFirstBurstLength = RT_MIN(pImage->cbFirstBurstLength, pImage->cbWriteSplit);
     ISCSIPARAMETER aParameterNeg[] =
     {
-        { "HeaderDigest", "None", 0 },
-        { "DataDigest", "None", 0 },
+        { "HeaderDigest", pImage->fHeaderDigestCfg ? "CRC32C,None" : "None", 0 },
+        { "DataDigest", pImage->fDataDigestCfg ? "CRC32C,None" : "None", 0 },
         { "MaxConnections", "1", 0 },
         { "InitialR2T", "No", 0 },
         { "ImmediateData", "Yes", 0 },
         { "MaxRecvDataSegmentLength", szMaxDataLength, 0 },
-        { "MaxBurstLength", szMaxDataLength, 0 },
-        { "FirstBurstLength", szMaxDataLength, 0 },
+        { "MaxBurstLength", szMaxBurstLength, 0 },
+        { "FirstBurstLength", szFirstBurstLength, 0 },
         { "DefaultTime2Wait", "0", 0 },
         { "DefaultTime2Retain", "60", 0 },
         { "DataPDUInOrder", "Yes", 0 },
         { "DataSequenceInOrder", "Yes", 0 },
         { "ErrorRecoveryLevel", "0", 0 },
-        { "MaxOutstandingR2T", "1", 0 }
+        { "MaxOutstandingR2T", szMaxOutstandingR2T, 0 }
     };
 
     if (!iscsiIsClientConnected(pImage))
@@ -1672,7 +1889,14 @@ static int iscsiLogin(PISCSIIMAGE pImage)
                 {
                     /*
                      * Finished login, continuing with Full Feature Phase.
+                     * The negotiated digests are used starting with the next PDU.
                      */
+                    pImage->fHeaderDigest = pImage->fHeaderDigestPending;
+                    pImage->fDataDigest   = pImage->fDataDigestPending;
+                    LogRel(("iSCSI: MaxBurstLength=%u FirstBurstLength=%u MaxRecvDataSegmentLength=%u MaxOutstandingR2T=%u ImmediateData=%RTbool HeaderDigest=%s DataDigest=%s\n",
+                            pImage->cbMaxBurstLength, pImage->cbFirstBurstLength, pImage->cbSendDataLength,
+                            pImage->cMaxOutstandingR2T, pImage->fImmediateData,
+                            pImage->fHeaderDigest ? "CRC32C" : "None", pImage->fDataDigest ? "CRC32C" : "None"));
                     rc = VINF_SUCCESS;
                     break;
                 }
@@ -1874,6 +2098,7 @@ static int iscsiCommand(PISCSIIMAGE pImage, PSCSIREQ pRequest)
 
     uint32_t *pDst = NULL;
     size_t cbBufLength;
+    size_t cbImmediate = 0;
     uint32_t aStatus[256]; /**< Plenty of buffer for status information. */
     uint32_t ExpDataSN = 0;
     bool final = false;
@@ -1882,7 +2107,6 @@ static int iscsiCommand(PISCSIIMAGE pImage, PSCSIREQ pRequest)
     LogFlowFunc(("entering, CmdSN=%d\n", pImage->CmdSN));
 
     Assert(pRequest->enmXfer != SCSIXFER_TO_FROM_TARGET);   /**< @todo not yet supported, would require AHS. */
-    Assert(pRequest->cbI2TData <= 0xffffff);    /* larger transfers would require R2T support. */
     Assert(pRequest->cbCDB <= 16);      /* would cause buffer overrun below. */
 
     /* If not in normal state, then the transport connection was dropped. Try
@@ -1896,7 +2120,8 @@ static int iscsiCommand(PISCSIIMAGE pImage, PSCSIREQ pRequest)
     if (pImage->state == ISCSISTATE_NORMAL)
     {
         /*
-         * Send SCSI command to target with all I2T data included.
+         * Send SCSI command to target with as much I2T data included as
+         * allowed, the target asks for the rest with R2Ts.
          */
         cbData = 0;
         if (pRequest->enmXfer == SCSIXFER_FROM_TARGET)
@@ -1906,11 +2131,14 @@ static int iscsiCommand(PISCSIIMAGE pImage, PSCSIREQ pRequest)
 
         RTSemMutexRequest(pImage->Mutex, RT_INDEFINITE_WAIT);
 
+        if (pImage->fImmediateData)
+            cbImmediate = RT_MIN(pRequest->cbI2TData, RT_MIN(pImage->cbFirstBurstLength, pImage->cbSendDataLength));
+
         itt = iscsiNewITT(pImage);
         memset(aReqBHS, 0, sizeof(aReqBHS));
         aReqBHS[0] = RT_H2N_U32(    ISCSI_FINAL_BIT | ISCSI_TASK_ATTR_SIMPLE | ISCSIOP_SCSI_CMD
                                 |   (pRequest->enmXfer << 21)); /* I=0,F=1,Attr=Simple */
-        aReqBHS[1] = RT_H2N_U32(0x00000000 | ((uint32_t)pRequest->cbI2TData & 0xffffff)); /* TotalAHSLength=0 */
+        aReqBHS[1] = RT_H2N_U32(0x00000000 | ((uint32_t)cbImmediate & 0xffffff)); /* TotalAHSLength=0 */
         aReqBHS[2] = RT_H2N_U32(pImage->LUN >> 32);
         aReqBHS[3] = RT_H2N_U32(pImage->LUN & 0xffffffff);
         aReqBHS[4] = itt;
@@ -1924,12 +2152,11 @@ static int iscsiCommand(PISCSIIMAGE pImage, PSCSIREQ pRequest)
         aISCSIReq[cnISCSIReq].cbSeg = sizeof(aReqBHS);
         cnISCSIReq++;
 
-        if (    pRequest->enmXfer == SCSIXFER_TO_TARGET
-            ||  pRequest->enmXfer == SCSIXFER_TO_FROM_TARGET)
+        if (cbImmediate)
         {
             Assert(pRequest->cI2TSegs == 1);
             aISCSIReq[cnISCSIReq].pcvSeg = pRequest->paI2TSegs[0].pvSeg;
-            aISCSIReq[cnISCSIReq].cbSeg = pRequest->paI2TSegs[0].cbSeg;  /* Padding done by transport. */
+            aISCSIReq[cnISCSIReq].cbSeg = cbImmediate;  /* Padding done by transport. */
             cnISCSIReq++;
         }
 
@@ -2053,6 +2280,44 @@ static int iscsiCommand(PISCSIIMAGE pImage, PSCSIREQ pRequest)
                         break;
                     }
                 }
+                else if (cmd == ISCSIOP_R2T)
+                {
+                    /* The target asks for (more) data, send it in as many Data-Out PDUs
+                     * as the negotiated segment length requires. */
+                    uint32_t offBuffer = RT_N2H_U32(aResBHS[10]);
+                    uint32_t cbXfer = RT_N2H_U32(aResBHS[11]);
+                    uint32_t DataSN = 0;
+
+                    if (   pRequest->enmXfer != SCSIXFER_TO_TARGET
+                        || offBuffer > pRequest->cbI2TData
+                        || cbXfer > pRequest->cbI2TData - offBuffer)
+                    {
+                        rc = VERR_PARSE_ERROR;
+                        break;
+                    }
+
+                    while (   cbXfer
+                           && RT_SUCCESS(rc))
+                    {
+                        ISCSIREQ aDataOutReq[2];
+                        uint32_t aDataOutBHS[12];
+                        uint32_t cbPDU = RT_MIN(cbXfer, pImage->cbSendDataLength);
+
+                        iscsiDataOutBHSInit(pImage, aDataOutBHS, itt, aResBHS[5], DataSN, offBuffer,
+                                            cbPDU, cbPDU == cbXfer);
+                        aDataOutReq[0].pcvSeg = aDataOutBHS;
+                        aDataOutReq[0].cbSeg = sizeof(aDataOutBHS);
+                        aDataOutReq[1].pcvSeg = (const uint8_t *)pRequest->paI2TSegs[0].pvSeg + offBuffer;
+                        aDataOutReq[1].cbSeg = cbPDU;   /* Padding done by transport. */
+
+                        rc = iscsiSendPDU(pImage, aDataOutReq, RT_ELEMENTS(aDataOutReq), ISCSIPDU_NO_REATTACH);
+                        DataSN++;
+                        offBuffer += cbPDU;
+                        cbXfer -= cbPDU;
+                    }
+                    if (RT_FAILURE(rc))
+                        break;
+                }
                 else
                 {
                     rc = VERR_PARSE_ERROR;
@@ -2173,6 +2438,19 @@ static int iscsiRecvPDU(PISCSIIMAGE pImage, uint32_t itt, PISCSIRES paRes, uint3
         aResBuf.pvSeg = pImage->pvRecvPDUBuf;
         aResBuf.cbSeg = pImage->cbRecvPDUBuf;
         rc = iscsiTransportRead(pImage, &aResBuf, 1);
+        if (RT_SUCCESS(rc))
+        {
+            rc = iscsiRecvPDUDigestsCheck(pImage, &aResBuf);
+            if (RT_FAILURE(rc))
+            {
+                /* Without error recovery the connection has to be dropped, handle it like a broken one. */
+                iscsiLogRel(pImage, "iSCSI: Digest error on PDU received from target %s, reconnecting\n",
+                            pImage->pszTargetName);
+                iscsiTransportClose(pImage);
+                pImage->state = ISCSISTATE_FREE;
+                rc = VERR_BROKEN_PIPE;
+            }
+        }
         if (RT_FAILURE(rc))
         {
             if (rc == VERR_BROKEN_PIPE || rc == VERR_NET_CONNECTION_REFUSED)
@@ -2370,6 +2648,104 @@ static void iscsiPDUTxAdd(PISCSIIMAGE pImage, PISCSIPDUTX pIScsiPDUTx, bool fFro
     }
 }
 
+/**
+ * Links a chain of Data-Out PDUs into the transmit list.
+ *
+ * Data-Out PDUs are not subject to the command window and must not wait behind
+ * new commands (which might wait for the very command to complete), so they are
+ * queued in front of all commands but after any Data-Out PDUs already waiting to
+ * keep the data sequences in order.
+ *
+ * @param   pImage      The iSCSI connection state to be used.
+ * @param   pHead       Head of the Data-Out PDU chain.
+ * @param   pTail       Tail of the Data-Out PDU chain.
+ */
+static void iscsiPDUTxAddDataOut(PISCSIIMAGE pImage, PISCSIPDUTX pHead, PISCSIPDUTX pTail)
+{
+    PISCSIPDUTX pPrev = NULL;
+
+    for (PISCSIPDUTX pCur = pImage->pIScsiPDUTxHead; pCur; pCur = pCur->pNext)
+        if (pCur->fDataOut)
+            pPrev = pCur;
+
+    if (pPrev)
+    {
+        pTail->pNext = pPrev->pNext;
+        pPrev->pNext = pHead;
+    }
+    else
+    {
+        pTail->pNext = pImage->pIScsiPDUTxHead;
+        pImage->pIScsiPDUTxHead = pHead;
+    }
+    if (!pTail->pNext)
+        pImage->pIScsiPDUTxTail = pTail;
+}
+
+/**
+ * Sets up the S/G list of a PDU to transmit, consisting of the already initialized
+ * BHS, the header digest, the given amount of data, padding and the data digest.
+ *
+ * @param   pImage      The iSCSI connection state to be used.
+ * @param   pIScsiPDU   The PDU, aISCSIReq must have room for cDataSegsMax + 4 entries.
+ * @param   pSgBuf      The S/G buffer to take the data from, NULL if there is no data.
+ * @param   cbData      Number of bytes to take from the S/G buffer.
+ * @param   cDataSegsMax Maximum number of data segments.
+ */
+static void iscsiPDUTxSetupSegs(PISCSIIMAGE pImage, PISCSIPDUTX pIScsiPDU, PRTSGBUF pSgBuf,
+                                size_t cbData, unsigned cDataSegsMax)
+{
+    unsigned cnISCSIReq = 0;
+    size_t   cbSegs = 0;
+
+    pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = sizeof(pIScsiPDU->aBHS);
+    pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = pIScsiPDU->aBHS;
+    cbSegs += sizeof(pIScsiPDU->aBHS);
+    cnISCSIReq++;
+    /* Padding is not necessary for the BHS. */
+
+    if (pImage->fHeaderDigest)
+    {
+        pIScsiPDU->u32HdrDigest = iscsiDigestCalc(&pIScsiPDU->aISCSIReq[0], 1);
+        pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = sizeof(pIScsiPDU->u32HdrDigest);
+        pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = &pIScsiPDU->u32HdrDigest;
+        cbSegs += sizeof(pIScsiPDU->u32HdrDigest);
+        cnISCSIReq++;
+    }
+
+    if (cbData)
+    {
+        unsigned const iDataFirst = cnISCSIReq;
+        unsigned cDataSegs = cDataSegsMax;
+        size_t cbDataSegs = RTSgBufSegArrayCreate(pSgBuf, &pIScsiPDU->aISCSIReq[cnISCSIReq], &cDataSegs, cbData);
+        Assert(cbDataSegs == cbData); NOREF(cbDataSegs);
+        cnISCSIReq += cDataSegs;
+        cbSegs += cbData;
+
+        /* Add padding if necessary. */
+        if (cbData & 3)
+        {
+            pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = &pImage->aPadding[0];
+            pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = 4 - (cbData & 3);
+            cbSegs += pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg;
+            cnISCSIReq++;
+        }
+
+        if (pImage->fDataDigest)
+        {
+            pIScsiPDU->u32DataDigest = iscsiDigestCalc(&pIScsiPDU->aISCSIReq[iDataFirst], cnISCSIReq - iDataFirst);
+            pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = sizeof(pIScsiPDU->u32DataDigest);
+            pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = &pIScsiPDU->u32DataDigest;
+            cbSegs += sizeof(pIScsiPDU->u32DataDigest);
+            cnISCSIReq++;
+        }
+    }
+
+    pIScsiPDU->cISCSIReq = cnISCSIReq;
+    pIScsiPDU->cbSgLeft  = cbSegs;
+    RTSgBufInit(&pIScsiPDU->SgBuf, pIScsiPDU->aISCSIReq, cnISCSIReq);
+}
+
 /**
  * Receives a PDU in a non blocking way.
  *
@@ -2409,15 +2785,9 @@ static int iscsiRecvPDUAsync(PISCSIIMAGE pImage)
         if (   !pImage->cbRecvPDUResidual
             && pImage->fRecvPDUBHS)
         {
-            size_t cbAHSLength, cbDataLength;
-
             /* If we were reading the BHS first get the actual PDU size now. */
             uint32_t word1 = RT_N2H_U32(((uint32_t *)(pImage->pvRecvPDUBuf))[1]);
-            cbAHSLength = (word1 & 0xff000000) >> 24;
-            cbAHSLength = ((cbAHSLength - 1) | 3) + 1;      /* Add padding. */
-            cbDataLength = word1 & 0x00ffffff;
-            cbDataLength = ((cbDataLength - 1) | 3) + 1;    /* Add padding. */
-            pImage->cbRecvPDUResidual = cbAHSLength + cbDataLength;
+            pImage->cbRecvPDUResidual = iscsiPDUSizeAfterBHS(pImage, word1);
             pImage->fRecvPDUBHS = false; /* Start receiving the rest of the PDU. */
         }
 
@@ -2428,7 +2798,16 @@ static int iscsiRecvPDUAsync(PISCSIIMAGE pImage)
             ISCSIRES aResBuf;
             aResBuf.pvSeg = pImage->pvRecvPDUBuf;
             aResBuf.cbSeg = pImage->cbRecvPDUBuf;
-            rc = iscsiRecvPDUProcess(pImage, &aResBuf, 1);
+            rc = iscsiRecvPDUDigestsCheck(pImage, &aResBuf);
+            if (RT_SUCCESS(rc))
+                rc = iscsiRecvPDUProcess(pImage, &aResBuf, 1);
+            else
+            {
+                /* Without error recovery the connection has to be dropped, the commands get resent. */
+                iscsiLogRel(pImage, "iSCSI: Digest error on PDU received from target %s, reconnecting\n",
+                            pImage->pszTargetName);
+                rc = VERR_BROKEN_PIPE;
+            }
         }
     }
     else
@@ -2454,7 +2833,8 @@ static int iscsiSendPDUAsync(PISCSIIMAGE pImage)
         if (!pImage->pIScsiPDUTxCur)
         {
             if (   !pImage->pIScsiPDUTxHead
-                || serial_number_greater(pImage->pIScsiPDUTxHead->CmdSN, pImage->MaxCmdSN))
+                || (   !pImage->pIScsiPDUTxHead->fDataOut
+                    && serial_number_greater(pImage->pIScsiPDUTxHead->CmdSN, pImage->MaxCmdSN)))
                 break;
 
             pImage->pIScsiPDUTxCur = pImage->pIScsiPDUTxHead;
@@ -2473,14 +2853,19 @@ static int iscsiSendPDUAsync(PISCSIIMAGE pImage)
             RTSgBufAdvance(&pImage->pIScsiPDUTxCur->SgBuf, cbSent);
             if (!pImage->pIScsiPDUTxCur->cbSgLeft)
             {
-                /* PDU completed, free it and place the command on the waiting for response list. */
-                if (pImage->pIScsiPDUTxCur->pIScsiCmd)
+                PISCSIPDUTX pIScsiPDUTx = pImage->pIScsiPDUTxCur;
+                PISCSICMD pIScsiCmd = pIScsiPDUTx->pIScsiCmd;
+
+                pImage->pIScsiPDUTxCur = NULL;
+                if (pIScsiPDUTx->fDataOut)
+                    iscsiCmdDataOutDone(pImage, pIScsiCmd);
+                else if (pIScsiCmd)
                 {
+                    /* PDU completed, place the command on the waiting for response list. */
                     LogFlow(("Sent complete PDU, placing on waiting list\n"));
-                    iscsiCmdInsert(pImage, pImage->pIScsiPDUTxCur->pIScsiCmd);
+                    iscsiCmdInsert(pImage, pIScsiCmd);
                 }
-                RTMemFree(pImage->pIScsiPDUTxCur);
-                pImage->pIScsiPDUTxCur = NULL;
+                RTMemFree(pIScsiPDUTx);
             }
         }
     } while (   RT_SUCCESS(rc)
@@ -2587,13 +2972,12 @@ static int iscsiRecvPDUProcess(PISCSIIMAGE pImage, PISCSIRES paRes, uint32_t cnR
                     && RT_N2H_U32(pcvResSeg[5]) != ISCSI_TASK_TAG_RSVD)
                 {
                     PISCSIPDUTX pIScsiPDUTx;
-                    uint32_t cnISCSIReq;
                     uint32_t *paReqBHS;
 
                     LogFlowFunc(("Sending NOP-Out\n"));
 
                     /* Allocate a new PDU initialize it and put onto the waiting list. */
-                    pIScsiPDUTx = (PISCSIPDUTX)RTMemAllocZ(sizeof(ISCSIPDUTX));
+                    pIScsiPDUTx = (PISCSIPDUTX)RTMemAllocZ(RT_OFFSETOF(ISCSIPDUTX, aISCSIReq[4]));
                     if (!pIScsiPDUTx)
                     {
                         rc = VERR_NO_MEMORY;
@@ -2613,12 +2997,7 @@ static int iscsiRecvPDUProcess(PISCSIIMAGE pImage, PISCSIRES paRes, uint32_t cnR
                     paReqBHS[10] = 0;            /* reserved */
                     paReqBHS[11] = 0;            /* reserved */
 
-                    cnISCSIReq = 0;
-                    pIScsiPDUTx->aISCSIReq[cnISCSIReq].pvSeg = paReqBHS;
-                    pIScsiPDUTx->aISCSIReq[cnISCSIReq].cbSeg = sizeof(pIScsiPDUTx->aBHS);
-                    cnISCSIReq++;
-                    pIScsiPDUTx->cbSgLeft = sizeof(pIScsiPDUTx->aBHS);
-                    RTSgBufInit(&pIScsiPDUTx->SgBuf, pIScsiPDUTx->aISCSIReq, cnISCSIReq);
+                    iscsiPDUTxSetupSegs(pImage, pIScsiPDUTx, NULL /* pSgBuf */, 0 /* cbData */, 0 /* cDataSegsMax */);
 
                     /*
                      * Link the PDU to the list.
@@ -2723,8 +3102,16 @@ static int iscsiValidatePDU(PISCSIRES paRes, uint32_t cnRes)
                 ||  (RT_N2H_U32(pcrgResBHS[4]) != ISCSI_TASK_TAG_RSVD))
                 return VERR_PARSE_ERROR;
             break;
-        case ISCSIOP_SCSI_TASKMGMT_RES:
         case ISCSIOP_R2T:
+            /* R2Ts must not be split into several PDUs, may not contain any data and must
+             * ask for some data of a valid task. */
+            if (    ((hw0 & ISCSI_FINAL_BIT) == 0)
+                ||  (RT_N2H_U32(pcrgResBHS[1]) != 0)
+                ||  (RT_N2H_U32(pcrgResBHS[4]) == ISCSI_TASK_TAG_RSVD)
+                ||  (RT_N2H_U32(pcrgResBHS[11]) == 0))
+                return VERR_PARSE_ERROR;
+            break;
+        case ISCSIOP_SCSI_TASKMGMT_RES:
         case ISCSIOP_REJECT:
         default:
             /* Do some logging, ignore PDU. */
@@ -2748,7 +3135,7 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
     int rc = VINF_SUCCESS;
     uint32_t *paReqBHS;
     size_t cbData = 0;
-    size_t cbSegs = 0;
+    size_t cbImmediate = 0;
     PSCSIREQ pScsiReq;
     PISCSIPDUTX pIScsiPDU = NULL;
 
@@ -2757,17 +3144,18 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
     Assert(pIScsiCmd->enmCmdType == ISCSICMDTYPE_REQ);
 
     pIScsiCmd->Itt = iscsiNewITT(pImage);
+    pIScsiCmd->cDataOutPending  = 0;
+    pIScsiCmd->fCompletePending = false;
     pScsiReq = pIScsiCmd->CmdType.ScsiReq.pScsiReq;
 
     if (pScsiReq->cT2ISegs)
         RTSgBufInit(&pScsiReq->SgBufT2I, pScsiReq->paT2ISegs, pScsiReq->cT2ISegs);
 
     /*
-     * Allocate twice as much entries as required for padding (worst case).
-     * The additional segment is for the BHS.
+     * Allocate enough entries for the BHS, the header digest, the data segments,
+     * the padding and the data digest.
      */
-    size_t cI2TSegs = 2*(pScsiReq->cI2TSegs + 1);
-    pIScsiPDU = (PISCSIPDUTX)RTMemAllocZ(RT_OFFSETOF(ISCSIPDUTX, aISCSIReq[cI2TSegs]));
+    pIScsiPDU = (PISCSIPDUTX)RTMemAllocZ(RT_OFFSETOF(ISCSIPDUTX, aISCSIReq[pScsiReq->cI2TSegs + 4]));
     if (!pIScsiPDU)
         return VERR_NO_MEMORY;
 
@@ -2778,12 +3166,17 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
     else
         cbData = (uint32_t)pScsiReq->cbI2TData;
 
+    /* Send as much data as allowed along with the command (bounded by the first burst and the
+     * target's MaxRecvDataSegmentLength), the target asks for the rest with R2Ts. */
+    if (pImage->fImmediateData)
+        cbImmediate = RT_MIN(pScsiReq->cbI2TData, RT_MIN(pImage->cbFirstBurstLength, pImage->cbSendDataLength));
+
     paReqBHS = pIScsiPDU->aBHS;
 
     /* Setup the BHS. */
     paReqBHS[0] = RT_H2N_U32(  ISCSI_FINAL_BIT | ISCSI_TASK_ATTR_SIMPLE | ISCSIOP_SCSI_CMD
                              | (pScsiReq->enmXfer << 21)); /* I=0,F=1,Attr=Simple */
-    paReqBHS[1] = RT_H2N_U32(0x00000000 | ((uint32_t)pScsiReq->cbI2TData & 0xffffff)); /* TotalAHSLength=0 */
+    paReqBHS[1] = RT_H2N_U32(0x00000000 | ((uint32_t)cbImmediate & 0xffffff)); /* TotalAHSLength=0 */
     paReqBHS[2] = RT_H2N_U32(pImage->LUN >> 32);
     paReqBHS[3] = RT_H2N_U32(pImage->LUN & 0xffffffff);
     paReqBHS[4] = pIScsiCmd->Itt;
@@ -2796,38 +3189,15 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
     pImage->CmdSN++;
 
     /* Setup the S/G buffers. */
-    uint32_t cnISCSIReq = 0;
-    pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = sizeof(pIScsiPDU->aBHS);
-    pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = pIScsiPDU->aBHS;
-    cnISCSIReq++;
-    cbSegs = sizeof(pIScsiPDU->aBHS);
-    /* Padding is not necessary for the BHS. */
-
-    if (pScsiReq->cbI2TData)
+    if (cbImmediate)
     {
-        for (unsigned cSeg = 0; cSeg < pScsiReq->cI2TSegs; cSeg++)
-        {
-            Assert(cnISCSIReq < cI2TSegs);
-            pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = pScsiReq->paI2TSegs[cSeg].cbSeg;
-            pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = pScsiReq->paI2TSegs[cSeg].pvSeg;
-            cbSegs += pScsiReq->paI2TSegs[cSeg].cbSeg;
-            cnISCSIReq++;
+        RTSGBUF SgBufI2T;
 
-            /* Add padding if necessary. */
-            if (pScsiReq->paI2TSegs[cSeg].cbSeg & 3)
-            {
-                Assert(cnISCSIReq < cI2TSegs);
-                pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = &pImage->aPadding[0];
-                pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = 4 - (pScsiReq->paI2TSegs[cSeg].cbSeg & 3);
-                cbSegs += pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg;
-                cnISCSIReq++;
-            }
-        }
+        RTSgBufInit(&SgBufI2T, pScsiReq->paI2TSegs, pScsiReq->cI2TSegs);
+        iscsiPDUTxSetupSegs(pImage, pIScsiPDU, &SgBufI2T, cbImmediate, pScsiReq->cI2TSegs);
     }
-
-    pIScsiPDU->cISCSIReq = cnISCSIReq;
-    pIScsiPDU->cbSgLeft  = cbSegs;
-    RTSgBufInit(&pIScsiPDU->SgBuf, pIScsiPDU->aISCSIReq, cnISCSIReq);
+    else
+        iscsiPDUTxSetupSegs(pImage, pIScsiPDU, NULL /* pSgBuf */, 0 /* cbData */, 0 /* cDataSegsMax */);
 
     /* Link the PDU to the list. */
     iscsiPDUTxAdd(pImage, pIScsiPDU, false /* fFront */);
@@ -2840,6 +3210,139 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
 }
 
 
+/**
+ * Queues the Data-Out PDUs answering a R2T received for the given command.
+ *
+ * @returns VBox status code.
+ * @param   pImage      The iSCSI connection state to be used.
+ * @param   pIScsiCmd   The iSCSI command the R2T is for.
+ * @param   paResBHS    The BHS of the R2T PDU.
+ */
+static int iscsiR2TProcess(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, const uint32_t *paResBHS)
+{
+    int rc = VINF_SUCCESS;
+    PSCSIREQ pScsiReq = pIScsiCmd->CmdType.ScsiReq.pScsiReq;
+    uint32_t offBuffer = RT_N2H_U32(paResBHS[10]);
+    uint32_t cbXfer = RT_N2H_U32(paResBHS[11]);
+    uint32_t DataSN = 0;
+    PISCSIPDUTX pHead = NULL;
+    PISCSIPDUTX pTail = NULL;
+    RTSGBUF SgBufI2T;
+
+    LogFlowFunc(("pImage=%#p pIScsiCmd=%#p offBuffer=%u cbXfer=%u\n", pImage, pIScsiCmd, offBuffer, cbXfer));
+
+    if (   pScsiReq->enmXfer != SCSIXFER_TO_TARGET
+        || offBuffer > pScsiReq->cbI2TData
+        || cbXfer > pScsiReq->cbI2TData - offBuffer
+        || pIScsiCmd->fCompletePending)
+        return VERR_PARSE_ERROR;
+
+    RTSgBufInit(&SgBufI2T, pScsiReq->paI2TSegs, pScsiReq->cI2TSegs);
+    RTSgBufAdvance(&SgBufI2T, offBuffer);
+
+    while (cbXfer)
+    {
+        uint32_t cbPDU = RT_MIN(cbXfer, pImage->cbSendDataLength);
+        unsigned cDataSegs = 0;
+
+        RTSgBufSegArrayCreate(&SgBufI2T, NULL, &cDataSegs, cbPDU);
+        PISCSIPDUTX pIScsiPDU = (PISCSIPDUTX)RTMemAllocZ(RT_OFFSETOF(ISCSIPDUTX, aISCSIReq[cDataSegs + 4]));
+        if (!pIScsiPDU)
+        {
+            rc = VERR_NO_MEMORY;
+            break;
+        }
+
+        pIScsiPDU->pIScsiCmd = pIScsiCmd;
+        pIScsiPDU->fDataOut  = true;
+        iscsiDataOutBHSInit(pImage, pIScsiPDU->aBHS, pIScsiCmd->Itt, paResBHS[5], DataSN, offBuffer,
+                            cbPDU, cbPDU == cbXfer);
+        iscsiPDUTxSetupSegs(pImage, pIScsiPDU, &SgBufI2T, cbPDU, cDataSegs);
+
+        if (pTail)
+            pTail->pNext = pIScsiPDU;
+        else
+            pHead = pIScsiPDU;
+        pTail = pIScsiPDU;
+
+        DataSN++;
+        offBuffer += cbPDU;
+        cbXfer -= cbPDU;
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        pIScsiCmd->cDataOutPending += DataSN;
+        iscsiPDUTxAddDataOut(pImage, pHead, pTail);
+
+        /* Start transfer of a PDU if there is no one active at the moment. */
+        if (!pImage->pIScsiPDUTxCur)
+            rc = iscsiSendPDUAsync(pImage);
+    }
+    else
+    {
+        while (pHead)
+        {
+            PISCSIPDUTX pFree = pHead;
+            pHead = pHead->pNext;
+            RTMemFree(pFree);
+        }
+    }
+
+    return rc;
+}
+
+
+/**
+ * Completes a command the target sent the final response for. Any Data-Out PDUs
+ * still queued for the command are dropped, if one is being sent right now the
+ * completion is deferred until it is out as it references the request data.
+ *
+ * @param   pImage      iSCSI connection state to use.
+ * @param   pIScsiCmd   The command to complete.
+ * @param   rcCmd       The status code to complete the command with.
+ */
+static void iscsiCmdCompleteFromTarget(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, int rcCmd)
+{
+    if (pIScsiCmd->cDataOutPending)
+    {
+        PISCSIPDUTX pPrev = NULL;
+        PISCSIPDUTX pCur = pImage->pIScsiPDUTxHead;
+
+        while (pCur)
+        {
+            PISCSIPDUTX pNext = pCur->pNext;
+
+            if (   pCur->fDataOut
+                && pCur->pIScsiCmd == pIScsiCmd)
+            {
+                if (pPrev)
+                    pPrev->pNext = pNext;
+                else
+                    pImage->pIScsiPDUTxHead = pNext;
+                if (pImage->pIScsiPDUTxTail == pCur)
+                    pImage->pIScsiPDUTxTail = pPrev;
+                pIScsiCmd->cDataOutPending--;
+                RTMemFree(pCur);
+            }
+            else
+                pPrev = pCur;
+            pCur = pNext;
+        }
+    }
+
+    if (!pIScsiCmd->cDataOutPending)
+        iscsiCmdComplete(pImage, pIScsiCmd, rcCmd);
+    else
+    {
+        Assert(pImage->pIScsiPDUTxCur && pImage->pIScsiPDUTxCur->pIScsiCmd == pIScsiCmd);
+        iscsiCmdRemove(pImage, pIScsiCmd->Itt);
+        pIScsiCmd->fCompletePending  = true;
+        pIScsiCmd->rcCompletePending = rcCmd;
+    }
+}
+
+
 /**
  * Updates the state of a request from the PDU we received.
  *
@@ -2912,7 +3415,7 @@ static int iscsiRecvPDUUpdateRequest(PISCSIIMAGE pImage, PISCSIRES paRes, uint32
                 else
                     pScsiReq->cbSense = 0;
             }
-            iscsiCmdComplete(pImage, pIScsiCmd, rc);
+            iscsiCmdCompleteFromTarget(pImage, pIScsiCmd, rc);
         }
         else if (cmd == ISCSIOP_SCSI_DATA_IN)
         {
@@ -2939,10 +3442,15 @@ static int iscsiRecvPDUUpdateRequest(PISCSIIMAGE pImage, PISCSIRES paRes, uint32
                 {
                     pScsiReq->status = RT_N2H_U32(paResBHS[0]) & 0x000000ff;
                     pScsiReq->cbSense = 0;
-                    iscsiCmdComplete(pImage, pIScsiCmd, VINF_SUCCESS);
+                    iscsiCmdCompleteFromTarget(pImage, pIScsiCmd, VINF_SUCCESS);
                 }
             }
         }
+        else if (cmd == ISCSIOP_R2T)
+        {
+            /* The target is ready to receive (more) data for a write. */
+            rc = iscsiR2TProcess(pImage, pIScsiCmd, paResBHS);
+        }
         else
             rc = VERR_PARSE_ERROR;
     }
@@ -3167,21 +3675,34 @@ static int iscsiUpdateParameters(PISCSIIMAGE pImage, const uint8_t *pbBuf, size_
     const char *pcszMaxRecvDataSegmentLength = NULL;
     const char *pcszMaxBurstLength = NULL;
     const char *pcszFirstBurstLength = NULL;
-    rc = iscsiTextGetKeyValue(pbBuf, cbBuf, "MaxRecvDataSegmentLength", &pcszMaxRecvDataSegmentLength);
-    if (rc == VERR_INVALID_NAME)
-        rc = VINF_SUCCESS;
-    if (RT_FAILURE(rc))
-        return VERR_PARSE_ERROR;
-    rc = iscsiTextGetKeyValue(pbBuf, cbBuf, "MaxBurstLength", &pcszMaxBurstLength);
-    if (rc == VERR_INVALID_NAME)
-        rc = VINF_SUCCESS;
-    if (RT_FAILURE(rc))
-        return VERR_PARSE_ERROR;
-    rc = iscsiTextGetKeyValue(pbBuf, cbBuf, "FirstBurstLength", &pcszFirstBurstLength);
-    if (rc == VERR_INVALID_NAME)
-        rc = VINF_SUCCESS;
-    if (RT_FAILURE(rc))
-        return VERR_PARSE_ERROR;
+    const char *pcszMaxOutstandingR2T = NULL;
+    const char *pcszImmediateData = NULL;
+    const char *pcszHeaderDigest = NULL;
+    const char *pcszDataDigest = NULL;
+    struct
+    {
+        const char  *pszKey;
+        const char **ppcszValue;
+    } const aKeys[] =
+    {
+        { "MaxRecvDataSegmentLength", &pcszMaxRecvDataSegmentLength },
+        { "MaxBurstLength",           &pcszMaxBurstLength },
+        { "FirstBurstLength",         &pcszFirstBurstLength },
+        { "MaxOutstandingR2T",        &pcszMaxOutstandingR2T },
+        { "ImmediateData",            &pcszImmediateData },
+        { "HeaderDigest",             &pcszHeaderDigest },
+        { "DataDigest",               &pcszDataDigest }
+    };
+
+    for (unsigned i = 0; i < RT_ELEMENTS(aKeys); i++)
+    {
+        rc = iscsiTextGetKeyValue(pbBuf, cbBuf, aKeys[i].pszKey, aKeys[i].ppcszValue);
+        if (rc == VERR_INVALID_NAME)
+            rc = VINF_SUCCESS;
+        if (RT_FAILURE(rc))
+            return VERR_PARSE_ERROR;
+    }
+
     if (pcszMaxRecvDataSegmentLength)
     {
         uint32_t cb = pImage->cbSendDataLength;
@@ -3191,18 +3712,31 @@ static int iscsiUpdateParameters(PISCSIIMAGE pImage, const uint8_t *pbBuf, size_
     }
     if (pcszMaxBurstLength)
     {
-        uint32_t cb = pImage->cbSendDataLength;
+        uint32_t cb = pImage->cbMaxBurstLength;
         rc = RTStrToUInt32Full(pcszMaxBurstLength, 0, &cb);
         AssertRC(rc);
-        pImage->cbSendDataLength = RT_MIN(pImage->cbSendDataLength, cb);
+        pImage->cbMaxBurstLength = RT_MIN(pImage->cbMaxBurstLength, cb);
     }
     if (pcszFirstBurstLength)
     {
-        uint32_t cb = pImage->cbSendDataLength;
+        uint32_t cb = pImage->cbFirstBurstLength;
         rc = RTStrToUInt32Full(pcszFirstBurstLength, 0, &cb);
         AssertRC(rc);
-        pImage->cbSendDataLength = RT_MIN(pImage->cbSendDataLength, cb);
+        pImage->cbFirstBurstLength = RT_MIN(pImage->cbFirstBurstLength, cb);
+    }
+    if (pcszMaxOutstandingR2T)
+    {
+        uint32_t c = pImage->cMaxOutstandingR2T;
+        rc = RTStrToUInt32Full(pcszMaxOutstandingR2T, 0, &c);
+        AssertRC(rc);
+        pImage->cMaxOutstandingR2T = RT_MIN(pImage->cMaxOutstandingR2T, c);
     }
+    if (pcszImmediateData)
+        pImage->fImmediateData = pImage->fImmediateData && !strcmp(pcszImmediateData, "Yes");
+    if (pcszHeaderDigest)
+        pImage->fHeaderDigestPending = !strcmp(pcszHeaderDigest, "CRC32C");
+    if (pcszDataDigest)
+        pImage->fDataDigestPending = !strcmp(pcszDataDigest, "CRC32C");
     return VINF_SUCCESS;
 }
 
@@ -3326,6 +3860,25 @@ static void iscsiCmdComplete(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, int rcCmd)
     RTMemFree(pIScsiCmd);
 }
 
+/**
+ * Accounts for a Data-Out PDU of the given command which was sent or dropped.
+ *
+ * If the target completed the command already it is completed now that no PDU
+ * references the request data anymore. Otherwise the command is still in the
+ * table of waiting commands (and gets resent from there after a reconnect).
+ *
+ * @param   pImage      iSCSI connection state.
+ * @param   pIScsiCmd   The command the Data-Out PDU belongs to.
+ */
+static void iscsiCmdDataOutDone(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
+{
+    Assert(pIScsiCmd->cDataOutPending > 0);
+    pIScsiCmd->cDataOutPending--;
+    if (   !pIScsiCmd->cDataOutPending
+        && pIScsiCmd->fCompletePending)
+        iscsiCmdComplete(pImage, pIScsiCmd, pIScsiCmd->rcCompletePending);
+}
+
 /**
  * Clears all RX/TX PDU states and returns the command for the current
  * pending TX PDU if existing.
@@ -3352,7 +3905,9 @@ static PISCSICMD iscsiPDURxTxClear(PISCSIIMAGE pImage)
         pImage->pIScsiPDUTxHead = pIScsiPDUTx->pNext;
 
         PISCSICMD pIScsiCmd = pIScsiPDUTx->pIScsiCmd;
-        if (pIScsiCmd)
+        if (pIScsiPDUTx->fDataOut)
+            iscsiCmdDataOutDone(pImage, pIScsiCmd);
+        else if (pIScsiCmd)
         {
             /* Place on command list. */
             pIScsiCmd->pNext = pIScsiCmdHead;
@@ -3371,7 +3926,9 @@ static PISCSICMD iscsiPDURxTxClear(PISCSIIMAGE pImage)
 
         pImage->pIScsiPDUTxCur = NULL;
         PISCSICMD pIScsiCmd = pIScsiPDUTx->pIScsiCmd;
-        if (pIScsiCmd)
+        if (pIScsiPDUTx->fDataOut)
+            iscsiCmdDataOutDone(pImage, pIScsiCmd);
+        else if (pIScsiCmd)
         {
             pIScsiCmd->pNext = pIScsiCmdHead;
             pIScsiCmdHead = pIScsiCmd;
@@ -4012,13 +4569,23 @@ static int iscsiOpenImageParseCfg(PISCSIIMAGE pImage)
     char *pszLUN = NULL, *pszLUNInitial = NULL;
     bool fLunEncoded = false;
     uint32_t uWriteSplitDef = 0;
+    uint32_t uMaxBurstLengthDef = 0;
+    uint32_t uMaxOutstandingR2TDef = 0;
     uint32_t uTimeoutDef = 0;
+    bool fDigestDef = false;
     uint64_t uCfgTmp = 0;
     bool fHostIPDef = false;
     bool fDumpMalformedPacketsDef = false;
 
     int rc = RTStrToUInt32Full(s_iscsiConfigDefaultWriteSplit, 0, &uWriteSplitDef);
     AssertRC(rc);
+    rc = RTStrToUInt32Full(s_iscsiConfigDefaultMaxBurstLength, 0, &uMaxBurstLengthDef);
+    AssertRC(rc);
+    rc = RTStrToUInt32Full(s_iscsiConfigDefaultMaxOutstandingR2T, 0, &uMaxOutstandingR2TDef);
+    AssertRC(rc);
+    rc = RTStrToUInt64Full(s_iscsiConfigDefaultDigest, 0, &uCfgTmp);
+    AssertRC(rc);
+    fDigestDef = RT_BOOL(uCfgTmp);
     rc = RTStrToUInt32Full(s_iscsiConfigDefaultTimeout, 0, &uTimeoutDef);
     AssertRC(rc);
     rc = RTStrToUInt64Full(s_iscsiConfigDefaultHostIPStack, 0, &uCfgTmp);
@@ -4040,6 +4607,10 @@ static int iscsiOpenImageParseCfg(PISCSIIMAGE pImage)
                            "TargetUsername\0"
                            "TargetSecret\0"
                            "WriteSplit\0"
+                           "MaxBurstLength\0"
+                           "MaxOutstandingR2T\0"
+                           "HeaderDigest\0"
+                           "DataDigest\0"
                            "Timeout\0"
                            "HostIPStack\0"
                            "DumpMalformedPackets\0"))
@@ -4124,6 +4695,26 @@ static int iscsiOpenImageParseCfg(PISCSIIMAGE pImage)
     if (RT_FAILURE(rc))
         return vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("iSCSI: configuration error: failed to read WriteSplit as U32"));
 
+    rc = VDCFGQueryU32Def(pImage->pIfConfig, "MaxBurstLength", &pImage->cbMaxBurstLengthCfg, uMaxBurstLengthDef);
+    if (RT_FAILURE(rc))
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("iSCSI: configuration error: failed to read MaxBurstLength as U32"));
+    pImage->cbMaxBurstLengthCfg = RT_MAX(pImage->cbMaxBurstLengthCfg, 512);
+    pImage->cbMaxBurstLengthCfg = RT_MIN(pImage->cbMaxBurstLengthCfg, ISCSI_BURST_LENGTH_MAX);
+
+    rc = VDCFGQueryU32Def(pImage->pIfConfig, "MaxOutstandingR2T", &pImage->cMaxOutstandingR2TCfg, uMaxOutstandingR2TDef);
+    if (RT_FAILURE(rc))
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("iSCSI: configuration error: failed to read MaxOutstandingR2T as U32"));
+    pImage->cMaxOutstandingR2TCfg = RT_MAX(pImage->cMaxOutstandingR2TCfg, 1);
+    pImage->cMaxOutstandingR2TCfg = RT_MIN(pImage->cMaxOutstandingR2TCfg, 65535);
+
+    rc = VDCFGQueryBoolDef(pImage->pIfConfig, "HeaderDigest", &pImage->fHeaderDigestCfg, fDigestDef);
+    if (RT_FAILURE(rc))
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("iSCSI: configuration error: failed to read HeaderDigest as boolean"));
+
+    rc = VDCFGQueryBoolDef(pImage->pIfConfig, "DataDigest", &pImage->fDataDigestCfg, fDigestDef);
+    if (RT_FAILURE(rc))
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("iSCSI: configuration error: failed to read DataDigest as boolean"));
+
     /* Query the iSCSI lower level configuration. */
     rc = VDCFGQueryU32Def(pImage->pIfConfig, "Timeout", &pImage->uReadTimeout, uTimeoutDef);
     if (RT_FAILURE(rc))
@@ -4805,9 +5396,10 @@ static DECLCALLBACK(int) iscsiRead(void *pBackendData, uint64_t uOffset, size_t
         return VERR_INVALID_PARAMETER;
 
     /*
-     * Clip read size to a value which is supported by the target.
+     * Clip read size to the negotiated burst length, the target splits
+     * the data into several Data-In PDUs if required.
      */
-    cbToRead = RT_MIN(cbToRead, pImage->cbRecvDataLength);
+    cbToRead = RT_MIN(cbToRead, pImage->cbMaxBurstLength);
 
     unsigned cT2ISegs = 0;
     size_t   cbSegs = 0;
@@ -4932,9 +5524,10 @@ static DECLCALLBACK(int) iscsiWrite(void *pBackendData, uint64_t uOffset, size_t
         return VERR_INVALID_PARAMETER;
 
     /*
-     * Clip read size to a value which is supported by the target.
+     * Clip write size to the negotiated burst length and the configured limit,
+     * anything not sent as immediate data is requested by the target with R2Ts.
      */
-    cbToWrite = RT_MIN(cbToWrite, pImage->cbSendDataLength);
+    cbToWrite = RT_MIN(cbToWrite, RT_MIN(pImage->cbMaxBurstLength, pImage->cbWriteSplit));
 
     unsigned cI2TSegs = 0;
     size_t   cbSegs = 0;
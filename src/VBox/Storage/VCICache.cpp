@@ -2038,6 +2038,14 @@ const VDCACHEBACKEND g_VciCacheBackend =
     NULL,
     /* pfnComposeName */
     NULL,
+    /* pfnWriteBack */
+    NULL,
+    /* pfnDirtyRead */
+    NULL,
+    /* pfnDirtyClear */
+    NULL,
+    /* pfnReclaim */
+    NULL,
     /* u32VersionEnd */
     VD_CACHEBACKEND_VERSION
 };
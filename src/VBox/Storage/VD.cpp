@@ -159,6 +159,11 @@ typedef struct VDCACHE
     PVDINTERFACE        pVDIfsCache;
     /** I/O related things. */
     VDIO                VDIo;
+
+    /** Where the next destage run starts, the dirty data is written round robin. */
+    uint64_t            offDestage;
+    /** Statistics, updated atomically. */
+    VDCACHESTATS        Stats;
 } VDCACHE, *PVDCACHE;
 
 /**
@@ -490,6 +495,9 @@ typedef struct VDIOCTX
  * multiple times.
  */
 #define VDIOCTX_FLAGS_WRITE_FILTER_APPLIED   RT_BIT_32(6)
+/** Write directly to the image even if the cache is in write-back mode.
+ * Used when destaging dirty data from the cache. */
+#define VDIOCTX_FLAGS_WRITE_BYPASS_CACHE     RT_BIT_32(7)
 
 /** NIL I/O context pointer value. */
 #define NIL_VDIOCTX ((PVDIOCTX)0)
@@ -651,7 +659,8 @@ static RTLDRMOD *g_ahCacheBackendPlugins = NULL;
 /** Builtin cache backends. */
 static PCVDCACHEBACKEND aStaticCacheBackends[] =
 {
-    &g_VciCacheBackend
+    &g_VciCacheBackend,
+    &g_VwcCacheBackend
 };
 
 /** Number of supported filter backends. */
@@ -1191,6 +1200,29 @@ static int vdCacheWriteHelper(PVDCACHE pCache, uint64_t uOffset, size_t cbWrite,
     return rc;
 }
 
+/**
+ * Internal: Drops the given range from the cache, used when the range is
+ * discarded or written to the image without going through the cache.
+ *
+ * @param   pCache     The cache, must implement pfnDiscard.
+ * @param   pIoCtx     The I/O context of the request.
+ * @param   uOffset    Offset of the range.
+ * @param   cbRange    Size of the range.
+ */
+static void vdCacheInvalidate(PVDCACHE pCache, PVDIOCTX pIoCtx, uint64_t uOffset, size_t cbRange)
+{
+    size_t cbPreAllocated = 0;
+    size_t cbPostAllocated = 0;
+    size_t cbActuallyDiscarded = 0;
+
+    LogFlowFunc(("pCache=%#p uOffset=%llu cbRange=%zu\n", pCache, uOffset, cbRange));
+
+    int rc = pCache->Backend->pfnDiscard(pCache->pBackendData, pIoCtx, uOffset, cbRange,
+                                         &cbPreAllocated, &cbPostAllocated,
+                                         &cbActuallyDiscarded, NULL, 0);
+    AssertRC(rc); NOREF(rc);
+}
+
 /**
  * Creates a new empty discard state.
  *
@@ -2084,24 +2116,56 @@ static DECLCALLBACK(int) vdReadHelperAsync(PVDIOCTX pIoCtx)
          * stale data when different block sizes are used for the images. */
         cbThisRead = cbToRead;
 
+        /* A write-back cache holds data newer than the last image, so it must
+         * not be used when reading from somewhere else in the chain. */
         if (   pDisk->pCache
-            && !pImageParentOverride)
+            && !pImageParentOverride
+            && (   !(pDisk->pCache->uOpenFlags & VD_OPEN_FLAGS_CACHE_WRITE_BACK)
+                || pIoCtx->Req.Io.pImageStart == pDisk->pLast))
         {
-            rc = vdCacheReadHelper(pDisk->pCache, uOffset, cbThisRead,
+            PVDCACHE pCache = pDisk->pCache;
+
+            rc = vdCacheReadHelper(pCache, uOffset, cbThisRead,
                                    pIoCtx, &cbThisRead);
             if (rc == VERR_VD_BLOCK_FREE)
             {
+                RTSGBUF SgBufStart;
+                RTSgBufClone(&SgBufStart, &pIoCtx->Req.Io.SgBuf);
+
+                ASMAtomicIncU64(&pCache->Stats.cReadMisses);
+                ASMAtomicAddU64(&pCache->Stats.cbReadMiss, cbThisRead);
+
                 rc = vdDiskReadHelper(pDisk, pCurrImage, NULL, uOffset, cbThisRead,
                                       pIoCtx, &cbThisRead);
 
                 /* If the read was successful, write the data back into the cache. */
-                if (   RT_SUCCESS(rc)
+                if (   rc == VINF_SUCCESS
                     && pIoCtx->fFlags & VDIOCTX_FLAGS_READ_UPDATE_CACHE)
                 {
-                    rc = vdCacheWriteHelper(pDisk->pCache, uOffset, cbThisRead,
-                                            pIoCtx, NULL);
+                    /* The read advanced the buffer already, rewind to the data just read. */
+                    RTSGBUF SgBufEnd;
+                    uint32_t cbTransferLeft = pIoCtx->Req.Io.cbTransferLeft;
+
+                    RTSgBufClone(&SgBufEnd, &pIoCtx->Req.Io.SgBuf);
+                    RTSgBufClone(&pIoCtx->Req.Io.SgBuf, &SgBufStart);
+                    ASMAtomicAddU32(&pIoCtx->Req.Io.cbTransferLeft, (uint32_t)cbThisRead);
+
+                    /* Failing to update the cache doesn't fail the read. */
+                    int rc2 = vdCacheWriteHelper(pCache, uOffset, cbThisRead,
+                                                 pIoCtx, NULL);
+                    if (RT_FAILURE(rc2))
+                        LogFlow(("Updating the cache failed with %Rrc\n", rc2));
+
+                    RTSgBufClone(&pIoCtx->Req.Io.SgBuf, &SgBufEnd);
+                    ASMAtomicWriteU32(&pIoCtx->Req.Io.cbTransferLeft, cbTransferLeft);
                 }
             }
+            else if (   RT_SUCCESS(rc)
+                     || rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+            {
+                ASMAtomicIncU64(&pCache->Stats.cReadHits);
+                ASMAtomicAddU64(&pCache->Stats.cbReadHit, cbThisRead);
+            }
         }
         else
         {
@@ -3045,6 +3109,35 @@ static DECLCALLBACK(int) vdWriteHelperAsync(PVDIOCTX pIoCtx)
             break;
         }
 
+        /* A write-back cache takes the data unless it is full or the write destages data from it. */
+        if (   pDisk->pCache
+            && (pDisk->pCache->uOpenFlags & VD_OPEN_FLAGS_CACHE_WRITE_BACK)
+            && !(pIoCtx->fFlags & VDIOCTX_FLAGS_WRITE_BYPASS_CACHE)
+            && pImage == pDisk->pLast)
+        {
+            PVDCACHE pCache = pDisk->pCache;
+
+            rc = pCache->Backend->pfnWriteBack(pCache->pBackendData, uOffset, cbThisWrite,
+                                               pIoCtx, &cbThisWrite);
+            if (rc != VERR_VD_BLOCK_FREE)
+            {
+                if (   RT_SUCCESS(rc)
+                    || rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+                    ASMAtomicAddU64(&pCache->Stats.cbWriteBack, cbThisWrite);
+                cbWrite -= cbThisWrite;
+                uOffset += cbThisWrite;
+                continue;
+            }
+
+            /* No room in the cache, write the range to the image directly. */
+            ASMAtomicAddU64(&pCache->Stats.cbWriteThrough, cbThisWrite);
+        }
+        else if (   pDisk->pCache
+                 && !(pDisk->pCache->uOpenFlags & VD_OPEN_FLAGS_CACHE_WRITE_BACK)
+                 && pDisk->pCache->Backend->pfnDiscard
+                 && pImage == pDisk->pLast)
+            vdCacheInvalidate(pDisk->pCache, pIoCtx, uOffset, cbThisWrite); /* Don't return stale data later. */
+
         fWrite =   (pImage->uOpenFlags & VD_OPEN_FLAGS_HONOR_SAME)
                  ? 0 : VD_WRITE_NO_ALLOC;
         rc = pImage->Backend->pfnWrite(pImage->pBackendData, uOffset, cbThisWrite,
@@ -3189,7 +3282,12 @@ static DECLCALLBACK(int) vdFlushHelperAsync(PVDIOCTX pIoCtx)
                 || rc == VERR_VD_IOCTX_HALT)
             && pDisk->pCache)
         {
+            int rcImage = rc;
+
             rc = pDisk->pCache->Backend->pfnFlush(pDisk->pCache->pBackendData, pIoCtx);
+            /* Keep the disk locked if only the image flush is still pending. */
+            if (RT_SUCCESS(rc) && RT_FAILURE(rcImage))
+                rc = rcImage;
             if (   RT_SUCCESS(rc)
                 || (   rc != VERR_VD_ASYNC_IO_IN_PROGRESS
                     && rc != VERR_VD_IOCTX_HALT))
@@ -3471,6 +3569,11 @@ static DECLCALLBACK(int) vdDiscardHelperAsync(PVDIOCTX pIoCtx)
             LogFlowFunc(("New range descriptor loaded (%u) offStart=%llu cbDiscard=%zu\n",
                          pIoCtx->Req.Discard.idxRange, offStart, cbDiscardLeft));
             pIoCtx->Req.Discard.idxRange++;
+
+            /* The cache must not return (or write back) data for discarded ranges. */
+            if (   pDisk->pCache
+                && pDisk->pCache->Backend->pfnDiscard)
+                vdCacheInvalidate(pDisk->pCache, pIoCtx, offStart, cbDiscardLeft);
         }
 
         /* Look for a matching block in the AVL tree first. */
@@ -3537,6 +3640,155 @@ static DECLCALLBACK(int) vdDiscardHelperAsync(PVDIOCTX pIoCtx)
     return rc;
 }
 
+/**
+ * internal: flush the last image and the cache synchronously.
+ */
+static int vdFlushHelper(PVBOXHDD pDisk)
+{
+    VDIOCTX IoCtx;
+    RTSEMEVENT hEventComplete = NIL_RTSEMEVENT;
+
+    int rc = RTSemEventCreate(&hEventComplete);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    vdIoCtxInit(&IoCtx, pDisk, VDIOCTXTXDIR_FLUSH, 0, 0, pDisk->pLast, NULL,
+                NULL, vdFlushHelperAsync, VDIOCTX_FLAGS_SYNC | VDIOCTX_FLAGS_DONT_FREE);
+
+    IoCtx.Type.Root.pfnComplete = vdIoCtxSyncComplete;
+    IoCtx.Type.Root.pvUser1     = pDisk;
+    IoCtx.Type.Root.pvUser2     = hEventComplete;
+    rc = vdIoCtxProcessSync(&IoCtx, hEventComplete);
+
+    RTSemEventDestroy(hEventComplete);
+    return rc;
+}
+
+/**
+ * internal: write dirty data from a write-back cache to the last image.
+ *
+ * The dirty ranges are collected in a buffer, written to the image and the
+ * image is flushed before the ranges are marked clean in the cache. Otherwise
+ * a host crash could lose data which is neither in the cache nor in the image.
+ *
+ * @returns VBox status code.
+ * @param   pDisk           Pointer to HDD container, the caller holds the write lock.
+ * @param   cbMax           Maximum number of bytes to write, UINT64_MAX for all.
+ * @param   pcbDirtyLeft    Where to store the number of dirty bytes left, optional.
+ */
+static int vdCacheDestage(PVBOXHDD pDisk, uint64_t cbMax, uint64_t *pcbDirtyLeft)
+{
+    PVDCACHE pCache = pDisk->pCache;
+    int rc = VINF_SUCCESS;
+
+    if (   !pCache
+        || !pDisk->pLast
+        || !(pCache->uOpenFlags & VD_OPEN_FLAGS_CACHE_WRITE_BACK))
+    {
+        if (pcbDirtyLeft)
+            *pcbDirtyLeft = 0;
+        return VINF_SUCCESS;
+    }
+
+    size_t const cbBuf = _1M;
+    uint8_t *pbBuf = (uint8_t *)RTMemTmpAlloc(cbBuf);
+    if (!pbBuf)
+        return VERR_NO_MEMORY;
+
+    uint64_t const offStart = pCache->offDestage;
+    bool fWrapped = offStart == 0;
+    uint64_t cbDestaged = 0;
+
+    do
+    {
+        struct
+        {
+            uint64_t uOffset;
+            size_t   cb;
+            uint64_t uToken;
+        } aChunks[32];
+        unsigned cChunks = 0;
+        size_t   cbUsed  = 0;
+
+        /* Collect as much dirty data as fits into the buffer. */
+        while (   cChunks < RT_ELEMENTS(aChunks)
+               && cbBuf - cbUsed >= _64K
+               && cbDestaged + cbUsed < cbMax)
+        {
+            rc = pCache->Backend->pfnDirtyRead(pCache->pBackendData, pCache->offDestage,
+                                               pbBuf + cbUsed, cbBuf - cbUsed,
+                                               &aChunks[cChunks].uOffset, &aChunks[cChunks].cb,
+                                               &aChunks[cChunks].uToken);
+            if (   rc == VERR_NOT_FOUND
+                || (   RT_SUCCESS(rc)
+                    && fWrapped
+                    && offStart
+                    && aChunks[cChunks].uOffset >= offStart))
+            {
+                /* Continue at the beginning of the disk once, everything after offStart is done already. */
+                rc = VINF_SUCCESS;
+                pCache->offDestage = 0;
+                if (fWrapped)
+                    break;
+                fWrapped = true;
+                continue;
+            }
+            if (RT_FAILURE(rc))
+                break;
+
+            pCache->offDestage = aChunks[cChunks].uOffset + aChunks[cChunks].cb;
+            cbUsed += aChunks[cChunks].cb;
+            cChunks++;
+        }
+
+        /* Write the data to the image bypassing the cache. */
+        size_t offBuf = 0;
+        for (unsigned i = 0; i < cChunks && RT_SUCCESS(rc); i++)
+        {
+            rc = vdWriteHelper(pDisk, pDisk->pLast, aChunks[i].uOffset, pbBuf + offBuf, aChunks[i].cb,
+                               VDIOCTX_FLAGS_WRITE_BYPASS_CACHE | VDIOCTX_FLAGS_DONT_SET_MODIFIED_FLAG);
+            offBuf += aChunks[i].cb;
+        }
+
+        if (RT_SUCCESS(rc) && cChunks)
+        {
+            /* The data must be durable in the image before it can leave the cache. */
+            rc = vdFlushHelper(pDisk);
+            for (unsigned i = 0; i < cChunks && RT_SUCCESS(rc); i++)
+                rc = pCache->Backend->pfnDirtyClear(pCache->pBackendData, aChunks[i].uOffset,
+                                                    aChunks[i].cb, aChunks[i].uToken);
+            if (RT_SUCCESS(rc))
+            {
+                cbDestaged += cbUsed;
+                ASMAtomicAddU64(&pCache->Stats.cbDestaged, cbUsed);
+            }
+        }
+
+        if (!cChunks || RT_FAILURE(rc))
+            break;
+    } while (cbDestaged < cbMax);
+
+    RTMemTmpFree(pbBuf);
+
+    if (RT_SUCCESS(rc))
+    {
+        uint64_t cbDirty = 0;
+        rc = pCache->Backend->pfnReclaim(pCache->pBackendData, &cbDirty);
+        if (RT_SUCCESS(rc))
+        {
+            ASMAtomicWriteU64(&pCache->Stats.cbDirty, cbDirty);
+            if (pcbDirtyLeft)
+                *pcbDirtyLeft = cbDirty;
+            /* Make the cleared and evicted slots available. */
+            if (cbDestaged)
+                rc = vdFlushHelper(pDisk);
+        }
+    }
+
+    LogFlowFunc(("returns %Rrc cbDestaged=%llu\n", rc, cbDestaged));
+    return rc;
+}
+
 #ifndef VBOX_HDD_NO_DYNAMIC_BACKENDS
 
 /**
@@ -4065,6 +4317,17 @@ static DECLCALLBACK(int) vdIOSetAllocationSizeFallback(void *pvUser, void *pvSto
     return RTFileSetAllocationSize(pStorage->File, cbSize, RTFILE_ALLOC_SIZE_F_DEFAULT);
 }
 
+/**
+ * VD async I/O interface callback for deallocating a range of the file.
+ */
+static DECLCALLBACK(int) vdIOPunchHoleFallback(void *pvUser, void *pvStorage, uint64_t off, uint64_t cb)
+{
+    RT_NOREF1(pvUser);
+    PVDIIOFALLBACKSTORAGE pStorage = (PVDIIOFALLBACKSTORAGE)pvStorage;
+
+    return RTFilePunchHole(pStorage->File, off, cb);
+}
+
 /**
  * VD async I/O interface callback for a synchronous write to the file.
  */
@@ -4692,6 +4955,16 @@ static DECLCALLBACK(int) vdIOIntSetSize(void *pvUser, PVDIOSTORAGE pIoStorage,
                                            pIoStorage->pStorage, cbSize);
 }
 
+static DECLCALLBACK(int) vdIOIntPunchHole(void *pvUser, PVDIOSTORAGE pIoStorage,
+                                          uint64_t off, uint64_t cb)
+{
+    PVDIO pVDIo = (PVDIO)pvUser;
+    if (!pVDIo->pInterfaceIo->pfnPunchHole)
+        return VERR_NOT_SUPPORTED;
+    return pVDIo->pInterfaceIo->pfnPunchHole(pVDIo->pInterfaceIo->Core.pvUser,
+                                             pIoStorage->pStorage, off, cb);
+}
+
 static DECLCALLBACK(int) vdIOIntSetAllocationSize(void *pvUser, PVDIOSTORAGE pIoStorage,
                                                   uint64_t cbSize, uint32_t fFlags,
                                                   PVDINTERFACEPROGRESS pIfProgress,
@@ -5304,7 +5577,7 @@ static DECLCALLBACK(int) vdIOIntFlush(void *pvUser, PVDIOSTORAGE pIoStorage, PVD
         if (!pMetaXfer)
             return VERR_NO_MEMORY;
 
-        pIoTask = vdIoTaskMetaAlloc(pIoStorage, pfnComplete, pvUser, pMetaXfer);
+        pIoTask = vdIoTaskMetaAlloc(pIoStorage, pfnComplete, pvCompleteUser, pMetaXfer);
         if (!pIoTask)
         {
             RTMemFree(pMetaXfer);
@@ -5563,6 +5836,15 @@ static DECLCALLBACK(int) vdIOIntSetSizeLimited(void *pvUser, PVDIOSTORAGE pIoSto
     return pInterfaceIo->pfnSetSize(NULL, pIoStorage->pStorage, cbSize);
 }
 
+static DECLCALLBACK(int) vdIOIntPunchHoleLimited(void *pvUser, PVDIOSTORAGE pIoStorage,
+                                                 uint64_t off, uint64_t cb)
+{
+    PVDINTERFACEIO pInterfaceIo = (PVDINTERFACEIO)pvUser;
+    if (!pInterfaceIo->pfnPunchHole)
+        return VERR_NOT_SUPPORTED;
+    return pInterfaceIo->pfnPunchHole(NULL, pIoStorage->pStorage, off, cb);
+}
+
 static DECLCALLBACK(int) vdIOIntWriteUserLimited(void *pvUser, PVDIOSTORAGE pStorage,
                                                  uint64_t uOffset, PVDIOCTX pIoCtx,
                                                  size_t cbWrite,
@@ -5739,6 +6021,7 @@ static void vdIfIoFallbackCallbacksSetup(PVDINTERFACEIO pIfIo)
     pIfIo->pfnGetSize             = vdIOGetSizeFallback;
     pIfIo->pfnSetSize             = vdIOSetSizeFallback;
     pIfIo->pfnSetAllocationSize   = vdIOSetAllocationSizeFallback;
+    pIfIo->pfnPunchHole           = vdIOPunchHoleFallback;
     pIfIo->pfnReadSync            = vdIOReadSyncFallback;
     pIfIo->pfnWriteSync           = vdIOWriteSyncFallback;
     pIfIo->pfnFlushSync           = vdIOFlushSyncFallback;
@@ -5764,6 +6047,7 @@ static void vdIfIoIntCallbacksSetup(PVDINTERFACEIOINT pIfIoInt)
     pIfIoInt->pfnGetSize              = vdIOIntGetSize;
     pIfIoInt->pfnSetSize              = vdIOIntSetSize;
     pIfIoInt->pfnSetAllocationSize    = vdIOIntSetAllocationSize;
+    pIfIoInt->pfnPunchHole            = vdIOIntPunchHole;
     pIfIoInt->pfnReadUser             = vdIOIntReadUser;
     pIfIoInt->pfnWriteUser            = vdIOIntWriteUser;
     pIfIoInt->pfnReadMeta             = vdIOIntReadMeta;
@@ -6257,6 +6541,7 @@ VBOXDDU_DECL(int) VDGetFormat(PVDINTERFACE pVDIfsDisk, PVDINTERFACE pVDIfsImage,
     VDIfIoInt.pfnGetModificationTime    = vdIOIntGetModificationTimeLimited;
     VDIfIoInt.pfnGetSize                = vdIOIntGetSizeLimited;
     VDIfIoInt.pfnSetSize                = vdIOIntSetSizeLimited;
+    VDIfIoInt.pfnPunchHole              = vdIOIntPunchHoleLimited;
     VDIfIoInt.pfnReadUser               = vdIOIntReadUserLimited;
     VDIfIoInt.pfnWriteUser              = vdIOIntWriteUserLimited;
     VDIfIoInt.pfnReadMeta               = vdIOIntReadMetaLimited;
@@ -6404,6 +6689,10 @@ VBOXDDU_DECL(int) VDOpen(PVBOXHDD pDisk, const char *pszBackend,
         AssertRC(rc2);
         fLockWrite = true;
         rc = vdDiscardStateDestroy(pDisk);
+        if (RT_FAILURE(rc))
+            break;
+        /* The dirty data in a write-back cache belongs to the image which becomes readonly. */
+        rc = vdCacheDestage(pDisk, UINT64_MAX, NULL);
         if (RT_FAILURE(rc))
             break;
         rc2 = vdThreadFinishWrite(pDisk);
@@ -6744,6 +7033,18 @@ VBOXDDU_DECL(int) VDCacheOpen(PVBOXHDD pDisk, const char *pszBackend,
                          N_("VD: unknown backend name '%s'"), pszBackend);
             break;
         }
+        if (uOpenFlags & VD_OPEN_FLAGS_CACHE_WRITE_BACK)
+        {
+            if (!pCache->Backend->pfnWriteBack)
+            {
+                rc = vdError(pDisk, VERR_NOT_SUPPORTED, RT_SRC_POS,
+                             N_("VD: backend '%s' doesn't support write-back caching"), pszBackend);
+                break;
+            }
+            AssertMsgBreakStmt(!(uOpenFlags & VD_OPEN_FLAGS_READONLY),
+                               ("uOpenFlags=%#x\n", uOpenFlags),
+                               rc = VERR_INVALID_PARAMETER);
+        }
 
         /* Set up the I/O interface. */
         pCache->VDIo.pInterfaceIo = VDIfIoGet(pVDIfsCache);
@@ -6762,16 +7063,16 @@ VBOXDDU_DECL(int) VDCacheOpen(PVBOXHDD pDisk, const char *pszBackend,
                             &pCache->VDIo, sizeof(VDINTERFACEIOINT), &pCache->pVDIfsCache);
         AssertRC(rc);
 
-        pCache->uOpenFlags = uOpenFlags & VD_OPEN_FLAGS_HONOR_SAME;
+        pCache->uOpenFlags = uOpenFlags & (VD_OPEN_FLAGS_HONOR_SAME | VD_OPEN_FLAGS_CACHE_WRITE_BACK);
         rc = pCache->Backend->pfnOpen(pCache->pszFilename,
-                                      uOpenFlags & ~VD_OPEN_FLAGS_HONOR_SAME,
+                                      uOpenFlags & ~(VD_OPEN_FLAGS_HONOR_SAME | VD_OPEN_FLAGS_CACHE_WRITE_BACK),
                                       pDisk->pVDIfsDisk,
                                       pCache->pVDIfsCache,
                                       &pCache->pBackendData);
         /* If the open in read-write mode failed, retry in read-only mode. */
         if (RT_FAILURE(rc))
         {
-            if (!(uOpenFlags & VD_OPEN_FLAGS_READONLY)
+            if (!(uOpenFlags & (VD_OPEN_FLAGS_READONLY | VD_OPEN_FLAGS_CACHE_WRITE_BACK))
                 &&  (   rc == VERR_ACCESS_DENIED
                      || rc == VERR_PERMISSION_DENIED
                      || rc == VERR_WRITE_PROTECT
@@ -6790,6 +7091,7 @@ VBOXDDU_DECL(int) VDCacheOpen(PVBOXHDD pDisk, const char *pszBackend,
                 break;
             }
         }
+        pCache->VDIo.pBackendData = pCache->pBackendData;
 
         /* Lock disk for writing, as we modify pDisk information below. */
         rc2 = vdThreadStartWrite(pDisk);
@@ -6811,7 +7113,14 @@ VBOXDDU_DECL(int) VDCacheOpen(PVBOXHDD pDisk, const char *pszBackend,
                                                                &UuidImage);
             if (RT_SUCCESS(rc))
             {
-                if (RTUuidCompare(&UuidImage, &UuidCache))
+                /* The image and a write-back cache are not updated atomically,
+                 * a mismatch is expected after a crash. The dirty data in the
+                 * cache is newer than the image in any case. */
+                if (   RTUuidCompare(&UuidImage, &UuidCache)
+                    && (uOpenFlags & VD_OPEN_FLAGS_CACHE_WRITE_BACK))
+                    LogRel(("VD: Modification UUID of write-back cache '%s' doesn't match the image (%RTuuid vs %RTuuid)\n",
+                            pszFilename, &UuidCache, &UuidImage));
+                else if (RTUuidCompare(&UuidImage, &UuidCache))
                     rc = VERR_VD_CACHE_NOT_UP_TO_DATE;
             }
         }
@@ -7330,6 +7639,10 @@ VBOXDDU_DECL(int) VDCreateDiff(PVBOXHDD pDisk, const char *pszBackend,
         AssertRC(rc2);
         fLockWrite = true;
         rc = vdDiscardStateDestroy(pDisk);
+        if (RT_FAILURE(rc))
+            break;
+        /* The dirty data in a write-back cache belongs to the image which becomes readonly. */
+        rc = vdCacheDestage(pDisk, UINT64_MAX, NULL);
         if (RT_FAILURE(rc))
             break;
         rc2 = vdThreadFinishWrite(pDisk);
@@ -7617,6 +7930,18 @@ VBOXDDU_DECL(int) VDCreateCache(PVBOXHDD pDisk, const char *pszBackend,
                          N_("VD: unknown backend name '%s'"), pszBackend);
             break;
         }
+        if (uOpenFlags & VD_OPEN_FLAGS_CACHE_WRITE_BACK)
+        {
+            if (!pCache->Backend->pfnWriteBack)
+            {
+                rc = vdError(pDisk, VERR_NOT_SUPPORTED, RT_SRC_POS,
+                             N_("VD: backend '%s' doesn't support write-back caching"), pszBackend);
+                break;
+            }
+            AssertMsgBreakStmt(!(uOpenFlags & VD_OPEN_FLAGS_READONLY),
+                               ("uOpenFlags=%#x\n", uOpenFlags),
+                               rc = VERR_INVALID_PARAMETER);
+        }
 
         pCache->VDIo.pDisk        = pDisk;
         pCache->pVDIfsCache       = pVDIfsCache;
@@ -7652,12 +7977,12 @@ VBOXDDU_DECL(int) VDCreateCache(PVBOXHDD pDisk, const char *pszBackend,
             pUuid = &uuid;
         }
 
-        pCache->uOpenFlags = uOpenFlags & VD_OPEN_FLAGS_HONOR_SAME;
+        pCache->uOpenFlags = uOpenFlags & (VD_OPEN_FLAGS_HONOR_SAME | VD_OPEN_FLAGS_CACHE_WRITE_BACK);
         pCache->VDIo.fIgnoreFlush = (uOpenFlags & VD_OPEN_FLAGS_IGNORE_FLUSH) != 0;
         rc = pCache->Backend->pfnCreate(pCache->pszFilename, cbSize,
                                         uImageFlags,
                                         pszComment, pUuid,
-                                        uOpenFlags & ~VD_OPEN_FLAGS_HONOR_SAME,
+                                        uOpenFlags & ~(VD_OPEN_FLAGS_HONOR_SAME | VD_OPEN_FLAGS_CACHE_WRITE_BACK),
                                         0, 99,
                                         pDisk->pVDIfsDisk,
                                         pCache->pVDIfsCache,
@@ -7777,6 +8102,9 @@ VBOXDDU_DECL(int) VDMerge(PVBOXHDD pDisk, unsigned nImageFrom,
         rc2 = vdThreadStartWrite(pDisk);
         AssertRC(rc2);
         fLockWrite = true;
+        rc = vdCacheDestage(pDisk, UINT64_MAX, NULL);
+        if (RT_FAILURE(rc))
+            break;
         PVDIMAGE pImageFrom = vdGetImageByNumber(pDisk, nImageFrom);
         PVDIMAGE pImageTo = vdGetImageByNumber(pDisk, nImageTo);
         if (!pImageFrom || !pImageTo)
@@ -8626,6 +8954,10 @@ VBOXDDU_DECL(int) VDCompact(PVBOXHDD pDisk, unsigned nImage,
         AssertRC(rc2);
         fLockWrite = true;
 
+        rc = vdCacheDestage(pDisk, UINT64_MAX, NULL);
+        if (RT_FAILURE(rc))
+            break;
+
         rc = pImage->Backend->pfnCompact(pImage->pBackendData,
                                          0, 99,
                                          pDisk->pVDIfsDisk,
@@ -8724,6 +9056,10 @@ VBOXDDU_DECL(int) VDResize(PVBOXHDD pDisk, uint64_t cbSize,
         AssertRC(rc2);
         fLockWrite = true;
 
+        rc = vdCacheDestage(pDisk, UINT64_MAX, NULL);
+        if (RT_FAILURE(rc))
+            break;
+
         VDGEOMETRY PCHSGeometryOld;
         VDGEOMETRY LCHSGeometryOld;
         PCVDGEOMETRY pPCHSGeometryNew;
@@ -9025,6 +9361,11 @@ VBOXDDU_DECL(int) VDClose(PVBOXHDD pDisk, bool fDelete)
         if (RT_FAILURE(rc))
             break;
 
+        /* A write-back cache holds data for the last image only. */
+        rc = vdCacheDestage(pDisk, UINT64_MAX, NULL);
+        if (RT_FAILURE(rc))
+            break;
+
         unsigned uOpenFlags = pImage->Backend->pfnGetOpenFlags(pImage->pBackendData);
         /* Remove image from list of opened images. */
         vdRemoveImageFromList(pDisk, pImage);
@@ -9124,6 +9465,12 @@ VBOXDDU_DECL(int) VDCacheClose(PVBOXHDD pDisk, bool fDelete)
 
         AssertPtrBreakStmt(pDisk->pCache, rc = VERR_VD_CACHE_NOT_FOUND);
 
+        /* Dirty data would be lost when the cache is deleted. */
+        rc = vdCacheDestage(pDisk, UINT64_MAX, NULL);
+        if (RT_FAILURE(rc) && fDelete)
+            break;
+        rc = VINF_SUCCESS;
+
         pCache = pDisk->pCache;
         pDisk->pCache = NULL;
 
@@ -9143,6 +9490,97 @@ VBOXDDU_DECL(int) VDCacheClose(PVBOXHDD pDisk, bool fDelete)
     return rc;
 }
 
+/**
+ * Writes dirty data from a write-back cache to the last image in the chain.
+ *
+ * @return  VBox status code.
+ * @return  VERR_VD_CACHE_NOT_FOUND if no cache is opened in HDD container.
+ * @param   pDisk           Pointer to HDD container.
+ * @param   cbMax           Maximum number of bytes to write before returning.
+ * @param   pcbDirtyLeft    Where to store the number of dirty bytes remaining, optional.
+ */
+VBOXDDU_DECL(int) VDCacheDestage(PVBOXHDD pDisk, uint64_t cbMax, uint64_t *pcbDirtyLeft)
+{
+    int rc = VINF_SUCCESS;
+    int rc2;
+    bool fLockWrite = false;
+
+    LogFlowFunc(("pDisk=%#p cbMax=%llu pcbDirtyLeft=%#p\n", pDisk, cbMax, pcbDirtyLeft));
+
+    do
+    {
+        /* sanity check */
+        AssertPtrBreakStmt(pDisk, rc = VERR_INVALID_PARAMETER);
+        AssertMsg(pDisk->u32Signature == VBOXHDDDISK_SIGNATURE, ("u32Signature=%08x\n", pDisk->u32Signature));
+
+        AssertMsgBreakStmt(VALID_PTR(pcbDirtyLeft) || !pcbDirtyLeft,
+                           ("pcbDirtyLeft=%#p\n", pcbDirtyLeft),
+                           rc = VERR_INVALID_PARAMETER);
+
+        rc2 = vdThreadStartWrite(pDisk);
+        AssertRC(rc2);
+        fLockWrite = true;
+
+        AssertPtrBreakStmt(pDisk->pCache, rc = VERR_VD_CACHE_NOT_FOUND);
+
+        rc = vdCacheDestage(pDisk, cbMax, pcbDirtyLeft);
+    } while (0);
+
+    if (RT_LIKELY(fLockWrite))
+    {
+        rc2 = vdThreadFinishWrite(pDisk);
+        AssertRC(rc2);
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Queries the statistics of the cache.
+ *
+ * @return  VBox status code.
+ * @return  VERR_VD_CACHE_NOT_FOUND if no cache is opened in HDD container.
+ * @param   pDisk           Pointer to HDD container.
+ * @param   pStats          Where to store the statistics.
+ */
+VBOXDDU_DECL(int) VDCacheQueryStatistics(PVBOXHDD pDisk, PVDCACHESTATS pStats)
+{
+    int rc = VINF_SUCCESS;
+    int rc2;
+    bool fLockRead = false;
+
+    LogFlowFunc(("pDisk=%#p pStats=%#p\n", pDisk, pStats));
+
+    do
+    {
+        /* sanity check */
+        AssertPtrBreakStmt(pDisk, rc = VERR_INVALID_PARAMETER);
+        AssertMsg(pDisk->u32Signature == VBOXHDDDISK_SIGNATURE, ("u32Signature=%08x\n", pDisk->u32Signature));
+
+        AssertMsgBreakStmt(VALID_PTR(pStats),
+                           ("pStats=%#p\n", pStats),
+                           rc = VERR_INVALID_PARAMETER);
+
+        rc2 = vdThreadStartRead(pDisk);
+        AssertRC(rc2);
+        fLockRead = true;
+
+        AssertPtrBreakStmt(pDisk->pCache, rc = VERR_VD_CACHE_NOT_FOUND);
+
+        *pStats = pDisk->pCache->Stats;
+    } while (0);
+
+    if (RT_UNLIKELY(fLockRead))
+    {
+        rc2 = vdThreadFinishRead(pDisk);
+        AssertRC(rc2);
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
 VBOXDDU_DECL(int) VDFilterRemove(PVBOXHDD pDisk, uint32_t fFlags)
 {
     int rc = VINF_SUCCESS;
@@ -9222,6 +9660,12 @@ VBOXDDU_DECL(int) VDCloseAll(PVBOXHDD pDisk)
         PVDCACHE pCache = pDisk->pCache;
         if (pCache)
         {
+            /* Dirty data which can't be written now stays in the cache and is written after reopening it. */
+            rc2 = vdCacheDestage(pDisk, UINT64_MAX, NULL);
+            if (RT_FAILURE(rc2))
+                LogRel(("VD: Writing dirty data from cache '%s' failed with %Rrc\n", pCache->pszFilename, rc2));
+
+            pDisk->pCache = NULL;
             rc2 = pCache->Backend->pfnClose(pCache->pBackendData, false);
             if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
                 rc = rc2;
@@ -9479,22 +9923,7 @@ VBOXDDU_DECL(int) VDFlush(PVBOXHDD pDisk)
         PVDIMAGE pImage = pDisk->pLast;
         AssertPtrBreakStmt(pImage, rc = VERR_VD_NOT_OPENED);
 
-        VDIOCTX IoCtx;
-        RTSEMEVENT hEventComplete = NIL_RTSEMEVENT;
-
-        rc = RTSemEventCreate(&hEventComplete);
-        if (RT_FAILURE(rc))
-            break;
-
-        vdIoCtxInit(&IoCtx, pDisk, VDIOCTXTXDIR_FLUSH, 0, 0, pImage, NULL,
-                    NULL, vdFlushHelperAsync, VDIOCTX_FLAGS_SYNC | VDIOCTX_FLAGS_DONT_FREE);
-
-        IoCtx.Type.Root.pfnComplete = vdIoCtxSyncComplete;
-        IoCtx.Type.Root.pvUser1     = pDisk;
-        IoCtx.Type.Root.pvUser2     = hEventComplete;
-        rc = vdIoCtxProcessSync(&IoCtx, hEventComplete);
-
-        RTSemEventDestroy(hEventComplete);
+        rc = vdFlushHelper(pDisk);
     } while (0);
 
     if (RT_UNLIKELY(fLockWrite))
@@ -11169,6 +11598,7 @@ VBOXDDU_DECL(int) VDRepair(PVDINTERFACE pVDIfsDisk, PVDINTERFACE pVDIfsImage,
     VDIfIoInt.pfnGetModificationTime    = vdIOIntGetModificationTimeLimited;
     VDIfIoInt.pfnGetSize                = vdIOIntGetSizeLimited;
     VDIfIoInt.pfnSetSize                = vdIOIntSetSizeLimited;
+    VDIfIoInt.pfnPunchHole              = vdIOIntPunchHoleLimited;
     VDIfIoInt.pfnReadUser               = vdIOIntReadUserLimited;
     VDIfIoInt.pfnWriteUser              = vdIOIntWriteUserLimited;
     VDIfIoInt.pfnReadMeta               = vdIOIntReadMetaLimited;
@@ -37,6 +37,7 @@ extern const VDIMAGEBACKEND g_QCowBackend;
 extern const VDIMAGEBACKEND g_VhdxBackend;
 
 extern const VDCACHEBACKEND g_VciCacheBackend;
+extern const VDCACHEBACKEND g_VwcCacheBackend;
 
 RT_C_DECLS_END
 
@@ -193,6 +193,35 @@ static void vdiConvBlocksEndianess(VDIECONV enmConv, PVDIIMAGEBLOCKPOINTER paBlo
         paBlocks[i] = SET_ENDIAN_U32(enmConv, paBlocks[i]);
 }
 
+/**
+ * Internal: Makes the slots of discarded blocks available for allocations
+ * after the image was flushed, the block table no longer references them on
+ * disk at this point.
+ *
+ * @param   pImage    VDI image instance data.
+ */
+static void vdiBlockSlotsDiscardedRelease(PVDIIMAGEDESC pImage)
+{
+    unsigned cBlocksAllocated = getImageBlocksAllocated(&pImage->Header);
+
+    if (pImage->paBlocksRev)
+    {
+        for (unsigned i = 0; i < cBlocksAllocated && pImage->cBlocksDiscarded; i++)
+        {
+            if (pImage->paBlocksRev[i] == VDI_IMAGE_BLOCK_DISCARDED)
+            {
+                pImage->paBlocksRev[i]   = VDI_IMAGE_BLOCK_FREE;
+                pImage->idxBlockFreeHint = RT_MIN(pImage->idxBlockFreeHint, i);
+                pImage->cBlocksDiscarded--;
+                pImage->cBlocksFree++;
+            }
+        }
+        AssertMsg(!pImage->cBlocksDiscarded, ("%u discarded slots left\n", pImage->cBlocksDiscarded));
+    }
+
+    pImage->cBlocksAllocatedMax = cBlocksAllocated;
+}
+
 /**
  * Internal: Flush the image file to disk.
  */
@@ -204,7 +233,9 @@ static void vdiFlushImage(PVDIIMAGEDESC pImage)
         int rc = vdiUpdateHeader(pImage);
         AssertMsgRC(rc, ("vdiUpdateHeader() failed, filename=\"%s\", rc=%Rrc\n",
                          pImage->pszFilename, rc));
-        vdIfIoIntFileFlushSync(pImage->pIfIo, pImage->pStorage);
+        rc = vdIfIoIntFileFlushSync(pImage->pIfIo, pImage->pStorage);
+        if (RT_SUCCESS(rc))
+            vdiBlockSlotsDiscardedRelease(pImage);
     }
 }
 
@@ -888,6 +919,21 @@ static int vdiImageBackResolvTblCreate(PVDIIMAGEDESC pImage)
                 }
             }
         }
+
+        /* Slots without a block are holes left by discarded blocks which can be reused. */
+        pImage->cBlocksFree         = 0;
+        pImage->cBlocksDiscarded    = 0;
+        pImage->cBlocksAllocatedMax = cBlocksAllocated;
+        pImage->idxBlockFreeHint    = cBlocksAllocated;
+        for (unsigned i = 0; i < cBlocksAllocated; i++)
+        {
+            if (pImage->paBlocksRev[i] == VDI_IMAGE_BLOCK_FREE)
+            {
+                if (!pImage->cBlocksFree)
+                    pImage->idxBlockFreeHint = i;
+                pImage->cBlocksFree++;
+            }
+        }
     }
     else
         rc = VERR_NO_MEMORY;
@@ -895,6 +941,84 @@ static int vdiImageBackResolvTblCreate(PVDIIMAGEDESC pImage)
     return rc;
 }
 
+/**
+ * Internal: Recreates the back resolving table if discarding is enabled, used
+ * after operations moving blocks around in the image.
+ *
+ * @returns VBox status code.
+ * @param   pImage          The VDI image descriptor.
+ */
+static int vdiImageBackResolvTblRecreate(PVDIIMAGEDESC pImage)
+{
+    if (!pImage->paBlocksRev)
+        return VINF_SUCCESS;
+
+    RTMemFree(pImage->paBlocksRev);
+    pImage->paBlocksRev = NULL;
+    pImage->cBlocksFree = 0;
+    return vdiImageBackResolvTblCreate(pImage);
+}
+
+/**
+ * Internal: Returns the lowest free block slot in the image or
+ * VDI_IMAGE_BLOCK_FREE if there is none.
+ *
+ * @returns Slot index.
+ * @param   pImage    VDI image instance data.
+ */
+static unsigned vdiBlockSlotFreeFind(PVDIIMAGEDESC pImage)
+{
+    if (!pImage->cBlocksFree)
+        return VDI_IMAGE_BLOCK_FREE;
+
+    unsigned cBlocksAllocated = getImageBlocksAllocated(&pImage->Header);
+    for (unsigned i = pImage->idxBlockFreeHint; i < cBlocksAllocated; i++)
+    {
+        if (pImage->paBlocksRev[i] == VDI_IMAGE_BLOCK_FREE)
+        {
+            pImage->idxBlockFreeHint = i;
+            return i;
+        }
+    }
+
+    AssertMsgFailed(("%u free slots accounted but none found\n", pImage->cBlocksFree));
+    return VDI_IMAGE_BLOCK_FREE;
+}
+
+/**
+ * Internal: Drops the free and discarded slots at the end of the image from the
+ * allocated block count. The caller has to update the header and shrink the
+ * image. Appends don't reuse the dropped slots before the next flush, see
+ * VDIIMAGEDESC::cBlocksAllocatedMax.
+ *
+ * @returns Number of slots dropped.
+ * @param   pImage    VDI image instance data.
+ */
+static unsigned vdiBlockSlotsTrimTail(PVDIIMAGEDESC pImage)
+{
+    unsigned cBlocksAllocated = getImageBlocksAllocated(&pImage->Header);
+    unsigned cSlotsTrimmed = 0;
+
+    while (cBlocksAllocated)
+    {
+        unsigned *puRev = &pImage->paBlocksRev[cBlocksAllocated - 1];
+        if (*puRev == VDI_IMAGE_BLOCK_FREE && pImage->cBlocksFree)
+            pImage->cBlocksFree--;
+        else if (*puRev == VDI_IMAGE_BLOCK_DISCARDED && pImage->cBlocksDiscarded)
+        {
+            *puRev = VDI_IMAGE_BLOCK_FREE;
+            pImage->cBlocksDiscarded--;
+        }
+        else
+            break;
+        cBlocksAllocated--;
+        cSlotsTrimmed++;
+    }
+
+    setImageBlocksAllocated(&pImage->Header, cBlocksAllocated);
+    return cSlotsTrimmed;
+}
+
 /**
  * Internal: Open a VDI image.
  */
@@ -1078,6 +1202,27 @@ static int vdiUpdateBlockInfoAsync(PVDIIMAGEDESC pImage, unsigned uBlock,
     return rc;
 }
 
+/**
+ * Completion callback for the flush of the image file.
+ *
+ * @returns VBox status code.
+ * @param   pBackendData    The opaque backend data.
+ * @param   pIoCtx          I/O context associated with this request.
+ * @param   pvUser          Opaque user data, unused.
+ * @param   rcReq           Status code for the completed request.
+ */
+static DECLCALLBACK(int) vdiFlushImageIoCtxComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq)
+{
+    RT_NOREF2(pIoCtx, pvUser);
+    PVDIIMAGEDESC pImage = (PVDIIMAGEDESC)pBackendData;
+
+    /* The disk is locked during the flush, so no discard completed meanwhile. */
+    if (RT_SUCCESS(rcReq))
+        vdiBlockSlotsDiscardedRelease(pImage);
+
+    return VINF_SUCCESS;
+}
+
 /**
  * Internal: Flush the image file to disk - async version.
  */
@@ -1092,9 +1237,12 @@ static int vdiFlushImageIoCtx(PVDIIMAGEDESC pImage, PVDIOCTX pIoCtx)
         AssertMsg(RT_SUCCESS(rc) || rc == VERR_VD_ASYNC_IO_IN_PROGRESS,
                   ("vdiUpdateHeaderAsync() failed, filename=\"%s\", rc=%Rrc\n",
                   pImage->pszFilename, rc));
-        rc = vdIfIoIntFileFlush(pImage->pIfIo, pImage->pStorage, pIoCtx, NULL, NULL);
+        rc = vdIfIoIntFileFlush(pImage->pIfIo, pImage->pStorage, pIoCtx,
+                                vdiFlushImageIoCtxComplete, NULL);
         AssertMsg(RT_SUCCESS(rc) || rc == VERR_VD_ASYNC_IO_IN_PROGRESS,
                   ("Flushing data to disk failed rc=%Rrc\n", rc));
+        if (RT_SUCCESS(rc))
+            vdiBlockSlotsDiscardedRelease(pImage);
     }
 
     return rc;
@@ -1158,20 +1306,26 @@ static DECLCALLBACK(int) vdiDiscardBlockAsyncUpdate(void *pBackendData, PVDIOCTX
             {
                 pImage->paBlocks[pDiscardAsync->uBlockLast] = pDiscardAsync->ptrBlockDiscard;
                 pImage->paBlocksRev[pDiscardAsync->ptrBlockDiscard] = pDiscardAsync->uBlockLast;
+            }
 
+            /* Holes which end up at the end of the image go away as well. */
+            setImageBlocksAllocated(&pImage->Header, pDiscardAsync->idxLastBlock);
+            unsigned cSlotsTrimmed = 1 + vdiBlockSlotsTrimTail(pImage);
+
+            if (pDiscardAsync->idxLastBlock != pDiscardAsync->ptrBlockDiscard)
+            {
                 rc = vdiUpdateBlockInfoAsync(pImage, pDiscardAsync->uBlockLast, pIoCtx, false /* fUpdateHdr */);
                 if (   RT_FAILURE(rc)
                     && rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
                     break;
             }
 
-            setImageBlocksAllocated(&pImage->Header, pDiscardAsync->idxLastBlock);
             rc = vdiUpdateBlockInfoAsync(pImage, pDiscardAsync->uBlock, pIoCtx, true /* fUpdateHdr */);
             if (   RT_FAILURE(rc)
                 && rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
                 break;
 
-            pImage->cbImage -= pImage->cbTotalBlockData;
+            pImage->cbImage -= (uint64_t)cSlotsTrimmed * pImage->cbTotalBlockData;
             LogFlowFunc(("Set new size %llu\n", pImage->cbImage));
             rc2 = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pImage->cbImage);
             if (RT_FAILURE(rc2))
@@ -1192,6 +1346,38 @@ static DECLCALLBACK(int) vdiDiscardBlockAsyncUpdate(void *pBackendData, PVDIOCTX
     return rc;
 }
 
+/**
+ * Internal: Discard a whole block from the image by punching a hole into the
+ * image file where the block was stored. The slot is reused for the next block
+ * allocation or filled with the last block of the image later on.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if the storage doesn't support punching holes.
+ * @param   pImage    VDI image instance data.
+ * @param   pIoCtx    I/O context associated with this request.
+ * @param   uBlock    The block to discard.
+ */
+static int vdiDiscardBlockPunchHoleAsync(PVDIIMAGEDESC pImage, PVDIOCTX pIoCtx, unsigned uBlock)
+{
+    VDIIMAGEBLOCKPOINTER ptrBlock = pImage->paBlocks[uBlock];
+    uint64_t u64Offset = (uint64_t)ptrBlock * pImage->cbTotalBlockData + pImage->offStartData;
+
+    LogFlowFunc(("Punching hole for [%u]=%u\n", uBlock, ptrBlock));
+
+    int rc = vdIfIoIntFilePunchHole(pImage->pIfIo, pImage->pStorage, u64Offset, pImage->cbTotalBlockData);
+    if (RT_SUCCESS(rc))
+    {
+        /* The slot can be reused only after the next flush. */
+        pImage->paBlocks[uBlock]      = VDI_IMAGE_BLOCK_ZERO;
+        pImage->paBlocksRev[ptrBlock] = VDI_IMAGE_BLOCK_DISCARDED;
+        pImage->cBlocksDiscarded++;
+
+        rc = vdiUpdateBlockInfoAsync(pImage, uBlock, pIoCtx, false /* fUpdateHdr */);
+    }
+
+    return rc;
+}
+
 /**
  * Internal: Discard a whole block from the image filling the created hole with
  * data from another block - async I/O version.
@@ -1211,6 +1397,27 @@ static int vdiDiscardBlockAsync(PVDIIMAGEDESC pImage, PVDIOCTX pIoCtx,
     LogFlowFunc(("pImage=%#p uBlock=%u pvBlock=%#p\n",
                  pImage, uBlock, pvBlock));
 
+    /*
+     * Blocks in the middle of the image are returned to the host by punching
+     * a hole instead of moving the last block around which saves copying a
+     * whole block for every discard. Use the old way if the host can't do it.
+     */
+    if (   pImage->paBlocks[uBlock] != getImageBlocksAllocated(&pImage->Header) - 1
+        && !pImage->fPunchHoleUnsupported)
+    {
+        rc = vdiDiscardBlockPunchHoleAsync(pImage, pIoCtx, uBlock);
+        if (rc != VERR_NOT_SUPPORTED)
+        {
+            RTMemFree(pvBlock);
+            LogFlowFunc(("returns rc=%Rrc\n", rc));
+            return rc;
+        }
+
+        LogRel(("VDI: Punching holes is not supported for '%s', moving blocks instead\n", pImage->pszFilename));
+        pImage->fPunchHoleUnsupported = true;
+        rc = VINF_SUCCESS;
+    }
+
     pDiscardAsync = (PVDIBLOCKDISCARDASYNC)RTMemAllocZ(sizeof(VDIBLOCKDISCARDASYNC));
     if (RT_UNLIKELY(!pDiscardAsync))
         return VERR_NO_MEMORY;
@@ -1306,15 +1513,37 @@ static DECLCALLBACK(int) vdiBlockAllocUpdate(void *pBackendData, PVDIOCTX pIoCtx
 
     if (RT_SUCCESS(rcReq))
     {
-        pImage->cbImage += pImage->cbTotalBlockData;
-        pImage->paBlocks[pBlockAlloc->uBlock] = pBlockAlloc->cBlocksAllocated;
+        bool fAppend = pBlockAlloc->idxSlot >= pBlockAlloc->cBlocksAllocated;
+
+        pImage->paBlocks[pBlockAlloc->uBlock] = pBlockAlloc->idxSlot;
 
         if (pImage->paBlocksRev)
-            pImage->paBlocksRev[pBlockAlloc->cBlocksAllocated] = pBlockAlloc->uBlock;
+            pImage->paBlocksRev[pBlockAlloc->idxSlot] = pBlockAlloc->uBlock;
+
+        if (fAppend)
+        {
+            /* Skipped slots are freed with the next flush like discarded ones. */
+            for (unsigned i = pBlockAlloc->cBlocksAllocated; i < pBlockAlloc->idxSlot; i++)
+            {
+                Assert(pImage->paBlocksRev);
+                pImage->paBlocksRev[i] = VDI_IMAGE_BLOCK_DISCARDED;
+                pImage->cBlocksDiscarded++;
+            }
+
+            pImage->cbImage += (uint64_t)(pBlockAlloc->idxSlot + 1 - pBlockAlloc->cBlocksAllocated)
+                             * pImage->cbTotalBlockData;
+            setImageBlocksAllocated(&pImage->Header, pBlockAlloc->idxSlot + 1);
+            pImage->cBlocksAllocatedMax = RT_MAX(pImage->cBlocksAllocatedMax, pBlockAlloc->idxSlot + 1);
+        }
+        else
+        {
+            /* Reused a hole left by a discarded block. */
+            Assert(pImage->cBlocksFree);
+            pImage->cBlocksFree--;
+        }
 
-        setImageBlocksAllocated(&pImage->Header, pBlockAlloc->cBlocksAllocated + 1);
         rc = vdiUpdateBlockInfoAsync(pImage, pBlockAlloc->uBlock, pIoCtx,
-                                     true /* fUpdateHdr */);
+                                     fAppend /* fUpdateHdr */);
     }
     /* else: I/O error don't update the block table. */
 
@@ -1636,12 +1865,19 @@ static DECLCALLBACK(int) vdiWrite(void *pBackendData, uint64_t uOffset, size_t c
                         break;
                     }
 
+                    /* Fill holes left by discarded blocks before growing the image.
+                     * Appends skip the slots dropped from the end since the last flush. */
                     unsigned cBlocksAllocated = getImageBlocksAllocated(&pImage->Header);
-                    uint64_t u64Offset = (uint64_t)cBlocksAllocated * pImage->cbTotalBlockData
+                    unsigned idxSlot = vdiBlockSlotFreeFind(pImage);
+                    if (idxSlot == VDI_IMAGE_BLOCK_FREE)
+                        idxSlot = pImage->paBlocksRev ? RT_MAX(cBlocksAllocated, pImage->cBlocksAllocatedMax)
+                                                      : cBlocksAllocated;
+                    uint64_t u64Offset = (uint64_t)idxSlot * pImage->cbTotalBlockData
                                        + (pImage->offStartData + pImage->offStartBlockData);
 
                     pBlockAlloc->cBlocksAllocated = cBlocksAllocated;
                     pBlockAlloc->uBlock           = uBlock;
+                    pBlockAlloc->idxSlot          = idxSlot;
 
                     *pcbPreRead = 0;
                     *pcbPostRead = 0;
@@ -2204,11 +2440,14 @@ static DECLCALLBACK(void) vdiDump(void *pBackendData)
                 cBadBlocks++;
         }
     }
-    if (cBlocksNotFree != getImageBlocksAllocated(&pImage->Header))
+    if (cBlocksNotFree > getImageBlocksAllocated(&pImage->Header))
     {
         vdIfErrorMessage(pImage->pIfError, "!! WARNING: %u blocks actually allocated (cBlocksAllocated=%u) !!\n",
                          cBlocksNotFree, getImageBlocksAllocated(&pImage->Header));
     }
+    else if (cBlocksNotFree < getImageBlocksAllocated(&pImage->Header))
+        vdIfErrorMessage(pImage->pIfError, "Image contains %u free block slots left by discarded blocks\n",
+                         getImageBlocksAllocated(&pImage->Header) - cBlocksNotFree);
     if (cBadBlocks)
     {
         vdIfErrorMessage(pImage->pIfError, "!! WARNING: %u bad blocks found !!\n",
@@ -2434,6 +2673,8 @@ static DECLCALLBACK(int) vdiCompact(void *pBackendData, unsigned uPercentStart,
         rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage,
                                   (uint64_t)uBlockUsedPos * pImage->cbTotalBlockData
                                   + pImage->offStartData + pImage->offStartBlockData);
+        if (RT_SUCCESS(rc))
+            rc = vdiImageBackResolvTblRecreate(pImage);
     } while (0);
 
     if (paBlocks2)
@@ -2527,11 +2768,15 @@ static DECLCALLBACK(int) vdiResize(void *pBackendData, uint64_t cbSize,
 
                     for (unsigned i = 0; i < cBlocksReloc; i++)
                     {
+                        bool fSlotUsed = false;
+
                         /* Search the index in the block table. */
                         for (unsigned idxBlock = 0; idxBlock < cBlocksOld; idxBlock++)
                         {
                             if (!pImage->paBlocks[idxBlock])
                             {
+                                fSlotUsed = true;
+
                                 /* Read data and append to the end of the image. */
                                 rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage,
                                                            offStartDataNew, pvBuf,
@@ -2582,6 +2827,22 @@ static DECLCALLBACK(int) vdiResize(void *pBackendData, uint64_t cbSize,
                         if (RT_FAILURE(rc))
                             break;
 
+                        if (!fSlotUsed)
+                        {
+                            /*
+                             * The first slot is a hole left by a discarded block, there is
+                             * nothing to move. It just vanishes under the new block array.
+                             */
+                            for (unsigned idxBlock = 0; idxBlock < cBlocksOld; idxBlock++)
+                            {
+                                if (IS_VDI_IMAGE_BLOCK_ALLOCATED(pImage->paBlocks[idxBlock]))
+                                    pImage->paBlocks[idxBlock]--;
+                            }
+
+                            cBlocksAllocated--;
+                            setImageBlocksAllocated(&pImage->Header, cBlocksAllocated);
+                        }
+
                         offStartDataNew += pImage->cbTotalBlockData;
                     }
                 } while (0);
@@ -2644,6 +2905,10 @@ static DECLCALLBACK(int) vdiResize(void *pBackendData, uint64_t cbSize,
             }
         }
 
+        int rc2 = vdiImageBackResolvTblRecreate(pImage);
+        if (RT_SUCCESS(rc))
+            rc = rc2;
+
         /* Update header information in base image file. */
         vdiFlushImage(pImage);
     }
@@ -2732,13 +2997,20 @@ static DECLCALLBACK(int) vdiDiscard(void *pBackendData, PVDIOCTX pIoCtx,
             }
             else if (fDiscard & VD_DISCARD_MARK_UNUSED)
             {
-                /* Just zero out the given range. */
-                memset(pvBlock, 0, cbDiscard);
-
+                /* Just zero out the given range, returning the space to the host if possible. */
                 uint64_t u64Offset = (uint64_t)pImage->paBlocks[uBlock] * pImage->cbTotalBlockData + pImage->offStartData + offDiscard;
-                rc = vdIfIoIntFileWriteMeta(pImage->pIfIo, pImage->pStorage,
-                                            u64Offset, pvBlock, cbDiscard, pIoCtx,
-                                            NULL, NULL);
+
+                rc = VERR_NOT_SUPPORTED;
+                if (!pImage->fPunchHoleUnsupported)
+                    rc = vdIfIoIntFilePunchHole(pImage->pIfIo, pImage->pStorage, u64Offset, cbDiscard);
+                if (rc == VERR_NOT_SUPPORTED)
+                {
+                    pImage->fPunchHoleUnsupported = true;
+                    memset(pvBlock, 0, cbDiscard);
+                    rc = vdIfIoIntFileWriteMeta(pImage->pIfIo, pImage->pStorage,
+                                                u64Offset, pvBlock, cbDiscard, pIoCtx,
+                                                NULL, NULL);
+                }
                 RTMemFree(pvBlock);
             }
             else
@@ -264,6 +264,14 @@ typedef VDIIMAGEBLOCKPOINTER *PVDIIMAGEBLOCKPOINTER;
 #define VDI_IMAGE_BLOCK_UNALLOCATED   (VDI_IMAGE_BLOCK_ZERO)
 #define IS_VDI_IMAGE_BLOCK_ALLOCATED(bp)   (bp < VDI_IMAGE_BLOCK_UNALLOCATED)
 
+/**
+ * Back resolving table entry of a slot whose block was discarded while the
+ * block table update might not be on disk yet. The slot becomes free with the
+ * next flush, reusing it earlier could leave two blocks pointing at it after
+ * a crash.
+ */
+#define VDI_IMAGE_BLOCK_DISCARDED   ((VDIIMAGEBLOCKPOINTER)~1)
+
 #define GET_MAJOR_HEADER_VERSION(ph) (VDI_GET_VERSION_MAJOR((ph)->uVersion))
 #define GET_MINOR_HEADER_VERSION(ph) (VDI_GET_VERSION_MINOR((ph)->uVersion))
 
@@ -563,6 +571,20 @@ typedef struct VDIIMAGEDESC
     PVDINTERFACEIOINT       pIfIo;
     /** Current size of the image (used for range validation when reading). */
     uint64_t                cbImage;
+    /** Number of free block slots below the allocated block count, i.e. holes
+     * left by discarded blocks (only tracked if discarding is enabled).  They
+     * are reused by block allocations and removed by compacting the image. */
+    unsigned                cBlocksFree;
+    /** Lowest block slot which might be free, search start for allocations. */
+    unsigned                idxBlockFreeHint;
+    /** Number of slots marked VDI_IMAGE_BLOCK_DISCARDED, waiting for a flush. */
+    unsigned                cBlocksDiscarded;
+    /** Highest allocated block count since the last flush.  Appends don't go
+     * below it, so slots dropped from the end of the image by a discard are
+     * not reused before the flush either. */
+    unsigned                cBlocksAllocatedMax;
+    /** Flag whether the storage doesn't support punching holes. */
+    bool                    fPunchHoleUnsupported;
 } VDIIMAGEDESC, *PVDIIMAGEDESC;
 
 /**
@@ -610,6 +632,9 @@ typedef struct VDIASYNCBLOCKALLOC
     unsigned                cBlocksAllocated;
     /** Block index to allocate. */
     unsigned                uBlock;
+    /** Slot in the image the block is written to, either a free slot
+     * or at least cBlocksAllocated when appending. */
+    unsigned                idxSlot;
 } VDIASYNCBLOCKALLOC, *PVDIASYNCBLOCKALLOC;
 
 /**
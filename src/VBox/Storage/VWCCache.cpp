@@ -0,0 +1,2173 @@
+/* $Id$ */
+/** @file
+ * VWCCache - VirtualBox Write-back Cache, Core Code.
+ */
+
+/*
+ * Copyright (C) 2016 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_storage_vwc    VWC - Write-back Cache Image
+ *
+ * The cache file is divided into fixed size slots, each holding one 64KB
+ * block of the virtual disk. A slot table right after the header records
+ * which block a slot holds and which of its sectors are valid and dirty
+ * (i.e. not yet written to the image chain).
+ *
+ * Crash consistency is achieved by ordering instead of a log: data is only
+ * ever written to the slots, and the slot table sectors describing the data
+ * are written on a flush after the data itself was flushed to the medium.
+ * A slot is only reused for another block after a flush made the slot table
+ * entry marking it free durable. This relies on 512 byte sector writes being
+ * atomic, every slot table sector carries a CRC for each entry to detect
+ * violations. The header is kept in two copies which are updated
+ * alternately.
+ *
+ * A cache which was not closed cleanly has all valid sectors marked dirty
+ * when it is opened again because a destage might have been interrupted
+ * between writing the image and updating the slot table.
+ *
+ * Clean blocks are evicted based on how often they were accessed, see
+ * vwcReclaim().
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_VD_VWC
+#include <VBox/vd-cache-backend.h>
+#include <VBox/err.h>
+
+#include <VBox/log.h>
+#include <iprt/assert.h>
+#include <iprt/alloc.h>
+#include <iprt/avl.h>
+#include <iprt/critsect.h>
+#include <iprt/crc.h>
+#include <iprt/file.h>
+#include <iprt/asm.h>
+#include <iprt/string.h>
+#include <iprt/uuid.h>
+
+#include "VDBackends.h"
+
+/*******************************************************************************
+* On disk data structures                                                      *
+*******************************************************************************/
+
+/** Sector size, the smallest unit tracked. */
+#define VWC_SECTOR_SIZE             512
+/** Size of a cache slot. */
+#define VWC_BLOCK_SIZE              _64K
+/** Number of sectors in a slot. */
+#define VWC_SECTORS_PER_BLOCK       (VWC_BLOCK_SIZE / VWC_SECTOR_SIZE)
+/** Offset of the slot table in the image. */
+#define VWC_SLOT_TABLE_OFFSET       _4K
+/** Number of slot table entries in one sector. */
+#define VWC_ENTRIES_PER_SECTOR      (VWC_SECTOR_SIZE / sizeof(VwcSlotEntry))
+/** Maximum number of segments for a single I/O task, see VD_IO_TASK_SEGMENTS_MAX. */
+#define VWC_SEGMENTS_MAX            64
+
+/**
+ * The VWC header, stored twice at the beginning of the file.
+ *
+ * The copy with the highest generation and a valid CRC is used. Updates go to
+ * the copy which is not current so a torn write never destroys both.
+ *
+ * All entries are stored in little endian order.
+ */
+#pragma pack(1)
+typedef struct VwcHdr
+{
+    /** The signature to identify a write-back cache image. */
+    uint32_t    u32Signature;
+    /** Version of the layout of metadata in the cache. */
+    uint32_t    u32Version;
+    /** Generation counter, incremented on every header update. */
+    uint64_t    u64Generation;
+    /** Flags, see VWC_HDR_F_XXX. */
+    uint32_t    fFlags;
+    /** Number of slots in the cache. */
+    uint32_t    cSlots;
+    /** Size of a slot in bytes. */
+    uint32_t    cbSlot;
+    /** Reserved, must be 0. */
+    uint32_t    u32Reserved;
+    /** Byte offset of the slot table. */
+    uint64_t    offSlotTable;
+    /** Byte offset of the first slot. */
+    uint64_t    offSlots;
+    /** UUID of the image. */
+    RTUUID      UuidImage;
+    /** Modification UUID for the cache. */
+    RTUUID      UuidModification;
+    /** Reserved for future use. */
+    uint8_t     abReserved[428];
+    /** CRC32C of all preceding fields. */
+    uint32_t    u32Crc;
+} VwcHdr;
+#pragma pack()
+AssertCompileSize(VwcHdr, VWC_SECTOR_SIZE);
+
+/** VWC signature to identify a valid image. */
+#define VWC_HDR_SIGNATURE           UINT32_C(0x31435756) /* 1CWV */
+/** Current version we support. */
+#define VWC_HDR_VERSION             UINT32_C(0x00000001)
+/** The cache is in use, it was not closed cleanly if set on open. */
+#define VWC_HDR_F_IN_USE            RT_BIT_32(0)
+
+/**
+ * A slot table entry.
+ *
+ * All entries are stored in little endian order.
+ */
+#pragma pack(1)
+typedef struct VwcSlotEntry
+{
+    /** The block of the virtual disk stored in the slot, VWC_SLOT_FREE if unused. */
+    uint64_t    u64Block;
+    /** Bitmap of valid sectors. */
+    uint64_t    au64Valid[2];
+    /** Bitmap of dirty sectors, always a subset of the valid ones. */
+    uint64_t    au64Dirty[2];
+    /** Reserved, must be 0. */
+    uint8_t     abReserved[20];
+    /** CRC32C of all preceding fields. */
+    uint32_t    u32Crc;
+} VwcSlotEntry;
+#pragma pack()
+AssertCompileSize(VwcSlotEntry, 64);
+AssertCompile(VWC_SECTORS_PER_BLOCK == 2 * 64);
+
+/** Marker for a free slot. */
+#define VWC_SLOT_FREE               UINT64_MAX
+
+/*******************************************************************************
+* Constants And Macros, Structures and Typedefs                                *
+*******************************************************************************/
+
+/**
+ * In memory state of a slot.
+ */
+typedef struct VWCSLOT
+{
+    /** AVL node core for the tree of mapped slots, the key is the block number. */
+    AVLRU64NODECORE     Core;
+    /** AVL node core for the tree of slots with dirty sectors. */
+    AVLRU64NODECORE     CoreDirty;
+    /** Bitmap of valid sectors. */
+    uint64_t            au64Valid[2];
+    /** Bitmap of dirty sectors. */
+    uint64_t            au64Dirty[2];
+    /** Generation, changed whenever data is written to the slot. */
+    uint64_t            uGen;
+    /** Index of the slot. */
+    uint32_t            idxSlot;
+    /** Number of dirty sectors. */
+    uint32_t            cDirty;
+    /** Number of pending writes and dirty reads for this slot. */
+    uint32_t            cIoPending;
+    /** Reclaim epoch of the last access. */
+    uint32_t            uLastAccess;
+    /** Access counter, halved on every reclaim run. */
+    uint8_t             cHits;
+    /** Flag whether the slot is in the tree of mapped slots. */
+    bool                fMapped;
+    /** Flag whether the slot is being evicted, i.e. is free after the next flush. */
+    bool                fEvicting;
+    /** Flag whether the free slot table entry is part of the active flush. */
+    bool                fEvictSnap;
+    /** Flag whether the slot is in the eviction list. */
+    bool                fEvictList;
+} VWCSLOT, *PVWCSLOT;
+
+/**
+ * VWC image data structure.
+ */
+typedef struct VWCCACHE
+{
+    /** Image name. */
+    const char         *pszFilename;
+    /** Storage handle. */
+    PVDIOSTORAGE        pStorage;
+
+    /** Pointer to the per-disk VD interface list. */
+    PVDINTERFACE        pVDIfsDisk;
+    /** Pointer to the per-image VD interface list. */
+    PVDINTERFACE        pVDIfsImage;
+    /** Error interface. */
+    PVDINTERFACEERROR   pIfError;
+    /** I/O interface. */
+    PVDINTERFACEIOINT   pIfIo;
+
+    /** Open flags passed by VBoxHD layer. */
+    unsigned            uOpenFlags;
+    /** Image flags defined during creation or determined during open. */
+    unsigned            uImageFlags;
+    /** Total size of the image. */
+    uint64_t            cbSize;
+
+    /** Lock protecting the slot state, I/O completions might run on any thread. */
+    RTCRITSECT          CritSect;
+    /** Generation of the current header copy. */
+    uint64_t            u64Generation;
+    /** UUID of the image. */
+    RTUUID              UuidImage;
+    /** Modification UUID. */
+    RTUUID              UuidModification;
+    /** Whether the in use flag is set in the header. */
+    bool                fHdrInUse;
+    /** Whether the header needs to be written on the next flush. */
+    bool                fHdrDirty;
+    /** Whether a flush is active. */
+    bool                fFlushActive;
+
+    /** Number of slots. */
+    uint32_t            cSlots;
+    /** Byte offset of the slot table. */
+    uint64_t            offSlotTable;
+    /** Byte offset of the first slot. */
+    uint64_t            offSlots;
+    /** Number of sectors in the slot table. */
+    uint32_t            cTableSectors;
+    /** Bitmap of slot table sectors which need to be written. */
+    uint32_t           *pbmTableDirty;
+    /** Array of slots. */
+    PVWCSLOT            paSlots;
+    /** Tree of mapped slots. */
+    AVLRU64TREE         TreeMapped;
+    /** Tree of slots holding dirty data. */
+    AVLRU64TREE         TreeDirty;
+    /** Stack of free slot indexes. */
+    uint32_t           *paidxFree;
+    /** Number of free slots. */
+    uint32_t            cFree;
+    /** Slots being evicted. */
+    uint32_t           *paidxEvict;
+    /** Number of entries in the eviction list. */
+    uint32_t            cEvict;
+    /** Number of dirty bytes. */
+    uint64_t            cbDirty;
+    /** Current reclaim epoch. */
+    uint32_t            uEpoch;
+    /** Scratch buffer for data which is not written to the cache. */
+    uint8_t            *pbScratch;
+} VWCCACHE, *PVWCCACHE;
+
+/**
+ * Write request state.
+ */
+typedef struct VWCWRITE
+{
+    /** The slot written. */
+    uint32_t            idxSlot;
+    /** First sector written. */
+    uint32_t            iSector;
+    /** Number of sectors written. */
+    uint32_t            cSectors;
+    /** Whether the data is dirty (write-back) or a copy of the image (populate). */
+    bool                fDirty;
+} VWCWRITE, *PVWCWRITE;
+
+/**
+ * Flush state.
+ *
+ * A flush with modified metadata flushes the data, writes a snapshot of the
+ * modified slot table sectors and the header and flushes again.
+ */
+typedef struct VWCFLUSH
+{
+    /** Number of metadata sectors to write. */
+    uint32_t            cSectors;
+    /** Number of writes still pending plus one while they are issued. */
+    volatile uint32_t   cWritesPending;
+    /** Status of the flush. */
+    volatile int32_t    rcFlush;
+    /** Whether the header is written. */
+    bool                fHdr;
+    /** The new header generation if fHdr is set. */
+    uint64_t            u64Generation;
+    /** Indexes of the slot table sectors, UINT32_MAX for the header. */
+    uint32_t           *paidxSector;
+    /** The sector data. */
+    uint8_t            *pbData;
+} VWCFLUSH, *PVWCFLUSH;
+
+
+/*********************************************************************************************************************************
+*   Static Variables                                                                                                             *
+*********************************************************************************************************************************/
+
+/** NULL-terminated array of supported file extensions. */
+static const char *const s_apszVwcFileExtensions[] =
+{
+    "vwc",
+    NULL
+};
+
+
+/*********************************************************************************************************************************
+*   Internal Functions                                                                                                           *
+*********************************************************************************************************************************/
+static DECLCALLBACK(int) vwcFlushMetaComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq);
+static DECLCALLBACK(int) vwcFlushFinalComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq);
+
+
+/**
+ * Returns the image offset of the given slot.
+ */
+DECLINLINE(uint64_t) vwcSlotOffset(PVWCCACHE pCache, PVWCSLOT pSlot)
+{
+    return pCache->offSlots + (uint64_t)pSlot->idxSlot * VWC_BLOCK_SIZE;
+}
+
+/**
+ * Marks the slot table sector holding the given slot for writing.
+ */
+DECLINLINE(void) vwcSlotSetTableDirty(PVWCCACHE pCache, PVWCSLOT pSlot)
+{
+    ASMBitSet(pCache->pbmTableDirty, pSlot->idxSlot / VWC_ENTRIES_PER_SECTOR);
+}
+
+/**
+ * Returns the number of consecutive sectors starting at @a iSector which have
+ * the given state in the bitmap.
+ */
+static uint32_t vwcBitmapRun(uint64_t const *pau64Bitmap, uint32_t iSector, uint32_t cSectorsMax, bool fSet)
+{
+    int iEnd;
+    if (fSet)
+        iEnd = ASMBitNextClear(pau64Bitmap, VWC_SECTORS_PER_BLOCK, iSector);
+    else
+        iEnd = ASMBitNextSet(pau64Bitmap, VWC_SECTORS_PER_BLOCK, iSector);
+    if (iEnd < 0)
+        iEnd = VWC_SECTORS_PER_BLOCK;
+    return RT_MIN((uint32_t)iEnd - iSector, cSectorsMax);
+}
+
+/**
+ * Looks up the slot holding the given block.
+ */
+DECLINLINE(PVWCSLOT) vwcSlotLookup(PVWCCACHE pCache, uint64_t uBlock)
+{
+    return (PVWCSLOT)RTAvlrU64Get(&pCache->TreeMapped, uBlock);
+}
+
+/**
+ * Sets or clears the dirty bits of a sector range, keeping the dirty counters
+ * and the dirty tree in sync.
+ */
+static void vwcSlotDirtySet(PVWCCACHE pCache, PVWCSLOT pSlot, uint32_t iSector, uint32_t cSectors, bool fDirty)
+{
+    uint32_t cDirtyOld = pSlot->cDirty;
+
+    for (uint32_t i = iSector; i < iSector + cSectors; i++)
+    {
+        if (fDirty && !ASMBitTestAndSet(pSlot->au64Dirty, i))
+            pSlot->cDirty++;
+        else if (!fDirty && ASMBitTestAndClear(pSlot->au64Dirty, i))
+            pSlot->cDirty--;
+    }
+
+    if (pSlot->cDirty != cDirtyOld)
+    {
+        pCache->cbDirty += ((int64_t)pSlot->cDirty - (int64_t)cDirtyOld) * VWC_SECTOR_SIZE;
+
+        if (!cDirtyOld)
+        {
+            pSlot->CoreDirty.Key     = pSlot->Core.Key;
+            pSlot->CoreDirty.KeyLast = pSlot->Core.Key;
+            bool fInserted = RTAvlrU64Insert(&pCache->TreeDirty, &pSlot->CoreDirty);
+            Assert(fInserted); NOREF(fInserted);
+        }
+        else if (!pSlot->cDirty)
+            RTAvlrU64Remove(&pCache->TreeDirty, pSlot->CoreDirty.Key);
+
+        vwcSlotSetTableDirty(pCache, pSlot);
+    }
+}
+
+/**
+ * Maps a free slot to the given block.
+ *
+ * @returns Pointer to the slot or NULL if there is no free slot.
+ */
+static PVWCSLOT vwcSlotAlloc(PVWCCACHE pCache, uint64_t uBlock)
+{
+    if (!pCache->cFree)
+        return NULL;
+
+    PVWCSLOT pSlot = &pCache->paSlots[pCache->paidxFree[--pCache->cFree]];
+    Assert(!pSlot->fMapped && !pSlot->cDirty && !pSlot->cIoPending);
+
+    pSlot->Core.Key     = uBlock;
+    pSlot->Core.KeyLast = uBlock;
+    pSlot->au64Valid[0] = 0;
+    pSlot->au64Valid[1] = 0;
+    pSlot->cHits        = 1;
+    pSlot->uLastAccess  = pCache->uEpoch;
+    pSlot->fMapped      = RTAvlrU64Insert(&pCache->TreeMapped, &pSlot->Core);
+    Assert(pSlot->fMapped);
+    vwcSlotSetTableDirty(pCache, pSlot);
+    return pSlot;
+}
+
+/**
+ * Makes a slot being evicted usable again because the block was written.
+ */
+static void vwcSlotRevive(PVWCCACHE pCache, PVWCSLOT pSlot)
+{
+    Assert(pSlot->fEvicting);
+    pSlot->fEvicting   = false;
+    pSlot->fEvictSnap  = false;
+    pSlot->cHits       = 1;
+    pSlot->uLastAccess = pCache->uEpoch;
+    vwcSlotSetTableDirty(pCache, pSlot);
+}
+
+/**
+ * Builds the on disk slot table entry of the given slot.
+ */
+static void vwcSlotEntryBuild(PVWCCACHE pCache, uint32_t idxSlot, VwcSlotEntry *pEntry)
+{
+    memset(pEntry, 0, sizeof(*pEntry));
+    pEntry->u64Block = RT_H2LE_U64(VWC_SLOT_FREE);
+    if (idxSlot < pCache->cSlots)
+    {
+        PVWCSLOT pSlot = &pCache->paSlots[idxSlot];
+        if (pSlot->fMapped && !pSlot->fEvicting)
+        {
+            pEntry->u64Block     = RT_H2LE_U64(pSlot->Core.Key);
+            pEntry->au64Valid[0] = RT_H2LE_U64(pSlot->au64Valid[0]);
+            pEntry->au64Valid[1] = RT_H2LE_U64(pSlot->au64Valid[1]);
+            pEntry->au64Dirty[0] = RT_H2LE_U64(pSlot->au64Dirty[0]);
+            pEntry->au64Dirty[1] = RT_H2LE_U64(pSlot->au64Dirty[1]);
+        }
+    }
+    pEntry->u32Crc = RT_H2LE_U32(RTCrc32C(pEntry, RT_OFFSETOF(VwcSlotEntry, u32Crc)));
+}
+
+/**
+ * Builds the header for the given generation.
+ */
+static void vwcHdrBuild(PVWCCACHE pCache, uint64_t u64Generation, VwcHdr *pHdr)
+{
+    memset(pHdr, 0, sizeof(*pHdr));
+    pHdr->u32Signature     = RT_H2LE_U32(VWC_HDR_SIGNATURE);
+    pHdr->u32Version       = RT_H2LE_U32(VWC_HDR_VERSION);
+    pHdr->u64Generation    = RT_H2LE_U64(u64Generation);
+    pHdr->fFlags           = RT_H2LE_U32(pCache->fHdrInUse ? VWC_HDR_F_IN_USE : 0);
+    pHdr->cSlots           = RT_H2LE_U32(pCache->cSlots);
+    pHdr->cbSlot           = RT_H2LE_U32(VWC_BLOCK_SIZE);
+    pHdr->offSlotTable     = RT_H2LE_U64(pCache->offSlotTable);
+    pHdr->offSlots         = RT_H2LE_U64(pCache->offSlots);
+    pHdr->UuidImage        = pCache->UuidImage;
+    pHdr->UuidModification = pCache->UuidModification;
+    pHdr->u32Crc           = RT_H2LE_U32(RTCrc32C(pHdr, RT_OFFSETOF(VwcHdr, u32Crc)));
+}
+
+/**
+ * Internal. Finishes a flush, committing or reverting the metadata state.
+ */
+static void vwcFlushFinish(PVWCCACHE pCache, PVWCFLUSH pFlush, int rc)
+{
+    RTCritSectEnter(&pCache->CritSect);
+
+    if (RT_SUCCESS(rc))
+    {
+        if (pFlush->fHdr)
+            pCache->u64Generation = pFlush->u64Generation;
+
+        /* The free entries of evicted slots are on the medium now, the slots can be reused. */
+        uint32_t cEvict = 0;
+        for (uint32_t i = 0; i < pCache->cEvict; i++)
+        {
+            PVWCSLOT pSlot = &pCache->paSlots[pCache->paidxEvict[i]];
+            if (pSlot->fEvicting && pSlot->fEvictSnap)
+            {
+                Assert(!pSlot->cDirty && !pSlot->cIoPending);
+                RTAvlrU64Remove(&pCache->TreeMapped, pSlot->Core.Key);
+                pSlot->fMapped    = false;
+                pSlot->fEvicting  = false;
+                pSlot->fEvictSnap = false;
+                pSlot->fEvictList = false;
+                pCache->paidxFree[pCache->cFree++] = pSlot->idxSlot;
+            }
+            else if (pSlot->fEvicting)
+                pCache->paidxEvict[cEvict++] = pSlot->idxSlot;
+            else
+                pSlot->fEvictList = false;
+        }
+        pCache->cEvict = cEvict;
+    }
+    else
+    {
+        LogRel(("VWC: Flushing '%s' failed with %Rrc\n", pCache->pszFilename, rc));
+        for (uint32_t i = 0; i < pFlush->cSectors; i++)
+        {
+            if (pFlush->paidxSector[i] != UINT32_MAX)
+                ASMBitSet(pCache->pbmTableDirty, pFlush->paidxSector[i]);
+        }
+        if (pFlush->fHdr)
+            pCache->fHdrDirty = true;
+        for (uint32_t i = 0; i < pCache->cEvict; i++)
+            pCache->paSlots[pCache->paidxEvict[i]].fEvictSnap = false;
+    }
+
+    pCache->fFlushActive = false;
+    RTCritSectLeave(&pCache->CritSect);
+
+    RTMemFree(pFlush->paidxSector);
+    RTMemFree(pFlush->pbData);
+    RTMemFree(pFlush);
+}
+
+/**
+ * Internal. Takes a snapshot of the modified metadata for a flush.
+ *
+ * @returns VBox status code.
+ * @param   pCache      The cache image.
+ * @param   ppFlush     Where to store the flush state, NULL if no metadata
+ *                      needs to be written.
+ */
+static int vwcFlushPrepare(PVWCCACHE pCache, PVWCFLUSH *ppFlush)
+{
+    int rc = VINF_SUCCESS;
+    uint32_t cSectors = pCache->fHdrDirty ? 1 : 0;
+
+    *ppFlush = NULL;
+
+    RTCritSectEnter(&pCache->CritSect);
+    Assert(!pCache->fFlushActive);
+
+    int iSector = ASMBitFirstSet(pCache->pbmTableDirty, RT_ALIGN_32(pCache->cTableSectors, 32));
+    while (iSector >= 0)
+    {
+        cSectors++;
+        iSector = ASMBitNextSet(pCache->pbmTableDirty, RT_ALIGN_32(pCache->cTableSectors, 32), iSector);
+    }
+
+    if (cSectors)
+    {
+        PVWCFLUSH pFlush = (PVWCFLUSH)RTMemAllocZ(sizeof(VWCFLUSH));
+        if (pFlush)
+        {
+            pFlush->paidxSector = (uint32_t *)RTMemAlloc(cSectors * sizeof(uint32_t));
+            pFlush->pbData      = (uint8_t *)RTMemAlloc(cSectors * VWC_SECTOR_SIZE);
+        }
+        if (pFlush && pFlush->paidxSector && pFlush->pbData)
+        {
+            iSector = ASMBitFirstSet(pCache->pbmTableDirty, RT_ALIGN_32(pCache->cTableSectors, 32));
+            while (iSector >= 0)
+            {
+                VwcSlotEntry *paEntries = (VwcSlotEntry *)&pFlush->pbData[pFlush->cSectors * VWC_SECTOR_SIZE];
+                for (uint32_t i = 0; i < VWC_ENTRIES_PER_SECTOR; i++)
+                    vwcSlotEntryBuild(pCache, iSector * VWC_ENTRIES_PER_SECTOR + i, &paEntries[i]);
+                pFlush->paidxSector[pFlush->cSectors++] = iSector;
+                ASMBitClear(pCache->pbmTableDirty, iSector);
+                iSector = ASMBitNextSet(pCache->pbmTableDirty, RT_ALIGN_32(pCache->cTableSectors, 32), iSector);
+            }
+
+            if (pCache->fHdrDirty)
+            {
+                pFlush->fHdr          = true;
+                pFlush->u64Generation = pCache->u64Generation + 1;
+                vwcHdrBuild(pCache, pFlush->u64Generation, (VwcHdr *)&pFlush->pbData[pFlush->cSectors * VWC_SECTOR_SIZE]);
+                pFlush->paidxSector[pFlush->cSectors++] = UINT32_MAX;
+                pCache->fHdrDirty = false;
+            }
+            Assert(pFlush->cSectors == cSectors);
+
+            /* The free entries of the slots being evicted are written with this flush. */
+            for (uint32_t i = 0; i < pCache->cEvict; i++)
+            {
+                PVWCSLOT pSlot = &pCache->paSlots[pCache->paidxEvict[i]];
+                pSlot->fEvictSnap = pSlot->fEvicting;
+            }
+
+            pCache->fFlushActive = true;
+            *ppFlush = pFlush;
+        }
+        else
+        {
+            if (pFlush)
+            {
+                RTMemFree(pFlush->paidxSector);
+                RTMemFree(pFlush->pbData);
+                RTMemFree(pFlush);
+            }
+            rc = VERR_NO_MEMORY;
+        }
+    }
+
+    RTCritSectLeave(&pCache->CritSect);
+    return rc;
+}
+
+/**
+ * Internal. Issues the final flush after the metadata was written.
+ */
+static int vwcFlushFinal(PVWCCACHE pCache, PVDIOCTX pIoCtx, PVWCFLUSH pFlush)
+{
+    int rc = pFlush->rcFlush;
+    if (RT_SUCCESS(rc))
+    {
+        rc = vdIfIoIntFileFlush(pCache->pIfIo, pCache->pStorage, pIoCtx, vwcFlushFinalComplete, pFlush);
+        if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+            return rc;
+    }
+
+    vwcFlushFinish(pCache, pFlush, rc);
+    return rc;
+}
+
+/**
+ * Internal. Writes the metadata snapshot after the data was flushed.
+ */
+static int vwcFlushWriteMeta(PVWCCACHE pCache, PVDIOCTX pIoCtx, PVWCFLUSH pFlush)
+{
+    int rc = VINF_SUCCESS;
+
+    /* Bias the counter so completions can't finish the flush while writes are still issued. */
+    ASMAtomicWriteU32(&pFlush->cWritesPending, 1);
+
+    for (uint32_t i = 0; i < pFlush->cSectors; i++)
+    {
+        uint64_t off =   pFlush->paidxSector[i] == UINT32_MAX
+                       ? (pFlush->u64Generation & 1) * VWC_SECTOR_SIZE
+                       : pCache->offSlotTable + (uint64_t)pFlush->paidxSector[i] * VWC_SECTOR_SIZE;
+
+        ASMAtomicIncU32(&pFlush->cWritesPending);
+        rc = vdIfIoIntFileWriteMeta(pCache->pIfIo, pCache->pStorage, off,
+                                    &pFlush->pbData[i * VWC_SECTOR_SIZE], VWC_SECTOR_SIZE,
+                                    pIoCtx, vwcFlushMetaComplete, pFlush);
+        if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+            continue;
+
+        ASMAtomicDecU32(&pFlush->cWritesPending);
+        if (RT_FAILURE(rc))
+        {
+            ASMAtomicCmpXchgS32(&pFlush->rcFlush, rc, VINF_SUCCESS);
+            break;
+        }
+    }
+
+    if (!ASMAtomicDecU32(&pFlush->cWritesPending))
+        return vwcFlushFinal(pCache, pIoCtx, pFlush);
+
+    return VERR_VD_ASYNC_IO_IN_PROGRESS;
+}
+
+/**
+ * @callback_method_impl{FNVDXFERCOMPLETED, Data flush completed.}
+ */
+static DECLCALLBACK(int) vwcFlushDataComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq)
+{
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    PVWCFLUSH pFlush = (PVWCFLUSH)pvUser;
+    int rc = VINF_SUCCESS;
+
+    if (RT_SUCCESS(rcReq))
+    {
+        rc = vwcFlushWriteMeta(pCache, pIoCtx, pFlush);
+        if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+            rc = VINF_SUCCESS;
+    }
+    else
+        vwcFlushFinish(pCache, pFlush, rcReq);
+
+    return rc;
+}
+
+/**
+ * @callback_method_impl{FNVDXFERCOMPLETED, Metadata sector written.}
+ */
+static DECLCALLBACK(int) vwcFlushMetaComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq)
+{
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    PVWCFLUSH pFlush = (PVWCFLUSH)pvUser;
+    int rc = VINF_SUCCESS;
+
+    if (RT_FAILURE(rcReq))
+        ASMAtomicCmpXchgS32(&pFlush->rcFlush, rcReq, VINF_SUCCESS);
+
+    if (!ASMAtomicDecU32(&pFlush->cWritesPending))
+    {
+        rc = vwcFlushFinal(pCache, pIoCtx, pFlush);
+        if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+            rc = VINF_SUCCESS;
+    }
+
+    return rc;
+}
+
+/**
+ * @callback_method_impl{FNVDXFERCOMPLETED, Final flush completed.}
+ */
+static DECLCALLBACK(int) vwcFlushFinalComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq)
+{
+    RT_NOREF1(pIoCtx);
+    vwcFlushFinish((PVWCCACHE)pBackendData, (PVWCFLUSH)pvUser, rcReq);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Flushes the cache, writing the modified metadata in the right order.
+ *
+ * @returns VBox status code.
+ * @param   pCache      The cache image.
+ * @param   pIoCtx      The I/O context, NULL for a synchronous flush.
+ */
+static int vwcFlushImage(PVWCCACHE pCache, PVDIOCTX pIoCtx)
+{
+    PVWCFLUSH pFlush = NULL;
+    int rc = vwcFlushPrepare(pCache, &pFlush);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    if (!pFlush)
+        return vdIfIoIntFileFlush(pCache->pIfIo, pCache->pStorage, pIoCtx, NULL, NULL);
+
+    rc = vdIfIoIntFileFlush(pCache->pIfIo, pCache->pStorage, pIoCtx, vwcFlushDataComplete, pFlush);
+    if (rc == VINF_SUCCESS)
+        rc = vwcFlushWriteMeta(pCache, pIoCtx, pFlush);
+    else if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+        vwcFlushFinish(pCache, pFlush, rc);
+
+    return rc;
+}
+
+/**
+ * @callback_method_impl{FNVDXFERCOMPLETED, Slot data written.}
+ */
+static DECLCALLBACK(int) vwcWriteComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq)
+{
+    RT_NOREF1(pIoCtx);
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    PVWCWRITE pReq   = (PVWCWRITE)pvUser;
+
+    RTCritSectEnter(&pCache->CritSect);
+
+    PVWCSLOT pSlot = &pCache->paSlots[pReq->idxSlot];
+    Assert(pSlot->cIoPending > 0);
+
+    if (RT_SUCCESS(rcReq))
+    {
+        ASMBitSetRange(pSlot->au64Valid, pReq->iSector, pReq->iSector + pReq->cSectors);
+        if (pReq->fDirty)
+            vwcSlotDirtySet(pCache, pSlot, pReq->iSector, pReq->cSectors, true /* fDirty */);
+    }
+    else
+    {
+        /* The content is undefined, fall back to the image. */
+        ASMBitClearRange(pSlot->au64Valid, pReq->iSector, pReq->iSector + pReq->cSectors);
+        vwcSlotDirtySet(pCache, pSlot, pReq->iSector, pReq->cSectors, false /* fDirty */);
+    }
+    vwcSlotSetTableDirty(pCache, pSlot);
+    pSlot->uGen++;
+    pSlot->cIoPending--;
+
+    RTCritSectLeave(&pCache->CritSect);
+    RTMemFree(pReq);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Writes data from the I/O context into a slot.
+ *
+ * @returns VBox status code.
+ * @param   pCache      The cache image.
+ * @param   pSlot       The slot to write to.
+ * @param   iSector     The first sector in the slot.
+ * @param   cbWrite     Number of bytes to write, limited to what fits into a
+ *                      single I/O task on return.
+ * @param   pIoCtx      The I/O context.
+ * @param   fDirty      Whether the data is dirty.
+ */
+static int vwcSlotWrite(PVWCCACHE pCache, PVWCSLOT pSlot, uint32_t iSector, size_t *pcbWrite,
+                        PVDIOCTX pIoCtx, bool fDirty)
+{
+    size_t cbWrite = *pcbWrite;
+
+    /* The completion must be called exactly once, so limit the write to a single task. */
+    for (;;)
+    {
+        unsigned cSegments = 0;
+        vdIfIoIntIoCtxSegArrayCreate(pCache->pIfIo, pIoCtx, NULL, &cSegments, cbWrite);
+        if (cSegments <= VWC_SEGMENTS_MAX || cbWrite <= VWC_SECTOR_SIZE)
+            break;
+        cbWrite = RT_ALIGN_Z(cbWrite / 2, VWC_SECTOR_SIZE);
+    }
+
+    PVWCWRITE pReq = (PVWCWRITE)RTMemAlloc(sizeof(VWCWRITE));
+    if (!pReq)
+        return VERR_NO_MEMORY;
+
+    pReq->idxSlot  = pSlot->idxSlot;
+    pReq->iSector  = iSector;
+    pReq->cSectors = (uint32_t)(cbWrite / VWC_SECTOR_SIZE);
+    pReq->fDirty   = fDirty;
+
+    pSlot->cIoPending++;
+    pSlot->uGen++;
+    pSlot->uLastAccess = pCache->uEpoch;
+
+    int rc = vdIfIoIntFileWriteUser(pCache->pIfIo, pCache->pStorage,
+                                    vwcSlotOffset(pCache, pSlot) + iSector * VWC_SECTOR_SIZE,
+                                    pIoCtx, cbWrite, vwcWriteComplete, pReq);
+    if (rc == VINF_SUCCESS)
+        vwcWriteComplete(pCache, pIoCtx, pReq, VINF_SUCCESS);
+    else if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+    {
+        pSlot->cIoPending--;
+        RTMemFree(pReq);
+    }
+
+    *pcbWrite = cbWrite;
+    return rc;
+}
+
+/**
+ * Internal. Allocates the in memory structures for the given number of slots.
+ */
+static int vwcAllocStructures(PVWCCACHE pCache, uint32_t cSlots)
+{
+    pCache->cSlots        = cSlots;
+    pCache->cTableSectors = (cSlots + VWC_ENTRIES_PER_SECTOR - 1) / VWC_ENTRIES_PER_SECTOR;
+    pCache->cbSize        = (uint64_t)cSlots * VWC_BLOCK_SIZE;
+
+    pCache->paSlots       = (PVWCSLOT)RTMemAllocZ(cSlots * sizeof(VWCSLOT));
+    pCache->paidxFree     = (uint32_t *)RTMemAlloc(cSlots * sizeof(uint32_t));
+    pCache->paidxEvict    = (uint32_t *)RTMemAlloc(cSlots * sizeof(uint32_t));
+    pCache->pbmTableDirty = (uint32_t *)RTMemAllocZ(RT_ALIGN_32(pCache->cTableSectors, 32) / 8);
+    pCache->pbScratch     = (uint8_t *)RTMemAlloc(VWC_BLOCK_SIZE);
+    if (   !pCache->paSlots
+        || !pCache->paidxFree
+        || !pCache->paidxEvict
+        || !pCache->pbmTableDirty
+        || !pCache->pbScratch)
+        return VERR_NO_MEMORY;
+
+    for (uint32_t i = 0; i < cSlots; i++)
+        pCache->paSlots[i].idxSlot = i;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Free all allocated space for representing an image except pCache,
+ * and optionally delete the image from disk.
+ */
+static int vwcFreeImage(PVWCCACHE pCache, bool fDelete)
+{
+    int rc = VINF_SUCCESS;
+
+    /* Freeing a never allocated image (e.g. because the open failed) is
+     * not signalled as an error. After all nothing bad happens. */
+    if (pCache)
+    {
+        if (pCache->pStorage)
+        {
+            /* No point updating the file that is deleted anyway. */
+            if (   !fDelete
+                && !(pCache->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+                && pCache->paSlots)
+            {
+                /* Mark the cache as closed cleanly, dirty data stays valid. */
+                pCache->fHdrInUse = false;
+                pCache->fHdrDirty = true;
+                rc = vwcFlushImage(pCache, NULL);
+            }
+
+            vdIfIoIntFileClose(pCache->pIfIo, pCache->pStorage);
+            pCache->pStorage = NULL;
+        }
+
+        if (fDelete && pCache->pszFilename)
+            vdIfIoIntFileDelete(pCache->pIfIo, pCache->pszFilename);
+
+        RTMemFree(pCache->paSlots);
+        RTMemFree(pCache->paidxFree);
+        RTMemFree(pCache->paidxEvict);
+        RTMemFree(pCache->pbmTableDirty);
+        RTMemFree(pCache->pbScratch);
+        pCache->paSlots       = NULL;
+        pCache->paidxFree     = NULL;
+        pCache->paidxEvict    = NULL;
+        pCache->pbmTableDirty = NULL;
+        pCache->pbScratch     = NULL;
+        pCache->TreeMapped    = NULL;
+        pCache->TreeDirty     = NULL;
+        pCache->cFree         = 0;
+        pCache->cEvict        = 0;
+        pCache->cbDirty       = 0;
+
+        if (RTCritSectIsInitialized(&pCache->CritSect))
+            RTCritSectDelete(&pCache->CritSect);
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Internal. Reads both header copies and returns the current one.
+ */
+static int vwcHdrLoad(PVDINTERFACEIOINT pIfIo, PVDIOSTORAGE pStorage, VwcHdr *pHdr)
+{
+    VwcHdr aHdrs[2];
+    int rc = vdIfIoIntFileReadSync(pIfIo, pStorage, 0, &aHdrs[0], sizeof(aHdrs));
+    if (RT_FAILURE(rc))
+        return VERR_VD_GEN_INVALID_HEADER;
+
+    int iHdr = -1;
+    for (int i = 0; i < 2; i++)
+    {
+        if (   RT_LE2H_U32(aHdrs[i].u32Signature) != VWC_HDR_SIGNATURE
+            || RT_LE2H_U32(aHdrs[i].u32Version) != VWC_HDR_VERSION
+            || RT_LE2H_U32(aHdrs[i].u32Crc) != RTCrc32C(&aHdrs[i], RT_OFFSETOF(VwcHdr, u32Crc)))
+            continue;
+        if (   iHdr < 0
+            || RT_LE2H_U64(aHdrs[i].u64Generation) > RT_LE2H_U64(aHdrs[iHdr].u64Generation))
+            iHdr = i;
+    }
+
+    if (iHdr < 0)
+        return VERR_VD_GEN_INVALID_HEADER;
+
+    *pHdr = aHdrs[iHdr];
+    pHdr->u32Signature  = RT_LE2H_U32(pHdr->u32Signature);
+    pHdr->u32Version    = RT_LE2H_U32(pHdr->u32Version);
+    pHdr->u64Generation = RT_LE2H_U64(pHdr->u64Generation);
+    pHdr->fFlags        = RT_LE2H_U32(pHdr->fFlags);
+    pHdr->cSlots        = RT_LE2H_U32(pHdr->cSlots);
+    pHdr->cbSlot        = RT_LE2H_U32(pHdr->cbSlot);
+    pHdr->offSlotTable  = RT_LE2H_U64(pHdr->offSlotTable);
+    pHdr->offSlots      = RT_LE2H_U64(pHdr->offSlots);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Loads the slot table and rebuilds the in memory state.
+ */
+static int vwcSlotTableLoad(PVWCCACHE pCache, bool fRecover)
+{
+    int rc = VINF_SUCCESS;
+    uint32_t cBad = 0;
+    uint32_t cDuplicates = 0;
+    uint32_t idxSlot = 0;
+
+    for (uint32_t iSector = 0; iSector < pCache->cTableSectors && RT_SUCCESS(rc);)
+    {
+        uint32_t cSectors = RT_MIN(pCache->cTableSectors - iSector, VWC_BLOCK_SIZE / VWC_SECTOR_SIZE);
+
+        rc = vdIfIoIntFileReadSync(pCache->pIfIo, pCache->pStorage,
+                                   pCache->offSlotTable + (uint64_t)iSector * VWC_SECTOR_SIZE,
+                                   pCache->pbScratch, cSectors * VWC_SECTOR_SIZE);
+        if (RT_FAILURE(rc))
+            break;
+
+        VwcSlotEntry *paEntries = (VwcSlotEntry *)pCache->pbScratch;
+        for (uint32_t i = 0; i < cSectors * VWC_ENTRIES_PER_SECTOR && idxSlot < pCache->cSlots; i++, idxSlot++)
+        {
+            PVWCSLOT pSlot = &pCache->paSlots[idxSlot];
+            VwcSlotEntry *pEntry = &paEntries[i];
+
+            if (RT_LE2H_U32(pEntry->u32Crc) != RTCrc32C(pEntry, RT_OFFSETOF(VwcSlotEntry, u32Crc)))
+            {
+                cBad++;
+                vwcSlotSetTableDirty(pCache, pSlot);
+                pCache->paidxFree[pCache->cFree++] = idxSlot;
+                continue;
+            }
+
+            uint64_t u64Block = RT_LE2H_U64(pEntry->u64Block);
+            if (u64Block == VWC_SLOT_FREE)
+            {
+                pCache->paidxFree[pCache->cFree++] = idxSlot;
+                continue;
+            }
+
+            pSlot->Core.Key     = u64Block;
+            pSlot->Core.KeyLast = u64Block;
+            if (!RTAvlrU64Insert(&pCache->TreeMapped, &pSlot->Core))
+            {
+                cDuplicates++;
+                vwcSlotSetTableDirty(pCache, pSlot);
+                pCache->paidxFree[pCache->cFree++] = idxSlot;
+                continue;
+            }
+
+            pSlot->fMapped      = true;
+            pSlot->cHits        = 1;
+            pSlot->au64Valid[0] = RT_LE2H_U64(pEntry->au64Valid[0]);
+            pSlot->au64Valid[1] = RT_LE2H_U64(pEntry->au64Valid[1]);
+            uint64_t au64Dirty[2];
+            au64Dirty[0] = RT_LE2H_U64(pEntry->au64Dirty[0]) & pSlot->au64Valid[0];
+            au64Dirty[1] = RT_LE2H_U64(pEntry->au64Dirty[1]) & pSlot->au64Valid[1];
+            if (fRecover)
+            {
+                /* A destage might have been interrupted, write everything to the image again. */
+                au64Dirty[0] = pSlot->au64Valid[0];
+                au64Dirty[1] = pSlot->au64Valid[1];
+            }
+
+            int iDirty = ASMBitFirstSet(au64Dirty, VWC_SECTORS_PER_BLOCK);
+            while (iDirty >= 0)
+            {
+                vwcSlotDirtySet(pCache, pSlot, iDirty, 1, true /* fDirty */);
+                iDirty = ASMBitNextSet(au64Dirty, VWC_SECTORS_PER_BLOCK, iDirty);
+            }
+        }
+
+        iSector += cSectors;
+    }
+
+    /* The free stack is popped from the end, hand out the slots in ascending order. */
+    for (uint32_t i = 0; i < pCache->cFree / 2; i++)
+    {
+        uint32_t idxTmp = pCache->paidxFree[i];
+        pCache->paidxFree[i] = pCache->paidxFree[pCache->cFree - i - 1];
+        pCache->paidxFree[pCache->cFree - i - 1] = idxTmp;
+    }
+
+    if (cBad || cDuplicates)
+        LogRel(("VWC: '%s' has %u damaged and %u duplicate slot table entries, dropped\n",
+                pCache->pszFilename, cBad, cDuplicates));
+    if (fRecover)
+        LogRel(("VWC: '%s' was not closed cleanly, %llu bytes of cached data are written to the image again\n",
+                pCache->pszFilename, pCache->cbDirty));
+    else if (!(pCache->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+    {
+        /* Only the sectors changed by the load need to be written. */
+        if (!cBad && !cDuplicates)
+            memset(pCache->pbmTableDirty, 0, RT_ALIGN_32(pCache->cTableSectors, 32) / 8);
+    }
+
+    return rc;
+}
+
+/**
+ * Internal: Open an image, constructing all necessary data structures.
+ */
+static int vwcOpenImage(PVWCCACHE pCache, unsigned uOpenFlags)
+{
+    VwcHdr Hdr;
+    uint64_t cbFile;
+    int rc;
+
+    pCache->uOpenFlags = uOpenFlags;
+
+    pCache->pIfError = VDIfErrorGet(pCache->pVDIfsDisk);
+    pCache->pIfIo = VDIfIoIntGet(pCache->pVDIfsImage);
+    AssertPtrReturn(pCache->pIfIo, VERR_INVALID_PARAMETER);
+
+    rc = RTCritSectInit(&pCache->CritSect);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /*
+     * Open the image.
+     */
+    rc = vdIfIoIntFileOpen(pCache->pIfIo, pCache->pszFilename,
+                           VDOpenFlagsToFileOpenFlags(uOpenFlags,
+                                                      false /* fCreate */),
+                           &pCache->pStorage);
+    if (RT_FAILURE(rc))
+    {
+        /* Do NOT signal an appropriate error here, as the VD layer has the
+         * choice of retrying the open if it failed. */
+        goto out;
+    }
+
+    rc = vdIfIoIntFileGetSize(pCache->pIfIo, pCache->pStorage, &cbFile);
+    if (RT_FAILURE(rc) || cbFile < 2 * sizeof(VwcHdr))
+    {
+        rc = VERR_VD_GEN_INVALID_HEADER;
+        goto out;
+    }
+
+    rc = vwcHdrLoad(pCache->pIfIo, pCache->pStorage, &Hdr);
+    if (RT_FAILURE(rc))
+        goto out;
+
+    if (   Hdr.cbSlot != VWC_BLOCK_SIZE
+        || !Hdr.cSlots
+        || Hdr.offSlotTable < 2 * sizeof(VwcHdr)
+        || Hdr.offSlots < Hdr.offSlotTable + (uint64_t)Hdr.cSlots * sizeof(VwcSlotEntry)
+        || cbFile < Hdr.offSlots + (uint64_t)Hdr.cSlots * VWC_BLOCK_SIZE)
+    {
+        rc = vdIfError(pCache->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
+                       N_("VWC: inconsistent header in '%s'"), pCache->pszFilename);
+        goto out;
+    }
+
+    pCache->u64Generation    = Hdr.u64Generation;
+    pCache->offSlotTable     = Hdr.offSlotTable;
+    pCache->offSlots         = Hdr.offSlots;
+    pCache->UuidImage        = Hdr.UuidImage;
+    pCache->UuidModification = Hdr.UuidModification;
+    pCache->fHdrInUse        = RT_BOOL(Hdr.fFlags & VWC_HDR_F_IN_USE);
+
+    rc = vwcAllocStructures(pCache, Hdr.cSlots);
+    if (RT_FAILURE(rc))
+        goto out;
+
+    rc = vwcSlotTableLoad(pCache,    pCache->fHdrInUse
+                                  && !(uOpenFlags & VD_OPEN_FLAGS_READONLY));
+    if (RT_FAILURE(rc))
+        goto out;
+
+    if (!(uOpenFlags & VD_OPEN_FLAGS_READONLY))
+    {
+        /* Anything written from now on is only consistent after a flush. */
+        pCache->fHdrInUse = true;
+        pCache->fHdrDirty = true;
+        rc = vwcFlushImage(pCache, NULL);
+    }
+
+out:
+    if (RT_FAILURE(rc))
+        vwcFreeImage(pCache, false);
+    return rc;
+}
+
+/**
+ * Internal: Create a vwc image.
+ */
+static int vwcCreateImage(PVWCCACHE pCache, uint64_t cbSize, PCRTUUID pUuid,
+                          unsigned uImageFlags, unsigned uOpenFlags,
+                          PFNVDPROGRESS pfnProgress, void *pvUser,
+                          unsigned uPercentStart, unsigned uPercentSpan)
+{
+    int rc;
+    uint64_t cSlots = cbSize / VWC_BLOCK_SIZE;
+
+    pCache->uImageFlags = uImageFlags;
+    pCache->uOpenFlags = uOpenFlags & ~VD_OPEN_FLAGS_READONLY;
+
+    pCache->pIfError = VDIfErrorGet(pCache->pVDIfsDisk);
+    pCache->pIfIo = VDIfIoIntGet(pCache->pVDIfsImage);
+    AssertPtrReturn(pCache->pIfIo, VERR_INVALID_PARAMETER);
+
+    if (uImageFlags & VD_IMAGE_FLAGS_DIFF)
+        return vdIfError(pCache->pIfError, VERR_VD_RAW_INVALID_TYPE, RT_SRC_POS,
+                         N_("VWC: cannot create diff image '%s'"), pCache->pszFilename);
+
+    if (!cSlots || cSlots >= UINT32_MAX)
+        return vdIfError(pCache->pIfError, VERR_VD_INVALID_SIZE, RT_SRC_POS,
+                         N_("VWC: invalid cache size %llu for '%s'"), cbSize, pCache->pszFilename);
+
+    rc = RTCritSectInit(&pCache->CritSect);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    do
+    {
+        /* Create image file. */
+        rc = vdIfIoIntFileOpen(pCache->pIfIo, pCache->pszFilename,
+                               VDOpenFlagsToFileOpenFlags(uOpenFlags & ~VD_OPEN_FLAGS_READONLY,
+                                                          true /* fCreate */),
+                               &pCache->pStorage);
+        if (RT_FAILURE(rc))
+        {
+            rc = vdIfError(pCache->pIfError, rc, RT_SRC_POS, N_("VWC: cannot create image '%s'"), pCache->pszFilename);
+            break;
+        }
+
+        rc = vwcAllocStructures(pCache, (uint32_t)cSlots);
+        if (RT_FAILURE(rc))
+        {
+            rc = vdIfError(pCache->pIfError, rc, RT_SRC_POS, N_("VWC: cannot allocate slot state for '%s'"), pCache->pszFilename);
+            break;
+        }
+
+        pCache->offSlotTable = VWC_SLOT_TABLE_OFFSET;
+        pCache->offSlots     = RT_ALIGN_64(pCache->offSlotTable + (uint64_t)pCache->cTableSectors * VWC_SECTOR_SIZE,
+                                           VWC_BLOCK_SIZE);
+        if (pUuid)
+            pCache->UuidImage = *pUuid;
+        else
+            RTUuidCreate(&pCache->UuidImage);
+        RTUuidClear(&pCache->UuidModification);
+
+        rc = vdIfIoIntFileSetSize(pCache->pIfIo, pCache->pStorage, pCache->offSlots + pCache->cbSize);
+        if (RT_FAILURE(rc))
+        {
+            rc = vdIfError(pCache->pIfError, rc, RT_SRC_POS, N_("VWC: cannot set the file size of '%s'"), pCache->pszFilename);
+            break;
+        }
+
+        /* All slots are free, write the complete table and the header. */
+        for (uint32_t i = 0; i < pCache->cSlots; i++)
+            pCache->paidxFree[pCache->cFree++] = pCache->cSlots - i - 1;
+        ASMBitSetRange(pCache->pbmTableDirty, 0, pCache->cTableSectors);
+        pCache->fHdrInUse = true;
+        pCache->fHdrDirty = true;
+
+        rc = vwcFlushImage(pCache, NULL);
+        if (RT_FAILURE(rc))
+        {
+            rc = vdIfError(pCache->pIfError, rc, RT_SRC_POS, N_("VWC: cannot write the slot table of '%s'"), pCache->pszFilename);
+            break;
+        }
+    } while (0);
+
+    if (RT_SUCCESS(rc) && pfnProgress)
+        pfnProgress(pvUser, uPercentStart + uPercentSpan);
+
+    if (RT_FAILURE(rc))
+        vwcFreeImage(pCache, rc != VERR_ALREADY_EXISTS);
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnProbe */
+static DECLCALLBACK(int) vwcProbe(const char *pszFilename, PVDINTERFACE pVDIfsDisk,
+                                  PVDINTERFACE pVDIfsImage)
+{
+    RT_NOREF1(pVDIfsDisk);
+    VwcHdr Hdr;
+    PVDIOSTORAGE pStorage = NULL;
+    uint64_t cbFile;
+    int rc = VINF_SUCCESS;
+
+    LogFlowFunc(("pszFilename=\"%s\"\n", pszFilename));
+
+    PVDINTERFACEIOINT pIfIo = VDIfIoIntGet(pVDIfsImage);
+    AssertPtrReturn(pIfIo, VERR_INVALID_PARAMETER);
+
+    rc = vdIfIoIntFileOpen(pIfIo, pszFilename,
+                           VDOpenFlagsToFileOpenFlags(VD_OPEN_FLAGS_READONLY,
+                                                      false /* fCreate */),
+                           &pStorage);
+    if (RT_FAILURE(rc))
+        goto out;
+
+    rc = vdIfIoIntFileGetSize(pIfIo, pStorage, &cbFile);
+    if (RT_FAILURE(rc) || cbFile < 2 * sizeof(VwcHdr))
+    {
+        rc = VERR_VD_GEN_INVALID_HEADER;
+        goto out;
+    }
+
+    rc = vwcHdrLoad(pIfIo, pStorage, &Hdr);
+
+out:
+    if (pStorage)
+        vdIfIoIntFileClose(pIfIo, pStorage);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnOpen */
+static DECLCALLBACK(int) vwcOpen(const char *pszFilename, unsigned uOpenFlags,
+                                 PVDINTERFACE pVDIfsDisk, PVDINTERFACE pVDIfsImage,
+                                 void **ppBackendData)
+{
+    LogFlowFunc(("pszFilename=\"%s\" uOpenFlags=%#x pVDIfsDisk=%#p pVDIfsImage=%#p ppBackendData=%#p\n", pszFilename, uOpenFlags, pVDIfsDisk, pVDIfsImage, ppBackendData));
+    int rc;
+    PVWCCACHE pCache;
+
+    /* Check open flags. All valid flags are supported. */
+    if (uOpenFlags & ~VD_OPEN_FLAGS_MASK)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    /* Check remaining arguments. */
+    if (   !VALID_PTR(pszFilename)
+        || !*pszFilename)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    pCache = (PVWCCACHE)RTMemAllocZ(sizeof(VWCCACHE));
+    if (!pCache)
+    {
+        rc = VERR_NO_MEMORY;
+        goto out;
+    }
+    pCache->pszFilename = pszFilename;
+    pCache->pStorage = NULL;
+    pCache->pVDIfsDisk = pVDIfsDisk;
+    pCache->pVDIfsImage = pVDIfsImage;
+
+    rc = vwcOpenImage(pCache, uOpenFlags);
+    if (RT_SUCCESS(rc))
+        *ppBackendData = pCache;
+    else
+        RTMemFree(pCache);
+
+out:
+    LogFlowFunc(("returns %Rrc (pBackendData=%#p)\n", rc, *ppBackendData));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnCreate */
+static DECLCALLBACK(int) vwcCreate(const char *pszFilename, uint64_t cbSize,
+                                   unsigned uImageFlags, const char *pszComment,
+                                   PCRTUUID pUuid, unsigned uOpenFlags,
+                                   unsigned uPercentStart, unsigned uPercentSpan,
+                                   PVDINTERFACE pVDIfsDisk, PVDINTERFACE pVDIfsImage,
+                                   PVDINTERFACE pVDIfsOperation, void **ppBackendData)
+{
+    RT_NOREF1(pszComment);
+    LogFlowFunc(("pszFilename=\"%s\" cbSize=%llu uImageFlags=%#x pszComment=\"%s\" Uuid=%RTuuid uOpenFlags=%#x uPercentStart=%u uPercentSpan=%u pVDIfsDisk=%#p pVDIfsImage=%#p pVDIfsOperation=%#p ppBackendData=%#p",
+                 pszFilename, cbSize, uImageFlags, pszComment, pUuid, uOpenFlags, uPercentStart, uPercentSpan, pVDIfsDisk, pVDIfsImage, pVDIfsOperation, ppBackendData));
+    int rc;
+    PVWCCACHE pCache;
+
+    PFNVDPROGRESS pfnProgress = NULL;
+    void *pvUser = NULL;
+    PVDINTERFACEPROGRESS pIfProgress = VDIfProgressGet(pVDIfsOperation);
+    if (pIfProgress)
+    {
+        pfnProgress = pIfProgress->pfnProgress;
+        pvUser = pIfProgress->Core.pvUser;
+    }
+
+    /* Check open flags. All valid flags are supported. */
+    if (uOpenFlags & ~VD_OPEN_FLAGS_MASK)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    /* Check remaining arguments. */
+    if (   !VALID_PTR(pszFilename)
+        || !*pszFilename)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    pCache = (PVWCCACHE)RTMemAllocZ(sizeof(VWCCACHE));
+    if (!pCache)
+    {
+        rc = VERR_NO_MEMORY;
+        goto out;
+    }
+    pCache->pszFilename = pszFilename;
+    pCache->pStorage = NULL;
+    pCache->pVDIfsDisk = pVDIfsDisk;
+    pCache->pVDIfsImage = pVDIfsImage;
+
+    rc = vwcCreateImage(pCache, cbSize, pUuid, uImageFlags, uOpenFlags,
+                        pfnProgress, pvUser, uPercentStart, uPercentSpan);
+    if (RT_SUCCESS(rc))
+    {
+        /* So far the image is opened in read/write mode. Make sure the
+         * image is opened in read-only mode if the caller requested that. */
+        if (uOpenFlags & VD_OPEN_FLAGS_READONLY)
+        {
+            vwcFreeImage(pCache, false);
+            rc = vwcOpenImage(pCache, uOpenFlags);
+            if (RT_FAILURE(rc))
+            {
+                RTMemFree(pCache);
+                goto out;
+            }
+        }
+        *ppBackendData = pCache;
+    }
+    else
+        RTMemFree(pCache);
+
+out:
+    LogFlowFunc(("returns %Rrc (pBackendData=%#p)\n", rc, *ppBackendData));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnClose */
+static DECLCALLBACK(int) vwcClose(void *pBackendData, bool fDelete)
+{
+    LogFlowFunc(("pBackendData=%#p fDelete=%d\n", pBackendData, fDelete));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc;
+
+    rc = vwcFreeImage(pCache, fDelete);
+    RTMemFree(pCache);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnRead */
+static DECLCALLBACK(int) vwcRead(void *pBackendData, uint64_t uOffset, size_t cbToRead,
+                                 PVDIOCTX pIoCtx, size_t *pcbActuallyRead)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbToRead=%zu pIoCtx=%#p pcbActuallyRead=%#p\n",
+                 pBackendData, uOffset, cbToRead, pIoCtx, pcbActuallyRead));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc = VINF_SUCCESS;
+    uint64_t uBlock  = uOffset / VWC_BLOCK_SIZE;
+    uint32_t iSector = (uint32_t)(uOffset % VWC_BLOCK_SIZE) / VWC_SECTOR_SIZE;
+    uint32_t cSectors = (uint32_t)(RT_MIN(cbToRead, VWC_BLOCK_SIZE - uOffset % VWC_BLOCK_SIZE) / VWC_SECTOR_SIZE);
+
+    AssertPtr(pCache);
+    Assert(uOffset % 512 == 0);
+    Assert(cbToRead % 512 == 0);
+
+    RTCritSectEnter(&pCache->CritSect);
+
+    PVWCSLOT pSlot = vwcSlotLookup(pCache, uBlock);
+    if (pSlot && pSlot->fEvicting)
+        pSlot = NULL;
+
+    if (pSlot && ASMBitTest(pSlot->au64Valid, iSector))
+    {
+        cSectors = vwcBitmapRun(pSlot->au64Valid, iSector, cSectors, true /* fSet */);
+        if (pSlot->cHits < UINT8_MAX)
+            pSlot->cHits++;
+        pSlot->uLastAccess = pCache->uEpoch;
+
+        rc = vdIfIoIntFileReadUser(pCache->pIfIo, pCache->pStorage,
+                                   vwcSlotOffset(pCache, pSlot) + iSector * VWC_SECTOR_SIZE,
+                                   pIoCtx, cSectors * VWC_SECTOR_SIZE);
+    }
+    else
+    {
+        if (pSlot)
+            cSectors = vwcBitmapRun(pSlot->au64Valid, iSector, cSectors, false /* fSet */);
+        rc = VERR_VD_BLOCK_FREE;
+    }
+
+    RTCritSectLeave(&pCache->CritSect);
+
+    if (pcbActuallyRead)
+        *pcbActuallyRead = cSectors * VWC_SECTOR_SIZE;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnWrite */
+static DECLCALLBACK(int) vwcWrite(void *pBackendData, uint64_t uOffset, size_t cbToWrite,
+                                  PVDIOCTX pIoCtx, size_t *pcbWriteProcess)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbToWrite=%zu pIoCtx=%#p pcbWriteProcess=%#p\n",
+                 pBackendData, uOffset, cbToWrite, pIoCtx, pcbWriteProcess));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc = VINF_SUCCESS;
+    uint64_t uBlock  = uOffset / VWC_BLOCK_SIZE;
+    uint32_t iSector = (uint32_t)(uOffset % VWC_BLOCK_SIZE) / VWC_SECTOR_SIZE;
+    size_t   cbWrite = RT_MIN(cbToWrite, VWC_BLOCK_SIZE - uOffset % VWC_BLOCK_SIZE);
+
+    AssertPtr(pCache);
+    Assert(uOffset % 512 == 0);
+    Assert(cbToWrite % 512 == 0);
+
+    /*
+     * This populates the cache with data read from the image. Sectors which
+     * are valid already are skipped as they might be newer than the image.
+     */
+    RTCritSectEnter(&pCache->CritSect);
+
+    PVWCSLOT pSlot = vwcSlotLookup(pCache, uBlock);
+    if (!pSlot)
+        pSlot = vwcSlotAlloc(pCache, uBlock);
+
+    if (   pSlot
+        && !pSlot->fEvicting
+        && !pSlot->cIoPending
+        && !ASMBitTest(pSlot->au64Valid, iSector))
+    {
+        cbWrite = vwcBitmapRun(pSlot->au64Valid, iSector, (uint32_t)(cbWrite / VWC_SECTOR_SIZE),
+                               false /* fSet */) * VWC_SECTOR_SIZE;
+        rc = vwcSlotWrite(pCache, pSlot, iSector, &cbWrite, pIoCtx, false /* fDirty */);
+        if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+            rc = VINF_SUCCESS;
+    }
+    else
+    {
+        if (pSlot && !pSlot->fEvicting && !pSlot->cIoPending)
+            cbWrite = vwcBitmapRun(pSlot->au64Valid, iSector, (uint32_t)(cbWrite / VWC_SECTOR_SIZE),
+                                   true /* fSet */) * VWC_SECTOR_SIZE;
+        vdIfIoIntIoCtxCopyFrom(pCache->pIfIo, pIoCtx, pCache->pbScratch, cbWrite);
+    }
+
+    RTCritSectLeave(&pCache->CritSect);
+
+    *pcbWriteProcess = cbWrite;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnFlush */
+static DECLCALLBACK(int) vwcFlush(void *pBackendData, PVDIOCTX pIoCtx)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    if (!(pCache->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+        rc = vwcFlushImage(pCache, pIoCtx);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnDiscard */
+static DECLCALLBACK(int) vwcDiscard(void *pBackendData, PVDIOCTX pIoCtx,
+                                    uint64_t uOffset, size_t cbDiscard,
+                                    size_t *pcbPreAllocated, size_t *pcbPostAllocated,
+                                    size_t *pcbActuallyDiscarded, void **ppbmAllocationBitmap,
+                                    unsigned fDiscard)
+{
+    RT_NOREF2(pIoCtx, fDiscard);
+    LogFlowFunc(("pBackendData=%#p pIoCtx=%#p uOffset=%llu cbDiscard=%zu\n",
+                 pBackendData, pIoCtx, uOffset, cbDiscard));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+
+    Assert(uOffset % 512 == 0);
+    Assert(cbDiscard % 512 == 0);
+
+    /* Just forget about the data, the range is discarded in the image by the caller as well. */
+    RTCritSectEnter(&pCache->CritSect);
+
+    uint64_t off = uOffset;
+    while (off < uOffset + cbDiscard)
+    {
+        uint32_t iSector  = (uint32_t)(off % VWC_BLOCK_SIZE) / VWC_SECTOR_SIZE;
+        uint32_t cSectors = (uint32_t)(RT_MIN(uOffset + cbDiscard - off, VWC_BLOCK_SIZE - off % VWC_BLOCK_SIZE)
+                                       / VWC_SECTOR_SIZE);
+        PVWCSLOT pSlot = vwcSlotLookup(pCache, off / VWC_BLOCK_SIZE);
+        if (pSlot && !pSlot->fEvicting)
+        {
+            ASMBitClearRange(pSlot->au64Valid, iSector, iSector + cSectors);
+            vwcSlotDirtySet(pCache, pSlot, iSector, cSectors, false /* fDirty */);
+            vwcSlotSetTableDirty(pCache, pSlot);
+            pSlot->uGen++;
+        }
+        off += cSectors * VWC_SECTOR_SIZE;
+    }
+
+    RTCritSectLeave(&pCache->CritSect);
+
+    *pcbPreAllocated      = 0;
+    *pcbPostAllocated     = 0;
+    *pcbActuallyDiscarded = cbDiscard;
+    if (ppbmAllocationBitmap)
+        *ppbmAllocationBitmap = NULL;
+    return VINF_SUCCESS;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnGetVersion */
+static DECLCALLBACK(unsigned) vwcGetVersion(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+        return VWC_HDR_VERSION;
+    else
+        return 0;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnGetSize */
+static DECLCALLBACK(uint64_t) vwcGetSize(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    uint64_t cb = 0;
+
+    AssertPtr(pCache);
+
+    if (pCache && pCache->pStorage)
+        cb = pCache->cbSize;
+
+    LogFlowFunc(("returns %llu\n", cb));
+    return cb;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnGetFileSize */
+static DECLCALLBACK(uint64_t) vwcGetFileSize(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    uint64_t cb = 0;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+    {
+        uint64_t cbFile;
+        if (pCache->pStorage)
+        {
+            int rc = vdIfIoIntFileGetSize(pCache->pIfIo, pCache->pStorage, &cbFile);
+            if (RT_SUCCESS(rc))
+                cb = cbFile;
+        }
+    }
+
+    LogFlowFunc(("returns %lld\n", cb));
+    return cb;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnGetImageFlags */
+static DECLCALLBACK(unsigned) vwcGetImageFlags(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    unsigned uImageFlags;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+        uImageFlags = pCache->uImageFlags;
+    else
+        uImageFlags = 0;
+
+    LogFlowFunc(("returns %#x\n", uImageFlags));
+    return uImageFlags;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnGetOpenFlags */
+static DECLCALLBACK(unsigned) vwcGetOpenFlags(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    unsigned uOpenFlags;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+        uOpenFlags = pCache->uOpenFlags;
+    else
+        uOpenFlags = 0;
+
+    LogFlowFunc(("returns %#x\n", uOpenFlags));
+    return uOpenFlags;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnSetOpenFlags */
+static DECLCALLBACK(int) vwcSetOpenFlags(void *pBackendData, unsigned uOpenFlags)
+{
+    LogFlowFunc(("pBackendData=%#p\n uOpenFlags=%#x", pBackendData, uOpenFlags));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc;
+
+    /* Image must be opened and the new flags must be valid. Just readonly and
+     * info flags are supported. */
+    if (!pCache || (uOpenFlags & ~(VD_OPEN_FLAGS_READONLY | VD_OPEN_FLAGS_INFO)))
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    /* Implement this operation via reopening the image. */
+    rc = vwcFreeImage(pCache, false);
+    if (RT_FAILURE(rc))
+        goto out;
+    rc = vwcOpenImage(pCache, uOpenFlags);
+
+out:
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnGetComment */
+static DECLCALLBACK(int) vwcGetComment(void *pBackendData, char *pszComment,
+                                       size_t cbComment)
+{
+    RT_NOREF2(pszComment, cbComment);
+    LogFlowFunc(("pBackendData=%#p pszComment=%#p cbComment=%zu\n", pBackendData, pszComment, cbComment));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+        rc = VERR_NOT_SUPPORTED;
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc comment='%s'\n", rc, pszComment));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnSetComment */
+static DECLCALLBACK(int) vwcSetComment(void *pBackendData, const char *pszComment)
+{
+    RT_NOREF1(pszComment);
+    LogFlowFunc(("pBackendData=%#p pszComment=\"%s\"\n", pBackendData, pszComment));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+    {
+        if (pCache->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+            rc = VERR_VD_IMAGE_READ_ONLY;
+        else
+            rc = VERR_NOT_SUPPORTED;
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnGetUuid */
+static DECLCALLBACK(int) vwcGetUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+    {
+        *pUuid = pCache->UuidImage;
+        rc = VINF_SUCCESS;
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", rc, pUuid));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnSetUuid */
+static DECLCALLBACK(int) vwcSetUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+    {
+        if (!(pCache->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+        {
+            RTCritSectEnter(&pCache->CritSect);
+            pCache->UuidImage = *pUuid;
+            pCache->fHdrDirty = true;
+            RTCritSectLeave(&pCache->CritSect);
+            rc = VINF_SUCCESS;
+        }
+        else
+            rc = VERR_VD_IMAGE_READ_ONLY;
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnGetModificationUuid */
+static DECLCALLBACK(int) vwcGetModificationUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+    {
+        *pUuid = pCache->UuidModification;
+        rc = VINF_SUCCESS;
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", rc, pUuid));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnSetModificationUuid */
+static DECLCALLBACK(int) vwcSetModificationUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc;
+
+    AssertPtr(pCache);
+
+    if (pCache)
+    {
+        if (!(pCache->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+        {
+            RTCritSectEnter(&pCache->CritSect);
+            pCache->UuidModification = *pUuid;
+            pCache->fHdrDirty = true;
+            RTCritSectLeave(&pCache->CritSect);
+            rc = VINF_SUCCESS;
+        }
+        else
+            rc = VERR_VD_IMAGE_READ_ONLY;
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnDump */
+static DECLCALLBACK(void) vwcDump(void *pBackendData)
+{
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+
+    AssertPtr(pCache);
+    if (!pCache)
+        return;
+
+    vdIfErrorMessage(pCache->pIfError, "Header: Generation=%llu InUse=%RTbool Slots=%u SlotTable=%#llx Slots=%#llx\n",
+                     pCache->u64Generation, pCache->fHdrInUse, pCache->cSlots, pCache->offSlotTable, pCache->offSlots);
+    vdIfErrorMessage(pCache->pIfError, "Header: Uuid=%RTuuid ModificationUuid=%RTuuid\n",
+                     &pCache->UuidImage, &pCache->UuidModification);
+    vdIfErrorMessage(pCache->pIfError, "State: Free=%u Evicting=%u Dirty=%llu bytes\n",
+                     pCache->cFree, pCache->cEvict, pCache->cbDirty);
+}
+
+/** @copydoc VDCACHEBACKEND::pfnWriteBack */
+static DECLCALLBACK(int) vwcWriteBack(void *pBackendData, uint64_t uOffset, size_t cbToWrite,
+                                      PVDIOCTX pIoCtx, size_t *pcbWriteProcess)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbToWrite=%zu pIoCtx=%#p pcbWriteProcess=%#p\n",
+                 pBackendData, uOffset, cbToWrite, pIoCtx, pcbWriteProcess));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc = VINF_SUCCESS;
+    uint64_t uBlock  = uOffset / VWC_BLOCK_SIZE;
+    uint32_t iSector = (uint32_t)(uOffset % VWC_BLOCK_SIZE) / VWC_SECTOR_SIZE;
+    size_t   cbWrite = RT_MIN(cbToWrite, VWC_BLOCK_SIZE - uOffset % VWC_BLOCK_SIZE);
+
+    AssertPtr(pCache);
+    Assert(uOffset % 512 == 0);
+    Assert(cbToWrite % 512 == 0);
+
+    RTCritSectEnter(&pCache->CritSect);
+
+    PVWCSLOT pSlot = vwcSlotLookup(pCache, uBlock);
+    if (!pSlot)
+        pSlot = vwcSlotAlloc(pCache, uBlock);
+    else if (pSlot->fEvicting)
+        vwcSlotRevive(pCache, pSlot);
+
+    if (pSlot)
+    {
+        if (pSlot->cHits < UINT8_MAX)
+            pSlot->cHits++;
+        rc = vwcSlotWrite(pCache, pSlot, iSector, &cbWrite, pIoCtx, true /* fDirty */);
+    }
+    else
+        rc = VERR_VD_BLOCK_FREE; /* Full, the caller has to write to the image directly. */
+
+    RTCritSectLeave(&pCache->CritSect);
+
+    *pcbWriteProcess = cbWrite;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnDirtyRead */
+static DECLCALLBACK(int) vwcDirtyRead(void *pBackendData, uint64_t uOffset, void *pvBuf, size_t cbBuf,
+                                      uint64_t *puOffsetDirty, size_t *pcbDirty, uint64_t *puToken)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu pvBuf=%#p cbBuf=%zu\n", pBackendData, uOffset, pvBuf, cbBuf));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    int rc = VINF_SUCCESS;
+    uint64_t uBlock  = uOffset / VWC_BLOCK_SIZE;
+    uint32_t iSector = (uint32_t)(uOffset % VWC_BLOCK_SIZE) / VWC_SECTOR_SIZE;
+    PVWCSLOT apSlots[4];
+    uint32_t aiSector[4];
+    uint32_t acSectors[4];
+    unsigned cSlots = 0;
+    size_t   cbDirty = 0;
+    uint64_t uToken = 0;
+
+    AssertReturn(cbBuf >= VWC_SECTOR_SIZE, VERR_INVALID_PARAMETER);
+    cbBuf = RT_MIN(cbBuf, (RT_ELEMENTS(apSlots) - 1) * VWC_BLOCK_SIZE) & ~(size_t)(VWC_SECTOR_SIZE - 1);
+
+    RTCritSectEnter(&pCache->CritSect);
+
+    /* Find the first dirty sector at or after the given offset. */
+    PVWCSLOT pSlot = NULL;
+    int iDirty = -1;
+    for (;;)
+    {
+        PAVLRU64NODECORE pCore = RTAvlrU64GetBestFit(&pCache->TreeDirty, uBlock, true /* fAbove */);
+        if (!pCore)
+            break;
+
+        pSlot = RT_FROM_MEMBER(pCore, VWCSLOT, CoreDirty);
+        if (pCore->Key != uBlock || !iSector)
+            iDirty = ASMBitFirstSet(pSlot->au64Dirty, VWC_SECTORS_PER_BLOCK);
+        else if (ASMBitTest(pSlot->au64Dirty, iSector))
+            iDirty = iSector;
+        else
+            iDirty = ASMBitNextSet(pSlot->au64Dirty, VWC_SECTORS_PER_BLOCK, iSector);
+        if (iDirty >= 0)
+            break;
+
+        uBlock  = pCore->Key + 1;
+        iSector = 0;
+    }
+
+    if (iDirty >= 0)
+    {
+        /* Collect the run of dirty sectors, it may continue in the slot of the next block. */
+        *puOffsetDirty = pSlot->CoreDirty.Key * VWC_BLOCK_SIZE + iDirty * VWC_SECTOR_SIZE;
+        for (;;)
+        {
+            uint32_t cSectors = vwcBitmapRun(pSlot->au64Dirty, iDirty,
+                                             (uint32_t)((cbBuf - cbDirty) / VWC_SECTOR_SIZE), true /* fSet */);
+            apSlots[cSlots]   = pSlot;
+            aiSector[cSlots]  = iDirty;
+            acSectors[cSlots] = cSectors;
+            cSlots++;
+
+            pSlot->cIoPending++; /* Keeps the slot from being evicted while reading. */
+            uToken  += pSlot->uGen;
+            cbDirty += cSectors * VWC_SECTOR_SIZE;
+
+            if (   cbDirty == cbBuf
+                || iDirty + cSectors != VWC_SECTORS_PER_BLOCK
+                || cSlots == RT_ELEMENTS(apSlots))
+                break;
+
+            pSlot = (PVWCSLOT)RTAvlrU64Get(&pCache->TreeMapped, pSlot->Core.Key + 1);
+            if (   !pSlot
+                || pSlot->fEvicting
+                || !ASMBitTest(pSlot->au64Dirty, 0))
+                break;
+            iDirty = 0;
+        }
+    }
+    else
+        rc = VERR_NOT_FOUND;
+
+    RTCritSectLeave(&pCache->CritSect);
+
+    if (RT_SUCCESS(rc))
+    {
+        uint8_t *pbBuf = (uint8_t *)pvBuf;
+        for (unsigned i = 0; i < cSlots && RT_SUCCESS(rc); i++)
+        {
+            rc = vdIfIoIntFileReadSync(pCache->pIfIo, pCache->pStorage,
+                                       vwcSlotOffset(pCache, apSlots[i]) + aiSector[i] * VWC_SECTOR_SIZE,
+                                       pbBuf, acSectors[i] * VWC_SECTOR_SIZE);
+            pbBuf += acSectors[i] * VWC_SECTOR_SIZE;
+        }
+
+        RTCritSectEnter(&pCache->CritSect);
+        for (unsigned i = 0; i < cSlots; i++)
+            apSlots[i]->cIoPending--;
+        RTCritSectLeave(&pCache->CritSect);
+
+        *pcbDirty = cbDirty;
+        *puToken  = uToken;
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnDirtyClear */
+static DECLCALLBACK(int) vwcDirtyClear(void *pBackendData, uint64_t uOffset, size_t cbClear, uint64_t uToken)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbClear=%zu uToken=%llu\n", pBackendData, uOffset, cbClear, uToken));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    uint64_t uTokenCur = 0;
+    uint64_t off;
+
+    Assert(uOffset % 512 == 0);
+    Assert(cbClear % 512 == 0);
+
+    RTCritSectEnter(&pCache->CritSect);
+
+    /* The generation only ever grows, an unchanged sum means no slot was written since the read. */
+    for (off = uOffset & ~(uint64_t)(VWC_BLOCK_SIZE - 1); off < uOffset + cbClear; off += VWC_BLOCK_SIZE)
+    {
+        PVWCSLOT pSlot = vwcSlotLookup(pCache, off / VWC_BLOCK_SIZE);
+        if (pSlot)
+            uTokenCur += pSlot->uGen;
+    }
+
+    if (uTokenCur == uToken)
+    {
+        off = uOffset;
+        while (off < uOffset + cbClear)
+        {
+            uint32_t iSector  = (uint32_t)(off % VWC_BLOCK_SIZE) / VWC_SECTOR_SIZE;
+            uint32_t cSectors = (uint32_t)(RT_MIN(uOffset + cbClear - off, VWC_BLOCK_SIZE - off % VWC_BLOCK_SIZE)
+                                           / VWC_SECTOR_SIZE);
+            PVWCSLOT pSlot = vwcSlotLookup(pCache, off / VWC_BLOCK_SIZE);
+            if (pSlot)
+                vwcSlotDirtySet(pCache, pSlot, iSector, cSectors, false /* fDirty */);
+            off += cSectors * VWC_SECTOR_SIZE;
+        }
+    }
+    else
+        LogFlowFunc(("Range was written again, stays dirty\n"));
+
+    RTCritSectLeave(&pCache->CritSect);
+    return VINF_SUCCESS;
+}
+
+/** @copydoc VDCACHEBACKEND::pfnReclaim */
+static DECLCALLBACK(int) vwcReclaim(void *pBackendData, uint64_t *pcbDirty)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVWCCACHE pCache = (PVWCCACHE)pBackendData;
+    uint32_t  acHits[UINT8_MAX + 1];
+
+    RTCritSectEnter(&pCache->CritSect);
+
+    /*
+     * Keep an eighth of the slots free for new writes. Clean slots which were
+     * not accessed since the last run are evicted, least frequently used first.
+     */
+    uint32_t const cTarget = RT_MAX(pCache->cSlots / 8, 1);
+    if (pCache->cFree + pCache->cEvict < cTarget)
+    {
+        uint32_t cEvict = cTarget - pCache->cFree - pCache->cEvict;
+
+        memset(acHits, 0, sizeof(acHits));
+        for (uint32_t i = 0; i < pCache->cSlots; i++)
+        {
+            PVWCSLOT pSlot = &pCache->paSlots[i];
+            if (   pSlot->fMapped
+                && !pSlot->fEvicting
+                && !pSlot->cDirty
+                && !pSlot->cIoPending
+                && pSlot->uLastAccess != pCache->uEpoch)
+                acHits[pSlot->cHits]++;
+        }
+
+        /* Find the access count up to which slots are evicted. */
+        uint32_t cHitsMax = 0;
+        uint32_t cCandidates = acHits[0];
+        while (cCandidates < cEvict && cHitsMax < UINT8_MAX)
+            cCandidates += acHits[++cHitsMax];
+
+        for (uint32_t i = 0; i < pCache->cSlots && cEvict; i++)
+        {
+            PVWCSLOT pSlot = &pCache->paSlots[i];
+            if (   pSlot->fMapped
+                && !pSlot->fEvicting
+                && !pSlot->cDirty
+                && !pSlot->cIoPending
+                && pSlot->uLastAccess != pCache->uEpoch
+                && pSlot->cHits <= cHitsMax)
+            {
+                pSlot->fEvicting    = true;
+                pSlot->au64Valid[0] = 0;
+                pSlot->au64Valid[1] = 0;
+                if (!pSlot->fEvictList)
+                {
+                    pSlot->fEvictList = true;
+                    pCache->paidxEvict[pCache->cEvict++] = i;
+                }
+                vwcSlotSetTableDirty(pCache, pSlot);
+                cEvict--;
+            }
+        }
+    }
+
+    /* Age the access counters so the frequency reflects recent use. */
+    for (uint32_t i = 0; i < pCache->cSlots; i++)
+        pCache->paSlots[i].cHits >>= 1;
+    pCache->uEpoch++;
+
+    *pcbDirty = pCache->cbDirty;
+
+    RTCritSectLeave(&pCache->CritSect);
+
+    LogFlowFunc(("returns VINF_SUCCESS cbDirty=%llu\n", *pcbDirty));
+    return VINF_SUCCESS;
+}
+
+
+const VDCACHEBACKEND g_VwcCacheBackend =
+{
+    /* u32Version */
+    VD_CACHEBACKEND_VERSION,
+    /* pszBackendName */
+    "VWC",
+    /* uBackendCaps */
+    VD_CAP_CREATE_FIXED | VD_CAP_FILE | VD_CAP_VFS,
+    /* papszFileExtensions */
+    s_apszVwcFileExtensions,
+    /* paConfigInfo */
+    NULL,
+    /* pfnProbe */
+    vwcProbe,
+    /* pfnOpen */
+    vwcOpen,
+    /* pfnCreate */
+    vwcCreate,
+    /* pfnClose */
+    vwcClose,
+    /* pfnRead */
+    vwcRead,
+    /* pfnWrite */
+    vwcWrite,
+    /* pfnFlush */
+    vwcFlush,
+    /* pfnDiscard */
+    vwcDiscard,
+    /* pfnGetVersion */
+    vwcGetVersion,
+    /* pfnGetSize */
+    vwcGetSize,
+    /* pfnGetFileSize */
+    vwcGetFileSize,
+    /* pfnGetImageFlags */
+    vwcGetImageFlags,
+    /* pfnGetOpenFlags */
+    vwcGetOpenFlags,
+    /* pfnSetOpenFlags */
+    vwcSetOpenFlags,
+    /* pfnGetComment */
+    vwcGetComment,
+    /* pfnSetComment */
+    vwcSetComment,
+    /* pfnGetUuid */
+    vwcGetUuid,
+    /* pfnSetUuid */
+    vwcSetUuid,
+    /* pfnGetModificationUuid */
+    vwcGetModificationUuid,
+    /* pfnSetModificationUuid */
+    vwcSetModificationUuid,
+    /* pfnDump */
+    vwcDump,
+    /* pfnComposeLocation */
+    NULL,
+    /* pfnComposeName */
+    NULL,
+    /* pfnWriteBack */
+    vwcWriteBack,
+    /* pfnDirtyRead */
+    vwcDirtyRead,
+    /* pfnDirtyClear */
+    vwcDirtyClear,
+    /* pfnReclaim */
+    vwcReclaim,
+    /* u32VersionEnd */
+    VD_CACHEBACKEND_VERSION
+};
+
@@ -59,6 +59,8 @@ typedef struct VDFILE
     char          *pszName;
     /** Storage backing the file. */
     PVDIOSTORAGE   pIoStorage;
+    /** Completion callback the storage was created with. */
+    PFNVDCOMPLETED pfnComplete;
     /** Flag whether the file is read locked. */
     bool           fReadLock;
     /** Flag whether the file is write locked. */
@@ -230,16 +232,183 @@ typedef struct VDIOTEST
     } u;
 } VDIOTEST, *PVDIOTEST;
 
+/** Number of latency histogram buckets per power of two, as a shift count. */
+#define VDIOBENCH_LAT_SUB_BUCKETS_SHIFT 3
+/** Number of latency histogram buckets, covers the whole 64-bit nanosecond range. */
+#define VDIOBENCH_LAT_BUCKETS           (64 << VDIOBENCH_LAT_SUB_BUCKETS_SHIFT)
+
+/**
+ * Benchmark statistics for one request type.
+ */
+typedef struct VDIOBENCHSTATS
+{
+    /** Number of successfully completed requests. */
+    uint64_t       cReqs;
+    /** Number of failed requests. */
+    uint64_t       cReqsFailed;
+    /** Number of bytes transferred. */
+    uint64_t       cbTransferred;
+    /** Sum of all request latencies in nanoseconds. */
+    uint64_t       cNsLatencyTotal;
+    /** Minimum request latency in nanoseconds. */
+    uint64_t       cNsLatencyMin;
+    /** Maximum request latency in nanoseconds. */
+    uint64_t       cNsLatencyMax;
+    /** Latency histogram, see tstVDIoBenchLatencyToBucket(). */
+    uint64_t       acLatency[VDIOBENCH_LAT_BUCKETS];
+} VDIOBENCHSTATS, *PVDIOBENCHSTATS;
+/** Pointer to const benchmark statistics. */
+typedef const VDIOBENCHSTATS *PCVDIOBENCHSTATS;
+
+/**
+ * A request of a replayed block trace.
+ */
+typedef struct VDIOTRACEENTRY
+{
+    /** Submission time relative to the start of the trace in nanoseconds. */
+    uint64_t       cNsStart;
+    /** Start offset. */
+    uint64_t       off;
+    /** Size of the request. */
+    size_t         cbReq;
+    /** Transfer type. */
+    VDIOREQTXDIR   enmTxDir;
+} VDIOTRACEENTRY, *PVDIOTRACEENTRY;
+/** Pointer to a const trace entry. */
+typedef const VDIOTRACEENTRY *PCVDIOTRACEENTRY;
+
+/**
+ * Benchmark request state.
+ */
+typedef enum VDIOBENCHREQSTATE
+{
+    /** Slot is free. */
+    VDIOBENCHREQSTATE_IDLE = 0,
+    /** Request is set up and waits for its submission time. */
+    VDIOBENCHREQSTATE_SCHEDULED,
+    /** Request was submitted. */
+    VDIOBENCHREQSTATE_ACTIVE,
+    /** Request completed, statistics are not updated yet. */
+    VDIOBENCHREQSTATE_COMPLETED,
+    /** 32bit hack. */
+    VDIOBENCHREQSTATE_32BIT_HACK = 0x7fffffff
+} VDIOBENCHREQSTATE;
+
+/** Pointer to a benchmark worker. */
+typedef struct VDIOBENCHWORKER *PVDIOBENCHWORKER;
+
+/**
+ * Benchmark request slot.
+ */
+typedef struct VDIOBENCHREQ
+{
+    /** Request state, VDIOBENCHREQSTATE. */
+    volatile uint32_t  enmState;
+    /** Transfer type. */
+    VDIOREQTXDIR       enmTxDir;
+    /** Start offset. */
+    uint64_t           off;
+    /** Size of the request. */
+    size_t             cbReq;
+    /** S/G buffer. */
+    RTSGBUF            SgBuf;
+    /** Data segment. */
+    RTSGSEG            DataSeg;
+    /** Range for discard requests. */
+    RTRANGE            Range;
+    /** Data buffer of the slot. */
+    void              *pvBuf;
+    /** Time the request is due for submission (RTTimeNanoTS). */
+    uint64_t           tsDue;
+    /** Submission timestamp. */
+    uint64_t           tsSubmit;
+    /** Completion timestamp. */
+    uint64_t           tsComplete;
+    /** Completion status code. */
+    int                rcReq;
+} VDIOBENCHREQ, *PVDIOBENCHREQ;
+
+/**
+ * Benchmark run state shared by all workers.
+ */
+typedef struct VDIOBENCH
+{
+    /** Global test data. */
+    PVDTESTGLOB         pGlob;
+    /** The disk to operate on. */
+    PVDDISK             pDisk;
+    /** Number of requests each worker keeps outstanding. */
+    unsigned            cQueueDepth;
+    /** Maximum size of a request. */
+    size_t              cbReqMax;
+    /** Flag whether random or sequential access is wanted. */
+    bool                fRandomAccess;
+    /** Block size. */
+    size_t              cbBlkIo;
+    /** Start offset of the accessed range. */
+    uint64_t            offStart;
+    /** Number of blocks in the accessed range. */
+    uint64_t            cBlocks;
+    /** Chance in percent to get a write. */
+    unsigned            uWriteChance;
+    /** Number of bytes left to transfer. */
+    volatile uint64_t   cbIoLeft;
+    /** Next block for sequential access. */
+    volatile uint64_t   iBlkNext;
+    /** Maximum runtime in nanoseconds, 0 for no limit. */
+    uint64_t            cNsRuntime;
+    /** The replayed trace, NULL for generated requests. */
+    PCVDIOTRACEENTRY    paTrace;
+    /** Number of trace entries. */
+    uint32_t            cTraceEntries;
+    /** Next trace entry to submit. */
+    volatile uint32_t   iTraceNext;
+    /** Flag whether the trace timing is honored. */
+    bool                fTimed;
+    /** Start timestamp (RTTimeNanoTS). */
+    uint64_t            tsStart;
+    /** Event semaphore releasing all workers at once. */
+    RTSEMEVENTMULTI     hEvtStart;
+} VDIOBENCH, *PVDIOBENCH;
+
+/**
+ * Benchmark worker thread state.
+ */
+typedef struct VDIOBENCHWORKER
+{
+    /** The benchmark. */
+    PVDIOBENCH          pBench;
+    /** Worker thread handle. */
+    RTTHREAD            hThread;
+    /** Event semaphore signalled on request completion. */
+    RTSEMEVENT          hEvtCompleted;
+    /** Random number generator of the worker. */
+    RTRAND              hRand;
+    /** Request slots, VDIOBENCH::cQueueDepth entries. */
+    PVDIOBENCHREQ       paReqs;
+    /** First error status code. */
+    int                 rc;
+    /** Statistics per request type, indexed by VDIOREQTXDIR. */
+    VDIOBENCHSTATS      aStats[VDIOREQTXDIR_DISCARD + 1];
+} VDIOBENCHWORKER;
+
 static DECLCALLBACK(int) vdScriptHandlerCreate(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerOpen(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerIoBench(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerIoTraceReplay(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerFlush(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerMerge(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerCompact(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerDiscard(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerCopy(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerClose(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerCreateCache(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerOpenCache(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerCloseCache(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerDestage(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerPrintFileSize(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerCheckFileSize(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerIoRngCreate(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerIoRngDestroy(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerIoPatternCreateFromNumber(PVDSCRIPTARG paScriptArgs, void *pvUser);
@@ -247,6 +416,7 @@ static DECLCALLBACK(int) vdScriptHandlerIoPatternCreateFromFile(PVDSCRIPTARG paS
 static DECLCALLBACK(int) vdScriptHandlerIoPatternDestroy(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerSleep(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerDumpFile(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerFileCopy(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerCreateDisk(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerDestroyDisk(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerCompareDisks(PVDSCRIPTARG paScriptArgs, void *pvUser);
@@ -303,6 +473,36 @@ const VDSCRIPTTYPE g_aArgIo[] =
     VDSCRIPTTYPE_STRING  /* pattern */
 };
 
+/* I/O benchmark action */
+const VDSCRIPTTYPE g_aArgIoBench[] =
+{
+    VDSCRIPTTYPE_STRING, /* disk */
+    VDSCRIPTTYPE_UINT32, /* threads */
+    VDSCRIPTTYPE_UINT32, /* queue depth per thread */
+    VDSCRIPTTYPE_STRING, /* mode */
+    VDSCRIPTTYPE_UINT64, /* blocksize */
+    VDSCRIPTTYPE_UINT64, /* offStart */
+    VDSCRIPTTYPE_UINT64, /* offEnd */
+    VDSCRIPTTYPE_UINT64, /* size */
+    VDSCRIPTTYPE_UINT32, /* runtime in milliseconds */
+    VDSCRIPTTYPE_UINT32, /* writes */
+    VDSCRIPTTYPE_STRING, /* label */
+    VDSCRIPTTYPE_STRING  /* results */
+};
+
+/* Block trace replay action */
+const VDSCRIPTTYPE g_aArgIoTraceReplay[] =
+{
+    VDSCRIPTTYPE_STRING, /* disk */
+    VDSCRIPTTYPE_UINT32, /* threads */
+    VDSCRIPTTYPE_UINT32, /* queue depth per thread */
+    VDSCRIPTTYPE_STRING, /* trace */
+    VDSCRIPTTYPE_STRING, /* event */
+    VDSCRIPTTYPE_BOOL,   /* timed */
+    VDSCRIPTTYPE_STRING, /* label */
+    VDSCRIPTTYPE_STRING  /* results */
+};
+
 /* flush action */
 const VDSCRIPTTYPE g_aArgFlush[] =
 {
@@ -355,6 +555,38 @@ const VDSCRIPTTYPE g_aArgClose[] =
     VDSCRIPTTYPE_BOOL    /* delete */
 };
 
+/* create cache action */
+const VDSCRIPTTYPE g_aArgCreateCache[] =
+{
+    VDSCRIPTTYPE_STRING, /* disk */
+    VDSCRIPTTYPE_STRING, /* name */
+    VDSCRIPTTYPE_STRING, /* backend */
+    VDSCRIPTTYPE_UINT64, /* size */
+    VDSCRIPTTYPE_BOOL    /* writeback */
+};
+
+/* open cache action */
+const VDSCRIPTTYPE g_aArgOpenCache[] =
+{
+    VDSCRIPTTYPE_STRING, /* disk */
+    VDSCRIPTTYPE_STRING, /* name */
+    VDSCRIPTTYPE_STRING, /* backend */
+    VDSCRIPTTYPE_BOOL    /* writeback */
+};
+
+/* close cache action */
+const VDSCRIPTTYPE g_aArgCloseCache[] =
+{
+    VDSCRIPTTYPE_STRING, /* disk */
+    VDSCRIPTTYPE_BOOL    /* delete */
+};
+
+/* destage action */
+const VDSCRIPTTYPE g_aArgDestage[] =
+{
+    VDSCRIPTTYPE_STRING  /* disk */
+};
+
 /* print file size action */
 const VDSCRIPTTYPE g_aArgPrintFileSize[] =
 {
@@ -362,6 +594,15 @@ const VDSCRIPTTYPE g_aArgPrintFileSize[] =
     VDSCRIPTTYPE_UINT32 /* image */
 };
 
+/* check file size action */
+const VDSCRIPTTYPE g_aArgCheckFileSize[] =
+{
+    VDSCRIPTTYPE_STRING, /* disk */
+    VDSCRIPTTYPE_UINT32, /* image */
+    VDSCRIPTTYPE_UINT64, /* min */
+    VDSCRIPTTYPE_UINT64  /* max */
+};
+
 #ifdef VBOX_TSTVDIO_WITH_LOG_REPLAY
 /* print file size action */
 const VDSCRIPTTYPE g_aArgIoLogReplay[] =
@@ -413,6 +654,13 @@ const VDSCRIPTTYPE g_aArgDumpFile[] =
     VDSCRIPTTYPE_STRING  /* path */
 };
 
+/* Copy memory file */
+const VDSCRIPTTYPE g_aArgFileCopy[] =
+{
+    VDSCRIPTTYPE_STRING, /* source */
+    VDSCRIPTTYPE_STRING  /* destination */
+};
+
 /* Create virtual disk handle */
 const VDSCRIPTTYPE g_aArgCreateDisk[] =
 {
@@ -476,9 +724,16 @@ const VDSCRIPTCALLBACK g_aScriptActions[] =
     {"create",                     VDSCRIPTTYPE_VOID, g_aArgCreate,                      RT_ELEMENTS(g_aArgCreate),                     vdScriptHandlerCreate},
     {"open",                       VDSCRIPTTYPE_VOID, g_aArgOpen,                        RT_ELEMENTS(g_aArgOpen),                       vdScriptHandlerOpen},
     {"io",                         VDSCRIPTTYPE_VOID, g_aArgIo,                          RT_ELEMENTS(g_aArgIo),                         vdScriptHandlerIo},
+    {"iobench",                    VDSCRIPTTYPE_VOID, g_aArgIoBench,                     RT_ELEMENTS(g_aArgIoBench),                    vdScriptHandlerIoBench},
+    {"iotracereplay",              VDSCRIPTTYPE_VOID, g_aArgIoTraceReplay,               RT_ELEMENTS(g_aArgIoTraceReplay),              vdScriptHandlerIoTraceReplay},
     {"flush",                      VDSCRIPTTYPE_VOID, g_aArgFlush,                       RT_ELEMENTS(g_aArgFlush),                      vdScriptHandlerFlush},
     {"close",                      VDSCRIPTTYPE_VOID, g_aArgClose,                       RT_ELEMENTS(g_aArgClose),                      vdScriptHandlerClose},
+    {"createcache",                VDSCRIPTTYPE_VOID, g_aArgCreateCache,                 RT_ELEMENTS(g_aArgCreateCache),                vdScriptHandlerCreateCache},
+    {"opencache",                  VDSCRIPTTYPE_VOID, g_aArgOpenCache,                   RT_ELEMENTS(g_aArgOpenCache),                  vdScriptHandlerOpenCache},
+    {"closecache",                 VDSCRIPTTYPE_VOID, g_aArgCloseCache,                  RT_ELEMENTS(g_aArgCloseCache),                 vdScriptHandlerCloseCache},
+    {"destage",                    VDSCRIPTTYPE_VOID, g_aArgDestage,                     RT_ELEMENTS(g_aArgDestage),                    vdScriptHandlerDestage},
     {"printfilesize",              VDSCRIPTTYPE_VOID, g_aArgPrintFileSize,               RT_ELEMENTS(g_aArgPrintFileSize),              vdScriptHandlerPrintFileSize},
+    {"checkfilesize",              VDSCRIPTTYPE_VOID, g_aArgCheckFileSize,               RT_ELEMENTS(g_aArgCheckFileSize),              vdScriptHandlerCheckFileSize},
 #ifdef VBOX_TSTVDIO_WITH_LOG_REPLAY
     {"ioreplay",                   VDSCRIPTTYPE_VOID, g_aArgIoLogReplay,                 RT_ELEMENTS(g_aArgIoLogReplay),                vdScriptHandlerIoLogReplay},
 #endif
@@ -493,6 +748,7 @@ const VDSCRIPTCALLBACK g_aScriptActions[] =
     {"iopatterndestroy",           VDSCRIPTTYPE_VOID, g_aArgIoPatternDestroy,            RT_ELEMENTS(g_aArgIoPatternDestroy),           vdScriptHandlerIoPatternDestroy},
     {"sleep",                      VDSCRIPTTYPE_VOID, g_aArgSleep,                       RT_ELEMENTS(g_aArgSleep),                      vdScriptHandlerSleep},
     {"dumpfile",                   VDSCRIPTTYPE_VOID, g_aArgDumpFile,                    RT_ELEMENTS(g_aArgDumpFile),                   vdScriptHandlerDumpFile},
+    {"filecopy",                   VDSCRIPTTYPE_VOID, g_aArgFileCopy,                    RT_ELEMENTS(g_aArgFileCopy),                   vdScriptHandlerFileCopy},
     {"createdisk",                 VDSCRIPTTYPE_VOID, g_aArgCreateDisk,                  RT_ELEMENTS(g_aArgCreateDisk),                 vdScriptHandlerCreateDisk},
     {"destroydisk",                VDSCRIPTTYPE_VOID, g_aArgDestroyDisk,                 RT_ELEMENTS(g_aArgDestroyDisk),                vdScriptHandlerDestroyDisk},
     {"comparedisks",               VDSCRIPTTYPE_VOID, g_aArgCompareDisks,                RT_ELEMENTS(g_aArgCompareDisks),               vdScriptHandlerCompareDisks},
@@ -924,71 +1180,961 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUs
                                     }
                                 }
 
-                                if (RT_FAILURE(rc))
-                                    RTPrintf("Error submitting task %u rc=%Rrc\n", paIoReq[idx].idx, rc);
-                            }
-                        }
-                    }
+                                if (RT_FAILURE(rc))
+                                    RTPrintf("Error submitting task %u rc=%Rrc\n", paIoReq[idx].idx, rc);
+                            }
+                        }
+                    }
+
+                    /* Wait for a request to complete. */
+                    if (   fAsync
+                        && fTasksOutstanding)
+                    {
+                        rc = RTSemEventWait(EventSem, RT_INDEFINITE_WAIT);
+                        AssertRC(rc);
+                    }
+                }
+
+                /* Cleanup, wait for all tasks to complete. */
+                while (fAsync)
+                {
+                    unsigned idx = 0;
+                    bool fAllIdle = true;
+
+                    while (idx < cMaxTasksOutstanding)
+                    {
+                        if (tstVDIoTestReqOutstanding(&paIoReq[idx]))
+                        {
+                            fAllIdle = false;
+                            break;
+                        }
+                        idx++;
+                    }
+
+                    if (!fAllIdle)
+                    {
+                        rc = RTSemEventWait(EventSem, 100);
+                        Assert(RT_SUCCESS(rc) || rc == VERR_TIMEOUT);
+                    }
+                    else
+                        break;
+                }
+
+                NanoTS = RTTimeNanoTS() - NanoTS;
+                uint64_t SpeedKBs = tstVDIoGetSpeedKBs(cbIo, NanoTS);
+                RTTestValue(pGlob->hTest, "Throughput", SpeedKBs, RTTESTUNIT_KILOBYTES_PER_SEC);
+
+                for (unsigned i = 0; i < cMaxTasksOutstanding; i++)
+                {
+                    if (paIoReq[i].pvBufRead)
+                        RTMemFree(paIoReq[i].pvBufRead);
+                }
+
+                RTSemEventDestroy(EventSem);
+                RTMemFree(paIoReq);
+            }
+            else
+            {
+                if (paIoReq)
+                    RTMemFree(paIoReq);
+                if (RT_SUCCESS(rc))
+                    RTSemEventDestroy(EventSem);
+                rc = VERR_NO_MEMORY;
+            }
+
+            tstVDIoTestDestroy(&IoTest);
+        }
+        RTTestSubDone(pGlob->hTest);
+    }
+
+    return rc;
+}
+
+/**
+ * Returns the latency histogram bucket for the given latency.
+ *
+ * The buckets are log-linear, each power of two is split into
+ * 2^VDIOBENCH_LAT_SUB_BUCKETS_SHIFT buckets so the relative error stays small.
+ *
+ * @returns Bucket index.
+ * @param   cNsLatency    The latency in nanoseconds.
+ */
+static unsigned tstVDIoBenchLatencyToBucket(uint64_t cNsLatency)
+{
+    if (cNsLatency < RT_BIT_64(VDIOBENCH_LAT_SUB_BUCKETS_SHIFT))
+        return (unsigned)cNsLatency;
+
+    unsigned iBit = ASMBitLastSetU64(cNsLatency) - 1;
+    unsigned iSub = (unsigned)(cNsLatency >> (iBit - VDIOBENCH_LAT_SUB_BUCKETS_SHIFT))
+                  & (RT_BIT_32(VDIOBENCH_LAT_SUB_BUCKETS_SHIFT) - 1);
+    return ((iBit - VDIOBENCH_LAT_SUB_BUCKETS_SHIFT + 1) << VDIOBENCH_LAT_SUB_BUCKETS_SHIFT) + iSub;
+}
+
+/**
+ * Returns the highest latency falling into the given histogram bucket.
+ *
+ * @returns Latency in nanoseconds.
+ * @param   iBucket       The bucket index.
+ */
+static uint64_t tstVDIoBenchBucketToLatency(unsigned iBucket)
+{
+    if (iBucket < RT_BIT_32(VDIOBENCH_LAT_SUB_BUCKETS_SHIFT))
+        return iBucket;
+
+    unsigned iBit = (iBucket >> VDIOBENCH_LAT_SUB_BUCKETS_SHIFT) + VDIOBENCH_LAT_SUB_BUCKETS_SHIFT - 1;
+    uint64_t uSub = iBucket & (RT_BIT_32(VDIOBENCH_LAT_SUB_BUCKETS_SHIFT) - 1);
+    return ((RT_BIT_64(VDIOBENCH_LAT_SUB_BUCKETS_SHIFT) + uSub + 1) << (iBit - VDIOBENCH_LAT_SUB_BUCKETS_SHIFT)) - 1;
+}
+
+/**
+ * Returns the given latency percentile.
+ *
+ * @returns Latency in nanoseconds, 0 if there are no requests.
+ * @param   pStats        The statistics.
+ * @param   uPerMille     The percentile in 1/1000.
+ */
+static uint64_t tstVDIoBenchStatsPercentile(PCVDIOBENCHSTATS pStats, unsigned uPerMille)
+{
+    uint64_t cReqsRank = (pStats->cReqs * uPerMille + 999) / 1000;
+    uint64_t cReqsSeen = 0;
+
+    if (!cReqsRank)
+        return 0;
+
+    for (unsigned i = 0; i < RT_ELEMENTS(pStats->acLatency); i++)
+    {
+        cReqsSeen += pStats->acLatency[i];
+        if (cReqsSeen >= cReqsRank)
+            return RT_MIN(tstVDIoBenchBucketToLatency(i), pStats->cNsLatencyMax);
+    }
+
+    return pStats->cNsLatencyMax;
+}
+
+/**
+ * Adds the statistics of one worker to the totals.
+ *
+ * @returns nothing.
+ * @param   pDst          The totals.
+ * @param   pSrc          The statistics to add.
+ */
+static void tstVDIoBenchStatsMerge(PVDIOBENCHSTATS pDst, PCVDIOBENCHSTATS pSrc)
+{
+    pDst->cReqs           += pSrc->cReqs;
+    pDst->cReqsFailed     += pSrc->cReqsFailed;
+    pDst->cbTransferred   += pSrc->cbTransferred;
+    pDst->cNsLatencyTotal += pSrc->cNsLatencyTotal;
+    pDst->cNsLatencyMin    = RT_MIN(pDst->cNsLatencyMin, pSrc->cNsLatencyMin);
+    pDst->cNsLatencyMax    = RT_MAX(pDst->cNsLatencyMax, pSrc->cNsLatencyMax);
+    for (unsigned i = 0; i < RT_ELEMENTS(pDst->acLatency); i++)
+        pDst->acLatency[i] += pSrc->acLatency[i];
+}
+
+/**
+ * Returns the name of the given transfer type for reporting.
+ */
+static const char *tstVDIoBenchTxDirName(VDIOREQTXDIR enmTxDir)
+{
+    switch (enmTxDir)
+    {
+        case VDIOREQTXDIR_READ:    return "read";
+        case VDIOREQTXDIR_WRITE:   return "write";
+        case VDIOREQTXDIR_FLUSH:   return "flush";
+        case VDIOREQTXDIR_DISCARD: return "discard";
+    }
+    return "invalid";
+}
+
+/**
+ * Sets up the next request for the given slot.
+ *
+ * @returns true if the slot holds a new request, false if there is no work left.
+ * @param   pWorker       The worker.
+ * @param   pReq          The request slot.
+ */
+static bool tstVDIoBenchReqNext(PVDIOBENCHWORKER pWorker, PVDIOBENCHREQ pReq)
+{
+    PVDIOBENCH pBench = pWorker->pBench;
+
+    if (pBench->paTrace)
+    {
+        uint32_t idx = ASMAtomicIncU32(&pBench->iTraceNext) - 1;
+        if (idx >= pBench->cTraceEntries)
+            return false;
+
+        PCVDIOTRACEENTRY pEntry = &pBench->paTrace[idx];
+        pReq->enmTxDir = pEntry->enmTxDir;
+        pReq->off      = pEntry->off;
+        pReq->cbReq    = pEntry->cbReq;
+        pReq->tsDue    = pBench->fTimed ? pBench->tsStart + pEntry->cNsStart : 0;
+    }
+    else
+    {
+        if (   pBench->cNsRuntime
+            && RTTimeNanoTS() - pBench->tsStart >= pBench->cNsRuntime)
+            return false;
+
+        /* Reserve the request size from the remaining bytes. */
+        uint64_t cbLeft = ASMAtomicReadU64(&pBench->cbIoLeft);
+        size_t   cbReq;
+        do
+        {
+            if (!cbLeft)
+                return false;
+            cbReq = (size_t)RT_MIN(cbLeft, pBench->cbBlkIo);
+        } while (!ASMAtomicCmpXchgExU64(&pBench->cbIoLeft, cbLeft - cbReq, cbLeft, &cbLeft));
+
+        uint64_t iBlk = pBench->fRandomAccess
+                      ? RTRandAdvU64Ex(pWorker->hRand, 0, pBench->cBlocks - 1)
+                      : (ASMAtomicIncU64(&pBench->iBlkNext) - 1) % pBench->cBlocks;
+
+        pReq->enmTxDir =   RTRandAdvU32Ex(pWorker->hRand, 0, 99) < pBench->uWriteChance
+                         ? VDIOREQTXDIR_WRITE
+                         : VDIOREQTXDIR_READ;
+        pReq->off      = pBench->offStart + iBlk * pBench->cbBlkIo;
+        pReq->cbReq    = cbReq;
+        pReq->tsDue    = 0;
+    }
+
+    pReq->enmState = VDIOBENCHREQSTATE_SCHEDULED;
+    return true;
+}
+
+/**
+ * Completion callback for benchmark requests.
+ */
+static DECLCALLBACK(void) tstVDIoBenchReqComplete(void *pvUser1, void *pvUser2, int rcReq)
+{
+    PVDIOBENCHREQ pReq = (PVDIOBENCHREQ)pvUser1;
+    RTSEMEVENT hEvtCompleted = (RTSEMEVENT)pvUser2;
+
+    pReq->tsComplete = RTTimeNanoTS();
+    pReq->rcReq      = rcReq;
+    ASMAtomicWriteU32(&pReq->enmState, VDIOBENCHREQSTATE_COMPLETED);
+    RTSemEventSignal(hEvtCompleted);
+}
+
+/**
+ * Submits the request in the given slot.
+ *
+ * @returns nothing, errors are recorded as the completion status of the request.
+ * @param   pWorker       The worker.
+ * @param   pReq          The request slot.
+ */
+static void tstVDIoBenchReqSubmit(PVDIOBENCHWORKER pWorker, PVDIOBENCHREQ pReq)
+{
+    PVBOXHDD pVD = pWorker->pBench->pDisk->pVD;
+    int rc = VERR_INVALID_PARAMETER;
+
+    pReq->DataSeg.pvSeg = pReq->pvBuf;
+    pReq->DataSeg.cbSeg = pReq->cbReq;
+    RTSgBufInit(&pReq->SgBuf, &pReq->DataSeg, 1);
+
+    ASMAtomicWriteU32(&pReq->enmState, VDIOBENCHREQSTATE_ACTIVE);
+    pReq->tsSubmit = RTTimeNanoTS();
+    switch (pReq->enmTxDir)
+    {
+        case VDIOREQTXDIR_READ:
+            rc = VDAsyncRead(pVD, pReq->off, pReq->cbReq, &pReq->SgBuf,
+                             tstVDIoBenchReqComplete, pReq, pWorker->hEvtCompleted);
+            break;
+        case VDIOREQTXDIR_WRITE:
+            rc = VDAsyncWrite(pVD, pReq->off, pReq->cbReq, &pReq->SgBuf,
+                              tstVDIoBenchReqComplete, pReq, pWorker->hEvtCompleted);
+            break;
+        case VDIOREQTXDIR_FLUSH:
+            rc = VDAsyncFlush(pVD, tstVDIoBenchReqComplete, pReq, pWorker->hEvtCompleted);
+            break;
+        case VDIOREQTXDIR_DISCARD:
+            pReq->Range.offStart = pReq->off;
+            pReq->Range.cbRange  = pReq->cbReq;
+            rc = VDAsyncDiscardRanges(pVD, &pReq->Range, 1, tstVDIoBenchReqComplete,
+                                      pReq, pWorker->hEvtCompleted);
+            break;
+    }
+
+    if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+    {
+        /* Completed synchronously or failed to submit. */
+        pReq->tsComplete = RTTimeNanoTS();
+        pReq->rcReq      = rc == VINF_VD_ASYNC_IO_FINISHED ? VINF_SUCCESS : rc;
+        ASMAtomicWriteU32(&pReq->enmState, VDIOBENCHREQSTATE_COMPLETED);
+    }
+}
+
+/**
+ * Updates the statistics with the given completed request.
+ *
+ * @returns nothing.
+ * @param   pWorker       The worker.
+ * @param   pReq          The completed request.
+ */
+static void tstVDIoBenchReqAccount(PVDIOBENCHWORKER pWorker, PVDIOBENCHREQ pReq)
+{
+    PVDIOBENCHSTATS pStats = &pWorker->aStats[pReq->enmTxDir];
+
+    if (RT_SUCCESS(pReq->rcReq))
+    {
+        uint64_t cNsLatency = pReq->tsComplete - pReq->tsSubmit;
+
+        pStats->cReqs++;
+        pStats->cbTransferred   += pReq->enmTxDir != VDIOREQTXDIR_FLUSH ? pReq->cbReq : 0;
+        pStats->cNsLatencyTotal += cNsLatency;
+        pStats->cNsLatencyMin    = RT_MIN(pStats->cNsLatencyMin, cNsLatency);
+        pStats->cNsLatencyMax    = RT_MAX(pStats->cNsLatencyMax, cNsLatency);
+        pStats->acLatency[tstVDIoBenchLatencyToBucket(cNsLatency)]++;
+    }
+    else
+    {
+        pStats->cReqsFailed++;
+        if (RT_SUCCESS(pWorker->rc))
+        {
+            pWorker->rc = pReq->rcReq;
+            RTTestFailed(pWorker->pBench->pGlob->hTest, "%s of %zu bytes at offset %llu failed with %Rrc\n",
+                         tstVDIoBenchTxDirName(pReq->enmTxDir), pReq->cbReq, pReq->off, pReq->rcReq);
+        }
+    }
+
+    pReq->enmState = VDIOBENCHREQSTATE_IDLE;
+}
+
+/**
+ * Benchmark worker thread, keeps the configured number of requests
+ * outstanding until there is no work left.
+ */
+static DECLCALLBACK(int) tstVDIoBenchWorker(RTTHREAD hThread, void *pvUser)
+{
+    RT_NOREF1(hThread);
+    PVDIOBENCHWORKER pWorker = (PVDIOBENCHWORKER)pvUser;
+    PVDIOBENCH pBench = pWorker->pBench;
+    bool fMoreWork = true;
+
+    RTSemEventMultiWait(pBench->hEvtStart, RT_INDEFINITE_WAIT);
+
+    for (;;)
+    {
+        unsigned cReqsPending = 0;
+        bool fRetry = false;
+        RTMSINTERVAL cMsWait = RT_INDEFINITE_WAIT;
+        uint64_t tsNow = RTTimeNanoTS();
+
+        for (unsigned i = 0; i < pBench->cQueueDepth; i++)
+        {
+            PVDIOBENCHREQ pReq = &pWorker->paReqs[i];
+
+            if (ASMAtomicReadU32(&pReq->enmState) == VDIOBENCHREQSTATE_COMPLETED)
+                tstVDIoBenchReqAccount(pWorker, pReq);
+
+            /* Stop issuing new requests after an error. */
+            if (RT_FAILURE(pWorker->rc))
+            {
+                fMoreWork = false;
+                if (pReq->enmState == VDIOBENCHREQSTATE_SCHEDULED)
+                    pReq->enmState = VDIOBENCHREQSTATE_IDLE;
+            }
+
+            if (   pReq->enmState == VDIOBENCHREQSTATE_IDLE
+                && fMoreWork)
+                fMoreWork = tstVDIoBenchReqNext(pWorker, pReq);
+
+            if (pReq->enmState == VDIOBENCHREQSTATE_SCHEDULED)
+            {
+                if (pReq->tsDue <= tsNow)
+                {
+                    tstVDIoBenchReqSubmit(pWorker, pReq);
+                    if (ASMAtomicReadU32(&pReq->enmState) == VDIOBENCHREQSTATE_COMPLETED)
+                        fRetry = true;
+                }
+                else
+                {
+                    uint64_t cMsDue = (pReq->tsDue - tsNow + RT_NS_1MS - 1) / RT_NS_1MS;
+                    cMsWait = RT_MIN(cMsWait, (RTMSINTERVAL)RT_MIN(cMsDue, RT_MS_1MIN));
+                }
+            }
+
+            if (pReq->enmState != VDIOBENCHREQSTATE_IDLE)
+                cReqsPending++;
+        }
+
+        if (!cReqsPending && !fMoreWork)
+            break;
+
+        if (!fRetry)
+            RTSemEventWait(pWorker->hEvtCompleted, cMsWait);
+    }
+
+    return pWorker->rc;
+}
+
+/**
+ * Writes the given string as a JSON string value.
+ *
+ * @returns nothing.
+ * @param   pStrm         The stream to write to.
+ * @param   psz           The string.
+ */
+static void tstVDIoBenchJsonString(PRTSTREAM pStrm, const char *psz)
+{
+    RTStrmPutCh(pStrm, '"');
+    for (; *psz; psz++)
+    {
+        if (*psz == '"' || *psz == '\\')
+            RTStrmPrintf(pStrm, "\\%c", *psz);
+        else if ((unsigned char)*psz < 0x20)
+            RTStrmPrintf(pStrm, "\\u%04x", (unsigned char)*psz);
+        else
+            RTStrmPutCh(pStrm, *psz);
+    }
+    RTStrmPutCh(pStrm, '"');
+}
+
+/**
+ * Reports the benchmark results through the test framework and appends
+ * them to the given results file as one JSON object per line.
+ *
+ * @returns VBox status code.
+ * @param   pBench        The benchmark.
+ * @param   paStats       The merged statistics indexed by VDIOREQTXDIR.
+ * @param   cThreads      Number of worker threads.
+ * @param   cNsElapsed    The runtime of the benchmark in nanoseconds.
+ * @param   pszMode       The access mode or the trace file name.
+ * @param   pszLabel      Label identifying the run in the results.
+ * @param   pszResults    The results file, "none" to skip writing the results.
+ */
+static int tstVDIoBenchReport(PVDIOBENCH pBench, PCVDIOBENCHSTATS paStats, unsigned cThreads, uint64_t cNsElapsed,
+                              const char *pszMode, const char *pszLabel, const char *pszResults)
+{
+    static const unsigned s_auPerMille[] = { 500, 900, 990, 999 };
+    static const char * const s_apszPercentile[] = { "p50", "p90", "p99", "p99.9" };
+    RTTEST hTest = pBench->pGlob->hTest;
+    PRTSTREAM pStrm = NULL;
+    int rc = VINF_SUCCESS;
+
+    cNsElapsed = RT_MAX(cNsElapsed, 1);
+
+    if (RTStrCmp(pszResults, "none"))
+    {
+        rc = RTStrmOpen(pszResults, "a", &pStrm);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("Opening the results file '%s' failed with %Rrc\n", pszResults, rc);
+            return rc;
+        }
+
+        RTStrmPrintf(pStrm, "{\"label\":");
+        tstVDIoBenchJsonString(pStrm, pszLabel);
+        RTStrmPrintf(pStrm, ",\"disk\":");
+        tstVDIoBenchJsonString(pStrm, pBench->pDisk->pszName);
+        RTStrmPrintf(pStrm, ",\"iobackend\":");
+        tstVDIoBenchJsonString(pStrm, pBench->pGlob->pszIoBackend);
+        RTStrmPrintf(pStrm, ",\"mode\":");
+        tstVDIoBenchJsonString(pStrm, pBench->paTrace ? "trace" : pBench->fRandomAccess ? "rnd" : "seq");
+        if (pBench->paTrace)
+        {
+            RTStrmPrintf(pStrm, ",\"trace\":");
+            tstVDIoBenchJsonString(pStrm, pszMode);
+        }
+        else
+            RTStrmPrintf(pStrm, ",\"blocksize\":%zu,\"writes\":%u", pBench->cbBlkIo, pBench->uWriteChance);
+        RTStrmPrintf(pStrm, ",\"threads\":%u,\"queuedepth\":%u,\"runtime_ns\":%llu,\"ops\":{",
+                     cThreads, pBench->cQueueDepth, cNsElapsed);
+    }
+
+    bool fFirst = true;
+    for (unsigned i = 0; i <= VDIOREQTXDIR_DISCARD; i++)
+    {
+        PCVDIOBENCHSTATS pStats = &paStats[i];
+        if (!pStats->cReqs && !pStats->cReqsFailed)
+            continue;
+
+        const char *pszTxDir = tstVDIoBenchTxDirName((VDIOREQTXDIR)i);
+        uint64_t cIops       = pStats->cReqs * RT_NS_1SEC / cNsElapsed;
+        uint64_t cbSpeedKBs  = tstVDIoGetSpeedKBs(pStats->cbTransferred, cNsElapsed);
+        uint64_t cNsAvg      = pStats->cReqs ? pStats->cNsLatencyTotal / pStats->cReqs : 0;
+        uint64_t acNsPercentile[RT_ELEMENTS(s_auPerMille)];
+
+        for (unsigned j = 0; j < RT_ELEMENTS(s_auPerMille); j++)
+            acNsPercentile[j] = tstVDIoBenchStatsPercentile(pStats, s_auPerMille[j]);
+
+        RTTestValueF(hTest, cIops, RTTESTUNIT_OCCURRENCES_PER_SEC, "%s %s IOPS", pszLabel, pszTxDir);
+        if (i != VDIOREQTXDIR_FLUSH)
+            RTTestValueF(hTest, cbSpeedKBs, RTTESTUNIT_KILOBYTES_PER_SEC, "%s %s throughput", pszLabel, pszTxDir);
+        RTTestValueF(hTest, cNsAvg, RTTESTUNIT_NS, "%s %s latency avg", pszLabel, pszTxDir);
+        for (unsigned j = 0; j < RT_ELEMENTS(s_auPerMille); j++)
+            RTTestValueF(hTest, acNsPercentile[j], RTTESTUNIT_NS, "%s %s latency %s", pszLabel, pszTxDir,
+                         s_apszPercentile[j]);
+
+        if (pStrm)
+        {
+            RTStrmPrintf(pStrm, "%s\"%s\":{\"requests\":%llu,\"failed\":%llu,\"bytes\":%llu,\"iops\":%llu,"
+                         "\"bandwidth_kbs\":%llu,\"latency_ns\":{\"min\":%llu,\"avg\":%llu,\"max\":%llu",
+                         fFirst ? "" : ",", pszTxDir, pStats->cReqs, pStats->cReqsFailed, pStats->cbTransferred,
+                         cIops, cbSpeedKBs, pStats->cReqs ? pStats->cNsLatencyMin : 0, cNsAvg, pStats->cNsLatencyMax);
+            for (unsigned j = 0; j < RT_ELEMENTS(s_auPerMille); j++)
+                RTStrmPrintf(pStrm, ",\"%s\":%llu", s_apszPercentile[j], acNsPercentile[j]);
+            RTStrmPrintf(pStrm, "}}");
+        }
+        fFirst = false;
+    }
+
+    if (pStrm)
+    {
+        RTStrmPrintf(pStrm, "}}\n");
+        rc = RTStrmClose(pStrm);
+    }
+
+    return rc;
+}
+
+/**
+ * Runs the benchmark described by the given state.
+ *
+ * @returns VBox status code.
+ * @param   pBench        The benchmark, the workload must be set up.
+ * @param   cThreads      Number of worker threads to use.
+ * @param   pszMode       The access mode or the trace file name for reporting.
+ * @param   pszLabel      Label identifying the run in the results.
+ * @param   pszResults    The results file, "none" to skip writing the results.
+ */
+static int tstVDIoBenchRun(PVDIOBENCH pBench, unsigned cThreads, const char *pszMode,
+                           const char *pszLabel, const char *pszResults)
+{
+    PVDIOBENCHWORKER paWorkers = (PVDIOBENCHWORKER)RTMemAllocZ(cThreads * sizeof(VDIOBENCHWORKER));
+    if (!paWorkers)
+        return VERR_NO_MEMORY;
+
+    int rc = RTSemEventMultiCreate(&pBench->hEvtStart);
+    for (unsigned i = 0; i < cThreads && RT_SUCCESS(rc); i++)
+    {
+        PVDIOBENCHWORKER pWorker = &paWorkers[i];
+
+        pWorker->pBench  = pBench;
+        pWorker->hThread = NIL_RTTHREAD;
+        for (unsigned j = 0; j < RT_ELEMENTS(pWorker->aStats); j++)
+            pWorker->aStats[j].cNsLatencyMin = UINT64_MAX;
+
+        rc = RTSemEventCreate(&pWorker->hEvtCompleted);
+        if (RT_SUCCESS(rc))
+            rc = RTRandAdvCreateParkMiller(&pWorker->hRand);
+        if (RT_SUCCESS(rc))
+        {
+            /* Fixed seeds to get the same access pattern on every run. */
+            RTRandAdvSeed(pWorker->hRand, i + 1);
+            pWorker->paReqs = (PVDIOBENCHREQ)RTMemAllocZ(pBench->cQueueDepth * sizeof(VDIOBENCHREQ));
+            if (!pWorker->paReqs)
+                rc = VERR_NO_MEMORY;
+        }
+        for (unsigned j = 0; j < pBench->cQueueDepth && RT_SUCCESS(rc); j++)
+        {
+            pWorker->paReqs[j].pvBuf = RTMemPageAlloc(RT_ALIGN_Z(pBench->cbReqMax, _4K));
+            if (pWorker->paReqs[j].pvBuf)
+                RTRandAdvBytes(pWorker->hRand, pWorker->paReqs[j].pvBuf, pBench->cbReqMax);
+            else
+                rc = VERR_NO_MEMORY;
+        }
+        if (RT_SUCCESS(rc))
+            rc = RTThreadCreateF(&pWorker->hThread, tstVDIoBenchWorker, pWorker, 0, RTTHREADTYPE_IO,
+                                 RTTHREADFLAGS_WAITABLE, "VDIoBench%u", i);
+    }
+
+    /* Release the workers, they bail out early on a setup failure. */
+    pBench->tsStart = RTTimeNanoTS();
+    if (RT_FAILURE(rc))
+    {
+        pBench->cbIoLeft      = 0;
+        pBench->cTraceEntries = 0;
+    }
+    if (pBench->hEvtStart != NIL_RTSEMEVENTMULTI)
+        RTSemEventMultiSignal(pBench->hEvtStart);
+
+    for (unsigned i = 0; i < cThreads; i++)
+    {
+        if (paWorkers[i].hThread != NIL_RTTHREAD)
+        {
+            int rcThread = VINF_SUCCESS;
+            int rc2 = RTThreadWait(paWorkers[i].hThread, RT_INDEFINITE_WAIT, &rcThread);
+            if (RT_SUCCESS(rc))
+                rc = RT_SUCCESS(rc2) ? rcThread : rc2;
+        }
+    }
+    uint64_t cNsElapsed = RTTimeNanoTS() - pBench->tsStart;
+
+    if (RT_SUCCESS(rc))
+    {
+        PVDIOBENCHSTATS paStats = (PVDIOBENCHSTATS)RTMemAllocZ((VDIOREQTXDIR_DISCARD + 1) * sizeof(VDIOBENCHSTATS));
+        if (paStats)
+        {
+            for (unsigned i = 0; i <= VDIOREQTXDIR_DISCARD; i++)
+            {
+                paStats[i].cNsLatencyMin = UINT64_MAX;
+                for (unsigned j = 0; j < cThreads; j++)
+                    tstVDIoBenchStatsMerge(&paStats[i], &paWorkers[j].aStats[i]);
+            }
+
+            rc = tstVDIoBenchReport(pBench, paStats, cThreads, cNsElapsed, pszMode, pszLabel, pszResults);
+            RTMemFree(paStats);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    for (unsigned i = 0; i < cThreads; i++)
+    {
+        PVDIOBENCHWORKER pWorker = &paWorkers[i];
+
+        if (pWorker->paReqs)
+        {
+            for (unsigned j = 0; j < pBench->cQueueDepth; j++)
+                if (pWorker->paReqs[j].pvBuf)
+                    RTMemPageFree(pWorker->paReqs[j].pvBuf, RT_ALIGN_Z(pBench->cbReqMax, _4K));
+            RTMemFree(pWorker->paReqs);
+        }
+        if (pWorker->hRand != NIL_RTRAND)
+            RTRandAdvDestroy(pWorker->hRand);
+        if (pWorker->hEvtCompleted != NIL_RTSEMEVENT)
+            RTSemEventDestroy(pWorker->hEvtCompleted);
+    }
+    if (pBench->hEvtStart != NIL_RTSEMEVENTMULTI)
+        RTSemEventMultiDestroy(pBench->hEvtStart);
+    RTMemFree(paWorkers);
+
+    return rc;
+}
+
+/**
+ * Checks the common benchmark arguments and initializes the benchmark state.
+ *
+ * @returns VBox status code.
+ * @param   pBench        The benchmark state to initialize.
+ * @param   pGlob         Global test state.
+ * @param   pcszDisk      Name of the disk to operate on.
+ * @param   cThreads      Number of worker threads.
+ * @param   cQueueDepth   Number of outstanding requests per thread.
+ */
+static int tstVDIoBenchInit(PVDIOBENCH pBench, PVDTESTGLOB pGlob, const char *pcszDisk,
+                            unsigned cThreads, unsigned cQueueDepth)
+{
+    RT_ZERO(*pBench);
+    pBench->pGlob       = pGlob;
+    pBench->cQueueDepth = cQueueDepth;
+    pBench->hEvtStart   = NIL_RTSEMEVENTMULTI;
+
+    if (   !cThreads
+        || !cQueueDepth)
+    {
+        RTPrintf("Thread count and queue depth must not be 0\n");
+        return VERR_INVALID_PARAMETER;
+    }
+
+    pBench->pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
+    if (!pBench->pDisk)
+        return VERR_NOT_FOUND;
+
+    /* Concurrent requests from several threads would make the verification content ambiguous. */
+    if (pBench->pDisk->pMemDiskVerify)
+    {
+        RTPrintf("Benchmarks are not supported on disks with verification enabled\n");
+        return VERR_INVALID_STATE;
+    }
+
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) vdScriptHandlerIoBench(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    VDIOBENCH   Bench;
+
+    const char *pcszDisk     = paScriptArgs[0].psz;
+    unsigned    cThreads     = paScriptArgs[1].u32;
+    unsigned    cQueueDepth  = paScriptArgs[2].u32;
+    const char *pcszMode     = paScriptArgs[3].psz;
+    uint64_t    cbBlkSize    = paScriptArgs[4].u64;
+    uint64_t    offStart     = paScriptArgs[5].u64;
+    uint64_t    offEnd       = paScriptArgs[6].u64;
+    uint64_t    cbIo         = paScriptArgs[7].u64;
+    uint32_t    cMsRuntime   = paScriptArgs[8].u32;
+    unsigned    uWriteChance = paScriptArgs[9].u32;
+    const char *pcszLabel    = paScriptArgs[10].psz;
+    const char *pcszResults  = paScriptArgs[11].psz;
+
+    int rc = tstVDIoBenchInit(&Bench, pGlob, pcszDisk, cThreads, cQueueDepth);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    if (!RTStrICmp(pcszMode, "seq"))
+        Bench.fRandomAccess = false;
+    else if (!RTStrICmp(pcszMode, "rnd"))
+        Bench.fRandomAccess = true;
+    else
+    {
+        RTPrintf("Invalid access mode '%s'\n", pcszMode);
+        return VERR_INVALID_PARAMETER;
+    }
+
+    /* Set defaults if not set by the user. */
+    if (offStart == 0 && offEnd == 0)
+    {
+        offEnd = VDGetSize(Bench.pDisk->pVD, VD_LAST_IMAGE);
+        if (offEnd == 0)
+            return VERR_INVALID_STATE;
+    }
+
+    if (   !cbBlkSize
+        || offEnd <= offStart
+        || offEnd - offStart < cbBlkSize
+        || uWriteChance > 100)
+    {
+        RTPrintf("Invalid block size, range or write chance\n");
+        return VERR_INVALID_PARAMETER;
+    }
+
+    Bench.cbReqMax     = (size_t)cbBlkSize;
+    Bench.cbBlkIo      = (size_t)cbBlkSize;
+    Bench.offStart     = offStart;
+    Bench.cBlocks      = (offEnd - offStart) / cbBlkSize;
+    Bench.uWriteChance = uWriteChance;
+    Bench.cNsRuntime   = cMsRuntime * RT_NS_1MS_64;
+    if (cbIo)
+        Bench.cbIoLeft = cbIo;
+    else
+        Bench.cbIoLeft = cMsRuntime ? UINT64_MAX : offEnd - offStart;
+
+    RTTestSub(pGlob->hTest, "I/O benchmark");
+    rc = tstVDIoBenchRun(&Bench, cThreads, pcszMode, pcszLabel, pcszResults);
+    RTTestSubDone(pGlob->hTest);
+
+    return rc;
+}
+
+/**
+ * Parses the timestamp of a blkparse event, "seconds.nanoseconds".
+ *
+ * @returns VBox status code.
+ * @param   psz           The timestamp string.
+ * @param   pcNs          Where to store the timestamp in nanoseconds.
+ */
+static int tstVDIoTraceParseTimestamp(const char *psz, uint64_t *pcNs)
+{
+    char *pszNext = NULL;
+    uint64_t cSecs = 0;
+    uint64_t cNs = 0;
+
+    int rc = RTStrToUInt64Ex(psz, &pszNext, 10, &cSecs);
+    if (RT_FAILURE(rc))
+        return rc;
 
-                    /* Wait for a request to complete. */
-                    if (   fAsync
-                        && fTasksOutstanding)
-                    {
-                        rc = RTSemEventWait(EventSem, RT_INDEFINITE_WAIT);
-                        AssertRC(rc);
-                    }
-                }
+    if (*pszNext == '.')
+    {
+        uint64_t uScale = RT_NS_1SEC;
+        for (pszNext++; RT_C_IS_DIGIT(*pszNext); pszNext++)
+        {
+            uScale /= 10;
+            cNs += (*pszNext - '0') * uScale;
+        }
+    }
 
-                /* Cleanup, wait for all tasks to complete. */
-                while (fAsync)
-                {
-                    unsigned idx = 0;
-                    bool fAllIdle = true;
+    if (*pszNext != '\0')
+        return VERR_PARSE_ERROR;
 
-                    while (idx < cMaxTasksOutstanding)
-                    {
-                        if (tstVDIoTestReqOutstanding(&paIoReq[idx]))
-                        {
-                            fAllIdle = false;
-                            break;
-                        }
-                        idx++;
-                    }
+    *pcNs = cSecs * RT_NS_1SEC + cNs;
+    return VINF_SUCCESS;
+}
 
-                    if (!fAllIdle)
-                    {
-                        rc = RTSemEventWait(EventSem, 100);
-                        Assert(RT_SUCCESS(rc) || rc == VERR_TIMEOUT);
-                    }
-                    else
-                        break;
-                }
+/**
+ * Loads a block trace in the default blkparse text format, like
+ *
+ *      8,0    3        1     0.000000000   697  Q  WS 3417048 + 8 [kjournald]
+ *
+ * Only events with the given action are used, other lines are ignored.
+ *
+ * @returns VBox status code.
+ * @param   pcszTrace     The trace file.
+ * @param   pcszEvent     The blktrace action to replay, usually "Q" or "D".
+ * @param   cbDisk        Size of the disk, requests beyond are skipped.
+ * @param   ppaTrace      Where to store the trace entries on success.
+ * @param   pcEntries     Where to store the number of trace entries.
+ * @param   pcbReqMax     Where to store the maximum request size.
+ */
+static int tstVDIoTraceLoad(const char *pcszTrace, const char *pcszEvent, uint64_t cbDisk,
+                            PVDIOTRACEENTRY *ppaTrace, uint32_t *pcEntries, size_t *pcbReqMax)
+{
+    PRTSTREAM pStrm = NULL;
+    PVDIOTRACEENTRY paTrace = NULL;
+    uint32_t cEntries = 0;
+    uint32_t cEntriesMax = 0;
+    uint32_t cSkipped = 0;
+    size_t cbReqMax = 0;
+    uint64_t cNsFirst = UINT64_MAX;
+    unsigned iLine = 0;
+    char szLine[512];
+
+    int rc = RTStrmOpen(pcszTrace, "r", &pStrm);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("Opening the trace '%s' failed with %Rrc\n", pcszTrace, rc);
+        return rc;
+    }
 
-                NanoTS = RTTimeNanoTS() - NanoTS;
-                uint64_t SpeedKBs = tstVDIoGetSpeedKBs(cbIo, NanoTS);
-                RTTestValue(pGlob->hTest, "Throughput", SpeedKBs, RTTESTUNIT_KILOBYTES_PER_SEC);
+    while (RT_SUCCESS(rc = RTStrmGetLine(pStrm, szLine, sizeof(szLine))))
+    {
+        char *apszTok[11];
+        unsigned cTok = 0;
+        char *psz = szLine;
 
-                for (unsigned i = 0; i < cMaxTasksOutstanding; i++)
-                {
-                    if (paIoReq[i].pvBufRead)
-                        RTMemFree(paIoReq[i].pvBufRead);
-                }
+        iLine++;
 
-                RTSemEventDestroy(EventSem);
-                RTMemFree(paIoReq);
-            }
-            else
+        /* Split the line at whitespace. */
+        for (;;)
+        {
+            psz = RTStrStripL(psz);
+            if (!*psz || cTok == RT_ELEMENTS(apszTok))
+                break;
+            apszTok[cTok++] = psz;
+            while (*psz && !RT_C_IS_SPACE(*psz))
+                psz++;
+            if (*psz)
+                *psz++ = '\0';
+        }
+
+        /* Only event lines of the requested action, skips the summary at the end. */
+        if (   cTok < 7
+            || !strchr(apszTok[0], ',')
+            || RTStrCmp(apszTok[5], pcszEvent))
+            continue;
+
+        uint64_t cNsStart = 0;
+        uint64_t uSector = 0;
+        uint32_t cSectors = 0;
+        const char *pszRwbs = apszTok[6];
+
+        rc = tstVDIoTraceParseTimestamp(apszTok[3], &cNsStart);
+        if (   RT_SUCCESS(rc)
+            && cTok >= 10
+            && !strcmp(apszTok[8], "+"))
+        {
+            rc = RTStrToUInt64Full(apszTok[7], 10, &uSector);
+            if (RT_SUCCESS(rc))
+                rc = RTStrToUInt32Full(apszTok[9], 10, &cSectors);
+        }
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("%s(%u): Invalid event\n", pcszTrace, iLine);
+            rc = VERR_PARSE_ERROR;
+            break;
+        }
+
+        if (cEntries + 2 > cEntriesMax)
+        {
+            uint32_t cEntriesNew = cEntriesMax ? cEntriesMax * 2 : _4K;
+            PVDIOTRACEENTRY paTraceNew = (PVDIOTRACEENTRY)RTMemRealloc(paTrace, cEntriesNew * sizeof(VDIOTRACEENTRY));
+            if (!paTraceNew)
             {
-                if (paIoReq)
-                    RTMemFree(paIoReq);
-                if (RT_SUCCESS(rc))
-                    RTSemEventDestroy(EventSem);
                 rc = VERR_NO_MEMORY;
+                break;
             }
+            paTrace     = paTraceNew;
+            cEntriesMax = cEntriesNew;
+        }
 
-            tstVDIoTestDestroy(&IoTest);
+        cNsFirst = RT_MIN(cNsFirst, cNsStart);
+
+        /* A leading F denotes a preflush which is replayed as a separate flush. */
+        if (*pszRwbs == 'F')
+        {
+            paTrace[cEntries].cNsStart = cNsStart;
+            paTrace[cEntries].off      = 0;
+            paTrace[cEntries].cbReq    = 0;
+            paTrace[cEntries].enmTxDir = VDIOREQTXDIR_FLUSH;
+            cEntries++;
+        }
+
+        if (!cSectors)
+            continue;
+
+        uint64_t off   = uSector * 512;
+        size_t   cbReq = (size_t)cSectors * 512;
+        if (   off >= cbDisk
+            || cbDisk - off < cbReq)
+        {
+            cSkipped++;
+            continue;
         }
+
+        VDIOREQTXDIR enmTxDir;
+        if (strchr(pszRwbs, 'D'))
+            enmTxDir = VDIOREQTXDIR_DISCARD;
+        else if (strchr(pszRwbs, 'W'))
+            enmTxDir = VDIOREQTXDIR_WRITE;
+        else if (strchr(pszRwbs, 'R'))
+            enmTxDir = VDIOREQTXDIR_READ;
+        else
+            continue;
+
+        paTrace[cEntries].cNsStart = cNsStart;
+        paTrace[cEntries].off      = off;
+        paTrace[cEntries].cbReq    = cbReq;
+        paTrace[cEntries].enmTxDir = enmTxDir;
+        cEntries++;
+        cbReqMax = RT_MAX(cbReqMax, cbReq);
+    }
+    RTStrmClose(pStrm);
+
+    if (rc == VERR_EOF)
+        rc = VINF_SUCCESS;
+    if (RT_SUCCESS(rc) && !cEntries)
+    {
+        RTPrintf("The trace '%s' contains no '%s' events\n", pcszTrace, pcszEvent);
+        rc = VERR_NOT_FOUND;
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        for (uint32_t i = 0; i < cEntries; i++)
+            paTrace[i].cNsStart -= cNsFirst;
+        if (cSkipped)
+            RTPrintf("Skipped %u requests of the trace '%s' beyond the end of the disk\n", cSkipped, pcszTrace);
+
+        *ppaTrace  = paTrace;
+        *pcEntries = cEntries;
+        *pcbReqMax = RT_MAX(cbReqMax, 512);
+    }
+    else
+        RTMemFree(paTrace);
+
+    return rc;
+}
+
+static DECLCALLBACK(int) vdScriptHandlerIoTraceReplay(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    VDIOBENCH   Bench;
+
+    const char *pcszDisk    = paScriptArgs[0].psz;
+    unsigned    cThreads    = paScriptArgs[1].u32;
+    unsigned    cQueueDepth = paScriptArgs[2].u32;
+    const char *pcszTrace   = paScriptArgs[3].psz;
+    const char *pcszEvent   = paScriptArgs[4].psz;
+    bool        fTimed      = paScriptArgs[5].f;
+    const char *pcszLabel   = paScriptArgs[6].psz;
+    const char *pcszResults = paScriptArgs[7].psz;
+
+    int rc = tstVDIoBenchInit(&Bench, pGlob, pcszDisk, cThreads, cQueueDepth);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    PVDIOTRACEENTRY paTrace = NULL;
+    rc = tstVDIoTraceLoad(pcszTrace, pcszEvent, VDGetSize(Bench.pDisk->pVD, VD_LAST_IMAGE),
+                          &paTrace, &Bench.cTraceEntries, &Bench.cbReqMax);
+    if (RT_SUCCESS(rc))
+    {
+        Bench.paTrace = paTrace;
+        Bench.fTimed  = fTimed;
+
+        RTTestSub(pGlob->hTest, "Block trace replay");
+        rc = tstVDIoBenchRun(&Bench, cThreads, pcszTrace, pcszLabel, pcszResults);
         RTTestSubDone(pGlob->hTest);
+        RTMemFree(paTrace);
     }
 
     return rc;
@@ -1374,6 +2520,101 @@ static DECLCALLBACK(int) vdScriptHandlerClose(PVDSCRIPTARG paScriptArgs, void *p
     return rc;
 }
 
+static DECLCALLBACK(int) vdScriptHandlerCreateCache(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    PVDDISK pDisk = NULL;
+
+    const char *pcszDisk    = paScriptArgs[0].psz;
+    const char *pcszImage   = paScriptArgs[1].psz;
+    const char *pcszBackend = paScriptArgs[2].psz;
+    uint64_t cbSize         = paScriptArgs[3].u64;
+    bool fWriteBack         = paScriptArgs[4].f;
+
+    pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
+    if (pDisk)
+    {
+        unsigned fOpenFlags = VD_OPEN_FLAGS_ASYNC_IO;
+
+        if (fWriteBack)
+            fOpenFlags |= VD_OPEN_FLAGS_CACHE_WRITE_BACK;
+
+        rc = VDCreateCache(pDisk->pVD, pcszBackend, pcszImage, cbSize, VD_IMAGE_FLAGS_FIXED, NULL, NULL,
+                           fOpenFlags, pGlob->pInterfacesImages, NULL);
+    }
+    else
+        rc = VERR_NOT_FOUND;
+
+    return rc;
+}
+
+static DECLCALLBACK(int) vdScriptHandlerOpenCache(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    PVDDISK pDisk = NULL;
+
+    const char *pcszDisk    = paScriptArgs[0].psz;
+    const char *pcszImage   = paScriptArgs[1].psz;
+    const char *pcszBackend = paScriptArgs[2].psz;
+    bool fWriteBack         = paScriptArgs[3].f;
+
+    pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
+    if (pDisk)
+    {
+        unsigned fOpenFlags = VD_OPEN_FLAGS_ASYNC_IO;
+
+        if (fWriteBack)
+            fOpenFlags |= VD_OPEN_FLAGS_CACHE_WRITE_BACK;
+
+        rc = VDCacheOpen(pDisk->pVD, pcszBackend, pcszImage, fOpenFlags, pGlob->pInterfacesImages);
+    }
+    else
+        rc = VERR_NOT_FOUND;
+
+    return rc;
+}
+
+static DECLCALLBACK(int) vdScriptHandlerCloseCache(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    const char *pcszDisk = paScriptArgs[0].psz;
+    bool fDelete = paScriptArgs[1].f;
+
+    PVDDISK pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
+    if (pDisk)
+        rc = VDCacheClose(pDisk->pVD, fDelete);
+    else
+        rc = VERR_NOT_FOUND;
+
+    return rc;
+}
+
+static DECLCALLBACK(int) vdScriptHandlerDestage(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    const char *pcszDisk = paScriptArgs[0].psz;
+
+    PVDDISK pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
+    if (pDisk)
+    {
+        uint64_t cbDirtyLeft = 0;
+        rc = VDCacheDestage(pDisk->pVD, UINT64_MAX, &cbDirtyLeft);
+        if (RT_SUCCESS(rc) && cbDirtyLeft)
+        {
+            RTPrintf("%s: %llu bytes are still dirty after destaging everything\n", pcszDisk, cbDirtyLeft);
+            rc = VERR_INVALID_STATE;
+        }
+    }
+    else
+        rc = VERR_NOT_FOUND;
+
+    return rc;
+}
+
 
 static DECLCALLBACK(int) vdScriptHandlerPrintFileSize(PVDSCRIPTARG paScriptArgs, void *pvUser)
 {
@@ -1393,6 +2634,34 @@ static DECLCALLBACK(int) vdScriptHandlerPrintFileSize(PVDSCRIPTARG paScriptArgs,
 }
 
 
+static DECLCALLBACK(int) vdScriptHandlerCheckFileSize(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    PVDDISK pDisk = NULL;
+    const char *pcszDisk = paScriptArgs[0].psz;
+    uint32_t nImage   = paScriptArgs[1].u32;
+    uint64_t cbMin    = paScriptArgs[2].u64;
+    uint64_t cbMax    = paScriptArgs[3].u64;
+
+    pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
+    if (pDisk)
+    {
+        uint64_t cbFile = VDGetFileSize(pDisk->pVD, nImage);
+        if (   cbFile < cbMin
+            || cbFile > cbMax)
+        {
+            RTPrintf("%s: size of image %u is %llu, expected %llu..%llu\n", pcszDisk, nImage, cbFile, cbMin, cbMax);
+            rc = VERR_MISMATCH;
+        }
+    }
+    else
+        rc = VERR_NOT_FOUND;
+
+    return rc;
+}
+
+
 #ifdef VBOX_TSTVDIO_WITH_LOG_REPLAY
 static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, void *pvUser)
 {
@@ -1739,6 +3008,103 @@ static DECLCALLBACK(int) vdScriptHandlerDumpFile(PVDSCRIPTARG paScriptArgs, void
     return rc;
 }
 
+/**
+ * Copies the content of a memory file to another one, creating it if necessary.
+ * Used to snapshot the state of an image as it would be found on disk after
+ * a host crash.
+ */
+static DECLCALLBACK(int) vdScriptHandlerFileCopy(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    const char *pcszSrc = paScriptArgs[0].psz;
+    const char *pcszDst = paScriptArgs[1].psz;
+    PVDFILE pSrc = NULL;
+    PVDFILE pDst = NULL;
+
+    PVDFILE pIt = NULL;
+    RTListForEach(&pGlob->ListFiles, pIt, VDFILE, Node)
+    {
+        if (!RTStrCmp(pIt->pszName, pcszSrc))
+            pSrc = pIt;
+        else if (!RTStrCmp(pIt->pszName, pcszDst))
+            pDst = pIt;
+    }
+
+    if (!pSrc)
+        return VERR_FILE_NOT_FOUND;
+
+    if (!pDst)
+    {
+        pDst = (PVDFILE)RTMemAllocZ(sizeof(VDFILE));
+        if (!pDst)
+            return VERR_NO_MEMORY;
+
+        pDst->pszName = RTStrDup(pcszDst);
+        if (pDst->pszName)
+        {
+            pDst->pfnComplete = pSrc->pfnComplete;
+            rc = VDIoBackendStorageCreate(pGlob->pIoBackend, pGlob->pszIoBackend,
+                                          pcszDst, pSrc->pfnComplete, &pDst->pIoStorage);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+
+        if (RT_FAILURE(rc))
+        {
+            if (pDst->pszName)
+                RTStrFree(pDst->pszName);
+            RTMemFree(pDst);
+            return rc;
+        }
+
+        RTListAppend(&pGlob->ListFiles, &pDst->Node);
+    }
+
+    uint64_t cbFile = 0;
+    rc = VDIoBackendStorageGetSize(pSrc->pIoStorage, &cbFile);
+    if (RT_SUCCESS(rc))
+        rc = VDIoBackendStorageSetSize(pDst->pIoStorage, 0);
+    if (RT_SUCCESS(rc))
+        rc = VDIoBackendStorageSetSize(pDst->pIoStorage, cbFile);
+    if (RT_SUCCESS(rc))
+    {
+        size_t cbBuf = _1M;
+        void *pvBuf = RTMemAlloc(cbBuf);
+        if (pvBuf)
+        {
+            uint64_t off = 0;
+
+            while (   off < cbFile
+                   && RT_SUCCESS(rc))
+            {
+                size_t cbThis = (size_t)RT_MIN(cbBuf, cbFile - off);
+                RTSGBUF SgBuf;
+                RTSGSEG Seg;
+
+                Seg.pvSeg = pvBuf;
+                Seg.cbSeg = cbThis;
+                RTSgBufInit(&SgBuf, &Seg, 1);
+                rc = VDIoBackendTransfer(pSrc->pIoStorage, VDIOTXDIR_READ, off,
+                                         cbThis, &SgBuf, NULL, true /* fSync */);
+                if (RT_SUCCESS(rc))
+                {
+                    RTSgBufReset(&SgBuf);
+                    rc = VDIoBackendTransfer(pDst->pIoStorage, VDIOTXDIR_WRITE, off,
+                                             cbThis, &SgBuf, NULL, true /* fSync */);
+                }
+                off += cbThis;
+            }
+
+            RTMemFree(pvBuf);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    return rc;
+}
+
 static DECLCALLBACK(int) vdScriptHandlerCreateDisk(PVDSCRIPTARG paScriptArgs, void *pvUser)
 {
     int rc = VINF_SUCCESS;
@@ -2080,6 +3446,7 @@ static DECLCALLBACK(int) tstVDIoFileOpen(void *pvUser, const char *pszLocation,
 
                 if (pIt->pszName)
                 {
+                    pIt->pfnComplete = pfnCompleted;
                     rc = VDIoBackendStorageCreate(pGlob->pIoBackend, pGlob->pszIoBackend,
                                                   pszLocation, pfnCompleted, &pIt->pIoStorage);
                 }
@@ -2248,6 +3615,38 @@ static DECLCALLBACK(int) tstVDIoFileSetAllocationSize(void *pvUser, void *pStora
     return VERR_NOT_SUPPORTED;
 }
 
+static DECLCALLBACK(int) tstVDIoFilePunchHole(void *pvUser, void *pStorage, uint64_t off, uint64_t cb)
+{
+    RT_NOREF1(pvUser);
+    PVDSTORAGE pIoStorage = (PVDSTORAGE)pStorage;
+
+    /* Emulated by writing zeros, the I/O backends have no notion of sparse files. */
+    size_t cbZero = (size_t)RT_MIN(cb, _1M);
+    void *pvZero = RTMemAllocZ(cbZero);
+    if (!pvZero)
+        return VERR_NO_MEMORY;
+
+    int rc = VINF_SUCCESS;
+    while (   cb
+           && RT_SUCCESS(rc))
+    {
+        RTSGBUF SgBuf;
+        RTSGSEG Seg;
+        size_t cbThis = (size_t)RT_MIN(cb, cbZero);
+
+        Seg.pvSeg = pvZero;
+        Seg.cbSeg = cbThis;
+        RTSgBufInit(&SgBuf, &Seg, 1);
+        rc = VDIoBackendTransfer(pIoStorage->pFile->pIoStorage, VDIOTXDIR_WRITE, off,
+                                 cbThis, &SgBuf, NULL, true /* fSync */);
+        off += cbThis;
+        cb  -= cbThis;
+    }
+
+    RTMemFree(pvZero);
+    return rc;
+}
+
 static DECLCALLBACK(int) tstVDIoFileWriteSync(void *pvUser, void *pStorage, uint64_t uOffset,
                                               const void *pvBuffer, size_t cbBuffer, size_t *pcbWritten)
 {
@@ -2727,6 +4126,7 @@ static void tstVDIoScriptExec(const char *pszName, const char *pszScript)
     GlobTest.VDIfIo.pfnReadAsync           = tstVDIoFileReadAsync;
     GlobTest.VDIfIo.pfnWriteAsync          = tstVDIoFileWriteAsync;
     GlobTest.VDIfIo.pfnFlushAsync          = tstVDIoFileFlushAsync;
+    GlobTest.VDIfIo.pfnPunchHole           = tstVDIoFilePunchHole;
 
     rc = VDInterfaceAdd(&GlobTest.VDIfIo.Core, "tstVDIo_VDIIo", VDINTERFACETYPE_IO,
                         &GlobTest, sizeof(VDINTERFACEIO), &GlobTest.pInterfacesImages);
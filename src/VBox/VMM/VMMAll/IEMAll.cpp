@@ -225,6 +225,9 @@ typedef IEMSELDESC *PIEMSELDESC;
 #if defined(DOXYGEN_RUNNING) || defined(RT_OS_WINDOWS) || 1
 # define IEM_WITH_SETJMP
 #endif
+#if defined(IEM_WITH_CODE_TLB) && !defined(IEM_WITH_SETJMP)
+# error "IEM_WITH_CODE_TLB requires IEM_WITH_SETJMP"
+#endif
 
 /** Temporary hack to disable the double execution.  Will be removed in favor
  * of a dedicated execution mode in EM. */
@@ -831,6 +834,31 @@ DECLINLINE(IEMMODE) iemCalcCpuMode(PCPUMCTX pCtx)
 }
 
 
+/**
+ * Flushes the virtual address part of the TLBs if the guest may have changed
+ * its paging structures without us noticing.
+ *
+ * With nested paging, HM neither intercepts guest CR3 loads nor INVLPG, so
+ * PGM never gets to tell us about them.  We therefore cannot trust what we
+ * cached during an earlier IEM call.  This is cheap as it only involves
+ * bumping the TLB revisions.
+ *
+ * @param   pVCpu       The cross context virtual CPU structure of the calling
+ *                      thread.
+ */
+DECLINLINE(void) iemTlbSyncWithGuestPaging(PVMCPU pVCpu)
+{
+#if defined(IEM_WITH_CODE_TLB) || defined(IEM_WITH_DATA_TLB)
+    if (!HMIsNestedPagingActive(pVCpu->CTX_SUFF(pVM)))
+    { /* likely */ }
+    else
+        IEMTlbInvalidateAll(pVCpu, false /*fVmm*/);
+#else
+    NOREF(pVCpu);
+#endif
+}
+
+
 /**
  * Initializes the execution state.
  *
@@ -891,6 +919,7 @@ DECLINLINE(void) iemInitExec(PVMCPU pVCpu, bool fBypassHandlers)
     pVCpu->iem.s.iNextMapping       = 0;
     pVCpu->iem.s.rcPassUp           = VINF_SUCCESS;
     pVCpu->iem.s.fBypassHandlers    = fBypassHandlers;
+    iemTlbSyncWithGuestPaging(pVCpu);
 #ifdef VBOX_WITH_RAW_MODE_NOT_R0
     pVCpu->iem.s.fInPatchCode       = pVCpu->iem.s.uCpl == 0
                                && pCtx->cs.u64Base == 0
@@ -1000,6 +1029,7 @@ DECLINLINE(void) iemInitDecoder(PVMCPU pVCpu, bool fBypassHandlers)
     pVCpu->iem.s.iNextMapping       = 0;
     pVCpu->iem.s.rcPassUp           = VINF_SUCCESS;
     pVCpu->iem.s.fBypassHandlers    = fBypassHandlers;
+    iemTlbSyncWithGuestPaging(pVCpu);
 #ifdef VBOX_WITH_RAW_MODE_NOT_R0
     pVCpu->iem.s.fInPatchCode       = pVCpu->iem.s.uCpl == 0
                                && pCtx->cs.u64Base == 0
@@ -1026,6 +1056,30 @@ DECLINLINE(void) iemInitDecoder(PVMCPU pVCpu, bool fBypassHandlers)
 }
 
 
+#ifdef IEM_WITH_CODE_TLB
+/**
+ * Checks that the opcode buffer still points at a valid mapping of the guest
+ * page before reusing it for the next instruction.
+ *
+ * The buffer points directly at the ring-3 mapping of the page and isn't
+ * protected by a PGM page mapping lock, so PGM may have invalidated it from
+ * another thread since the code TLB entry was loaded.
+ *
+ * @returns true if valid, false if the opcodes must be refetched.
+ * @param   pVCpu               The cross context virtual CPU structure of the calling EMT.
+ */
+DECLINLINE(bool) iemOpcodeInstrBufIsValid(PVMCPU pVCpu)
+{
+    uint64_t const     uTag  = IEMTLB_CALC_TAG(&pVCpu->iem.s.CodeTlb, pVCpu->iem.s.uInstrBufPc);
+    PIEMTLBENTRY const pTlbe = IEMTLB_TAG_TO_ENTRY(&pVCpu->iem.s.CodeTlb, uTag);
+    return pTlbe->uTag == uTag
+        &&    (pTlbe->fFlagsAndPhysRev & (IEMTLBE_F_PHYS_REV | IEMTLBE_F_NO_MAPPINGR3 | IEMTLBE_F_PG_NO_READ))
+           == ASMAtomicReadU64(&pVCpu->iem.s.CodeTlb.uTlbPhysRev)
+        && pTlbe->pbMappingR3 == pVCpu->iem.s.pbInstrBuf;
+}
+#endif
+
+
 /**
  * Reinitializes the decoder state 2nd+ loop of IEMExecLots.
  *
@@ -1079,7 +1133,8 @@ DECLINLINE(void) iemReInitDecoder(PVMCPU pVCpu)
     {
         uint64_t off = (pVCpu->iem.s.enmCpuMode == IEMMODE_64BIT ? pCtx->rip : pCtx->eip + (uint32_t)pCtx->cs.u64Base)
                      - pVCpu->iem.s.uInstrBufPc;
-        if (off < pVCpu->iem.s.cbInstrBufTotal)
+        if (   off < pVCpu->iem.s.cbInstrBufTotal
+            && iemOpcodeInstrBufIsValid(pVCpu))
         {
             pVCpu->iem.s.offInstrNextByte = (uint32_t)off;
             pVCpu->iem.s.offCurInstrStart = (uint16_t)off;
@@ -1160,7 +1215,67 @@ IEM_STATIC VBOXSTRICTRC iemInitDecoderAndPrefetchOpcodes(PVMCPU pVCpu, bool fByp
     iemInitDecoder(pVCpu, fBypassHandlers);
 
 #ifdef IEM_WITH_CODE_TLB
-    /** @todo Do ITLB lookup here. */
+    /*
+     * Do an instruction TLB lookup and set up the opcode buffer directly if
+     * we've got a valid mapping of the page.  Anything else (TLB misses,
+     * faults, MMIO, patch code) is left to iemOpcodeFetchBytesJmp, which will
+     * be called by the first opcode fetch since pbInstrBuf is NULL.
+     */
+    PCPUMCTX pCtx = IEM_GET_CTX(pVCpu);
+    RTGCPTR  GCPtrPC;
+    uint32_t cbMaxRead;
+    if (pVCpu->iem.s.enmCpuMode == IEMMODE_64BIT)
+    {
+        GCPtrPC = pCtx->rip;
+        if (!IEM_IS_CANONICAL(GCPtrPC))
+            return iemRaiseGeneralProtectionFault0(pVCpu);
+        cbMaxRead = X86_PAGE_SIZE - ((uint32_t)GCPtrPC & X86_PAGE_OFFSET_MASK);
+    }
+    else
+    {
+        uint32_t const GCPtrPC32 = pCtx->eip;
+        AssertMsg(!(GCPtrPC32 & ~(uint32_t)UINT16_MAX) || pVCpu->iem.s.enmCpuMode == IEMMODE_32BIT, ("%04x:%RX64\n", pCtx->cs.Sel, pCtx->rip));
+        if (GCPtrPC32 > pCtx->cs.u32Limit)
+            return iemRaiseSelectorBounds(pVCpu, X86_SREG_CS, IEM_ACCESS_INSTRUCTION);
+        cbMaxRead = pCtx->cs.u32Limit - GCPtrPC32 + 1;
+        if (!cbMaxRead) /* overflowed */
+        {
+            Assert(GCPtrPC32 == 0); Assert(pCtx->cs.u32Limit == UINT32_MAX);
+            cbMaxRead = X86_PAGE_SIZE;
+        }
+        GCPtrPC = (uint32_t)pCtx->cs.u64Base + GCPtrPC32;
+        uint32_t const cbMaxRead2 = X86_PAGE_SIZE - ((uint32_t)GCPtrPC & X86_PAGE_OFFSET_MASK);
+        if (cbMaxRead2 < cbMaxRead)
+            cbMaxRead = cbMaxRead2;
+    }
+
+    uint64_t const     uTag  = IEMTLB_CALC_TAG(&pVCpu->iem.s.CodeTlb, GCPtrPC);
+    PIEMTLBENTRY const pTlbe = IEMTLB_TAG_TO_ENTRY(&pVCpu->iem.s.CodeTlb, uTag);
+    if (   pTlbe->uTag == uTag
+        &&    (pTlbe->fFlagsAndPhysRev & (  IEMTLBE_F_PHYS_REV | IEMTLBE_F_NO_MAPPINGR3 | IEMTLBE_F_PG_NO_READ
+                                          | IEMTLBE_F_PATCH_CODE))
+           == pVCpu->iem.s.CodeTlb.uTlbPhysRev
+        && (   !(pTlbe->fFlagsAndPhysRev & IEMTLBE_F_PT_NO_USER)
+            || pVCpu->iem.s.uCpl != 3)
+        && (   !(pTlbe->fFlagsAndPhysRev & IEMTLBE_F_PT_NO_EXEC)
+            || !(pCtx->msrEFER & MSR_K6_EFER_NXE)))
+    {
+# ifdef VBOX_WITH_STATISTICS
+        pVCpu->iem.s.CodeTlb.cTlbHits++;
+# endif
+        uint32_t const offPg = (uint32_t)GCPtrPC & X86_PAGE_OFFSET_MASK;
+        pVCpu->iem.s.uInstrBufPc      = GCPtrPC & ~(RTGCPTR)X86_PAGE_OFFSET_MASK;
+        pVCpu->iem.s.pbInstrBuf       = pTlbe->pbMappingR3;
+        pVCpu->iem.s.offInstrNextByte = offPg;
+        pVCpu->iem.s.offCurInstrStart = (int16_t)offPg;
+        pVCpu->iem.s.cbInstrBuf       = offPg + RT_MIN(15, cbMaxRead);
+        pVCpu->iem.s.cbInstrBufTotal  = (uint16_t)(offPg + cbMaxRead);
+    }
+    else
+    {
+        pVCpu->iem.s.cbInstrBuf       = 0;
+        pVCpu->iem.s.cbInstrBufTotal  = 0;
+    }
 
 #else /* !IEM_WITH_CODE_TLB */
 
@@ -1317,7 +1432,11 @@ IEM_STATIC VBOXSTRICTRC iemInitDecoderAndPrefetchOpcodes(PVMCPU pVCpu, bool fByp
  *
  * This is called internally as well as by PGM when moving GC mappings.
  *
- * @returns
+ * @remarks The TLBs are invalidated regardless of whether the current context
+ *          makes use of them, since the IEMCPU state is shared by all contexts
+ *          and ring-3 may make use of TLB entries loaded before a ring-0 or
+ *          raw-mode context CR3 reload, for instance.
+ *
  * @param   pVCpu       The cross context virtual CPU structure of the calling
  *                      thread.
  * @param   fVmm        Set when PGM calls us with a remapping.
@@ -1326,6 +1445,8 @@ VMM_INT_DECL(void) IEMTlbInvalidateAll(PVMCPU pVCpu, bool fVmm)
 {
 #ifdef IEM_WITH_CODE_TLB
     pVCpu->iem.s.cbInstrBufTotal = 0;
+#endif
+    pVCpu->iem.s.CodeTlb.cTlbInvalidateAll++;
     pVCpu->iem.s.CodeTlb.uTlbRevision += IEMTLB_REVISION_INCR;
     if (pVCpu->iem.s.CodeTlb.uTlbRevision != 0)
     { /* very likely */ }
@@ -1336,9 +1457,8 @@ VMM_INT_DECL(void) IEMTlbInvalidateAll(PVMCPU pVCpu, bool fVmm)
         while (i-- > 0)
             pVCpu->iem.s.CodeTlb.aEntries[i].uTag = 0;
     }
-#endif
 
-#ifdef IEM_WITH_DATA_TLB
+    pVCpu->iem.s.DataTlb.cTlbInvalidateAll++;
     pVCpu->iem.s.DataTlb.uTlbRevision += IEMTLB_REVISION_INCR;
     if (pVCpu->iem.s.DataTlb.uTlbRevision != 0)
     { /* very likely */ }
@@ -1349,8 +1469,7 @@ VMM_INT_DECL(void) IEMTlbInvalidateAll(PVMCPU pVCpu, bool fVmm)
         while (i-- > 0)
             pVCpu->iem.s.DataTlb.aEntries[i].uTag = 0;
     }
-#endif
-    NOREF(pVCpu); NOREF(fVmm);
+    NOREF(fVmm);
 }
 
 
@@ -1363,28 +1482,26 @@ VMM_INT_DECL(void) IEMTlbInvalidateAll(PVMCPU pVCpu, bool fVmm)
  */
 VMM_INT_DECL(void) IEMTlbInvalidatePage(PVMCPU pVCpu, RTGCPTR GCPtr)
 {
-#if defined(IEM_WITH_CODE_TLB) || defined(IEM_WITH_DATA_TLB)
-    GCPtr = GCPtr >> X86_PAGE_SHIFT;
     AssertCompile(RT_ELEMENTS(pVCpu->iem.s.CodeTlb.aEntries) == 256);
     AssertCompile(RT_ELEMENTS(pVCpu->iem.s.DataTlb.aEntries) == 256);
-    uintptr_t idx = (uint8_t)GCPtr;
+    GCPtr = IEMTLB_CALC_TAG_NO_REV(GCPtr);
+    uintptr_t const idx = IEMTLB_TAG_TO_INDEX(GCPtr);
 
-# ifdef IEM_WITH_CODE_TLB
     if (pVCpu->iem.s.CodeTlb.aEntries[idx].uTag == (GCPtr | pVCpu->iem.s.CodeTlb.uTlbRevision))
     {
         pVCpu->iem.s.CodeTlb.aEntries[idx].uTag = 0;
-        if (GCPtr == (pVCpu->iem.s.uInstrBufPc >> X86_PAGE_SHIFT))
+        pVCpu->iem.s.CodeTlb.cTlbInvalidatePage++;
+#ifdef IEM_WITH_CODE_TLB
+        if (GCPtr == IEMTLB_CALC_TAG_NO_REV(pVCpu->iem.s.uInstrBufPc))
             pVCpu->iem.s.cbInstrBufTotal = 0;
+#endif
     }
-# endif
 
-# ifdef IEM_WITH_DATA_TLB
     if (pVCpu->iem.s.DataTlb.aEntries[idx].uTag == (GCPtr | pVCpu->iem.s.DataTlb.uTlbRevision))
+    {
         pVCpu->iem.s.DataTlb.aEntries[idx].uTag = 0;
-# endif
-#else
-    NOREF(pVCpu); NOREF(GCPtr);
-#endif
+        pVCpu->iem.s.DataTlb.cTlbInvalidatePage++;
+    }
 }
 
 
@@ -1398,61 +1515,163 @@ VMM_INT_DECL(void) IEMTlbInvalidatePage(PVMCPU pVCpu, RTGCPTR GCPtr)
  */
 VMM_INT_DECL(void) IEMTlbInvalidateAllPhysical(PVMCPU pVCpu)
 {
-#if defined(IEM_WITH_CODE_TLB) || defined(IEM_WITH_DATA_TLB)
-    /* Note! This probably won't end up looking exactly like this, but it give an idea... */
-
-# ifdef IEM_WITH_CODE_TLB
+#ifdef IEM_WITH_CODE_TLB
     pVCpu->iem.s.cbInstrBufTotal = 0;
-# endif
+#endif
     uint64_t uTlbPhysRev = pVCpu->iem.s.CodeTlb.uTlbPhysRev + IEMTLB_PHYS_REV_INCR;
     if (uTlbPhysRev != 0)
     {
-        pVCpu->iem.s.CodeTlb.uTlbPhysRev = uTlbPhysRev;
-        pVCpu->iem.s.DataTlb.uTlbPhysRev = uTlbPhysRev;
+        ASMAtomicWriteU64(&pVCpu->iem.s.CodeTlb.uTlbPhysRev, uTlbPhysRev);
+        ASMAtomicWriteU64(&pVCpu->iem.s.DataTlb.uTlbPhysRev, uTlbPhysRev);
     }
     else
     {
-        pVCpu->iem.s.CodeTlb.uTlbPhysRev = IEMTLB_PHYS_REV_INCR;
-        pVCpu->iem.s.DataTlb.uTlbPhysRev = IEMTLB_PHYS_REV_INCR;
+        ASMAtomicWriteU64(&pVCpu->iem.s.CodeTlb.uTlbPhysRev, IEMTLB_PHYS_REV_INCR);
+        ASMAtomicWriteU64(&pVCpu->iem.s.DataTlb.uTlbPhysRev, IEMTLB_PHYS_REV_INCR);
 
-        unsigned i;
-# ifdef IEM_WITH_CODE_TLB
-        i = RT_ELEMENTS(pVCpu->iem.s.CodeTlb.aEntries);
+        unsigned i = RT_ELEMENTS(pVCpu->iem.s.CodeTlb.aEntries);
         while (i-- > 0)
         {
             pVCpu->iem.s.CodeTlb.aEntries[i].pbMappingR3       = NULL;
             pVCpu->iem.s.CodeTlb.aEntries[i].fFlagsAndPhysRev &= ~(IEMTLBE_F_PG_NO_WRITE | IEMTLBE_F_PG_NO_READ | IEMTLBE_F_PHYS_REV);
         }
-# endif
-# ifdef IEM_WITH_DATA_TLB
         i = RT_ELEMENTS(pVCpu->iem.s.DataTlb.aEntries);
         while (i-- > 0)
         {
             pVCpu->iem.s.DataTlb.aEntries[i].pbMappingR3       = NULL;
             pVCpu->iem.s.DataTlb.aEntries[i].fFlagsAndPhysRev &= ~(IEMTLBE_F_PG_NO_WRITE | IEMTLBE_F_PG_NO_READ | IEMTLBE_F_PHYS_REV);
         }
-# endif
     }
-#else
-    NOREF(pVCpu);
-#endif
 }
 
 
 /**
- * Invalidates the host physical aspects of the IEM TLBs.
+ * Bumps the physical revision of the IEM TLBs of a CPU other than the calling
+ * one.
  *
- * This is called internally as well as by PGM when moving GC mappings.
+ * Should the revision wrap around, we skip the zero value and leave the entry
+ * scrubbing to that CPU's next IEMTlbInvalidateAllPhysical call; a stale entry
+ * would need to survive 2^56 revisions to be revived.
+ *
+ * @param   pVCpu       The cross context virtual CPU structure of the CPU
+ *                      which TLBs to invalidate.
+ */
+IEM_STATIC void iemTlbInvalidateAllPhysicalOther(PVMCPU pVCpu)
+{
+    uint64_t uTlbPhysRev = ASMAtomicUoReadU64(&pVCpu->iem.s.CodeTlb.uTlbPhysRev) + IEMTLB_PHYS_REV_INCR;
+    if (RT_UNLIKELY(uTlbPhysRev == 0))
+        uTlbPhysRev = IEMTLB_PHYS_REV_INCR;
+    ASMAtomicWriteU64(&pVCpu->iem.s.CodeTlb.uTlbPhysRev, uTlbPhysRev);
+    ASMAtomicWriteU64(&pVCpu->iem.s.DataTlb.uTlbPhysRev, uTlbPhysRev);
+}
+
+
+/**
+ * Scans a TLB for entries with valid physical page info for the given guest
+ * page.
+ *
+ * The A20 bit is ignored when comparing the addresses.
+ *
+ * @returns true if any were found, false if not.
+ * @param   pTlb        The TLB.
+ * @param   GCPhys      The guest physical address of the page.
+ * @param   fDrop       Whether to invalidate the physical info of the entries
+ *                      found.  Only the EMT owning the TLB may do this.
+ */
+IEM_STATIC bool iemTlbScanPhysPage(IEMTLB *pTlb, RTGCPHYS GCPhys, bool fDrop)
+{
+    uint64_t const uTlbPhysRev = ASMAtomicReadU64(&pTlb->uTlbPhysRev);
+    bool           fFound      = false;
+    unsigned       i           = RT_ELEMENTS(pTlb->aEntries);
+    while (i-- > 0)
+        if (   (pTlb->aEntries[i].fFlagsAndPhysRev & IEMTLBE_F_PHYS_REV) == uTlbPhysRev
+            && !((pTlb->aEntries[i].GCPhys ^ GCPhys) & ~(RTGCPHYS)(X86_PAGE_OFFSET_MASK | RT_BIT_64(20))))
+        {
+            fFound = true;
+            if (!fDrop)
+                break;
+            pTlb->aEntries[i].fFlagsAndPhysRev &= ~IEMTLBE_F_PHYS_REV;
+        }
+    return fFound;
+}
+
+
+/**
+ * Invalidates the host physical aspects of the IEM TLBs on all CPUs.
+ *
+ * This is called by PGM whenever the backing, the handler state or the host
+ * mapping of one or more guest physical pages changes.
  *
  * @param   pVM         The cross context VM structure.
  *
- * @remarks Caller holds the PGM lock.
+ * @remarks Caller holds the PGM lock.  The TLB entries of the other CPUs are
+ *          only ever loaded while holding the PGM lock (see
+ *          PGMPhysIemGCPhys2PtrNoLock), so bumping their physical revision
+ *          here is sufficient.
  */
 VMM_INT_DECL(void) IEMTlbInvalidateAllPhysicalAllCpus(PVM pVM)
 {
-    RT_NOREF_PV(pVM);
+    PVMCPU pVCpuCaller = VMMGetCpu(pVM);
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        PVMCPU pVCpu = &pVM->aCpus[idCpu];
+        if (pVCpu == pVCpuCaller)
+            IEMTlbInvalidateAllPhysical(pVCpu);
+        else
+            iemTlbInvalidateAllPhysicalOther(pVCpu);
+    }
+}
+
+
+/**
+ * Invalidates the host physical aspects of the IEM TLBs for one guest page on
+ * all CPUs.
+ *
+ * This is called by PGM when the backing or the host mapping of a single page
+ * changes.  On the calling CPU only the entries caching the page are dropped,
+ * while the other CPUs only get their physical revision bumped if they have
+ * the page cached.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   GCPhys      The guest physical address of the page.
+ *
+ * @remarks Caller holds the PGM lock, see IEMTlbInvalidateAllPhysicalAllCpus.
+ *          As the physical part of the entries is only loaded while holding
+ *          the PGM lock, scanning the TLBs of the other CPUs without their
+ *          cooperation will find all the valid entries for the page.
+ */
+VMM_INT_DECL(void) IEMTlbInvalidatePhysPageAllCpus(PVM pVM, RTGCPHYS GCPhys)
+{
+    PVMCPU pVCpuCaller = VMMGetCpu(pVM);
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        PVMCPU pVCpu = &pVM->aCpus[idCpu];
+        if (pVCpu != pVCpuCaller)
+        {
+            if (   iemTlbScanPhysPage(&pVCpu->iem.s.CodeTlb, GCPhys, false /*fDrop*/)
+                || iemTlbScanPhysPage(&pVCpu->iem.s.DataTlb, GCPhys, false /*fDrop*/))
+                iemTlbInvalidateAllPhysicalOther(pVCpu);
+        }
+        /* Direct mappings handed out for the current instruction are revalidated
+           by comparing the revision, so we cannot just drop the entries then. */
+        else if (pVCpu->iem.s.cActiveMappings)
+            IEMTlbInvalidateAllPhysical(pVCpu);
+        else
+        {
+            if (iemTlbScanPhysPage(&pVCpu->iem.s.CodeTlb, GCPhys, true /*fDrop*/))
+            {
+#ifdef IEM_WITH_CODE_TLB
+                pVCpu->iem.s.cbInstrBufTotal = 0;
+#endif
+                pVCpu->iem.s.CodeTlb.cTlbInvalidatePhysPage++;
+            }
+            if (iemTlbScanPhysPage(&pVCpu->iem.s.DataTlb, GCPhys, true /*fDrop*/))
+                pVCpu->iem.s.DataTlb.cTlbInvalidatePhysPage++;
+        }
+    }
 }
 
+
 #ifdef IEM_WITH_CODE_TLB
 
 /**
@@ -1474,11 +1693,6 @@ VMM_INT_DECL(void) IEMTlbInvalidateAllPhysicalAllCpus(PVM pVM)
  */
 IEM_STATIC void iemOpcodeFetchBytesJmp(PVMCPU pVCpu, size_t cbDst, void *pvDst)
 {
-#ifdef IN_RING3
-//__debugbreak();
-#else
-    longjmp(*CTX_SUFF(pVCpu->iem.s.pJmpBuf), VERR_INTERNAL_ERROR);
-#endif
     for (;;)
     {
         Assert(cbDst <= 8);
@@ -1499,7 +1713,7 @@ IEM_STATIC void iemOpcodeFetchBytesJmp(PVMCPU pVCpu, size_t cbDst, void *pvDst)
                 cbDst  -= cbCopy;
                 pvDst   = (uint8_t *)pvDst + cbCopy;
                 offBuf += cbCopy;
-                pVCpu->iem.s.offInstrNextByte += offBuf;
+                pVCpu->iem.s.offInstrNextByte = offBuf;
             }
         }
 
@@ -1549,9 +1763,8 @@ IEM_STATIC void iemOpcodeFetchBytesJmp(PVMCPU pVCpu, size_t cbDst, void *pvDst)
         /*
          * Get the TLB entry for this piece of code.
          */
-        uint64_t     uTag  = (GCPtrFirst >> X86_PAGE_SHIFT) | pVCpu->iem.s.CodeTlb.uTlbRevision;
-        AssertCompile(RT_ELEMENTS(pVCpu->iem.s.CodeTlb.aEntries) == 256);
-        PIEMTLBENTRY pTlbe = &pVCpu->iem.s.CodeTlb.aEntries[(uint8_t)uTag];
+        uint64_t const     uTag  = IEMTLB_CALC_TAG(&pVCpu->iem.s.CodeTlb, GCPtrFirst);
+        PIEMTLBENTRY const pTlbe = IEMTLB_TAG_TO_ENTRY(&pVCpu->iem.s.CodeTlb, uTag);
         if (pTlbe->uTag == uTag)
         {
             /* likely when executing lots of code, otherwise unlikely */
@@ -1580,13 +1793,14 @@ IEM_STATIC void iemOpcodeFetchBytesJmp(PVMCPU pVCpu, size_t cbDst, void *pvDst)
                 if (RT_FAILURE(rc))
                 {
                     Log(("iemOpcodeFetchMoreBytes: %RGv - rc=%Rrc\n", GCPtrFirst, rc));
+                    pTlbe->uTag = 0;
                     iemRaisePageFaultJmp(pVCpu, GCPtrFirst, IEM_ACCESS_INSTRUCTION, rc);
                 }
 
                 AssertCompile(IEMTLBE_F_PT_NO_EXEC == 1);
                 pTlbe->uTag             = uTag;
                 pTlbe->fFlagsAndPhysRev = (~fFlags & (X86_PTE_US | X86_PTE_RW | X86_PTE_D)) | (fFlags >> X86_PTE_PAE_BIT_NX);
-                pTlbe->GCPhys           = GCPhys;
+                pTlbe->GCPhys           = GCPhys & ~(RTGCPHYS)X86_PAGE_OFFSET_MASK;
                 pTlbe->pbMappingR3      = NULL;
             }
         }
@@ -1638,12 +1852,13 @@ IEM_STATIC void iemOpcodeFetchBytesJmp(PVMCPU pVCpu, size_t cbDst, void *pvDst)
             AssertCompile(PGMIEMGCPHYS2PTR_F_NO_MAPPINGR3 == IEMTLBE_F_NO_MAPPINGR3);
             pTlbe->fFlagsAndPhysRev &= ~(  IEMTLBE_F_PHYS_REV
                                          | IEMTLBE_F_NO_MAPPINGR3 | IEMTLBE_F_PG_NO_READ | IEMTLBE_F_PG_NO_WRITE);
+            pVCpu->iem.s.CodeTlb.cTlbPhysLoads++;
             int rc = PGMPhysIemGCPhys2PtrNoLock(pVCpu->CTX_SUFF(pVM), pVCpu, pTlbe->GCPhys, &pVCpu->iem.s.CodeTlb.uTlbPhysRev,
                                                 &pTlbe->pbMappingR3, &pTlbe->fFlagsAndPhysRev);
             AssertRCStmt(rc, longjmp(*CTX_SUFF(pVCpu->iem.s.pJmpBuf), rc));
         }
 
-# if defined(IN_RING3) || (defined(IN_RING0) && !defined(VBOX_WITH_2X_4GB_ADDR_SPACE))
+# ifdef IN_RING3
         /*
          * Try do a direct read using the pbMappingR3 pointer.
          */
@@ -1735,6 +1950,8 @@ IEM_STATIC void iemOpcodeFetchBytesJmp(PVMCPU pVCpu, size_t cbDst, void *pvDst)
                      GCPtrFirst, pTlbe->GCPhys + (GCPtrFirst & X86_PAGE_OFFSET_MASK), VBOXSTRICTRC_VAL(rcStrict), cbToRead));
                 longjmp(*CTX_SUFF(pVCpu->iem.s.pJmpBuf), VBOXSTRICTRC_VAL(rcStrict));
             }
+            pVCpu->iem.s.pbInstrBuf       = NULL;
+            pVCpu->iem.s.cbInstrBuf       = 0;
             pVCpu->iem.s.offInstrNextByte = offBuf + cbToRead;
             if (cbToRead == cbDst)
                 return;
@@ -7575,17 +7792,47 @@ iemMemApplySegment(PVMCPU pVCpu, uint32_t fAccess, uint8_t iSegReg, size_t cbMem
 IEM_STATIC VBOXSTRICTRC
 iemMemPageTranslateAndCheckAccess(PVMCPU pVCpu, RTGCPTR GCPtrMem, uint32_t fAccess, PRTGCPHYS pGCPhysMem)
 {
-    /** @todo Need a different PGM interface here.  We're currently using
-     *        generic / REM interfaces. this won't cut it for R0 & RC. */
     RTGCPHYS    GCPhys;
     uint64_t    fFlags;
-    int rc = PGMGstGetPage(pVCpu, GCPtrMem, &fFlags, &GCPhys);
-    if (RT_FAILURE(rc))
+#ifdef IEM_WITH_DATA_TLB
+    /*
+     * Consult the data TLB first.  The entries only cache the page table level
+     * access bits (complemented), so reconstruct fFlags from them.  The
+     * accessed bit was set when the entry was loaded.
+     */
+    uint64_t const     uTag  = IEMTLB_CALC_TAG(&pVCpu->iem.s.DataTlb, GCPtrMem);
+    PIEMTLBENTRY const pTlbe = IEMTLB_TAG_TO_ENTRY(&pVCpu->iem.s.DataTlb, uTag);
+    if (pTlbe->uTag == uTag)
+    {
+# ifdef VBOX_WITH_STATISTICS
+        pVCpu->iem.s.DataTlb.cTlbHits++;
+# endif
+        AssertCompile(IEMTLBE_F_PT_NO_EXEC == 1);
+        fFlags = (~pTlbe->fFlagsAndPhysRev & (X86_PTE_US | X86_PTE_RW | X86_PTE_D))
+               | ((pTlbe->fFlagsAndPhysRev & IEMTLBE_F_PT_NO_EXEC) << X86_PTE_PAE_BIT_NX)
+               | X86_PTE_P | X86_PTE_A;
+        GCPhys = pTlbe->GCPhys;
+    }
+    else
+#endif
     {
-        /** @todo Check unassigned memory in unpaged mode. */
-        /** @todo Reserved bits in page tables. Requires new PGM interface. */
-        *pGCPhysMem = NIL_RTGCPHYS;
-        return iemRaisePageFault(pVCpu, GCPtrMem, fAccess, rc);
+        /** @todo Need a different PGM interface here.  We're currently using
+         *        generic / REM interfaces. this won't cut it for R0 & RC. */
+        int rc = PGMGstGetPage(pVCpu, GCPtrMem, &fFlags, &GCPhys);
+        if (RT_FAILURE(rc))
+        {
+            /** @todo Check unassigned memory in unpaged mode. */
+            /** @todo Reserved bits in page tables. Requires new PGM interface. */
+            *pGCPhysMem = NIL_RTGCPHYS;
+            return iemRaisePageFault(pVCpu, GCPtrMem, fAccess, rc);
+        }
+#ifdef IEM_WITH_DATA_TLB
+        pVCpu->iem.s.DataTlb.cTlbMisses++;
+        pTlbe->uTag             = uTag;
+        pTlbe->fFlagsAndPhysRev = (~fFlags & (X86_PTE_US | X86_PTE_RW | X86_PTE_D)) | (fFlags >> X86_PTE_PAE_BIT_NX);
+        pTlbe->GCPhys           = GCPhys & ~(RTGCPHYS)X86_PAGE_OFFSET_MASK;
+        pTlbe->pbMappingR3      = NULL;
+#endif
     }
 
     /* If the page is writable and does not have the no-exec bit set, all
@@ -7600,6 +7847,9 @@ iemMemPageTranslateAndCheckAccess(PVMCPU pVCpu, RTGCPTR GCPtrMem, uint32_t fAcce
         {
             Log(("iemMemPageTranslateAndCheckAccess: GCPtrMem=%RGv - read-only page -> #PF\n", GCPtrMem));
             *pGCPhysMem = NIL_RTGCPHYS;
+#ifdef IEM_WITH_DATA_TLB
+            pTlbe->uTag = 0;
+#endif
             return iemRaisePageFault(pVCpu, GCPtrMem, fAccess & ~IEM_ACCESS_TYPE_READ, VERR_ACCESS_DENIED);
         }
 
@@ -7610,6 +7860,9 @@ iemMemPageTranslateAndCheckAccess(PVMCPU pVCpu, RTGCPTR GCPtrMem, uint32_t fAcce
         {
             Log(("iemMemPageTranslateAndCheckAccess: GCPtrMem=%RGv - user access to kernel page -> #PF\n", GCPtrMem));
             *pGCPhysMem = NIL_RTGCPHYS;
+#ifdef IEM_WITH_DATA_TLB
+            pTlbe->uTag = 0;
+#endif
             return iemRaisePageFault(pVCpu, GCPtrMem, fAccess, VERR_ACCESS_DENIED);
         }
 
@@ -7620,6 +7873,9 @@ iemMemPageTranslateAndCheckAccess(PVMCPU pVCpu, RTGCPTR GCPtrMem, uint32_t fAcce
         {
             Log(("iemMemPageTranslateAndCheckAccess: GCPtrMem=%RGv - NX -> #PF\n", GCPtrMem));
             *pGCPhysMem = NIL_RTGCPHYS;
+#ifdef IEM_WITH_DATA_TLB
+            pTlbe->uTag = 0;
+#endif
             return iemRaisePageFault(pVCpu, GCPtrMem, fAccess & ~(IEM_ACCESS_TYPE_READ | IEM_ACCESS_TYPE_WRITE),
                                      VERR_ACCESS_DENIED);
         }
@@ -7635,6 +7891,10 @@ iemMemPageTranslateAndCheckAccess(PVMCPU pVCpu, RTGCPTR GCPtrMem, uint32_t fAcce
     {
         int rc2 = PGMGstModifyPage(pVCpu, GCPtrMem, 1, fAccessedDirty, ~(uint64_t)fAccessedDirty);
         AssertRC(rc2);
+#ifdef IEM_WITH_DATA_TLB
+        if (fAccessedDirty & X86_PTE_D)
+            pTlbe->fFlagsAndPhysRev &= ~IEMTLBE_F_PT_NO_DIRTY;
+#endif
     }
 
     GCPhys |= GCPtrMem & PAGE_OFFSET_MASK;
@@ -7717,6 +7977,79 @@ DECLINLINE(void) iemMemPageUnmap(PVMCPU pVCpu, RTGCPHYS GCPhysMem, uint32_t fAcc
     PGMPhysReleasePageMappingLock(pVCpu->CTX_SUFF(pVM), pLock);
 }
 
+#if defined(IEM_WITH_DATA_TLB) && defined(IN_RING3)
+/**
+ * Tries to map a guest page directly using the ring-3 mapping cached in the
+ * data TLB entry.
+ *
+ * This must be called right after a successful
+ * iemMemPageTranslateAndCheckAccess call for the same address, as it relies on
+ * the data TLB entry being loaded.  The returned mapping is not protected by a
+ * PGM page mapping lock, the caller must mark it with IEM_ACCESS_NOT_LOCKED and
+ * have iemMemNotLockedCommit check writes against the returned revision.
+ *
+ * @returns Pointer to the guest memory on success, NULL if the access must take
+ *          the normal iemMemPageMap path (handlers, non-writable page, etc).
+ * @param   pVCpu               The cross context virtual CPU structure of the calling thread.
+ * @param   GCPtrMem            The virtual address (flat).
+ * @param   fAccess             The intended access.
+ * @param   puTlbPhysRev        Where to return the physical revision the
+ *                              mapping was validated against.
+ */
+DECLINLINE(void *) iemMemPageMapViaDataTlb(PVMCPU pVCpu, RTGCPTR GCPtrMem, uint32_t fAccess, uint64_t *puTlbPhysRev)
+{
+# ifdef IEM_LOG_MEMORY_WRITES
+    if (fAccess & IEM_ACCESS_TYPE_WRITE)
+        return NULL;
+# endif
+    if (pVCpu->iem.s.fBypassHandlers)
+        return NULL;
+
+    uint64_t const     uTag  = IEMTLB_CALC_TAG(&pVCpu->iem.s.DataTlb, GCPtrMem);
+    PIEMTLBENTRY const pTlbe = IEMTLB_TAG_TO_ENTRY(&pVCpu->iem.s.DataTlb, uTag);
+    Assert(pTlbe->uTag == uTag);
+
+    /*
+     * Look up the physical page info if necessary.
+     */
+    if ((pTlbe->fFlagsAndPhysRev & IEMTLBE_F_PHYS_REV) == pVCpu->iem.s.DataTlb.uTlbPhysRev)
+    { /* not necessary */ }
+    else
+    {
+        pTlbe->fFlagsAndPhysRev &= ~(  IEMTLBE_F_PHYS_REV
+                                     | IEMTLBE_F_NO_MAPPINGR3 | IEMTLBE_F_PG_NO_READ | IEMTLBE_F_PG_NO_WRITE);
+        pVCpu->iem.s.DataTlb.cTlbPhysLoads++;
+        int rc = PGMPhysIemGCPhys2PtrNoLock(pVCpu->CTX_SUFF(pVM), pVCpu, pTlbe->GCPhys, &pVCpu->iem.s.DataTlb.uTlbPhysRev,
+                                            &pTlbe->pbMappingR3, &pTlbe->fFlagsAndPhysRev);
+        if (RT_FAILURE(rc))
+        {
+            pTlbe->fFlagsAndPhysRev &= ~IEMTLBE_F_PHYS_REV;
+            return NULL;
+        }
+    }
+
+    /*
+     * Check that the page can be accessed directly.  Pages which aren't
+     * writable (zero, shared, write monitored) stay in the TLB for reads, while
+     * the write goes thru PGMPhysIemGCPhys2Ptr which will make them writable.
+     */
+    uint64_t const fNoAccess = IEMTLBE_F_NO_MAPPINGR3
+                             | (fAccess & IEM_ACCESS_TYPE_READ  ? IEMTLBE_F_PG_NO_READ  : 0)
+                             | (fAccess & IEM_ACCESS_TYPE_WRITE ? IEMTLBE_F_PG_NO_WRITE : 0);
+    uint64_t const uTlbPhysRev = ASMAtomicReadU64(&pVCpu->iem.s.DataTlb.uTlbPhysRev);
+    if ((pTlbe->fFlagsAndPhysRev & (IEMTLBE_F_PHYS_REV | fNoAccess)) == uTlbPhysRev)
+    {
+        *puTlbPhysRev = uTlbPhysRev;
+        return &pTlbe->pbMappingR3[GCPtrMem & X86_PAGE_OFFSET_MASK];
+    }
+
+    if (fAccess & IEM_ACCESS_TYPE_WRITE)
+        pTlbe->fFlagsAndPhysRev &= ~IEMTLBE_F_PHYS_REV; /* Reload after PGM has made the page writable. */
+    pVCpu->iem.s.DataTlb.cTlbSlowReadPath++;
+    return NULL;
+}
+#endif /* IEM_WITH_DATA_TLB && IN_RING3 */
+
 
 /**
  * Looks up a memory mapping entry.
@@ -8011,6 +8344,52 @@ IEM_STATIC VBOXSTRICTRC iemMemBounceBufferCommitAndUnmap(PVMCPU pVCpu, unsigned
 }
 
 
+#if defined(IEM_WITH_DATA_TLB) && defined(IN_RING3)
+/**
+ * Revalidates a write done thru a mapping from iemMemPageMapViaDataTlb.
+ *
+ * The direct mapping isn't protected by a PGM page mapping lock, so PGM may
+ * have changed the page (started write monitoring it, for instance) while the
+ * instruction was writing to it.  PGM invalidates the physical side of our
+ * TLBs before making such changes, so if the physical revision changed since
+ * the page was mapped we repeat the write thru PGMPhysWrite to let PGM and any
+ * access handlers see it.
+ *
+ * @returns Strict VBox status code.
+ * @param   pVCpu           The cross context virtual CPU structure of the calling thread.
+ * @param   iMemMap         The index of the mapping.
+ */
+IEM_STATIC VBOXSTRICTRC iemMemNotLockedCommit(PVMCPU pVCpu, unsigned iMemMap)
+{
+    Assert(pVCpu->iem.s.aMemMappings[iMemMap].fAccess & IEM_ACCESS_NOT_LOCKED);
+    Assert(pVCpu->iem.s.aMemMappings[iMemMap].fAccess & IEM_ACCESS_TYPE_WRITE);
+    if (RT_LIKELY(pVCpu->iem.s.aMemMappingLocks[iMemMap].uTlbPhysRev == ASMAtomicReadU64(&pVCpu->iem.s.DataTlb.uTlbPhysRev)))
+        return VINF_SUCCESS;
+
+    VBOXSTRICTRC rcStrict = PGMPhysWrite(pVCpu->CTX_SUFF(pVM),
+                                         pVCpu->iem.s.aMemBbMappings[iMemMap].GCPhysFirst,
+                                         pVCpu->iem.s.aMemMappings[iMemMap].pv,
+                                         pVCpu->iem.s.aMemBbMappings[iMemMap].cbFirst,
+                                         PGMACCESSORIGIN_IEM);
+    if (rcStrict == VINF_SUCCESS)
+        Log(("iemMemNotLockedCommit: GCPhysFirst=%RGp/%#x rewritten\n",
+             pVCpu->iem.s.aMemBbMappings[iMemMap].GCPhysFirst, pVCpu->iem.s.aMemBbMappings[iMemMap].cbFirst));
+    else if (PGM_PHYS_RW_IS_SUCCESS(rcStrict))
+    {
+        Log(("iemMemNotLockedCommit: PGMPhysWrite GCPhysFirst=%RGp/%#x %Rrc\n",
+             pVCpu->iem.s.aMemBbMappings[iMemMap].GCPhysFirst, pVCpu->iem.s.aMemBbMappings[iMemMap].cbFirst,
+             VBOXSTRICTRC_VAL(rcStrict) ));
+        rcStrict = iemSetPassUpStatus(pVCpu, rcStrict);
+    }
+    else
+        Log(("iemMemNotLockedCommit: PGMPhysWrite GCPhysFirst=%RGp/%#x %Rrc (!!)\n",
+             pVCpu->iem.s.aMemBbMappings[iMemMap].GCPhysFirst, pVCpu->iem.s.aMemBbMappings[iMemMap].cbFirst,
+             VBOXSTRICTRC_VAL(rcStrict) ));
+    return rcStrict;
+}
+#endif /* IEM_WITH_DATA_TLB && IN_RING3 */
+
+
 /**
  * iemMemMap worker that deals with a request crossing pages.
  */
@@ -8360,9 +8739,21 @@ iemMemMap(PVMCPU pVCpu, void **ppvMem, size_t cbMem, uint8_t iSegReg, RTGCPTR GC
         Log9(("IEM RD %RGv (%RGp) LB %#zx\n", GCPtrMem, GCPhysFirst, cbMem));
 
     void *pvMem;
-    rcStrict = iemMemPageMap(pVCpu, GCPhysFirst, fAccess, &pvMem, &pVCpu->iem.s.aMemMappingLocks[iMemMap].Lock);
-    if (rcStrict != VINF_SUCCESS)
-        return iemMemBounceBufferMapPhys(pVCpu, iMemMap, ppvMem, cbMem, GCPhysFirst, fAccess, rcStrict);
+#if defined(IEM_WITH_DATA_TLB) && defined(IN_RING3)
+    pvMem = iemMemPageMapViaDataTlb(pVCpu, GCPtrMem, fAccess, &pVCpu->iem.s.aMemMappingLocks[iMemMap].uTlbPhysRev);
+    if (pvMem)
+    {
+        fAccess |= IEM_ACCESS_NOT_LOCKED;
+        pVCpu->iem.s.aMemBbMappings[iMemMap].GCPhysFirst = GCPhysFirst;
+        pVCpu->iem.s.aMemBbMappings[iMemMap].cbFirst     = (uint16_t)cbMem;
+    }
+    else
+#endif
+    {
+        rcStrict = iemMemPageMap(pVCpu, GCPhysFirst, fAccess, &pvMem, &pVCpu->iem.s.aMemMappingLocks[iMemMap].Lock);
+        if (rcStrict != VINF_SUCCESS)
+            return iemMemBounceBufferMapPhys(pVCpu, iMemMap, ppvMem, cbMem, GCPhysFirst, fAccess, rcStrict);
+    }
 
     /*
      * Fill in the mapping table entry.
@@ -8390,6 +8781,7 @@ IEM_STATIC VBOXSTRICTRC iemMemCommitAndUnmap(PVMCPU pVCpu, void *pvMem, uint32_t
 {
     int iMemMap = iemMapLookup(pVCpu, pvMem, fAccess);
     AssertReturn(iMemMap >= 0, iMemMap);
+    VBOXSTRICTRC rcStrict = VINF_SUCCESS;
 
     /* If it's bounce buffered, we may need to write back the buffer. */
     if (pVCpu->iem.s.aMemMappings[iMemMap].fAccess & IEM_ACCESS_BOUNCE_BUFFERED)
@@ -8398,14 +8790,19 @@ IEM_STATIC VBOXSTRICTRC iemMemCommitAndUnmap(PVMCPU pVCpu, void *pvMem, uint32_t
             return iemMemBounceBufferCommitAndUnmap(pVCpu, iMemMap, false /*fPostponeFail*/);
     }
     /* Otherwise unlock it. */
-    else
+    else if (!(pVCpu->iem.s.aMemMappings[iMemMap].fAccess & IEM_ACCESS_NOT_LOCKED))
         PGMPhysReleasePageMappingLock(pVCpu->CTX_SUFF(pVM), &pVCpu->iem.s.aMemMappingLocks[iMemMap].Lock);
+#if defined(IEM_WITH_DATA_TLB) && defined(IN_RING3)
+    /* Or check that PGM didn't change the page while we were writing to it. */
+    else if (pVCpu->iem.s.aMemMappings[iMemMap].fAccess & IEM_ACCESS_TYPE_WRITE)
+        rcStrict = iemMemNotLockedCommit(pVCpu, iMemMap);
+#endif
 
     /* Free the entry. */
     pVCpu->iem.s.aMemMappings[iMemMap].fAccess = IEM_ACCESS_INVALID;
     Assert(pVCpu->iem.s.cActiveMappings != 0);
     pVCpu->iem.s.cActiveMappings--;
-    return VINF_SUCCESS;
+    return rcStrict;
 }
 
 #ifdef IEM_WITH_SETJMP
@@ -8490,15 +8887,27 @@ IEM_STATIC void *iemMemMapJmp(PVMCPU pVCpu, size_t cbMem, uint8_t iSegReg, RTGCP
         Log9(("IEM RD %RGv (%RGp) LB %#zx\n", GCPtrMem, GCPhysFirst, cbMem));
 
     void *pvMem;
-    rcStrict = iemMemPageMap(pVCpu, GCPhysFirst, fAccess, &pvMem, &pVCpu->iem.s.aMemMappingLocks[iMemMap].Lock);
-    if (rcStrict == VINF_SUCCESS)
-    { /* likely */ }
+#if defined(IEM_WITH_DATA_TLB) && defined(IN_RING3)
+    pvMem = iemMemPageMapViaDataTlb(pVCpu, GCPtrMem, fAccess, &pVCpu->iem.s.aMemMappingLocks[iMemMap].uTlbPhysRev);
+    if (pvMem)
+    {
+        fAccess |= IEM_ACCESS_NOT_LOCKED;
+        pVCpu->iem.s.aMemBbMappings[iMemMap].GCPhysFirst = GCPhysFirst;
+        pVCpu->iem.s.aMemBbMappings[iMemMap].cbFirst     = (uint16_t)cbMem;
+    }
     else
+#endif
     {
-        rcStrict = iemMemBounceBufferMapPhys(pVCpu, iMemMap, &pvMem, cbMem, GCPhysFirst, fAccess, rcStrict);
+        rcStrict = iemMemPageMap(pVCpu, GCPhysFirst, fAccess, &pvMem, &pVCpu->iem.s.aMemMappingLocks[iMemMap].Lock);
         if (rcStrict == VINF_SUCCESS)
-            return pvMem;
-        longjmp(*pVCpu->iem.s.CTX_SUFF(pJmpBuf), VBOXSTRICTRC_VAL(rcStrict));
+        { /* likely */ }
+        else
+        {
+            rcStrict = iemMemBounceBufferMapPhys(pVCpu, iMemMap, &pvMem, cbMem, GCPhysFirst, fAccess, rcStrict);
+            if (rcStrict == VINF_SUCCESS)
+                return pvMem;
+            longjmp(*pVCpu->iem.s.CTX_SUFF(pJmpBuf), VBOXSTRICTRC_VAL(rcStrict));
+        }
     }
 
     /*
@@ -8538,8 +8947,22 @@ IEM_STATIC void iemMemCommitAndUnmapJmp(PVMCPU pVCpu, void *pvMem, uint32_t fAcc
         }
     }
     /* Otherwise unlock it. */
-    else
+    else if (!(pVCpu->iem.s.aMemMappings[iMemMap].fAccess & IEM_ACCESS_NOT_LOCKED))
         PGMPhysReleasePageMappingLock(pVCpu->CTX_SUFF(pVM), &pVCpu->iem.s.aMemMappingLocks[iMemMap].Lock);
+#if defined(IEM_WITH_DATA_TLB) && defined(IN_RING3)
+    /* Or check that PGM didn't change the page while we were writing to it. */
+    else if (pVCpu->iem.s.aMemMappings[iMemMap].fAccess & IEM_ACCESS_TYPE_WRITE)
+    {
+        VBOXSTRICTRC rcStrict = iemMemNotLockedCommit(pVCpu, iMemMap);
+        if (rcStrict != VINF_SUCCESS)
+        {
+            pVCpu->iem.s.aMemMappings[iMemMap].fAccess = IEM_ACCESS_INVALID;
+            Assert(pVCpu->iem.s.cActiveMappings != 0);
+            pVCpu->iem.s.cActiveMappings--;
+            longjmp(*pVCpu->iem.s.CTX_SUFF(pJmpBuf), VBOXSTRICTRC_VAL(rcStrict));
+        }
+    }
+#endif
 
     /* Free the entry. */
     pVCpu->iem.s.aMemMappings[iMemMap].fAccess = IEM_ACCESS_INVALID;
@@ -8575,7 +8998,7 @@ IEM_STATIC VBOXSTRICTRC iemMemCommitAndUnmapPostponeTroubleToR3(PVMCPU pVCpu, vo
             return iemMemBounceBufferCommitAndUnmap(pVCpu, iMemMap, true /*fPostponeFail*/);
     }
     /* Otherwise unlock it. */
-    else
+    else if (!(pVCpu->iem.s.aMemMappings[iMemMap].fAccess & IEM_ACCESS_NOT_LOCKED))
         PGMPhysReleasePageMappingLock(pVCpu->CTX_SUFF(pVM), &pVCpu->iem.s.aMemMappingLocks[iMemMap].Lock);
 
     /* Free the entry. */
@@ -8607,7 +9030,7 @@ IEM_STATIC void iemMemRollback(PVMCPU pVCpu)
         {
             AssertMsg(!(fAccess & ~IEM_ACCESS_VALID_MASK) && fAccess != 0, ("%#x\n", fAccess));
             pVCpu->iem.s.aMemMappings[iMemMap].fAccess = IEM_ACCESS_INVALID;
-            if (!(fAccess & IEM_ACCESS_BOUNCE_BUFFERED))
+            if (!(fAccess & (IEM_ACCESS_BOUNCE_BUFFERED | IEM_ACCESS_NOT_LOCKED)))
                 PGMPhysReleasePageMappingLock(pVCpu->CTX_SUFF(pVM), &pVCpu->iem.s.aMemMappingLocks[iMemMap].Lock);
             Assert(pVCpu->iem.s.cActiveMappings > 0);
             pVCpu->iem.s.cActiveMappings--;
@@ -8867,11 +9290,30 @@ IEM_STATIC uint32_t iemMemFetchDataU32SafeJmp(PVMCPU pVCpu, uint8_t iSegReg, RTG
  */
 DECL_NO_INLINE(IEM_STATIC, uint32_t) iemMemFetchDataU32Jmp(PVMCPU pVCpu, uint8_t iSegReg, RTGCPTR GCPtrMem)
 {
-# ifdef IEM_WITH_DATA_TLB
+# if defined(IEM_WITH_DATA_TLB) && defined(IN_RING3)
     RTGCPTR GCPtrEff = iemMemApplySegmentToReadJmp(pVCpu, iSegReg, sizeof(uint32_t), GCPtrMem);
     if (RT_LIKELY((GCPtrEff & X86_PAGE_OFFSET_MASK) <= X86_PAGE_SIZE - sizeof(uint32_t)))
     {
-        /// @todo more later.
+        /*
+         * TLB lookup.  Only take the direct path when the entry is valid for
+         * this physical revision, the page is readable without handlers and
+         * the privilege level allows the access.  Everything else is left to
+         * the safe path, which also takes care of raising exceptions.
+         */
+        uint64_t const     uTag  = IEMTLB_CALC_TAG(&pVCpu->iem.s.DataTlb, GCPtrEff);
+        PIEMTLBENTRY const pTlbe = IEMTLB_TAG_TO_ENTRY(&pVCpu->iem.s.DataTlb, uTag);
+        if (   pTlbe->uTag == uTag
+            &&    (pTlbe->fFlagsAndPhysRev & (  IEMTLBE_F_PHYS_REV | IEMTLBE_F_NO_MAPPINGR3 | IEMTLBE_F_PG_NO_READ
+                                              | (pVCpu->iem.s.uCpl == 3 ? IEMTLBE_F_PT_NO_USER : 0)))
+               == pVCpu->iem.s.DataTlb.uTlbPhysRev)
+        {
+#  ifdef VBOX_WITH_STATISTICS
+            pVCpu->iem.s.DataTlb.cTlbHits++;
+#  endif
+            uint32_t const u32Ret = *(uint32_t const *)&pTlbe->pbMappingR3[GCPtrEff & X86_PAGE_OFFSET_MASK];
+            Log9(("IEM RD dword %d|%RGv: %#010x\n", iSegReg, GCPtrMem, u32Ret));
+            return u32Ret;
+        }
     }
 
     return iemMemFetchDataU32SafeJmp(pVCpu, iSegReg, GCPtrMem);
@@ -13836,6 +14278,7 @@ VMMDECL(VBOXSTRICTRC)       IEMExecOneWithPrefetchedByPC(PVMCPU pVCpu, PCPUMCTXC
 #ifdef IEM_WITH_CODE_TLB
         pVCpu->iem.s.uInstrBufPc      = OpcodeBytesPC;
         pVCpu->iem.s.pbInstrBuf       = (uint8_t const *)pvOpcodeBytes;
+        pVCpu->iem.s.cbInstrBuf       = (uint32_t)RT_MIN(15, cbOpcodeBytes);
         pVCpu->iem.s.cbInstrBufTotal  = (uint16_t)RT_MIN(X86_PAGE_SIZE, cbOpcodeBytes);
         pVCpu->iem.s.offCurInstrStart = 0;
         pVCpu->iem.s.offInstrNextByte = 0;
@@ -13894,6 +14337,7 @@ VMMDECL(VBOXSTRICTRC)       IEMExecOneBypassWithPrefetchedByPC(PVMCPU pVCpu, PCP
 #ifdef IEM_WITH_CODE_TLB
         pVCpu->iem.s.uInstrBufPc      = OpcodeBytesPC;
         pVCpu->iem.s.pbInstrBuf       = (uint8_t const *)pvOpcodeBytes;
+        pVCpu->iem.s.cbInstrBuf       = (uint32_t)RT_MIN(15, cbOpcodeBytes);
         pVCpu->iem.s.cbInstrBufTotal  = (uint16_t)RT_MIN(X86_PAGE_SIZE, cbOpcodeBytes);
         pVCpu->iem.s.offCurInstrStart = 0;
         pVCpu->iem.s.offInstrNextByte = 0;
@@ -13944,6 +14388,7 @@ VMMDECL(VBOXSTRICTRC)       IEMExecOneBypassWithPrefetchedByPCWritten(PVMCPU pVC
 #ifdef IEM_WITH_CODE_TLB
         pVCpu->iem.s.uInstrBufPc      = OpcodeBytesPC;
         pVCpu->iem.s.pbInstrBuf       = (uint8_t const *)pvOpcodeBytes;
+        pVCpu->iem.s.cbInstrBuf       = (uint32_t)RT_MIN(15, cbOpcodeBytes);
         pVCpu->iem.s.cbInstrBufTotal  = (uint16_t)RT_MIN(X86_PAGE_SIZE, cbOpcodeBytes);
         pVCpu->iem.s.offCurInstrStart = 0;
         pVCpu->iem.s.offInstrNextByte = 0;
@@ -13969,6 +14414,219 @@ VMMDECL(VBOXSTRICTRC)       IEMExecOneBypassWithPrefetchedByPCWritten(PVMCPU pVC
 }
 
 
+#ifdef IEM_WITH_DECODE_CACHE
+
+/**
+ * Checks if the given byte is an instruction prefix in the given CPU mode.
+ *
+ * @returns true if prefix, false if not.
+ * @param   bOpcode             The opcode byte.
+ * @param   enmCpuMode          The current CPU mode.
+ */
+DECLINLINE(bool) iemDecodeCacheIsPrefix(uint8_t bOpcode, IEMMODE enmCpuMode)
+{
+    switch (bOpcode)
+    {
+        case 0x26: case 0x2e: case 0x36: case 0x3e: case 0x64: case 0x65:
+        case 0x66: case 0x67: case 0xf0: case 0xf2: case 0xf3:
+            return true;
+        default:
+            return (bOpcode & 0xf0) == 0x40 && enmCpuMode == IEMMODE_64BIT;
+    }
+}
+
+
+/**
+ * Decodes the prefixes of the current instruction, updates the decode cache
+ * entry and calls the opcode handler.
+ *
+ * The prefix decoding here must match what the prefix opcode handlers in
+ * IEMAllInstructions.cpp.h do.  Instructions with more prefixes than fit into
+ * an entry are handed to the regular decoder without caching.
+ *
+ * @returns Strict VBox status code.
+ * @param   pVCpu               The cross context virtual CPU structure of the calling EMT.
+ * @param   pEntry              The decode cache entry to fill.
+ * @param   uPc                 The flat PC of the instruction.
+ * @param   uBytes              The first IEM_DECODE_CACHE_MAX_BYTES opcode bytes.
+ */
+DECL_NO_INLINE(IEM_STATIC, VBOXSTRICTRC) iemDecodeCacheFillAndExec(PVMCPU pVCpu, PIEMDECODECACHEENTRY pEntry,
+                                                                    uint64_t uPc, uint64_t uBytes)
+{
+    IEMMODE const enmCpuMode = pVCpu->iem.s.enmCpuMode;
+
+    /*
+     * Find the opcode and check that everything fits in the entry.
+     */
+    unsigned cbPrefixes = 0;
+    while (   cbPrefixes < IEM_DECODE_CACHE_MAX_BYTES
+           && iemDecodeCacheIsPrefix((uint8_t)(uBytes >> (cbPrefixes * 8)), enmCpuMode))
+        cbPrefixes++;
+    unsigned cbBytes    = cbPrefixes + 1;
+    uint16_t idxHandler = cbPrefixes < IEM_DECODE_CACHE_MAX_BYTES ? (uint8_t)(uBytes >> (cbPrefixes * 8)) : 0;
+    if (idxHandler == 0x0f)
+    {
+        cbBytes++;
+        idxHandler = cbBytes <= IEM_DECODE_CACHE_MAX_BYTES ? 0x100 | (uint8_t)(uBytes >> (cbPrefixes * 8 + 8)) : 0;
+    }
+    if (   cbBytes > IEM_DECODE_CACHE_MAX_BYTES
+        || IEM_GET_TARGET_CPU(pVCpu) < IEMTARGETCPU_386)
+    {
+        uint8_t b; IEM_OPCODE_GET_NEXT_U8(&b);
+        return FNIEMOP_CALL(g_apfnOneByteMap[b]);
+    }
+
+    /*
+     * Apply the prefixes to the decoder state.
+     */
+    for (unsigned off = 0; off < cbPrefixes; off++)
+    {
+        uint8_t const bPrefix = (uint8_t)(uBytes >> (off * 8));
+
+        /* A REX prefix only counts when it immediately precedes the opcode. */
+        if (pVCpu->iem.s.fPrefixes & IEM_OP_PRF_REX)
+        {
+            pVCpu->iem.s.fPrefixes &= ~IEM_OP_PRF_REX_MASK;
+            pVCpu->iem.s.uRexB     = 0;
+            pVCpu->iem.s.uRexIndex = 0;
+            pVCpu->iem.s.uRexReg   = 0;
+            iemRecalEffOpSize(pVCpu);
+        }
+
+        switch (bPrefix)
+        {
+            case 0x26: pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SEG_ES; pVCpu->iem.s.iEffSeg = X86_SREG_ES; break;
+            case 0x2e: pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SEG_CS; pVCpu->iem.s.iEffSeg = X86_SREG_CS; break;
+            case 0x36: pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SEG_SS; pVCpu->iem.s.iEffSeg = X86_SREG_SS; break;
+            case 0x3e: pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SEG_DS; pVCpu->iem.s.iEffSeg = X86_SREG_DS; break;
+            case 0x64: pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SEG_FS; pVCpu->iem.s.iEffSeg = X86_SREG_FS; break;
+            case 0x65: pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SEG_GS; pVCpu->iem.s.iEffSeg = X86_SREG_GS; break;
+            case 0x66:
+                pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SIZE_OP;
+                iemRecalEffOpSize(pVCpu);
+                break;
+            case 0x67:
+                pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SIZE_ADDR;
+                pVCpu->iem.s.enmEffAddrMode = pVCpu->iem.s.enmDefAddrMode == IEMMODE_32BIT ? IEMMODE_16BIT : IEMMODE_32BIT;
+                break;
+            case 0xf0: pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_LOCK; break;
+            case 0xf2: pVCpu->iem.s.fPrefixes = (pVCpu->iem.s.fPrefixes & ~IEM_OP_PRF_REPZ)  | IEM_OP_PRF_REPNZ; break;
+            case 0xf3: pVCpu->iem.s.fPrefixes = (pVCpu->iem.s.fPrefixes & ~IEM_OP_PRF_REPNZ) | IEM_OP_PRF_REPZ; break;
+            default:
+                Assert((bPrefix & 0xf0) == 0x40 && enmCpuMode == IEMMODE_64BIT);
+                pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_REX;
+                if (bPrefix & 1)
+                {
+                    pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_REX_B;
+                    pVCpu->iem.s.uRexB      = 1 << 3;
+                }
+                if (bPrefix & 2)
+                {
+                    pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_REX_X;
+                    pVCpu->iem.s.uRexIndex  = 1 << 3;
+                }
+                if (bPrefix & 4)
+                {
+                    pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_REX_R;
+                    pVCpu->iem.s.uRexReg    = 1 << 3;
+                }
+                if (bPrefix & 8)
+                {
+                    pVCpu->iem.s.fPrefixes |= IEM_OP_PRF_SIZE_REX_W;
+                    iemRecalEffOpSize(pVCpu);
+                }
+                break;
+        }
+    }
+
+    /*
+     * Update the entry.
+     */
+    PIEMDECODECACHE pCache = pVCpu->iem.s.pDecodeCacheR3;
+    if (pEntry->uPc == uPc)
+        pCache->cStale++;
+    pCache->cMisses++;
+
+    uint64_t const fBytesMask = cbBytes < 8 ? RT_BIT_64(cbBytes * 8) - 1 : UINT64_MAX;
+    pEntry->uPc             = uPc;
+    pEntry->uBytes          = uBytes & fBytesMask;
+    pEntry->fBytesMask      = fBytesMask;
+    pEntry->uTlbRevision    = pVCpu->iem.s.CodeTlb.uTlbRevision;
+    pEntry->uTlbPhysRev     = ASMAtomicReadU64(&pVCpu->iem.s.CodeTlb.uTlbPhysRev);
+    pEntry->fPrefixes       = pVCpu->iem.s.fPrefixes;
+    pEntry->idxHandler      = idxHandler;
+    pEntry->cbBytes         = (uint8_t)cbBytes;
+    pEntry->enmCpuMode      = (uint8_t)enmCpuMode;
+    pEntry->enmEffOpSize    = (uint8_t)pVCpu->iem.s.enmEffOpSize;
+    pEntry->enmEffAddrMode  = (uint8_t)pVCpu->iem.s.enmEffAddrMode;
+    pEntry->iEffSeg         = pVCpu->iem.s.iEffSeg;
+    pEntry->uRexReg         = pVCpu->iem.s.uRexReg;
+    pEntry->uRexB           = pVCpu->iem.s.uRexB;
+    pEntry->uRexIndex       = pVCpu->iem.s.uRexIndex;
+
+    /*
+     * Consume the bytes and call the handler.
+     */
+    pVCpu->iem.s.offInstrNextByte += cbBytes;
+    if (idxHandler < 0x100)
+        return FNIEMOP_CALL(g_apfnOneByteMap[idxHandler]);
+    return FNIEMOP_CALL(g_apfnTwoByteMap[idxHandler & 0xff]);
+}
+
+
+/**
+ * Decodes and executes one instruction for IEMExecLots, using the decode cache
+ * for instructions starting with prefixes.
+ *
+ * Entries are validated against the current opcode bytes, so writes to the code
+ * are picked up without any explicit invalidation.  Code TLB flushes and
+ * physical revision changes invalidate all the entries.
+ *
+ * @returns Strict VBox status code.
+ * @param   pVCpu               The cross context virtual CPU structure of the calling EMT.
+ */
+DECLINLINE(VBOXSTRICTRC) iemExecOneDecodeCached(PVMCPU pVCpu)
+{
+    uint8_t const  *pbBuf  = pVCpu->iem.s.pbInstrBuf;
+    uint32_t const  offBuf = pVCpu->iem.s.offInstrNextByte;
+    if (   pbBuf != NULL
+        && offBuf + IEM_DECODE_CACHE_MAX_BYTES <= pVCpu->iem.s.cbInstrBuf
+        && iemDecodeCacheIsPrefix(pbBuf[offBuf], pVCpu->iem.s.enmCpuMode))
+    {
+        uint64_t uBytes;
+        memcpy(&uBytes, &pbBuf[offBuf], sizeof(uBytes));
+        uint64_t const       uPc    = pVCpu->iem.s.uInstrBufPc + offBuf;
+        PIEMDECODECACHE      pCache = pVCpu->iem.s.pDecodeCacheR3;
+        PIEMDECODECACHEENTRY pEntry = &pCache->aEntries[IEM_DECODE_CACHE_PC_TO_INDEX(uPc)];
+        if (   pEntry->uPc == uPc
+            && (uBytes & pEntry->fBytesMask) == pEntry->uBytes
+            && pEntry->enmCpuMode   == (uint8_t)pVCpu->iem.s.enmCpuMode
+            && pEntry->uTlbRevision == pVCpu->iem.s.CodeTlb.uTlbRevision
+            && pEntry->uTlbPhysRev  == ASMAtomicReadU64(&pVCpu->iem.s.CodeTlb.uTlbPhysRev))
+        {
+            pCache->cHits++;
+            pVCpu->iem.s.fPrefixes          = pEntry->fPrefixes;
+            pVCpu->iem.s.enmEffOpSize       = (IEMMODE)pEntry->enmEffOpSize;
+            pVCpu->iem.s.enmEffAddrMode     = (IEMMODE)pEntry->enmEffAddrMode;
+            pVCpu->iem.s.iEffSeg            = pEntry->iEffSeg;
+            pVCpu->iem.s.uRexReg            = pEntry->uRexReg;
+            pVCpu->iem.s.uRexB              = pEntry->uRexB;
+            pVCpu->iem.s.uRexIndex          = pEntry->uRexIndex;
+            pVCpu->iem.s.offInstrNextByte   = offBuf + pEntry->cbBytes;
+            if (pEntry->idxHandler < 0x100)
+                return FNIEMOP_CALL(g_apfnOneByteMap[pEntry->idxHandler]);
+            return FNIEMOP_CALL(g_apfnTwoByteMap[pEntry->idxHandler & 0xff]);
+        }
+        return iemDecodeCacheFillAndExec(pVCpu, pEntry, uPc, uBytes);
+    }
+
+    uint8_t b; IEM_OPCODE_GET_NEXT_U8(&b);
+    return FNIEMOP_CALL(g_apfnOneByteMap[b]);
+}
+
+#endif /* IEM_WITH_DECODE_CACHE */
+
+
 VMMDECL(VBOXSTRICTRC) IEMExecLots(PVMCPU pVCpu, uint32_t *pcInstructions)
 {
     uint32_t const cInstructionsAtStart = pVCpu->iem.s.cInstructions;
@@ -14078,8 +14736,12 @@ VMMDECL(VBOXSTRICTRC) IEMExecLots(PVMCPU pVCpu, uint32_t *pcInstructions)
                 /*
                  * Do the decoding and emulation.
                  */
+# ifdef IEM_WITH_DECODE_CACHE
+                rcStrict = iemExecOneDecodeCached(pVCpu);
+# else
                 uint8_t b; IEM_OPCODE_GET_NEXT_U8(&b);
                 rcStrict = FNIEMOP_CALL(g_apfnOneByteMap[b]);
+# endif
                 if (RT_LIKELY(rcStrict == VINF_SUCCESS))
                 {
                     Assert(pVCpu->iem.s.cActiveMappings == 0);
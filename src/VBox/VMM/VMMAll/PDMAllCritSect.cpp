@@ -32,26 +32,19 @@
 #include <iprt/asm.h>
 #include <iprt/asm-amd64-x86.h>
 #include <iprt/assert.h>
+#include <iprt/lockvalidator.h>
 #ifdef IN_RING3
-# include <iprt/lockvalidator.h>
 # include <iprt/semaphore.h>
 #endif
 #if defined(IN_RING3) || defined(IN_RING0)
 # include <iprt/thread.h>
+# include <iprt/time.h>
 #endif
 
 
 /*********************************************************************************************************************************
 *   Defined Constants And Macros                                                                                                 *
 *********************************************************************************************************************************/
-/** The number loops to spin for in ring-3. */
-#define PDMCRITSECT_SPIN_COUNT_R3       20
-/** The number loops to spin for in ring-0. */
-#define PDMCRITSECT_SPIN_COUNT_R0       256
-/** The number loops to spin for in the raw-mode context. */
-#define PDMCRITSECT_SPIN_COUNT_RC       256
-
-
 /** Skips some of the overly paranoid atomic updates.
  * Makes some assumptions about cache coherence, though not brave enough not to
  * always end with an atomic update. */
@@ -127,14 +120,21 @@ DECL_FORCE_INLINE(int) pdmCritSectEnterFirst(PPDMCRITSECT pCritSect, RTNATIVETHR
  * @param   pCritSect           The critsect.
  * @param   hNativeSelf         The native thread handle.
  * @param   pSrcPos             The source position of the lock operation.
+ * @param   pProf               The contention profile, NULL if not available.
+ * @param   nsStart             When the contention was first noticed.
+ * @param   uCaller             The caller address for the contention profile.
  */
-static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD hNativeSelf, PCRTLOCKVALSRCPOS pSrcPos)
+static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD hNativeSelf, PCRTLOCKVALSRCPOS pSrcPos,
+                                         PPDMCRITSECTPROF pProf, uint64_t nsStart, RTHCUINTPTR uCaller)
 {
     /*
      * Start waiting.
      */
     if (ASMAtomicIncS32(&pCritSect->s.Core.cLockers) == 0)
+    {
+        pdmCritSectProfRecordWait(pProf, nsStart, true /*fBlocked*/, pSrcPos, uCaller);
         return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+    }
 # ifdef IN_RING3
     STAM_COUNTER_INC(&pCritSect->s.StatContentionR3);
 # else
@@ -190,7 +190,10 @@ static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD
         if (RT_UNLIKELY(pCritSect->s.Core.u32Magic != RTCRITSECT_MAGIC))
             return VERR_SEM_DESTROYED;
         if (rc == VINF_SUCCESS)
+        {
+            pdmCritSectProfRecordWait(pProf, nsStart, true /*fBlocked*/, pSrcPos, uCaller);
             return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+        }
         AssertMsg(rc == VERR_INTERRUPTED, ("rc=%Rrc\n", rc));
 
 # ifdef IN_RING0
@@ -265,27 +268,48 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
     /*
      * Spin for a bit without incrementing the counter.
      */
-    /** @todo Move this to cfgm variables since it doesn't make sense to spin on UNI
-     *        cpu systems. */
-    int32_t cSpinsLeft = CTX_SUFF(PDMCRITSECT_SPIN_COUNT_);
+#ifdef IN_RC
+    int32_t cSpinsLeft = PDMCRITSECT_SPIN_COUNT_RC;
     while (cSpinsLeft-- > 0)
     {
         if (ASMAtomicCmpXchgS32(&pCritSect->s.Core.cLockers, 0, -1))
             return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
         ASMNopPause();
-        /** @todo Should use monitor/mwait on e.g. &cLockers here, possibly with a
-           cli'ed pendingpreemption check up front using sti w/ instruction fusing
-           for avoiding races. Hmm ... This is assuming the other party is actually
-           executing code on another CPU ... which we could keep track of if we
-           wanted. */
     }
+#else
+    /* The number of loops adapts to how long the section is usually held and
+       is zero on uni-processor hosts.  Only try the cmpxchg when the section
+       looks free, so we don't keep stealing the cache line from the owner. */
+    /** @todo Should use monitor/mwait on e.g. &cLockers here, possibly with a
+       cli'ed pendingpreemption check up front using sti w/ instruction fusing
+       for avoiding races. Hmm ... This is assuming the other party is actually
+       executing code on another CPU ... which we could keep track of if we
+       wanted. */
+    PVM               pVMProf   = pCritSect->s.CTX_SUFF(pVM);
+    RTHCUINTPTR const uCaller   = (RTHCUINTPTR)ASMReturnAddress();
+    uint64_t const    nsStart   = RTTimeNanoTS();
+    PPDMCRITSECTPROF  pProf     = pdmCritSectProfLookup(pVMProf, (RTR3UINTPTR)pCritSect->s.pszName);
+    int32_t const     cSpinsMax = pdmCritSectProfSpinStart(pVMProf, pProf);
+    for (int32_t cSpins = 0; cSpins < cSpinsMax; cSpins++)
+    {
+        if (   ASMAtomicUoReadS32(&pCritSect->s.Core.cLockers) == -1
+            && ASMAtomicCmpXchgS32(&pCritSect->s.Core.cLockers, 0, -1))
+        {
+            pdmCritSectProfSpinEnd(pProf, cSpins, true /*fAcquired*/);
+            pdmCritSectProfRecordWait(pProf, nsStart, false /*fBlocked*/, pSrcPos, uCaller);
+            return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+        }
+        ASMNopPause();
+    }
+    pdmCritSectProfSpinEnd(pProf, cSpinsMax, false /*fAcquired*/);
+#endif
 
 #ifdef IN_RING3
     /*
      * Take the slow path.
      */
     NOREF(rcBusy);
-    return pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos);
+    return pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos, pProf, nsStart, uCaller);
 
 #else
 # ifdef IN_RING0
@@ -307,7 +331,7 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
         if (RTThreadPreemptIsEnabled(NIL_RTTHREAD))
         {
             STAM_REL_COUNTER_ADD(&pCritSect->s.StatContentionRZLock,    1000000);
-            rc = pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos);
+            rc = pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos, pProf, nsStart, uCaller);
         }
         else
         {
@@ -317,7 +341,7 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
             HMR0Leave(pVM, pVCpu);
             RTThreadPreemptRestore(NIL_RTTHREAD, XXX);
 
-            rc = pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos);
+            rc = pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos, pProf, nsStart, uCaller);
 
             RTThreadPreemptDisable(NIL_RTTHREAD, XXX);
             HMR0Enter(pVM, pVCpu);
@@ -330,8 +354,9 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
      */
     if (   RTThreadPreemptIsEnabled(NIL_RTTHREAD)
         && ASMIntAreEnabled())
-        return pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos);
+        return pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos, pProf, nsStart, uCaller);
 #  endif
+    pdmCritSectProfRecordWait(pProf, nsStart, true /*fBlocked*/, pSrcPos, uCaller);
 #endif /* IN_RING0 */
 
     STAM_REL_COUNTER_INC(&pCritSect->s.StatContentionRZLock);
@@ -400,12 +425,13 @@ VMMDECL(int) PDMCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy)
  */
 VMMDECL(int) PDMCritSectEnterDebug(PPDMCRITSECT pCritSect, int rcBusy, RTHCUINTPTR uId, RT_SRC_POS_DECL)
 {
-#ifdef PDMCRITSECT_STRICT
-    RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_DEBUG_API();
-    return pdmCritSectEnter(pCritSect, rcBusy, &SrcPos);
-#else
+#ifdef IN_RC
     NOREF(uId); RT_SRC_POS_NOREF();
     return pdmCritSectEnter(pCritSect, rcBusy, NULL);
+#else
+    /* The source position is also used by the contention profiler. */
+    RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_DEBUG_API();
+    return pdmCritSectEnter(pCritSect, rcBusy, &SrcPos);
 #endif
 }
 
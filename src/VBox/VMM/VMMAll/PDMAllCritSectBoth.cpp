@@ -29,6 +29,8 @@
 #include <VBox/log.h>
 #include <iprt/assert.h>
 #include <iprt/asm.h>
+#include <iprt/lockvalidator.h>
+#include <iprt/time.h>
 
 
 #if defined(IN_RING3) || defined(IN_RING0)
@@ -95,3 +97,150 @@ VMM_INT_DECL(void) PDMCritSectBothFF(PVMCPU pVCpu)
 }
 #endif /* IN_RING3 || IN_RING0 */
 
+
+#if defined(IN_RING3) || defined(IN_RING0)
+/**
+ * Looks up the contention profile of a critical section.
+ *
+ * The probing stops at the first empty slot, registration keeps enough of
+ * them around that sections without a profile don't scan the whole table.
+ *
+ * @returns Pointer to the profile, NULL if not found (table full or not
+ *          allocated yet).
+ * @param   pVM         The cross context VM structure.
+ * @param   uKey        The ring-3 address of the critical section name.
+ */
+PPDMCRITSECTPROF pdmCritSectProfLookup(PVM pVM, RTR3UINTPTR uKey)
+{
+    PPDMCRITSECTPROF paProf = pVM->pdm.s.CTX_SUFF(paCritSectProf);
+    if (paProf && uKey != 0)
+    {
+        uint32_t i = pdmCritSectProfHash(uKey);
+        for (uint32_t cLeft = PDMCRITSECT_PROF_ENTRIES; cLeft > 0; cLeft--)
+        {
+            RTR3UINTPTR const uCur = (RTR3UINTPTR)paProf[i].pszName;
+            if (uCur == uKey)
+                return &paProf[i];
+            if (uCur == 0)
+                break;
+            i = (i + 1) & (PDMCRITSECT_PROF_ENTRIES - 1);
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Calculates the spin budget for a contended enter.
+ *
+ * @returns Number of loops to spin before blocking, zero on uni-processor
+ *          hosts.
+ * @param   pVM         The cross context VM structure.
+ * @param   pProf       The contention profile, NULL if not available.
+ */
+int32_t pdmCritSectProfSpinStart(PVM pVM, PPDMCRITSECTPROF pProf)
+{
+    int32_t const cMaxSpins = pVM->pdm.s.CTX_SUFF(cCritSectMaxSpins);
+    int32_t       cSpins    = pProf
+                            ? ASMAtomicUoReadS32(&pProf->CTX_SUFF(cSpins)) * 2 + 16
+                            : CTX_SUFF(PDMCRITSECT_SPIN_COUNT_);
+    return RT_MIN(cSpins, cMaxSpins);
+}
+
+
+/**
+ * Updates the adaptive spin count after spinning.
+ *
+ * Successful spins pull the count towards the number of loops it actually took,
+ * while unsuccessful ones decay it so that sections which are held for long
+ * periods end up blocking right away.
+ *
+ * @param   pProf       The contention profile, NULL if not available.
+ * @param   cSpins      The number of loops spun.
+ * @param   fAcquired   Whether the section was acquired while spinning.
+ */
+void pdmCritSectProfSpinEnd(PPDMCRITSECTPROF pProf, int32_t cSpins, bool fAcquired)
+{
+    if (pProf)
+    {
+        /* Racy, but it's only a heuristic. */
+        int32_t cCur = ASMAtomicUoReadS32(&pProf->CTX_SUFF(cSpins));
+        if (fAcquired)
+            cCur += (cSpins - cCur) / 8;
+        else
+            cCur -= (cCur + 7) / 8;
+        ASMAtomicUoWriteS32(&pProf->CTX_SUFF(cSpins), RT_MAX(cCur, 0));
+    }
+}
+
+
+/**
+ * Records a contended enter in the profile of a critical section.
+ *
+ * When ring-0 hands the enter over to ring-3, only the time spent in ring-0
+ * is recorded here, ring-3 records its own wait separately.
+ *
+ * @param   pProf       The contention profile, NULL if not available.
+ * @param   nsStart     The RTTimeNanoTS() timestamp of when the contention
+ *                      was first noticed.
+ * @param   fBlocked    Set if we had to block (or go to ring-3), clear if we
+ *                      got it while spinning.
+ * @param   pSrcPos     The source position of the lock operation, NULL if not
+ *                      available.
+ * @param   uCaller     The caller address to use if @a pSrcPos doesn't
+ *                      provide one.
+ */
+void pdmCritSectProfRecordWait(PPDMCRITSECTPROF pProf, uint64_t nsStart, bool fBlocked, PCRTLOCKVALSRCPOS pSrcPos,
+                               RTHCUINTPTR uCaller)
+{
+    if (!pProf)
+        return;
+
+    uint64_t const cNsWaited = RTTimeNanoTS() - nsStart;
+    if (fBlocked)
+        STAM_REL_COUNTER_INC(&pProf->StatBlocks);
+    else
+        STAM_REL_COUNTER_INC(&pProf->StatSpinWins);
+    STAM_REL_PROFILE_ADD_PERIOD(&pProf->StatWait, cNsWaited);
+
+    unsigned iBucket  = 0;
+    uint64_t cNsLimit = RT_NS_1US;
+    while (cNsWaited >= cNsLimit && iBucket < PDMCRITSECT_PROF_WAIT_BUCKETS - 1)
+    {
+        iBucket++;
+        cNsLimit *= 10;
+    }
+    STAM_REL_COUNTER_INC(&pProf->aStatWaitHisto[iBucket]);
+
+    /*
+     * Attribute it to the call site, claiming a free slot if it's a new one.
+     */
+    if (pSrcPos && pSrcPos->uId)
+        uCaller = pSrcPos->uId;
+    if (!uCaller)
+        return;
+    for (unsigned i = 0; i < PDMCRITSECT_PROF_CALL_SITES; i++)
+    {
+        PPDMCRITSECTPROFSITE pSite = &pProf->aSites[i];
+        uint64_t uCur = ASMAtomicUoReadU64(&pSite->uCaller);
+        if (   uCur == 0
+            && ASMAtomicCmpXchgU64(&pSite->uCaller, uCaller, 0))
+        {
+# ifdef IN_RING3
+            pSite->pszFunction = pSrcPos ? pSrcPos->pszFunction : NULL;
+            pSite->fRing0      = false;
+# else
+            pSite->fRing0      = true;
+# endif
+            uCur = uCaller;
+        }
+        if (uCur == uCaller)
+        {
+            ASMAtomicIncU64(&pSite->cContentions);
+            ASMAtomicAddU64(&pSite->cNsWaited, cNsWaited);
+            return;
+        }
+    }
+    STAM_REL_COUNTER_INC(&pProf->StatOtherSites);
+}
+#endif /* IN_RING3 || IN_RING0 */
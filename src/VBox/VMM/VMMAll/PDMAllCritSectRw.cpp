@@ -32,33 +32,19 @@
 #include <iprt/asm.h>
 #include <iprt/asm-amd64-x86.h>
 #include <iprt/assert.h>
+#include <iprt/lockvalidator.h>
 #ifdef IN_RING3
-# include <iprt/lockvalidator.h>
 # include <iprt/semaphore.h>
 #endif
 #if defined(IN_RING3) || defined(IN_RING0)
 # include <iprt/thread.h>
+# include <iprt/time.h>
 #endif
 
 
 /*********************************************************************************************************************************
 *   Defined Constants And Macros                                                                                                 *
 *********************************************************************************************************************************/
-/** The number loops to spin for shared access in ring-3. */
-#define PDMCRITSECTRW_SHRD_SPIN_COUNT_R3       20
-/** The number loops to spin for shared access in ring-0. */
-#define PDMCRITSECTRW_SHRD_SPIN_COUNT_R0       128
-/** The number loops to spin for shared access in the raw-mode context. */
-#define PDMCRITSECTRW_SHRD_SPIN_COUNT_RC       128
-
-/** The number loops to spin for exclusive access in ring-3. */
-#define PDMCRITSECTRW_EXCL_SPIN_COUNT_R3       20
-/** The number loops to spin for exclusive access in ring-0. */
-#define PDMCRITSECTRW_EXCL_SPIN_COUNT_R0       256
-/** The number loops to spin for exclusive access in the raw-mode context. */
-#define PDMCRITSECTRW_EXCL_SPIN_COUNT_RC       256
-
-
 /* Undefine the automatic VBOX_STRICT API mappings. */
 #undef PDMCritSectRwEnterExcl
 #undef PDMCritSectRwTryEnterExcl
@@ -185,6 +171,12 @@ static int pdmCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy, bool fTryO
      */
     uint64_t u64State    = ASMAtomicReadU64(&pThis->s.Core.u64State);
     uint64_t u64OldState = u64State;
+#if defined(IN_RING3) || defined(IN_RING0)
+    PPDMCRITSECTPROF pProf     = NULL;
+    uint64_t         nsStart   = 0;
+    int32_t          cSpinsMax = -1; /* -1 until we hit contention. */
+    int32_t          cSpins    = 0;
+#endif
 
     for (;;)
     {
@@ -252,6 +244,18 @@ static int pdmCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy, bool fTryO
             }
 
 #if defined(IN_RING3) || defined(IN_RING0)
+            /*
+             * Spin a little before queuing up, the writer may be about done.
+             */
+            if (cSpinsMax < 0)
+            {
+                nsStart   = RTTimeNanoTS();
+                pProf     = pdmCritSectProfLookup(pThis->s.CTX_SUFF(pVM), (RTR3UINTPTR)pThis->s.pszName);
+                cSpinsMax = pdmCritSectProfSpinStart(pThis->s.CTX_SUFF(pVM), pProf);
+            }
+            if (cSpins < cSpinsMax)
+                cSpins++;
+            else
 # ifdef IN_RING0
             if (   RTThreadPreemptIsEnabled(NIL_RTTHREAD)
                 && ASMIntAreEnabled())
@@ -376,6 +380,10 @@ static int pdmCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy, bool fTryO
                  * back to ring-3 and do it there or return rcBusy.
                  */
                 STAM_REL_COUNTER_INC(&pThis->s.CTX_MID_Z(StatContention,EnterShared));
+# ifdef IN_RING0
+                pdmCritSectProfSpinEnd(pProf, cSpins, false /*fAcquired*/);
+                pdmCritSectProfRecordWait(pProf, nsStart, true /*fBlocked*/, pSrcPos, 0);
+# endif
                 if (rcBusy == VINF_SUCCESS)
                 {
                     PVM     pVM   = pThis->s.CTX_SUFF(pVM);     AssertPtr(pVM);
@@ -398,6 +406,14 @@ static int pdmCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy, bool fTryO
     }
 
     /* got it! */
+#if defined(IN_RING3) || defined(IN_RING0)
+    if (cSpinsMax >= 0)
+    {
+        bool const fBlocked = cSpins >= cSpinsMax;
+        pdmCritSectProfSpinEnd(pProf, cSpins, !fBlocked);
+        pdmCritSectProfRecordWait(pProf, nsStart, fBlocked, pSrcPos, 0);
+    }
+#endif
     STAM_REL_COUNTER_INC(&pThis->s.CTX_MID_Z(Stat,EnterShared));
     Assert((ASMAtomicReadU64(&pThis->s.Core.u64State) & RTCSRW_DIR_MASK) == (RTCSRW_DIR_READ << RTCSRW_DIR_SHIFT));
     return VINF_SUCCESS;
@@ -425,9 +441,10 @@ static int pdmCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy, bool fTryO
  */
 VMMDECL(int) PDMCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy)
 {
-#if !defined(PDMCRITSECTRW_STRICT) || !defined(IN_RING3)
-    return pdmCritSectRwEnterShared(pThis, rcBusy, false /*fTryOnly*/, NULL,    false /*fNoVal*/);
+#ifdef IN_RC
+    return pdmCritSectRwEnterShared(pThis, rcBusy, false /*fTryOnly*/, NULL, false /*fNoVal*/);
 #else
+    /* The source position is also used by the contention profiler. */
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_NORMAL_API();
     return pdmCritSectRwEnterShared(pThis, rcBusy, false /*fTryOnly*/, &SrcPos, false /*fNoVal*/);
 #endif
@@ -456,10 +473,11 @@ VMMDECL(int) PDMCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy)
  */
 VMMDECL(int) PDMCritSectRwEnterSharedDebug(PPDMCRITSECTRW pThis, int rcBusy, RTHCUINTPTR uId, RT_SRC_POS_DECL)
 {
-    NOREF(uId); NOREF(pszFile); NOREF(iLine); NOREF(pszFunction);
-#if !defined(PDMCRITSECTRW_STRICT) || !defined(IN_RING3)
-    return pdmCritSectRwEnterShared(pThis, rcBusy, false /*fTryOnly*/, NULL,    false /*fNoVal*/);
+#ifdef IN_RC
+    NOREF(uId); RT_SRC_POS_NOREF();
+    return pdmCritSectRwEnterShared(pThis, rcBusy, false /*fTryOnly*/, NULL, false /*fNoVal*/);
 #else
+    /* The source position is also used by the contention profiler. */
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_DEBUG_API();
     return pdmCritSectRwEnterShared(pThis, rcBusy, false /*fTryOnly*/, &SrcPos, false /*fNoVal*/);
 #endif
@@ -822,12 +840,44 @@ static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnl
         STAM_REL_COUNTER_INC(&pThis->s.CTX_MID_Z(StatContention,EnterExcl));
 
 #if defined(IN_RING3) || defined(IN_RING0)
-        if (   !fTryOnly
+        /*
+         * Spin a little while waiting for the ownership to become available.
+         * This isn't entirely fair to threads already blocking on the event
+         * semaphore, but it's a lot cheaper than joining them.
+         */
+        PPDMCRITSECTPROF pProf   = NULL;
+        uint64_t         nsStart = 0;
+        if (!fTryOnly)
+        {
+            nsStart = RTTimeNanoTS();
+            pProf   = pdmCritSectProfLookup(pThis->s.CTX_SUFF(pVM), (RTR3UINTPTR)pThis->s.pszName);
+            int32_t const cSpinsMax = pdmCritSectProfSpinStart(pThis->s.CTX_SUFF(pVM), pProf);
+            int32_t       cSpins    = 0;
+            while (cSpins < cSpinsMax)
+            {
+                cSpins++;
+                ASMNopPause();
+                u64State = ASMAtomicReadU64(&pThis->s.Core.u64State);
+                ASMAtomicUoReadHandle(&pThis->s.Core.hNativeWriter, &hNativeWriter);
+                if (   (u64State & RTCSRW_DIR_MASK) == (RTCSRW_DIR_WRITE << RTCSRW_DIR_SHIFT)
+                    && hNativeWriter == NIL_RTNATIVETHREAD)
+                {
+                    ASMAtomicCmpXchgHandle(&pThis->s.Core.hNativeWriter, hNativeSelf, NIL_RTNATIVETHREAD, fDone);
+                    if (fDone)
+                        break;
+                }
+            }
+            pdmCritSectProfSpinEnd(pProf, cSpins, fDone);
+        }
+
+        if (fDone)
+            pdmCritSectProfRecordWait(pProf, nsStart, false /*fBlocked*/, pSrcPos, 0);
+        else if (   !fTryOnly
 # ifdef IN_RING0
-            && RTThreadPreemptIsEnabled(NIL_RTTHREAD)
-            && ASMIntAreEnabled()
+                 && RTThreadPreemptIsEnabled(NIL_RTTHREAD)
+                 && ASMIntAreEnabled()
 # endif
-           )
+                )
         {
 
             /*
@@ -893,6 +943,7 @@ static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnl
                 AssertMsg(iLoop < 1000, ("%u\n", iLoop)); /* may loop a few times here... */
             }
 
+            pdmCritSectProfRecordWait(pProf, nsStart, true /*fBlocked*/, pSrcPos, 0);
         }
         else
 #endif /* IN_RING3 || IN_RING0 */
@@ -918,6 +969,9 @@ static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnl
 #ifdef IN_RING3
             return VERR_SEM_BUSY;
 #else
+# ifdef IN_RING0
+            pdmCritSectProfRecordWait(pProf, nsStart, true /*fBlocked*/, pSrcPos, 0);
+# endif
             if (rcBusy == VINF_SUCCESS)
             {
                 Assert(!fTryOnly);
@@ -970,9 +1024,10 @@ static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnl
  */
 VMMDECL(int) PDMCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy)
 {
-#if !defined(PDMCRITSECTRW_STRICT) || !defined(IN_RING3)
-    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, NULL,    false /*fNoVal*/);
+#ifdef IN_RC
+    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, NULL, false /*fNoVal*/);
 #else
+    /* The source position is also used by the contention profiler. */
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_NORMAL_API();
     return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, &SrcPos, false /*fNoVal*/);
 #endif
@@ -1002,10 +1057,11 @@ VMMDECL(int) PDMCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy)
  */
 VMMDECL(int) PDMCritSectRwEnterExclDebug(PPDMCRITSECTRW pThis, int rcBusy, RTHCUINTPTR uId, RT_SRC_POS_DECL)
 {
-    NOREF(uId); NOREF(pszFile); NOREF(iLine); NOREF(pszFunction);
-#if !defined(PDMCRITSECTRW_STRICT) || !defined(IN_RING3)
-    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, NULL,    false /*fNoVal*/);
+#ifdef IN_RC
+    NOREF(uId); RT_SRC_POS_NOREF();
+    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, NULL, false /*fNoVal*/);
 #else
+    /* The source position is also used by the contention profiler. */
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_DEBUG_API();
     return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, &SrcPos, false /*fNoVal*/);
 #endif
@@ -28,7 +28,9 @@
 # endif
 # include <VBox/vmm/mm.h>
 #endif
+#include <VBox/vmm/tm.h>
 #include <VBox/vmm/vm.h>
+#include <VBox/vmm/vmm.h>
 #include <VBox/err.h>
 #include <VBox/log.h>
 #include <iprt/asm.h>
@@ -69,6 +71,11 @@ VMMDECL(PPDMQUEUEITEMCORE) PDMQueueAlloc(PPDMQUEUE pQueue)
 /**
  * Sets the FFs and fQueueFlushed.
  *
+ * Only the insert raising the pending flag notifies an EMT, later inserts
+ * piggyback on that wake-up until the queues have been flushed.  Inserts made
+ * on an EMT need no notification at all as the FF will be serviced on the way
+ * back to guest context.
+ *
  * @param   pQueue              The PDM queue.
  */
 static void pdmQueueSetFF(PPDMQUEUE pQueue)
@@ -76,12 +83,15 @@ static void pdmQueueSetFF(PPDMQUEUE pQueue)
     PVM pVM = pQueue->CTX_SUFF(pVM);
     Log2(("PDMQueueInsert: VM_FF_PDM_QUEUES %d -> 1\n", VM_FF_IS_SET(pVM, VM_FF_PDM_QUEUES)));
     VM_FF_SET(pVM, VM_FF_PDM_QUEUES);
-    ASMAtomicBitSet(&pVM->pdm.s.fQueueFlushing, PDM_QUEUE_FLUSH_FLAG_PENDING_BIT);
+    bool const fWasPending = ASMAtomicBitTestAndSet(&pVM->pdm.s.fQueueFlushing, PDM_QUEUE_FLUSH_FLAG_PENDING_BIT);
 #ifdef IN_RING3
 # ifdef VBOX_WITH_REM
     REMR3NotifyQueuePending(pVM); /** @todo r=bird: we can remove REMR3NotifyQueuePending and let VMR3NotifyFF do the work. */
 # endif
-    VMR3NotifyGlobalFFU(pVM->pUVM, VMNOTIFYFF_FLAGS_DONE_REM);
+    if (!fWasPending && !VMMGetCpu(pVM))
+        pdmR3QueueNotifyConsumer(pVM);
+#else
+    NOREF(fWasPending);
 #endif
 }
 
@@ -100,6 +110,10 @@ VMMDECL(void) PDMQueueInsert(PPDMQUEUE pQueue, PPDMQUEUEITEMCORE pItem)
     Assert(VALID_PTR(pQueue) && pQueue->CTX_SUFF(pVM));
     Assert(VALID_PTR(pItem));
 
+    /* Timestamp the first item of a batch for the latency statistics. */
+    if (!pQueue->u64FirstPendingTS)
+        ASMAtomicCmpXchgU64(&pQueue->u64FirstPendingTS, TMVirtualGetNoCheck(pQueue->CTX_SUFF(pVM)), 0);
+
 #if 0 /* the paranoid android version: */
     void *pvNext;
     do
@@ -2290,6 +2290,7 @@ VMMDECL(int) PGMChangeMode(PVMCPU pVCpu, uint64_t cr0, uint64_t cr4, uint64_t ef
 
     /* Flush the TLB */
     PGM_INVL_VCPU_TLBS(pVCpu);
+    IEMTlbInvalidateAll(pVCpu, false /*fVmm*/);
 
 #ifdef IN_RING3
     return PGMR3ChangeMode(pVCpu->CTX_SUFF(pVM), pVCpu, enmGuestMode);
@@ -25,6 +25,7 @@
 #include <VBox/vmm/iom.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/em.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/stam.h>
 #ifdef VBOX_WITH_REM
 # include <VBox/vmm/rem.h>
@@ -410,6 +411,9 @@ static int pgmHandlerPhysicalSetRamFlagsAndFlushShadowPTs(PVM pVM, PPGMPHYSHANDL
     else
         Log(("pgmHandlerPhysicalSetRamFlagsAndFlushShadowPTs: doesn't flush guest TLBs. rc=%Rrc; sync flags=%x VMCPU_FF_PGM_SYNC_CR3=%d\n", rc, VMMGetCpu(pVM)->pgm.s.fSyncFlags, VMCPU_FF_IS_SET(VMMGetCpu(pVM), VMCPU_FF_PGM_SYNC_CR3)));
 
+    /* The IEM TLBs may have direct mappings of the pages cached. */
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
+
     return rc;
 }
 
@@ -660,6 +664,7 @@ DECLINLINE(void) pgmHandlerPhysicalRecalcPageState(PVM pVM, RTGCPHYS GCPhys, boo
                 PGM_INVL_ALL_VCPU_TLBS(pVM);
             else
                 AssertRC(rc);
+            IEMTlbInvalidateAllPhysicalAllCpus(pVM);
         }
         else
             AssertRC(rc);
@@ -778,6 +783,8 @@ static void pgmHandlerPhysicalResetRamFlags(PVM pVM, PPGMPHYSHANDLER pCur)
     pCur->cAliasedPages = 0;
     pCur->cTmpOffPages  = 0;
 
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
+
     /*
      * Check for partial start and end pages.
      */
@@ -22,6 +22,7 @@
 #define LOG_GROUP LOG_GROUP_PGM_PHYS
 #include <VBox/vmm/pgm.h>
 #include <VBox/vmm/trpm.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/vmm.h>
 #include <VBox/vmm/iom.h>
 #include <VBox/vmm/em.h>
@@ -604,6 +605,9 @@ void pgmPhysInvalidatePageMapTLB(PVM pVM)
 
     /** @todo clear the RC TLB whenever we add it. */
 
+    /* The IEM TLBs cache the same kind of information. */
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
+
     pgmUnlock(pVM);
 }
 
@@ -636,6 +640,8 @@ void pgmPhysInvalidatePageMapTLBEntry(PVM pVM, RTGCPHYS GCPhys)
 #endif
 
     /** @todo clear the RC TLB whenever we add it. */
+
+    IEMTlbInvalidatePhysPageAllCpus(pVM, GCPhys);
 }
 
 /**
@@ -446,6 +446,10 @@ typedef struct GMMCHUNK
  * @{ */
 /** Indicates that the chunk is a large page (2MB). */
 #define GMM_CHUNK_FLAGS_LARGE_PAGE  UINT16_C(0x0001)
+/** Indicates that the chunk is ring-3 memory locked down by GMMR0SeedLargePage,
+ * so it is already mapped into the owner VM process and nowhere else.  Freed
+ * pages are not reused, the chunk is freed when the last one goes. */
+#define GMM_CHUNK_FLAGS_SEEDED      UINT16_C(0x0002)
 /** @}  */
 
 
@@ -1449,7 +1453,9 @@ static bool gmmR0CleanupVMScanChunk(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk)
             else
                 cShared++;
 
-        gmmR0SelectSetAndLinkChunk(pGMM, pGVM, pChunk);
+        /* Seeded chunks never go back on a free list, see below. */
+        if (!(pChunk->fFlags & GMM_CHUNK_FLAGS_SEEDED))
+            gmmR0SelectSetAndLinkChunk(pGMM, pGVM, pChunk);
 
         /*
          * Did it add up?
@@ -1466,6 +1472,23 @@ static bool gmmR0CleanupVMScanChunk(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk)
         }
     }
 
+    /*
+     * A seeded chunk is backed by ring-3 memory of the terminating VM, so
+     * nobody else can use it.  Free it now that there are no private pages
+     * left in it, unless shared pages are still referenced by other VMs, in
+     * which case gmmR0FreePageWorker frees it with the last one.  (Our caller
+     * restarts the walk when cFreedChunks changes.)
+     */
+    if (   (pChunk->fFlags & GMM_CHUNK_FLAGS_SEEDED)
+        && pChunk->hGVM == pGVM->hSelf)
+    {
+        if (!pChunk->cPrivate && !pChunk->cShared)
+            return gmmR0FreeChunk(pGMM, pGVM, pChunk, true /*fRelaxedSem*/);
+        if (!g_pGMM->fBoundMemoryMode)
+            pChunk->hGVM = NIL_GVM_HANDLE;
+        return false;
+    }
+
     /*
      * If not in bound memory mode, we should reset the hGVM field
      * if it has our handle in it.
@@ -1912,7 +1935,7 @@ DECLINLINE(void) gmmR0UnlinkChunk(PGMMCHUNK pChunk)
     {
         Assert(!pChunk->pFreeNext);
         Assert(!pChunk->pFreePrev);
-        Assert(!pChunk->cFree);
+        Assert(!pChunk->cFree || (pChunk->fFlags & GMM_CHUNK_FLAGS_SEEDED));
     }
 }
 
@@ -2106,7 +2129,8 @@ static uint32_t gmmR0AllocatePagesFromChunk(PGMMCHUNK pChunk, uint16_t const hGV
 /**
  * Registers a new chunk of memory.
  *
- * This is called by both gmmR0AllocateOneChunk and GMMR0SeedChunk.
+ * This is called by gmmR0AllocateOneChunk, GMMR0SeedChunk and the large page
+ * allocators.
  *
  * @returns VBox status code.  On success, the giant GMM lock will be held, the
  *          caller must release it (ugly).
@@ -2127,7 +2151,9 @@ static int gmmR0RegisterChunk(PGMM pGMM, PGMMCHUNKFREESET pSet, RTR0MEMOBJ MemOb
 {
     Assert(pGMM->hMtxOwner != RTThreadNativeSelf());
     Assert(hGVM != NIL_GVM_HANDLE || pGMM->fBoundMemoryMode);
-    Assert(fChunkFlags == 0 || fChunkFlags == GMM_CHUNK_FLAGS_LARGE_PAGE);
+    Assert(   fChunkFlags == 0
+           || fChunkFlags == GMM_CHUNK_FLAGS_LARGE_PAGE
+           || fChunkFlags == (GMM_CHUNK_FLAGS_LARGE_PAGE | GMM_CHUNK_FLAGS_SEEDED));
 
     int rc;
     PGMMCHUNK pChunk = (PGMMCHUNK)RTMemAllocZ(sizeof(*pChunk));
@@ -3005,6 +3031,49 @@ GMMR0DECL(int) GMMR0AllocatePagesReq(PVM pVM, VMCPUID idCpu, PGMMALLOCATEPAGESRE
 }
 
 
+/**
+ * Allocates all the pages of a freshly registered large page chunk.
+ *
+ * @param   pGMM        Pointer to the GMM instance data.
+ * @param   pGVM        Pointer to the kernel-only VM instace data.
+ * @param   pSet        The free set the chunk was registered with.
+ * @param   pChunk      The chunk.
+ * @param   pIdPage     Where to return the GMM page ID of the first page.
+ * @param   pHCPhys     Where to return the host physical address of the first
+ *                      page.
+ *
+ * @remarks Caller owns the giant GMM lock, this function releases it.
+ */
+static void gmmR0AllocateLargePageChunk(PGMM pGMM, PGVM pGVM, PGMMCHUNKFREESET pSet, PGMMCHUNK pChunk,
+                                        uint32_t *pIdPage, RTHCPHYS *pHCPhys)
+{
+    const unsigned cPages = (GMM_CHUNK_SIZE >> PAGE_SHIFT);
+
+    /* Unlink the new chunk from the free list. */
+    gmmR0UnlinkChunk(pChunk);
+
+    /** @todo rewrite this to skip the looping. */
+    /* Allocate all pages. */
+    GMMPAGEDESC PageDesc;
+    gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
+
+    /* Return the first page as we'll use the whole chunk as one big page. */
+    *pIdPage = PageDesc.idPage;
+    *pHCPhys = PageDesc.HCPhysGCPhys;
+
+    for (unsigned i = 1; i < cPages; i++)
+        gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
+
+    /* Update accounting. */
+    pGVM->gmm.s.Stats.Allocated.cBasePages += cPages;
+    pGVM->gmm.s.Stats.cPrivatePages        += cPages;
+    pGMM->cAllocatedPages                  += cPages;
+
+    gmmR0LinkChunk(pChunk, pSet);
+    gmmR0MutexRelease(pGMM);
+}
+
+
 /**
  * Allocate a large page to represent guest RAM
  *
@@ -3080,33 +3149,7 @@ GMMR0DECL(int)  GMMR0AllocateLargePage(PVM pVM, VMCPUID idCpu, uint32_t cbPage,
             PGMMCHUNK pChunk;
             rc = gmmR0RegisterChunk(pGMM, pSet, hMemObj, pGVM->hSelf, GMM_CHUNK_FLAGS_LARGE_PAGE, &pChunk);
             if (RT_SUCCESS(rc))
-            {
-                /*
-                 * Allocate all the pages in the chunk.
-                 */
-                /* Unlink the new chunk from the free list. */
-                gmmR0UnlinkChunk(pChunk);
-
-                /** @todo rewrite this to skip the looping. */
-                /* Allocate all pages. */
-                GMMPAGEDESC PageDesc;
-                gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
-
-                /* Return the first page as we'll use the whole chunk as one big page. */
-                *pIdPage = PageDesc.idPage;
-                *pHCPhys = PageDesc.HCPhysGCPhys;
-
-                for (unsigned i = 1; i < cPages; i++)
-                    gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
-
-                /* Update accounting. */
-                pGVM->gmm.s.Stats.Allocated.cBasePages += cPages;
-                pGVM->gmm.s.Stats.cPrivatePages        += cPages;
-                pGMM->cAllocatedPages                  += cPages;
-
-                gmmR0LinkChunk(pChunk, pSet);
-                gmmR0MutexRelease(pGMM);
-            }
+                gmmR0AllocateLargePageChunk(pGMM, pGVM, pSet, pChunk, pIdPage, pHCPhys);
             else
                 RTR0MemObjFree(hMemObj, false /* fFreeMappings */);
         }
@@ -3330,11 +3373,25 @@ static void gmmR0FreePageWorker(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk, uint32_t
     pPage->Free.iNext = pChunk->iFreeHead;
     pChunk->iFreeHead = pPage - &pChunk->aPages[0];
 
+    /*
+     * Seeded chunks are never linked back onto a free list, as the owner
+     * unmaps the ring-3 memory once it has freed all the pages.  So, free
+     * the chunk as soon as it's empty.
+     */
+    unsigned const cFree = pChunk->cFree;
+    if (pChunk->fFlags & GMM_CHUNK_FLAGS_SEEDED)
+    {
+        Assert(!pChunk->pSet);
+        pChunk->cFree = cFree + 1;
+        if (pChunk->cFree == GMM_CHUNK_NUM_PAGES)
+            gmmR0FreeChunk(pGMM, NULL, pChunk, false);
+        return;
+    }
+
     /*
      * Update statistics (the cShared/cPrivate stats are up to date already),
      * and relink the chunk if necessary.
      */
-    unsigned const cFree = pChunk->cFree;
     if (   !cFree
         || gmmR0SelectFreeSetList(cFree) != gmmR0SelectFreeSetList(cFree + 1))
     {
@@ -3934,7 +3991,8 @@ static int gmmR0UnmapChunkLocked(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk)
  */
 static int gmmR0UnmapChunk(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk, bool fRelaxedSem)
 {
-    if (!pGMM->fLegacyAllocationMode)
+    if (   !pGMM->fLegacyAllocationMode
+        && !(pChunk->fFlags & GMM_CHUNK_FLAGS_SEEDED))
     {
         /*
          * Lock the chunk and if possible leave the giant GMM lock.
@@ -3972,9 +4030,10 @@ static int gmmR0UnmapChunk(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk, bool fRelaxed
 static int gmmR0MapChunkLocked(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk, PRTR3PTR ppvR3)
 {
     /*
-     * If we're in legacy mode this is simple.
+     * If we're in legacy mode or the chunk was seeded this is simple.
      */
-    if (pGMM->fLegacyAllocationMode)
+    if (   pGMM->fLegacyAllocationMode
+        || (pChunk->fFlags & GMM_CHUNK_FLAGS_SEEDED))
     {
         if (pChunk->hGVM != pGVM->hSelf)
         {
@@ -4281,6 +4340,106 @@ GMMR0DECL(int) GMMR0SeedChunk(PVM pVM, VMCPUID idCpu, RTR3PTR pvR3)
     return rc;
 }
 
+
+/**
+ * Turns a large page allocated by ring-3 into a large page chunk.
+ *
+ * The memory is locked down and, provided the host backs it by a single
+ * physically contiguous large page (hugetlbfs, transparent huge pages, ...),
+ * registered as a large page chunk owned by the calling VM and allocated in
+ * full like GMMR0AllocateLargePage does.  The ring-3 mapping doubles as the
+ * chunk mapping of the owner, so it must stay until the chunk is freed.  The
+ * chunk never goes back on a free list and is freed as soon as all its pages
+ * have been freed, which is when ring-3 may unmap the memory.
+ *
+ * @returns VBox status code:
+ * @retval  VERR_GMM_SEED_NOT_LARGE_PAGE if the memory isn't physically
+ *          contiguous and 2 MB aligned.
+ * @retval  VERR_NOT_SUPPORTED in legacy allocation mode.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   idCpu       The VCPU id.
+ * @param   pvR3        The 2 MB aligned ring-3 address of the memory.
+ * @param   pIdPage     Where to return the GMM page ID of the page.
+ * @param   pHCPhys     Where to return the host physical address of the page.
+ */
+GMMR0DECL(int) GMMR0SeedLargePage(PVM pVM, VMCPUID idCpu, RTR3PTR pvR3, uint32_t *pIdPage, RTHCPHYS *pHCPhys)
+{
+    LogFlow(("GMMR0SeedLargePage: pVM=%p pvR3=%RHv\n", pVM, pvR3));
+
+    AssertReturn(pvR3 != NIL_RTR3PTR, VERR_INVALID_POINTER);
+    AssertReturn(!((uintptr_t)pvR3 & (GMM_CHUNK_SIZE - 1)), VERR_INVALID_POINTER);
+    AssertPtrReturn(pIdPage, VERR_INVALID_PARAMETER);
+    AssertPtrReturn(pHCPhys, VERR_INVALID_PARAMETER);
+
+    /*
+     * Validate, get basics and check the account.
+     */
+    PGMM pGMM;
+    GMM_GET_VALID_INSTANCE(pGMM, VERR_GMM_INSTANCE);
+    PGVM pGVM;
+    int rc = GVMMR0ByVMAndEMT(pVM, idCpu, &pGVM);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* Legacy mode has GMMR0SeedChunk for this. */
+    if (pGMM->fLegacyAllocationMode)
+        return VERR_NOT_SUPPORTED;
+
+    *pHCPhys = NIL_RTHCPHYS;
+    *pIdPage = NIL_GMM_PAGEID;
+
+    const unsigned cPages = (GMM_CHUNK_SIZE >> PAGE_SHIFT);
+    gmmR0MutexAcquire(pGMM);
+    if (!GMM_CHECK_SANITY_UPON_ENTERING(pGMM))
+    {
+        gmmR0MutexRelease(pGMM);
+        return VERR_GMM_IS_NOT_SANE;
+    }
+    if (RT_UNLIKELY(  pGVM->gmm.s.Stats.Allocated.cBasePages + pGVM->gmm.s.Stats.cBalloonedPages + cPages
+                    > pGVM->gmm.s.Stats.Reserved.cBasePages))
+    {
+        Log(("GMMR0SeedLargePage: Reserved=%#llx Allocated+Requested=%#llx+%#x!\n",
+             pGVM->gmm.s.Stats.Reserved.cBasePages, pGVM->gmm.s.Stats.Allocated.cBasePages, cPages));
+        gmmR0MutexRelease(pGMM);
+        return VERR_GMM_HIT_VM_ACCOUNT_LIMIT;
+    }
+    gmmR0MutexRelease(pGMM);
+
+    /*
+     * Lock it down and check that we've actually got a large page.
+     */
+    RTR0MEMOBJ hMemObj;
+    rc = RTR0MemObjLockUser(&hMemObj, pvR3, GMM_CHUNK_SIZE, RTMEM_PROT_READ | RTMEM_PROT_WRITE, NIL_RTR0PROCESS);
+    if (RT_SUCCESS(rc))
+    {
+        RTHCPHYS const HCPhysFirst = RTR0MemObjGetPagePhysAddr(hMemObj, 0);
+        bool           fLargePage  = !(HCPhysFirst & (GMM_CHUNK_SIZE - 1));
+        for (unsigned iPage = 1; iPage < cPages && fLargePage; iPage++)
+            fLargePage = RTR0MemObjGetPagePhysAddr(hMemObj, iPage) == HCPhysFirst + ((RTHCPHYS)iPage << PAGE_SHIFT);
+        if (fLargePage)
+        {
+            /* Always the private set, nobody else can map it. */
+            PGMMCHUNKFREESET pSet = &pGVM->gmm.s.Private;
+            PGMMCHUNK        pChunk;
+            rc = gmmR0RegisterChunk(pGMM, pSet, hMemObj, pGVM->hSelf,
+                                    GMM_CHUNK_FLAGS_LARGE_PAGE | GMM_CHUNK_FLAGS_SEEDED, &pChunk);
+            if (RT_SUCCESS(rc))
+                gmmR0AllocateLargePageChunk(pGMM, pGVM, pSet, pChunk, pIdPage, pHCPhys);
+            else
+                RTR0MemObjFree(hMemObj, false /* fFreeMappings */);
+        }
+        else
+        {
+            RTR0MemObjFree(hMemObj, false /* fFreeMappings */);
+            rc = VERR_GMM_SEED_NOT_LARGE_PAGE;
+        }
+    }
+
+    LogFlow(("GMMR0SeedLargePage: returns %Rrc\n", rc));
+    return rc;
+}
+
 #ifdef VBOX_WITH_PAGE_SHARING
 
 # ifdef VBOX_STRICT
@@ -228,6 +228,42 @@ VMMR0_INT_DECL(int) PGMR0PhysAllocateLargeHandyPage(PVM pVM, PVMCPU pVCpu)
 }
 
 
+/**
+ * Turns a large page allocated by ring-3 into a large handy page.
+ *
+ * This is the alternative to PGMR0PhysAllocateLargeHandyPage for hosts where
+ * GMM rarely finds physically contiguous memory, but ring-3 can get large
+ * pages from the host OS (e.g. hugetlbfs on Linux).
+ *
+ * @returns The following VBox status codes.
+ * @retval  VINF_SUCCESS on success.
+ * @retval  VERR_GMM_SEED_NOT_LARGE_PAGE if the memory isn't a large page.
+ * @retval  VERR_NO_MEMORY if we're out of memory.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pVCpu       The cross context virtual CPU structure.
+ * @param   pvR3        The 2 MB aligned ring-3 address of the large page.
+ *
+ * @thread  EMT.
+ *
+ * @remarks Must be called from within the PGM critical section. The caller
+ *          must clear the new pages.
+ */
+VMMR0_INT_DECL(int) PGMR0PhysSeedLargeHandyPage(PVM pVM, PVMCPU pVCpu, RTR3PTR pvR3)
+{
+    PGM_LOCK_ASSERT_OWNER_EX(pVM, pVCpu);
+    Assert(!pVM->pgm.s.cLargeHandyPages);
+
+    int rc = GMMR0SeedLargePage(pVM, pVCpu->idCpu, pvR3,
+                                &pVM->pgm.s.aLargeHandyPage[0].idPage,
+                                &pVM->pgm.s.aLargeHandyPage[0].HCPhysGCPhys);
+    if (RT_SUCCESS(rc))
+        pVM->pgm.s.cLargeHandyPages = 1;
+
+    return rc;
+}
+
+
 #ifdef VBOX_WITH_PCI_PASSTHROUGH
 /* Interface sketch.  The interface belongs to a global PCI pass-through
    manager.  It shall use the global VM handle, not the user VM handle to
@@ -106,6 +106,14 @@ VMMR3DECL(int)      IEMR3Init(PVM pVM)
                         "Code TLB physical revision",               "/IEM/CPU%u/CodeTlb-PhysRev", idCpu);
         STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbSlowReadPath,    STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_NONE,
                         "Code TLB slow read path",                  "/IEM/CPU%u/CodeTlb-SlowReads", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbPhysLoads,       STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Code TLB physical page info loads",        "/IEM/CPU%u/CodeTlb-PhysLoads", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbInvalidateAll,   STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Code TLB full flushes",                    "/IEM/CPU%u/CodeTlb-InvalidateAll", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbInvalidatePage,  STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Code TLB single page flushes",             "/IEM/CPU%u/CodeTlb-InvalidatePage", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbInvalidatePhysPage, STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Code TLB single physical page flushes",    "/IEM/CPU%u/CodeTlb-InvalidatePhysPage", idCpu);
 
         STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbMisses,          STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
                         "Data TLB misses",                          "/IEM/CPU%u/DataTlb-Misses", idCpu);
@@ -113,6 +121,26 @@ VMMR3DECL(int)      IEMR3Init(PVM pVM)
                         "Data TLB revision",                        "/IEM/CPU%u/DataTlb-Revision", idCpu);
         STAMR3RegisterF(pVM, (void *)&pVCpu->iem.s.DataTlb.uTlbPhysRev, STAMTYPE_X64,       STAMVISIBILITY_ALWAYS, STAMUNIT_NONE,
                         "Data TLB physical revision",               "/IEM/CPU%u/DataTlb-PhysRev", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbSlowReadPath,    STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Data TLB slow mapping path",               "/IEM/CPU%u/DataTlb-SlowMaps", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbPhysLoads,       STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Data TLB physical page info loads",        "/IEM/CPU%u/DataTlb-PhysLoads", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbInvalidateAll,   STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Data TLB full flushes",                    "/IEM/CPU%u/DataTlb-InvalidateAll", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbInvalidatePage,  STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Data TLB single page flushes",             "/IEM/CPU%u/DataTlb-InvalidatePage", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbInvalidatePhysPage, STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Data TLB single physical page flushes",    "/IEM/CPU%u/DataTlb-InvalidatePhysPage", idCpu);
+
+        /* The prefix decode cache of IEMExecLots. */
+        pVCpu->iem.s.pDecodeCacheR3 = (PIEMDECODECACHE)MMR3HeapAllocZ(pVM, MM_TAG_IEM, sizeof(IEMDECODECACHE));
+        AssertLogRelReturn(pVCpu->iem.s.pDecodeCacheR3, VERR_NO_MEMORY);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.pDecodeCacheR3->cHits,      STAMTYPE_U64_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Decode cache hits",                        "/IEM/CPU%u/DecodeCache-Hits", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.pDecodeCacheR3->cMisses,    STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Decode cache misses",                      "/IEM/CPU%u/DecodeCache-Misses", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.pDecodeCacheR3->cStale,     STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Decode cache entries invalidated by code writes or TLB flushes", "/IEM/CPU%u/DecodeCache-Stale", idCpu);
 
 #if defined(VBOX_WITH_STATISTICS) && !defined(DOXYGEN_RUNNING)
         /* Allocate instruction statistics and register them. */
@@ -404,6 +404,11 @@ VMMR3_INT_DECL(int) PDMR3Init(PVM pVM)
     //pVM->pdm.s.idTracingDev = 0;
     pVM->pdm.s.idTracingOther = 1024;
 
+    STAM_REL_REG(pVM, &pVM->pdm.s.StatQueueNotifyWakeUps, STAMTYPE_COUNTER, "/PDM/QueueNotify/WakeUps", STAMUNIT_OCCURENCES,
+                 "Number of times a queue insert from a non-EMT thread woke up a halted EMT.");
+    STAM_REL_REG(pVM, &pVM->pdm.s.StatQueueNotifyPokes,   STAMTYPE_COUNTER, "/PDM/QueueNotify/Pokes",   STAMUNIT_OCCURENCES,
+                 "Number of times a queue insert from a non-EMT thread poked an EMT out of guest context.");
+
     /*
      * Initialize critical sections first.
      */
@@ -1720,6 +1720,30 @@ VMMR3DECL(int) PDMR3AsyncCompletionEpSetSize(PPDMASYNCCOMPLETIONENDPOINT pEndpoi
 }
 
 
+/**
+ * Deallocates the given range of an endpoint, leaving a hole which reads
+ * back as zeros.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if the endpoint or the underlying host
+ *          filesystem does not support this operation.
+ * @param   pEndpoint       The file endpoint.
+ * @param   off             Start offset of the range.
+ * @param   cb              Size of the range in bytes.
+ *
+ * @note The caller must make sure there are no requests in flight for the
+ *       given range.
+ */
+VMMR3DECL(int) PDMR3AsyncCompletionEpPunchHole(PPDMASYNCCOMPLETIONENDPOINT pEndpoint, uint64_t off, uint64_t cb)
+{
+    AssertPtrReturn(pEndpoint, VERR_INVALID_POINTER);
+
+    if (pEndpoint->pEpClass->pEndpointOps->pfnEpPunchHole)
+        return pEndpoint->pEpClass->pEndpointOps->pfnEpPunchHole(pEndpoint, off, cb);
+    return VERR_NOT_SUPPORTED;
+}
+
+
 /**
  * Assigns or removes a bandwidth control manager to/from the endpoint.
  *
@@ -1252,6 +1252,13 @@ static DECLCALLBACK(int) pdmacFileEpSetSize(PPDMASYNCCOMPLETIONENDPOINT pEndpoin
     return rc;
 }
 
+static DECLCALLBACK(int) pdmacFileEpPunchHole(PPDMASYNCCOMPLETIONENDPOINT pEndpoint, uint64_t off, uint64_t cb)
+{
+    PPDMASYNCCOMPLETIONENDPOINTFILE pEpFile = (PPDMASYNCCOMPLETIONENDPOINTFILE)pEndpoint;
+
+    return RTFilePunchHole(pEpFile->hFile, off, cb);
+}
+
 const PDMASYNCCOMPLETIONEPCLASSOPS g_PDMAsyncCompletionEndpointClassFile =
 {
     /* u32Version */
@@ -1284,6 +1291,8 @@ const PDMASYNCCOMPLETIONEPCLASSOPS g_PDMAsyncCompletionEndpointClassFile =
     pdmacFileEpGetSize,
     /* pfnEpSetSize */
     pdmacFileEpSetSize,
+    /* pfnEpPunchHole */
+    pdmacFileEpPunchHole,
     /* u32VersionEnd */
     PDMAC_EPCLASS_OPS_VERSION
 };
@@ -23,6 +23,7 @@
 #include "PDMInternal.h"
 #include <VBox/vmm/pdmcritsect.h>
 #include <VBox/vmm/pdmcritsectrw.h>
+#include <VBox/vmm/dbgf.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
@@ -33,6 +34,7 @@
 #include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/lockvalidator.h>
+#include <iprt/mp.h>
 #include <iprt/string.h>
 #include <iprt/thread.h>
 
@@ -42,6 +44,7 @@
 *********************************************************************************************************************************/
 static int pdmR3CritSectDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTINT pCritSect, PPDMCRITSECTINT pPrev, bool fFinal);
 static int pdmR3CritSectRwDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTRWINT pCritSect, PPDMCRITSECTRWINT pPrev, bool fFinal);
+static DECLCALLBACK(void) pdmR3CritSectInfoProf(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 
 
 
@@ -56,10 +59,218 @@ int pdmR3CritSectBothInitStats(PVM pVM)
     RT_NOREF_PV(pVM);
     STAM_REG(pVM, &pVM->pdm.s.StatQueuedCritSectLeaves, STAMTYPE_COUNTER, "/PDM/QueuedCritSectLeaves", STAMUNIT_OCCURENCES,
              "Number of times a critical section leave request needed to be queued for ring-3 execution.");
+    DBGFR3InfoRegisterInternal(pVM, "critsectprof",
+                               "Critical section contention profile, sorted by total wait time. "
+                               "Pass 'all' to include uncontended sections.",
+                               pdmR3CritSectInfoProf);
     return VINF_SUCCESS;
 }
 
 
+/**
+ * Adds a critical section to the contention profiler and registers its
+ * statistics.
+ *
+ * The table is allocated on the first call since some of the critical sections
+ * are created before PDM is initialized.  Running out of table entries isn't
+ * fatal, the section will just use the default spin count and not be profiled.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pszName     The (unique) name of the critical section.
+ * @param   fRw         Set if it's a read/write critical section.
+ */
+static void pdmR3CritSectProfRegister(PVM pVM, const char *pszName, bool fRw)
+{
+    PUVM pUVM = pVM->pUVM;
+    RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
+
+    PPDMCRITSECTPROF paProf = pVM->pdm.s.paCritSectProfR3;
+    if (!paProf)
+    {
+        int rc = MMHyperAlloc(pVM, sizeof(PDMCRITSECTPROF) * PDMCRITSECT_PROF_ENTRIES, 0, MM_TAG_PDM, (void **)&paProf);
+        if (RT_FAILURE(rc))
+        {
+            RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+            return;
+        }
+        pVM->pdm.s.paCritSectProfR0 = MMHyperR3ToR0(pVM, paProf);
+        ASMAtomicWritePtr(&pVM->pdm.s.paCritSectProfR3, paProf);
+
+        /* Spinning is pointless when there is nobody to release the section
+           while we're at it. */
+        bool const fSmp = RTMpGetOnlineCount() > 1;
+        pVM->pdm.s.cCritSectMaxSpinsR3 = fSmp ? PDMCRITSECT_SPIN_MAX_R3 : 0;
+        pVM->pdm.s.cCritSectMaxSpinsR0 = fSmp ? PDMCRITSECT_SPIN_MAX_R0 : 0;
+    }
+
+    /* Linear probing, reusing deleted entries.  Empty slots are only taken
+       while the table is below the load limit, see pdmCritSectProfLookup. */
+    uint32_t cUsed = 0;
+    for (uint32_t j = 0; j < PDMCRITSECT_PROF_ENTRIES; j++)
+        if (paProf[j].pszName != NULL)
+            cUsed++;
+
+    uint32_t i = pdmCritSectProfHash((RTR3UINTPTR)pszName);
+    for (uint32_t cLeft = PDMCRITSECT_PROF_ENTRIES; cLeft > 0; cLeft--)
+    {
+        PPDMCRITSECTPROF pProf = &paProf[i];
+        if (   pProf->pszName == NULL
+            && cUsed >= PDMCRITSECT_PROF_ENTRIES_USED_MAX)
+            break;
+        if (   pProf->pszName == NULL
+            || (RTR3UINTPTR)pProf->pszName == PDMCRITSECT_PROF_TOMBSTONE)
+        {
+            RT_ZERO(*pProf);
+            pProf->fRw      = fRw;
+            pProf->cSpinsR3 = PDMCRITSECT_SPIN_COUNT_R3;
+            pProf->cSpinsR0 = PDMCRITSECT_SPIN_COUNT_R0;
+            ASMAtomicWritePtr(&pProf->pszName, pszName);
+
+            const char *pszPrefix = fRw ? "/PDM/CritSectsRw" : "/PDM/CritSects";
+            STAMR3RegisterF(pVM, &pProf->StatSpinWins,   STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,       "Contended enters that got it while spinning.",        "%s/%s/SpinWins", pszPrefix, pszName);
+            STAMR3RegisterF(pVM, &pProf->StatBlocks,     STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,       "Contended enters that had to block or go to ring-3.", "%s/%s/Blocks", pszPrefix, pszName);
+            STAMR3RegisterF(pVM, &pProf->StatOtherSites, STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,       "Contended enters from untracked call sites.",         "%s/%s/OtherSites", pszPrefix, pszName);
+            STAMR3RegisterF(pVM, &pProf->StatWait,       STAMTYPE_PROFILE, STAMVISIBILITY_USED, STAMUNIT_NS_PER_OCCURENCE, "Time spent waiting in contended enters.",             "%s/%s/Wait", pszPrefix, pszName);
+            static const char * const s_apszBuckets[PDMCRITSECT_PROF_WAIT_BUCKETS] =
+            { "lt1us", "lt10us", "lt100us", "lt1ms", "lt10ms", "ge10ms" };
+            for (unsigned iBucket = 0; iBucket < RT_ELEMENTS(s_apszBuckets); iBucket++)
+                STAMR3RegisterF(pVM, &pProf->aStatWaitHisto[iBucket], STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
+                                "Contended enters by wait time.", "%s/%s/WaitHisto/%s", pszPrefix, pszName, s_apszBuckets[iBucket]);
+            break;
+        }
+        i = (i + 1) & (PDMCRITSECT_PROF_ENTRIES - 1);
+    }
+
+    RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+}
+
+
+/**
+ * Removes a critical section from the contention profiler.
+ *
+ * The statistics are deregistered together with the other per section ones.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pszName     The name of the critical section.
+ *
+ * @remarks Caller must have entered the ListCritSect.
+ */
+static void pdmR3CritSectProfDeregister(PVM pVM, const char *pszName)
+{
+    PPDMCRITSECTPROF pProf = pdmCritSectProfLookup(pVM, (RTR3UINTPTR)pszName);
+    if (!pProf)
+        return;
+    ASMAtomicWritePtr(&pProf->pszName, (const char *)PDMCRITSECT_PROF_TOMBSTONE);
+
+    /* Tombstones at the end of a probe chain aren't needed by any lookup, so
+       turn them back into empty slots to keep the chains short. */
+    PPDMCRITSECTPROF paProf = pVM->pdm.s.paCritSectProfR3;
+    uint32_t i = (uint32_t)(pProf - paProf);
+    while (   (RTR3UINTPTR)paProf[i].pszName == PDMCRITSECT_PROF_TOMBSTONE
+           && paProf[(i + 1) & (PDMCRITSECT_PROF_ENTRIES - 1)].pszName == NULL)
+    {
+        ASMAtomicWriteNullPtr(&paProf[i].pszName);
+        i = (i - 1) & (PDMCRITSECT_PROF_ENTRIES - 1);
+    }
+}
+
+
+/**
+ * Info handler for 'critsectprof'.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pHlp        The output helpers.
+ * @param   pszArgs     'all' to include sections without contention.
+ */
+static DECLCALLBACK(void) pdmR3CritSectInfoProf(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    bool const fAll = pszArgs && !strcmp(RTStrStrip((char *)pszArgs), "all");
+    PUVM pUVM = pVM->pUVM;
+    RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
+
+    PPDMCRITSECTPROF paProf = pVM->pdm.s.paCritSectProfR3;
+    if (!paProf)
+    {
+        RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+        pHlp->pfnPrintf(pHlp, "No critical sections have been registered.\n");
+        return;
+    }
+
+    /*
+     * Collect the interesting entries and sort them by total wait time (insertion sort).
+     */
+    PPDMCRITSECTPROF apSorted[PDMCRITSECT_PROF_ENTRIES];
+    unsigned         cSorted = 0;
+    for (unsigned i = 0; i < PDMCRITSECT_PROF_ENTRIES; i++)
+    {
+        PPDMCRITSECTPROF pProf = &paProf[i];
+        if ((RTR3UINTPTR)pProf->pszName <= PDMCRITSECT_PROF_TOMBSTONE)
+            continue;
+        if (!fAll && !pProf->StatWait.cPeriods)
+            continue;
+        unsigned j = cSorted++;
+        while (j > 0 && apSorted[j - 1]->StatWait.cTicks < pProf->StatWait.cTicks)
+        {
+            apSorted[j] = apSorted[j - 1];
+            j--;
+        }
+        apSorted[j] = pProf;
+    }
+
+    /*
+     * Display them.
+     */
+    pHlp->pfnPrintf(pHlp, "Critical section contention (max spins: R3=%d R0=%d):\n",
+                    pVM->pdm.s.cCritSectMaxSpinsR3, pVM->pdm.s.cCritSectMaxSpinsR0);
+    for (unsigned i = 0; i < cSorted; i++)
+    {
+        PPDMCRITSECTPROF pProf = apSorted[i];
+        uint64_t const   cWaits = pProf->StatWait.cPeriods;
+        pHlp->pfnPrintf(pHlp,
+                        "%s%s: %'llu contentions, %'llu spin wins, %'llu blocks, wait total %'llu ns avg %'llu ns max %'llu ns, spins R3=%d R0=%d\n"
+                        "    wait histogram: <1us=%llu <10us=%llu <100us=%llu <1ms=%llu <10ms=%llu >=10ms=%llu\n",
+                        pProf->pszName, pProf->fRw ? " (rw)" : "", cWaits, pProf->StatSpinWins.c, pProf->StatBlocks.c,
+                        pProf->StatWait.cTicks, cWaits ? pProf->StatWait.cTicks / cWaits : 0,
+                        cWaits ? pProf->StatWait.cTicksMax : 0, pProf->cSpinsR3, pProf->cSpinsR0,
+                        pProf->aStatWaitHisto[0].c, pProf->aStatWaitHisto[1].c, pProf->aStatWaitHisto[2].c,
+                        pProf->aStatWaitHisto[3].c, pProf->aStatWaitHisto[4].c, pProf->aStatWaitHisto[5].c);
+
+        for (unsigned iSite = 0; iSite < PDMCRITSECT_PROF_CALL_SITES; iSite++)
+        {
+            PPDMCRITSECTPROFSITE pSite = &pProf->aSites[iSite];
+            if (!pSite->uCaller)
+                break;
+
+            /* Try resolve ring-0 addresses, ring-3 ones are left to the user
+               unless we've got a function name from the source position. */
+            char         szSym[128];
+            szSym[0] = '\0';
+            if (pSite->fRing0)
+            {
+                DBGFADDRESS Addr;
+                RTGCINTPTR  offDisp = 0;
+                RTDBGSYMBOL Sym;
+                DBGFR3AddrFromFlat(pUVM, &Addr, pSite->uCaller);
+                if (RT_SUCCESS(DBGFR3AsSymbolByAddr(pUVM, DBGF_AS_R0, &Addr, RTDBGSYMADDR_FLAGS_LESS_OR_EQUAL,
+                                                    &offDisp, &Sym, NULL)))
+                    RTStrPrintf(szSym, sizeof(szSym), " %s+%#RGv", Sym.szName, offDisp);
+            }
+            else if (pSite->pszFunction)
+                RTStrPrintf(szSym, sizeof(szSym), " %s", pSite->pszFunction);
+
+            pHlp->pfnPrintf(pHlp, "    %s %RX64%s: %'llu contentions, %'llu ns waited\n",
+                            pSite->fRing0 ? "R0" : "R3", pSite->uCaller, szSym, pSite->cContentions, pSite->cNsWaited);
+        }
+        if (pProf->StatOtherSites.c)
+            pHlp->pfnPrintf(pHlp, "    other call sites: %'llu contentions\n", pProf->StatOtherSites.c);
+    }
+    if (!cSorted)
+        pHlp->pfnPrintf(pHlp, "No contention recorded.\n");
+
+    RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+}
+
+
 /**
  * Relocates all the critical sections.
  *
@@ -192,6 +403,7 @@ static int pdmR3CritSectInitOne(PVM pVM, PPDMCRITSECTINT pCritSect, void *pvKey,
 #ifdef VBOX_WITH_STATISTICS
                 STAMR3RegisterF(pVM, &pCritSect->StatLocked,        STAMTYPE_PROFILE_ADV, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_OCCURENCE, NULL, "/PDM/CritSects/%s/Locked", pCritSect->pszName);
 #endif
+                pdmR3CritSectProfRegister(pVM, pszName, false /*fRw*/);
 
                 PUVM pUVM = pVM->pUVM;
                 RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
@@ -293,6 +505,7 @@ static int pdmR3CritSectRwInitOne(PVM pVM, PPDMCRITSECTRWINT pCritSect, void *pv
 #ifdef VBOX_WITH_STATISTICS
                     STAMR3RegisterF(pVM, &pCritSect->StatWriteLocked,         STAMTYPE_PROFILE_ADV, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_OCCURENCE, NULL, "/PDM/CritSectsRw/%s/WriteLocked", pCritSect->pszName);
 #endif
+                    pdmR3CritSectProfRegister(pVM, pszName, true /*fRw*/);
 
                     PUVM pUVM = pVM->pUVM;
                     RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
@@ -532,6 +745,7 @@ static int pdmR3CritSectDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTINT pCritSect,
     pCritSect->pVMR3   = NULL;
     pCritSect->pVMR0   = NIL_RTR0PTR;
     pCritSect->pVMRC   = NIL_RTRCPTR;
+    pdmR3CritSectProfDeregister(pVM, pCritSect->pszName);
     if (!fFinal)
         STAMR3DeregisterF(pVM->pUVM, "/PDM/CritSects/%s/*", pCritSect->pszName);
     RTStrFree((char *)pCritSect->pszName);
@@ -603,6 +817,7 @@ static int pdmR3CritSectRwDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTRWINT pCritS
     pCritSect->pVMR3   = NULL;
     pCritSect->pVMR0   = NIL_RTR0PTR;
     pCritSect->pVMRC   = NIL_RTRCPTR;
+    pdmR3CritSectProfDeregister(pVM, pCritSect->pszName);
     if (!fFinal)
         STAMR3DeregisterF(pVM->pUVM, "/PDM/CritSectsRw/%s/*", pCritSect->pszName);
     RTStrFree((char *)pCritSect->pszName);
@@ -36,6 +36,7 @@
 #include <VBox/vmm/uvm.h>
 #include <VBox/vmm/vmm.h>
 
+#include <VBox/msi.h>
 #include <VBox/version.h>
 #include <VBox/log.h>
 #include <VBox/err.h>
@@ -1702,9 +1703,9 @@ static DECLCALLBACK(void) pdmR3DevHlp_PCISetIrq(PPDMDEVINS pDevIns, PPDMPCIDEV p
              pDevIns->pReg->szName, pDevIns->iInstance, pPciDev, pPciDev->uDevFn, iIrq, iLevel));
 
     /*
-     * Validate input.
+     * Validate input.  Devices with MSI-X pass the vector number as iIrq.
      */
-    Assert(iIrq == 0);
+    Assert((uint32_t)iIrq < VBOX_MSIX_MAX_ENTRIES);
     Assert((uint32_t)iLevel <= PDM_IRQ_LEVEL_FLIP_FLOP);
 
     /*
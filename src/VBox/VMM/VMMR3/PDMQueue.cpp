@@ -23,11 +23,13 @@
 #include "PDMInternal.h"
 #include <VBox/vmm/pdm.h>
 #include <VBox/vmm/mm.h>
+#include <VBox/vmm/tm.h>
 #ifdef VBOX_WITH_REM
 # include <VBox/vmm/rem.h>
 #endif
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
+#include <VBox/vmm/vmm.h>
 #include <VBox/err.h>
 
 #include <VBox/log.h>
@@ -178,6 +180,11 @@ static int pdmR3QueueCreate(PVM pVM, size_t cbItem, uint32_t cItems, uint32_t cM
     STAMR3RegisterF(pVM, &pQueue->StatInsert,           STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_CALLS,        "Calls to PDMQueueInsert.",         "/PDM/Queue/%s/Insert",         pQueue->pszName);
     STAMR3RegisterF(pVM, &pQueue->StatFlush,            STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_CALLS,        "Calls to pdmR3QueueFlush.",        "/PDM/Queue/%s/Flush",          pQueue->pszName);
     STAMR3RegisterF(pVM, &pQueue->StatFlushLeftovers,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,   "Left over items after flush.",     "/PDM/Queue/%s/FlushLeftovers", pQueue->pszName);
+    STAMR3RegisterF(pVM, &pQueue->StatLatency,          STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_NS_PER_OCCURENCE, "Enqueue-to-consume latency of the oldest item.", "/PDM/Queue/%s/Latency", pQueue->pszName);
+    static const char * const s_apszLatencyBuckets[PDMQUEUE_LATENCY_BUCKETS] = { "lt1us", "lt10us", "lt100us", "lt1ms", "lt10ms", "ge10ms" };
+    for (unsigned i = 0; i < RT_ELEMENTS(pQueue->aStatLatency); i++)
+        STAMR3RegisterF(pVM, &pQueue->aStatLatency[i], STAMTYPE_COUNTER, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES, "Enqueue-to-consume latency histogram.",
+                        "/PDM/Queue/%s/LatencyHisto/%s", pQueue->pszName, s_apszLatencyBuckets[i]);
 #ifdef VBOX_WITH_STATISTICS
     STAMR3RegisterF(pVM, &pQueue->StatFlushPrf,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_CALLS,        "Profiling pdmR3QueueFlush.",       "/PDM/Queue/%s/FlushPrf",       pQueue->pszName);
     STAMR3RegisterF(pVM, (void *)&pQueue->cStatPending, STAMTYPE_U32,     STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,        "Pending items.",                   "/PDM/Queue/%s/Pending",        pQueue->pszName);
@@ -445,7 +452,7 @@ VMMR3_INT_DECL(int) PDMR3QueueDestroy(PPDMQUEUE pQueue)
     /*
      * Deregister statistics.
      */
-    STAMR3DeregisterF(pVM->pUVM, "/PDM/Queue/%s/cbItem", pQueue->pszName);
+    STAMR3DeregisterF(pVM->pUVM, "/PDM/Queue/%s/*", pQueue->pszName);
 
     /*
      * Destroy the timer and free it.
@@ -651,6 +658,7 @@ VMMR3_INT_DECL(void) PDMR3QueueFlushAll(PVM pVM)
     while (!ASMAtomicBitTestAndSet(&pVM->pdm.s.fQueueFlushing, PDM_QUEUE_FLUSH_FLAG_ACTIVE_BIT))
     {
         ASMAtomicBitClear(&pVM->pdm.s.fQueueFlushing, PDM_QUEUE_FLUSH_FLAG_PENDING_BIT);
+        pVM->pdm.s.idQueueFlushCpu = VMMGetCpuId(pVM);
 
         for (PPDMQUEUE pCur = pVM->pUVM->pdm.s.pQueuesForced; pCur; pCur = pCur->pNext)
             if (    pCur->pPendingR3
@@ -669,6 +677,36 @@ VMMR3_INT_DECL(void) PDMR3QueueFlushAll(PVM pVM)
 }
 
 
+/**
+ * Gets the attention of one EMT for flushing the queues.
+ *
+ * This is used when a thread other than an EMT inserts an item.  Rather than
+ * waking up all the EMTs, we wake up a halted one if there is one.  Otherwise
+ * we poke the EMT which did the last flush, so it leaves guest context and
+ * services VM_FF_PDM_QUEUES right away instead of at the next VM exit.
+ *
+ * @param   pVM     The cross context VM structure.
+ * @thread  Any thread but EMTs.
+ */
+void pdmR3QueueNotifyConsumer(PVM pVM)
+{
+    PUVM pUVM = pVM->pUVM;
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        if (VMCPU_GET_STATE(&pVM->aCpus[idCpu]) == VMCPUSTATE_STARTED_HALTED)
+        {
+            STAM_REL_COUNTER_INC(&pVM->pdm.s.StatQueueNotifyWakeUps);
+            VMR3NotifyCpuFFU(&pUVM->aCpus[idCpu], VMNOTIFYFF_FLAGS_DONE_REM);
+            return;
+        }
+
+    VMCPUID idCpu = pVM->pdm.s.idQueueFlushCpu;
+    if (idCpu >= pVM->cCpus)
+        idCpu = 0;
+    STAM_REL_COUNTER_INC(&pVM->pdm.s.StatQueueNotifyPokes);
+    VMR3NotifyCpuFFU(&pUVM->aCpus[idCpu], VMNOTIFYFF_FLAGS_DONE_REM | VMNOTIFYFF_FLAGS_POKE);
+}
+
+
 /**
  * Process pending items in one queue.
  *
@@ -681,8 +719,10 @@ static bool pdmR3QueueFlush(PPDMQUEUE pQueue)
     STAM_PROFILE_START(&pQueue->StatFlushPrf,p);
 
     /*
-     * Get the lists.
+     * Get the lists.  The timestamp must be reset first so that items
+     * inserted after we've grabbed the lists will stamp a new one.
      */
+    uint64_t const    u64FirstPendingTS = ASMAtomicXchgU64(&pQueue->u64FirstPendingTS, 0);
     PPDMQUEUEITEMCORE pItems   = ASMAtomicXchgPtrT(&pQueue->pPendingR3, NULL, PPDMQUEUEITEMCORE);
     RTRCPTR           pItemsRC = ASMAtomicXchgRCPtr(&pQueue->pPendingRC, NIL_RTRCPTR);
     RTR0PTR           pItemsR0 = ASMAtomicXchgR0Ptr(&pQueue->pPendingR0, NIL_RTR0PTR);
@@ -730,6 +770,19 @@ static bool pdmR3QueueFlush(PPDMQUEUE pQueue)
         pItems = pInsert;
     }
 
+    /*
+     * Update the latency statistics.
+     */
+    if (u64FirstPendingTS)
+    {
+        uint64_t const cNsLatency = TMVirtualGetNoCheck(pQueue->pVMR3) - u64FirstPendingTS;
+        STAM_REL_PROFILE_ADD_PERIOD(&pQueue->StatLatency, cNsLatency);
+        unsigned iBucket = 0;
+        for (uint64_t cNsLimit = RT_NS_1US; cNsLatency >= cNsLimit && iBucket < RT_ELEMENTS(pQueue->aStatLatency) - 1; cNsLimit *= 10)
+            iBucket++;
+        STAM_REL_COUNTER_INC(&pQueue->aStatLatency[iBucket]);
+    }
+
     /*
      * Feed the items to the consumer function.
      */
@@ -820,6 +873,8 @@ static bool pdmR3QueueFlush(PPDMQUEUE pQueue)
                 pItems = pPending;
             }
         }
+        if (u64FirstPendingTS)
+            ASMAtomicCmpXchgU64(&pQueue->u64FirstPendingTS, u64FirstPendingTS, 0);
 
         STAM_REL_COUNTER_INC(&pQueue->StatFlushLeftovers);
         STAM_PROFILE_STOP(&pQueue->StatFlushPrf,p);
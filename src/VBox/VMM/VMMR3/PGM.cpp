@@ -669,6 +669,7 @@ typedef PGMRELOCHANDLERARGS const *PCPGMRELOCHANDLERARGS;
 *********************************************************************************************************************************/
 static int                pgmR3InitPaging(PVM pVM);
 static int                pgmR3InitStats(PVM pVM);
+static void               pgmR3PrintLargePagePctStat(PVM pVM, void *pvSample, char *pszBuf, size_t cchBuf);
 static DECLCALLBACK(void) pgmR3PhysInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 static DECLCALLBACK(void) pgmR3InfoMode(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 static DECLCALLBACK(void) pgmR3InfoCr3(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
@@ -1369,6 +1370,32 @@ VMMR3DECL(int) PGMR3Init(PVM pVM)
     rc = CFGMR3QueryBoolDef(pCfgPGM, "ZeroRamPagesOnReset", &pVM->pgm.s.fZeroRamPagesOnReset, true);
     AssertLogRelRCReturn(rc, rc);
 
+    /** @cfgm{/PGM/LargePageBacking, string, "gmm"}
+     * Where the memory for large pages comes from: "gmm" has ring-0 allocate
+     * physically contiguous memory, while "hugetlbfs" and "thp" have ring-3
+     * allocate hugetlbfs or transparent huge page memory and hand it to GMM.  The
+     * last two are only available on linux hosts and fall back on "gmm" when the
+     * host cannot provide a large page. */
+    char szLargePageBacking[16];
+    rc = CFGMR3QueryStringDef(pCfgPGM, "LargePageBacking", szLargePageBacking, sizeof(szLargePageBacking), "gmm");
+    AssertLogRelRCReturn(rc, rc);
+    if (!RTStrICmp(szLargePageBacking, "gmm"))
+        pVM->pgm.s.enmLargePageBacking = PGMLARGEPAGEBACKING_GMM;
+    else if (!RTStrICmp(szLargePageBacking, "hugetlbfs"))
+        pVM->pgm.s.enmLargePageBacking = PGMLARGEPAGEBACKING_HUGETLBFS;
+    else if (!RTStrICmp(szLargePageBacking, "thp"))
+        pVM->pgm.s.enmLargePageBacking = PGMLARGEPAGEBACKING_THP;
+    else
+        AssertLogRelMsgFailedReturn(("Configuration error: Invalid \"LargePageBacking\" value \"%s\".\n", szLargePageBacking),
+                                    VERR_INVALID_PARAMETER);
+#ifndef RT_OS_LINUX
+    if (pVM->pgm.s.enmLargePageBacking != PGMLARGEPAGEBACKING_GMM)
+    {
+        LogRel(("PGM: LargePageBacking=%s is not supported on this host, using gmm.\n", szLargePageBacking));
+        pVM->pgm.s.enmLargePageBacking = PGMLARGEPAGEBACKING_GMM;
+    }
+#endif
+
 #ifdef VBOX_WITH_STATISTICS
     /*
      * Allocate memory for the statistics before someone tries to use them.
@@ -1740,6 +1767,9 @@ static int pgmR3InitStats(PVM pVM)
     STAM_REL_REG(pVM, &pPGM->cHandyPages,                        STAMTYPE_U32,     "/PGM/Page/cHandyPages",              STAMUNIT_COUNT,     "The number of handy pages (not included in cAllPages).");
     STAM_REL_REG(pVM, &pPGM->cLargePages,                        STAMTYPE_U32,     "/PGM/Page/cLargePages",              STAMUNIT_COUNT,     "The number of large pages allocated (includes disabled).");
     STAM_REL_REG(pVM, &pPGM->cLargePagesDisabled,                STAMTYPE_U32,     "/PGM/Page/cLargePagesDisabled",      STAMUNIT_COUNT,     "The number of disabled large pages.");
+    STAM_REL_REG(pVM, &pPGM->cLargePagesSeeded,                  STAMTYPE_U32,     "/PGM/Page/cLargePagesSeeded",        STAMUNIT_COUNT,     "The number of large pages backed by ring-3 hugetlbfs/THP memory.");
+    STAMR3RegisterCallback(pVM, pPGM, STAMVISIBILITY_ALWAYS, STAMUNIT_PCT, NULL, pgmR3PrintLargePagePctStat,
+                           "The percentage of RAM mapped by enabled large pages.", "/PGM/Page/LargePagePct");
     STAM_REL_REG(pVM, &pPGM->cRelocations,                       STAMTYPE_COUNTER, "/PGM/cRelocations",                  STAMUNIT_OCCURENCES,"Number of hypervisor relocations.");
     STAM_REL_REG(pVM, &pPGM->ChunkR3Map.c,                       STAMTYPE_U32,     "/PGM/ChunkR3Map/c",                  STAMUNIT_COUNT,     "Number of mapped chunks.");
     STAM_REL_REG(pVM, &pPGM->ChunkR3Map.cMax,                    STAMTYPE_U32,     "/PGM/ChunkR3Map/cMax",               STAMUNIT_COUNT,     "Maximum number of mapped chunks.");
@@ -2701,6 +2731,28 @@ VMMR3_INT_DECL(void) PGMR3ResetNoMorePhysWritesFlag(PVM pVM)
     pVM->pgm.s.fNoMorePhysWrites = false;
 }
 
+/**
+ * Prints the percentage of guest RAM mapped by large pages (STAM callback).
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pvSample    The PGM instance data.
+ * @param   pszBuf      The buffer to print into.
+ * @param   cchBuf      The size of the buffer.
+ */
+static void pgmR3PrintLargePagePctStat(PVM pVM, void *pvSample, char *pszBuf, size_t cchBuf)
+{
+    PPGM     pPGM        = (PPGM)pvSample;
+    uint32_t cRamPages   = pPGM->cAllPages - pPGM->cPureMmioPages;
+    uint32_t cLargePages = pPGM->cLargePages - pPGM->cLargePagesDisabled;
+    NOREF(pVM);
+    if (cRamPages)
+        RTStrPrintf(pszBuf, cchBuf, "%u",
+                    (uint32_t)((uint64_t)cLargePages * (_2M / PAGE_SIZE) * 100 / cRamPages));
+    else
+        RTStrPrintf(pszBuf, cchBuf, "0");
+}
+
+
 /**
  * Terminates the PGM.
  *
@@ -2713,6 +2765,7 @@ VMMR3DECL(int) PGMR3Term(PVM pVM)
     pgmLock(pVM);
     pgmR3PhysRamTerm(pVM);
     pgmR3PhysRomTerm(pVM);
+    pgmR3PhysLargePageSeedsTerm(pVM);
     pgmUnlock(pVM);
 
     PGMDeregisterStringFormatTypes();
@@ -46,6 +46,10 @@
 #include <iprt/thread.h>
 #include <iprt/string.h>
 #include <iprt/system.h>
+#ifdef RT_OS_LINUX
+# include <errno.h>
+# include <sys/mman.h>
+#endif
 
 
 /*********************************************************************************************************************************
@@ -1143,6 +1147,10 @@ static DECLCALLBACK(VBOXSTRICTRC) pgmR3PhysWriteProtectRAMRendezvous(PVM pVM, PV
     NOREF(pvUser); NOREF(pVCpu);
 
     pgmLock(pVM);
+
+    /* Once for all the pages we're about to write monitor. */
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
+
 #ifdef PGMPOOL_WITH_OPTIMIZED_DIRTY_PT
     pgmPoolResetDirtyPages(pVM);
 #endif
@@ -4458,6 +4466,7 @@ VMMDECL(void) PGMR3PhysSetA20(PVMCPU pVCpu, bool fEnable)
         pgmR3RefreshShadowModeAfterA20Change(pVCpu);
         HMFlushTLB(pVCpu);
 #endif
+        IEMTlbInvalidateAll(pVCpu, false /*fVmm*/); /* The guest page walk may have applied the A20 mask. */
         IEMTlbInvalidateAllPhysical(pVCpu);
         STAM_REL_COUNTER_INC(&pVCpu->pgm.s.cA20Changes);
     }
@@ -4578,6 +4587,67 @@ static int32_t pgmR3PhysChunkFindUnmapCandidate(PVM pVM)
 }
 
 
+/**
+ * Removes a chunk that ring-0 no longer has mapped for us from the ring-3
+ * mapping cache and flushes the PGM pointers that may point into it.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   idChunk     The chunk id.
+ *
+ * @remarks The caller must own the PGM lock.
+ */
+static void pgmR3PhysChunkRemoveMapping(PVM pVM, uint32_t idChunk)
+{
+    /*
+     * Remove the unmapped one.
+     */
+    PPGMCHUNKR3MAP pUnmappedChunk = (PPGMCHUNKR3MAP)RTAvlU32Remove(&pVM->pgm.s.ChunkR3Map.pTree, idChunk);
+    AssertRelease(pUnmappedChunk);
+    AssertRelease(!pUnmappedChunk->cRefs);
+    AssertRelease(!pUnmappedChunk->cPermRefs);
+    pUnmappedChunk->pv       = NULL;
+    pUnmappedChunk->Core.Key = UINT32_MAX;
+#ifdef VBOX_WITH_2X_4GB_ADDR_SPACE
+    MMR3HeapFree(pUnmappedChunk);
+#else
+    MMR3UkHeapFree(pVM, pUnmappedChunk, MM_TAG_PGM_CHUNK_MAPPING);
+#endif
+    pVM->pgm.s.ChunkR3Map.c--;
+
+    /*
+     * Flush dangling PGM pointers (R3 & R0 ptrs to GC physical addresses).
+     */
+    /** @todo We should not flush chunks which include cr3 mappings. */
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        PPGMCPU pPGM = &pVM->aCpus[idCpu].pgm.s;
+
+        pPGM->pGst32BitPdR3    = NULL;
+        pPGM->pGstPaePdptR3    = NULL;
+        pPGM->pGstAmd64Pml4R3  = NULL;
+#ifndef VBOX_WITH_2X_4GB_ADDR_SPACE
+        pPGM->pGst32BitPdR0    = NIL_RTR0PTR;
+        pPGM->pGstPaePdptR0    = NIL_RTR0PTR;
+        pPGM->pGstAmd64Pml4R0  = NIL_RTR0PTR;
+#endif
+        for (unsigned i = 0; i < RT_ELEMENTS(pPGM->apGstPaePDsR3); i++)
+        {
+            pPGM->apGstPaePDsR3[i]             = NULL;
+#ifndef VBOX_WITH_2X_4GB_ADDR_SPACE
+            pPGM->apGstPaePDsR0[i]             = NIL_RTR0PTR;
+#endif
+        }
+
+        /* Flush REM TLBs. */
+        CPUMSetChangedFlags(&pVM->aCpus[idCpu], CPUM_CHANGED_GLOBAL_TLB_FLUSH);
+    }
+#ifdef VBOX_WITH_REM
+    /* Flush REM translation blocks. */
+    REMFlushTBs(pVM);
+#endif
+}
+
+
 /**
  * Rendezvous callback used by pgmR3PhysUnmapChunk that unmaps a chunk
  *
@@ -4619,54 +4689,8 @@ static DECLCALLBACK(VBOXSTRICTRC) pgmR3PhysUnmapChunkRendezvous(PVM pVM, PVMCPU
             STAM_PROFILE_STOP(&pVM->pgm.s.CTX_SUFF(pStats)->StatChunkUnmap, a);
             if (RT_SUCCESS(rc))
             {
-                /*
-                 * Remove the unmapped one.
-                 */
-                PPGMCHUNKR3MAP pUnmappedChunk = (PPGMCHUNKR3MAP)RTAvlU32Remove(&pVM->pgm.s.ChunkR3Map.pTree, Req.idChunkUnmap);
-                AssertRelease(pUnmappedChunk);
-                AssertRelease(!pUnmappedChunk->cRefs);
-                AssertRelease(!pUnmappedChunk->cPermRefs);
-                pUnmappedChunk->pv       = NULL;
-                pUnmappedChunk->Core.Key = UINT32_MAX;
-#ifdef VBOX_WITH_2X_4GB_ADDR_SPACE
-                MMR3HeapFree(pUnmappedChunk);
-#else
-                MMR3UkHeapFree(pVM, pUnmappedChunk, MM_TAG_PGM_CHUNK_MAPPING);
-#endif
-                pVM->pgm.s.ChunkR3Map.c--;
+                pgmR3PhysChunkRemoveMapping(pVM, Req.idChunkUnmap);
                 pVM->pgm.s.cUnmappedChunks++;
-
-                /*
-                 * Flush dangling PGM pointers (R3 & R0 ptrs to GC physical addresses).
-                 */
-                /** @todo We should not flush chunks which include cr3 mappings. */
-                for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
-                {
-                    PPGMCPU pPGM = &pVM->aCpus[idCpu].pgm.s;
-
-                    pPGM->pGst32BitPdR3    = NULL;
-                    pPGM->pGstPaePdptR3    = NULL;
-                    pPGM->pGstAmd64Pml4R3  = NULL;
-#ifndef VBOX_WITH_2X_4GB_ADDR_SPACE
-                    pPGM->pGst32BitPdR0    = NIL_RTR0PTR;
-                    pPGM->pGstPaePdptR0    = NIL_RTR0PTR;
-                    pPGM->pGstAmd64Pml4R0  = NIL_RTR0PTR;
-#endif
-                    for (unsigned i = 0; i < RT_ELEMENTS(pPGM->apGstPaePDsR3); i++)
-                    {
-                        pPGM->apGstPaePDsR3[i]             = NULL;
-#ifndef VBOX_WITH_2X_4GB_ADDR_SPACE
-                        pPGM->apGstPaePDsR0[i]             = NIL_RTR0PTR;
-#endif
-                    }
-
-                    /* Flush REM TLBs. */
-                    CPUMSetChangedFlags(&pVM->aCpus[idCpu], CPUM_CHANGED_GLOBAL_TLB_FLUSH);
-                }
-#ifdef VBOX_WITH_REM
-                /* Flush REM translation blocks. */
-                REMFlushTBs(pVM);
-#endif
             }
         }
     }
@@ -4852,6 +4876,167 @@ VMMR3DECL(void) PGMR3PhysChunkInvalidateTLB(PVM pVM)
 }
 
 
+#if defined(PGM_WITH_LARGE_PAGES) && defined(RT_OS_LINUX)
+/**
+ * Allocates a large page in ring-3 according to /PGM/LargePageBacking and
+ * seeds it into GMM as the large handy page.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+static int pgmR3PhysSeedLargeHandyPage(PVM pVM)
+{
+    /*
+     * Get a 2 MB aligned large page from the host.
+     */
+    uint8_t *pb;
+    if (pVM->pgm.s.enmLargePageBacking == PGMLARGEPAGEBACKING_HUGETLBFS)
+    {
+# ifdef MAP_HUGETLB
+        pb = (uint8_t *)mmap(NULL, _2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (pb == (uint8_t *)MAP_FAILED)
+            return RTErrConvertFromErrno(errno);
+# else
+        return VERR_NOT_SUPPORTED;
+# endif
+    }
+    else
+    {
+# ifdef MADV_HUGEPAGE
+        /* Over-allocate so we can trim it down to a 2 MB aligned range the
+           kernel can back by a transparent huge page. */
+        uint8_t *pbMap = (uint8_t *)mmap(NULL, _4M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pbMap == (uint8_t *)MAP_FAILED)
+            return RTErrConvertFromErrno(errno);
+        pb = RT_ALIGN_PT(pbMap, _2M, uint8_t *);
+        if (pb != pbMap)
+            munmap(pbMap, pb - pbMap);
+        if (pb + _2M != pbMap + _4M)
+            munmap(pb + _2M, pbMap + _4M - (pb + _2M));
+        madvise(pb, _2M, MADV_HUGEPAGE);
+        pb[0] = 0; /* Fault it in now while the kernel can still pick a huge page. */
+# else
+        return VERR_NOT_SUPPORTED;
+# endif
+    }
+
+    PPGMLARGEPAGESEED pSeed = (PPGMLARGEPAGESEED)MMR3HeapAlloc(pVM, MM_TAG_PGM_PHYS, sizeof(*pSeed));
+    if (!pSeed)
+    {
+        munmap(pb, _2M);
+        return VERR_NO_MEMORY;
+    }
+
+    /*
+     * Have ring-0 lock it down, check that it's contiguous and make it the
+     * large handy page.
+     */
+    int rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_SEED_LARGE_HANDY_PAGE, (uintptr_t)pb, NULL);
+    if (RT_SUCCESS(rc))
+    {
+        pSeed->Core.Key = pVM->pgm.s.aLargeHandyPage[0].idPage >> GMM_CHUNKID_SHIFT;
+        pSeed->cPages   = GMM_CHUNK_NUM_PAGES;
+        pSeed->pv       = pb;
+        bool fRc = RTAvlU32Insert(&pVM->pgm.s.pLargePageSeedTreeR3, &pSeed->Core);
+        AssertRelease(fRc);
+        pVM->pgm.s.cLargePagesSeeded++;
+    }
+    else
+    {
+        munmap(pb, _2M);
+        MMR3HeapFree(pSeed);
+    }
+    return rc;
+}
+#endif /* PGM_WITH_LARGE_PAGES && RT_OS_LINUX */
+
+
+/**
+ * Notes that we're freeing a page of a seeded large page, unmapping the
+ * ring-3 memory when it's the last one.
+ *
+ * GMM never hands out the pages of a seeded chunk again and frees the chunk
+ * once all of them have been freed, so nobody will be referencing the memory
+ * after this.  Ring-0 keeps it locked until the pending free request has been
+ * performed, so it doesn't matter that we unmap it before that.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   idChunk     The chunk id of the page.
+ *
+ * @remarks The caller must own the PGM lock.
+ */
+static void pgmR3PhysLargePageSeedFreePage(PVM pVM, uint32_t idChunk)
+{
+    PPGMLARGEPAGESEED pSeed = (PPGMLARGEPAGESEED)RTAvlU32Get(&pVM->pgm.s.pLargePageSeedTreeR3, idChunk);
+    if (!pSeed)
+        return;
+    Assert(pSeed->cPages > 0);
+    if (--pSeed->cPages > 0)
+        return;
+
+    /*
+     * Drop our mapping cache entry for it before the chunk id gets reused.
+     */
+    PPGMCHUNKR3MAP pMap = (PPGMCHUNKR3MAP)RTAvlU32Get(&pVM->pgm.s.ChunkR3Map.pTree, idChunk);
+    if (pMap)
+    {
+        /* Leave it to pgmR3PhysLargePageSeedsTerm if it's still referenced. */
+        AssertMsgReturnVoid(!pMap->cRefs && !pMap->cPermRefs,
+                            ("idChunk=%#x cRefs=%#x cPermRefs=%#x\n", idChunk, pMap->cRefs, pMap->cPermRefs));
+
+        PPGMCHUNKR3MAPTLBE pTlbe = &pVM->pgm.s.ChunkR3Map.Tlb.aEntries[PGM_CHUNKR3MAPTLB_IDX(idChunk)];
+        if (pTlbe->idChunk == idChunk)
+        {
+            pTlbe->idChunk = NIL_GMM_CHUNKID;
+            pTlbe->pChunk  = NULL;
+        }
+        pgmPhysInvalidatePageMapTLB(pVM);
+        pgmR3PhysChunkRemoveMapping(pVM, idChunk);
+    }
+
+    RTAvlU32Remove(&pVM->pgm.s.pLargePageSeedTreeR3, idChunk);
+#ifdef RT_OS_LINUX
+    munmap(pSeed->pv, _2M);
+#endif
+    MMR3HeapFree(pSeed);
+    pVM->pgm.s.cLargePagesSeeded--;
+}
+
+
+/**
+ * Destroy callback used by pgmR3PhysLargePageSeedsTerm.
+ *
+ * @returns 0
+ * @param   pNode       The seed.
+ * @param   pvUser      Unused.
+ */
+static DECLCALLBACK(int) pgmR3PhysLargePageSeedDestroyCallback(PAVLU32NODECORE pNode, void *pvUser)
+{
+    PPGMLARGEPAGESEED pSeed = (PPGMLARGEPAGESEED)pNode;
+    NOREF(pvUser);
+#ifdef RT_OS_LINUX
+    munmap(pSeed->pv, _2M);
+#endif
+    MMR3HeapFree(pSeed);
+    return 0;
+}
+
+
+/**
+ * Unmaps the ring-3 memory of the large pages still seeded into GMM.
+ *
+ * Ring-0 keeps the pages locked until GMM cleans up after the VM, so this
+ * only gets rid of our mappings.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+void pgmR3PhysLargePageSeedsTerm(PVM pVM)
+{
+    RTAvlU32Destroy(&pVM->pgm.s.pLargePageSeedTreeR3, pgmR3PhysLargePageSeedDestroyCallback, NULL);
+    pVM->pgm.s.cLargePagesSeeded = 0;
+}
+
+
 /**
  * Response to VMMCALLRING3_PGM_ALLOCATE_LARGE_HANDY_PAGE to allocate a large
  * (2MB) page for use with a nested paging PDE.
@@ -4872,7 +5057,22 @@ VMMR3DECL(int) PGMR3PhysAllocateLargeHandyPage(PVM pVM, RTGCPHYS GCPhys)
 
     STAM_PROFILE_START(&pVM->pgm.s.CTX_SUFF(pStats)->StatAllocLargePage, a);
     u64TimeStamp1 = RTTimeMilliTS();
-    int rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_ALLOCATE_LARGE_HANDY_PAGE, 0, NULL);
+    int rc = VERR_NOT_SUPPORTED;
+# ifdef RT_OS_LINUX
+    if (pVM->pgm.s.enmLargePageBacking != PGMLARGEPAGEBACKING_GMM)
+    {
+        rc = pgmR3PhysSeedLargeHandyPage(pVM);
+        if (RT_FAILURE(rc))
+        {
+            /* Don't keep trying if the host doesn't have any to give us. */
+            LogRel(("PGM: Failed to seed a %s large page (rc=%Rrc), using gmm from now on.\n",
+                    pVM->pgm.s.enmLargePageBacking == PGMLARGEPAGEBACKING_HUGETLBFS ? "hugetlbfs" : "thp", rc));
+            pVM->pgm.s.enmLargePageBacking = PGMLARGEPAGEBACKING_GMM;
+        }
+    }
+# endif
+    if (RT_FAILURE(rc))
+        rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_ALLOCATE_LARGE_HANDY_PAGE, 0, NULL);
     u64TimeStamp2 = RTTimeMilliTS();
     STAM_PROFILE_STOP(&pVM->pgm.s.CTX_SUFF(pStats)->StatAllocLargePage, a);
     if (RT_SUCCESS(rc))
@@ -5238,6 +5438,12 @@ int pgmPhysFreePage(PVM pVM, PGMMFREEPAGESREQ pReq, uint32_t *pcPendingPages, PP
         }
     }
 
+    /*
+     * Unmap the ring-3 memory of seeded large pages when freeing the last page.
+     */
+    if (pVM->pgm.s.pLargePageSeedTreeR3)
+        pgmR3PhysLargePageSeedFreePage(pVM, idPage >> GMM_CHUNKID_SHIFT);
+
     /*
      * Push it onto the page array.
      */
@@ -21,6 +21,7 @@
 *********************************************************************************************************************************/
 #define LOG_GROUP LOG_GROUP_PGM
 #include <VBox/vmm/pgm.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/stam.h>
 #include <VBox/vmm/ssm.h>
 #include <VBox/vmm/pdmdrv.h>
@@ -1357,6 +1358,7 @@ static void pgmR3ScanRamPages(PVM pVM, bool fFinalPass)
      */
     RTGCPHYS GCPhysCur = 0;
     PPGMRAMRANGE pCur;
+    bool fIemTlbsInvalidated = false;
     pgmLock(pVM);
     do
     {
@@ -1377,11 +1379,15 @@ static void pgmR3ScanRamPages(PVM pVM, bool fFinalPass)
 #ifndef PGMLIVESAVERAMPAGE_WITH_CRC32
                         && (iPage & 0x7ff) == 0x100
 #endif
-                        && PDMR3CritSectYield(&pVM->pgm.s.CritSectX)
-                        && pVM->pgm.s.idRamRangesGen != idRamRangesGen)
+                        && PDMR3CritSectYield(&pVM->pgm.s.CritSectX))
                     {
-                        GCPhysCur = pCur->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
-                        break; /* restart */
+                        /* The EMTs may have reloaded their IEM TLBs meanwhile. */
+                        fIemTlbsInvalidated = false;
+                        if (pVM->pgm.s.idRamRangesGen != idRamRangesGen)
+                        {
+                            GCPhysCur = pCur->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+                            break; /* restart */
+                        }
                     }
 
                     /* Skip already ignored pages. */
@@ -1423,6 +1429,11 @@ static void pgmR3ScanRamPages(PVM pVM, bool fFinalPass)
                                         paLSPages[iPage].cDirtied = PGMLIVSAVEPAGE_MAX_DIRTIED;
                                 }
 
+                                if (!fIemTlbsInvalidated)
+                                {
+                                    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
+                                    fIemTlbsInvalidated = true;
+                                }
                                 pgmPhysPageWriteMonitor(pVM, &pCur->aPages[iPage],
                                                         pCur->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT));
                                 paLSPages[iPage].fWriteMonitored        = 1;
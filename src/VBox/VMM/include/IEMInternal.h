@@ -64,7 +64,34 @@ RT_C_DECLS_BEGIN
 #endif
 
 
-//#define IEM_WITH_CODE_TLB// - work in progress
+/** @def IEM_WITH_CODE_TLB
+ * Enables the instruction TLB and the direct opcode buffer mapping of the
+ * decoder.
+ *
+ * This is ring-3 only as the TLB entries carry ring-3 page mappings.  The
+ * layout of IEMCPU after the decoder state is the same with and without this
+ * define, so it is fine to have it differ between the contexts.
+ */
+#if (   defined(IN_RING3) \
+     && !defined(IEM_VERIFICATION_MODE) && !defined(IEM_VERIFICATION_MODE_MINIMAL) && !defined(IEM_VERIFICATION_MODE_FULL) \
+     && !defined(IEM_WITHOUT_TLBS) && !defined(IN_TSTVMSTRUCT)) \
+  || defined(DOXYGEN_RUNNING)
+# define IEM_WITH_CODE_TLB
+#endif
+
+/** @def IEM_WITH_DATA_TLB
+ * Enables the data TLB, caching guest page walks for iemMemMap and friends.
+ *
+ * In ring-3 the entries also cache the mapping of the guest page, so that
+ * plain RAM can be accessed without taking PGM page mapping locks.  Other
+ * contexts only use the page walk part.
+ */
+#if (   (defined(IN_RING3) || defined(IN_RING0)) \
+     && !defined(IEM_VERIFICATION_MODE) && !defined(IEM_VERIFICATION_MODE_MINIMAL) && !defined(IEM_VERIFICATION_MODE_FULL) \
+     && !defined(IEM_WITHOUT_TLBS)) \
+  || defined(DOXYGEN_RUNNING)
+# define IEM_WITH_DATA_TLB
+#endif
 
 
 #if !defined(IN_TSTVMSTRUCT) && !defined(DOXYGEN_RUNNING)
@@ -387,8 +414,16 @@ typedef struct IEMTLB
     uint64_t            cTlbHits;
     /** TLB misses. */
     uint32_t            cTlbMisses;
-    /** Slow read path.  */
+    /** Slow read path (code TLB) / slow mapping path (data TLB).  */
     uint32_t            cTlbSlowReadPath;
+    /** Number of times the physical page info was (re)loaded. */
+    uint32_t            cTlbPhysLoads;
+    /** Number of full TLB invalidations (revision bumps). */
+    uint32_t            cTlbInvalidateAll;
+    /** Number of single page invalidations that hit an entry. */
+    uint32_t            cTlbInvalidatePage;
+    /** Number of single physical page invalidations that hit an entry. */
+    uint32_t            cTlbInvalidatePhysPage;
 #if 0
     /** TLB misses because of tag mismatch. */
     uint32_t            cTlbMissesTag;
@@ -404,13 +439,132 @@ typedef struct IEMTLB
     uint32_t            cTlbMissesMapping;
 #endif
     /** Alignment padding. */
-    uint32_t            au32Padding[3+5];
+    uint32_t            au32Padding[4];
 } IEMTLB;
 AssertCompileSizeAlignment(IEMTLB, 64);
 /** IEMTLB::uTlbRevision increment.  */
 #define IEMTLB_REVISION_INCR    RT_BIT_64(36)
 /** IEMTLB::uTlbPhysRev increment.  */
 #define IEMTLB_PHYS_REV_INCR    RT_BIT_64(8)
+/**
+ * Calculates the TLB tag for a virtual address.
+ * @returns Tag value for indexing and comparing with IEMTLB::uTag.
+ * @param   a_pTlb      The TLB.
+ * @param   a_GCPtr     The virtual address.  Only bits 47 thru 12 are used.
+ */
+#define IEMTLB_CALC_TAG(a_pTlb, a_GCPtr)    ( IEMTLB_CALC_TAG_NO_REV(a_GCPtr) | (a_pTlb)->uTlbRevision )
+/**
+ * Calculates the TLB tag for a virtual address but without the TLB revision.
+ * @returns Tag value without the revision.
+ * @param   a_GCPtr     The virtual address.  Only bits 47 thru 12 are used.
+ */
+#define IEMTLB_CALC_TAG_NO_REV(a_GCPtr)     ( (((uint64_t)(a_GCPtr) << 16) >> (X86_PAGE_SHIFT + 16)) )
+/**
+ * Converts a TLB tag value into a TLB index.
+ * @returns Index into IEMTLB::aEntries.
+ * @param   a_uTag      Value returned by IEMTLB_CALC_TAG.
+ */
+#define IEMTLB_TAG_TO_INDEX(a_uTag)         ( (uint8_t)(a_uTag) )
+/**
+ * Converts a TLB tag value into a TLB entry pointer.
+ * @returns Pointer into IEMTLB::aEntries corresponding to the tag.
+ * @param   a_pTlb      The TLB.
+ * @param   a_uTag      Value returned by IEMTLB_CALC_TAG.
+ */
+#define IEMTLB_TAG_TO_ENTRY(a_pTlb, a_uTag) ( &(a_pTlb)->aEntries[IEMTLB_TAG_TO_INDEX(a_uTag)] )
+
+
+/** @def IEM_WITH_DECODE_CACHE
+ * Enables the prefix decode cache of IEMExecLots.
+ *
+ * This requires the code TLB since the cache entries are validated against the
+ * opcode bytes in the directly mapped instruction buffer.
+ */
+#if defined(IEM_WITH_CODE_TLB) || defined(DOXYGEN_RUNNING)
+# define IEM_WITH_DECODE_CACHE
+#endif
+
+/** Max number of prefix and opcode bytes covered by a decode cache entry. */
+#define IEM_DECODE_CACHE_MAX_BYTES  8
+/** Number of decode cache entries (power of two). */
+#define IEM_DECODE_CACHE_ENTRIES    1024
+
+/**
+ * A decode cache entry.
+ *
+ * Records the decoder state after the prefixes of an instruction have been
+ * consumed along with the opcode handler to call.  The entry is only valid as
+ * long as the opcode bytes in the instruction buffer match, the CPU mode is the
+ * same and neither of the code TLB revisions have changed.
+ */
+typedef struct IEMDECODECACHEENTRY
+{
+    /** The flat PC of the first prefix byte (the tag). */
+    uint64_t            uPc;
+    /** The prefix and opcode bytes, little endian, masked by fBytesMask. */
+    uint64_t            uBytes;
+    /** Mask covering the cbBytes valid bytes of uBytes. */
+    uint64_t            fBytesMask;
+    /** IEMTLB::uTlbRevision of the code TLB when the entry was made. */
+    uint64_t            uTlbRevision;
+    /** IEMTLB::uTlbPhysRev of the code TLB when the entry was made. */
+    uint64_t            uTlbPhysRev;
+    /** The resulting prefix mask (IEM_OP_PRF_XXX). */
+    uint32_t            fPrefixes;
+    /** The opcode handler: 0x00..0xff for the one byte map, 0x100 + byte for
+     * the two byte map. */
+    uint16_t            idxHandler;
+    /** Number of prefix and opcode bytes consumed. */
+    uint8_t             cbBytes;
+    /** The CPU mode (IEMMODE) the entry was decoded in. */
+    uint8_t             enmCpuMode;
+    /** The resulting effective operand size (IEMMODE). */
+    uint8_t             enmEffOpSize;
+    /** The resulting effective address mode (IEMMODE). */
+    uint8_t             enmEffAddrMode;
+    /** The resulting effective segment (X86_SREG_XXX). */
+    uint8_t             iEffSeg;
+    /** The resulting REX.R bit (<< 3). */
+    uint8_t             uRexReg;
+    /** The resulting REX.B bit (<< 3). */
+    uint8_t             uRexB;
+    /** The resulting REX.X bit (<< 3). */
+    uint8_t             uRexIndex;
+    /** Alignment padding. */
+    uint8_t             abPadding[10];
+} IEMDECODECACHEENTRY;
+AssertCompileSize(IEMDECODECACHEENTRY, 64);
+/** Pointer to a decode cache entry. */
+typedef IEMDECODECACHEENTRY *PIEMDECODECACHEENTRY;
+
+/**
+ * The per-CPU decode cache, ring-3 only.
+ */
+typedef struct IEMDECODECACHE
+{
+    /** Number of hits. */
+    uint64_t            cHits;
+    /** Number of misses, i.e. entries (re)filled. */
+    uint32_t            cMisses;
+    /** Number of misses on a matching tag because the opcode bytes or a code
+     * TLB revision changed. */
+    uint32_t            cStale;
+    /** Alignment padding. */
+    uint32_t            au32Padding[12];
+    /** The entries, indexed by IEM_DECODE_CACHE_PC_TO_INDEX. */
+    IEMDECODECACHEENTRY aEntries[IEM_DECODE_CACHE_ENTRIES];
+} IEMDECODECACHE;
+AssertCompileMemberAlignment(IEMDECODECACHE, aEntries, 64);
+/** Pointer to the decode cache. */
+typedef IEMDECODECACHE *PIEMDECODECACHE;
+
+/**
+ * Converts a flat PC into a decode cache index.
+ * @returns Index into IEMDECODECACHE::aEntries.
+ * @param   a_uPc       The flat PC of the instruction.
+ */
+#define IEM_DECODE_CACHE_PC_TO_INDEX(a_uPc) \
+    ( (uint32_t)((a_uPc) ^ ((a_uPc) >> 10)) & (IEM_DECODE_CACHE_ENTRIES - 1) )
 
 
 /**
@@ -564,10 +718,15 @@ typedef struct IEMCPU
     union
     {
         PGMPAGEMAPLOCK      Lock;
+        /** The data TLB physical revision an IEM_ACCESS_NOT_LOCKED mapping was
+         * made under.  The page address and size of the access are kept in
+         * aMemBbMappings. */
+        uint64_t            uTlbPhysRev;
         uint64_t            au64Padding[2];
     } aMemMappingLocks[3];
 
-    /** Bounce buffer info.
+    /** Bounce buffer info, GCPhysFirst and cbFirst are also used by
+     * IEM_ACCESS_NOT_LOCKED mappings.
      * This runs in parallel to aMemMappings. */
     struct
     {
@@ -679,7 +838,10 @@ typedef struct IEMCPU
     CPUMCPUVENDOR           enmHostCpuVendor;
     /** @} */
 
-    uint32_t                au32Alignment8[HC_ARCH_BITS == 64 ? 1 + 2 + 8 : 1 + 2]; /**< Alignment padding. */
+    uint32_t                au32Alignment8[HC_ARCH_BITS == 64 ? 1 + 8 : 1 + 1]; /**< Alignment padding. */
+    /** The prefix decode cache of IEMExecLots - ring-3 only, see
+     * IEM_WITH_DECODE_CACHE. */
+    R3PTRTYPE(PIEMDECODECACHE) pDecodeCacheR3;
 
     /** Data TLB.
      * @remarks Must be 64-byte aligned. */
@@ -777,8 +939,11 @@ typedef IEMCPU const *PCIEMCPU;
 #define IEM_ACCESS_PENDING_R3_WRITE_1ST UINT32_C(0x00000400)
 /** Bounce buffer with ring-3 write pending, second page. */
 #define IEM_ACCESS_PENDING_R3_WRITE_2ND UINT32_C(0x00000800)
+/** Used in aMemMappings to indicate that the entry was mapped via the data TLB
+ * and does not hold a PGM page mapping lock. */
+#define IEM_ACCESS_NOT_LOCKED           UINT32_C(0x00001000)
 /** Valid bit mask. */
-#define IEM_ACCESS_VALID_MASK           UINT32_C(0x00000fff)
+#define IEM_ACCESS_VALID_MASK           UINT32_C(0x00001fff)
 /** Read+write data alias. */
 #define IEM_ACCESS_DATA_RW              (IEM_ACCESS_TYPE_READ  | IEM_ACCESS_TYPE_WRITE | IEM_ACCESS_WHAT_DATA)
 /** Write data alias. */
@@ -149,6 +149,18 @@ typedef struct PDMASYNCCOMPLETIONEPCLASSOPS
     DECLR3CALLBACKMEMBER(int, pfnEpSetSize, (PPDMASYNCCOMPLETIONENDPOINT pEndpoint,
                                              uint64_t cbSize));
 
+    /**
+     * Deallocates the given range of the endpoint. Optional.
+     * This is a synchronous operation.
+     *
+     * @returns VBox status code.
+     * @param   pEndpoint     Endpoint the request is for.
+     * @param   off           Start offset of the range.
+     * @param   cb            Size of the range in bytes.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnEpPunchHole, (PPDMASYNCCOMPLETIONENDPOINT pEndpoint,
+                                               uint64_t off, uint64_t cb));
+
     /** Initialization safety marker. */
     uint32_t    u32VersionEnd;
 } PDMASYNCCOMPLETIONEPCLASSOPS;
@@ -158,7 +170,7 @@ typedef PDMASYNCCOMPLETIONEPCLASSOPS *PPDMASYNCCOMPLETIONEPCLASSOPS;
 typedef const PDMASYNCCOMPLETIONEPCLASSOPS *PCPDMASYNCCOMPLETIONEPCLASSOPS;
 
 /** Version for the endpoint class operations structure. */
-#define PDMAC_EPCLASS_OPS_VERSION 0x00000001
+#define PDMAC_EPCLASS_OPS_VERSION 0x00000002
 
 /** Pointer to a bandwidth control manager. */
 typedef struct PDMACBWMGR *PPDMACBWMGR;
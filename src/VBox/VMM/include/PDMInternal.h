@@ -372,6 +372,105 @@ AssertCompileMemberAlignment(PDMCRITSECTRWINT, Core.u64State, 8);
 typedef PDMCRITSECTRWINT *PPDMCRITSECTRWINT;
 
 
+/** @name Critical section contention profiler and adaptive spinning.
+ * @{ */
+/** The initial number of loops to spin for in ring-3. */
+#define PDMCRITSECT_SPIN_COUNT_R3           20
+/** The initial number of loops to spin for in ring-0. */
+#define PDMCRITSECT_SPIN_COUNT_R0           256
+/** The number of loops to spin for in the raw-mode context. */
+#define PDMCRITSECT_SPIN_COUNT_RC           256
+/** Number of slots in the contention profiler hash table (power of two). */
+#define PDMCRITSECT_PROF_ENTRIES            128
+/** Number of slots which may be occupied, live or deleted, so that lookups for
+ * sections without a profile always run into an empty slot early. */
+#define PDMCRITSECT_PROF_ENTRIES_USED_MAX   (PDMCRITSECT_PROF_ENTRIES / 4 * 3)
+/** Number of call sites tracked per critical section. */
+#define PDMCRITSECT_PROF_CALL_SITES         4
+/** Number of buckets in the wait time histogram.
+ * The buckets are decimal: <1us, <10us, <100us, <1ms, <10ms and the rest. */
+#define PDMCRITSECT_PROF_WAIT_BUCKETS       6
+/** Marks a profiler entry whose critical section has been deleted. */
+#define PDMCRITSECT_PROF_TOMBSTONE          ((RTR3UINTPTR)1)
+/** The max number of loops to spin before blocking in ring-3. */
+#define PDMCRITSECT_SPIN_MAX_R3             1024
+/** The max number of loops to spin before blocking or going to ring-3 in
+ * ring-0. */
+#define PDMCRITSECT_SPIN_MAX_R0             2048
+/** @} */
+
+/**
+ * Contention profile of one call site entering a critical section.
+ */
+typedef struct PDMCRITSECTPROFSITE
+{
+    /** The caller address, 0 if the entry is free. */
+    uint64_t volatile               uCaller;
+    /** Number of contended enters from this call site. */
+    uint64_t volatile               cContentions;
+    /** Total nanoseconds waited by this call site. */
+    uint64_t volatile               cNsWaited;
+    /** The caller function name if known (ring-3 strict builds only). */
+    R3PTRTYPE(const char *)         pszFunction;
+    /** Set if uCaller is a ring-0 address. */
+    bool                            fRing0;
+    /** Alignment padding. */
+    bool                            afPadding[HC_ARCH_BITS == 64 ? 7 : 3];
+} PDMCRITSECTPROFSITE;
+/** Pointer to a call site contention profile. */
+typedef PDMCRITSECTPROFSITE *PPDMCRITSECTPROFSITE;
+
+/**
+ * Contention profile and adaptive spinning state for one critical section.
+ *
+ * These live in a hash table in the hyper heap keyed by the (unique) ring-3
+ * name pointer of the critical section, so the critical section structures,
+ * which are embedded in device instance data, don't need to grow.
+ */
+typedef struct PDMCRITSECTPROF
+{
+    /** The name of the critical section, this is the lookup key.
+     * NIL_RTR3PTR if the entry is free, PDMCRITSECT_PROF_TOMBSTONE if deleted. */
+    R3PTRTYPE(const char *) volatile pszName;
+    /** Set if this is a read/write critical section. */
+    bool                            fRw;
+    /** Alignment padding. */
+    bool                            afPadding[3];
+    /** The adaptive ring-3 spin count. */
+    int32_t volatile                cSpinsR3;
+    /** The adaptive ring-0 spin count. */
+    int32_t volatile                cSpinsR0;
+    /** Alignment padding. */
+    uint32_t                        u32Padding;
+    /** Number of contended enters that got the section while spinning. */
+    STAMCOUNTER                     StatSpinWins;
+    /** Number of contended enters that had to block or go to ring-3. */
+    STAMCOUNTER                     StatBlocks;
+    /** Number of contended enters from call sites that didn't fit in aSites. */
+    STAMCOUNTER                     StatOtherSites;
+    /** Time spent waiting in contended enters (ns). */
+    STAMPROFILE                     StatWait;
+    /** Wait time histogram, see PDMCRITSECT_PROF_WAIT_BUCKETS. */
+    STAMCOUNTER                     aStatWaitHisto[PDMCRITSECT_PROF_WAIT_BUCKETS];
+    /** The call sites. */
+    PDMCRITSECTPROFSITE             aSites[PDMCRITSECT_PROF_CALL_SITES];
+} PDMCRITSECTPROF;
+AssertCompileMemberAlignment(PDMCRITSECTPROF, StatSpinWins, 8);
+/** Pointer to a critical section contention profile. */
+typedef PDMCRITSECTPROF *PPDMCRITSECTPROF;
+
+/**
+ * Calculates the contention profiler hash table index for a critical section.
+ *
+ * @returns Index into the table.
+ * @param   uKey        The ring-3 address of the critical section name.
+ */
+DECLINLINE(uint32_t) pdmCritSectProfHash(RTR3UINTPTR uKey)
+{
+    return ((uint32_t)(uKey >> 3) * UINT32_C(0x9e3779b1) >> 16) & (PDMCRITSECT_PROF_ENTRIES - 1);
+}
+
+
 
 /**
  * The usual device/driver/internal/external stuff.
@@ -807,6 +906,9 @@ typedef PDMMOD *PPDMMOD;
 
 /** Extra space in the free array. */
 #define PDMQUEUE_FREE_SLACK         16
+/** Number of buckets in the enqueue-to-consume latency histogram.
+ * The buckets are decimal: <1us, <10us, <100us, <1ms, <10ms and the rest. */
+#define PDMQUEUE_LATENCY_BUCKETS    6
 
 /**
  * Queue type.
@@ -898,6 +1000,9 @@ typedef struct PDMQUEUE
     uint32_t volatile               iFreeHead;
     /** Index to the free tail (where we remove). */
     uint32_t volatile               iFreeTail;
+    /** TMVirtualGetNoCheck timestamp of the oldest pending item, 0 if none.
+     * Used for the enqueue-to-consume latency statistics. */
+    uint64_t volatile               u64FirstPendingTS;
 
     /** Unique queue name. */
     R3PTRTYPE(const char *)         pszName;
@@ -912,6 +1017,10 @@ typedef struct PDMQUEUE
     STAMCOUNTER                     StatFlush;
     /** Stat: Queue flushes with pending items left over. */
     STAMCOUNTER                     StatFlushLeftovers;
+    /** Stat: Enqueue-to-consume latency of the oldest item of each flush (ns). */
+    STAMPROFILE                     StatLatency;
+    /** Stat: Enqueue-to-consume latency histogram, see PDMQUEUE_LATENCY_BUCKETS. */
+    STAMCOUNTER                     aStatLatency[PDMQUEUE_LATENCY_BUCKETS];
 #ifdef VBOX_WITH_STATISTICS
     /** State: Profiling the flushing. */
     STAMPROFILE                     StatFlushPrf;
@@ -1153,8 +1262,9 @@ typedef struct PDM
 
     /** Pending reset flags (PDMVMRESET_F_XXX). */
     uint32_t volatile               fResetFlags;
-    /** Alignment padding. */
-    uint32_t volatile               u32Padding;
+    /** The ID of the EMT which last flushed the queues.  This is the one we
+     * poke when a non-EMT thread inserts an item and no EMT is halted. */
+    VMCPUID volatile                idQueueFlushCpu;
 
     /** The tracing ID of the next device instance.
      *
@@ -1184,6 +1294,22 @@ typedef struct PDM
 
     /** Number of times a critical section leave request needed to be queued for ring-3 execution. */
     STAMCOUNTER                     StatQueuedCritSectLeaves;
+    /** Number of times a queue insert by a non-EMT thread woke up a halted EMT. */
+    STAMCOUNTER                     StatQueueNotifyWakeUps;
+    /** Number of times a queue insert by a non-EMT thread poked an executing EMT. */
+    STAMCOUNTER                     StatQueueNotifyPokes;
+
+    /** @name Critical section contention profiler.
+     * @{ */
+    /** The profiler hash table (PDMCRITSECT_PROF_ENTRIES) - R3 Ptr. */
+    R3PTRTYPE(PPDMCRITSECTPROF)     paCritSectProfR3;
+    /** The profiler hash table (PDMCRITSECT_PROF_ENTRIES) - R0 Ptr. */
+    R0PTRTYPE(PPDMCRITSECTPROF)     paCritSectProfR0;
+    /** The max ring-3 spin count, 0 on uni-processor hosts. */
+    int32_t                         cCritSectMaxSpinsR3;
+    /** The max ring-0 spin count, 0 on uni-processor hosts. */
+    int32_t                         cCritSectMaxSpinsR0;
+    /** @} */
 } PDM;
 AssertCompileMemberAlignment(PDM, GCPhysVMMDevHeap, sizeof(RTGCPHYS));
 AssertCompileMemberAlignment(PDM, CritSect, 8);
@@ -1339,6 +1465,7 @@ char       *pdmR3FileR3(const char *pszFile, bool fShared);
 int         pdmR3LoadR3U(PUVM pUVM, const char *pszFilename, const char *pszName);
 
 void        pdmR3QueueRelocate(PVM pVM, RTGCINTPTR offDelta);
+void        pdmR3QueueNotifyConsumer(PVM pVM);
 
 int         pdmR3ThreadCreateDevice(PVM pVM, PPDMDEVINS pDevIns, PPPDMTHREAD ppThread, void *pvUser, PFNPDMTHREADDEV pfnThread,
                                     PFNPDMTHREADWAKEUPDEV pfnWakeup, size_t cbStack, RTTHREADTYPE enmType, const char *pszName);
@@ -1384,6 +1511,11 @@ void        pdmUnlock(PVM pVM);
 #if defined(IN_RING3) || defined(IN_RING0)
 void        pdmCritSectRwLeaveSharedQueued(PPDMCRITSECTRW pThis);
 void        pdmCritSectRwLeaveExclQueued(PPDMCRITSECTRW pThis);
+PPDMCRITSECTPROF pdmCritSectProfLookup(PVM pVM, RTR3UINTPTR uKey);
+int32_t     pdmCritSectProfSpinStart(PVM pVM, PPDMCRITSECTPROF pProf);
+void        pdmCritSectProfSpinEnd(PPDMCRITSECTPROF pProf, int32_t cSpins, bool fAcquired);
+void        pdmCritSectProfRecordWait(PPDMCRITSECTPROF pProf, uint64_t nsStart, bool fBlocked, PCRTLOCKVALSRCPOS pSrcPos,
+                                      RTHCUINTPTR uCaller);
 #endif
 
 /** @} */
@@ -518,7 +518,11 @@ DECLINLINE(int) pgmPhysPageQueryTlbeWithPage(PVM pVM, PPGMPAGE pPage, RTGCPHYS G
 /**
  * Enables write monitoring for an allocated page.
  *
- * The caller is responsible for updating the shadow page tables.
+ * The caller is responsible for updating the shadow page tables, and for
+ * calling IEMTlbInvalidateAllPhysicalAllCpus before changing the first page
+ * after taking the PGM lock, as IEM may have direct writable mappings of the
+ * pages cached.  Doing it before rather than after lets IEM detect writes
+ * which raced the state change (see iemMemNotLockedCommit).
  *
  * @param   pVM         The cross context VM structure.
  * @param   pPage       The page to write monitor.
@@ -1646,6 +1646,44 @@ typedef struct PGMROMRANGE
 typedef PGMROMRANGE *PPGMROMRANGE;
 
 
+/**
+ * How large pages are backed on the host.
+ * Configured by /PGM/LargePageBacking.
+ */
+typedef enum PGMLARGEPAGEBACKING
+{
+    /** Invalid zero value. */
+    PGMLARGEPAGEBACKING_INVALID = 0,
+    /** Physically contiguous memory allocated by GMM in ring-0 (default). */
+    PGMLARGEPAGEBACKING_GMM,
+    /** hugetlbfs pages allocated by ring-3 and seeded into GMM (Linux). */
+    PGMLARGEPAGEBACKING_HUGETLBFS,
+    /** Transparent huge pages allocated by ring-3 and seeded into GMM (Linux). */
+    PGMLARGEPAGEBACKING_THP,
+    /** End of valid values. */
+    PGMLARGEPAGEBACKING_END
+} PGMLARGEPAGEBACKING;
+
+
+/**
+ * A ring-3 allocated large page seeded into GMM.
+ *
+ * These are kept in a tree so the memory can be unmapped when we free the last
+ * page of the chunk, or at termination.
+ */
+typedef struct PGMLARGEPAGESEED
+{
+    /** The key is the chunk id. */
+    AVLU32NODECORE                      Core;
+    /** The number of pages of the chunk we haven't freed yet. */
+    uint32_t                            cPages;
+    /** The 2 MB aligned ring-3 address of the memory. */
+    void                               *pv;
+} PGMLARGEPAGESEED;
+/** Pointer to a seeded large page. */
+typedef PGMLARGEPAGESEED *PPGMLARGEPAGESEED;
+
+
 /**
  * Live save per page data for an MMIO2 page.
  *
@@ -3266,8 +3304,10 @@ typedef struct PGM
     bool                            fRestoreRomPagesOnReset;
     /** Whether to automatically clear all RAM pages on reset. */
     bool                            fZeroRamPagesOnReset;
+    /** How large pages are backed, PGMLARGEPAGEBACKING. */
+    uint8_t                         enmLargePageBacking;
     /** Alignment padding. */
-    bool                            afAlignment3[7];
+    bool                            afAlignment3[6];
 
     /** Indicates that PGMR3FinalizeMappings has been called and that further
      * PGMR3MapIntermediate calls will be rejected. */
@@ -3327,7 +3367,9 @@ typedef struct PGM
     /** Pointer to SHW+GST mode data (function pointers).
      * The index into this table is made up from */
     R3PTRTYPE(PPGMMODEDATA)         paModeData;
-    RTR3PTR                         R3PtrAlignment0;
+    /** Tree of large pages allocated by ring-3 and seeded into GMM, ordered by
+     * chunk id. */
+    R3PTRTYPE(PAVLU32NODECORE)      pLargePageSeedTreeR3;
     /** MMIO2 lookup array for ring-3.  Indexed by idMmio2 minus 1. */
     R3PTRTYPE(PPGMREGMMIORANGE)     apMmio2RangesR3[PGM_MMIO2_MAX_RANGES];
 
@@ -3596,7 +3638,8 @@ typedef struct PGM
     uint32_t                        cUnmappedChunks;        /**< Number of times we unmapped a chunk. */
     uint32_t                        cLargePages;            /**< The number of large pages. */
     uint32_t                        cLargePagesDisabled;    /**< The number of disabled large pages. */
-/*    uint32_t                        aAlignment4[1]; */
+    uint32_t                        cLargePagesSeeded;      /**< The number of large pages backed by ring-3 memory. */
+    uint32_t                        aAlignment4[1];
 
     /** The number of times we were forced to change the hypervisor region location. */
     STAMCOUNTER                     cRelocations;
@@ -4217,6 +4260,7 @@ int             pgmR3PhysRamZeroAll(PVM pVM);
 int             pgmR3PhysChunkMap(PVM pVM, uint32_t idChunk, PPPGMCHUNKR3MAP ppChunk);
 int             pgmR3PhysRamTerm(PVM pVM);
 void            pgmR3PhysRomTerm(PVM pVM);
+void            pgmR3PhysLargePageSeedsTerm(PVM pVM);
 void            pgmR3PhysAssertSharedPageChecksums(PVM pVM);
 
 int             pgmR3PoolInit(PVM pVM);
@@ -22,6 +22,8 @@
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/vmm.h>
 #include <VBox/vmm/cpum.h>
+#include <VBox/vmm/gmm.h>
+#include <VBox/vmm/pgm.h>
 #include <VBox/vmm/tm.h>
 #include <VBox/vmm/pdmapi.h>
 #include <VBox/err.h>
@@ -193,6 +195,77 @@ tstVMMConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
 }
 
 
+/** VMR3Create config constructor for tstVMMLargePageSeedTeardown. */
+static DECLCALLBACK(int)
+tstVMMLargePageConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    RT_NOREF2(pUVM, pvUser);
+    int rc = CFGMR3ConstructDefaultTree(pVM);
+    if (RT_SUCCESS(rc))
+    {
+        PCFGMNODE pRoot = CFGMR3GetRoot(pVM);
+        rc = CFGMR3InsertInteger(pRoot, "HMEnabled", false);
+        RTTESTI_CHECK_MSG_RET(RT_SUCCESS(rc),
+                              ("CFGMR3InsertInteger(pRoot,\"HMEnabled\",) -> %Rrc\n", rc), rc);
+        PCFGMNODE pPGM;
+        rc = CFGMR3InsertNode(pRoot, "PGM", &pPGM);
+        RTTESTI_CHECK_MSG_RET(RT_SUCCESS(rc),
+                              ("CFGMR3InsertNode(pRoot,\"PGM\",) -> %Rrc\n", rc), rc);
+        rc = CFGMR3InsertString(pPGM, "LargePageBacking", "thp");
+        RTTESTI_CHECK_MSG_RET(RT_SUCCESS(rc),
+                              ("CFGMR3InsertString(pPGM,\"LargePageBacking\",) -> %Rrc\n", rc), rc);
+    }
+    return rc;
+}
+
+
+/**
+ * Creates VMs which seed a ring-3 allocated large page into GMM and destroys
+ * them again, checking that GMM frees the chunks with them.
+ *
+ * @param   hTest       The test handle.
+ * @param   pVMObserver The VM to query the GMM statistics thru.  It's left
+ *                      alone otherwise, so its allocations don't change.
+ */
+static void tstVMMLargePageSeedTeardown(RTTEST hTest, PVM pVMObserver)
+{
+    uint64_t cAllocPagesBefore, cFreePagesBefore, cBalloonPages, cSharedPages;
+    int rc = GMMR3QueryHypervisorMemoryStats(pVMObserver, &cAllocPagesBefore, &cFreePagesBefore, &cBalloonPages, &cSharedPages);
+    RTTEST_CHECK_RC_RETV(hTest, rc, VINF_SUCCESS);
+
+    for (unsigned iRound = 0; iRound < 2; iRound++)
+    {
+        PVM  pVM;
+        PUVM pUVM;
+        rc = VMR3Create(1, NULL, NULL, NULL, tstVMMLargePageConfigConstructor, NULL, &pVM, &pUVM);
+        RTTEST_CHECK_RC_RETV(hTest, rc, VINF_SUCCESS);
+
+        /* Falls back on a GMM large page if the host can't give us a huge page. */
+        rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)PGMR3PhysAllocateLargeHandyPage, 2, pVM, (RTGCPHYS)_4M);
+        RTTEST_CHECK_RC(hTest, rc, VINF_SUCCESS);
+
+        rc = VMR3PowerOff(pUVM);
+        if (RT_FAILURE(rc))
+            RTTestFailed(hTest, "VMR3PowerOff failed: rc=%Rrc\n", rc);
+        rc = VMR3Destroy(pUVM);
+        if (RT_FAILURE(rc))
+            RTTestFailed(hTest, "VMR3Destroy failed: rc=%Rrc\n", rc);
+        VMR3ReleaseUVM(pUVM);
+
+        /* All the pages of the destroyed VM must be gone and none of its
+           chunks may be left behind on a free list. */
+        uint64_t cAllocPagesAfter, cFreePagesAfter;
+        rc = GMMR3QueryHypervisorMemoryStats(pVMObserver, &cAllocPagesAfter, &cFreePagesAfter, &cBalloonPages, &cSharedPages);
+        RTTEST_CHECK_RC_RETV(hTest, rc, VINF_SUCCESS);
+        RTTEST_CHECK_MSG(hTest, cAllocPagesAfter == cAllocPagesBefore,
+                         (hTest, "round %u: cAllocPages=%#RX64, expected %#RX64\n", iRound, cAllocPagesAfter, cAllocPagesBefore));
+        RTTEST_CHECK_MSG(hTest, cAllocPagesAfter + cFreePagesAfter <= cAllocPagesBefore + cFreePagesBefore,
+                         (hTest, "round %u: %#RX64 pages in chunks, expected at most %#RX64\n", iRound,
+                          cAllocPagesAfter + cFreePagesAfter, cAllocPagesBefore + cFreePagesBefore));
+    }
+}
+
+
 /**
  * Entry point.
  */
@@ -219,7 +292,8 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
     };
     enum
     {
-        kTstVMMTest_VMM,  kTstVMMTest_TM, kTstVMMTest_MSRs, kTstVMMTest_KnownMSRs, kTstVMMTest_MSRExperiments
+        kTstVMMTest_VMM,  kTstVMMTest_TM, kTstVMMTest_MSRs, kTstVMMTest_KnownMSRs, kTstVMMTest_MSRExperiments,
+        kTstVMMTest_LargePages
     } enmTestOpt = kTstVMMTest_VMM;
 
     int ch;
@@ -245,6 +319,8 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
                     enmTestOpt = kTstVMMTest_KnownMSRs;
                 else if (!strcmp("msr-experiments", ValueUnion.psz))
                     enmTestOpt = kTstVMMTest_MSRExperiments;
+                else if (!strcmp("large-pages", ValueUnion.psz))
+                    enmTestOpt = kTstVMMTest_LargePages;
                 else
                 {
                     RTPrintf("tstVMM: unknown test: '%s'\n", ValueUnion.psz);
@@ -257,7 +333,7 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
                 break;
 
             case 'h':
-                RTPrintf("usage: tstVMM [--cpus|-c cpus] [-s] [--test <vmm|tm|msrs|known-msrs>]\n");
+                RTPrintf("usage: tstVMM [--cpus|-c cpus] [-s] [--test <vmm|tm|msrs|known-msrs|large-pages>]\n");
                 return 1;
 
             case 'V':
@@ -358,6 +434,13 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
                 break;
             }
 
+            case kTstVMMTest_LargePages:
+            {
+                RTTestSub(hTest, "Seeded large page teardown");
+                tstVMMLargePageSeedTeardown(hTest, pVM);
+                break;
+            }
+
         }
 
         /*
@@ -596,6 +596,7 @@
     GEN_CHECK_OFF(PDMQUEUE, pPendingRC);
     GEN_CHECK_OFF(PDMQUEUE, iFreeHead);
     GEN_CHECK_OFF(PDMQUEUE, iFreeTail);
+    GEN_CHECK_OFF(PDMQUEUE, u64FirstPendingTS);
     GEN_CHECK_OFF(PDMQUEUE, pszName);
     GEN_CHECK_OFF(PDMQUEUE, StatAllocFailures);
     GEN_CHECK_OFF(PDMQUEUE, StatInsert);
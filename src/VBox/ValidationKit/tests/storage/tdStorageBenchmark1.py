@@ -440,6 +440,12 @@ class tdStorageBenchmark(vbox.TestDriver):
     kiIoTest      = 7;
     kiTestSet     = 8;
 
+    # The virtio-scsi controller has no Main controller type yet and is configured
+    # through extra data, this is the pseudo controller type used for it.
+    ksStorageCtrlVirtioScsi = 'VirtioSCSI';
+    # Extra data node of the virtio-scsi device LUN the test disk is attached to.
+    ksVirtioScsiLun         = 'VBoxInternal/Devices/virtio-scsi/0/LUN#0';
+
     def __init__(self):
         vbox.TestDriver.__init__(self);
         self.asRsrcs                 = None;
@@ -485,6 +491,8 @@ class tdStorageBenchmark(vbox.TestDriver):
         reporter.log('      Default: %s' % (':'.join(str(c) for c in self.acCpusDef)));
         reporter.log('  --storage-ctrls <type1[:type2[:...]]>');
         reporter.log('      Default: %s' % (':'.join(self.asStorageCtrlsDef)));
+        reporter.log('      %s attaches the disk to a virtio-scsi controller configured through' % (self.ksStorageCtrlVirtioScsi));
+        reporter.log('      extra data for comparing it with AHCI using fio, it is not a default');
         reporter.log('  --host-io-cache <setting1[:setting2[:...]]>');
         reporter.log('      Default: %s' % (':'.join(self.asHostIoCacheDef)));
         reporter.log('  --disk-formats  <type1[:type2[:...]]>');
@@ -782,6 +790,8 @@ class tdStorageBenchmark(vbox.TestDriver):
             eStorageCtrl = vboxcon.StorageControllerType_BusLogic;
         elif sStorageCtrl == 'NVMe':
             eStorageCtrl = vboxcon.StorageControllerType_NVMe;
+        elif sStorageCtrl == self.ksStorageCtrlVirtioScsi:
+            eStorageCtrl = self.ksStorageCtrlVirtioScsi;
 
         return eStorageCtrl;
 
@@ -809,8 +819,33 @@ class tdStorageBenchmark(vbox.TestDriver):
            and asTestCfg[self.kiStorageCtrl] == 'IDE':
             return False;
 
+        # The virtio-scsi disk is configured by hand and can't be a differencing image or iSCSI target.
+        if     asTestCfg[self.kiStorageCtrl] == self.ksStorageCtrlVirtioScsi \
+           and (asTestCfg[self.kiDiskFmt] == 'iSCSI' or self.cDiffLvls > 0):
+            return False;
+
         return True;
 
+    def setupVirtioScsiDisk(self, oSession, oHd, sHostIoCache):
+        """
+        Attaches the given disk to the virtio-scsi controller through extra data.
+        Passing None for the disk removes the configuration again.
+        Returns True on success, False on failure (logged).
+        """
+        asKeys = [ '/Driver', '/AttachedDriver/Driver', '/AttachedDriver/Config/Path',
+                   '/AttachedDriver/Config/Format', '/AttachedDriver/Config/Type',
+                   '/AttachedDriver/Config/Mountable', '/AttachedDriver/Config/UseNewIo' ];
+        if oHd is not None:
+            asValues = [ 'SCSI', 'VD', 'string:' + oHd.location, oHd.format, 'HardDisk', '0',
+                         '1' if sHostIoCache == 'no-hostiocache' else '' ];
+        else:
+            asValues = [ '' ] * len(asKeys);
+
+        fRc = True;
+        for sKey, sValue in zip(asKeys, asValues):
+            fRc = fRc and oSession.setExtraData(self.ksVirtioScsiLun + sKey, sValue);
+        return fRc;
+
     def fnFormatCpuString(self, cCpus):
         """
         Formats the CPU count to be readable.
@@ -947,13 +982,16 @@ class tdStorageBenchmark(vbox.TestDriver):
             oSession = self.openSession(oVM);
             if oSession is not None:
                 # Attach HD
-                fRc = oSession.ensureControllerAttached(_ControllerTypeToName(eStorageController));
-                fRc = fRc and oSession.setStorageControllerType(eStorageController, _ControllerTypeToName(eStorageController));
+                fVirtioScsi = eStorageController == self.ksStorageCtrlVirtioScsi;
+                if not fVirtioScsi:
+                    fRc = oSession.ensureControllerAttached(_ControllerTypeToName(eStorageController));
+                    fRc = fRc and oSession.setStorageControllerType(eStorageController, \
+                                                                    _ControllerTypeToName(eStorageController));
 
-                if sHostIoCache == 'hostiocache':
-                    fRc = fRc and oSession.setStorageControllerHostIoCache(_ControllerTypeToName(eStorageController), True);
-                elif sHostIoCache == 'no-hostiocache':
-                    fRc = fRc and oSession.setStorageControllerHostIoCache(_ControllerTypeToName(eStorageController), False);
+                    if sHostIoCache == 'hostiocache':
+                        fRc = fRc and oSession.setStorageControllerHostIoCache(_ControllerTypeToName(eStorageController), True);
+                    elif sHostIoCache == 'no-hostiocache':
+                        fRc = fRc and oSession.setStorageControllerHostIoCache(_ControllerTypeToName(eStorageController), False);
 
                 iDevice = 0;
                 if eStorageController == vboxcon.StorageControllerType_PIIX3 or \
@@ -964,7 +1002,12 @@ class tdStorageBenchmark(vbox.TestDriver):
                 if iDiffLvl > 0:
                     oHdParent = lstDisks[0];
                 oHd = self.createHd(oSession, sDiskFormat, sDiskVariant, iDiffLvl, oHdParent, sDiskPath, cbDisk);
-                if oHd is not None:
+                if oHd is not None and fVirtioScsi:
+                    lstDisks.insert(0, oHd);
+                    fRc = fRc and self.setupVirtioScsiDisk(oSession, oHd, sHostIoCache);
+                    if fRc:
+                        reporter.log('attached "%s" to virtio-scsi of %s' % (oHd.location, oSession.sName));
+                elif oHd is not None:
                     lstDisks.insert(0, oHd);
                     try:
                         if oSession.fpApiVer >= 4.0:
@@ -1023,11 +1066,15 @@ class tdStorageBenchmark(vbox.TestDriver):
                 oSession = self.openSession(oVM);
                 if oSession is not None:
                     try:
-                        oSession.o.machine.detachDevice(_ControllerTypeToName(eStorageController), 0, iDevice);
+                        if eStorageController == self.ksStorageCtrlVirtioScsi:
+                            self.setupVirtioScsiDisk(oSession, None, sHostIoCache);
+                        else:
+                            oSession.o.machine.detachDevice(_ControllerTypeToName(eStorageController), 0, iDevice);
 
                         # Remove storage controller if it is not an IDE controller.
                         if     eStorageController is not vboxcon.StorageControllerType_PIIX3 \
-                           and eStorageController is not vboxcon.StorageControllerType_PIIX4:
+                           and eStorageController is not vboxcon.StorageControllerType_PIIX4 \
+                           and eStorageController != self.ksStorageCtrlVirtioScsi:
                             oSession.o.machine.removeStorageController(_ControllerTypeToName(eStorageController));
 
                         oSession.saveSettings();